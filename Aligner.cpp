@@ -0,0 +1,218 @@
+//	Metal - A fast methylation alignment and calling tool for WGBS data.
+//	Copyright (C) 2017  Jonas Fischer
+//
+//	This program is free software: you can redistribute it and/or modify
+//	it under the terms of the GNU General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+//
+//	This program is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//	GNU General Public License for more details.
+//
+//	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Jonas Fischer	jonaspost@web.de
+
+#include <iostream>
+#include <algorithm>
+
+#include "CONST.h"
+#include "RefGenome.h"
+#include "ReadQueue.h"
+#include "ReadSource.h"
+#include "Aligner.h"
+
+
+namespace
+{
+    // applies the options to the process wide settings, before the engine sizes its thread state
+    void applyOptions(const Aligner::Options& opts)
+    {
+        MyConst::coreNum = opts.threads;
+        if (opts.errors > 0)
+            MyConst::errBudget = opts.errors;
+        MyConst::checkRuntimeParams();
+    }
+
+    Aligner::RESULT resultOf(const Read& r)
+    {
+        if (!r.isInvalid)
+            return Aligner::ALIGNED;
+        switch (r.reason)
+        {
+            case UNMAPPED::NONUNIQUE:
+            case UNMAPPED::OVERBUDGET:
+                return Aligner::NONUNIQUE;
+            case UNMAPPED::LENGTH:
+            case UNMAPPED::NLETTERS:
+                return Aligner::FILTERED;
+            default:
+                return Aligner::UNMATCHED;
+        }
+    }
+}
+
+Aligner::Aligner(const std::string& indexPath, const Options& opts) :
+        ownRef((applyOptions(opts), new RefGenome(indexPath)))
+    ,   ref(*ownRef)
+    ,   rQue(new ReadQueue(ref, opts.paired, opts.bothStrands))
+    ,   input(new MemoryReadSource())
+    ,   options(opts)
+    ,   chrNames(ref.chrMap.size())
+    ,   sampled(opts.bothStrands)
+{
+
+    for (const auto& chr : ref.chrMap)
+    {
+        chrNames[chr.first] = chr.second;
+    }
+    rQue->collectMethDeltas(true);
+    rQue->setSource(input.get());
+}
+
+Aligner::Aligner(RefGenome& reference, const Options& opts) :
+        ref((applyOptions(opts), reference))
+    ,   rQue(new ReadQueue(ref, opts.paired, opts.bothStrands))
+    ,   input(new MemoryReadSource())
+    ,   options(opts)
+    ,   chrNames(ref.chrMap.size())
+    ,   sampled(opts.bothStrands)
+{
+
+    for (const auto& chr : ref.chrMap)
+    {
+        chrNames[chr.first] = chr.second;
+    }
+    rQue->collectMethDeltas(true);
+    rQue->setSource(input.get());
+}
+
+Aligner::~Aligner()
+{
+}
+
+Aligner::Stats Aligner::align(const Seq* reads, const size_t n, const MatchCallback& onMatch, const CpgCallback& onCpgs)
+{
+
+    if (options.paired)
+    {
+        std::cerr << "Aligner for paired reads got single-end reads!\n";
+        return Stats();
+    }
+    Stats stats;
+    alignInput(reads, nullptr, n, onMatch, stats);
+    reportDeltas(onCpgs);
+    return stats;
+}
+
+Aligner::Stats Aligner::alignPairs(const Seq* reads1, const Seq* reads2, const size_t n, const MatchCallback& onMatch, const CpgCallback& onCpgs)
+{
+
+    if (!options.paired)
+    {
+        std::cerr << "Aligner for single-end reads got paired reads!\n";
+        return Stats();
+    }
+    Stats stats;
+    alignInput(reads1, reads2, n, onMatch, stats);
+    reportDeltas(onCpgs);
+    return stats;
+}
+
+void Aligner::alignInput(const Seq* reads, const Seq* reads2, const size_t n, const MatchCallback& onMatch, Stats& stats)
+{
+
+    // the reads are handed to the engine as a MemoryReadSource, parsed into the read buffers like those of a file
+    std::vector<MemoryReadSource::Seq> seqs(n);
+    std::vector<MemoryReadSource::Seq> seqs2(reads2 ? n : 0);
+    for (size_t i = 0; i < n; ++i)
+    {
+        seqs[i] = {reads[i].data, reads[i].len};
+        if (reads2)
+            seqs2[i] = {reads2[i].data, reads2[i].len};
+    }
+    input->reset(seqs.data(), reads2 ? seqs2.data() : nullptr, n);
+    size_t first = 0;
+    bool moreReads = true;
+    while (moreReads)
+    {
+        unsigned int procReads = 0;
+        moreReads = rQue->parseChunk(procReads);
+        if (procReads == 0)
+            break;
+        alignChunk(reads2 != nullptr, first, procReads, onMatch, stats);
+        first += procReads;
+    }
+    input->reset(nullptr, nullptr, 0);
+}
+
+void Aligner::alignChunk(const bool paired, const size_t first, const unsigned int procReads, const MatchCallback& onMatch, Stats& stats)
+{
+
+    ReadBatch& batch = rQue->getReads();
+    ReadBatch& batch2 = rQue->getReads2();
+    // the conversion of the reads is decided on the first batch, as in queryRoutine
+    if (!sampled)
+    {
+        rQue->sampleStrand(procReads);
+        sampled = true;
+    }
+    if (paired)
+        rQue->matchPairedReads(procReads, stats.aligned, stats.nonUnique, stats.unmatched, stats.pairs, stats.tooShort, false);
+    else
+        rQue->matchReads(procReads, stats.aligned, stats.nonUnique, stats.unmatched, false);
+
+    if (!onMatch)
+        return;
+    Match m;
+    for (unsigned int i = 0; i < procReads; ++i)
+    {
+        for (unsigned int mate = 0; mate < (paired ? 2u : 1u); ++mate)
+        {
+            const Read& r = mate == 0 ? batch[i] : batch2[i];
+            m.read = first + i;
+            m.mate = mate;
+            m.result = resultOf(r);
+            m.chrom = nullptr;
+            m.pos = 0;
+            m.errors = 0;
+            m.reverse = false;
+            m.convGA = false;
+            if (m.result == ALIGNED)
+            {
+                // see ReadQueue::placeRead
+                const bool isFwd = MATCH::isFwd(r.mat);
+                m.chrom = &chrNames[ref.metaWindows[MATCH::getMetaID(r.mat)].chrom];
+                m.pos = rQue->getMatchPos(r.mat);
+                m.errors = MATCH::getErrNum(r.mat);
+                m.reverse = MATCH::isRevComp(r.mat) == isFwd;
+                m.convGA = !isFwd;
+            }
+            onMatch(m);
+        }
+    }
+}
+
+void Aligner::reportDeltas(const CpgCallback& onCpgs)
+{
+
+    std::vector<ReadQueue::MethDelta> deltas;
+    rQue->takeMethDeltas(deltas);
+    if (!onCpgs)
+        return;
+    std::vector<CpgDelta> out(deltas.size());
+    for (size_t i = 0; i < deltas.size(); ++i)
+    {
+        const struct CpG& cpg = ref.cpgTable[deltas[i].cpgId];
+        out[i].chrom = &chrNames[cpg.chrom];
+        out[i].pos = cpg.pos + MyConst::READLEN - 2 + ref.chrOffsets[cpg.chrom];
+        out[i].methFwd = deltas[i].methFwd;
+        out[i].unmethFwd = deltas[i].unmethFwd;
+        out[i].methRev = deltas[i].methRev;
+        out[i].unmethRev = deltas[i].unmethRev;
+    }
+    onCpgs(out.data(), out.size());
+}
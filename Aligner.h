@@ -0,0 +1,162 @@
+//	Metal - A fast methylation alignment and calling tool for WGBS data.
+//	Copyright (C) 2017  Jonas Fischer
+//
+//	This program is free software: you can redistribute it and/or modify
+//	it under the terms of the GNU General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+//
+//	This program is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//	GNU General Public License for more details.
+//
+//	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Jonas Fischer	jonaspost@web.de
+
+#ifndef ALIGNER_H
+#define ALIGNER_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+
+
+class RefGenome;
+class ReadQueue;
+class MemoryReadSource;
+
+// Alignment of read batches held in memory, for programs that link FAME as a library (libfame.a, see make lib)
+// instead of running it on FASTQ files and parsing its output.
+// The reads of a batch are passed as pointer/length pairs and matched by the same engine as the FAME binary
+// (ReadQueue::matchReads resp. matchPairedReads, one OpenMP team of threads per call). The result of every read
+// and the methylation counts the batch adds to the CpGs it covers are handed to callbacks on the calling thread
+// before align(...) returns; nothing is written to files.
+// The index and the engine state stay allocated between the calls. The settings of Options are process wide
+// (see MyConst), hence all Aligners of a process must use the same ones, and an Aligner must not be used by
+// two threads at once.
+class Aligner
+{
+
+    public:
+
+        struct Options
+        {
+            // number of threads matching a batch
+            unsigned int threads = 32;
+            // number of errors allowed in the alignment of a read, one of MyConst::ERRBUDGETS (0 for the default)
+            unsigned int errors = 0;
+            // true iff the reads are paired (see alignPairs)
+            bool paired = false;
+            // true iff the reads have no known conversion (see --unord_reads), otherwise it is decided on the
+            // first batch
+            bool bothStrands = false;
+        };
+
+        // a read sequence owned by the caller, only read during the call it is passed to
+        struct Seq
+        {
+            const char* data;
+            size_t len;
+        };
+
+        enum RESULT : uint8_t {
+            ALIGNED = 0,    // unique match
+            UNMATCHED,      // no match within the error budget
+            NONUNIQUE,      // several equally good matches
+            FILTERED        // too short or too long, or too many Ns
+        };
+
+        // result of one read
+        struct Match
+        {
+            // index of the read (pair) in the batch
+            size_t read;
+            // 0 for single-end reads and read 1 of a pair, 1 for read 2
+            unsigned int mate;
+            RESULT result;
+            // the following are only set for ALIGNED reads
+            // chromosome as named in the reference, valid as long as the Aligner
+            const std::string* chrom;
+            // 0 based position of the last reference letter aligned to the read, on the forward strand
+            uint64_t pos;
+            unsigned int errors;
+            // true iff the read lies on the reverse strand
+            bool reverse;
+            // true iff the read was matched as G->A converted
+            bool convGA;
+        };
+
+        // counts a batch adds to one CpG
+        struct CpgDelta
+        {
+            // chromosome as named in the reference, valid as long as the Aligner
+            const std::string* chrom;
+            // position of the C of the CpG as in the methylation report of FAME
+            uint64_t pos;
+            uint32_t methFwd;
+            uint32_t unmethFwd;
+            uint32_t methRev;
+            uint32_t unmethRev;
+        };
+
+        // counts of a batch as in the summary of FAME, reads of pairs are counted one by one
+        struct Stats
+        {
+            uint64_t aligned = 0;
+            uint64_t nonUnique = 0;
+            uint64_t unmatched = 0;
+            // pairs with both reads aligned
+            uint64_t pairs = 0;
+            uint64_t tooShort = 0;
+        };
+
+        // called once per read (of a pair) in the order of the batch
+        typedef std::function<void(const Match&)> MatchCallback;
+        // called once per batch with the deltas of all covered CpGs, ordered by their index; the array is valid
+        // during the call only
+        typedef std::function<void(const CpgDelta*, size_t)> CpgCallback;
+
+        // maps the index stored at indexPath, terminates if it cannot be loaded
+        Aligner(const std::string& indexPath, const Options& opts);
+        // uses an index loaded by the caller, which must outlive the Aligner
+        Aligner(RefGenome& ref, const Options& opts);
+        ~Aligner();
+
+        Aligner(const Aligner&) = delete;
+        Aligner& operator=(const Aligner&) = delete;
+
+        // aligns the n single-end reads, each callback may be empty
+        Stats align(const Seq* reads, const size_t n, const MatchCallback& onMatch, const CpgCallback& onCpgs);
+        // aligns the n pairs (reads1[i], reads2[i]), each callback may be empty
+        Stats alignPairs(const Seq* reads1, const Seq* reads2, const size_t n, const MatchCallback& onMatch, const CpgCallback& onCpgs);
+
+        inline RefGenome& reference() { return ref; }
+
+    private:
+
+        // matches the n reads (pairs) of reads (and reads2) chunk by chunk, the engine takes them from input
+        void alignInput(const Seq* reads, const Seq* reads2, const size_t n, const MatchCallback& onMatch, Stats& stats);
+        // matches the procReads reads parsed into the engine, the first one is read first of the batch
+        void alignChunk(const bool paired, const size_t first, const unsigned int procReads, const MatchCallback& onMatch, Stats& stats);
+        // reports the deltas collected since the last call to onCpgs
+        void reportDeltas(const CpgCallback& onCpgs);
+
+        std::unique_ptr<RefGenome> ownRef;
+        RefGenome& ref;
+        std::unique_ptr<ReadQueue> rQue;
+        // the reads of the batch being aligned, the source of rQue
+        std::unique_ptr<MemoryReadSource> input;
+        Options options;
+        // names of the chromosomes by their internal id
+        std::vector<std::string> chrNames;
+        // false until the conversion of the reads is decided
+        bool sampled;
+};
+
+#endif /* ALIGNER_H */
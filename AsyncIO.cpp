@@ -0,0 +1,589 @@
+//	Metal - A fast methylation alignment and calling tool for WGBS data.
+//	Copyright (C) 2017  Jonas Fischer
+//
+//	This program is free software: you can redistribute it and/or modify
+//	it under the terms of the GNU General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+//
+//	This program is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//	GNU General Public License for more details.
+//
+//	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Jonas Fischer	jonaspost@web.de
+
+#include "AsyncIO.h"
+
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#ifdef FAME_IOURING
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#endif
+
+#include "CONST.h"
+
+
+namespace
+{
+    // reads until n bytes arrived or the input ended
+    size_t readFull(const int fd, char* dst, const size_t n)
+    {
+        size_t got = 0;
+        while (got < n)
+        {
+            const ssize_t r = ::read(fd, dst + got, n - got);
+            if (r < 0 && errno == EINTR)
+                continue;
+            if (r <= 0)
+                break;
+            got += r;
+        }
+        return got;
+    }
+
+    bool writeFull(const int fd, const char* src, const size_t n)
+    {
+        size_t done = 0;
+        while (done < n)
+        {
+            const ssize_t w = ::write(fd, src + done, n - done);
+            if (w < 0 && errno == EINTR)
+                continue;
+            if (w <= 0)
+                return false;
+            done += w;
+        }
+        return true;
+    }
+}
+
+
+IoRing::IoRing() :
+        ringFd(-1)
+    ,   toSubmit(0)
+    ,   sqMap(nullptr)
+    ,   sqMapLen(0)
+    ,   cqMap(nullptr)
+    ,   cqMapLen(0)
+    ,   sqeMap(nullptr)
+    ,   sqeMapLen(0)
+{
+}
+
+IoRing::~IoRing()
+{
+#ifdef FAME_IOURING
+    if (sqeMap != nullptr)
+        munmap(sqeMap, sqeMapLen);
+    if (cqMap != nullptr && cqMap != sqMap)
+        munmap(cqMap, cqMapLen);
+    if (sqMap != nullptr)
+        munmap(sqMap, sqMapLen);
+    if (ringFd >= 0)
+        ::close(ringFd);
+#endif
+}
+
+bool IoRing::init(const unsigned int depth)
+{
+#ifdef FAME_IOURING
+
+    io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    const int rfd = syscall(__NR_io_uring_setup, depth, &p);
+    if (rfd < 0)
+        return false;
+    // plain reads and writes at offsets (IORING_OP_READ/WRITE) came together with this feature in Linux 5.6
+    if (!(p.features & IORING_FEAT_RW_CUR_POS))
+    {
+        ::close(rfd);
+        return false;
+    }
+    sqMapLen = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+    cqMapLen = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    const bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+    if (single)
+        sqMapLen = cqMapLen = std::max(sqMapLen, cqMapLen);
+    sqeMapLen = p.sq_entries * sizeof(io_uring_sqe);
+
+    void* sq = mmap(nullptr, sqMapLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, rfd, IORING_OFF_SQ_RING);
+    void* cq = single ? sq : mmap(nullptr, cqMapLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, rfd, IORING_OFF_CQ_RING);
+    void* sqe = mmap(nullptr, sqeMapLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, rfd, IORING_OFF_SQES);
+    if (sq == MAP_FAILED || cq == MAP_FAILED || sqe == MAP_FAILED)
+    {
+        if (sqe != MAP_FAILED)
+            munmap(sqe, sqeMapLen);
+        if (cq != MAP_FAILED && cq != sq)
+            munmap(cq, cqMapLen);
+        if (sq != MAP_FAILED)
+            munmap(sq, sqMapLen);
+        ::close(rfd);
+        return false;
+    }
+    sqMap = sq;
+    cqMap = cq;
+    sqeMap = sqe;
+
+    char* sqBytes = static_cast<char*>(sq);
+    char* cqBytes = static_cast<char*>(cq);
+    sqTail = reinterpret_cast<unsigned int*>(sqBytes + p.sq_off.tail);
+    sqMask = reinterpret_cast<unsigned int*>(sqBytes + p.sq_off.ring_mask);
+    sqArray = reinterpret_cast<unsigned int*>(sqBytes + p.sq_off.array);
+    cqHead = reinterpret_cast<unsigned int*>(cqBytes + p.cq_off.head);
+    cqTail = reinterpret_cast<unsigned int*>(cqBytes + p.cq_off.tail);
+    cqMask = reinterpret_cast<unsigned int*>(cqBytes + p.cq_off.ring_mask);
+    sqes = sqe;
+    cqes = cqBytes + p.cq_off.cqes;
+    ringFd = rfd;
+    return true;
+
+#else
+
+    (void)depth;
+    return false;
+
+#endif
+}
+
+void IoRing::queueRead(const int fd, char* buf, const uint32_t n, const uint64_t off, const uint64_t tag)
+{
+#ifdef FAME_IOURING
+    queue(IORING_OP_READ, fd, buf, n, off, tag);
+#endif
+}
+
+void IoRing::queueWrite(const int fd, const char* buf, const uint32_t n, const uint64_t off, const uint64_t tag)
+{
+#ifdef FAME_IOURING
+    queue(IORING_OP_WRITE, fd, buf, n, off, tag);
+#endif
+}
+
+void IoRing::queue(const uint8_t op, const int fd, const char* buf, const uint32_t n, const uint64_t off, const uint64_t tag)
+{
+#ifdef FAME_IOURING
+    const unsigned int tail = *sqTail;
+    const unsigned int idx = tail & *sqMask;
+    io_uring_sqe* sqe = static_cast<io_uring_sqe*>(sqes) + idx;
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = op;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(buf);
+    sqe->len = n;
+    sqe->off = off;
+    sqe->user_data = tag;
+    sqArray[idx] = idx;
+    // the kernel must see the entry before the new tail
+    __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+    ++toSubmit;
+#else
+    (void)op; (void)fd; (void)buf; (void)n; (void)off; (void)tag;
+#endif
+}
+
+void IoRing::submit()
+{
+#ifdef FAME_IOURING
+    while (toSubmit > 0)
+    {
+        const int r = syscall(__NR_io_uring_enter, ringFd, toSubmit, 0, 0, nullptr, 0);
+        if (r < 0)
+        {
+            // the requests stay queued, wait retries them
+            if (errno == EINTR)
+                continue;
+            return;
+        }
+        toSubmit -= r;
+    }
+#endif
+}
+
+bool IoRing::wait(uint64_t& tag, int& res)
+{
+#ifdef FAME_IOURING
+    while (true)
+    {
+        const unsigned int head = *cqHead;
+        if (head != __atomic_load_n(cqTail, __ATOMIC_ACQUIRE))
+        {
+            const io_uring_cqe* cqe = static_cast<io_uring_cqe*>(cqes) + (head & *cqMask);
+            tag = cqe->user_data;
+            res = cqe->res;
+            __atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+            return true;
+        }
+        const int r = syscall(__NR_io_uring_enter, ringFd, toSubmit, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+        if (r < 0)
+        {
+            if (errno == EINTR || errno == EAGAIN || errno == EBUSY)
+                continue;
+            return false;
+        }
+        toSubmit -= r;
+    }
+#else
+    (void)tag; (void)res;
+    return false;
+#endif
+}
+
+
+
+AsyncReader::AsyncReader() :
+        fd(-1)
+    ,   ownFd(false)
+    ,   fileSize(0)
+    ,   nextOff(0)
+    ,   endOff(0)
+    ,   readFailed(false)
+    ,   headIdx(0)
+{
+}
+
+AsyncReader::~AsyncReader()
+{
+    close();
+}
+
+bool AsyncReader::open(const std::string& filePath)
+{
+    close();
+    if (filePath == "-")
+    {
+        fd = STDIN_FILENO;
+        ownFd = false;
+
+    } else {
+
+        fd = ::open(filePath.c_str(), O_RDONLY);
+        ownFd = true;
+        if (fd < 0)
+            return false;
+    }
+    readFailed = false;
+    nextOff = 0;
+    headIdx = 0;
+
+    // only regular files can be read at offsets, pipes are read one block after another
+    struct stat st;
+    const bool regular = fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+    fileSize = regular ? st.st_size : 0;
+    endOff = fileSize;
+    const bool async = regular && MyConst::ioDepth > 1 && (ring.active() || ring.init(MyConst::ioDepth));
+
+    blocks.resize(async ? MyConst::ioDepth : 1);
+    for (Block& b : blocks)
+    {
+        b.data.resize(MyConst::IOBLOCK);
+        b.state = IDLE;
+        b.off = b.len = b.got = b.pos = 0;
+    }
+    if (async)
+    {
+        for (Block& b : blocks)
+            issue(b);
+        ring.submit();
+    }
+    return true;
+}
+
+void AsyncReader::close()
+{
+    if (fd < 0)
+        return;
+    // the kernel must not write to the buffers anymore
+    for (Block& b : blocks)
+    {
+        while (b.state == PENDING && !readFailed)
+            complete();
+    }
+    if (ownFd)
+        ::close(fd);
+    fd = -1;
+    blocks.clear();
+}
+
+void AsyncReader::issue(Block& b)
+{
+    b.got = b.pos = 0;
+    if (nextOff >= fileSize)
+    {
+        b.state = IDLE;
+        b.len = 0;
+        return;
+    }
+    b.off = nextOff;
+    b.len = std::min<uint64_t>(MyConst::IOBLOCK, fileSize - nextOff);
+    nextOff += b.len;
+    b.state = PENDING;
+    ring.queueRead(fd, b.data.data(), b.len, b.off, &b - blocks.data());
+}
+
+void AsyncReader::complete()
+{
+    uint64_t tag;
+    int res;
+    if (!ring.wait(tag, res))
+    {
+        // without completions nothing in flight arrives anymore
+        readFailed = true;
+        for (Block& b : blocks)
+        {
+            if (b.state == PENDING)
+            {
+                b.state = READY;
+                endOff = std::min(endOff, b.off + b.got);
+            }
+        }
+        return;
+    }
+    Block& b = blocks[tag];
+    if (res == -EINTR || res == -EAGAIN)
+    {
+        res = 0;
+
+    } else if (res <= 0) {
+
+        // a failed read or a file truncated while reading ends the input here
+        readFailed = true;
+        endOff = std::min(endOff, b.off + b.got);
+        res = 0;
+        b.len = b.got;
+    }
+    b.got += res;
+    if (b.got < b.len)
+    {
+        // short read, request the rest
+        ring.queueRead(fd, b.data.data() + b.got, b.len - b.got, b.off + b.got, tag);
+        ring.submit();
+    } else {
+        b.state = READY;
+    }
+}
+
+bool AsyncReader::fetch()
+{
+    if (fd < 0)
+        return false;
+    if (!ring.active() || blocks.size() == 1)
+    {
+        Block& b = blocks[0];
+        if (b.pos < b.got)
+            return true;
+        b.got = readFull(fd, b.data.data(), b.data.size());
+        b.pos = 0;
+        return b.got > 0;
+    }
+    Block* h = &blocks[headIdx];
+    if (h->state == READY && h->pos == h->got)
+    {
+        // taken completely, the block requests the first bytes not yet requested
+        issue(*h);
+        ring.submit();
+        headIdx = (headIdx + 1) % blocks.size();
+        h = &blocks[headIdx];
+    }
+    while (h->state == PENDING)
+        complete();
+    // behind a failed block no bytes follow
+    return h->state == READY && h->pos < h->got && h->off < endOff;
+}
+
+size_t AsyncReader::read(char* dst, const size_t n)
+{
+    size_t done = 0;
+    while (done < n && fetch())
+    {
+        Block& h = blocks[ring.active() && blocks.size() > 1 ? headIdx : 0];
+        const size_t k = std::min(n - done, h.got - h.pos);
+        memcpy(dst + done, h.data.data() + h.pos, k);
+        h.pos += k;
+        done += k;
+    }
+    return done;
+}
+
+bool AsyncReader::atEnd()
+{
+    return !fetch();
+}
+
+bool AsyncReader::seek(const uint64_t off)
+{
+    if (fd < 0)
+        return false;
+    if (!ring.active() || blocks.size() == 1)
+    {
+        if (lseek(fd, off, SEEK_SET) < 0)
+            return false;
+        blocks[0].got = blocks[0].pos = 0;
+        return true;
+    }
+    for (Block& b : blocks)
+    {
+        while (b.state == PENDING && !readFailed)
+            complete();
+    }
+    nextOff = off;
+    endOff = fileSize;
+    headIdx = 0;
+    for (Block& b : blocks)
+        issue(b);
+    ring.submit();
+    return true;
+}
+
+uint64_t AsyncReader::discard()
+{
+    uint64_t n = 0;
+    while (fetch())
+    {
+        Block& h = blocks[ring.active() && blocks.size() > 1 ? headIdx : 0];
+        n += h.got - h.pos;
+        h.pos = h.got;
+    }
+    return n;
+}
+
+
+
+AsyncWriter::AsyncWriter() :
+        fd(-1)
+    ,   fileOff(0)
+    ,   writeFailed(false)
+    ,   curIdx(0)
+    ,   pendingNum(0)
+{
+}
+
+AsyncWriter::~AsyncWriter()
+{
+    close();
+}
+
+bool AsyncWriter::open(const std::string& filePath)
+{
+    close();
+    fd = ::open(filePath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return false;
+    fileOff = 0;
+    writeFailed = false;
+    curIdx = 0;
+    pendingNum = 0;
+
+    // /dev/stdout, pipes and the like are written one block after another
+    struct stat st;
+    const bool regular = fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+    const bool async = regular && MyConst::ioDepth > 1 && (ring.active() || ring.init(MyConst::ioDepth));
+
+    blocks.resize(async ? MyConst::ioDepth : 1);
+    for (Block& b : blocks)
+    {
+        b.data.resize(MyConst::IOBLOCK);
+        b.pending = false;
+        b.off = b.len = b.done = 0;
+    }
+    return true;
+}
+
+bool AsyncWriter::close()
+{
+    if (fd < 0)
+        return true;
+    if (blocks[curIdx].len > 0)
+        submit();
+    while (pendingNum > 0)
+        complete();
+    if (::close(fd) != 0)
+        writeFailed = true;
+    fd = -1;
+    blocks.clear();
+    return !writeFailed;
+}
+
+void AsyncWriter::write(const char* data, size_t n)
+{
+    while (n > 0)
+    {
+        Block& c = blocks[curIdx];
+        // the block is reused only once its last write finished
+        while (c.pending)
+            complete();
+        const size_t k = std::min(n, c.data.size() - c.len);
+        memcpy(c.data.data() + c.len, data, k);
+        c.len += k;
+        data += k;
+        n -= k;
+        if (c.len == c.data.size())
+            submit();
+    }
+}
+
+void AsyncWriter::submit()
+{
+    Block& c = blocks[curIdx];
+    if (!ring.active() || blocks.size() == 1)
+    {
+        if (!writeFailed && !writeFull(fd, c.data.data(), c.len))
+            writeFailed = true;
+        c.len = 0;
+        return;
+    }
+    c.off = fileOff;
+    c.done = 0;
+    fileOff += c.len;
+    c.pending = true;
+    ++pendingNum;
+    ring.queueWrite(fd, c.data.data(), c.len, c.off, curIdx);
+    ring.submit();
+    curIdx = (curIdx + 1) % blocks.size();
+}
+
+void AsyncWriter::complete()
+{
+    uint64_t tag;
+    int res;
+    if (!ring.wait(tag, res))
+    {
+        writeFailed = true;
+        for (Block& b : blocks)
+        {
+            b.pending = false;
+            b.len = 0;
+        }
+        pendingNum = 0;
+        return;
+    }
+    Block& b = blocks[tag];
+    if (res == -EINTR || res == -EAGAIN)
+        res = 0;
+    else if (res <= 0)
+    {
+        writeFailed = true;
+        res = b.len - b.done;
+    }
+    b.done += res;
+    if (b.done < b.len)
+    {
+        // short write, hand in the rest
+        ring.queueWrite(fd, b.data.data() + b.done, b.len - b.done, b.off + b.done, tag);
+        ring.submit();
+    } else {
+        b.pending = false;
+        b.len = 0;
+        --pendingNum;
+    }
+}
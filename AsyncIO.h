@@ -0,0 +1,227 @@
+//	Metal - A fast methylation alignment and calling tool for WGBS data.
+//	Copyright (C) 2017  Jonas Fischer
+//
+//	This program is free software: you can redistribute it and/or modify
+//	it under the terms of the GNU General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+//
+//	This program is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//	GNU General Public License for more details.
+//
+//	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Jonas Fischer	jonaspost@web.de
+
+#ifndef ASYNCIO_H
+#define ASYNCIO_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define FAME_IOURING
+#endif
+#endif
+
+
+// Sequential file input and output with several requests of MyConst::IOBLOCK bytes in flight
+// On Linux the requests go through an io_uring, such that the latency of the requests (e.g. on a network file
+// system) overlaps instead of adding up. Pipes, systems without io_uring, kernels refusing it (old versions,
+// seccomp filters) and MyConst::ioDepth == 0 fall back to blocking read and write calls on the same buffers.
+
+
+// submission and completion queue of one io_uring, used by one thread at a time
+class IoRing
+{
+
+    public:
+
+        IoRing();
+        ~IoRing();
+
+        IoRing(const IoRing&) = delete;
+        IoRing& operator=(const IoRing&) = delete;
+
+        // sets up a ring for depth requests in flight
+        // RETURN:  false iff io_uring is not available, the ring stays inactive then
+        bool init(const unsigned int depth);
+
+        inline bool active() const { return ringFd >= 0; }
+
+        // queues a read to (write from) buf of n bytes at offset off of fd, tag identifies its completion
+        // at most depth requests may be queued or in flight
+        void queueRead(const int fd, char* buf, const uint32_t n, const uint64_t off, const uint64_t tag);
+        void queueWrite(const int fd, const char* buf, const uint32_t n, const uint64_t off, const uint64_t tag);
+
+        // hands the queued requests to the kernel without waiting
+        void submit();
+
+        // submits the queued requests and waits for the next completion
+        // ARGUMENTS:
+        //          tag     tag of the completed request
+        //          res     bytes transferred, or -errno
+        // RETURN:  false iff the ring failed, no completion is returned then
+        bool wait(uint64_t& tag, int& res);
+
+    private:
+
+        void queue(const uint8_t op, const int fd, const char* buf, const uint32_t n, const uint64_t off, const uint64_t tag);
+
+        int ringFd;
+        // requests queued but not yet handed to the kernel
+        unsigned int toSubmit;
+
+        void* sqMap;
+        size_t sqMapLen;
+        void* cqMap;
+        size_t cqMapLen;
+        void* sqeMap;
+        size_t sqeMapLen;
+
+        unsigned int* sqTail;
+        unsigned int* sqMask;
+        unsigned int* sqArray;
+        unsigned int* cqHead;
+        unsigned int* cqTail;
+        unsigned int* cqMask;
+        // struct io_uring_sqe* and struct io_uring_cqe*, kept opaque to spare the includes
+        void* sqes;
+        void* cqes;
+};
+
+
+// Reads a file front to back, with the next MyConst::ioDepth blocks requested ahead of the caller
+class AsyncReader
+{
+
+    public:
+
+        AsyncReader();
+        ~AsyncReader();
+
+        AsyncReader(const AsyncReader&) = delete;
+        AsyncReader& operator=(const AsyncReader&) = delete;
+
+        // opens file filePath ("-" for stdin) and requests its first blocks
+        // RETURN:  true iff file could be opened
+        bool open(const std::string& filePath);
+        void close();
+
+        inline bool isOpen() const { return fd >= 0; }
+
+        // reads up to n bytes to dst, blocks until they arrived
+        // RETURN:  number of bytes read, less than n iff the end of the file was reached
+        size_t read(char* dst, const size_t n);
+
+        // true iff all bytes of the file have been read
+        bool atEnd();
+
+        // continues reading at offset off of the file, all requested blocks are dropped
+        // RETURN:  false iff the input is no regular file (a pipe cannot seek)
+        bool seek(const uint64_t off);
+
+        // reads the rest of the file without copying it anywhere, which pulls the file into the page cache
+        // RETURN:  number of bytes read
+        uint64_t discard();
+
+        // true iff a read failed, the input ends at the failed request
+        inline bool failed() const { return readFailed; }
+
+    private:
+
+        enum STATE : uint8_t { IDLE, PENDING, READY };
+        struct Block
+        {
+            std::vector<char> data;
+            STATE state;
+            // offset in the file, bytes requested, bytes arrived and bytes taken by the caller
+            uint64_t off;
+            size_t len;
+            size_t got;
+            size_t pos;
+        };
+
+        // requests the next block of the file into b, if there is one
+        void issue(Block& b);
+        // waits for one completion and books it
+        void complete();
+        // makes the block at headIdx hold bytes not yet taken, moving on once it is taken completely
+        // RETURN:  false iff the file is read completely
+        bool fetch();
+
+        int fd;
+        bool ownFd;
+        uint64_t fileSize;
+        // offset of the next block to request
+        uint64_t nextOff;
+        // the input ends before this offset, earlier than fileSize after a failed read
+        uint64_t endOff;
+        bool readFailed;
+
+        IoRing ring;
+        // blocks in the order of their offsets, starting at headIdx
+        std::vector<Block> blocks;
+        size_t headIdx;
+};
+
+
+// Writes a file front to back, with up to MyConst::ioDepth blocks in flight while the caller fills the next one
+class AsyncWriter
+{
+
+    public:
+
+        AsyncWriter();
+        ~AsyncWriter();
+
+        AsyncWriter(const AsyncWriter&) = delete;
+        AsyncWriter& operator=(const AsyncWriter&) = delete;
+
+        // opens file filePath for writing, truncating it
+        // RETURN:  true iff file could be opened
+        bool open(const std::string& filePath);
+
+        // writes all pending blocks and closes the file
+        // RETURN:  false iff a write failed
+        bool close();
+
+        inline bool isOpen() const { return fd >= 0; }
+
+        void write(const char* data, size_t n);
+
+    private:
+
+        struct Block
+        {
+            std::vector<char> data;
+            bool pending;
+            uint64_t off;
+            size_t len;
+            size_t done;
+        };
+
+        // hands the filled block at curIdx to the kernel (or writes it if there is no ring)
+        void submit();
+        // waits for one completion and books it
+        void complete();
+
+        int fd;
+        uint64_t fileOff;
+        bool writeFailed;
+
+        IoRing ring;
+        std::vector<Block> blocks;
+        // block filled by write
+        size_t curIdx;
+        // number of blocks in flight
+        size_t pendingNum;
+};
+
+#endif /* ASYNCIO_H */
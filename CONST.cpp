@@ -21,6 +21,42 @@
 #include "CONST.h"
 
 
+unsigned int MyConst::coreNum = MyConst::DEFAULTCORENUM;
+unsigned int MyConst::chunkSize = MyConst::CHUNKSIZE;
+unsigned int MyConst::pipelineDepth = 0;
+unsigned int MyConst::outputThreads = 2;
+unsigned int MyConst::ioDepth = 8;
+unsigned int MyConst::errBudget = MyConst::MISCOUNT + MyConst::ADDMIS;
+bool MyConst::maskN = false;
+unsigned int MyConst::trimQual = 0;
+bool MyConst::trimAdapter = false;
+bool MyConst::adaptiveErrors = false;
+bool MyConst::batchVerify = false;
+bool MyConst::offload = false;
+bool MyConst::readCache = false;
+bool MyConst::jointStrands = false;
+bool MyConst::mateRescue = false;
+bool MyConst::fusedPairs = false;
+bool MyConst::tieredErrors = false;
+unsigned int MyConst::interleave = 1;
+bool MyConst::substitutionCalls = false;
+unsigned int MyConst::candidateBudget = 0;
+unsigned int MyConst::qThresh = MyConst::QTHRESH;
+unsigned int MyConst::kmerDist = MyConst::KMERDIST;
+bool MyConst::hugePages = false;
+bool MyConst::numa = false;
+bool MyConst::windowRecords = false;
+unsigned int MyConst::hotBuckets = 0;
+unsigned int MyConst::kmerCutoff = 0;
+bool MyConst::verifyIndex = false;
+bool MyConst::warmIndex = false;
+unsigned int MyConst::indexMem = 0;
+unsigned int MyConst::shardIdx = 0;
+unsigned int MyConst::shardNum = 1;
+MyConst::SCHEDULE MyConst::schedule = MyConst::SCHED_AUTO;
+MyConst::LAYOUT MyConst::threadLayout = MyConst::LAYOUT_OS;
+
+
 void MyConst::sanityChecks()
 {
 
@@ -64,6 +100,62 @@ void MyConst::sanityChecks()
 
     if (MyConst::HTABSIZE < 2 << 16)
     {
-        std::cout << "The chosen size of your hash table (" << MyConst::HTABSIZE << ") is quite small. You should consider redefining HTABSIZE (default is 2^30 for the human genome).\n\n";
+        std::cout << "The chosen maximum size of your hash table (" << MyConst::HTABSIZE << ") is quite small. You should consider redefining HTABSIZE (default is 2^30 for the human genome).\n\n";
+    }
+}
+
+
+void MyConst::checkRuntimeParams()
+{
+
+    if (MyConst::coreNum == 0)
+    {
+        std::cerr << "The number of threads must be at least 1! Terminating...\n\n";
+        exit(1);
+    }
+    if (MyConst::chunkSize == 0)
+    {
+        std::cerr << "The chunk size must be at least 1! Terminating...\n\n";
+        exit(1);
+    }
+    if (MyConst::outputThreads == 0)
+    {
+        std::cerr << "The number of output threads must be at least 1! Terminating...\n\n";
+        exit(1);
+    }
+    bool supported = false;
+    for (const unsigned int e : MyConst::ERRBUDGETS)
+    {
+        supported |= (e == MyConst::errBudget);
+    }
+    if (!supported)
+    {
+        std::cerr << "Unsupported error budget " << MyConst::errBudget << ", supported are";
+        for (const unsigned int e : MyConst::ERRBUDGETS)
+        {
+            std::cerr << " " << e;
+        }
+        std::cerr << "! Terminating...\n\n";
+        exit(1);
+    }
+    if (MyConst::interleave == 0 || MyConst::interleave > MyConst::MAXINTERLEAVE)
+    {
+        std::cerr << "The number of interleaved reads must be between 1 and " << MyConst::MAXINTERLEAVE << "! Terminating...\n\n";
+        exit(1);
+    }
+    if (MyConst::qThresh == 0 || MyConst::qThresh > MyConst::READLEN)
+    {
+        std::cerr << "The q-gram threshold must be between 1 and the read length " << MyConst::READLEN << "! Terminating...\n\n";
+        exit(1);
+    }
+    if (MyConst::trimQual > 93)
+    {
+        std::cerr << "Quality cutoff " << MyConst::trimQual << " is above the highest Phred score 93! Terminating...\n\n";
+        exit(1);
+    }
+    if (MyConst::shardNum == 0 || MyConst::shardIdx >= MyConst::shardNum)
+    {
+        std::cerr << "Invalid shard " << MyConst::shardIdx << " of " << MyConst::shardNum << "! Terminating...\n\n";
+        exit(1);
     }
 }
@@ -33,15 +33,22 @@ namespace MyConst {
 //
 // maximum read length of the reads in bp
 constexpr unsigned int READLEN = 100;
+// number of 64 bit words per layer of the shift-and automata (see ShiftAnd), enough for patterns of READLEN bp
+// plus the initial state, at least 2 (the fast path for reads up to 127 bp)
+constexpr unsigned int SAWORDS = READLEN < 128 ? 2 : (READLEN + 64) / 64;
+// longest read the automata represent, longer reads are discarded
+constexpr unsigned int SAMAXLEN = 64 * SAWORDS - 1;
 
-// Number of cores that this program is allowed to occupy at any given point
-#define CORENUM 32
+// Default number of cores that this program is allowed to occupy at any given point
+// (can be overwritten at runtime, see coreNum)
+constexpr unsigned int DEFAULTCORENUM = 32;
+#define CORENUM (MyConst::coreNum)
 
 // closed interval borders for distances allowed between paired reads
 constexpr uint32_t MINPDIST = 50;
 constexpr uint32_t MAXPDIST = 550;
 
-// number of chromosomes in organism
+// number of chromosomes in organism (memory reservation only, see chromId for the limit)
 constexpr unsigned int CHROMNUM = 24;
 
 //  --------------------------------------
@@ -56,6 +63,10 @@ constexpr unsigned int CHROMNUM = 24;
 // seed used for spaced k-mer hashing
 const std::vector<bool> SEED = {1,1,0,1,1,1,1,0,1,1,1,1,1,1,0,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,0,1};
 constexpr uint32_t SEEDBITS = 0b11011110111111011111111111111101;
+// complementary spaced seeds hashed together by indexes built with --multi_seed, the first one is SEEDBITS
+// (the second one skips other positions, such that a mismatch skipped by one of them still gives a seed hit)
+constexpr unsigned int SEEDNUM = 2;
+constexpr uint32_t SEEDSET[SEEDNUM] = {SEEDBITS, 0b11110111111011111110111110111111};
 
 // (more than) size in bp of biggest chromosome in organism
 constexpr unsigned int CHROMMAX = 1000000000;
@@ -68,6 +79,31 @@ constexpr unsigned int CPGMAX = 100000000;
 // recommended is 300 000
 constexpr unsigned int CHUNKSIZE = 300000;
 
+// bytes per request of the asynchronous file input and output (see AsyncIO.h)
+constexpr size_t IOBLOCK = 1 << 20;
+
+// strand detection (see ReadQueue::sampleStrand): reads of the first batch are aligned to both strands in rounds of
+// STRANDROUND reads until a sequential probability ratio test of "a fraction STRANDP of the unique matches is on the
+// fwd strand" against "... on the rev strand" decides with error rates STRANDERR, after at least STRANDMINMATCH
+// unique matches (such that the odds reported are meaningful)
+constexpr unsigned int STRANDROUND = 4096;
+constexpr double STRANDP = 0.6;
+constexpr double STRANDERR = 1e-4;
+constexpr uint64_t STRANDMINMATCH = 1000;
+
+// default number of bp a targeted index (see readTargets) keeps on both sides of every target region,
+// such that reads overlapping the border of a region are still aligned
+constexpr unsigned int TARGETPAD = 2 * READLEN;
+
+// scheduling of the reads of a batch onto the threads, see MyConst::schedule
+// a batch is considered imbalanced if the threads wait more than SCHEDIMBALANCE (fraction of the
+// slowest thread's time) for the slowest thread
+constexpr double SCHEDIMBALANCE = 0.05;
+// in adaptive mode, static scheduling is retried every SCHEDPROBE batches
+constexpr unsigned int SCHEDPROBE = 16;
+// dynamic scheduling hands out chunks such that each thread gets about SCHEDCHUNKS of them per batch
+constexpr unsigned int SCHEDCHUNKS = 64;
+
 // Length of a kmer in bp
 // WARNING: THIS PARAMETER MUST EQUAL SEED.size() !!!
 constexpr unsigned int KMERLEN = 32;
@@ -75,14 +111,45 @@ constexpr unsigned int KMERLEN = 32;
 // Kmer bitmask
 constexpr uint32_t KMERMASK = (KMERLEN == 32 ? 0xffffffff : ((uint64_t)1 << KMERLEN) - 1);
 
+// seedBits as mask of a k-mer with 2 bits per letter (as in the blacklist of the index)
+constexpr uint64_t seedLetterMask(const uint32_t seedBits)
+{
+    uint64_t mask = 0;
+    for (unsigned int b = 0; b < KMERLEN; ++b)
+    {
+        if ((seedBits >> b) & 1)
+            mask |= 3ULL << (2 * b);
+    }
+    return mask;
+}
+constexpr uint64_t SEEDLETTERMASK = seedLetterMask(SEEDBITS);
+constexpr uint64_t SEEDLETTERMASKS[SEEDNUM] = {SEEDLETTERMASK, seedLetterMask(SEEDSET[1])};
+// letter code 1, which the reduced alphabet of the blacklist does not use, at the last position seedBits skips
+constexpr uint64_t seedTag(const uint32_t seedBits)
+{
+    for (unsigned int b = 0; b < KMERLEN; ++b)
+    {
+        if (!((seedBits >> b) & 1))
+            return 1ULL << (2 * b);
+    }
+    return 0;
+}
+// added to the blacklisted k-mers of the other seeds than the first one, such that they never equal one of another
+// seed (see RefGenome::seedKey)
+constexpr uint64_t SEEDTAGS[SEEDNUM] = {0, seedTag(SEEDSET[1])};
+static_assert(seedTag(SEEDSET[1]) != 0, "all seeds but the first one have to skip a position");
+
 // minimum number of k-mers required to test for match
 // recommended is 5 for read length 100
 constexpr uint16_t QTHRESH = 5;
 
 
-// size of hash table
+// maximum size of hash table, the table is sized to the number of k-mers of the genome
+// (power of two, at least HTABMINSIZE) and the chosen size is stored in the index
 // recommended is 1 << 30
 constexpr uint64_t HTABSIZE = 1ULL << 30;
+constexpr uint64_t HTABMINSIZE = 1ULL << 16;
+static_assert((HTABSIZE & (HTABSIZE - 1)) == 0 && HTABMINSIZE <= HTABSIZE, "HTABSIZE has to be a power of two");
 
 
 // window length for meta CpGs
@@ -105,10 +172,154 @@ constexpr int32_t KMERDIST = 10;
 
 // Only hash every SKIPMODth reference k-mer
 constexpr unsigned int SKIPMOD = 2;
+// indexes built with --syncmers hash the open syncmers instead: the k-mers whose smallest s-mer of length SYNCLEN
+// (of the seed masked k-mer, compared by hash) starts at SYNCPOS, about one in KMERLEN - SYNCLEN + 1 k-mers;
+// reads then only look up their syncmers (see RefGenome::isSyncmer)
+constexpr unsigned int SYNCLEN = 29;
+constexpr unsigned int SYNCPOS = (KMERLEN - SYNCLEN) / 2;
+static_assert(SYNCLEN <= KMERLEN, "s-mers of syncmers cannot be longer than k-mers");
+
+// mapping quality of the records of the alignment output (see --align_out), only unique best matches are reported
+constexpr unsigned int ALIGNMAPQ = 60;
 
 // dummy index for CpGs
 constexpr uint32_t CPGDUMMY = std::numeric_limits<uint32_t>::max();
 
+
+//  -------- RUNTIME PARAMETERS --------
+//
+// these default to the values above and can be set through the command line
+// before any reads are processed
+//
+// number of threads used for index construction and read matching
+extern unsigned int coreNum;
+// number of reads (or read pairs) per batch
+extern unsigned int chunkSize;
+// number of batches in flight in the stages parsing, matching and writing the reads (see Pipeline.h), 0 for as many
+// as the stages have threads
+extern unsigned int pipelineDepth;
+// number of threads formatting the alignment output and unaligned reads of matched batches, each on its own batch
+extern unsigned int outputThreads;
+// number of IOBLOCK requests in flight per input or output file, 0 for blocking reads and writes
+extern unsigned int ioDepth;
+// overall number of errors allowed for shift-and and alignment
+// must be one of the budgets listed in ERRBUDGETS (the kernels are compiled for each of them)
+extern unsigned int errBudget;
+constexpr std::array<unsigned int, 4> ERRBUDGETS = {{2, 4, 6, 8}};
+// reads with up to errBudget Ns are matched with the Ns as mismatches instead of being discarded
+extern bool maskN;
+// 3' ends of reads are cut at the first window of TRIMWINDOW bases with a mean Phred quality below trimQual
+// while the FASTQ file is parsed (0 switches quality trimming off)
+extern unsigned int trimQual;
+constexpr unsigned int TRIMWINDOW = 4;
+// offset of the quality letters (Sanger / Illumina 1.8+)
+constexpr unsigned int PHREDOFFSET = 33;
+// reads are cut at the first occurrence of ADAPTER (Illumina TruSeq adapter prefix, unchanged by bisulfite
+// conversion since the adapters are methylated) while the FASTQ file is parsed, including a prefix of at
+// least ADAPTERMINLEN letters of it at the 3' end
+extern bool trimAdapter;
+constexpr char ADAPTER[] = "AGATCGGAAGAGC";
+constexpr size_t ADAPTERLEN = sizeof(ADAPTER) - 1;
+constexpr size_t ADAPTERMINLEN = 3;
+// single-end reads only: shrink the number of errors searched by shift-and to one more than the
+// best match found so far while the candidate windows of a read are verified
+extern bool adaptiveErrors;
+// single-end reads only: verify the candidate windows of all reads of a batch sorted by window instead of
+// read by read, such that reads hitting the same window are verified together (same results)
+extern bool batchVerify;
+// batched verification (implies batchVerify) with all windows of a batch verified in one flat kernel, which runs on an
+// OpenMP offload device (GPU) if FAME is built with OFFLOAD (see DeviceVerify)
+extern bool offload;
+// single-end reads only: reads of a batch with the same sequence (and cell) are matched once, the result and the
+// methylation counts of the first one are taken for all of them (see ReadQueue::collapseReads)
+extern bool readCache;
+// single-end reads matched as read and reverse complement (non-stranded libraries): the candidate windows of both
+// on both strands are verified together, filling the lanes of one shift and pass (same results, not combined
+// with adaptiveErrors)
+extern bool jointStrands;
+// paired-end reads only: once read 1 has a confident match, read 2 is verified only in the positions pairing
+// with it instead of being seeded
+extern bool mateRescue;
+// paired-end reads only: seed both reads of a pair at once, their hits are sorted by window and paired in a
+// linear sweep instead of hash map lookups per k-mer (see ReadQueue::getSeedRefsPaired)
+extern bool fusedPairs;
+// match every batch with the error budget TIERBUDGET first and retry only the reads (or pairs) without a
+// match of at most TIERBUDGET errors with the full errBudget (see ReadQueue::matchReadsBudget)
+extern bool tieredErrors;
+// error budget of the first pass of tieredErrors, must be one of ERRBUDGETS
+constexpr unsigned int TIERBUDGET = 2;
+// single-end reads only: number of reads each thread seeds together, the hash table lookups of all of them are
+// issued (and prefetched) before the first one waits for its memory, as are the reference windows a read
+// verifies next (same results, 1 to seed one read after the other, see ReadQueue::seedAhead)
+extern unsigned int interleave;
+// largest value of interleave
+constexpr unsigned int MAXINTERLEAVE = 32;
+// single-end reads only: maximum number of candidate windows of a read (or its reverse complement) that pass the
+// q-gram threshold, reads with more are classed as non-unique without verifying them, 0 for no maximum
+extern unsigned int candidateBudget;
+// minimum number of k-mer hits of a window to verify a read in it (QTHRESH unless set on the command line)
+extern unsigned int qThresh;
+// paired-end reads only: windows with more than kmerDist k-mer hits fewer than the best window of a read are not
+// verified (KMERDIST unless set on the command line)
+extern unsigned int kmerDist;
+// reads matched with errors whose mismatches to the reference without any shift are no more than their errors are
+// called like exact matches instead of from the banded alignment (see ReadQueue::substitutionsOnly)
+extern bool substitutionCalls;
+// copy the bucket directory, the k-mer table and the reference sequence of a loaded index to memory backed by
+// huge pages (explicit ones if reserved, transparent ones otherwise) instead of using them in the file mapping
+extern bool hugePages;
+// interleave the tables copied as for hugePages page by page over all NUMA nodes and pin the OpenMP worker
+// threads to CPUs alternating between the nodes (see NUMA::spreadCpus)
+extern bool numa;
+// copy the reference of a loaded index into one cache line aligned record per window with the letters around the
+// window and the offsets of its CpGs, read by verification and calling instead of the sequences and the CpG table
+// (see RefGenome::buildWindowRecords)
+extern bool windowRecords;
+// budget in KB for the window summaries of the largest buckets of a loaded index, which seeding reads instead of
+// the buckets themselves (see RefGenome::buildHotBuckets), 0 for none
+extern unsigned int hotBuckets;
+// k-mer cutoff a deferred index is filtered with when it is loaded (see RefGenome::applyKmerCutoff), 0 for
+// KMERCUTOFF; indexes filtered when they were built always use the cutoff they were built with
+extern unsigned int kmerCutoff;
+// verify the checksums of all sections of a loaded index before using it (the header is always verified)
+extern bool verifyIndex;
+// fault the sections of a loaded index into memory by a background thread, the hash table first, while reads are
+// already matched, instead of reading the whole file before loading returns (see RefGenome::warmUp)
+extern bool warmIndex;
+// memory budget in MB for the k-mer table while an index is built, 0 for none
+// a larger table is built in several passes over the reference, each keeping the k-mers of a range of hash
+// table cells (see RefGenome::buildInPasses)
+extern unsigned int indexMem;
+// distributed runs: the input is cut into blocks of SHARDBLOCK records (pairs) and this process only aligns
+// the blocks b with b % shardNum == shardIdx, the counts of all shards are summed with --merge
+extern unsigned int shardIdx;
+extern unsigned int shardNum;
+constexpr uint64_t SHARDBLOCK = 4096;
+// how the reads of a batch are distributed among the threads
+// SCHED_AUTO starts static and switches to dynamic for batches following an imbalanced one
+enum SCHEDULE : uint8_t {
+    SCHED_STATIC = 0,
+    SCHED_DYNAMIC,
+    SCHED_AUTO
+};
+extern SCHEDULE schedule;
+// CPUs the OpenMP worker threads run on
+// LAYOUT_OS leaves the placement to the operating system, LAYOUT_COMPACT pins the threads to the CPUs of one NUMA
+// node before the next one (sharing the last level cache), LAYOUT_SPREAD alternates between the nodes as numa does
+enum LAYOUT : uint8_t {
+    LAYOUT_OS = 0,
+    LAYOUT_COMPACT,
+    LAYOUT_SPREAD
+};
+extern LAYOUT threadLayout;
+// autotuning (see --autotune): the batch sizes tried are chunkSize times the factors in TUNECHUNKS, thread counts
+// are the CPUs the process may use divided by the divisors in TUNETHREADS
+constexpr double TUNECHUNKS[4] = {0.25, 0.5, 1, 2};
+constexpr unsigned int TUNETHREADS[3] = {1, 2, 4};
+
+// Checks the given runtime parameters, terminates on invalid values
+void checkRuntimeParams();
+
 // Checks the usefulness of the set parameters
 void sanityChecks();
 
@@ -0,0 +1,199 @@
+//	Metal - A fast methylation alignment and calling tool for WGBS data.
+//	Copyright (C) 2017  Jonas Fischer
+//
+//	This program is free software: you can redistribute it and/or modify
+//	it under the terms of the GNU General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+//
+//	This program is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//	GNU General Public License for more details.
+//
+//	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Jonas Fischer	jonaspost@web.de
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+
+#include "CellBarcodes.h"
+
+
+namespace
+{
+    // 2 bit code of letter c, 4 for letters other than A, C, G, T
+    inline unsigned int letterCode(const char c)
+    {
+        switch (c & 0xdf)
+        {
+            case 'A': return 0;
+            case 'C': return 1;
+            case 'G': return 2;
+            case 'T': return 3;
+            default: return 4;
+        }
+    }
+}
+
+constexpr uint32_t CellBarcodes::NOCELL;
+constexpr uint32_t CellBarcodes::NEIGHBOUR;
+
+CellBarcodes::CellBarcodes() :
+        len(0)
+    ,   readLen(0)
+{
+}
+
+bool CellBarcodes::load(const std::string& path)
+{
+
+    std::ifstream in(path);
+    if (!in)
+    {
+        std::cerr << "Could not open barcode whitelist \"" << path << "\"!\n";
+        return false;
+    }
+    len = 0;
+    names.clear();
+    cells.clear();
+    std::vector<uint64_t> packed;
+    std::string line;
+    while (std::getline(in, line))
+    {
+        std::istringstream fields(line);
+        std::string bc;
+        std::string name;
+        if (!(fields >> bc))
+            continue;
+        if (!(fields >> name))
+            name = bc;
+        if (len == 0)
+            len = bc.size();
+        if (bc.size() != len || len > 32)
+        {
+            std::cerr << "Barcode \"" << bc << "\" of whitelist \"" << path << "\" differs in length from the first one or is longer than 32 letters!\n";
+            return false;
+        }
+        uint64_t code = 0;
+        for (const char c : bc)
+        {
+            const unsigned int l = letterCode(c);
+            if (l > 3)
+            {
+                std::cerr << "Barcode \"" << bc << "\" of whitelist \"" << path << "\" has a letter other than A, C, G, T!\n";
+                return false;
+            }
+            code = (code << 2) | l;
+        }
+        if (!cells.emplace(code, names.size()).second)
+        {
+            std::cerr << "Barcode \"" << bc << "\" is listed twice in whitelist \"" << path << "\"!\n";
+            return false;
+        }
+        packed.push_back(code);
+        names.push_back(name);
+    }
+    if (names.empty())
+    {
+        std::cerr << "Barcode whitelist \"" << path << "\" is empty!\n";
+        return false;
+    }
+
+    // all barcodes with one mismatch, after the whitelist such that listed barcodes are never shadowed
+    cells.reserve(cells.size() * (1 + 3 * len));
+    for (uint32_t cell = 0; cell < packed.size(); ++cell)
+    {
+        for (unsigned int i = 0; i < len; ++i)
+        {
+            const unsigned int shift = 2 * (len - 1 - i);
+            for (uint64_t l = 1; l < 4; ++l)
+            {
+                const uint64_t code = packed[cell] ^ (l << shift);
+                auto it = cells.find(code);
+                if (it == cells.end())
+                {
+                    cells.emplace(code, cell | NEIGHBOUR);
+
+                } else if ((it->second & NEIGHBOUR) && it->second != (cell | NEIGHBOUR)) {
+
+                    it.value() = NOCELL;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+uint32_t CellBarcodes::lookup(const char* id, const size_t idLen, const char* seq, const size_t seqLen) const
+{
+
+    if (readLen > 0)
+        return seqLen < readLen ? NOCELL : find(seq, readLen);
+
+    // last field of the header, read from its end
+    char bc[64];
+    size_t n = 0;
+    size_t i = idLen;
+    while (i > 0 && (id[i - 1] == '\r' || id[i - 1] == ' ' || id[i - 1] == '\t'))
+        --i;
+    for (; i > 0; --i)
+    {
+        const char c = id[i - 1];
+        if (c == ':' || c == '_' || c == ' ' || c == '\t' || c == '@')
+            break;
+        if (c == '+')
+            continue;
+        if (n == sizeof(bc))
+            return NOCELL;
+        bc[n++] = c;
+    }
+    if (n != len)
+        return NOCELL;
+    std::reverse(bc, bc + n);
+    return find(bc, n);
+}
+
+uint32_t CellBarcodes::find(const char* bc, const size_t n) const
+{
+
+    if (n != len)
+        return NOCELL;
+    uint64_t code = 0;
+    int nPos = -1;
+    for (size_t i = 0; i < n; ++i)
+    {
+        unsigned int l = letterCode(bc[i]);
+        if (l > 3)
+        {
+            // a single N is the one mismatch allowed, tried with all letters below
+            if (nPos >= 0)
+                return NOCELL;
+            nPos = i;
+            l = 0;
+        }
+        code = (code << 2) | l;
+    }
+    if (nPos < 0)
+    {
+        const auto it = cells.find(code);
+        return it == cells.end() || it->second == NOCELL ? NOCELL : it->second & ~NEIGHBOUR;
+    }
+    // the barcodes of the whitelist that agree with bc outside of the N
+    uint32_t cell = NOCELL;
+    const unsigned int shift = 2 * (len - 1 - nPos);
+    for (uint64_t l = 0; l < 4; ++l)
+    {
+        const auto it = cells.find(code | (l << shift));
+        if (it == cells.end() || (it->second & NEIGHBOUR))
+            continue;
+        if (cell != NOCELL)
+            return NOCELL;
+        cell = it->second;
+    }
+    return cell;
+}
@@ -0,0 +1,78 @@
+//	Metal - A fast methylation alignment and calling tool for WGBS data.
+//	Copyright (C) 2017  Jonas Fischer
+//
+//	This program is free software: you can redistribute it and/or modify
+//	it under the terms of the GNU General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+//
+//	This program is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//	GNU General Public License for more details.
+//
+//	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Jonas Fischer	jonaspost@web.de
+
+#ifndef CELLBARCODES_H
+#define CELLBARCODES_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <limits>
+
+#include <hopscotch_map.h>
+
+
+// Whitelist of the cell barcodes of a multiplexed single cell run
+// The barcode of a read is either the last field of its FASTQ header (fields separated by ':', '_' or white space,
+// a '+' between dual indices is dropped, e.g. "@M1:7:FC:1:1101:1:1 1:N:0:ACGTACGT+TTGCAAGT") or the first
+// readLen letters of its sequence. Barcodes are packed with 2 bits per letter and looked up in one hash table that
+// holds all barcodes of the whitelist and all their neighbours with one mismatch, such that a read barcode with one
+// sequencing error (or one N) still finds its cell in a single lookup. Neighbours shared by two barcodes of the
+// whitelist are ambiguous and match no cell.
+class CellBarcodes
+{
+
+    public:
+
+        // cell of reads whose barcode is not on the whitelist
+        static constexpr uint32_t NOCELL = std::numeric_limits<uint32_t>::max();
+
+        CellBarcodes();
+
+        // reads the whitelist from path, one barcode per line, optionally followed by white space and the name of
+        // the cell (the barcode itself otherwise); all barcodes must have the same length of at most 32 letters
+        //
+        // RETURN:  false iff the file could not be read or holds an invalid barcode, an error is printed
+        bool load(const std::string& path);
+
+        // take the barcode from the first n letters of the reads instead of their header, 0 for the header
+        inline void setReadLength(const unsigned int n) { readLen = n; }
+        // number of letters the barcode takes at the start of a read
+        inline unsigned int readLength() const { return readLen; }
+
+        // RETURN:  cell of the read with the given header and sequence, NOCELL if its barcode is not on the whitelist
+        uint32_t lookup(const char* id, const size_t idLen, const char* seq, const size_t seqLen) const;
+
+        inline size_t size() const { return names.size(); }
+        inline const std::string& name(const uint32_t cell) const { return names[cell]; }
+
+    private:
+
+        // RETURN:  cell of the barcode bc of length n, NOCELL if there is none
+        uint32_t find(const char* bc, const size_t n) const;
+
+        // barcode length of the whitelist
+        unsigned int len;
+        unsigned int readLen;
+        std::vector<std::string> names;
+        // packed barcode to cell, neighbours are marked with NEIGHBOUR, ambiguous ones hold NOCELL
+        tsl::hopscotch_map<uint64_t, uint32_t> cells;
+        static constexpr uint32_t NEIGHBOUR = 1U << 31;
+};
+
+#endif /* CELLBARCODES_H */
@@ -0,0 +1,82 @@
+//	Metal - A fast methylation alignment and calling tool for WGBS data.
+//	Copyright (C) 2017  Jonas Fischer
+//
+//	This program is free software: you can redistribute it and/or modify
+//	it under the terms of the GNU General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+//
+//	This program is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//	GNU General Public License for more details.
+//
+//	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Jonas Fischer	jonaspost@web.de
+
+#include <algorithm>
+
+#include "CellCounts.h"
+
+
+constexpr size_t CellCounts::MINPENDING;
+
+void CellCounts::compact()
+{
+
+    if (pending.empty())
+        return;
+    std::sort(pending.begin(), pending.end());
+
+    std::vector<uint64_t> merged;
+    std::vector<std::pair<uint32_t, uint32_t> > mergedOverflow;
+    size_t e = 0;
+    size_t p = 0;
+    size_t o = 0;
+    while (e < entries.size() || p < pending.size())
+    {
+
+        // next CpG of both lists
+        uint32_t cpg;
+        if (p == pending.size() || (e < entries.size() && (entries[e] >> 16) <= (pending[p] >> 2)))
+            cpg = entries[e] >> 16;
+        else
+            cpg = pending[p] >> 2;
+
+        uint32_t n[4] = {0, 0, 0, 0};
+        if (e < entries.size() && (entries[e] >> 16) == cpg)
+        {
+            for (unsigned int c = 0; c < 4; ++c)
+            {
+                n[c] = (entries[e] >> (4 * c)) & 0xf;
+                if (n[c] == 0xf)
+                    n[c] += overflow[o++].second;
+            }
+            ++e;
+        }
+        for (; p < pending.size() && (pending[p] >> 2) == cpg; ++p)
+        {
+            ++n[pending[p] & 3];
+        }
+
+        uint64_t entry = static_cast<uint64_t>(cpg) << 16;
+        for (unsigned int c = 0; c < 4; ++c)
+        {
+            if (n[c] >= 0xf)
+            {
+                entry |= static_cast<uint64_t>(0xf) << (4 * c);
+                mergedOverflow.emplace_back(cpg << 2 | c, n[c] - 0xf);
+
+            } else {
+
+                entry |= static_cast<uint64_t>(n[c]) << (4 * c);
+            }
+        }
+        merged.push_back(entry);
+    }
+    entries.swap(merged);
+    overflow.swap(mergedOverflow);
+    pending.clear();
+}
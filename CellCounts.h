@@ -0,0 +1,82 @@
+//	Metal - A fast methylation alignment and calling tool for WGBS data.
+//	Copyright (C) 2017  Jonas Fischer
+//
+//	This program is free software: you can redistribute it and/or modify
+//	it under the terms of the GNU General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+//
+//	This program is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//	GNU General Public License for more details.
+//
+//	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Jonas Fischer	jonaspost@web.de
+
+#ifndef CELLCOUNTS_H
+#define CELLCOUNTS_H
+
+#include <vector>
+#include <utility>
+#include <cstddef>
+#include <cstdint>
+
+
+// Counts of one cell for one range of CpGs (see ReadQueue::mergeMethEvents) while the reads of the cell are matched
+// Single cells cover few CpGs, and those rarely more than a few times, hence no dense table is held per cell.
+// New calls are appended to a list and folded from time to time into a sorted list of the covered CpGs with four
+// saturating 4 bit counters each; counts beyond 15 are kept in a side table. A covered CpG costs 8 bytes, a pending
+// call 4 bytes, independent of the size of the genome.
+class CellCounts
+{
+
+    public:
+
+        // adds a call of counter c (0 to 3, see ReadQueue::METHCOUNTER) of the CpG at offset cpg in the range
+        inline void add(const uint32_t cpg, const unsigned int c)
+        {
+            pending.push_back(cpg << 2 | c);
+            if (pending.size() > entries.size() / 2 + MINPENDING)
+                compact();
+        }
+
+        // calls f(cpg, c, n) for every counter c of a CpG at offset cpg with n > 0 calls, in the order of the CpGs
+        template <typename F>
+        void forEach(F f)
+        {
+            compact();
+            size_t o = 0;
+            for (const uint64_t e : entries)
+            {
+                const uint32_t cpg = e >> 16;
+                for (unsigned int c = 0; c < 4; ++c)
+                {
+                    uint32_t n = (e >> (4 * c)) & 0xf;
+                    if (n == 0xf)
+                        n += overflow[o++].second;
+                    if (n > 0)
+                        f(cpg, c, n);
+                }
+            }
+        }
+
+    private:
+
+        // folds the pending calls into the entries
+        void compact();
+
+        // calls appended before they are folded into the entries at the least
+        static constexpr size_t MINPENDING = 1024;
+
+        // calls (cpg << 2 | c) not yet counted in the entries
+        std::vector<uint32_t> pending;
+        // covered CpGs, sorted, as (cpg << 16 | the counters, 4 bits each, counter c at bit 4 * c)
+        std::vector<uint64_t> entries;
+        // calls beyond 15 of a saturated counter as (cpg << 2 | c, calls - 15), sorted
+        std::vector<std::pair<uint32_t, uint32_t> > overflow;
+};
+
+#endif /* CELLCOUNTS_H */
@@ -0,0 +1,96 @@
+//	Metal - A fast methylation alignment and calling tool for WGBS data.
+//	Copyright (C) 2017  Jonas Fischer
+//
+//	This program is free software: you can redistribute it and/or modify
+//	it under the terms of the GNU General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+//
+//	This program is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//	GNU General Public License for more details.
+//
+//	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Jonas Fischer	jonaspost@web.de
+
+#include "DeviceVerify.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+
+DeviceVerify::DeviceVerify(const std::vector<PackedSeq>& fullSeq) :
+        seqWords(nullptr)
+    ,   nMaskWords(nullptr)
+    ,   seqLen(0)
+    ,   nMaskLen(0)
+    ,   seqCopy()
+    ,   nMaskCopy()
+    ,   seqBase(fullSeq.size())
+    ,   nMaskBase(fullSeq.size())
+{
+
+    // a loaded index keeps all chromosomes one after another in one section each
+    bool contiguous = !fullSeq.empty();
+    for (size_t i = 0; i < fullSeq.size(); ++i)
+    {
+        seqBase[i] = seqLen;
+        nMaskBase[i] = nMaskLen;
+        if (fullSeq[i].seqData().data() != fullSeq[0].seqData().data() + seqLen || fullSeq[i].nMaskData().data() != fullSeq[0].nMaskData().data() + nMaskLen)
+            contiguous = false;
+        seqLen += fullSeq[i].seqData().size();
+        nMaskLen += fullSeq[i].nMaskData().size();
+    }
+    if (contiguous)
+    {
+        seqWords = fullSeq[0].seqData().data();
+        nMaskWords = fullSeq[0].nMaskData().data();
+
+    } else {
+
+        seqCopy.reserve(seqLen);
+        nMaskCopy.reserve(nMaskLen);
+        for (const PackedSeq& chromSeq : fullSeq)
+        {
+            seqCopy.insert(seqCopy.end(), chromSeq.seqData().begin(), chromSeq.seqData().end());
+            nMaskCopy.insert(nMaskCopy.end(), chromSeq.nMaskData().begin(), chromSeq.nMaskData().end());
+        }
+        seqWords = seqCopy.data();
+        nMaskWords = nMaskCopy.data();
+    }
+
+#ifdef FAME_OFFLOAD
+    // the reference stays resident, the kernels find it present
+    const uint64_t* seqW = seqWords;
+    const uint64_t* nMaskW = nMaskWords;
+    const uint64_t* seqB = seqBase.data();
+    const uint64_t* nMaskB = nMaskBase.data();
+    const size_t chroms = seqBase.size();
+#pragma omp target enter data map(to: seqW[0:seqLen], nMaskW[0:nMaskLen], seqB[0:chroms], nMaskB[0:chroms])
+#endif
+}
+
+DeviceVerify::~DeviceVerify()
+{
+#ifdef FAME_OFFLOAD
+    const uint64_t* seqW = seqWords;
+    const uint64_t* nMaskW = nMaskWords;
+    const uint64_t* seqB = seqBase.data();
+    const uint64_t* nMaskB = nMaskBase.data();
+    const size_t chroms = seqBase.size();
+#pragma omp target exit data map(delete: seqW[0:seqLen], nMaskW[0:nMaskLen], seqB[0:chroms], nMaskB[0:chroms])
+#endif
+}
+
+bool DeviceVerify::onDevice() const
+{
+#ifdef FAME_OFFLOAD
+    return omp_get_num_devices() > 0;
+#else
+    return false;
+#endif
+}
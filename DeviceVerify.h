@@ -0,0 +1,251 @@
+//	Metal - A fast methylation alignment and calling tool for WGBS data.
+//	Copyright (C) 2017  Jonas Fischer
+//
+//	This program is free software: you can redistribute it and/or modify
+//	it under the terms of the GNU General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+//
+//	This program is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//	GNU General Public License for more details.
+//
+//	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Jonas Fischer	jonaspost@web.de
+
+#ifndef DEVICEVERIFY_H
+#define DEVICEVERIFY_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "CONST.h"
+#include "PackedSeq.h"
+#include "ShiftAnd.h"
+
+
+// shift and verification of a whole batch of (pattern, reference slice) tasks in one flat kernel (see MyConst::offload)
+//
+// Built with FAME_OFFLOAD (make OFFLOAD=<target>) the kernel is an OpenMP target region and the packed reference
+// stays in device memory for the lifetime of the object, otherwise it runs on the host threads.
+// The kernel computes exactly what ShiftAnd::querySeq resp. ShiftAnd::queryRevSeq computes for each task.
+class DeviceVerify
+{
+
+    public:
+
+        // automaton of one pattern, bitmasks indexed by the 2 bit letter code of PackedSeq, MyConst::SAWORDS words each
+        struct Pattern
+        {
+            uint64_t m[4][MyConst::SAWORDS];
+            uint64_t acc[MyConst::SAWORDS];
+            uint64_t pLen;
+        };
+
+        // one reference slice to query a pattern to
+        // forward: letters start, start + 1, ..., start + len - 1 of chromosome chrom
+        // reverse: the complements of letters start, start - 1, ..., start - len + 1
+        struct Task
+        {
+            uint64_t start;
+            uint32_t len;
+            uint32_t pattern;
+            uint32_t chrom;
+            uint32_t isFwd;
+        };
+
+        // number of matchings returned per task, tasks with more are reported with their full count
+        // and have to be queried again on the host
+        static constexpr uint32_t MAXMATCHES = 8;
+
+        // makes the reference sequence available to the kernel
+        explicit DeviceVerify(const std::vector<PackedSeq>& fullSeq);
+        ~DeviceVerify();
+
+        DeviceVerify(const DeviceVerify&) = delete;
+        DeviceVerify& operator=(const DeviceVerify&) = delete;
+
+        // writes the automaton sa currently holds to p
+        template <size_t E>
+        static inline void loadPattern(const ShiftAnd<E>& sa, Pattern& p);
+
+        // queries the n tasks, the matchings of task t (as reported by ShiftAnd::querySeq/queryRevSeq) are written
+        // to matchings[t * MAXMATCHES, ...) and errors[t * MAXMATCHES, ...), their number to counts[t]
+        template <size_t E>
+        inline void verify(const Pattern* patterns, const size_t patternNum, const Task* tasks, const size_t n, uint32_t* counts, uint64_t* matchings, uint8_t* errors) const;
+
+        // true if the kernel runs on an offload device
+        bool onDevice() const;
+
+    private:
+
+        // the sequence words and N masks of all chromosomes, every chromosome starting at a new word
+        // (views of the loaded index if its sections are contiguous, copies otherwise)
+        const uint64_t* seqWords;
+        const uint64_t* nMaskWords;
+        size_t seqLen;
+        size_t nMaskLen;
+        std::vector<uint64_t> seqCopy;
+        std::vector<uint64_t> nMaskCopy;
+        // first word of each chromosome in seqWords resp. nMaskWords
+        std::vector<uint64_t> seqBase;
+        std::vector<uint64_t> nMaskBase;
+};
+
+
+template <size_t E>
+inline void DeviceVerify::loadPattern(const ShiftAnd<E>& sa, Pattern& p)
+{
+    const char letters[4] = {'A', 'C', 'G', 'T'};
+    for (unsigned int code = 0; code < 4; ++code)
+    {
+        for (size_t w = 0; w < MyConst::SAWORDS; ++w)
+            p.m[code][w] = sa.masks[sa.lmap[letters[code] % 16]].B[w];
+    }
+    for (size_t w = 0; w < MyConst::SAWORDS; ++w)
+        p.acc[w] = sa.accepted.B[w];
+    p.pLen = sa.pLen;
+}
+
+template <size_t E>
+inline void DeviceVerify::verify(const Pattern* patterns, const size_t patternNum, const Task* tasks, const size_t n, uint32_t* counts, uint64_t* matchings, uint8_t* errors) const
+{
+
+    // plain pointers, such that the map clauses find the reference mapped by the constructor
+    const uint64_t* seqW = seqWords;
+    const uint64_t* nMaskW = nMaskWords;
+    const uint64_t* seqB = seqBase.data();
+    const uint64_t* nMaskB = nMaskBase.data();
+#ifdef FAME_OFFLOAD
+    const size_t sLen = seqLen;
+    const size_t nLen = nMaskLen;
+    const size_t chroms = seqBase.size();
+    const size_t outLen = n * MAXMATCHES;
+#pragma omp target teams distribute parallel for map(to: seqW[0:sLen], nMaskW[0:nLen], seqB[0:chroms], nMaskB[0:chroms], patterns[0:patternNum], tasks[0:n]) map(from: counts[0:n], matchings[0:outLen], errors[0:outLen])
+#else
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(CORENUM) schedule(dynamic, 256)
+#endif
+#endif
+    for (size_t t = 0; t < n; ++t)
+    {
+
+        const Task task = tasks[t];
+        const Pattern& p = patterns[task.pattern];
+        const uint64_t* seq = seqW + seqB[task.chrom];
+        const uint64_t* nMask = nMaskW + nMaskB[task.chrom];
+
+        constexpr size_t W = MyConst::SAWORDS;
+        // states as in ShiftAnd::active
+        uint64_t a[E + 1][W];
+        for (size_t i = 0; i <= E; ++i)
+        {
+            a[i][0] = (static_cast<uint64_t>(1) << (i+1)) - 1;
+            for (size_t w = 1; w < W; ++w)
+                a[i][w] = 0;
+        }
+
+        bool wasMatch = false;
+        uint8_t prevErrs = MyConst::MISCOUNT + 1;
+        uint64_t numCompLets = 0;
+        uint32_t count = 0;
+        for (uint32_t k = 0; k < task.len; ++k)
+        {
+
+            const uint64_t pos = task.isFwd ? task.start + k : task.start - k;
+            // we do not consider Ns for matches - restart whole automaton for next letter
+            if ((nMask[pos >> 6] >> (pos & 63)) & 1)
+            {
+                for (size_t i = 0; i <= E; ++i)
+                {
+                    a[i][0] = (static_cast<uint64_t>(1) << (i+1)) - 1;
+                    for (size_t w = 1; w < W; ++w)
+                        a[i][w] = 0;
+                }
+                continue;
+            }
+            uint64_t code = (seq[pos >> 5] >> ((pos & 31) << 1)) & 3;
+            if (!task.isFwd)
+                code = 3 - code;
+            const uint64_t* m = p.m[code];
+
+            // same updates as in ShiftAnd::queryLetter
+            for (size_t i = E; i > 0; --i)
+            {
+                for (size_t w = W - 1; w > 0; --w)
+                    a[i][w] = ((a[i][w] << 1 | a[i][w-1] >> 63) & m[w]) | (a[i-1][w]) | (a[i-1][w] << 1 | a[i-1][w-1] >> 63);
+                a[i][0] = ((a[i][0] << 1 | 1) & m[0]) | (a[i-1][0]) | (a[i-1][0] << 1);
+            }
+            for (size_t w = W - 1; w > 0; --w)
+                a[0][w] = ((a[0][w] << 1 | a[0][w-1] >> 63) & m[w]);
+            a[0][0] = ((a[0][0] << 1 | 1) & m[0]);
+            for (size_t i = 1; i <= E; ++i)
+            {
+                for (size_t w = W - 1; w > 0; --w)
+                    a[i][w] |= a[i-1][w] << 1 | a[i-1][w-1] >> 63;
+                a[i][0] |= a[i-1][0] << 1;
+            }
+
+            ++numCompLets;
+            // There can only be a match after at least pLen - E many chars are queried so only then compare
+            if (numCompLets < (p.pLen - E))
+                continue;
+
+            // true iff layer i is in an accepting state
+            auto accepts = [&](const size_t i)
+            {
+                uint64_t acc = 0;
+                for (size_t w = 0; w < W; ++w)
+                    acc |= a[i][w] & p.acc[w];
+                return acc != 0;
+            };
+            if (!accepts(E))
+            {
+                wasMatch = false;
+                continue;
+            }
+            uint8_t errNum = E;
+            for (size_t i = 0; i < E; ++i)
+            {
+                if (accepts(i))
+                {
+                    errNum = i;
+                    break;
+                }
+            }
+            const uint64_t offset = task.isFwd ? k : task.len - k + p.pLen - 2;
+
+            // if we matched in previous round, overwrite that match
+            if (wasMatch)
+            {
+                if (errNum <= prevErrs)
+                {
+                    if (count <= MAXMATCHES)
+                    {
+                        matchings[t * MAXMATCHES + count - 1] = offset;
+                        errors[t * MAXMATCHES + count - 1] = errNum;
+                    }
+                    prevErrs = errNum;
+                }
+
+            } else {
+
+                if (count < MAXMATCHES)
+                {
+                    matchings[t * MAXMATCHES + count] = offset;
+                    errors[t * MAXMATCHES + count] = errNum;
+                }
+                ++count;
+                wasMatch = true;
+                prevErrs = errNum;
+            }
+        }
+        counts[t] = count;
+    }
+}
+
+#endif /* DEVICEVERIFY_H */
@@ -0,0 +1,440 @@
+#include <omp.h>
+#include <zlib.h>
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <climits>
+#include <cmath>
+
+#include "Evaluate.h"
+
+
+constexpr uint16_t Evaluator::NOCHROM;
+constexpr unsigned int Evaluator::ERRCLASSES;
+
+// bytes of a file parsed at once
+constexpr size_t EVALBLOCK = 64 << 20;
+
+namespace
+{
+    // splits line[0, len) at tabs into at most n fields, returns the number of fields
+    size_t splitFields(const char* line, const size_t len, const char** fields, size_t* lens, const size_t n)
+    {
+        size_t f = 0;
+        const char* p = line;
+        const char* end = line + len;
+        while (f < n)
+        {
+            const char* tab = static_cast<const char*>(memchr(p, '\t', end - p));
+            fields[f] = p;
+            lens[f] = (tab ? tab : end) - p;
+            ++f;
+            if (!tab)
+                break;
+            p = tab + 1;
+        }
+        return f;
+    }
+
+    // non negative decimal number of field, false if it is none
+    bool parseNum(const char* p, const size_t len, uint64_t& v)
+    {
+        if (len == 0)
+            return false;
+        v = 0;
+        for (size_t i = 0; i < len; ++i)
+        {
+            if (p[i] < '0' || p[i] > '9')
+                return false;
+            v = v * 10 + (p[i] - '0');
+        }
+        return true;
+    }
+
+    // calls parse(t, line, len) for every line of the (gzip compressed) file path; the file is read in blocks of
+    // EVALBLOCK bytes, each cut into one slice of whole lines per thread t that are parsed in parallel; prepare(block,
+    // len) is called with the lines of each block before they are parsed
+    // RETURN:  false iff the file could not be read
+    template <typename ParseFn, typename PrepareFn>
+    bool forLines(const std::string& path, const unsigned int threads, ParseFn parse, PrepareFn prepare)
+    {
+
+        // gzread reads uncompressed files as they are
+        gzFile in = gzopen(path.c_str(), "rb");
+        if (in == nullptr)
+        {
+            std::cerr << "Could not open file \"" << path << "\"!\n";
+            return false;
+        }
+        gzbuffer(in, 1 << 20);
+        std::vector<char> buf(EVALBLOCK);
+        size_t filled = 0;
+        bool eof = false;
+        std::vector<size_t> cuts(threads + 1);
+        while (!eof || filled > 0)
+        {
+            while (filled < buf.size() && !eof)
+            {
+                const int n = gzread(in, buf.data() + filled, static_cast<unsigned int>(std::min<size_t>(buf.size() - filled, INT_MAX)));
+                if (n < 0)
+                {
+                    std::cerr << "Reading file \"" << path << "\" failed!\n";
+                    gzclose(in);
+                    return false;
+                }
+                eof = n == 0;
+                filled += n;
+            }
+            // whole lines only, the rest moves to the next block; a last line may lack its line break
+            size_t end = filled;
+            if (!eof)
+            {
+                const char* last = static_cast<const char*>(memrchr(buf.data(), '\n', filled));
+                if (last == nullptr)
+                {
+                    buf.resize(2 * buf.size());
+                    continue;
+                }
+                end = last - buf.data() + 1;
+            }
+            cuts[0] = 0;
+            for (unsigned int t = 1; t < threads; ++t)
+            {
+                size_t c = std::max(cuts[t - 1], end / threads * t);
+                const char* nl = c < end ? static_cast<const char*>(memchr(buf.data() + c, '\n', end - c)) : nullptr;
+                cuts[t] = nl ? nl - buf.data() + 1 : end;
+            }
+            cuts[threads] = end;
+            if (end > 0)
+                prepare(buf.data(), end);
+#pragma omp parallel for num_threads(threads) schedule(static,1)
+            for (unsigned int t = 0; t < threads; ++t)
+            {
+                const char* p = buf.data() + cuts[t];
+                const char* sliceEnd = buf.data() + cuts[t + 1];
+                while (p < sliceEnd)
+                {
+                    const char* nl = static_cast<const char*>(memchr(p, '\n', sliceEnd - p));
+                    const char* lineEnd = nl ? nl : sliceEnd;
+                    if (lineEnd > p)
+                        parse(t, p, lineEnd - p);
+                    p = lineEnd + 1;
+                }
+            }
+            std::memmove(buf.data(), buf.data() + end, filled - end);
+            filled -= end;
+        }
+        gzclose(in);
+        return true;
+    }
+
+    // letters of the read of SAM record, from SEQ or, if that is *, from CIGAR
+    uint64_t samReadLen(const char* seq, const size_t seqLen, const char* cigar, const size_t cigarLen)
+    {
+        if (!(seqLen == 1 && seq[0] == '*'))
+            return seqLen;
+        uint64_t len = 0;
+        uint64_t n = 0;
+        for (size_t i = 0; i < cigarLen; ++i)
+        {
+            const char c = cigar[i];
+            if (c >= '0' && c <= '9')
+            {
+                n = n * 10 + (c - '0');
+                continue;
+            }
+            if (c == 'M' || c == 'I' || c == 'S' || c == '=' || c == 'X')
+                len += n;
+            n = 0;
+        }
+        return len;
+    }
+}
+
+Evaluator::Evaluator(const unsigned int threads, const uint64_t tolerance) :
+        threadNum(std::max(1u, threads))
+    ,   tol(tolerance)
+    ,   paired(false)
+    ,   unknown(0)
+    ,   scoredReads(false)
+    ,   scoredCpgs(false)
+    ,   cpgsTruth(0)
+    ,   cpgsFame(0)
+    ,   cpgsBoth(0)
+    ,   callsTruth(0)
+    ,   callsFame(0)
+    ,   callsMatched(0)
+    ,   levelDiff(0)
+{
+}
+
+uint16_t Evaluator::chromId(const std::string& name, std::unordered_map<std::string, uint16_t>& cache)
+{
+
+    const auto it = cache.find(name);
+    if (it != cache.end())
+        return it->second;
+    uint16_t id;
+#pragma omp critical(evalChromIds)
+    {
+        const auto ins = chromIds.emplace(name, chromNames.size());
+        if (ins.second)
+            chromNames.push_back(name);
+        id = ins.first->second;
+    }
+    cache.emplace(name, id);
+    return id;
+}
+
+bool Evaluator::loadTruth(const std::string& path)
+{
+
+    truth.clear();
+    std::vector<std::unordered_map<std::string, uint16_t> > caches(threadNum);
+    std::vector<uint64_t> bad(threadNum, 0);
+    std::vector<uint8_t> pairedLines(threadNum, 0);
+    // the lines come in the order of the reads, the truth is grown to the last read of a block before it is parsed
+    const bool ok = forLines(path, threadNum, [&](const unsigned int t, const char* line, const size_t len)
+    {
+        const char* f[7] = {};
+        size_t l[7] = {};
+        const size_t n = splitFields(line, len, f, l, 7);
+        uint64_t read;
+        uint64_t start;
+        uint64_t end;
+        uint64_t err1;
+        uint64_t err2 = 0;
+        if (n < 6 || !parseNum(f[0], l[0], read) || !parseNum(f[2], l[2], start) || !parseNum(f[3], l[3], end) || !parseNum(f[5], l[5], err1) || (n == 7 && !parseNum(f[6], l[6], err2)) || read >= truth.size())
+        {
+            ++bad[t];
+            return;
+        }
+        pairedLines[t] |= n == 7;
+        TruthRead& r = truth[read];
+        r.start = start;
+        r.end = end;
+        r.chrom = chromId(std::string(f[1], l[1]), caches[t]);
+        r.fwd = l[4] == 1 && f[4][0] == '+';
+        r.errors[0] = std::min<uint64_t>(err1, ERRCLASSES - 1);
+        r.errors[1] = std::min<uint64_t>(err2, ERRCLASSES - 1);
+    }, [&](const char* block, const size_t end)
+    {
+        // read number of the last line of the block
+        const char* p = block + end - 1;
+        while (p > block && *(p - 1) != '\n')
+            --p;
+        uint64_t read = 0;
+        const char* tab = static_cast<const char*>(memchr(p, '\t', block + end - p));
+        if (tab && parseNum(p, tab - p, read) && read + 1 > truth.size())
+            truth.resize(read + 1, TruthRead{0, 0, NOCHROM, 0, {{0, 0}}});
+    });
+    if (!ok)
+        return false;
+    uint64_t badLines = 0;
+    for (unsigned int t = 0; t < threadNum; ++t)
+    {
+        badLines += bad[t];
+        paired |= pairedLines[t];
+    }
+    if (badLines > 0)
+        std::cerr << "Skipped " << badLines << " lines of \"" << path << "\" that are no truth records of SimReads\n";
+    return true;
+}
+
+bool Evaluator::scoreAlignments(const std::string& path)
+{
+
+    counts.assign(chromNames.size(), std::array<Counts, ERRCLASSES>());
+    for (const TruthRead& r : truth)
+    {
+        if (r.chrom == NOCHROM)
+            continue;
+        for (unsigned int mate = 0; mate < (paired ? 2u : 1u); ++mate)
+            ++counts[r.chrom][r.errors[mate]].reads;
+    }
+    // counts per thread, merged at the end
+    std::vector<std::vector<std::array<Counts, ERRCLASSES> > > threadCounts(threadNum, counts);
+    for (auto& tc : threadCounts)
+        for (auto& chr : tc)
+            for (Counts& c : chr)
+                c.reads = 0;
+    std::vector<uint64_t> threadUnknown(threadNum, 0);
+    std::vector<std::unordered_map<std::string, uint16_t> > caches(threadNum);
+    const bool ok = forLines(path, threadNum, [&](const unsigned int t, const char* line, const size_t len)
+    {
+        if (line[0] == '@')
+            return;
+        const char* f[10];
+        size_t l[10];
+        uint64_t flag;
+        uint64_t pos;
+        if (splitFields(line, len, f, l, 10) < 10 || !parseNum(f[1], l[1], flag) || !parseNum(f[3], l[3], pos))
+        {
+            ++threadUnknown[t];
+            return;
+        }
+        // secondary and supplementary alignments
+        if (flag & 0x900)
+            return;
+        // read number in front of the name
+        const char* us = static_cast<const char*>(memchr(f[0], '_', l[0]));
+        uint64_t read;
+        if (!parseNum(f[0], (us ? us : f[0] + l[0]) - f[0], read) || read >= truth.size() || truth[read].chrom == NOCHROM)
+        {
+            ++threadUnknown[t];
+            return;
+        }
+        const TruthRead& r = truth[read];
+        const unsigned int mate = (flag & 0x80) ? 1 : 0;
+        Counts& c = threadCounts[t][r.chrom][r.errors[mate]];
+        if (flag & 0x4)
+            return;
+        ++c.aligned;
+        // read 1 lies at the start of the fragment on its strand, read 2 at the end
+        const uint64_t readLen = samReadLen(f[9], l[9], f[5], l[5]);
+        const bool atStart = (mate == 0) == (r.fwd == 1);
+        const uint64_t expected = atStart ? r.start : (r.end >= readLen ? r.end - readLen : 0);
+        const uint64_t found = pos > 0 ? pos - 1 : 0;
+        if ((found > expected ? found - expected : expected - found) <= tol && chromId(std::string(f[2], l[2]), caches[t]) == r.chrom)
+            ++c.correct;
+    }, [&](const char*, const size_t) {});
+    if (!ok)
+        return false;
+    // chromosomes only seen in the alignments have no simulated reads
+    counts.resize(chromNames.size());
+    for (unsigned int t = 0; t < threadNum; ++t)
+    {
+        unknown += threadUnknown[t];
+        for (size_t chr = 0; chr < threadCounts[t].size(); ++chr)
+        {
+            for (unsigned int e = 0; e < ERRCLASSES; ++e)
+            {
+                counts[chr][e].aligned += threadCounts[t][chr][e].aligned;
+                counts[chr][e].correct += threadCounts[t][chr][e].correct;
+            }
+        }
+    }
+    scoredReads = true;
+    return true;
+}
+
+bool Evaluator::loadCpgs(const std::string& path, std::vector<CpgCalls>& cpgs)
+{
+
+    std::vector<std::vector<CpgCalls> > threadCpgs(threadNum);
+    std::vector<std::unordered_map<std::string, uint16_t> > caches(threadNum);
+    cpgs.clear();
+    const bool ok = forLines(path, threadNum, [&](const unsigned int t, const char* line, const size_t len)
+    {
+        const char* f[6];
+        size_t l[6];
+        CpgCalls c;
+        uint64_t v[4];
+        if (splitFields(line, len, f, l, 6) < 6 || !parseNum(f[1], l[1], c.pos) || !parseNum(f[2], l[2], v[0]) || !parseNum(f[3], l[3], v[1]) || !parseNum(f[4], l[4], v[2]) || !parseNum(f[5], l[5], v[3]))
+            return;
+        c.chrom = chromId(std::string(f[0], l[0]), caches[t]);
+        for (unsigned int i = 0; i < 4; ++i)
+            c.calls[i] = v[i];
+        threadCpgs[t].push_back(c);
+    }, [](const char*, const size_t) {});
+    // the threads parse the slices of all blocks, the CpGs are sorted below
+    for (auto& tc : threadCpgs)
+        cpgs.insert(cpgs.end(), tc.begin(), tc.end());
+    const auto less = [](const CpgCalls& a, const CpgCalls& b) { return a.chrom < b.chrom || (a.chrom == b.chrom && a.pos < b.pos); };
+    if (!std::is_sorted(cpgs.begin(), cpgs.end(), less))
+        std::sort(cpgs.begin(), cpgs.end(), less);
+    return ok;
+}
+
+bool Evaluator::scoreCpgs(const std::string& truthPath, const std::string& famePath)
+{
+
+    std::vector<CpgCalls> truthCpgs;
+    std::vector<CpgCalls> fameCpgs;
+    if (!loadCpgs(truthPath, truthCpgs) || !loadCpgs(famePath, fameCpgs))
+        return false;
+
+    // merge join of the two sorted lists
+    cpgsTruth = 0;
+    cpgsFame = 0;
+    cpgsBoth = 0;
+    callsTruth = 0;
+    callsFame = 0;
+    callsMatched = 0;
+    levelDiff = 0;
+    const auto covered = [](const CpgCalls& c) { return c.calls[0] + c.calls[1] + c.calls[2] + c.calls[3] > 0; };
+    const auto level = [](const CpgCalls& c) { return static_cast<double>(c.calls[0] + c.calls[2]) / (c.calls[0] + c.calls[1] + c.calls[2] + c.calls[3]); };
+    size_t i = 0;
+    size_t j = 0;
+    while (i < truthCpgs.size() || j < fameCpgs.size())
+    {
+        const bool takeTruth = j == fameCpgs.size() || (i < truthCpgs.size() && (truthCpgs[i].chrom < fameCpgs[j].chrom || (truthCpgs[i].chrom == fameCpgs[j].chrom && truthCpgs[i].pos <= fameCpgs[j].pos)));
+        const bool takeFame = i == truthCpgs.size() || (j < fameCpgs.size() && (fameCpgs[j].chrom < truthCpgs[i].chrom || (fameCpgs[j].chrom == truthCpgs[i].chrom && fameCpgs[j].pos <= truthCpgs[i].pos)));
+        const bool inTruth = takeTruth && covered(truthCpgs[i]);
+        const bool inFame = takeFame && covered(fameCpgs[j]);
+        cpgsTruth += inTruth;
+        cpgsFame += inFame;
+        for (unsigned int k = 0; k < 4; ++k)
+        {
+            const uint32_t t = takeTruth ? truthCpgs[i].calls[k] : 0;
+            const uint32_t f = takeFame ? fameCpgs[j].calls[k] : 0;
+            callsTruth += t;
+            callsFame += f;
+            callsMatched += std::min(t, f);
+        }
+        if (inTruth && inFame)
+        {
+            ++cpgsBoth;
+            levelDiff += std::abs(level(truthCpgs[i]) - level(fameCpgs[j]));
+        }
+        i += takeTruth;
+        j += takeFame;
+    }
+    scoredCpgs = true;
+    return true;
+}
+
+void Evaluator::report(std::ostream& os) const
+{
+
+    const auto row = [&os](const std::string& name, const Counts& c)
+    {
+        os << name << "\t" << c.reads << "\t" << c.aligned << "\t" << c.correct << "\t";
+        os << (c.aligned ? static_cast<double>(c.correct) / c.aligned : 0) << "\t" << (c.reads ? static_cast<double>(c.correct) / c.reads : 0) << "\n";
+    };
+    if (scoredReads)
+    {
+        Counts all;
+        std::array<Counts, ERRCLASSES> byErrors;
+        std::vector<Counts> byChrom(counts.size());
+        for (size_t chr = 0; chr < counts.size(); ++chr)
+        {
+            for (unsigned int e = 0; e < ERRCLASSES; ++e)
+            {
+                const Counts& c = counts[chr][e];
+                for (Counts* s : {&all, &byErrors[e], &byChrom[chr]})
+                {
+                    s->reads += c.reads;
+                    s->aligned += c.aligned;
+                    s->correct += c.correct;
+                }
+            }
+        }
+        os << "class\treads\taligned\tcorrect\tprecision\trecall\n";
+        row("all", all);
+        for (unsigned int e = 0; e < ERRCLASSES; ++e)
+            row("errors_" + std::to_string(e) + (e == ERRCLASSES - 1 ? "+" : ""), byErrors[e]);
+        for (size_t chr = 0; chr < counts.size(); ++chr)
+            row("chrom_" + chromNames[chr], byChrom[chr]);
+        if (unknown > 0)
+            os << "# " << unknown << " alignments of reads not in the truth file\n";
+    }
+    if (scoredCpgs)
+    {
+        os << "cpgs_truth\tcpgs_fame\tcpgs_both\tcalls_truth\tcalls_fame\tcalls_matched\tcall_precision\tcall_recall\tmean_level_diff\n";
+        os << cpgsTruth << "\t" << cpgsFame << "\t" << cpgsBoth << "\t" << callsTruth << "\t" << callsFame << "\t" << callsMatched << "\t";
+        os << (callsFame ? static_cast<double>(callsMatched) / callsFame : 0) << "\t" << (callsTruth ? static_cast<double>(callsMatched) / callsTruth : 0) << "\t";
+        os << (cpgsBoth ? levelDiff / cpgsBoth : 0) << "\n";
+    }
+}
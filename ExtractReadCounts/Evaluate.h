@@ -0,0 +1,109 @@
+#ifndef EVALUATE_H
+#define EVALUATE_H
+
+#include <string>
+#include <vector>
+#include <array>
+#include <unordered_map>
+#include <ostream>
+#include <cstdint>
+
+
+// Accuracy of FAME on reads simulated by Synth/SimReads
+// Joins the alignments of FAME (SAM, see --align_out) with the truth file of the simulation, read by read through the
+// read number in front of the read names, and the CpG report of FAME with the calls per CpG of the simulation.
+// Files (plain or gzip compressed) are read in blocks that are cut into one slice of lines per thread and parsed in
+// parallel, only the truth of the reads is held in memory (16 bytes per read, resp. pair).
+// Reported are precision (correct / aligned) and recall (correct / simulated) of the reads per number of
+// substitutions and per chromosome of origin, and precision and recall of the methylation calls per CpG.
+class Evaluator
+{
+
+    public:
+
+        // ARGUMENTS:
+        //          threads     number of threads parsing a block
+        //          tolerance   an alignment is correct if its position is at most this many letters off the origin
+        Evaluator(const unsigned int threads, const uint64_t tolerance);
+
+        // reads the truth file of the simulation (<basename>_truth.tsv of SimReads)
+        // RETURN:  false iff the file could not be read
+        bool loadTruth(const std::string& path);
+
+        // scores the alignments of the SAM file against the truth, secondary and supplementary records are skipped
+        // RETURN:  false iff the file could not be read
+        bool scoreAlignments(const std::string& path);
+
+        // compares the CpG report of FAME with the calls per CpG of the simulation (<basename>_cpg_truth.tsv)
+        // RETURN:  false iff one of the files could not be read
+        bool scoreCpgs(const std::string& truthPath, const std::string& famePath);
+
+        // writes the report as tab separated table
+        void report(std::ostream& os) const;
+
+    private:
+
+        // origin of a read (pair), see the truth file of SimReads
+        struct TruthRead
+        {
+            // forward strand interval [start, end) of the fragment
+            uint32_t start;
+            uint32_t end;
+            // chromosome id, NOCHROM if the read is not in the truth file
+            uint16_t chrom;
+            // 1 iff the fragment stems from the forward strand
+            uint8_t fwd;
+            // substitutions in read 1 and read 2
+            std::array<uint8_t, 2> errors;
+        };
+        static constexpr uint16_t NOCHROM = UINT16_MAX;
+        // substitutions of a read are counted in classes 0, 1 and ERRCLASSES - 1 or more
+        static constexpr unsigned int ERRCLASSES = 3;
+
+        struct Counts
+        {
+            uint64_t reads = 0;
+            uint64_t aligned = 0;
+            uint64_t correct = 0;
+        };
+
+        // calls of a CpG in the columns of the CpG report
+        struct CpgCalls
+        {
+            uint16_t chrom;
+            uint64_t pos;
+            std::array<uint32_t, 4> calls;
+        };
+
+        // id of chromosome name, added to the table if new; cache holds the ids a thread looked up before
+        uint16_t chromId(const std::string& name, std::unordered_map<std::string, uint16_t>& cache);
+        // parses a CpG report into cpgs, sorted by chromosome id and position
+        bool loadCpgs(const std::string& path, std::vector<CpgCalls>& cpgs);
+
+        unsigned int threadNum;
+        uint64_t tol;
+
+        std::vector<TruthRead> truth;
+        bool paired;
+        std::vector<std::string> chromNames;
+        std::unordered_map<std::string, uint16_t> chromIds;
+
+        // per chromosome and class of substitutions
+        std::vector<std::array<Counts, ERRCLASSES> > counts;
+        // alignments of reads not in the truth file
+        uint64_t unknown;
+        bool scoredReads;
+
+        // see scoreCpgs
+        bool scoredCpgs;
+        uint64_t cpgsTruth;
+        uint64_t cpgsFame;
+        uint64_t cpgsBoth;
+        uint64_t callsTruth;
+        uint64_t callsFame;
+        uint64_t callsMatched;
+        // sum of the absolute differences of the methylation levels of the CpGs in both files
+        double levelDiff;
+};
+
+#endif /* EVALUATE_H */
@@ -0,0 +1,132 @@
+#include <iostream>
+#include <string>
+#include <cstdlib>
+
+#include "Evaluate.h"
+
+
+static void printHelp()
+{
+    std::cout << "\nEvaluate - accuracy of FAME on reads simulated by Synth/SimReads\n\n";
+    std::cout << "Usage: Evaluate --truth <B_truth.tsv> --sam <alignments.sam> [options]\n";
+    std::cout << "       Evaluate --cpg_truth <B_cpg_truth.tsv> --cpg <B_cpg.tsv> [options]\n\n";
+    std::cout << "    --truth <file>          truth file of the simulation, needed by --sam\n";
+    std::cout << "    --sam <file>            alignments of FAME (--align_out), scored per read against the truth\n";
+    std::cout << "    --cpg_truth <file>      calls per CpG of the simulation (B_cpg_truth.tsv), needed by --cpg\n";
+    std::cout << "    --cpg <file>            CpG report of FAME, compared with --cpg_truth\n";
+    std::cout << "    --tolerance <n>         letters an alignment may be off the origin of the read (default 2)\n";
+    std::cout << "    --threads <n>           threads parsing the files (default 1)\n\n";
+    std::cout << "The read level (--truth, --sam) and the CpG level (--cpg_truth, --cpg) evaluation are independent,\n";
+    std::cout << "either or both may be run. All files may be gzip compressed. Reported are precision (correct / aligned) and recall\n";
+    std::cout << "(correct / simulated) of the reads, per substitutions per read and chromosome of origin, and\n";
+    std::cout << "precision and recall of the methylation calls per CpG.\n\n";
+}
+
+// value of the option at argv[i], i.e. argv[i + 1], terminates if there is none
+static const char* optionValue(int argc, char** argv, int& i)
+{
+    if (i + 1 >= argc)
+    {
+        std::cerr << "No value for option \"" << argv[i] << "\" provided! Terminating...\n\n";
+        exit(1);
+    }
+    return argv[++i];
+}
+
+static uint64_t parseUInt(const std::string& opt, const char* val)
+{
+    char* end;
+    const unsigned long long n = strtoull(val, &end, 10);
+    if (*val == '\0' || *end != '\0' || *val == '-')
+    {
+        std::cerr << "Invalid argument \"" << val << "\" for option \"" << opt << "\"! Terminating...\n\n";
+        exit(1);
+    }
+    return n;
+}
+
+int main(int argc, char** argv)
+{
+
+    std::string truthPath;
+    std::string samPath;
+    std::string cpgTruthPath;
+    std::string cpgPath;
+    uint64_t tolerance = 2;
+    uint64_t threads = 1;
+    if (argc == 1)
+    {
+        printHelp();
+        return 0;
+    }
+    for (int i = 1; i < argc; ++i)
+    {
+
+        const std::string arg(argv[i]);
+        if (arg == "-h" || arg == "--help")
+        {
+            printHelp();
+            return 0;
+
+        } else if (arg == "--truth") {
+
+            truthPath = optionValue(argc, argv, i);
+
+        } else if (arg == "--sam") {
+
+            samPath = optionValue(argc, argv, i);
+
+        } else if (arg == "--cpg_truth") {
+
+            cpgTruthPath = optionValue(argc, argv, i);
+
+        } else if (arg == "--cpg") {
+
+            cpgPath = optionValue(argc, argv, i);
+
+        } else if (arg == "--tolerance") {
+
+            tolerance = parseUInt(arg, optionValue(argc, argv, i));
+
+        } else if (arg == "--threads") {
+
+            threads = parseUInt(arg, optionValue(argc, argv, i));
+            if (threads == 0 || threads > 1024)
+            {
+                std::cerr << "Invalid number of threads " << threads << "! Terminating...\n\n";
+                exit(1);
+            }
+
+        } else {
+
+            std::cerr << "Don't know the option \"" << arg << "\", maybe you forgot a flag?\n\n";
+            exit(1);
+        }
+    }
+    // the read level (--sam) and the CpG level (--cpg) evaluation are independent, each needs its own truth
+    if (!samPath.empty() && truthPath.empty())
+    {
+        std::cerr << "--sam needs the read truth of the simulation (--truth)! Terminating...\n\n";
+        exit(1);
+    }
+    if (cpgPath.empty() != cpgTruthPath.empty())
+    {
+        std::cerr << "--cpg and --cpg_truth have to be given together! Terminating...\n\n";
+        exit(1);
+    }
+    if (samPath.empty() && cpgPath.empty())
+    {
+        std::cerr << "Nothing to evaluate, give --truth with --sam and/or --cpg_truth with --cpg! Terminating...\n\n";
+        exit(1);
+    }
+    if (samPath.empty() && !truthPath.empty())
+        std::cerr << "No alignments (--sam) given, --truth is not used.\n";
+
+    Evaluator eval(threads, tolerance);
+    if (!samPath.empty() && (!eval.loadTruth(truthPath) || !eval.scoreAlignments(samPath)))
+        return 1;
+    if (!cpgPath.empty() && !eval.scoreCpgs(cpgTruthPath, cpgPath))
+        return 1;
+    eval.report(std::cout);
+    return 0;
+}
@@ -0,0 +1,668 @@
+//	Metal - A fast methylation alignment and calling tool for WGBS data.
+//	Copyright (C) 2017  Jonas Fischer
+//
+//	This program is free software: you can redistribute it and/or modify
+//	it under the terms of the GNU General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+//
+//	This program is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//	GNU General Public License for more details.
+//
+//	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Jonas Fischer	jonaspost@web.de
+
+
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+#include <zlib.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "CONST.h"
+#include "FastqReader.h"
+
+
+// number of bytes read from the file at once
+constexpr size_t FASTQBLOCK = 1 << 22;
+// number of compressed bytes inflated at once
+constexpr size_t GZBLOCK = 1 << 20;
+// number of compressed bytes split into BGZF blocks at once
+// (a few blocks per thread, a BGZF block holds at most 64kB)
+constexpr size_t BGZFCHUNK = 1 << 21;
+// number of decompressed blocks the inflater may run ahead of the parser
+constexpr size_t RINGSIZE = 4;
+
+
+// checks if p points to the header of a BGZF block
+// ARGUMENTS:
+//          p       start of header
+//          avail   number of bytes available at p
+//          bsize   set to the full size of the block (header, data and footer)
+//          xlen    set to the size of the extra field of the header
+//
+// RETURN:  false iff p is no BGZF header or avail does not contain the full header
+static bool bgzfHeader(const unsigned char* p, const size_t avail, size_t& bsize, size_t& xlen)
+{
+
+    // magic, deflate, FEXTRA
+    if (avail < 12 || p[0] != 0x1f || p[1] != 0x8b || p[2] != 8 || !(p[3] & 4))
+        return false;
+
+    xlen = p[10] | (p[11] << 8);
+    if (avail < 12 + xlen)
+        return false;
+
+    // look for the BC subfield holding the block size
+    for (size_t i = 12; i + 4 <= 12 + xlen; )
+    {
+        const size_t slen = p[i + 2] | (p[i + 3] << 8);
+        if (p[i] == 'B' && p[i + 1] == 'C' && slen == 2 && i + 6 <= 12 + xlen)
+        {
+            bsize = (p[i + 4] | (p[i + 5] << 8)) + 1;
+            return bsize >= 12 + xlen + 8;
+        }
+        i += 4 + slen;
+    }
+    return false;
+}
+
+static inline uint32_t readLE32(const unsigned char* p)
+{
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) | (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+
+FastqReader::FastqReader() :
+        mode(NONE)
+    ,   headPos(0)
+    ,   inputBytes(0)
+    ,   recordNum(0)
+    ,   shardIdx(0)
+    ,   shardNum(1)
+    ,   shardBlock(1)
+    ,   barcodes(nullptr)
+    ,   ringHead(0)
+    ,   ringCount(0)
+    ,   inflaterDone(true)
+    ,   stopInflater(false)
+    ,   bufPos(0)
+    ,   bufEnd(0)
+    ,   inputEnd(true)
+{
+}
+
+FastqReader::~FastqReader()
+{
+    close();
+}
+
+bool FastqReader::open(const std::string& filePath, const bool isGZ)
+{
+
+    close();
+    if (!in.open(filePath))
+        return false;
+
+    mode = NONE;
+    head.clear();
+    headPos = 0;
+    inputBytes = 0;
+    recordNum = 0;
+    if (isGZ)
+    {
+
+        // like gzread, files without gzip magic are read as they are
+        head.resize(64);
+        head.resize(in.read(head.data(), head.size()));
+        const unsigned char* h = reinterpret_cast<const unsigned char*>(head.data());
+        size_t bsize, xlen;
+        if (bgzfHeader(h, head.size(), bsize, xlen))
+        {
+            mode = BGZF;
+
+        } else if (head.size() >= 2 && h[0] == 0x1f && h[1] == 0x8b) {
+
+            mode = GZIP;
+        }
+    }
+
+    buf.resize(FASTQBLOCK);
+    bufPos = 0;
+    bufEnd = 0;
+    inputEnd = false;
+
+    if (mode != NONE)
+    {
+        ring.resize(RINGSIZE);
+        ringHead = 0;
+        ringCount = 0;
+        inflaterDone = false;
+        stopInflater = false;
+        if (mode == BGZF)
+        {
+            inflater = std::thread(&FastqReader::inflateBgzf, this);
+        } else {
+            inflater = std::thread(&FastqReader::inflateGzip, this);
+        }
+    }
+    return true;
+}
+
+void FastqReader::close()
+{
+
+    if (inflater.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(ringMutex);
+            stopInflater = true;
+        }
+        ringCond.notify_all();
+        inflater.join();
+    }
+    in.close();
+    head.clear();
+    headPos = 0;
+    mode = NONE;
+    bufPos = 0;
+    bufEnd = 0;
+    inputEnd = true;
+}
+
+size_t FastqReader::read(ReadBatch& batch, const size_t n)
+{
+
+    const char* id;
+    const char* seq;
+    const char* qual;
+    size_t idLen;
+    size_t seqLen;
+    size_t qualLen;
+    size_t count = 0;
+    cellTags.clear();
+    while (count < n && nextRecord(id, idLen, seq, seqLen, qual, qualLen))
+    {
+        if (!inShard(recordNum - 1))
+            continue;
+        if (barcodes)
+        {
+            cellTags.push_back(barcodes->lookup(id, idLen, seq, seqLen));
+            const size_t clip = std::min<size_t>(barcodes->readLength(), seqLen);
+            seq += clip;
+            seqLen -= clip;
+            const size_t qualClip = std::min(clip, qualLen);
+            qual += qualClip;
+            qualLen -= qualClip;
+        }
+        batch.push(id, idLen, seq, trimmedLength(seq, seqLen, qual, qualLen), qual, qualLen);
+        ++count;
+    }
+    return count;
+}
+
+void FastqReader::setShard(const unsigned int idx, const unsigned int num, const uint64_t blockLen)
+{
+
+    shardIdx = idx;
+    shardNum = num;
+    shardBlock = blockLen;
+}
+
+size_t FastqReader::readPairs(ReadBatch& batch, ReadBatch& batch2, const size_t n)
+{
+
+    const char* id;
+    const char* seq;
+    const char* qual;
+    size_t idLen;
+    size_t seqLen;
+    size_t qualLen;
+    size_t count = 0;
+    while (count < n && nextRecord(id, idLen, seq, seqLen, qual, qualLen))
+    {
+        const bool keep = inShard((recordNum - 1) / 2);
+        if (keep)
+            batch.push(id, idLen, seq, trimmedLength(seq, seqLen, qual, qualLen), qual, qualLen);
+        if (!nextRecord(id, idLen, seq, seqLen, qual, qualLen))
+        {
+            std::cerr << "Interleaved read file ends with read 1 of a pair! Terminating...\n\n";
+            exit(1);
+        }
+        if (!keep)
+            continue;
+        batch2.push(id, idLen, seq, trimmedLength(seq, seqLen, qual, qualLen), qual, qualLen);
+        ++count;
+    }
+    return count;
+}
+
+bool FastqReader::nextRecord(const char*& id, size_t& idLen, const char*& seq, size_t& seqLen, const char*& qual, size_t& qualLen)
+{
+
+    while (true)
+    {
+
+        const char* start = buf.data() + bufPos;
+        const char* end = buf.data() + bufEnd;
+        // line breaks of the 4 lines of the record
+        const char* lineEnd[4];
+        const char* lineStart = start;
+        unsigned int lines = 0;
+        for (; lines < 4; ++lines)
+        {
+            lineEnd[lines] = static_cast<const char*>(memchr(lineStart, '\n', end - lineStart));
+            if (lineEnd[lines] == nullptr)
+                break;
+            lineStart = lineEnd[lines] + 1;
+        }
+
+        if (lines < 4 && !inputEnd)
+        {
+            refill();
+            continue;
+        }
+        if (lines < 4)
+        {
+            // nothing left but empty lines
+            if (std::all_of(start, end, [](const char c) { return c == '\n' || c == '\r'; }))
+            {
+                bufPos = bufEnd;
+                return false;
+            }
+            // last line of the file without line break
+            lineEnd[lines++] = end;
+            lineStart = end;
+            // incomplete records are filled up with empty lines
+            for (; lines < 4; ++lines)
+                lineEnd[lines] = end;
+        }
+
+        id = start;
+        idLen = lineEnd[0] - start;
+        seq = std::min(lineEnd[0] + 1, end);
+        seqLen = lineEnd[1] - seq;
+        qual = std::min(lineEnd[2] + 1, end);
+        qualLen = lineEnd[3] - qual;
+        bufPos = lineStart - buf.data();
+        ++recordNum;
+        return true;
+    }
+}
+
+size_t FastqReader::trimmedLength(const char* seq, const size_t seqLen, const char* qual, const size_t qualLen)
+{
+
+    size_t len = seqLen;
+    if (MyConst::trimQual > 0)
+    {
+        // running sum over the window [i, i + w)
+        const size_t qLen = std::min(seqLen, qualLen);
+        const size_t w = std::min<size_t>(MyConst::TRIMWINDOW, qLen);
+        const int cutoff = static_cast<int>(MyConst::trimQual * w);
+        int sum = 0;
+        for (size_t i = 0; i < w; ++i)
+            sum += qual[i] - static_cast<int>(MyConst::PHREDOFFSET);
+        for (size_t i = 0; ; ++i)
+        {
+            if (sum < cutoff)
+            {
+                // the leading bases of the window that pass the cutoff on their own are kept
+                len = i;
+                while (len < i + w && qual[len] - static_cast<int>(MyConst::PHREDOFFSET) >= static_cast<int>(MyConst::trimQual))
+                    ++len;
+                break;
+            }
+            if (i + w >= qLen)
+                break;
+            sum += qual[i + w] - qual[i];
+        }
+    }
+    if (MyConst::trimAdapter)
+    {
+        // true iff the adapter (or the prefix of it that fits) starts at p
+        auto isAdapter = [len, seq](const char* p)
+        {
+            return memcmp(p, MyConst::ADAPTER, std::min<size_t>(seq + len - p, MyConst::ADAPTERLEN)) == 0;
+        };
+        typedef char byteVec __attribute__ ((vector_size (16)));
+        constexpr size_t VECLEN = sizeof(byteVec);
+        size_t pos = 0;
+        // lanes of hit are set where the first ADAPTERMINLEN letters of the adapter start
+        for (; pos + VECLEN + MyConst::ADAPTERMINLEN - 1 <= len; pos += VECLEN)
+        {
+            byteVec hit;
+            memcpy(&hit, seq + pos, VECLEN);
+            hit = hit == MyConst::ADAPTER[0];
+            for (size_t k = 1; k < MyConst::ADAPTERMINLEN; ++k)
+            {
+                byteVec v;
+                memcpy(&v, seq + pos + k, VECLEN);
+                hit &= v == MyConst::ADAPTER[k];
+            }
+            uint64_t any[2];
+            memcpy(any, &hit, VECLEN);
+            if ((any[0] | any[1]) == 0)
+                continue;
+            for (size_t l = 0; l < VECLEN; ++l)
+            {
+                if (hit[l] && isAdapter(seq + pos + l))
+                    return pos + l;
+            }
+        }
+        for (; pos + MyConst::ADAPTERMINLEN <= len; ++pos)
+        {
+            if (isAdapter(seq + pos))
+                return pos;
+        }
+    }
+    return len;
+}
+
+bool FastqReader::skipTo(const uint64_t off, const uint64_t recs)
+{
+
+    // the inflater runs ahead, compressed files are skipped record by record
+    if (mode == NONE && headPos == head.size() && recordNum == 0)
+    {
+        if (in.seek(off))
+        {
+            inputBytes = off;
+            recordNum = recs;
+            bufPos = 0;
+            bufEnd = 0;
+            return true;
+        }
+        // pipes cannot seek, nothing was read by the failed attempt
+    }
+
+    const char* id;
+    const char* seq;
+    const char* qual;
+    size_t idLen;
+    size_t seqLen;
+    size_t qualLen;
+    while (recordNum < recs && nextRecord(id, idLen, seq, seqLen, qual, qualLen))
+    {
+    }
+    return recordNum == recs;
+}
+
+size_t FastqReader::readInput(char* dst, const size_t n)
+{
+
+    size_t got = std::min(n, head.size() - headPos);
+    memcpy(dst, head.data() + headPos, got);
+    headPos += got;
+    if (got < n)
+    {
+        got += in.read(dst + got, n - got);
+    }
+    inputBytes += got;
+    return got;
+}
+
+void FastqReader::refill()
+{
+
+    // move unparsed bytes to the front
+    const size_t rest = bufEnd - bufPos;
+    if (bufPos > 0)
+        memmove(buf.data(), buf.data() + bufPos, rest);
+    bufPos = 0;
+    bufEnd = rest;
+
+    if (mode == NONE)
+    {
+
+        // a single record is larger than the buffer
+        if (bufEnd + FASTQBLOCK / 2 > buf.size())
+            buf.resize(buf.size() * 2);
+
+        const size_t got = readInput(buf.data() + bufEnd, buf.size() - bufEnd);
+        bufEnd += got;
+        if (got == 0)
+            inputEnd = true;
+
+    } else {
+
+        if (!popBlock(block))
+        {
+            inputEnd = true;
+            return;
+        }
+        if (bufEnd + block.size() > buf.size())
+            buf.resize(bufEnd + block.size());
+        memcpy(buf.data() + bufEnd, block.data(), block.size());
+        bufEnd += block.size();
+    }
+}
+
+bool FastqReader::pushBlock(std::vector<char>& b)
+{
+
+    std::unique_lock<std::mutex> lock(ringMutex);
+    ringCond.wait(lock, [this]() { return ringCount < RINGSIZE || stopInflater; });
+    if (stopInflater)
+        return false;
+    ring[(ringHead + ringCount) % RINGSIZE].swap(b);
+    ++ringCount;
+    lock.unlock();
+    ringCond.notify_all();
+    return true;
+}
+
+bool FastqReader::popBlock(std::vector<char>& b)
+{
+
+    std::unique_lock<std::mutex> lock(ringMutex);
+    ringCond.wait(lock, [this]() { return ringCount > 0 || inflaterDone; });
+    if (ringCount == 0)
+        return false;
+    b.swap(ring[ringHead]);
+    ringHead = (ringHead + 1) % RINGSIZE;
+    --ringCount;
+    lock.unlock();
+    ringCond.notify_all();
+    return true;
+}
+
+void FastqReader::inflateGzip()
+{
+
+    z_stream strm;
+    strm.zalloc = Z_NULL;
+    strm.zfree = Z_NULL;
+    strm.opaque = Z_NULL;
+    strm.next_in = Z_NULL;
+    strm.avail_in = 0;
+    // 15 + 32 for gzip header detection
+    inflateInit2(&strm, 15 + 32);
+
+    std::vector<char> inBuf(GZBLOCK);
+    std::vector<char> out;
+    bool fileEnd = false;
+    bool streamEnd = false;
+    while (!streamEnd)
+    {
+
+        out.resize(FASTQBLOCK);
+        strm.next_out = reinterpret_cast<Bytef*>(out.data());
+        strm.avail_out = FASTQBLOCK;
+        while (strm.avail_out > 0)
+        {
+
+            if (strm.avail_in == 0)
+            {
+                strm.avail_in = readInput(inBuf.data(), GZBLOCK);
+                strm.next_in = reinterpret_cast<Bytef*>(inBuf.data());
+                if (strm.avail_in == 0)
+                {
+                    fileEnd = true;
+                    break;
+                }
+            }
+
+            const int ret = inflate(&strm, Z_NO_FLUSH);
+            if (ret == Z_STREAM_END)
+            {
+                // gzip files may consist of several concatenated members
+                if (strm.avail_in == 0 && headPos == head.size() && in.atEnd())
+                {
+                    streamEnd = true;
+                    break;
+                }
+                inflateReset(&strm);
+
+            } else if (ret != Z_OK) {
+
+                std::cerr << "Error while decompressing gzipped reads (" << (strm.msg ? strm.msg : "invalid data") << ")! Terminating...\n\n";
+                exit(1);
+            }
+        }
+        if (fileEnd && !streamEnd)
+        {
+            std::cerr << "WARNING: Gzipped read file ends unexpectedly, ignoring the incomplete end.\n";
+            streamEnd = true;
+        }
+
+        out.resize(FASTQBLOCK - strm.avail_out);
+        if (!out.empty() && !pushBlock(out))
+            break;
+    }
+    inflateEnd(&strm);
+
+    {
+        std::lock_guard<std::mutex> lock(ringMutex);
+        inflaterDone = true;
+    }
+    ringCond.notify_all();
+}
+
+void FastqReader::inflateBgzf()
+{
+
+    // one inflate stream per thread, reset for every block
+    std::vector<z_stream> streams(CORENUM);
+    for (z_stream& strm : streams)
+    {
+        strm.zalloc = Z_NULL;
+        strm.zfree = Z_NULL;
+        strm.opaque = Z_NULL;
+        strm.next_in = Z_NULL;
+        strm.avail_in = 0;
+        // raw deflate data, headers are parsed here
+        inflateInit2(&strm, -15);
+    }
+
+    std::vector<unsigned char> inBuf(BGZFCHUNK);
+    size_t inLen = 0;
+    bool fileEnd = false;
+    // start of blocks in inBuf and offset of blocks in decompressed output
+    std::vector<size_t> blockStart;
+    std::vector<size_t> blockSize;
+    std::vector<size_t> outOff;
+    std::vector<char> out;
+    while (true)
+    {
+
+        if (!fileEnd)
+        {
+            const size_t space = BGZFCHUNK - inLen;
+            const size_t got = readInput(reinterpret_cast<char*>(inBuf.data()) + inLen, space);
+            inLen += got;
+            if (got < space)
+                fileEnd = true;
+        }
+
+        // split complete blocks
+        blockStart.clear();
+        blockSize.clear();
+        outOff.assign(1, 0);
+        size_t pos = 0;
+        while (pos < inLen)
+        {
+            const unsigned char* b = inBuf.data() + pos;
+            const size_t avail = inLen - pos;
+            // header incomplete, read on in next round
+            if (!fileEnd && (avail < 12 || avail < 12 + static_cast<size_t>(b[10] | (b[11] << 8))))
+                break;
+            size_t bsize, xlen;
+            if (!bgzfHeader(b, avail, bsize, xlen))
+            {
+                std::cerr << "Error while decompressing bgzipped reads (invalid BGZF block)! Terminating...\n\n";
+                exit(1);
+            }
+            if (pos + bsize > inLen)
+                break;
+            blockStart.push_back(pos);
+            blockSize.push_back(bsize);
+            outOff.push_back(outOff.back() + readLE32(inBuf.data() + pos + bsize - 4));
+            pos += bsize;
+        }
+        if (blockStart.empty() && fileEnd)
+        {
+            if (pos < inLen)
+                std::cerr << "WARNING: Bgzipped read file ends unexpectedly, ignoring the incomplete end.\n";
+            break;
+        }
+
+        out.resize(outOff.back());
+        bool blockError = false;
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(CORENUM) schedule(dynamic)
+#endif
+        for (size_t i = 0; i < blockStart.size(); ++i)
+        {
+
+            const unsigned char* b = inBuf.data() + blockStart[i];
+            const size_t xlen = b[10] | (b[11] << 8);
+#ifdef _OPENMP
+            z_stream& strm = streams[omp_get_thread_num()];
+#else
+            z_stream& strm = streams[0];
+#endif
+            inflateReset(&strm);
+            strm.next_in = const_cast<Bytef*>(b + 12 + xlen);
+            strm.avail_in = blockSize[i] - 12 - xlen - 8;
+            strm.next_out = reinterpret_cast<Bytef*>(out.data() + outOff[i]);
+            strm.avail_out = outOff[i + 1] - outOff[i];
+            const int ret = inflate(&strm, Z_FINISH);
+            const uint32_t crc = crc32(0L, reinterpret_cast<const Bytef*>(out.data() + outOff[i]), outOff[i + 1] - outOff[i]);
+            if (ret != Z_STREAM_END || strm.avail_out != 0 || crc != readLE32(b + blockSize[i] - 8))
+            {
+#ifdef _OPENMP
+#pragma omp atomic write
+#endif
+                blockError = true;
+            }
+        }
+        if (blockError)
+        {
+            std::cerr << "Error while decompressing bgzipped reads (corrupt BGZF block)! Terminating...\n\n";
+            exit(1);
+        }
+
+        // keep incomplete block for next round
+        memmove(inBuf.data(), inBuf.data() + pos, inLen - pos);
+        inLen -= pos;
+        // the EOF block is empty
+        if (!out.empty() && !pushBlock(out))
+            break;
+    }
+    for (z_stream& strm : streams)
+        inflateEnd(&strm);
+
+    {
+        std::lock_guard<std::mutex> lock(ringMutex);
+        inflaterDone = true;
+    }
+    ringCond.notify_all();
+}
@@ -0,0 +1,184 @@
+//	Metal - A fast methylation alignment and calling tool for WGBS data.
+//	Copyright (C) 2017  Jonas Fischer
+//
+//	This program is free software: you can redistribute it and/or modify
+//	it under the terms of the GNU General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+//
+//	This program is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//	GNU General Public License for more details.
+//
+//	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Jonas Fischer	jonaspost@web.de
+
+
+#ifndef FASTQREADER_H
+#define FASTQREADER_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "Read.h"
+#include "AsyncIO.h"
+#include "CellBarcodes.h"
+
+
+// Input source for FASTQ files (plain or gzip compressed)
+// The file is read in large blocks, records are split at line breaks with memchr and
+// id and sequence are copied straight into the arena of a ReadBatch. The "+" line is
+// skipped, the quality line is only copied if the batch keeps qualities. With MyConst::trimQual or MyConst::trimAdapter
+// set, the sequence is cut before it is copied (see trimmedLength).
+// Compressed files are inflated by a separate thread that hands decompressed blocks
+// to the parser through a small ring of buffers. If the file is BGZF (bgzip), the
+// thread splits the input at block boundaries and inflates CORENUM blocks in parallel.
+// The input is read strictly sequentially, such that pipes and FIFOs work as well ("-" reads stdin). Regular files
+// keep MyConst::ioDepth reads in flight ahead of the parser (see AsyncIO.h).
+class FastqReader
+{
+
+    public:
+
+        FastqReader();
+        ~FastqReader();
+
+        FastqReader(const FastqReader&) = delete;
+        FastqReader& operator=(const FastqReader&) = delete;
+
+        // opens file filePath for reading
+        // ARGUMENTS:
+        //          filePath    path of FASTQ file, "-" for stdin
+        //          isGZ        flag - true iff file is gzip compressed
+        //
+        // RETURN:  true iff file could be opened
+        bool open(const std::string& filePath, const bool isGZ);
+
+        void close();
+
+        inline bool isOpen() const { return in.isOpen(); }
+
+        // appends up to n reads to batch, does NOT call batch.bind()
+        //
+        // RETURN:  number of reads appended, less than n iff the end of the file was reached
+        size_t read(ReadBatch& batch, const size_t n);
+
+        // appends up to n pairs of an interleaved file (read 1 and read 2 of a pair in consecutive records) to
+        // batch and batch2, does NOT call bind(); terminates if the file ends inside a pair
+        //
+        // RETURN:  number of pairs appended, less than n iff the end of the file was reached
+        size_t readPairs(ReadBatch& batch, ReadBatch& batch2, const size_t n);
+
+        // only records (pairs for readPairs) in the blocks of shard idx out of num are returned by read and
+        // readPairs, the file is cut into blocks of blockLen records (pairs)
+        void setShard(const unsigned int idx, const unsigned int num, const uint64_t blockLen);
+
+        // tags every read returned by read with the cell of its barcode, the letters of a barcode in the sequence
+        // are cut off before trimming; no tags if bc is nullptr
+        inline void setBarcodes(const CellBarcodes* bc) { barcodes = bc; }
+        // cells of the reads appended by the last call to read (see setBarcodes), CellBarcodes::NOCELL for reads
+        // whose barcode is not on the whitelist
+        inline const std::vector<uint32_t>& cells() const { return cellTags; }
+
+        // number of records parsed since the file was opened, including those of other shards
+        inline uint64_t records() const { return recordNum; }
+        // byte offset of the next record in the file, only meaningful for uncompressed files
+        inline uint64_t offset() const { return inputBytes - (bufEnd - bufPos); }
+        // continues reading at the record with number recs, which starts at byte off of an uncompressed file
+        // (see offset()); seeks if possible, otherwise the records before are parsed and dropped
+        //
+        // RETURN:  false iff the file has less than recs records
+        bool skipTo(const uint64_t off, const uint64_t recs);
+
+
+    private:
+
+        // finds the next record in the buffer, refilling it as needed
+        // ARGUMENTS:
+        //          id, idLen, seq, seqLen  set to id and sequence line of the record (without line break)
+        //          qual, qualLen           set to the quality line of the record (without line break)
+        //
+        // RETURN:  false iff there is no further record
+        bool nextRecord(const char*& id, size_t& idLen, const char*& seq, size_t& seqLen, const char*& qual, size_t& qualLen);
+
+        // length of seq after quality and adapter trimming as set by MyConst::trimQual and MyConst::trimAdapter
+        // the adapter prefix is searched 16 positions at a time in vector registers, candidates are compared in full
+        //
+        // RETURN:  number of letters of seq to keep
+        static size_t trimmedLength(const char* seq, const size_t seqLen, const char* qual, const size_t qualLen);
+
+        // reads up to n bytes of the file to dst, starting with the bytes open() looked at to detect the format
+        // RETURN:  number of bytes read, less than n iff the end of the file was reached
+        size_t readInput(char* dst, const size_t n);
+
+        // moves the unparsed bytes to the front of the buffer and appends the next block of the file
+        // the buffer is grown if a single record does not fit into it
+        void refill();
+
+        // bodies of the inflater thread for gzip and BGZF input, respectively
+        void inflateGzip();
+        void inflateBgzf();
+
+        // hands block to the parser, block is swapped with a free buffer of the ring
+        // RETURN:  false iff the reader is closed and the inflater must stop
+        bool pushBlock(std::vector<char>& block);
+        // takes the next decompressed block, blocks until one is available
+        // RETURN:  false iff the inflater finished and all blocks are taken
+        bool popBlock(std::vector<char>& block);
+
+        // how the file content is stored
+        enum COMPRESSION { NONE, GZIP, BGZF };
+        COMPRESSION mode;
+
+        AsyncReader in;
+        // bytes read by open() to detect the compression, consumed by readInput before the rest of the file
+        // (the file is not rewound, which would fail on pipes)
+        std::vector<char> head;
+        size_t headPos;
+        // bytes returned by readInput and records returned by nextRecord since open()
+        uint64_t inputBytes;
+        uint64_t recordNum;
+        // see setShard
+        unsigned int shardIdx;
+        unsigned int shardNum;
+        uint64_t shardBlock;
+        // see setBarcodes
+        const CellBarcodes* barcodes;
+        std::vector<uint32_t> cellTags;
+        // true iff the record (pair) with number rec belongs to this shard
+        inline bool inShard(const uint64_t rec) const
+        {
+            return shardNum == 1 || (rec / shardBlock) % shardNum == shardIdx;
+        }
+
+        // inflater thread and the ring of decompressed blocks passed to the parser
+        std::thread inflater;
+        std::mutex ringMutex;
+        std::condition_variable ringCond;
+        std::vector<std::vector<char> > ring;
+        // index of the oldest block and number of blocks in ring
+        size_t ringHead;
+        size_t ringCount;
+        // flag - true iff the inflater pushed its last block
+        bool inflaterDone;
+        // flag - true iff the reader is closed while the inflater is running
+        bool stopInflater;
+        // block taken from the ring last
+        std::vector<char> block;
+
+        // block buffer, bytes [bufPos, bufEnd) are not parsed yet
+        std::vector<char> buf;
+        size_t bufPos;
+        size_t bufEnd;
+        // flag - true iff all bytes of the file are in the buffer
+        bool inputEnd;
+};
+
+#endif /* FASTQREADER_H */
@@ -0,0 +1,119 @@
+//	Metal - A fast methylation alignment and calling tool for WGBS data.
+//	Copyright (C) 2017  Jonas Fischer
+//
+//	This program is free software: you can redistribute it and/or modify
+//	it under the terms of the GNU General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+//
+//	This program is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//	GNU General Public License for more details.
+//
+//	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Jonas Fischer	jonaspost@web.de
+
+#include <iostream>
+
+#include "FastqWriter.h"
+
+
+// maximum number of chunks handed over but not written yet
+constexpr size_t PENDINGCHUNKS = 4;
+// compression level of gzip output, the fastest level keeps the writer thread ahead of the matching
+static const char* const GZMODE = "wb1";
+
+
+FastqWriter::FastqWriter() :
+        file(nullptr)
+    ,   closing(false)
+    ,   failed(false)
+{
+}
+
+FastqWriter::~FastqWriter()
+{
+    close();
+}
+
+bool FastqWriter::open(const std::string& filePath, const bool isGZ)
+{
+
+    close();
+    // transparent mode writes the bytes as they are
+    file = gzopen(filePath.c_str(), isGZ ? GZMODE : "wT");
+    if (file == nullptr)
+        return false;
+    gzbuffer(file, 1 << 20);
+    path = filePath;
+    closing = false;
+    failed = false;
+    writer = std::thread(&FastqWriter::drain, this);
+    return true;
+}
+
+void FastqWriter::close()
+{
+
+    if (file == nullptr)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(chunkMutex);
+        closing = true;
+    }
+    chunkCond.notify_all();
+    writer.join();
+    if (gzclose(file) != Z_OK)
+        failed = true;
+    file = nullptr;
+    if (failed)
+        std::cerr << "Error while writing \"" << path << "\", the file is incomplete.\n";
+    pending.clear();
+    spare.clear();
+}
+
+void FastqWriter::write(std::string& chunk)
+{
+
+    if (chunk.empty())
+        return;
+    std::unique_lock<std::mutex> lock(chunkMutex);
+    chunkCond.wait(lock, [this]() { return pending.size() < PENDINGCHUNKS; });
+    pending.emplace_back();
+    pending.back().swap(chunk);
+    if (!spare.empty())
+    {
+        chunk.swap(spare.back());
+        spare.pop_back();
+    }
+    lock.unlock();
+    chunkCond.notify_all();
+}
+
+void FastqWriter::drain()
+{
+
+    std::unique_lock<std::mutex> lock(chunkMutex);
+    while (true)
+    {
+        chunkCond.wait(lock, [this]() { return closing || !pending.empty(); });
+        if (pending.empty())
+            return;
+        std::string chunk;
+        chunk.swap(pending.front());
+        pending.pop_front();
+        lock.unlock();
+        chunkCond.notify_all();
+
+        // gzwrite takes at most UINT_MAX bytes at once, chunks are far smaller
+        if (!failed && gzwrite(file, chunk.data(), static_cast<unsigned int>(chunk.size())) != static_cast<int>(chunk.size()))
+            failed = true;
+        chunk.clear();
+
+        lock.lock();
+        spare.push_back(std::move(chunk));
+    }
+}
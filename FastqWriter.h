@@ -0,0 +1,84 @@
+//	Metal - A fast methylation alignment and calling tool for WGBS data.
+//	Copyright (C) 2017  Jonas Fischer
+//
+//	This program is free software: you can redistribute it and/or modify
+//	it under the terms of the GNU General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+//
+//	This program is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//	GNU General Public License for more details.
+//
+//	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Jonas Fischer	jonaspost@web.de
+
+#ifndef FASTQWRITER_H
+#define FASTQWRITER_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <zlib.h>
+
+
+// Output sink for FASTQ records (plain or gzip compressed)
+// The caller hands over chunks of formatted records, a separate thread compresses and writes them,
+// such that the matching threads never wait for zlib. At most a few chunks are pending,
+// beyond that write blocks until the thread caught up. The buffers of written chunks are handed back
+// to the caller, such that formatting further chunks does not allocate.
+class FastqWriter
+{
+
+    public:
+
+        FastqWriter();
+        ~FastqWriter();
+
+        FastqWriter(const FastqWriter&) = delete;
+        FastqWriter& operator=(const FastqWriter&) = delete;
+
+        // opens file filePath for writing, truncating it, and starts the writer thread
+        // ARGUMENTS:
+        //          filePath    path of output file
+        //          isGZ        flag - true iff output should be gzip compressed
+        //
+        // RETURN:  true iff file could be opened
+        bool open(const std::string& filePath, const bool isGZ);
+
+        // writes all pending chunks, stops the writer thread and closes the file
+        void close();
+
+        inline bool isOpen() const { return file != nullptr; }
+
+        // queues the records in chunk for writing, chunk is left empty (keeping the memory of an earlier chunk)
+        void write(std::string& chunk);
+
+    private:
+
+        // writer thread: writes the pending chunks in order until the writer is closed
+        void drain();
+
+        gzFile file;
+        std::string path;
+
+        std::thread writer;
+        std::mutex chunkMutex;
+        std::condition_variable chunkCond;
+        // chunks in the order they were handed over, the oldest one is written next
+        std::deque<std::string> pending;
+        // written chunks whose memory is reused by write
+        std::vector<std::string> spare;
+        // flag - true iff the thread writes the last pending chunks and ends
+        bool closing;
+        // flag - true iff writing failed, reported once when the writer is closed
+        bool failed;
+};
+
+#endif /* FASTQWRITER_H */
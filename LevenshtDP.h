@@ -16,15 +16,19 @@
 //
 //	Jonas Fischer	jonaspost@web.de
 
+
 #ifndef LEVENSHTDP_H
 #define LEVENSHTDP_H
 
 #include <string>
+#include <vector>
+#include <array>
+#include <cstdint>
 #include <limits>   // numeric limits (max)
+#include <algorithm>
 #include <iostream> // cerr
 
-
-#include "BandedMatrix.h"
+#include "SeqView.h"
 
 
 // types of errors allowed
@@ -35,21 +39,35 @@ enum ERROR_T {MATCHING, MISMATCH, INSERTION, DELETION};
 // it is REQUIRED that the first given string (rowStr in Ctor) must be fully
 // matched!
 //
-// template parameter is the size type T of the underlying matrix
+// template parameter is the size type T of the returned distances
 // i.e. should be the minimal size type that fits the max of the two string sizes
 // and the bandwidth of the banded alignment
 // i.e. the number of errors allowed (hence we only fill some diagonals in the matrix)
+//
+// The band of a row (2*band + 1 cells) is represented by bitvectors (see Hyyro,
+// "A bit-vector algorithm for computing Levenshtein and Damerau edit distances", 2003)
+// storing the differences to neighbouring cells, so a whole row is computed with a constant
+// number of word operations
+// For row i and column j = i - band + k the bit k of
+//      diag        is set iff D(i,j) - D(i-1,j-1) == 1 (otherwise 0)
+//      horP        is set iff D(i,j) - D(i,j-1) == 1
+//      horN        is set iff D(i,j) - D(i,j-1) == -1
+// and base is the value of D(i, i - band)
+// Columns left of the matrix (j < 0) are treated as virtual cells with D(i,j) = i - j,
+// which equals the usual initialization of the first row/column and does not change any other cell
 template <typename T, size_t band>
 class LevenshtDP
 {
 
+    static_assert(2 * band + 1 < 64, "LevenshtDP: band does not fit into a machine word");
+
     public:
 
         // ------ Ctors ------
 
         LevenshtDP() = delete;
 
-        LevenshtDP(const std::string& rowStr, const char* colStr);
+        LevenshtDP(const SeqView& rowStr, const char* colStr);
 
         // -------------------
 
@@ -57,7 +75,7 @@ class LevenshtDP
         // compute the levenshtein distance
         //
         // ARGUMENTS:
-        //      comp        comparison function for the letters
+        //      comp        comparison function for the letters, returns 0 for a match and 1 otherwise
         //
         template <typename C>
         void runDPFill(C& comp);
@@ -71,7 +89,7 @@ class LevenshtDP
         {
             T minimum = std::numeric_limits<T>::max();
             for (long offset = -static_cast<long>(band); offset <= static_cast<long>(band); ++offset)
-                minimum = std::min(minimum, dpMatrix(rowPat.size(), rowPat.size() + offset));
+                minimum = std::min(minimum, dpVal(rowPat.size(), rowPat.size() + offset));
             return minimum;
         }
 
@@ -93,55 +111,88 @@ class LevenshtDP
 
     private:
 
-        // recursive formulation of the levenshtein distance
-        // DP drops in here
-        //
-        // Formula:
-        //
-        //          LevRec(i,j) = min {LevRec(i-1,j) + 1, LevRec(i,j-1) + 1,
-        //                              LevRec(i-1,j-1) + isEqual(rowPat(i),colPat(j)) }
-        //
-        // ARGUMENTS:
-        //          indices of positions in strings
-        //          i       position in rowPat
-        //          j       position in colPat
-        //          comp    comparison function for the letters
-        //
-        //
+        // bitvector representation of one row of the band, see class description
+        struct bandRow {
+
+            uint64_t diag;
+            uint64_t horP;
+            uint64_t horN;
+            T base;
+
+        };
+
+        // number of cells in one row of the band
+        static constexpr uint64_t bandW = 2 * band + 1;
+        static constexpr uint64_t bandMask = (1ULL << bandW) - 1;
+
+        // fill the band row by row, the read letter of row i is rowPat[i - 1] if rev, rowPat[size - i] otherwise
+        template <typename C>
+        inline void fill(C& comp, const bool rev);
+        template <typename C>
+        inline void backtrack(C& comp, const bool rev, std::vector<ERROR_T>& alignment);
+
+        // computes the bitmask of reference positions matching letter c according to comp
+        // bit j + band is set iff reference letter j (1-based, running from colPat to the left) matches c
         // RETURN:
-        //          solution to recurrence
+        //      pointer to the first word of the mask
         template <typename C>
-        inline T LevRec(long i, long j, C& comp)
+        inline const uint64_t* matchMask(C& comp, const char c);
+        // computes the masks of the reference letters that matchMask combines
+        inline void classifyRef();
+
+        // bits [pos, pos + bandW) of mask
+        inline uint64_t maskWindow(const uint64_t* mask, const size_t pos)
         {
-            T mismatchTest = comp(rowPat[rowPat.size() - i], *(colPat-j+1));
-            return std::min({dpMatrix(i-1,j) + 1, dpMatrix(i,j-1) + 1, dpMatrix(i-1,j-1) + mismatchTest});
+            const size_t w = pos >> 6;
+            const size_t s = pos & 63;
+            uint64_t bits = mask[w] >> s;
+            if (s)
+                bits |= mask[w + 1] << (64 - s);
+            return bits & bandMask;
         }
-        // if we want to align reverse sequence
-        template <typename C>
-        inline T LevRecRev(long i, long j, C& comp)
+
+        // value of the cell (i,j), infinity for cells outside the band
+        inline T dpVal(const long i, const long j)
         {
-            T mismatchTest = comp(rowPat[i-1], *(colPat-j+1));
-            return std::min({dpMatrix(i-1,j) + 1, dpMatrix(i,j-1) + 1, dpMatrix(i-1,j-1) + mismatchTest});
+            if (j - i > static_cast<long>(band) || i - j > static_cast<long>(band))
+                return std::numeric_limits<T>::max();
+            const bandRow& r = rows[i];
+            // prefix of the row up to (including) cell j, without the base cell
+            const uint64_t pre = ((2ULL << (j - i + band)) - 1) & ~1ULL;
+            return r.base + __builtin_popcountll(r.horP & pre) - __builtin_popcountll(r.horN & pre);
         }
 
         // the two strings that are compared
         // rowPat is represented by rows of the DP matrix
         // colPat is represented by columns in DP matrix
-        const std::string& rowPat;
+        const SeqView rowPat;
         const char* colPat;
 
-        // underlying dp matrix
-        // note that bandwidth is extended by one for the edge cases
-        BandedMatrix<T, band + 1> dpMatrix;
+        // rows of the banded dp matrix, rows[0] being the initial row
+        std::vector<bandRow> rows;
+
+        // per letter masks of colPat computed by matchMask, preceded by the masks of the letters in refLetters
+        // and the mask of all other letters
+        // maskSlot[c] is the index of the mask of letter c in masks, or -1 if not yet computed
+        std::array<int8_t, 256> maskSlot;
+        std::vector<uint64_t> masks;
+        // true iff colPat only consists of letters in refLetters
+        bool refPlain;
+        static constexpr std::array<char, 5> refLetters = {{'A', 'C', 'G', 'T', 'N'}};
+        // number of words of a single mask
+        size_t maskWords;
 
 };
 
 
 template <typename T, size_t band>
-LevenshtDP<T, band>::LevenshtDP(const std::string& rowStr, const char* colStr) :
+LevenshtDP<T, band>::LevenshtDP(const SeqView& rowStr, const char* colStr) :
         rowPat(rowStr)
     ,   colPat(colStr)
-    ,   dpMatrix(rowStr.size() + 1, rowStr.size() + 1 + band, static_cast<T>(0))
+    ,   rows(rowStr.size() + 1)
+    ,   refPlain(true)
+        // bits up to rowStr.size() + 2 * band are used, plus one word for reading windows at the end
+    ,   maskWords(((rowStr.size() + 2 * band) >> 6) + 2)
 {
     // check if template param is correct size type
     if (!std::is_integral<T>::value)
@@ -149,211 +200,155 @@ LevenshtDP<T, band>::LevenshtDP(const std::string& rowStr, const char* colStr) :
         std::cerr << "\n\n(LevenshtDP) Template parameter is not a valid integral type! Terminating...\n\n";
         exit(1);
     }
+    // masks of the reference letters and the read letters A,C,G,T and N
+    masks.reserve((2 * refLetters.size() + 1) * maskWords);
 }
 
+template <typename T, size_t band>
+constexpr std::array<char, 5> LevenshtDP<T, band>::refLetters;
+
 template <typename T, size_t band>
 template <typename C>
 void LevenshtDP<T, band>::runDPFill(C& comp)
 {
+    fill<C>(comp, false);
+}
+template <typename T, size_t band>
+template <typename C>
+void LevenshtDP<T, band>::runDPFillRev(C& comp)
+{
+    fill<C>(comp, true);
+}
 
-    // INIT BORDERS
-
-    dpMatrix(0,0) = 0;
+template <typename T, size_t band>
+template <typename C>
+inline const uint64_t* LevenshtDP<T, band>::matchMask(C& comp, const char c)
+{
 
-    // initialize first row
-    for (long col = 1; col <= static_cast<long>(band); ++col)
-    {
-        dpMatrix(0, col) = col;
-    }
-    // init first column
-    for (long row = 1; row <= static_cast<long>(band); ++row)
+    int8_t& slot = maskSlot[static_cast<unsigned char>(c)];
+    if (slot < 0)
     {
-        dpMatrix(row, 0) = row;
-    }
-    // init outermost lefthanded band
-    for (long col = 0; col < static_cast<long>(rowPat.size() - band); ++col)
-    {
-        dpMatrix(col + (band + 1), col) = std::numeric_limits<T>::max() - col - band - 1;
-    }
-    // init outermost righthanded band
-    for (long row = 0; row < static_cast<long>(rowPat.size()); ++row)
-    {
-        dpMatrix(row, row + (band + 1)) = std::numeric_limits<T>::max() - row - band - 1;
-    }
 
+        slot = masks.size() / maskWords;
+        masks.resize(masks.size() + maskWords, 0);
+        uint64_t* mask = masks.data() + slot * maskWords;
 
-    // FILL MATRIX
-    for (long row = 1; row <= static_cast<long>(rowPat.size()); ++row)
-    {
-
-        for (long offset = -band; offset <= static_cast<long>(band); ++offset)
+        if (refPlain)
         {
-            // skip borders
-            if (row + offset <= 0)
-                continue;
+            // combine the masks of all reference letters matching c
+            for (size_t l = 0; l < refLetters.size(); ++l)
+            {
+                if (comp(c, refLetters[l]))
+                    continue;
+                const uint64_t* refMask = masks.data() + l * maskWords;
+                for (size_t w = 0; w < maskWords; ++w)
+                    mask[w] |= refMask[w];
+            }
+
+        } else {
 
-            dpMatrix(row, row + offset) = LevRec<C>(row, row + offset, comp);
+            for (size_t j = 1; j <= rowPat.size() + band; ++j)
+            {
+                if (!comp(c, *(colPat - j + 1)))
+                    mask[(j + band) >> 6] |= 1ULL << ((j + band) & 63);
+            }
         }
     }
-
-    // // TEST PRINTOUT
-    // for (long row = 0; row <= static_cast<long>(rowPat.size()); ++row)
-    // {
-    //     for (long offset = -band - 1; offset <= static_cast<long>(band + 1); ++offset)
-    //     {
-    //         // skip borders
-    //         if (row + offset < 0)
-    //             continue;
-    //         if (row  + offset > rowPat.size() + band)
-    //             continue;
-    //         std::cout << dpMatrix(row, row + offset) << "\t";
-    //     }
-    //     std::cout << "\n";
-    // }
+    return masks.data() + slot * maskWords;
 }
+
 template <typename T, size_t band>
-template <typename C>
-void LevenshtDP<T, band>::runDPFillRev(C& comp)
+inline void LevenshtDP<T, band>::classifyRef()
 {
 
-    // INIT BORDERS
-
-    dpMatrix(0,0) = 0;
-
-    // initialize first row
-    for (long col = 1; col <= static_cast<long>(band); ++col)
+    // index of each letter in refLetters, refLetters.size() for all other letters
+    static const std::array<uint8_t, 256> letterIdx = [] {
+        std::array<uint8_t, 256> idx;
+        idx.fill(refLetters.size());
+        for (size_t l = 0; l < refLetters.size(); ++l)
+            idx[static_cast<unsigned char>(refLetters[l])] = l;
+        return idx;
+    }();
+
+    // one mask per reference letter in front of the letter masks, plus one for all other letters
+    // done without branching on the letters, which are random to the branch predictor
+    masks.assign((refLetters.size() + 1) * maskWords, 0);
+    maskSlot.fill(-1);
+    for (size_t j = 1; j <= rowPat.size() + band; ++j)
     {
-        dpMatrix(0, col) = col;
+        const size_t l = letterIdx[static_cast<unsigned char>(*(colPat - j + 1))];
+        masks[l * maskWords + ((j + band) >> 6)] |= 1ULL << ((j + band) & 63);
     }
-    // init first column
-    for (long row = 1; row <= static_cast<long>(band); ++row)
-    {
-        dpMatrix(row, 0) = row;
-    }
-    // init outermost lefthanded band
-    for (long col = 0; col < static_cast<long>(rowPat.size() - band); ++col)
-    {
-        dpMatrix(col + (band + 1), col) = std::numeric_limits<T>::max() - col - band - 1;
-    }
-    // init outermost righthanded band
-    for (long row = 0; row < static_cast<long>(rowPat.size()); ++row)
-    {
-        dpMatrix(row, row + (band + 1)) = std::numeric_limits<T>::max() - row - band - 1;
-    }
-
-
-    // FILL MATRIX
-    for (long row = 1; row <= static_cast<long>(rowPat.size()); ++row)
+    refPlain = true;
+    for (size_t w = 0; w < maskWords; ++w)
     {
-
-        for (long offset = -band; offset <= static_cast<long>(band); ++offset)
-        {
-            // skip borders
-            if (row + offset <= 0)
-                continue;
-
-            dpMatrix(row, row + offset) = LevRecRev<C>(row, row + offset, comp);
-        }
+        if (masks[refLetters.size() * maskWords + w])
+            refPlain = false;
     }
-    // // TEST PRINTOUT
-    // for (long row = 0; row <= static_cast<long>(rowPat.size()); ++row)
-    // {
-    //     for (long offset = -band - 1; offset <= static_cast<long>(band + 1); ++offset)
-    //     {
-    //         // skip borders
-    //         if (row + offset < 0)
-    //             continue;
-    //         if (row  + offset > rowPat.size() + band)
-    //             continue;
-    //         std::cout << dpMatrix(row, row + offset) << "\t";
-    //     }
-    //     std::cout << "\n";
-    // }
 }
 
-
-
 template <typename T, size_t band>
 template <typename C>
-void LevenshtDP<T, band>::backtrackDP(C& comp, std::vector<ERROR_T>& alignment)
+inline void LevenshtDP<T, band>::fill(C& comp, const bool rev)
 {
 
-    // the trace of errors
-    // note that insertion means we have an additional character in the PATTERN (rowPat)
-    // and deletion analogously
-    // we start indexing for the character in the back
-    // that is alignment[0] is the error type of the last character
-    alignment.reserve(rowPat.size() + band);
-    // find minimum in the last part of table
-    T minimum = std::numeric_limits<T>::max();
-    // stores the index of the cell of the minimum
-    size_t col = 0;
-    for (long offset = -static_cast<long>(band); offset <= static_cast<long>(band); ++offset)
-    {
-        const T& valRef = dpMatrix(rowPat.size(), rowPat.size() + offset);
-        if (valRef < minimum)
-        {
-
-            col = rowPat.size() + offset;
-            minimum = valRef;
-        }
-    }
-
-    // BACKTRACK
-    // starting from the minimum cell in the last column
-    for (long row = rowPat.size(); row > 0;)
-    {
+    classifyRef();
 
-        // check if characters match
-        T mismatchFlag = comp(rowPat[rowPat.size() - row], *(colPat-col+1));
+    // INIT FIRST ROW
+    // D(0,j) = |j| for j in [-band, band]
+    rows[0].base = band;
+    rows[0].diag = 0;
+    rows[0].horN = ((1ULL << (band + 1)) - 1) & ~1ULL;
+    rows[0].horP = bandMask & ~((1ULL << (band + 1)) - 1);
 
-        // see where does it came from
-        if (dpMatrix(row-1,col) < dpMatrix(row,col-1))
-        {
-            // we have an insertion in the pattern
-            if (dpMatrix(row-1,col) + 1 < dpMatrix(row-1,col-1) + mismatchFlag)
-            {
-                alignment.emplace_back(INSERTION);
-                --row;
 
-            } else {
+    // FILL MATRIX
+    for (size_t row = 1; row <= rowPat.size(); ++row)
+    {
 
-                // test if mismatch
-                if (mismatchFlag)
-                    alignment.emplace_back(MISMATCH);
-                else
-                    alignment.emplace_back(MATCHING);
-                --row;
-                --col;
+        const bandRow& prev = rows[row - 1];
+        bandRow& cur = rows[row];
 
-            }
+        const char c = rev ? rowPat[row - 1] : rowPat[rowPat.size() - row];
+        const uint64_t eq = maskWindow(matchMask<C>(comp, c), row);
 
-        } else {
+        // D(i,j) == D(i-1,j-1) iff match, or the cell above is smaller, or the cell to the left is
+        // equal to D(i-1,j-1) - 1, the last one depends on the cell to the left and is resolved by a carry chain
+        const uint64_t start = eq | (prev.horN >> 1);
+        const uint64_t prop = prev.horP;
+        const uint64_t gen = start | prop;
+        const uint64_t carry = ((start + gen) ^ start ^ gen) & bandMask;
+        const uint64_t diagZero = start | (prop & carry);
 
-            // we have a deletion in the pattern
-            if (dpMatrix(row,col-1) + 1 < dpMatrix(row-1,col-1) + mismatchFlag)
-            {
-                alignment.emplace_back(DELETION);
-                --col;
+        cur.diag = ~diagZero & bandMask;
+        cur.base = prev.base + (cur.diag & 1);
 
-            } else {
+        // D(i,j) - D(i,j-1) = D(i-1,j-1) - D(i-1,j-2) + diag[k] - diag[k-1]
+        const uint64_t same = ~(cur.diag ^ (cur.diag << 1));
+        const uint64_t noHor = ~(prev.horP | prev.horN);
+        cur.horP = ((prev.horP & same) | (noHor & cur.diag & ~(cur.diag << 1))) & bandMask & ~1ULL;
+        cur.horN = ((prev.horN & same) | (noHor & ~cur.diag & (cur.diag << 1))) & bandMask & ~1ULL;
+    }
+}
 
-                // test if mismatch
-                if (mismatchFlag)
-                    alignment.emplace_back(MISMATCH);
-                else
-                    alignment.emplace_back(MATCHING);
-                --row;
-                --col;
 
-            }
-        }
 
-    }
+template <typename T, size_t band>
+template <typename C>
+void LevenshtDP<T, band>::backtrackDP(C& comp, std::vector<ERROR_T>& alignment)
+{
+    backtrack<C>(comp, false, alignment);
 }
 template <typename T, size_t band>
 template <typename C>
 void LevenshtDP<T, band>::backtrackDPRev(C& comp, std::vector<ERROR_T>& alignment)
+{
+    backtrack<C>(comp, true, alignment);
+}
+
+template <typename T, size_t band>
+template <typename C>
+inline void LevenshtDP<T, band>::backtrack(C& comp, const bool rev, std::vector<ERROR_T>& alignment)
 {
 
     // the trace of errors
@@ -365,34 +360,57 @@ void LevenshtDP<T, band>::backtrackDPRev(C& comp, std::vector<ERROR_T>& alignmen
     // find minimum in the last part of table
     T minimum = std::numeric_limits<T>::max();
     // stores the index of the cell of the minimum
-    size_t col = 0;
+    long col = 0;
     for (long offset = -static_cast<long>(band); offset <= static_cast<long>(band); ++offset)
     {
-        const T& valRef = dpMatrix(rowPat.size(), rowPat.size() + offset);
-        if (valRef < minimum)
+        const T val = dpVal(rowPat.size(), rowPat.size() + offset);
+        if (val < minimum)
         {
 
             col = rowPat.size() + offset;
-            minimum = valRef;
+            minimum = val;
         }
     }
 
     // BACKTRACK
     // starting from the minimum cell in the last column
+    // the values of the neighbouring cells are obtained from the difference vectors of the current cell
+    long val = minimum;
     for (long row = rowPat.size(); row > 0;)
     {
 
+        // reached the first column, the remaining pattern characters are insertions
+        if (col == 0)
+        {
+            alignment.emplace_back(INSERTION);
+            --row;
+            continue;
+        }
+
         // check if characters match
-        T mismatchFlag = comp(rowPat[row - 1], *(colPat -col + 1));
+        const char c = rev ? rowPat[row - 1] : rowPat[rowPat.size() - row];
+        const uint64_t* mask = matchMask<C>(comp, c);
+        const long mismatchFlag = ((mask[(col + band) >> 6] >> ((col + band) & 63)) & 1) ^ 1;
+
+        // index of cell (row, col) inside its band row, the same cell (row - 1, col - 1) has in the row above
+        const uint64_t k = col - row + band;
+        const bandRow& r = rows[row];
+        const bandRow& p = rows[row - 1];
+        constexpr long inf = std::numeric_limits<T>::max();
+
+        const long diagonal = val - static_cast<long>((r.diag >> k) & 1);
+        const long left = k == 0 ? inf : val - static_cast<long>((r.horP >> k) & 1) + static_cast<long>((r.horN >> k) & 1);
+        const long up = k + 1 == bandW ? inf : diagonal + static_cast<long>((p.horP >> (k + 1)) & 1) - static_cast<long>((p.horN >> (k + 1)) & 1);
 
         // see where does it came from
-        if (dpMatrix(row-1,col) < dpMatrix(row,col-1))
+        if (up < left)
         {
             // we have an insertion in the pattern
-            if (dpMatrix(row-1,col) + 1 < dpMatrix(row-1,col-1) + mismatchFlag)
+            if (up + 1 < diagonal + mismatchFlag)
             {
                 alignment.emplace_back(INSERTION);
                 --row;
+                val = up;
 
             } else {
 
@@ -403,16 +421,18 @@ void LevenshtDP<T, band>::backtrackDPRev(C& comp, std::vector<ERROR_T>& alignmen
                     alignment.emplace_back(MATCHING);
                 --row;
                 --col;
+                val = diagonal;
 
             }
 
         } else {
 
             // we have a deletion in the pattern
-            if (dpMatrix(row,col-1) + 1 < dpMatrix(row-1,col-1) + mismatchFlag)
+            if (left + 1 < diagonal + mismatchFlag)
             {
                 alignment.emplace_back(DELETION);
                 --col;
+                val = left;
 
             } else {
 
@@ -423,9 +443,11 @@ void LevenshtDP<T, band>::backtrackDPRev(C& comp, std::vector<ERROR_T>& alignmen
                     alignment.emplace_back(MATCHING);
                 --row;
                 --col;
+                val = diagonal;
 
             }
         }
+
     }
 }
 
@@ -242,6 +242,33 @@ TEST(matching_test, complexSeqAll)
     ASSERT_EQ(trace, backtrace);
 }
 
+// test insertions at the end of the pattern, where backtracking reaches the first column early
+TEST(matching_test, insertionAtEnd)
+{
+    struct Compi
+    {
+        uint8_t operator()(const char c1, const char c2)
+        {
+            return c1==c2 ? 0 : 1;
+        }
+    } comp;
+
+    std::string s1 = "ACTGAC";
+    std::string s2 = "TTTACTGA";
+
+    LevenshtDP<uint16_t, 2> lev(s1, s2.data() + 7);
+
+    lev.runDPFill<Compi>(comp);
+
+    ASSERT_EQ(1, lev.getEditDist());
+
+    std::vector<ERROR_T> trace ({MATCHING, MATCHING, MATCHING, MATCHING, MATCHING, INSERTION});
+    std::vector<ERROR_T> backtrace;
+    lev.backtrackDP<Compi>(comp, backtrace);
+
+    ASSERT_EQ(trace, backtrace);
+}
+
 // TODO test indels for reverse
 //
 //
@@ -0,0 +1,137 @@
+//	Metal - A fast methylation alignment and calling tool for WGBS data.
+//	Copyright (C) 2017  Jonas Fischer
+//
+//	This program is free software: you can redistribute it and/or modify
+//	it under the terms of the GNU General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+//
+//	This program is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//	GNU General Public License for more details.
+//
+//	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Jonas Fischer	jonaspost@web.de
+
+#ifndef MAPPEDARRAY_H
+#define MAPPEDARRAY_H
+
+#include <vector>
+#include <cstddef>
+#include <utility>
+
+// Contiguous array that either owns its elements (backed by a std::vector) or is a
+// read only view onto memory owned by someone else, e.g. a memory mapped index file
+// (see RefGenome::load)
+//
+// Provides the subset of the std::vector interface that is used on the index tables.
+// Any call that changes the size of a view copies the viewed data into owned storage first.
+// Elements of a view must not be written through operator[] since the mapping is read only.
+template<typename T>
+class MappedArray
+{
+
+    public:
+
+        // Ctors -----
+
+        MappedArray() : elems(), ptr(nullptr), len(0), isView(false) {}
+        explicit MappedArray(size_t n) : elems(n), isView(false) { sync(); }
+        MappedArray(size_t n, const T& val) : elems(n, val), isView(false) { sync(); }
+        MappedArray(std::vector<T>&& v) : elems(std::move(v)), isView(false) { sync(); }
+
+        MappedArray(const MappedArray& o) : elems(o.elems), ptr(o.ptr), len(o.len), isView(o.isView)
+        {
+            if (!isView)
+                sync();
+        }
+        MappedArray(MappedArray&& o) : elems(std::move(o.elems)), ptr(o.ptr), len(o.len), isView(o.isView)
+        {
+            if (!isView)
+                sync();
+            o.elems.clear();
+            o.sync();
+        }
+        MappedArray& operator=(MappedArray o)
+        {
+            swap(o);
+            return *this;
+        }
+
+        // -----------
+
+        // let this array view n elements starting at p, previously owned elements are freed
+        // p must stay valid as long as this array is used
+        inline void view(T* p, const size_t n)
+        {
+            std::vector<T>().swap(elems);
+            ptr = p;
+            len = n;
+            isView = true;
+        }
+        // true iff this array does not own its elements
+        inline bool isMapped() const { return isView; }
+
+        inline T& operator[](const size_t i) { return ptr[i]; }
+        inline const T& operator[](const size_t i) const { return ptr[i]; }
+
+        inline size_t size() const { return len; }
+        inline bool empty() const { return len == 0; }
+        inline T* data() { return ptr; }
+        inline const T* data() const { return ptr; }
+        inline T* begin() { return ptr; }
+        inline const T* begin() const { return ptr; }
+        inline T* end() { return ptr + len; }
+        inline const T* end() const { return ptr + len; }
+        inline T& back() { return ptr[len - 1]; }
+        inline const T& back() const { return ptr[len - 1]; }
+
+        // modifiers, these switch a view to owned storage
+        inline void resize(const size_t n) { own(); elems.resize(n); sync(); }
+        inline void resize(const size_t n, const T& val) { own(); elems.resize(n, val); sync(); }
+        inline void reserve(const size_t n) { own(); elems.reserve(n); sync(); }
+        inline void push_back(const T& val) { own(); elems.push_back(val); sync(); }
+        template<typename... Args>
+        inline void emplace_back(Args&&... args) { own(); elems.emplace_back(std::forward<Args>(args)...); sync(); }
+        inline void shrink_to_fit() { own(); elems.shrink_to_fit(); sync(); }
+        inline void clear() { std::vector<T>().swap(elems); isView = false; sync(); }
+
+        inline void swap(MappedArray& o)
+        {
+            elems.swap(o.elems);
+            std::swap(ptr, o.ptr);
+            std::swap(len, o.len);
+            std::swap(isView, o.isView);
+        }
+
+
+    private:
+
+        // copy viewed elements into owned storage
+        inline void own()
+        {
+            if (isView)
+            {
+                elems.assign(ptr, ptr + len);
+                isView = false;
+                sync();
+            }
+        }
+        inline void sync()
+        {
+            ptr = elems.data();
+            len = elems.size();
+        }
+
+        // owned elements, empty for views
+        std::vector<T> elems;
+        // start and number of elements, points into elems if this array is not a view
+        T* ptr;
+        size_t len;
+        bool isView;
+};
+
+#endif /* MAPPEDARRAY_H */
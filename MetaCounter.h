@@ -0,0 +1,191 @@
+//	Metal - A fast methylation alignment and calling tool for WGBS data.
+//	Copyright (C) 2017  Jonas Fischer
+//
+//	This program is free software: you can redistribute it and/or modify
+//	it under the terms of the GNU General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+//
+//	This program is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//	GNU General Public License for more details.
+//
+//	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Jonas Fischer	jonaspost@web.de
+
+
+#ifndef METACOUNTER_H
+#define METACOUNTER_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <utility>
+#include <algorithm>
+
+
+// Counts k-mer hits per meta CpG (window) id for one read at a time
+// Open addressing table with linear probing that is allocated once per thread and reused for all reads.
+// Every slot carries the generation in which it was written, hence clear() is a single increment
+// instead of freeing and allocating a new table for every read.
+// The table grows if it becomes more than half full.
+// Optionally, every id keeps the span [lo, hi] of the positions it was added with (e.g. the placements
+// of the read predicted by its seeds, see ReadQueue::getSeedRefs).
+class MetaCounter
+{
+
+    public:
+
+        MetaCounter() : gen(1) { allocate(1 << 10); }
+
+        // removes all ids
+        inline void clear()
+        {
+            insertOrder.clear();
+            if (++gen == 0)
+            {
+                // generation counter wrapped, stamps of old generations could become valid again
+                stamps.assign(stamps.size(), 0);
+                gen = 1;
+            }
+        }
+
+        // increase count of id by one, inserts id if not present
+        inline void add(const uint32_t id)
+        {
+            const size_t s = find(id);
+            if (stamps[s] != gen)
+            {
+                stamps[s] = gen;
+                keys[s] = id;
+                counts[s] = 1;
+                insertOrder.push_back(id);
+                if (2 * insertOrder.size() > keys.size())
+                    allocate(2 * keys.size());
+            } else {
+                ++counts[s];
+            }
+        }
+
+        // as add(id), additionally extends the span of id to pos
+        inline void add(const uint32_t id, const int32_t pos)
+        {
+            const size_t s = find(id);
+            if (stamps[s] != gen)
+            {
+                stamps[s] = gen;
+                keys[s] = id;
+                counts[s] = 1;
+                lo[s] = pos;
+                hi[s] = pos;
+                insertOrder.push_back(id);
+                if (2 * insertOrder.size() > keys.size())
+                    allocate(2 * keys.size());
+            } else {
+                ++counts[s];
+                lo[s] = std::min(lo[s], pos);
+                hi[s] = std::max(hi[s], pos);
+            }
+        }
+
+        // increase count of id by one iff id is present
+        inline void addExisting(const uint32_t id)
+        {
+            const size_t s = find(id);
+            if (stamps[s] == gen)
+                ++counts[s];
+        }
+        inline void addExisting(const uint32_t id, const int32_t pos)
+        {
+            const size_t s = find(id);
+            if (stamps[s] == gen)
+            {
+                ++counts[s];
+                lo[s] = std::min(lo[s], pos);
+                hi[s] = std::max(hi[s], pos);
+            }
+        }
+
+        // count of id, 0 if not present
+        inline uint16_t count(const uint32_t id) const
+        {
+            const size_t s = find(id);
+            return stamps[s] == gen ? counts[s] : 0;
+        }
+
+        // span of the positions id was added with, only meaningful if id is present and was always added with a position
+        inline std::pair<int32_t, int32_t> span(const uint32_t id) const
+        {
+            const size_t s = find(id);
+            return std::make_pair(lo[s], hi[s]);
+        }
+
+        // all ids present, in order of insertion
+        inline const std::vector<uint32_t>& ids() const { return insertOrder; }
+
+        inline size_t size() const { return insertOrder.size(); }
+
+
+    private:
+
+        // slot holding id or the empty slot where id would be inserted
+        inline size_t find(const uint32_t id) const
+        {
+            const size_t mask = keys.size() - 1;
+            // Fibonacci hashing spreads consecutive window ids
+            size_t s = (static_cast<uint64_t>(id) * 0x9e3779b97f4a7c15ULL) >> shift;
+            while (stamps[s] == gen && keys[s] != id)
+                s = (s + 1) & mask;
+            return s;
+        }
+
+        // resize table to n slots (power of 2), keeps all ids of the current generation
+        inline void allocate(const size_t n)
+        {
+            std::vector<uint32_t> oldKeys;
+            std::vector<uint32_t> oldStamps;
+            std::vector<uint16_t> oldCounts;
+            std::vector<int32_t> oldLo;
+            std::vector<int32_t> oldHi;
+            oldKeys.swap(keys);
+            oldStamps.swap(stamps);
+            oldCounts.swap(counts);
+            oldLo.swap(lo);
+            oldHi.swap(hi);
+            keys.assign(n, 0);
+            stamps.assign(n, 0);
+            counts.assign(n, 0);
+            lo.assign(n, 0);
+            hi.assign(n, 0);
+            shift = 64;
+            for (size_t i = n; i > 1; i >>= 1)
+                --shift;
+            for (size_t i = 0; i < oldKeys.size(); ++i)
+            {
+                if (oldStamps[i] == gen)
+                {
+                    const size_t s = find(oldKeys[i]);
+                    stamps[s] = gen;
+                    keys[s] = oldKeys[i];
+                    counts[s] = oldCounts[i];
+                    lo[s] = oldLo[i];
+                    hi[s] = oldHi[i];
+                }
+            }
+        }
+
+        std::vector<uint32_t> keys;
+        std::vector<uint32_t> stamps;
+        std::vector<uint16_t> counts;
+        std::vector<int32_t> lo;
+        std::vector<int32_t> hi;
+        // number of bits to shift the 64 bit hash to obtain a slot
+        unsigned int shift;
+        uint32_t gen;
+        std::vector<uint32_t> insertOrder;
+};
+
+#endif /* METACOUNTER_H */
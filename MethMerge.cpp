@@ -0,0 +1,234 @@
+//	Metal - A fast methylation alignment and calling tool for WGBS data.
+//	Copyright (C) 2017  Jonas Fischer
+//
+//	This program is free software: you can redistribute it and/or modify
+//	it under the terms of the GNU General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+//
+//	This program is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//	GNU General Public License for more details.
+//
+//	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Jonas Fischer	jonaspost@web.de
+
+
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "CONST.h"
+#include "MethWriter.h"
+#include "MethMerge.h"
+
+
+// number of records read from an input file at once
+constexpr size_t MERGEBLOCK = 1 << 20;
+
+
+// header and chromosome table of a binary methylation file, the stream is positioned at the first record
+static void readMethHeader(std::ifstream& in, const std::string& path, METHFILE::header& hdr, std::vector<std::string>& chrNames, std::string& chrTable)
+{
+
+    in.read(reinterpret_cast<char*>(&hdr), sizeof(hdr));
+    if (!in || hdr.magic != METHFILE::MAGIC)
+    {
+        std::cerr << "File \"" << path << "\" is no binary methylation file! Terminating...\n\n";
+        exit(1);
+    }
+    if (hdr.version != METHFILE::VERSION)
+    {
+        std::cerr << "Binary methylation file \"" << path << "\" has version " << hdr.version << ", expected " << METHFILE::VERSION << "! Terminating...\n\n";
+        exit(1);
+    }
+    chrTable.clear();
+    for (uint32_t c = 0; c < hdr.chrNum; ++c)
+    {
+        chromId id;
+        uint32_t len;
+        in.read(reinterpret_cast<char*>(&id), sizeof(id));
+        in.read(reinterpret_cast<char*>(&len), sizeof(len));
+        std::string name(len, '\0');
+        in.read(&name[0], len);
+        if (!in)
+        {
+            std::cerr << "Binary methylation file \"" << path << "\" is truncated! Terminating...\n\n";
+            exit(1);
+        }
+        if (chrNames.size() <= id)
+            chrNames.resize(id + 1);
+        chrNames[id] = name;
+        chrTable.append(reinterpret_cast<const char*>(&id), sizeof(id));
+        chrTable.append(reinterpret_cast<const char*>(&len), sizeof(len));
+        chrTable += name;
+    }
+}
+
+void mergeMethFiles(const std::vector<std::string>& inputs, const std::string& basename, const METHFILE::FORMAT fmt)
+{
+
+    if (inputs.empty())
+        return;
+
+    std::cout << "\nMerging " << inputs.size() << " methylation file(s)\n";
+
+    METHFILE::header hdr;
+    std::vector<std::string> chrNames;
+    std::string chrTable;
+    std::ifstream first(inputs[0], std::ifstream::binary);
+    if (!first.is_open())
+    {
+        std::cerr << "Could not open file \"" << inputs[0] << "\"! Terminating...\n\n";
+        exit(1);
+    }
+    readMethHeader(first, inputs[0], hdr, chrNames, chrTable);
+    std::vector<METHFILE::record> sum(hdr.cpgNum);
+    first.read(reinterpret_cast<char*>(sum.data()), sizeof(METHFILE::record) * sum.size());
+    if (static_cast<size_t>(first.gcount()) != sizeof(METHFILE::record) * sum.size())
+    {
+        std::cerr << "Binary methylation file \"" << inputs[0] << "\" is truncated! Terminating...\n\n";
+        exit(1);
+    }
+
+    std::vector<METHFILE::record> block(std::min<size_t>(MERGEBLOCK, hdr.cpgNum));
+    for (size_t f = 1; f < inputs.size(); ++f)
+    {
+
+        std::ifstream in(inputs[f], std::ifstream::binary);
+        if (!in.is_open())
+        {
+            std::cerr << "Could not open file \"" << inputs[f] << "\"! Terminating...\n\n";
+            exit(1);
+        }
+        METHFILE::header h;
+        std::vector<std::string> names;
+        std::string table;
+        readMethHeader(in, inputs[f], h, names, table);
+        if (h.cpgNum != hdr.cpgNum || h.fingerprint != hdr.fingerprint || table != chrTable)
+        {
+            std::cerr << "Binary methylation files \"" << inputs[0] << "\" and \"" << inputs[f] << "\" were computed with different indexes! Terminating...\n\n";
+            exit(1);
+        }
+
+        for (size_t start = 0; start < sum.size(); start += block.size())
+        {
+
+            const size_t n = std::min(block.size(), sum.size() - start);
+            in.read(reinterpret_cast<char*>(block.data()), sizeof(METHFILE::record) * n);
+            if (static_cast<size_t>(in.gcount()) != sizeof(METHFILE::record) * n)
+            {
+                std::cerr << "Binary methylation file \"" << inputs[f] << "\" is truncated! Terminating...\n\n";
+                exit(1);
+            }
+            // plain field wise adds, vectorized by the compiler; positions are compared on the way
+            // such that a corrupt file is noticed
+            METHFILE::record* dst = sum.data() + start;
+            const METHFILE::record* src = block.data();
+            uint32_t mismatch = 0;
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(CORENUM) schedule(static) reduction(|:mismatch)
+#endif
+            for (size_t i = 0; i < n; ++i)
+            {
+                mismatch |= (dst[i].pos ^ src[i].pos) | (dst[i].chrom ^ src[i].chrom);
+                dst[i].methFwd += src[i].methFwd;
+                dst[i].unmethFwd += src[i].unmethFwd;
+                dst[i].methRev += src[i].methRev;
+                dst[i].unmethRev += src[i].unmethRev;
+            }
+            if (mismatch)
+            {
+                std::cerr << "Binary methylation file \"" << inputs[f] << "\" does not list the CpGs of \"" << inputs[0] << "\"! Terminating...\n\n";
+                exit(1);
+            }
+        }
+    }
+
+    std::string path = basename + "_cpg.tsv";
+    if (fmt == METHFILE::BGZF)
+    {
+        path += ".gz";
+
+    } else if (fmt == METHFILE::BINARY) {
+
+        path = basename + "_cpg.bin";
+    }
+    MethWriter out;
+    if (!out.open(path, fmt == METHFILE::BGZF, fmt == METHFILE::BGZF))
+    {
+        std::cerr << "Could not open file \"" << path << "\" for writing! Terminating...\n\n";
+        exit(1);
+    }
+
+    if (fmt == METHFILE::BINARY)
+    {
+        out.write(reinterpret_cast<const char*>(&hdr), sizeof(hdr));
+        out.write(chrTable);
+        out.write(reinterpret_cast<const char*>(sum.data()), sizeof(METHFILE::record) * sum.size());
+
+    } else {
+
+        // same slices as ReadQueue::printMethylationLevels
+        constexpr size_t sliceLen = 1 << 16;
+        size_t maxNameLen = 0;
+        for (const std::string& name : chrNames)
+        {
+            maxNameLen = std::max(maxNameLen, name.size());
+        }
+        const size_t lineLen = maxNameLen + 5 * 20 + 5;
+        std::vector<std::vector<char> > slices(CORENUM, std::vector<char>(sliceLen * lineLen));
+        std::vector<size_t> sliceBytes(CORENUM);
+        const std::vector<uint32_t> order = MethWriter::tableOrder(sum.size(),
+                [&](const size_t i) -> const std::string& { return chrNames[sum[i].chrom]; },
+                [&](const size_t i) { return sum[i].pos; });
+        for (size_t roundStart = 0; roundStart < sum.size(); roundStart += sliceLen * CORENUM)
+        {
+
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(CORENUM) schedule(static,1)
+#endif
+            for (unsigned int t = 0; t < CORENUM; ++t)
+            {
+
+                const size_t sliceStart = std::min(sum.size(), roundStart + t * sliceLen);
+                const size_t sliceEnd = std::min(sum.size(), sliceStart + sliceLen);
+                char* o = slices[t].data();
+                for (size_t i = sliceStart; i < sliceEnd; ++i)
+                {
+                    const METHFILE::record& rec = sum[order.empty() ? i : order[i]];
+                    const std::string& name = chrNames[rec.chrom];
+                    std::memcpy(o, name.data(), name.size());
+                    o += name.size();
+                    *o++ = '\t';
+                    o += MethWriter::formatUInt(o, rec.pos);
+                    *o++ = '\t';
+                    o += MethWriter::formatUInt(o, rec.methFwd);
+                    *o++ = '\t';
+                    o += MethWriter::formatUInt(o, rec.unmethFwd);
+                    *o++ = '\t';
+                    o += MethWriter::formatUInt(o, rec.methRev);
+                    *o++ = '\t';
+                    o += MethWriter::formatUInt(o, rec.unmethRev);
+                    *o++ = '\n';
+                }
+                sliceBytes[t] = o - slices[t].data();
+            }
+            for (unsigned int t = 0; t < CORENUM; ++t)
+            {
+                out.write(slices[t].data(), sliceBytes[t]);
+            }
+        }
+    }
+    out.close();
+    std::cout << "Finished writing merged methylation levels to \"" << path << "\"\n\n";
+}
@@ -0,0 +1,36 @@
+//	Metal - A fast methylation alignment and calling tool for WGBS data.
+//	Copyright (C) 2017  Jonas Fischer
+//
+//	This program is free software: you can redistribute it and/or modify
+//	it under the terms of the GNU General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+//
+//	This program is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//	GNU General Public License for more details.
+//
+//	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Jonas Fischer	jonaspost@web.de
+
+
+#ifndef METHMERGE_H
+#define METHMERGE_H
+
+#include <vector>
+#include <string>
+
+#include "structs.h"
+
+// sums the counts of binary methylation files (see METHFILE) computed with the same index, e.g. of the lanes or
+// replicates of a sample aligned separately, and writes them like ReadQueue::printMethylationLevels
+// ARGUMENTS:
+//          inputs      paths of the binary files, terminates if they do not refer to the same index
+//          basename    output is written to basename_cpg.tsv, basename_cpg.tsv.gz or basename_cpg.bin
+//          fmt         format of the output
+void mergeMethFiles(const std::vector<std::string>& inputs, const std::string& basename, const METHFILE::FORMAT fmt);
+
+#endif /* METHMERGE_H */
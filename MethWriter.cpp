@@ -0,0 +1,381 @@
+//	Metal - A fast methylation alignment and calling tool for WGBS data.
+//	Copyright (C) 2017  Jonas Fischer
+//
+//	This program is free software: you can redistribute it and/or modify
+//	it under the terms of the GNU General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+//
+//	This program is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//	GNU General Public License for more details.
+//
+//	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Jonas Fischer	jonaspost@web.de
+
+#include <iostream>
+#include <algorithm>
+#include <cstdio>
+#include <zlib.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "CONST.h"
+#include "MethWriter.h"
+
+
+// maximum number of uncompressed bytes per BGZF block
+// (chosen such that even incompressible data fits into the 64kB limit of a block)
+constexpr size_t BGZFBLOCK = 0xff00;
+// size of BGZF header and footer
+constexpr size_t BGZFHEAD = 18;
+constexpr size_t BGZFFOOT = 8;
+// empty block marking the end of a BGZF file
+constexpr unsigned char BGZFEOF[28] = {0x1f, 0x8b, 0x08, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0x06, 0x00,
+                                       0x42, 0x43, 0x02, 0x00, 0x1b, 0x00, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00,
+                                       0x00, 0x00, 0x00, 0x00};
+
+
+MethWriter::MethWriter() :
+        isBgzf(false)
+    ,   isIndexed(false)
+    ,   bufBase(0)
+    ,   flushSize(0)
+{
+}
+
+MethWriter::~MethWriter()
+{
+    close();
+}
+
+bool MethWriter::open(const std::string& filePath, const bool bgzf, const bool tabix)
+{
+
+    close();
+    const bool opened = of.open(filePath);
+    isBgzf = bgzf;
+    isIndexed = bgzf && tabix;
+    indexPath = filePath + ".tbi";
+    index.clear();
+    bufBase = 0;
+    blockStarts.assign(1, 0);
+    // give every thread a few blocks per flush
+    flushSize = BGZFBLOCK * 4 * CORENUM;
+    buf.reserve(flushSize + BGZFBLOCK);
+    return opened;
+}
+
+void MethWriter::close()
+{
+
+    if (!of.isOpen())
+        return;
+
+    flush(true);
+    if (isBgzf)
+    {
+        of.write(reinterpret_cast<const char*>(BGZFEOF), sizeof(BGZFEOF));
+    }
+    if (!of.close())
+        std::cerr << "Writing the methylation output failed!\n";
+    std::vector<char>().swap(buf);
+    std::vector<std::vector<char> >().swap(blocks);
+
+    if (isIndexed)
+    {
+        isIndexed = false;
+        if (!index.valid())
+        {
+            // a stale index of an earlier run would point into the wrong blocks
+            std::remove(indexPath.c_str());
+            std::cerr << "The table is not sorted by chromosome and position, no index written to " << indexPath << "\n";
+
+        } else if (!index.write(indexPath, blockStarts, BGZFBLOCK)) {
+
+            std::cerr << "Writing the index " << indexPath << " failed!\n";
+        }
+        index.clear();
+    }
+}
+
+void MethWriter::flush(const bool final)
+{
+
+    if (!isBgzf)
+    {
+        of.write(buf.data(), buf.size());
+        buf.clear();
+        return;
+    }
+
+    if (isIndexed)
+        index.addLines(buf.data(), buf.size(), bufBase, final);
+
+    // only compress full blocks unless we are done
+    const size_t blockNum = final ? (buf.size() + BGZFBLOCK - 1) / BGZFBLOCK : buf.size() / BGZFBLOCK;
+    if (blocks.size() < blockNum)
+        blocks.resize(blockNum);
+
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(CORENUM) schedule(static)
+#endif
+    for (size_t b = 0; b < blockNum; ++b)
+    {
+        const size_t start = b * BGZFBLOCK;
+        compressBlock(buf.data() + start, std::min(BGZFBLOCK, buf.size() - start), blocks[b]);
+    }
+    for (size_t b = 0; b < blockNum; ++b)
+    {
+        of.write(blocks[b].data(), blocks[b].size());
+        blockStarts.push_back(blockStarts.back() + blocks[b].size());
+    }
+    // keep the incomplete last block
+    const size_t done = std::min(buf.size(), blockNum * BGZFBLOCK);
+    buf.erase(buf.begin(), buf.begin() + done);
+    bufBase += done;
+}
+
+void MethWriter::compressBlock(const char* data, const size_t len, std::vector<char>& out)
+{
+
+    out.resize(BGZFHEAD + compressBound(len) + BGZFFOOT);
+    unsigned char* o = reinterpret_cast<unsigned char*>(out.data());
+
+    // raw deflate stream, gzip header is written by hand to include the BGZF extra field
+    z_stream zs;
+    zs.zalloc = Z_NULL;
+    zs.zfree = Z_NULL;
+    zs.opaque = Z_NULL;
+    if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+    {
+        std::cerr << "Initializing zlib failed! Terminating...\n\n";
+        exit(1);
+    }
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+    zs.avail_in = len;
+    zs.next_out = o + BGZFHEAD;
+    zs.avail_out = out.size() - BGZFHEAD - BGZFFOOT;
+    if (deflate(&zs, Z_FINISH) != Z_STREAM_END)
+    {
+        std::cerr << "Compressing output block failed! Terminating...\n\n";
+        exit(1);
+    }
+    const size_t cLen = zs.total_out;
+    deflateEnd(&zs);
+
+    const size_t blockSize = BGZFHEAD + cLen + BGZFFOOT;
+    // gzip header with FEXTRA flag, subfield "BC" holds size of block - 1
+    const unsigned char head[BGZFHEAD] = {0x1f, 0x8b, 0x08, 0x04, 0, 0, 0, 0, 0, 0xff, 0x06, 0x00, 0x42, 0x43, 0x02, 0x00,
+                                      static_cast<unsigned char>((blockSize - 1) & 0xff), static_cast<unsigned char>((blockSize - 1) >> 8)};
+    std::memcpy(o, head, BGZFHEAD);
+
+    const uint32_t crc = crc32(crc32(0L, Z_NULL, 0), reinterpret_cast<const Bytef*>(data), len);
+    unsigned char* foot = o + BGZFHEAD + cLen;
+    for (unsigned int i = 0; i < 4; ++i)
+    {
+        foot[i] = (crc >> (8 * i)) & 0xff;
+        foot[4 + i] = (static_cast<uint32_t>(len) >> (8 * i)) & 0xff;
+    }
+    out.resize(blockSize);
+}
+
+
+
+// bin of the zero based interval [beg, end) in the binning scheme of tabix and BAM (see the SAM specification, 5.3)
+static inline uint32_t tabixBin(const uint64_t beg, uint64_t end)
+{
+    --end;
+    if (beg >> 14 == end >> 14) return ((1 << 15) - 1) / 7 + (beg >> 14);
+    if (beg >> 17 == end >> 17) return ((1 << 12) - 1) / 7 + (beg >> 17);
+    if (beg >> 20 == end >> 20) return ((1 << 9) - 1) / 7 + (beg >> 20);
+    if (beg >> 23 == end >> 23) return ((1 << 6) - 1) / 7 + (beg >> 23);
+    if (beg >> 26 == end >> 26) return ((1 << 3) - 1) / 7 + (beg >> 26);
+    return 0;
+}
+
+// appends the n lowest bytes of v, least significant first
+static inline void appendLE(std::string& out, const uint64_t v, const unsigned int n)
+{
+    for (unsigned int i = 0; i < n; ++i)
+    {
+        out.push_back(static_cast<char>((v >> (8 * i)) & 0xff));
+    }
+}
+
+void TabixIndex::clear()
+{
+    refs.clear();
+    refIds.clear();
+    sorted = true;
+    partial.clear();
+    partialOff = 0;
+}
+
+void TabixIndex::addLines(const char* data, const size_t len, const uint64_t base, const bool final)
+{
+
+    // the lines of the last call were parsed up to the incomplete one
+    size_t pos = partial.empty() ? 0 : (partialOff + partial.size() - base);
+    if (!partial.empty())
+    {
+        const char* nl = static_cast<const char*>(std::memchr(data + pos, '\n', len - pos));
+        if (nl == nullptr && !final)
+        {
+            partial.append(data + pos, len - pos);
+            return;
+        }
+        const size_t end = nl == nullptr ? len : nl - data + 1;
+        partial.append(data + pos, end - pos);
+        addLine(partial.data(), partial.size(), partialOff);
+        partial.clear();
+        pos = end;
+
+    } else {
+
+        pos = partialOff > base ? partialOff - base : 0;
+    }
+    while (pos < len)
+    {
+        const char* nl = static_cast<const char*>(std::memchr(data + pos, '\n', len - pos));
+        if (nl == nullptr)
+        {
+            if (final)
+            {
+                addLine(data + pos, len - pos, base + pos);
+                pos = len;
+            } else {
+                partial.assign(data + pos, len - pos);
+                partialOff = base + pos;
+            }
+            break;
+        }
+        const size_t end = nl - data + 1;
+        addLine(data + pos, end - pos, base + pos);
+        pos = end;
+    }
+    // the next call starts after the lines parsed here
+    if (partial.empty())
+        partialOff = base + pos;
+}
+
+void TabixIndex::addLine(const char* line, const size_t len, const uint64_t off)
+{
+
+    if (len == 0 || line[0] == '#' || line[0] == '\n')
+        return;
+    const char* tab = static_cast<const char*>(std::memchr(line, '\t', len));
+    if (tab == nullptr)
+    {
+        sorted = false;
+        return;
+    }
+    uint64_t beg = 0;
+    for (const char* p = tab + 1; p < line + len && *p >= '0' && *p <= '9'; ++p)
+        beg = beg * 10 + (*p - '0');
+    // tabix bins cover 2^29 bases
+    if (beg >= (1ULL << 29) - 1)
+    {
+        sorted = false;
+        return;
+    }
+
+    const std::string name(line, tab - line);
+    const auto ins = refIds.emplace(name, refs.size());
+    if (ins.second)
+    {
+        refs.emplace_back();
+        refs.back().name = name;
+        refs.back().lastPos = 0;
+
+    } else if (ins.first->second + 1 != refs.size() || beg < refs.back().lastPos) {
+
+        // a chromosome that came before or a position going back
+        sorted = false;
+        return;
+    }
+    Ref& ref = refs.back();
+    ref.lastPos = beg;
+
+    std::vector<std::pair<uint64_t, uint64_t> >& chunks = ref.bins[tabixBin(beg, beg + 1)];
+    if (!chunks.empty() && chunks.back().second == off)
+        chunks.back().second = off + len;
+    else
+        chunks.emplace_back(off, off + len);
+    const size_t win = beg >> 14;
+    if (ref.linear.size() <= win)
+        ref.linear.resize(win + 1, UINT64_MAX);
+    if (ref.linear[win] == UINT64_MAX)
+        ref.linear[win] = off;
+}
+
+bool TabixIndex::write(const std::string& path, const std::vector<uint64_t>& blockStarts, const size_t blockLen) const
+{
+
+    // virtual file offset of uncompressed offset u
+    const auto virt = [&](const uint64_t u)
+    {
+        const size_t b = std::min<size_t>(u / blockLen, blockStarts.size() - 1);
+        return (blockStarts[b] << 16) | (u - b * blockLen);
+    };
+
+    std::string names;
+    for (const Ref& ref : refs)
+    {
+        names += ref.name;
+        names.push_back('\0');
+    }
+    std::string out("TBI\1", 4);
+    appendLE(out, refs.size(), 4);
+    // generic format with zero based positions (0x10000), the name in column 1, the position in column 2 and no
+    // end column, lines starting with '#' are skipped
+    appendLE(out, 0x10000, 4);
+    appendLE(out, 1, 4);
+    appendLE(out, 2, 4);
+    appendLE(out, 0, 4);
+    appendLE(out, '#', 4);
+    appendLE(out, 0, 4);
+    appendLE(out, names.size(), 4);
+    out += names;
+    for (const Ref& ref : refs)
+    {
+        appendLE(out, ref.bins.size(), 4);
+        for (const auto& bin : ref.bins)
+        {
+            appendLE(out, bin.first, 4);
+            appendLE(out, bin.second.size(), 4);
+            for (const auto& chunk : bin.second)
+            {
+                appendLE(out, virt(chunk.first), 8);
+                appendLE(out, virt(chunk.second), 8);
+            }
+        }
+        // windows without lines start where the next line does, before the first line of the chromosome
+        std::vector<uint64_t> linear(ref.linear);
+        uint64_t next = UINT64_MAX;
+        for (size_t w = linear.size(); w-- > 0; )
+        {
+            if (linear[w] == UINT64_MAX)
+                linear[w] = next;
+            else
+                next = linear[w];
+        }
+        appendLE(out, linear.size(), 4);
+        for (const uint64_t u : linear)
+            appendLE(out, virt(u), 8);
+    }
+    // no lines without coordinates
+    appendLE(out, 0, 8);
+
+    MethWriter idx;
+    if (!idx.open(path, true))
+        return false;
+    idx.write(out);
+    idx.close();
+    return true;
+}
@@ -0,0 +1,229 @@
+//	Metal - A fast methylation alignment and calling tool for WGBS data.
+//	Copyright (C) 2017  Jonas Fischer
+//
+//	This program is free software: you can redistribute it and/or modify
+//	it under the terms of the GNU General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+//
+//	This program is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//	GNU General Public License for more details.
+//
+//	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Jonas Fischer	jonaspost@web.de
+
+#ifndef METHWRITER_H
+#define METHWRITER_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <map>
+#include <unordered_map>
+
+#include "AsyncIO.h"
+
+
+// Tabix index (.tbi) of a bgzip compressed table of zero based positions (chromosome, position, ...)
+// The lines are added in their uncompressed form with their offset in the uncompressed stream. The virtual file
+// offsets of the index (compressed offset of the block << 16 | offset in the block) are only known once the blocks
+// are compressed, they are translated when the index is written. Querying a region (tabix, htslib) then only
+// decompresses the blocks holding its lines.
+class TabixIndex
+{
+
+    public:
+
+        TabixIndex() : sorted(true), partialOff(0) {}
+
+        void clear();
+
+        // parses the lines of data[0, len), which start at offset base of the uncompressed stream
+        // an incomplete last line is kept until the next call, final adds it as it is
+        void addLines(const char* data, const size_t len, const uint64_t base, const bool final);
+
+        // false iff a chromosome does not come as one run of lines sorted by position (or a position is beyond the
+        // 2^29 bases of the tabix binning), no index can be written then
+        inline bool valid() const { return sorted; }
+
+        // writes the bgzip compressed index
+        // ARGUMENTS:
+        //          path        file to write
+        //          blockStarts compressed offset of each uncompressed block of blockLen bytes, plus the end of the
+        //                      last block
+        // RETURN:  true iff the index was written
+        bool write(const std::string& path, const std::vector<uint64_t>& blockStarts, const size_t blockLen) const;
+
+    private:
+
+        void addLine(const char* line, const size_t len, const uint64_t off);
+
+        struct Ref
+        {
+            std::string name;
+            // chunks [begin, end) of uncompressed offsets per bin, adjacent chunks are merged
+            std::map<uint32_t, std::vector<std::pair<uint64_t, uint64_t> > > bins;
+            // offset of the first line overlapping each 16kb window, UINT64_MAX if none
+            std::vector<uint64_t> linear;
+            uint64_t lastPos;
+        };
+        std::vector<Ref> refs;
+        std::unordered_map<std::string, size_t> refIds;
+        bool sorted;
+
+        // incomplete last line of the previous addLines and its offset
+        std::string partial;
+        uint64_t partialOff;
+};
+
+
+// Output sink for the methylation reports
+// Bytes are collected in a large buffer and written either as they are or as bgzip
+// compressed file (BGZF, i.e. a series of gzip members of at most 64kB input each,
+// readable by zcat, tabix and htslib).
+// BGZF blocks are compressed in parallel using CORENUM threads, the file is written with MyConst::ioDepth writes in
+// flight (see AsyncIO.h). A compressed table of positions can be indexed for tabix while it is written.
+class MethWriter
+{
+
+    public:
+
+        MethWriter();
+        ~MethWriter();
+
+        MethWriter(const MethWriter&) = delete;
+        MethWriter& operator=(const MethWriter&) = delete;
+
+        // opens file filePath for writing, truncating it
+        // ARGUMENTS:
+        //          filePath    path of output file
+        //          bgzf        flag - true iff output should be bgzip compressed
+        //          tabix       flag - true iff a bgzip compressed table should be indexed to filePath.tbi
+        //
+        // RETURN:  true iff file could be opened
+        bool open(const std::string& filePath, const bool bgzf, const bool tabix = false);
+
+        // flushes all buffered data (terminating the BGZF stream) and closes the file, then writes the index
+        void close();
+
+        inline bool isOpen() const { return of.isOpen(); }
+
+        // append n bytes starting at data
+        inline void write(const char* data, const size_t n)
+        {
+            buf.insert(buf.end(), data, data + n);
+            if (buf.size() >= flushSize)
+                flush(false);
+        }
+        inline void write(const std::string& s)
+        {
+            write(s.data(), s.size());
+        }
+        inline void put(const char c)
+        {
+            buf.push_back(c);
+            if (buf.size() >= flushSize)
+                flush(false);
+        }
+        // append decimal representation of v
+        inline void putUInt(const uint64_t v)
+        {
+            char tmp[20];
+            const size_t n = formatUInt(tmp, v);
+            write(tmp, n);
+        }
+
+        // writes decimal representation of v to p, returns number of characters written
+        // p must provide space for at least 20 characters
+        static inline size_t formatUInt(char* p, uint64_t v)
+        {
+            char tmp[20];
+            size_t n = 0;
+            do
+            {
+                tmp[n++] = '0' + (v % 10);
+                v /= 10;
+
+            } while (v);
+            for (size_t i = 0; i < n; ++i)
+            {
+                p[i] = tmp[n - 1 - i];
+            }
+            return n;
+        }
+
+        // order in which n records are written as a table, grouped by chromosome name (in order of first
+        // appearance) and sorted by position as tabix requires; empty if the records are in this order already
+        // nameOf(i) and posOf(i) give the chromosome name and the position of record i
+        template <typename NameFn, typename PosFn>
+        static std::vector<uint32_t> tableOrder(const size_t n, NameFn nameOf, PosFn posOf)
+        {
+            std::unordered_map<std::string, uint32_t> ranks;
+            std::vector<uint32_t> rank(n);
+            bool inOrder = true;
+            for (size_t i = 0; i < n; ++i)
+            {
+                // the name is looked up only where it changes
+                const std::string& name = nameOf(i);
+                if (i > 0 && name == nameOf(i - 1))
+                {
+                    rank[i] = rank[i - 1];
+                    inOrder &= posOf(i - 1) <= posOf(i);
+                    continue;
+                }
+                const auto ins = ranks.emplace(name, ranks.size());
+                rank[i] = ins.first->second;
+                inOrder &= ins.second;
+            }
+            std::vector<uint32_t> order;
+            if (inOrder)
+                return order;
+            order.resize(n);
+            for (size_t i = 0; i < n; ++i)
+                order[i] = i;
+            std::stable_sort(order.begin(), order.end(), [&](const uint32_t a, const uint32_t b)
+            {
+                return rank[a] < rank[b] || (rank[a] == rank[b] && posOf(a) < posOf(b));
+            });
+            return order;
+        }
+
+
+    private:
+
+        // writes buffered data to file
+        // ARGUMENTS:
+        //          final   flag - true iff all data must be written, otherwise only full BGZF blocks
+        void flush(const bool final);
+
+        // compresses len bytes at data into a single BGZF block stored in out
+        static void compressBlock(const char* data, const size_t len, std::vector<char>& out);
+
+        AsyncWriter of;
+        bool isBgzf;
+
+        // index of the table, if requested
+        bool isIndexed;
+        std::string indexPath;
+        TabixIndex index;
+        // offset of buf[0] in the uncompressed stream
+        uint64_t bufBase;
+        // compressed offset of every block written so far, and of the next one
+        std::vector<uint64_t> blockStarts;
+
+        // pending bytes that are not written yet
+        std::vector<char> buf;
+        // number of pending bytes at which buffer is flushed
+        size_t flushSize;
+
+        // compressed blocks of one flush
+        std::vector<std::vector<char> > blocks;
+};
+
+#endif /* METHWRITER_H */
@@ -0,0 +1,263 @@
+//	Metal - A fast methylation alignment and calling tool for WGBS data.
+//	Copyright (C) 2017  Jonas Fischer
+//
+//	This program is free software: you can redistribute it and/or modify
+//	it under the terms of the GNU General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+//
+//	This program is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//	GNU General Public License for more details.
+//
+//	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Jonas Fischer	jonaspost@web.de
+
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include <vector>
+#include <cstdio>
+#include <sys/resource.h>
+
+#include "Metrics.h"
+
+
+namespace
+{
+    // resident and peak resident memory of the process in bytes
+    void memoryUse(uint64_t& rss, uint64_t& peak)
+    {
+        rss = 0;
+        peak = 0;
+        std::ifstream status("/proc/self/status");
+        std::string line;
+        while (std::getline(status, line))
+        {
+            if (line.compare(0, 6, "VmRSS:") == 0)
+                rss = std::stoull(line.substr(6)) * 1024;
+            else if (line.compare(0, 6, "VmHWM:") == 0)
+                peak = std::stoull(line.substr(6)) * 1024;
+        }
+        // without procfs only the peak is known
+        if (peak == 0)
+        {
+            struct rusage usage;
+            if (getrusage(RUSAGE_SELF, &usage) == 0)
+                peak = static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+        }
+    }
+
+    // nearest rank percentile p of sorted values
+    double percentile(const std::vector<double>& sorted, const double p)
+    {
+        if (sorted.empty())
+            return 0;
+        const size_t rank = static_cast<size_t>(p * sorted.size() + 0.999999);
+        return sorted[std::min(sorted.size(), std::max<size_t>(rank, 1)) - 1];
+    }
+
+    constexpr double PERCENTILES[3] = {0.5, 0.9, 0.99};
+    const char* const PERCENTILENAMES[3] = {"p50", "p90", "p99"};
+}
+
+
+Metrics::Metrics() :
+        prom(false)
+    ,   paired(false)
+    ,   interval(0)
+    ,   stop(false)
+    ,   prevReads(0)
+{
+}
+
+Metrics::~Metrics()
+{
+    close();
+}
+
+bool Metrics::open(const std::string& filePath, const unsigned int intervalSecs, const bool isPaired)
+{
+
+    close();
+    path = filePath;
+    prom = path.size() >= 5 && path.compare(path.size() - 5, 5, ".prom") == 0;
+    paired = isPaired;
+    interval = std::chrono::seconds(std::max(intervalSecs, 1u));
+    startTime = prevTime = std::chrono::steady_clock::now();
+    stop = false;
+    counts = Counts();
+    prevReads = 0;
+    pipelineStats = std::function<PipelineStats()>();
+    lastStats = PipelineStats();
+    lastStats.batches = 0;
+
+    // fail early on an unwritable path instead of in the background
+    if (!write(false))
+        return false;
+    writer = std::thread(&Metrics::run, this);
+    return true;
+}
+
+void Metrics::close()
+{
+
+    if (!writer.joinable())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    cond.notify_all();
+    writer.join();
+    write(true);
+}
+
+void Metrics::update(const Counts& c)
+{
+
+    if (!writer.joinable())
+        return;
+    std::lock_guard<std::mutex> lock(mutex);
+    counts = c;
+}
+
+void Metrics::attach(std::function<PipelineStats()> stats)
+{
+
+    if (!writer.joinable())
+        return;
+    std::lock_guard<std::mutex> lock(mutex);
+    // keep the state of a finished pipeline for the final write
+    if (!stats && pipelineStats)
+        lastStats = pipelineStats();
+    pipelineStats = std::move(stats);
+}
+
+void Metrics::run()
+{
+
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!stop)
+    {
+        if (cond.wait_for(lock, interval, [this]() { return stop; }))
+            break;
+        lock.unlock();
+        if (!write(false))
+            std::cerr << "Could not write metrics file " << path << "!\n";
+        lock.lock();
+    }
+}
+
+bool Metrics::write(const bool final)
+{
+
+    std::ostringstream out;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        const double elapsed = std::chrono::duration<double>(now - startTime).count();
+        const double sincePrev = std::chrono::duration<double>(now - prevTime).count();
+        const double recentRate = sincePrev > 0 ? (counts.reads - prevReads) / sincePrev : 0;
+        prevReads = counts.reads;
+        prevTime = now;
+        const PipelineStats st = pipelineStats ? pipelineStats() : lastStats;
+        if (prom)
+            writeProm(out, final, elapsed, recentRate, st);
+        else
+            writeJson(out, final, elapsed, recentRate, st);
+    }
+
+    const std::string tmpPath = path + ".tmp";
+    {
+        std::ofstream file(tmpPath, std::ofstream::trunc);
+        file << out.str();
+        file.close();
+        if (!file)
+            return false;
+    }
+    return std::rename(tmpPath.c_str(), path.c_str()) == 0;
+}
+
+void Metrics::writeJson(std::ostream& out, const bool final, const double elapsed, const double recentRate, const PipelineStats& st)
+{
+
+    uint64_t rss, peak;
+    memoryUse(rss, peak);
+    std::vector<double> lat(st.latencies);
+    std::sort(lat.begin(), lat.end());
+
+    out << "{\n";
+    out << "  \"state\": \"" << (final ? "done" : "running") << "\",\n";
+    out << "  \"elapsed_s\": " << elapsed << ",\n";
+    out << "  \"reads\": " << counts.reads << ",\n";
+    out << "  \"batches\": " << counts.batches << ",\n";
+    out << "  \"reads_per_s\": " << (elapsed > 0 ? counts.reads / elapsed : 0) << ",\n";
+    out << "  \"reads_per_s_recent\": " << recentRate << ",\n";
+    out << "  \"matched\": " << counts.matched << ",\n";
+    out << "  \"unmatched\": " << counts.unmatched << ",\n";
+    out << "  \"nonunique\": " << counts.nonUnique << ",\n";
+    if (paired)
+    {
+        out << "  \"matched_pairs\": " << counts.pairs << ",\n";
+        out << "  \"too_short\": " << counts.tooShort << ",\n";
+    }
+    const uint64_t all = counts.matched + counts.unmatched + counts.nonUnique;
+    out << "  \"match_rate\": " << (all > 0 ? static_cast<double>(counts.matched) / all : 0) << ",\n";
+    out << "  \"stages\": [";
+    for (size_t s = 0; s < st.stages.size(); ++s)
+    {
+        const PipelineStats::Stage& stage = st.stages[s];
+        out << (s > 0 ? ",\n" : "\n") << "    {\"name\": \"" << stage.name << "\", \"threads\": " << stage.threadNum;
+        out << ", \"busy_s\": " << stage.busy << ", \"wait_s\": " << stage.wait << ", \"queued\": " << stage.queued << "}";
+    }
+    out << (st.stages.empty() ? "],\n" : "\n  ],\n");
+    out << "  \"batch_latency_s\": {\"count\": " << lat.size();
+    for (unsigned int p = 0; p < 3; ++p)
+        out << ", \"" << PERCENTILENAMES[p] << "\": " << percentile(lat, PERCENTILES[p]);
+    out << ", \"max\": " << (lat.empty() ? 0 : lat.back()) << "},\n";
+    out << "  \"memory\": {\"rss_bytes\": " << rss << ", \"peak_rss_bytes\": " << peak << "}\n";
+    out << "}\n";
+}
+
+void Metrics::writeProm(std::ostream& out, const bool final, const double elapsed, const double recentRate, const PipelineStats& st)
+{
+
+    uint64_t rss, peak;
+    memoryUse(rss, peak);
+    std::vector<double> lat(st.latencies);
+    std::sort(lat.begin(), lat.end());
+
+    out << "# TYPE fame_running gauge\nfame_running " << (final ? 0 : 1) << "\n";
+    out << "# TYPE fame_elapsed_seconds gauge\nfame_elapsed_seconds " << elapsed << "\n";
+    out << "# TYPE fame_reads_total counter\nfame_reads_total " << counts.reads << "\n";
+    out << "# TYPE fame_batches_total counter\nfame_batches_total " << counts.batches << "\n";
+    out << "# TYPE fame_reads_per_second gauge\nfame_reads_per_second " << recentRate << "\n";
+    out << "# TYPE fame_reads_matched_total counter\nfame_reads_matched_total{result=\"unique\"} " << counts.matched << "\n";
+    out << "fame_reads_matched_total{result=\"none\"} " << counts.unmatched << "\n";
+    out << "fame_reads_matched_total{result=\"nonunique\"} " << counts.nonUnique << "\n";
+    if (paired)
+    {
+        out << "# TYPE fame_pairs_matched_total counter\nfame_pairs_matched_total " << counts.pairs << "\n";
+        out << "# TYPE fame_reads_too_short_total counter\nfame_reads_too_short_total " << counts.tooShort << "\n";
+    }
+    out << "# TYPE fame_stage_busy_seconds_total counter\n";
+    for (const PipelineStats::Stage& stage : st.stages)
+        out << "fame_stage_busy_seconds_total{stage=\"" << stage.name << "\"} " << stage.busy << "\n";
+    out << "# TYPE fame_stage_wait_seconds_total counter\n";
+    for (const PipelineStats::Stage& stage : st.stages)
+        out << "fame_stage_wait_seconds_total{stage=\"" << stage.name << "\"} " << stage.wait << "\n";
+    out << "# TYPE fame_stage_queued_batches gauge\n";
+    for (const PipelineStats::Stage& stage : st.stages)
+        out << "fame_stage_queued_batches{stage=\"" << stage.name << "\"} " << stage.queued << "\n";
+    // percentiles over the last batches only, hence no summary with a sum over the whole run
+    out << "# TYPE fame_batch_latency_seconds gauge\n";
+    for (unsigned int p = 0; p < 3; ++p)
+        out << "fame_batch_latency_seconds{quantile=\"" << PERCENTILES[p] << "\"} " << percentile(lat, PERCENTILES[p]) << "\n";
+    out << "# TYPE fame_resident_memory_bytes gauge\nfame_resident_memory_bytes " << rss << "\n";
+    out << "# TYPE fame_peak_resident_memory_bytes gauge\nfame_peak_resident_memory_bytes " << peak << "\n";
+}
@@ -0,0 +1,113 @@
+//	Metal - A fast methylation alignment and calling tool for WGBS data.
+//	Copyright (C) 2017  Jonas Fischer
+//
+//	This program is free software: you can redistribute it and/or modify
+//	it under the terms of the GNU General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+//
+//	This program is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//	GNU General Public License for more details.
+//
+//	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Jonas Fischer	jonaspost@web.de
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <chrono>
+#include <ostream>
+#include <cstdint>
+
+#include "Pipeline.h"
+
+
+// Live metrics of an alignment run for monitoring
+// A background thread rewrites a file every few seconds with the reads processed, reads per second (overall and
+// since the last write), the match counters, the time of every pipeline stage, the batches queued in front of each
+// stage, percentiles of the batch latency and the memory in use. Since it does not depend on batches finishing,
+// a stalled run shows as reads per second dropping to 0 and batches piling up in front of the stalled stage.
+//
+// The file is replaced atomically (written next to it and renamed), readers never see a partial file. Paths ending
+// with ".prom" are written in the Prometheus text format (e.g. for the textfile collector of node_exporter), all
+// others as JSON.
+class Metrics
+{
+
+    public:
+
+        // counters of the alignment, as printed at its end
+        struct Counts
+        {
+            Counts() : reads(0), batches(0), matched(0), unmatched(0), nonUnique(0), pairs(0), tooShort(0) {}
+            uint64_t reads;
+            uint64_t batches;
+            uint64_t matched;
+            uint64_t unmatched;
+            uint64_t nonUnique;
+            // paired end only
+            uint64_t pairs;
+            uint64_t tooShort;
+        };
+
+        Metrics();
+        ~Metrics();
+
+        Metrics(const Metrics&) = delete;
+        Metrics& operator=(const Metrics&) = delete;
+
+        // starts writing the metrics to filePath every intervalSecs seconds
+        // RETURN:  true iff filePath could be written
+        bool open(const std::string& filePath, const unsigned int intervalSecs, const bool isPaired);
+
+        // writes the final metrics and stops the writer
+        void close();
+
+        inline bool isOpen() const { return writer.joinable(); }
+
+        // counters after the last matched batch
+        void update(const Counts& c);
+
+        // stats of the pipeline processing the reads, an empty function once it finished
+        void attach(std::function<PipelineStats()> stats);
+
+    private:
+
+        void run();
+        // RETURN:  false iff the file could not be written
+        bool write(const bool final);
+
+        void writeJson(std::ostream& out, const bool final, const double elapsed, const double recentRate, const PipelineStats& st);
+        void writeProm(std::ostream& out, const bool final, const double elapsed, const double recentRate, const PipelineStats& st);
+
+        std::string path;
+        bool prom;
+        bool paired;
+        std::chrono::seconds interval;
+        std::chrono::steady_clock::time_point startTime;
+
+        // guards everything below
+        std::mutex mutex;
+        std::condition_variable cond;
+        bool stop;
+        Counts counts;
+        std::function<PipelineStats()> pipelineStats;
+        // stats of the pipeline when it finished
+        PipelineStats lastStats;
+        // reads at the previous write, for the recent rate
+        uint64_t prevReads;
+        std::chrono::steady_clock::time_point prevTime;
+
+        std::thread writer;
+};
+
+#endif /* METRICS_H */
@@ -0,0 +1,189 @@
+//	Metal - A fast methylation alignment and calling tool for WGBS data.
+//	Copyright (C) 2017  Jonas Fischer
+//
+//	This program is free software: you can redistribute it and/or modify
+//	it under the terms of the GNU General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+//
+//	This program is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//	GNU General Public License for more details.
+//
+//	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Jonas Fischer	jonaspost@web.de
+
+
+#ifndef NUMA_H
+#define NUMA_H
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <cstddef>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "CONST.h"
+
+
+// NUMA placement of the index tables and the matching threads (see MyConst::numa)
+//
+// The topology is read from sysfs and memory is placed with the raw mbind system call, such that
+// no libnuma is needed to build or run. On machines without NUMA information everything is a single node.
+namespace NUMA
+{
+
+    // memory policy of mbind, see linux/mempolicy.h
+    constexpr int MPOL_INTERLEAVE_ = 3;
+
+    // parses a sysfs list such as "0-3,8,10-11"
+    inline std::vector<int> parseList(const std::string& list)
+    {
+        std::vector<int> ids;
+        size_t pos = 0;
+        while (pos < list.size())
+        {
+            size_t end = list.find(',', pos);
+            if (end == std::string::npos)
+                end = list.size();
+            const std::string range = list.substr(pos, end - pos);
+            const size_t dash = range.find('-');
+            if (!range.empty() && range[0] >= '0' && range[0] <= '9')
+            {
+                const int from = std::stoi(range);
+                const int to = dash == std::string::npos ? from : std::stoi(range.substr(dash + 1));
+                for (int id = from; id <= to; ++id)
+                    ids.push_back(id);
+            }
+            pos = end + 1;
+        }
+        return ids;
+    }
+
+    inline std::vector<int> readList(const std::string& path)
+    {
+        std::ifstream f(path);
+        std::string line;
+        std::getline(f, line);
+        return parseList(line);
+    }
+
+    // nodes with memory, empty if the system has no NUMA information
+    inline std::vector<int> memNodes()
+    {
+        std::vector<int> nodes = readList("/sys/devices/system/node/has_memory");
+        if (nodes.empty())
+            nodes = readList("/sys/devices/system/node/online");
+        return nodes;
+    }
+
+    // interleaves the pages of [mem, mem + len) page by page over nodes, must be called before the pages are
+    // touched; returns false if the kernel refused (no NUMA support, not allowed by the cpuset...)
+    inline bool interleave(void* mem, const size_t len, const std::vector<int>& nodes)
+    {
+        if (nodes.empty())
+            return false;
+        constexpr size_t longBits = 8 * sizeof(unsigned long);
+        std::vector<unsigned long> mask(nodes.back() / longBits + 1, 0);
+        for (const int n : nodes)
+            mask[n / longBits] |= 1UL << (n % longBits);
+        // the kernel reads one bit less than maxnode
+        const unsigned long maxNode = mask.size() * longBits + 1;
+        return syscall(SYS_mbind, mem, len, MPOL_INTERLEAVE_, mask.data(), maxNode, 0) == 0;
+    }
+
+    // the CPUs the process may run on per node, the nodes in their order, a single node on machines without NUMA
+    // information; empty if the affinity of the process cannot be read
+    inline std::vector<std::vector<int> > nodeCpus()
+    {
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+            return std::vector<std::vector<int> >();
+
+        std::vector<std::vector<int> > cpusOfNodes;
+        for (const int n : readList("/sys/devices/system/node/online"))
+        {
+            std::vector<int> cpus;
+            for (const int c : readList("/sys/devices/system/node/node" + std::to_string(n) + "/cpulist"))
+            {
+                if (c < CPU_SETSIZE && CPU_ISSET(c, &allowed))
+                    cpus.push_back(c);
+            }
+            if (!cpus.empty())
+                cpusOfNodes.push_back(std::move(cpus));
+        }
+        if (cpusOfNodes.empty())
+        {
+            cpusOfNodes.emplace_back();
+            for (int c = 0; c < CPU_SETSIZE; ++c)
+            {
+                if (CPU_ISSET(c, &allowed))
+                    cpusOfNodes[0].push_back(c);
+            }
+        }
+        return cpusOfNodes;
+    }
+
+    // the CPUs the process may run on, ordered such that consecutive positions alternate between the nodes
+    // (first CPU of node 0, first CPU of node 1, ..., second CPU of node 0, ...)
+    // threads pinned in this order spread evenly over the sockets and use all memory controllers
+    inline std::vector<int> spreadCpus()
+    {
+        const std::vector<std::vector<int> > cpusOfNodes = nodeCpus();
+        std::vector<int> order;
+        for (size_t i = 0; ; ++i)
+        {
+            const size_t before = order.size();
+            for (const std::vector<int>& cpus : cpusOfNodes)
+            {
+                if (i < cpus.size())
+                    order.push_back(cpus[i]);
+            }
+            if (order.size() == before)
+                break;
+        }
+        return order;
+    }
+
+    // the CPUs the process may run on, node by node (all CPUs of node 0, then node 1, ...)
+    // threads pinned in this order fill one socket and its last level cache before using the next one
+    inline std::vector<int> compactCpus()
+    {
+        std::vector<int> order;
+        for (const std::vector<int>& cpus : nodeCpus())
+            order.insert(order.end(), cpus.begin(), cpus.end());
+        return order;
+    }
+
+    // the CPUs of the layout in the order threads are pinned to them, empty for MyConst::LAYOUT_OS
+    inline std::vector<int> layoutCpus(const MyConst::LAYOUT layout)
+    {
+        switch (layout)
+        {
+            case MyConst::LAYOUT_COMPACT:
+                return compactCpus();
+            case MyConst::LAYOUT_SPREAD:
+                return spreadCpus();
+            default:
+                return std::vector<int>();
+        }
+    }
+
+    // pins the calling thread to cpu
+    inline bool pinThread(const int cpu)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        return sched_setaffinity(0, sizeof(set), &set) == 0;
+    }
+
+}
+
+#endif /* NUMA_H */
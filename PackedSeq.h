@@ -0,0 +1,216 @@
+//	Metal - A fast methylation alignment and calling tool for WGBS data.
+//	Copyright (C) 2017  Jonas Fischer
+//
+//	This program is free software: you can redistribute it and/or modify
+//	it under the terms of the GNU General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+//
+//	This program is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//	GNU General Public License for more details.
+//
+//	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Jonas Fischer	jonaspost@web.de
+
+
+#ifndef PACKEDSEQ_H
+#define PACKEDSEQ_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <iterator>
+#include <algorithm>
+
+#include "MappedArray.h"
+
+
+// 2 bit encoded DNA sequence over {A,C,G,T,N}
+// Encoding (as in DnaBitStr):
+//          A -> 00
+//          C -> 01
+//          G -> 10
+//          T -> 11
+//          N -> 00 and flagged in the N mask
+//
+// Base i is stored in bits 2*(i%32) and 2*(i%32)+1 of word i/32 of the sequence words,
+// its N flag in bit i%64 of word i/64 of the N mask.
+// Both arrays may view memory owned by someone else (see MappedArray), e.g. the memory mapped index.
+class PackedSeq
+{
+
+    public:
+
+        // random access iterator over the letters of the sequence
+        // positions outside of the sequence may be formed (e.g. one before the first letter)
+        // but must not be dereferenced
+        class const_iterator
+        {
+
+            public:
+
+                typedef std::random_access_iterator_tag iterator_category;
+                typedef char value_type;
+                typedef std::ptrdiff_t difference_type;
+                typedef const char* pointer;
+                typedef char reference;
+
+                const_iterator() : seq(nullptr), nMask(nullptr), pos(0) {}
+                const_iterator(const uint64_t* s, const uint64_t* n, const std::ptrdiff_t p) : seq(s), nMask(n), pos(p) {}
+
+                inline char operator*() const { return letterAt(seq, nMask, pos); }
+                inline char operator[](const std::ptrdiff_t i) const { return letterAt(seq, nMask, pos + i); }
+
+                inline const_iterator& operator++() { ++pos; return *this; }
+                inline const_iterator& operator--() { --pos; return *this; }
+                inline const_iterator operator++(int) { const_iterator tmp(*this); ++pos; return tmp; }
+                inline const_iterator operator--(int) { const_iterator tmp(*this); --pos; return tmp; }
+                inline const_iterator& operator+=(const std::ptrdiff_t i) { pos += i; return *this; }
+                inline const_iterator& operator-=(const std::ptrdiff_t i) { pos -= i; return *this; }
+                inline const_iterator operator+(const std::ptrdiff_t i) const { return const_iterator(seq, nMask, pos + i); }
+                inline const_iterator operator-(const std::ptrdiff_t i) const { return const_iterator(seq, nMask, pos - i); }
+                inline std::ptrdiff_t operator-(const const_iterator& o) const { return pos - o.pos; }
+
+                inline bool operator==(const const_iterator& o) const { return pos == o.pos; }
+                inline bool operator!=(const const_iterator& o) const { return pos != o.pos; }
+                inline bool operator<(const const_iterator& o) const { return pos < o.pos; }
+                inline bool operator>(const const_iterator& o) const { return pos > o.pos; }
+                inline bool operator<=(const const_iterator& o) const { return pos <= o.pos; }
+                inline bool operator>=(const const_iterator& o) const { return pos >= o.pos; }
+
+            private:
+
+                const uint64_t* seq;
+                const uint64_t* nMask;
+                std::ptrdiff_t pos;
+        };
+        typedef const_iterator iterator;
+
+
+        // Ctors -----
+
+        PackedSeq() : seq(), nMask(), len(0) {}
+
+        // pack the n letters at letters, every letter not in {A,C,G,T} is stored as N
+        PackedSeq(const char* letters, const size_t n) :
+                seq()
+            ,   nMask()
+            ,   len(0)
+        {
+            assign(letters, n);
+        }
+
+        // -----------
+
+        // let this sequence of n letters view the given sequence words and N mask
+        // both must stay valid as long as this sequence is used
+        inline void view(uint64_t* seqData, uint64_t* nMaskData, const size_t n)
+        {
+            seq.view(seqData, seqWords(n));
+            nMask.view(nMaskData, maskWords(n));
+            len = n;
+        }
+
+        // replace the sequence by the n letters at letters (see constructor), the storage is reused
+        inline void assign(const char* letters, const size_t n)
+        {
+            seq.resize(seqWords(n));
+            nMask.resize(maskWords(n));
+            std::fill(seq.begin(), seq.end(), 0);
+            std::fill(nMask.begin(), nMask.end(), 0);
+            len = n;
+            for (size_t i = 0; i < n; ++i)
+            {
+                uint64_t code;
+                switch (letters[i])
+                {
+                    case 'A':
+                        code = 0;
+                        break;
+                    case 'C':
+                        code = 1;
+                        break;
+                    case 'G':
+                        code = 2;
+                        break;
+                    case 'T':
+                        code = 3;
+                        break;
+                    default:
+                        code = 0;
+                        nMask[i >> 6] |= 1ULL << (i & 63);
+                        break;
+                }
+                seq[i >> 5] |= code << ((i & 31) << 1);
+            }
+        }
+
+        inline char operator[](const size_t i) const { return letterAt(seq.data(), nMask.data(), i); }
+
+        inline size_t size() const { return len; }
+        inline bool empty() const { return len == 0; }
+
+        inline const_iterator begin() const { return const_iterator(seq.data(), nMask.data(), 0); }
+        inline const_iterator end() const { return const_iterator(seq.data(), nMask.data(), len); }
+
+        // writes the n letters starting at pos to out, positions outside of the sequence are written as N
+        inline void unpack(const std::ptrdiff_t pos, const size_t n, char* out) const
+        {
+            for (size_t i = 0; i < n; ++i)
+            {
+                const std::ptrdiff_t p = pos + i;
+                out[i] = (p < 0 || static_cast<size_t>(p) >= len) ? 'N' : letterAt(seq.data(), nMask.data(), p);
+            }
+        }
+
+        // the 32 letters starting at pos, 2 bits each with letter pos + i in bits [2i, 2i + 2)
+        // (A = 0, C = 1, G = 2, T = 3, N as A), letters past the end are returned as A
+        inline uint64_t seqWordAt(const size_t pos) const
+        {
+            const size_t w = pos >> 5;
+            const unsigned int sh = (pos & 31) << 1;
+            uint64_t word = seq[w] >> sh;
+            if (sh && w + 1 < seq.size())
+                word |= seq[w + 1] << (64 - sh);
+            return word;
+        }
+        // the N flags of the 64 letters starting at pos, letter pos + i in bit i, letters past the end are not N
+        inline uint64_t nMaskAt(const size_t pos) const
+        {
+            const size_t w = pos >> 6;
+            const unsigned int sh = pos & 63;
+            uint64_t word = nMask[w] >> sh;
+            if (sh && w + 1 < nMask.size())
+                word |= nMask[w + 1] << (64 - sh);
+            return word;
+        }
+
+        // storage, used for writing the index
+        inline const MappedArray<uint64_t>& seqData() const { return seq; }
+        inline const MappedArray<uint64_t>& nMaskData() const { return nMask; }
+
+        // number of words needed to store n letters / their N flags
+        static inline size_t seqWords(const size_t n) { return (n + 31) / 32; }
+        static inline size_t maskWords(const size_t n) { return (n + 63) / 64; }
+
+
+    private:
+
+        static inline char letterAt(const uint64_t* s, const uint64_t* n, const size_t i)
+        {
+            if ((n[i >> 6] >> (i & 63)) & 1)
+                return 'N';
+            return "ACGT"[(s[i >> 5] >> ((i & 31) << 1)) & 3];
+        }
+
+        MappedArray<uint64_t> seq;
+        MappedArray<uint64_t> nMask;
+        // number of letters
+        size_t len;
+};
+
+#endif /* PACKEDSEQ_H */
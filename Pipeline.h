@@ -0,0 +1,349 @@
+//	Metal - A fast methylation alignment and calling tool for WGBS data.
+//	Copyright (C) 2017  Jonas Fischer
+//
+//	This program is free software: you can redistribute it and/or modify
+//	it under the terms of the GNU General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+//
+//	This program is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//	GNU General Public License for more details.
+//
+//	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Jonas Fischer	jonaspost@web.de
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <vector>
+#include <algorithm>
+#include <deque>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <chrono>
+#include <ostream>
+#include <iomanip>
+#include <cstdint>
+
+
+// snapshot of a pipeline (see Pipeline::stats)
+struct PipelineStats
+{
+    struct Stage
+    {
+        std::string name;
+        unsigned int threadNum;
+        // seconds spent working and waiting for input, summed over the threads of the stage
+        double busy;
+        double wait;
+        // batches waiting for the stage (for the source: free slots)
+        size_t queued;
+    };
+    std::vector<Stage> stages;
+    // number of batches that passed the last stage
+    uint64_t batches;
+    // seconds from the source taking a slot until the last stage finished it, for the last (at most 1024) batches
+    std::vector<double> latencies;
+};
+
+
+// Staged processing of a stream of batches
+// A fixed pool of depth slots circulates through the stages: the source fills a free slot, every further stage
+// takes the slots from the stage before it and the slots of the last stage are free again. Each stage runs on its
+// own threads, such that e.g. parsing, matching and output of consecutive batches overlap. At most depth batches
+// are in flight, which bounds the memory of the queues between the stages.
+//
+// The queue behind a stage hands its slots on in the order the source filled them, also if a stage with several
+// threads finishes them in another order. Stages that must see the batches in input order (matching, writing)
+// therefore run on one thread, stages working on each batch on its own (formatting) may run on several.
+//
+// The queues pass slots at batch granularity, a mutex per queue costs nothing against the work per batch. The
+// time each stage spends working and waiting for its input and the latency of the batches are recorded (see
+// printTiming and stats, which may be called while the pipeline runs).
+template <typename Slot>
+class Pipeline
+{
+
+    public:
+
+        // ARGUMENTS:
+        //          depth   number of slots, i.e. batches in flight (at least 1)
+        explicit Pipeline(const size_t depth) :
+                slots(depth < 1 ? 1 : depth)
+            ,   started(slots.size())
+            ,   freeQueue(slots.size())
+            ,   sourceOut(slots.size())
+            ,   doneNum(0)
+            ,   latencies(1024)
+        {
+            for (size_t i = 0; i < slots.size(); ++i)
+                freeQueue.push(i, &slots[i]);
+        }
+
+        Pipeline(const Pipeline&) = delete;
+        Pipeline& operator=(const Pipeline&) = delete;
+
+        // sets the first stage, which fills a free slot and returns true iff further slots follow
+        void source(const std::string& name, std::function<bool(Slot&)> fn)
+        {
+            srcName = name;
+            srcFn = std::move(fn);
+        }
+
+        // appends a stage run by threadNum threads (at least 1) on every slot
+        void stage(const std::string& name, const unsigned int threadNum, std::function<void(Slot&)> fn)
+        {
+            stages.emplace_back(name, threadNum < 1 ? 1 : threadNum, std::move(fn), slots.size());
+        }
+
+        // runs all stages until the source is exhausted and every slot passed the last stage
+        void run()
+        {
+            std::vector<std::thread> threads;
+            for (size_t s = 0; s < stages.size(); ++s)
+            {
+                for (unsigned int t = 0; t < stages[s].threadNum; ++t)
+                    threads.emplace_back(&Pipeline::runStage, this, s);
+            }
+            runSource();
+            for (std::thread& t : threads)
+                t.join();
+        }
+
+        // prints the time every stage spent working and waiting for input
+        void printTiming(std::ostream& out)
+        {
+            const PipelineStats st = stats();
+            out << std::fixed << std::setprecision(2);
+            for (size_t s = 0; s < st.stages.size(); ++s)
+            {
+                const PipelineStats::Stage& stage = st.stages[s];
+                out << "Stage " << stage.name;
+                if (s == 0)
+                {
+                    out << ": " << stage.busy << "s working, " << stage.wait << "s waiting for a free batch\n";
+                } else {
+                    out << " (" << stage.threadNum << (stage.threadNum == 1 ? " thread" : " threads") << "): ";
+                    out << stage.busy << "s working, " << stage.wait << "s waiting for input\n";
+                }
+            }
+            out.unsetf(std::ios_base::floatfield);
+        }
+
+        // timing, queue lengths and batch latencies so far, the source comes first
+        PipelineStats stats()
+        {
+            PipelineStats st;
+            {
+                std::lock_guard<std::mutex> lock(srcTimeMutex);
+                st.stages.push_back({srcName, 1, srcTime.busy, srcTime.wait, freeQueue.waiting()});
+            }
+            for (size_t s = 0; s < stages.size(); ++s)
+            {
+                Stage& stage = stages[s];
+                std::lock_guard<std::mutex> lock(stage.timeMutex);
+                st.stages.push_back({stage.name, stage.threadNum, stage.time.busy, stage.time.wait, (s == 0 ? sourceOut : stages[s - 1].out).waiting()});
+            }
+            std::lock_guard<std::mutex> lock(latencyMutex);
+            st.batches = doneNum;
+            const size_t n = std::min<uint64_t>(doneNum, latencies.size());
+            st.latencies.assign(latencies.begin(), latencies.begin() + n);
+            return st;
+        }
+
+
+    private:
+
+        // slots passed between two stages, delivered in the order of their sequence numbers
+        class SlotQueue
+        {
+            public:
+
+                explicit SlotQueue(const size_t depth) : ring(depth, nullptr), next(0), end(UINT64_MAX) {}
+
+                // at most depth slots are in flight, such that seq % depth is unique among them
+                void push(const uint64_t seq, Slot* slot)
+                {
+                    {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        ring[seq % ring.size()] = slot;
+                    }
+                    cond.notify_all();
+                }
+                // no slot with sequence number end or larger follows
+                void close(const uint64_t seqEnd)
+                {
+                    {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        end = seqEnd;
+                    }
+                    cond.notify_all();
+                }
+                // number of slots that can be taken
+                size_t waiting()
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    size_t n = 0;
+                    for (const Slot* slot : ring)
+                        n += slot != nullptr;
+                    return n;
+                }
+                // waits for the next slot in order, returns nullptr once the queue is closed and drained
+                Slot* pop(uint64_t& seq)
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    cond.wait(lock, [this]() { return next == end || ring[next % ring.size()] != nullptr; });
+                    if (next == end)
+                        return nullptr;
+                    Slot* slot = ring[next % ring.size()];
+                    ring[next % ring.size()] = nullptr;
+                    seq = next++;
+                    return slot;
+                }
+
+            private:
+
+                std::vector<Slot*> ring;
+                // sequence number of the slot handed out next
+                uint64_t next;
+                uint64_t end;
+                std::mutex mutex;
+                std::condition_variable cond;
+        };
+
+        struct Timing
+        {
+            Timing() : busy(0), wait(0) {}
+            double busy;
+            double wait;
+        };
+
+        struct Stage
+        {
+            Stage(const std::string& n, const unsigned int tNum, std::function<void(Slot&)> f, const size_t depth) :
+                    name(n)
+                ,   threadNum(tNum)
+                ,   fn(std::move(f))
+                ,   out(depth)
+            {
+            }
+            std::string name;
+            unsigned int threadNum;
+            std::function<void(Slot&)> fn;
+            // slots done by this stage, taken by the next one
+            SlotQueue out;
+            // summed over the threads of the stage
+            Timing time;
+            std::mutex timeMutex;
+        };
+
+        static inline double since(const std::chrono::steady_clock::time_point& t)
+        {
+            return std::chrono::duration<double>(std::chrono::steady_clock::now() - t).count();
+        }
+
+        void runSource()
+        {
+            uint64_t seq = 0;
+            bool more = true;
+            while (more)
+            {
+                std::chrono::steady_clock::time_point t = std::chrono::steady_clock::now();
+                uint64_t freeSeq;
+                Slot* slot = freeQueue.pop(freeSeq);
+                const double wait = since(t);
+                t = std::chrono::steady_clock::now();
+                started[slot - slots.data()] = t;
+                more = srcFn(*slot);
+                {
+                    std::lock_guard<std::mutex> lock(srcTimeMutex);
+                    srcTime.wait += wait;
+                    srcTime.busy += since(t);
+                }
+                if (stages.empty())
+                {
+                    finished(*slot);
+                    freeQueue.push(seq + slots.size(), slot);
+                } else
+                    sourceOut.push(seq, slot);
+                ++seq;
+            }
+            // the queues between the stages end after the last slot of the source
+            sourceOut.close(seq);
+            for (Stage& st : stages)
+                st.out.close(seq);
+        }
+
+        void runStage(const size_t s)
+        {
+            Stage& st = stages[s];
+            SlotQueue& in = s == 0 ? sourceOut : stages[s - 1].out;
+            uint64_t seq;
+            while (true)
+            {
+                std::chrono::steady_clock::time_point t = std::chrono::steady_clock::now();
+                Slot* slot = in.pop(seq);
+                const double wait = since(t);
+                if (slot == nullptr)
+                {
+                    std::lock_guard<std::mutex> lock(st.timeMutex);
+                    st.time.wait += wait;
+                    break;
+                }
+                t = std::chrono::steady_clock::now();
+                st.fn(*slot);
+                {
+                    std::lock_guard<std::mutex> lock(st.timeMutex);
+                    st.time.wait += wait;
+                    st.time.busy += since(t);
+                }
+                // the slots behind the last stage are free for the batch depth batches later
+                if (s + 1 < stages.size())
+                {
+                    st.out.push(seq, slot);
+                } else {
+                    finished(*slot);
+                    freeQueue.push(seq + slots.size(), slot);
+                }
+            }
+        }
+
+        // records the latency of a slot that passed the last stage
+        void finished(Slot& slot)
+        {
+            const double lat = since(started[&slot - slots.data()]);
+            std::lock_guard<std::mutex> lock(latencyMutex);
+            latencies[doneNum % latencies.size()] = lat;
+            ++doneNum;
+        }
+
+        std::vector<Slot> slots;
+        // time the source took each slot
+        std::vector<std::chrono::steady_clock::time_point> started;
+        // free slots, numbered by the sequence number of the batch they are filled with next
+        SlotQueue freeQueue;
+
+        std::string srcName;
+        std::function<bool(Slot&)> srcFn;
+        Timing srcTime;
+        std::mutex srcTimeMutex;
+        // slots filled by the source
+        SlotQueue sourceOut;
+
+        // a deque keeps the stages in place, they hold mutexes
+        std::deque<Stage> stages;
+
+        // latencies of the last batches, batch i at i % latencies.size()
+        uint64_t doneNum;
+        std::vector<double> latencies;
+        std::mutex latencyMutex;
+};
+
+#endif /* PIPELINE_H */
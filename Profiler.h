@@ -0,0 +1,429 @@
+//	Metal - A fast methylation alignment and calling tool for WGBS data.
+//	Copyright (C) 2017  Jonas Fischer
+//
+//	This program is free software: you can redistribute it and/or modify
+//	it under the terms of the GNU General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+//
+//	This program is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//	GNU General Public License for more details.
+//
+//	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Jonas Fischer	jonaspost@web.de
+
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <array>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <fstream>
+#include <ostream>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+
+// Per thread time spent in the stages of read matching and histograms of the hash table bucket sizes
+// and candidate windows per read. Disabled by default, then every probe is a single branch.
+//
+// Time is accounted exclusively: a Scope charges the time since the last transition to the stage that
+// was active before it, such that nested stages (e.g. computeMethLvl called by extractSingleMatch) are
+// not counted twice. Each slot must only be used by one thread at a time, the matching threads use
+// their OpenMP thread number, parsing and output use the slots PARSESLOT and OUTPUTSLOT.
+//
+// With hardware counters, every slot also reads a perf_event group of the thread using it (cycles, instructions,
+// last level cache and data TLB load misses, branch misses) at each transition and charges the events to the stage
+// like the time. The group counts user space only and is opened again if another thread takes over the slot.
+class Profiler
+{
+
+        struct Slot;
+
+    public:
+
+        enum STAGE : uint8_t {
+            OTHER = 0,      // read loop outside the stages below (reverse complement, counting...)
+            PARSE,          // parsing of FASTQ records
+            SEED,           // hash table lookup of the seeds of a read (getSeedRefs*)
+            SHIFTAND,       // verification of candidate windows (saQuerySeedSetRef*)
+            EXTRACT,        // selection of the best (paired) match (extractSingleMatch, extractPairedMatch)
+            METHLVL,        // alignment and methylation counting (computeMethLvl)
+            OUTPUT,         // writing of methylation levels
+            STAGENUM,
+            NOSTAGE = STAGENUM
+        };
+        enum HIST : uint8_t {
+            BUCKETS = 0,    // size of the hash table bucket of a seed
+            CANDIDATES,     // candidate windows of a read, for single end reads per strand and passing the
+                            // q-gram threshold, for paired reads all windows with seed hits
+            HISTNUM
+        };
+        enum COUNTER : uint8_t {
+            CYCLES = 0,
+            INSTRUCTIONS,
+            LLCMISSES,      // last level cache read misses
+            DTLBMISSES,     // data TLB load misses
+            BRANCHMISSES,
+            COUNTERNUM
+        };
+        // bin 0 counts zeros, bin b > 0 counts values in [2^(b-1), 2^b)
+        static constexpr unsigned int HISTBINS = 24;
+
+        Profiler() : on(false), counting(false), threadNum(0) {}
+        ~Profiler()
+        {
+            closeCounters();
+        }
+        Profiler(const Profiler&) = delete;
+        Profiler& operator=(const Profiler&) = delete;
+
+        // enables profiling and resets all counters for threadNum matching threads, with hardware counters
+        // iff counters
+        void enable(const unsigned int tNum, const bool counters)
+        {
+            closeCounters();
+            on = true;
+            counting = counters;
+            threadNum = tNum;
+            slots.assign(tNum + 2, Slot());
+        }
+        inline bool enabled() const { return on; }
+
+        // slots of the threads that do not match reads
+        inline unsigned int parseSlot() const { return threadNum; }
+        inline unsigned int outputSlot() const { return threadNum + 1; }
+
+        // marks slot t to be in stage s during its lifetime
+        class Scope
+        {
+            public:
+                Scope(Profiler& p, const unsigned int t, const STAGE s) : slot(p.on ? &p.slots[t] : nullptr), prev(NOSTAGE), counting(p.counting)
+                {
+                    if (slot)
+                    {
+                        prev = slot->enter(s, true, counting);
+                    }
+                }
+                ~Scope()
+                {
+                    if (slot)
+                    {
+                        slot->enter(prev, false, counting);
+                    }
+                }
+                Scope(const Scope&) = delete;
+                Scope& operator=(const Scope&) = delete;
+
+            private:
+                Slot* slot;
+                STAGE prev;
+                bool counting;
+        };
+
+        // adds value v to histogram h of slot t
+        inline void hist(const unsigned int t, const HIST h, const uint64_t v)
+        {
+            if (on)
+            {
+                unsigned int b = 0;
+                for (uint64_t x = v; x != 0 && b < HISTBINS - 1; x >>= 1)
+                    ++b;
+                ++slots[t].hists[h][b];
+            }
+        }
+
+        // writes all counters as tab separated table to path
+        // rows are "stage <name> <thread|all> <seconds> <calls>" and "hist <name> <lower> <upper> <count>"
+        // returns false if the file could not be written
+        bool write(const std::string& path) const
+        {
+            std::ofstream of(path);
+            if (!of)
+                return false;
+
+            static const char* histNames[HISTNUM] = {"bucket_size", "candidates"};
+            of << "#type\tname\tthread\tseconds\tcalls";
+            if (counting)
+            {
+                for (unsigned int c = 0; c < COUNTERNUM; ++c)
+                    of << "\t" << counterName(c);
+            }
+            of << "\n";
+            // events of all slots that could count them, NA for counters no slot had
+            auto writeEvents = [&](const std::array<uint64_t, COUNTERNUM>& events, const uint8_t avail)
+            {
+                if (!counting)
+                    return;
+                for (unsigned int c = 0; c < COUNTERNUM; ++c)
+                {
+                    if (avail & (1u << c))
+                        of << "\t" << events[c];
+                    else
+                        of << "\tNA";
+                }
+            };
+            for (unsigned int s = 0; s < STAGENUM; ++s)
+            {
+                double sum = 0;
+                uint64_t calls = 0;
+                std::array<uint64_t, COUNTERNUM> events;
+                events.fill(0);
+                uint8_t avail = 0;
+                for (unsigned int t = 0; t < slots.size(); ++t)
+                {
+                    if (slots[t].calls[s] == 0)
+                        continue;
+                    of << "stage\t" << stageName(s) << "\t" << slotName(t) << "\t" << slots[t].time[s] << "\t" << slots[t].calls[s];
+                    writeEvents(slots[t].events[s], slots[t].avail);
+                    of << "\n";
+                    sum += slots[t].time[s];
+                    calls += slots[t].calls[s];
+                    for (unsigned int c = 0; c < COUNTERNUM; ++c)
+                        events[c] += slots[t].events[s][c];
+                    avail |= slots[t].avail;
+                }
+                of << "stage\t" << stageName(s) << "\tall\t" << sum << "\t" << calls;
+                writeEvents(events, avail);
+                of << "\n";
+            }
+            of << "#type\tname\tlower\tupper\tcount\n";
+            for (unsigned int h = 0; h < HISTNUM; ++h)
+            {
+                for (unsigned int b = 0; b < HISTBINS; ++b)
+                {
+                    uint64_t count = 0;
+                    for (const Slot& slot : slots)
+                        count += slot.hists[h][b];
+                    if (count == 0)
+                        continue;
+                    const uint64_t lower = b == 0 ? 0 : (1ULL << (b - 1));
+                    const uint64_t upper = b == 0 ? 0 : (1ULL << b) - 1;
+                    of << "hist\t" << histNames[h] << "\t" << lower << "\t" << upper << "\t" << count << "\n";
+                }
+            }
+            return static_cast<bool>(of);
+        }
+
+        // prints instructions per cycle and misses per 1000 instructions of every stage over all threads, or why
+        // no counters could be read; nothing without hardware counters
+        void printCounters(std::ostream& os) const
+        {
+            if (!counting)
+                return;
+            uint8_t avail = 0;
+            int err = 0;
+            for (const Slot& slot : slots)
+            {
+                avail |= slot.avail;
+                if (slot.openErr)
+                    err = slot.openErr;
+            }
+            if (!(avail & (1u << CYCLES)) || !(avail & (1u << INSTRUCTIONS)))
+            {
+                os << "No hardware counters could be read (perf_event_open: " << std::strerror(err) << "), they need a PMU visible to this machine and /proc/sys/kernel/perf_event_paranoid of at most 2\n";
+                return;
+            }
+            os << "Hardware counters per stage (IPC, misses per 1000 instructions):\n";
+            for (unsigned int s = 0; s < STAGENUM; ++s)
+            {
+                std::array<uint64_t, COUNTERNUM> events;
+                events.fill(0);
+                for (const Slot& slot : slots)
+                {
+                    for (unsigned int c = 0; c < COUNTERNUM; ++c)
+                        events[c] += slot.events[s][c];
+                }
+                if (events[INSTRUCTIONS] == 0)
+                    continue;
+                os << "\t" << stageName(s) << "\tIPC " << (events[CYCLES] ? static_cast<double>(events[INSTRUCTIONS]) / events[CYCLES] : 0.0);
+                for (const COUNTER c : {LLCMISSES, DTLBMISSES, BRANCHMISSES})
+                {
+                    if (avail & (1u << c))
+                        os << "\t" << counterName(c) << " " << 1000.0 * events[c] / events[INSTRUCTIONS];
+                }
+                os << "\n";
+            }
+        }
+
+
+    private:
+
+        static const char* stageName(const unsigned int s)
+        {
+            static const char* names[STAGENUM] = {"other", "parse", "seed", "shiftand", "extract", "methlvl", "output"};
+            return names[s];
+        }
+        static const char* counterName(const unsigned int c)
+        {
+            static const char* names[COUNTERNUM] = {"cycles", "instructions", "llc_misses", "dtlb_misses", "branch_misses"};
+            return names[c];
+        }
+
+        struct Slot
+        {
+            Slot() : cur(NOSTAGE), mark(std::chrono::steady_clock::now()), fd(-1), tid(0), avail(0), openErr(0)
+            {
+                time.fill(0);
+                calls.fill(0);
+                for (auto& h : hists)
+                    h.fill(0);
+                for (auto& e : events)
+                    e.fill(0);
+                last.fill(0);
+                member.fill(-1);
+            }
+            // charges the time (and with counting the hardware events) since the last transition to the current
+            // stage and switches to s, counting a call of s iff isCall, returns the stage that was active before
+            inline STAGE enter(const STAGE s, const bool isCall, const bool counting)
+            {
+                const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+                if (cur != NOSTAGE)
+                    time[cur] += std::chrono::duration<double>(now - mark).count();
+                if (counting)
+                    countEvents();
+                if (isCall)
+                    ++calls[s];
+                const STAGE prev = cur;
+                cur = s;
+                mark = now;
+                return prev;
+            }
+            // reads the group of the calling thread and charges the events since the last read to cur
+            inline void countEvents()
+            {
+                static thread_local const pid_t self = syscall(SYS_gettid);
+                if (self != tid)
+                {
+                    openCounters(self);
+                    return;
+                }
+                if (fd < 0)
+                    return;
+                // nr followed by the values of the members in the order they were opened
+                std::array<uint64_t, COUNTERNUM + 1> buf;
+                if (read(fd, buf.data(), sizeof(buf)) < static_cast<ssize_t>(sizeof(uint64_t)))
+                    return;
+                for (unsigned int c = 0; c < COUNTERNUM; ++c)
+                {
+                    if (member[c] < 0)
+                        continue;
+                    const uint64_t v = buf[1 + member[c]];
+                    if (cur != NOSTAGE)
+                        events[cur][c] += v - last[c];
+                    last[c] = v;
+                }
+            }
+            // opens the counter group for thread t, counters the machine does not have are left out
+            void openCounters(const pid_t t)
+            {
+                closeCounters();
+                tid = t;
+                static const std::array<std::pair<uint32_t, uint64_t>, COUNTERNUM> config = {{
+                    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+                    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+                    {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+                    {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+                    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES}
+                }};
+                int8_t n = 0;
+                for (unsigned int c = 0; c < COUNTERNUM; ++c)
+                {
+                    struct perf_event_attr attr;
+                    std::memset(&attr, 0, sizeof(attr));
+                    attr.size = sizeof(attr);
+                    attr.type = config[c].first;
+                    attr.config = config[c].second;
+                    attr.read_format = PERF_FORMAT_GROUP;
+                    attr.exclude_kernel = 1;
+                    attr.exclude_hv = 1;
+                    attr.disabled = fd < 0 ? 1 : 0;
+                    const int efd = syscall(SYS_perf_event_open, &attr, t, -1, fd, 0);
+                    if (efd < 0)
+                    {
+                        openErr = errno;
+                        // the group needs its leader
+                        if (fd < 0)
+                            return;
+                        continue;
+                    }
+                    if (fd < 0)
+                        fd = efd;
+                    else
+                        memberFds.push_back(efd);
+                    member[c] = n++;
+                    avail |= 1u << c;
+                }
+                ioctl(fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+                // start the deltas at the current values
+                const STAGE keep = cur;
+                cur = NOSTAGE;
+                countEvents();
+                cur = keep;
+            }
+            void closeCounters()
+            {
+                for (const int efd : memberFds)
+                    close(efd);
+                memberFds.clear();
+                if (fd >= 0)
+                    close(fd);
+                fd = -1;
+                last.fill(0);
+                member.fill(-1);
+            }
+
+            STAGE cur;
+            std::chrono::steady_clock::time_point mark;
+            std::array<double, STAGENUM> time;
+            std::array<uint64_t, STAGENUM> calls;
+            std::array<std::array<uint64_t, HISTBINS>, HISTNUM> hists;
+            // hardware events per stage, the group leader and the other members of the counter group, the thread
+            // it counts, the position of each counter in the group (-1 if not counted) and its last value
+            std::array<std::array<uint64_t, COUNTERNUM>, STAGENUM> events;
+            int fd;
+            std::vector<int> memberFds;
+            pid_t tid;
+            std::array<int8_t, COUNTERNUM> member;
+            std::array<uint64_t, COUNTERNUM> last;
+            // bit c set iff counter c was counted at some time, errno of the last counter that could not be opened
+            uint8_t avail;
+            int openErr;
+            // keep slots of different threads on different cache lines
+            char pad[64];
+        };
+
+        void closeCounters()
+        {
+            for (Slot& slot : slots)
+                slot.closeCounters();
+        }
+
+        std::string slotName(const unsigned int t) const
+        {
+            if (t == parseSlot())
+                return "parse";
+            if (t == outputSlot())
+                return "output";
+            return std::to_string(t);
+        }
+
+        bool on;
+        // true iff hardware counters are read (see Slot::countEvents)
+        bool counting;
+        unsigned int threadNum;
+        std::vector<Slot> slots;
+};
+
+#endif /* PROFILER_H */
@@ -16,20 +16,67 @@
 //
 //	Jonas Fischer	jonaspost@web.de
 
+#include <iostream>
+
+#include "CONST.h"
 #include "Read.h"
 
 Read::Read() :
         id()
     ,   seq()
+    ,   rev()
+    ,   idOff(0)
+    ,   seqOff(0)
+    ,   revOff(0)
+    ,   qualOff(0)
+    ,   nNum(0)
     // ,   matches()
     ,   isInvalid(true)
+    ,   reason(UNMAPPED::NONE)
 {
 }
 
-Read::Read(std::string& sequence, std::string& identifier) :
-        id(identifier)
-    ,   seq(sequence)
-    // ,   matches()
-    ,   isInvalid(false)
+
+ReadBatch::ReadBatch() :
+        count(0)
+    ,   unknownLetters(0)
+    ,   keepQual(false)
+    ,   keepId(true)
+{
+}
+
+ReadBatch::ReadBatch(const size_t n) :
+        count(0)
+    ,   unknownLetters(0)
+    ,   keepQual(false)
+    ,   keepId(true)
+{
+    reserve(n);
+}
+
+void ReadBatch::reserve(const size_t n)
 {
+
+    if (reads.size() < n)
+        reads.resize(n);
+    // id, sequence and reverse complement of typical reads
+    arena.reserve(n * (2 * MyConst::READLEN + 64));
+}
+
+void ReadBatch::bind()
+{
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        Read& r = reads[i];
+        r.id = SeqView(arena.data() + r.idOff, r.id.size());
+        r.seq = SeqView(arena.data() + r.seqOff, r.seq.size());
+        r.rev = SeqView(arena.data() + r.revOff, r.rev.size());
+        r.qual = SeqView(arena.data() + r.qualOff, r.qual.size());
+    }
+    if (unknownLetters)
+    {
+        std::cerr << "Warning! " << unknownLetters << " letters other than A, C, G, T, N in the reads, they are read as N.\n";
+        unknownLetters = 0;
+    }
 }
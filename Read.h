@@ -22,8 +22,11 @@
 #include <string>
 #include <fstream>
 #include <vector>
+#include <utility>
+#include <algorithm>
 
 #include "structs.h"
+#include "SeqView.h"
 
 class Read
 {
@@ -33,7 +36,6 @@ class Read
         // ---- Ctors ----
         //
         Read();
-        Read(std::string& seq, std::string& id);
 
         // ---------------
 
@@ -55,10 +57,23 @@ class Read
         // print the matching info to ofs in SAM format
         void printMatchSam(std::ofstream& ofs);
 
-        std::string id;
+        // id and (DNA) sequence of the read, both point into the arena of the ReadBatch holding the read
+        // (the id is empty if the batch does not keep ids, see ReadBatch::keepIds)
+        SeqView id;
+        SeqView seq;
+        // reverse complement of seq, computed when the read is parsed (see ReadBatch::push)
+        SeqView rev;
+        // base qualities of seq, empty unless the batch keeps them (see ReadBatch::keepQualities)
+        SeqView qual;
 
-        // (DNA) sequence of the read
-        std::string seq;
+        // offsets of id, sequence and reverse complement in the arena of the ReadBatch
+        size_t idOff;
+        size_t seqOff;
+        size_t revOff;
+        size_t qualOff;
+
+        // number of Ns in the sequence (including letters other than A, C, G, T, which are stored as N)
+        uint32_t nNum;
 
         // The matching positions of the read
         MATCH::match mat;
@@ -67,7 +82,135 @@ class Read
         // OR maps to multiple locations in the genome
         // if this is the case, it won't be processed
         bool isInvalid;
+        // why the read is invalid or unmatched, UNMAPPED::NONE for aligned reads
+        UNMAPPED::REASON reason;
+
+        inline void invalidate(const UNMAPPED::REASON why)
+        {
+            isInvalid = true;
+            reason = why;
+        }
+
+};
+
+
+// The reads of one chunk
+// All ids and sequences are stored consecutively in one arena. The arena and the Read records keep
+// their memory when the batch is cleared, such that parsing further chunks does not allocate.
+class ReadBatch
+{
+
+    public:
 
+        ReadBatch();
+        // ARGUMENTS:
+        //          n       expected number of reads per chunk
+        explicit ReadBatch(const size_t n);
+
+        // removes all reads, keeps the allocated memory
+        inline void clear()
+        {
+            count = 0;
+            unknownLetters = 0;
+            arena.clear();
+        }
+
+        // appends a read, its views are valid after the next call to bind()
+        // the sequence is validated and its reverse complement stored in the same pass: lower case letters are
+        // taken as upper case, other letters than A, C, G, T become N (and are counted in unknownLetters)
+        // the first seqLen qualities are stored as well if the batch keeps qualities, missing ones as 'I'
+        inline void push(const char* id, const size_t idLen, const char* seq, const size_t seqLen, const char* qual = nullptr, const size_t qualLen = 0)
+        {
+            if (count == reads.size())
+                reads.emplace_back();
+            Read& r = reads[count++];
+            r.idOff = arena.size();
+            if (keepId)
+                arena.insert(arena.end(), id, id + idLen);
+            r.seqOff = arena.size();
+            r.revOff = r.seqOff + seqLen;
+            arena.resize(r.revOff + seqLen);
+            char* fwd = arena.data() + r.seqOff;
+            char* rev = arena.data() + r.revOff;
+            // the selects are branch free, such that the loop runs in vector lanes
+            uint32_t nNum = 0;
+            uint32_t unknown = 0;
+            for (size_t i = 0; i < seqLen; ++i)
+            {
+                const char c = seq[i] & 0xdf;
+                const bool isA = c == 'A';
+                const bool isC = c == 'C';
+                const bool isG = c == 'G';
+                const bool isT = c == 'T';
+                const bool isN = !(isA | isC | isG | isT);
+                fwd[i] = isN ? 'N' : c;
+                rev[seqLen - 1 - i] = isA ? 'T' : (isC ? 'G' : (isG ? 'C' : (isT ? 'A' : 'N')));
+                nNum += isN;
+                unknown += isN & (c != 'N');
+            }
+            unknownLetters += unknown;
+            r.nNum = nNum;
+            r.id = SeqView(nullptr, keepId ? idLen : 0);
+            r.seq = SeqView(nullptr, seqLen);
+            r.rev = SeqView(nullptr, seqLen);
+            r.qualOff = arena.size();
+            r.qual = SeqView(nullptr, 0);
+            if (keepQual)
+            {
+                const size_t n = std::min(qualLen, seqLen);
+                arena.insert(arena.end(), qual, qual + n);
+                arena.insert(arena.end(), seqLen - n, 'I');
+                r.qual = SeqView(nullptr, seqLen);
+            }
+            r.isInvalid = false;
+            r.reason = UNMAPPED::NONE;
+        }
+        inline void push(const std::string& id, const std::string& seq)
+        {
+            push(id.data(), id.size(), seq.data(), seq.size());
+        }
+
+        // points the views of all reads into the arena
+        // MUST be called after reads were pushed, before the reads are accessed
+        // reports the letters that were replaced by N since the last call
+        void bind();
+
+        void reserve(const size_t n);
+
+        // flag - true iff push stores the base qualities of the reads (needed to write reads back as FASTQ)
+        inline void keepQualities(const bool keep) { keepQual = keep; }
+        // flag - true iff push stores the ids of the reads (default), the ids are empty otherwise
+        inline void keepIds(const bool keep) { keepId = keep; }
+
+        inline size_t size() const { return count; }
+        inline Read& operator[](const size_t i) { return reads[i]; }
+
+        // exchanges the records of reads i and j, their sequences stay in place in the arena
+        inline void swapReads(const size_t i, const size_t j) { std::swap(reads[i], reads[j]); }
+        // drops all reads from n on (n <= size()), e.g. reads moved behind the kept ones with swapReads; their
+        // letters stay in the arena until the batch is cleared
+        inline void truncate(const size_t n) { count = n; }
+
+        inline void swap(ReadBatch& other)
+        {
+            reads.swap(other.reads);
+            arena.swap(other.arena);
+            std::swap(count, other.count);
+            std::swap(unknownLetters, other.unknownLetters);
+            std::swap(keepQual, other.keepQual);
+            std::swap(keepId, other.keepId);
+        }
+
+    private:
+
+        std::vector<Read> reads;
+        std::vector<char> arena;
+        // number of valid reads in reads
+        size_t count;
+        // number of letters other than A, C, G, T, N pushed since the last call to bind()
+        uint64_t unknownLetters;
+        bool keepQual;
+        bool keepId;
 };
 
 #endif /* READ_H */
@@ -19,46 +19,46 @@
 #include <iostream>
 #include <chrono>
 #include <algorithm>
+#include <cstring>
+#include <limits>
+#include <cmath>
+#include <cstdio>
 
+#include "Numa.h"
 #include "ReadQueue.h"
 
-ReadQueue::ReadQueue(const char* filePath, RefGenome& reference, const bool isGZ, const bool bsFlag) :
+ReadQueue::ReadQueue(const std::vector<std::string>& filePaths, RefGenome& reference, const bool isGZ, const bool bsFlag) :
         ref(reference)
-    ,   readBuffer(MyConst::CHUNKSIZE)
+    ,   readBuffer(MyConst::chunkSize)
 	,	isPaired(false)
 	,	isSC(false)
+	,	scSparse(false)
+    ,   interleaved(false)
     ,   methLevels(ref.cpgTable.size())
     ,   methLevelsStart(ref.cpgStartTable.size())
+    ,   methBucketSize(ref.cpgTable.size() / CORENUM + 1)
+    ,   ctxBucketSize(1)
 	,	bothStrandsFlag(bsFlag)
 	,	r1FwdMatches(0)
 	,	r1RevMatches(0)
 	,	matchR1Fwd(true)
+    ,   readFileIdx(0)
+    ,   readFilesGZ(false)
+    ,   inFastq(&fastq)
+    ,   inFastq2(&fastq2)
+    ,   source(nullptr)
+    ,   idsKept(false)
+    ,   cachedReads(0)
+    ,   alignBam(false)
     //TODO
     ,   of("errOut.txt")
 {
-    if (isGZ)
-    {
-
-        igz.open(filePath);
-
-    } else {
 
-        file.open(filePath);
-    }
-
-    // fill counting structure for parallelization
-    for (unsigned int i = 0; i < CORENUM; ++i)
-    {
+    initThreadState();
+    readFiles = filePaths;
+    readFilesGZ = isGZ;
+    openSample(0);
 
-        // fwdMetaIDs[i] = google::dense_hash_map<uint32_t, uint16_t, MetaHash>();
-        // revMetaIDs[i] = google::dense_hash_map<uint32_t, uint16_t, MetaHash>();
-        // fwdMetaIDs[i].set_deleted_key(ref.metaCpGs.size() + 10);
-        // revMetaIDs[i].set_deleted_key(ref.metaCpGs.size() + 10);
-        // fwdMetaIDs[i].set_empty_key(ref.metaWindows.size() + 11);
-        // revMetaIDs[i].set_empty_key(ref.metaWindows.size() + 11);
-		fwdMetaIDs[i] = tsl::hopscotch_map<uint32_t, uint16_t, MetaHash>();
-		revMetaIDs[i] = tsl::hopscotch_map<uint32_t, uint16_t, MetaHash>();
-    }
     // fill array mapping - locale specific filling
     lmap['A'%16] = 0;
     lmap['C'%16] = 1;
@@ -66,22 +66,36 @@ ReadQueue::ReadQueue(const char* filePath, RefGenome& reference, const bool isGZ
     lmap['T'%16] = 3;
 
 }
-ReadQueue::ReadQueue(const char* filePath, const char* filePath2, RefGenome& reference, const bool isGZ, const bool bsFlag) :
+ReadQueue::ReadQueue(const std::vector<std::string>& filePaths, const std::vector<std::string>& filePaths2, RefGenome& reference, const bool isGZ, const bool bsFlag) :
         ref(reference)
-    ,   readBuffer(MyConst::CHUNKSIZE)
-    ,   readBuffer2(MyConst::CHUNKSIZE)
+    ,   readBuffer(MyConst::chunkSize)
+    ,   readBuffer2(MyConst::chunkSize)
 	,	isPaired(true)
 	,	isSC(false)
+	,	scSparse(false)
+    ,   interleaved(false)
     ,   methLevels(ref.cpgTable.size())
     ,   methLevelsStart(ref.cpgStartTable.size())
+    ,   methBucketSize(ref.cpgTable.size() / CORENUM + 1)
+    ,   ctxBucketSize(1)
 	,	bothStrandsFlag(bsFlag)
 	,	r1FwdMatches(0)
 	,	r1RevMatches(0)
 	,	matchR1Fwd(true)
+    ,   readFileIdx(0)
+    ,   readFilesGZ(false)
+    ,   inFastq(&fastq)
+    ,   inFastq2(&fastq2)
+    ,   source(nullptr)
+    ,   idsKept(false)
+    ,   cachedReads(0)
+    ,   alignBam(false)
 	// TODO
     ,   of("errOut.txt")
 {
 
+    initThreadState();
+
 
 
 	// TODO: remove this
@@ -118,17 +132,16 @@ ReadQueue::ReadQueue(const char* filePath, const char* filePath2, RefGenome& ref
 	// cCountFile.close();
 
 
-    if (isGZ)
+    interleaved = filePaths2.empty();
+    if (!interleaved && filePaths.size() != filePaths2.size())
     {
-
-        igz.open(filePath);
-        igz2.open(filePath2);
-
-    } else {
-
-        file.open(filePath);
-        file2.open(filePath2);
+        std::cerr << "Not the same number of files for read 1 and read 2! Terminating...\n\n";
+        exit(1);
     }
+    readFiles = filePaths;
+    readFiles2 = filePaths2;
+    readFilesGZ = isGZ;
+    openSample(0);
 
     // fill counting structure for parallelization
     for (unsigned int i = 0; i < CORENUM; ++i)
@@ -149,180 +162,469 @@ ReadQueue::ReadQueue(const char* filePath, const char* filePath2, RefGenome& ref
     lmap['G'%16] = 2;
     lmap['T'%16] = 3;
 }
-ReadQueue::ReadQueue(const char* scOutputPath, RefGenome& reference, const bool isGZ, const bool bsFlag, const bool isP) :
+ReadQueue::ReadQueue(RefGenome& reference, const bool isP, const bool bsFlag) :
+        ref(reference)
+    ,   readBuffer(MyConst::chunkSize)
+    ,   readBuffer2(isP ? MyConst::chunkSize : 0)
+	,	isPaired(isP)
+	,	isSC(false)
+	,	scSparse(false)
+    ,   interleaved(false)
+    ,   methLevels(ref.cpgTable.size())
+    ,   methLevelsStart(ref.cpgStartTable.size())
+    ,   methBucketSize(ref.cpgTable.size() / CORENUM + 1)
+    ,   ctxBucketSize(1)
+	,	bothStrandsFlag(bsFlag)
+	,	r1FwdMatches(0)
+	,	r1RevMatches(0)
+	,	matchR1Fwd(true)
+    ,   readFileIdx(0)
+    ,   readFilesGZ(false)
+    ,   inFastq(&fastq)
+    ,   inFastq2(&fastq2)
+    ,   source(nullptr)
+    ,   idsKept(false)
+    ,   cachedReads(0)
+    ,   alignBam(false)
+    ,   of("errOut.txt")
+{
+
+    initThreadState();
+
+    // fill array mapping - locale specific filling
+    lmap['A'%16] = 0;
+    lmap['C'%16] = 1;
+    lmap['G'%16] = 2;
+    lmap['T'%16] = 3;
+}
+
+ReadQueue::ReadQueue(const char* scOutputPath, RefGenome& reference, const bool isGZ, const bool bsFlag, const bool isP, const METHFILE::FORMAT scFormat, const bool sparse) :
         ref(reference)
-    ,   readBuffer(MyConst::CHUNKSIZE)
-    ,   readBuffer2(MyConst::CHUNKSIZE)
+    ,   readBuffer(MyConst::chunkSize)
+    ,   readBuffer2(MyConst::chunkSize)
 	,	isPaired(isP)
 	,	isSC(true)
+	,	scSparse(sparse)
+    ,   interleaved(false)
     ,   methLevels(ref.cpgTable.size())
     ,   methLevelsStart(ref.cpgStartTable.size())
 	,	methLevelsSc(ref.cpgTable.size())
-	,	scOutput(scOutputPath)
+    ,   methBucketSize(ref.cpgTable.size() / CORENUM + 1)
+    ,   ctxBucketSize(1)
 	,	bothStrandsFlag(bsFlag)
 	,	r1FwdMatches(0)
 	,	r1RevMatches(0)
 	,	matchR1Fwd(true)
+    ,   readFileIdx(0)
+    ,   readFilesGZ(false)
+    ,   inFastq(&fastq)
+    ,   inFastq2(&fastq2)
+    ,   source(nullptr)
+    ,   idsKept(false)
+    ,   cachedReads(0)
+    ,   alignBam(false)
 	// TODO
     ,   of("errOut.txt")
 {
 
+    initThreadState();
+
     // fill array mapping - locale specific filling
     lmap['A'%16] = 0;
     lmap['C'%16] = 1;
     lmap['G'%16] = 2;
     lmap['T'%16] = 3;
 	// initialize sc output file
-	scOutput << "\nSC_ID\tCount_Type\t";
+	if (scFormat == METHFILE::BINARY)
+	{
+		std::cerr << "Binary output is not available for single cell counts! Terminating...\n\n";
+		exit(1);
+	}
+	if (!scOutput.open(scOutputPath, scFormat == METHFILE::BGZF))
+	{
+		std::cerr << "Could not open file \"" << scOutputPath << "\" for single cell output! Terminating...\n\n";
+		exit(1);
+	}
+	if (scSparse)
+	{
+		scOutput.write("SC_ID\tChromosome\tPosition\tFwd_methylated\tFwd_unmethylated\tRev_methylated\tRev_unmethylated\n");
+		return;
+	}
+	const std::vector<std::string> chrNames = getChromNames();
+	scOutput.write("\nSC_ID\tCount_Type\t");
     for (size_t cpgID = 0; cpgID < ref.cpgTable.size(); ++cpgID)
     {
-        scOutput << ref.chrMap[ref.cpgTable[cpgID].chrom] << "\t";
+        scOutput.write(chrNames[ref.cpgTable[cpgID].chrom]);
+        scOutput.put('\t');
 	}
-	scOutput << "\nSC_ID\tCount_Type\t";
+	scOutput.write("\nSC_ID\tCount_Type\t");
     for (size_t cpgID = 0; cpgID < ref.cpgTable.size(); ++cpgID)
     {
-        scOutput << ref.cpgTable[cpgID].pos + MyConst::READLEN - 2 << "\t";
+        scOutput.putUInt(ref.cpgTable[cpgID].pos + MyConst::READLEN - 2 + ref.chrOffsets[ref.cpgTable[cpgID].chrom]);
+        scOutput.put('\t');
 	}
 }
 
-bool ReadQueue::parseChunk(unsigned int& procReads)
+void ReadQueue::initThreadState()
 {
 
-    // std::cout << "Start reading chunk of reads\n";
-    //
-    std::string id;
+    fwdMetaIDs.resize(CORENUM);
+    revMetaIDs.resize(CORENUM);
+    paired_fwdMetaIDs.resize(CORENUM);
+    paired_revMetaIDs.resize(CORENUM);
+    paired_fwdSpans.resize(CORENUM);
+    paired_revSpans.resize(CORENUM);
+    methEvents.assign(CORENUM, std::vector<std::vector<uint64_t> >(CORENUM));
+    methDeltaEvents.assign(CORENUM, std::vector<uint64_t>());
+    keepMethDeltas = false;
+    methOverflow.resize(CORENUM);
+    methTouched.resize(CORENUM);
+    threadCell.assign(CORENUM, 0);
+    threadWeight.assign(CORENUM, 1);
+    genomeReads.assign(ref.genomes().empty() ? 0 : CORENUM, std::vector<uint64_t>(ref.genomes().size(), 0));
+    threadCalls.resize(CORENUM);
+    threadReadFlags.assign(CORENUM, 0);
+    threadRead.assign(CORENUM, 0);
+    dedup = false;
+    dedupPass = false;
+    dupCount = 0;
+    threadCallText.resize(CORENUM);
+    revSeqBuf.resize(2 * CORENUM);
+    refWinBuf.resize(CORENUM);
+    seedBuckets.resize(CORENUM);
+    seedHashes.resize(CORENUM);
+    seedPrints.resize(CORENUM);
+    seedGroups.resize(CORENUM);
+    seedOrder.resize(CORENUM);
+    pairKeys.resize(2 * CORENUM);
+    overBudget.assign(CORENUM, 0);
+    overBudgetStats.assign(CORENUM, 0);
+    pairHits.resize(CORENUM);
+    pairRunHits.resize(CORENUM);
+    pairRuns.resize(CORENUM);
+    pairWindows.resize(CORENUM);
+    readPacks.resize(2 * CORENUM);
+    // automata hold a reference to lmap, so they are constructed in place
+    auto allocAutomata = [&](auto& sas)
+    {
+        sas.clear();
+        sas.reserve(SASLOTS * CORENUM);
+        for (unsigned int i = 0; i < SASLOTS * CORENUM; ++i)
+        {
+            sas.emplace_back(lmap);
+        }
+    };
+    allocAutomata(std::get<0>(automata));
+    allocAutomata(std::get<1>(automata));
+    allocAutomata(std::get<2>(automata));
+    allocAutomata(std::get<3>(automata));
+    saMatchings.resize(CORENUM);
+    saErrors.resize(CORENUM);
+    candidateBuf.resize(CORENUM);
+    laneMatchBuf.resize(CORENUM);
+    laneErrBuf.resize(CORENUM);
+    tierRetryBuf.resize(CORENUM);
+    tierOverlap.resize(CORENUM, 0);
+    batchTasks.resize(CORENUM);
+    batchMatchings.resize(CORENUM + 1);
+    batchErrors.resize(CORENUM + 1);
+    pairedMetaBuf.resize(CORENUM);
+    pairedMatchBuf.resize(CORENUM);
+    matchStats.assign(CORENUM, 0);
+    nonUniqueStats.assign(CORENUM, 0);
+    noMatchStats.assign(CORENUM, 0);
+    matchPairedStats.assign(CORENUM, 0);
+    tooShortCounts.assign(CORENUM, 0);
+    threadBusy.assign(CORENUM, 0);
+
+    // scheduling starts static, see beginSchedule
+    schedDynamic = false;
+    schedDynamicBatches = 0;
+    sumBusyTime = 0;
+    sumIdleTime = 0;
+    staticBatches = 0;
+    dynamicBatches = 0;
+
+    // the OpenMP runtime keeps its workers for all parallel regions of CORENUM threads, so pinning them once
+    // fixes the CPU (and node) every thread number runs on
+    // (workers pinned by an earlier queue of the process, e.g. one of the autotuner, are released for LAYOUT_OS)
+    static bool workersPinned = false;
+    const std::vector<int> cpus = NUMA::layoutCpus(MyConst::numa ? MyConst::LAYOUT_SPREAD : MyConst::threadLayout);
+    if (!cpus.empty() || workersPinned)
+    {
+        // the master thread is never pinned, its affinity is the one of the process
+        cpu_set_t processCpus;
+        CPU_ZERO(&processCpus);
+        const bool haveProcessCpus = sched_getaffinity(0, sizeof(processCpus), &processCpus) == 0;
+#pragma omp parallel num_threads(CORENUM)
+        {
+            const unsigned int t = omp_get_thread_num();
+            // the master thread also starts the FASTQ parsing threads, which would inherit its affinity
+            if (t > 0 && !cpus.empty())
+                NUMA::pinThread(cpus[t % cpus.size()]);
+            else if (t > 0 && haveProcessCpus)
+                sched_setaffinity(0, sizeof(processCpus), &processCpus);
+        }
+        workersPinned = !cpus.empty();
+    }
+}
 
-    // counter on how many reads have been read so far
-    unsigned int readCounter = 0;
+void ReadQueue::beginSchedule(const unsigned int procReads)
+{
 
-    // read first line of read (aka @'SEQID')
-    while (std::getline(file, id))
+    switch (MyConst::schedule)
     {
+        case MyConst::SCHED_STATIC:
+            schedDynamic = false;
+            break;
+        case MyConst::SCHED_DYNAMIC:
+            schedDynamic = true;
+            break;
+        default:
+            // a dynamic batch shows no imbalance, so retry static every SCHEDPROBE batches
+            // to find out if the reads became uniform again
+            if (schedDynamic && schedDynamicBatches >= MyConst::SCHEDPROBE)
+            {
+                schedDynamic = false;
+            }
+            break;
+    }
+    threadBusy.assign(CORENUM, 0);
 
-        // read the next line (aka raw sequence)
-        std::string seq;
-        std::getline(file, seq);
-        // construct read and push it to buffer
-        readBuffer[readCounter] = Read(seq, id);
-        // read the rest of read (aka +'SEQID' and quality score sequence)
-        std::getline(file,id);
-        std::getline(file,seq);
-
-        ++readCounter;
+#ifdef _OPENMP
+    if (schedDynamic)
+    {
+        const int chunk = std::max(1u, procReads / (CORENUM * MyConst::SCHEDCHUNKS));
+        omp_set_schedule(omp_sched_dynamic, chunk);
 
-        // if buffer is read completely, return
-        if (readCounter >= MyConst::CHUNKSIZE)
-        {
-            procReads = MyConst::CHUNKSIZE;
-            break;
+    } else {
 
-        }
+        omp_set_schedule(omp_sched_static, 0);
     }
-    // if needed, read paired reads
-    if (isPaired)
-    {
+#endif
+}
 
-        unsigned int readCounter2 = 0;
-        // read first line of read (aka @'SEQID')
-        while (std::getline(file2, id))
-        {
+void ReadQueue::endSchedule()
+{
 
-            // read the next line (aka raw sequence)
-            std::string seq;
-            std::getline(file2, seq);
-            // construct read and push it to buffer
-            readBuffer2[readCounter2] = Read(seq, id);
-            // read the rest of read (aka +'SEQID' and quality score sequence)
-            std::getline(file2,id);
-            std::getline(file2,seq);
+    double maxBusy = 0;
+    double busy = 0;
+    for (const double t : threadBusy)
+    {
+        maxBusy = std::max(maxBusy, t);
+        busy += t;
+    }
+    // time the threads wait for the slowest one at the end of the batch
+    const double idle = maxBusy * CORENUM - busy;
+    sumBusyTime += busy;
+    sumIdleTime += idle;
 
-            ++readCounter2;
+    if (schedDynamic)
+    {
+        ++dynamicBatches;
+        ++schedDynamicBatches;
 
-            // if buffer is read completely, return
-            if (readCounter2 >= MyConst::CHUNKSIZE)
-            {
-                procReads = MyConst::CHUNKSIZE;
-                return true;
+    } else {
 
-            }
-        }
-        // check if same number of reads is processed so far
-        if (readCounter != readCounter2)
+        ++staticBatches;
+        schedDynamicBatches = 0;
+        if (MyConst::schedule == MyConst::SCHED_AUTO && CORENUM > 1)
         {
-            std::cerr << "Not the same number of reads available in the paired read files! \
-                            Make sure that you paired all reads. \
-                            Single reads have to be processed separately.\n\n";
-            exit(1);
+            // mean waiting time of a thread relative to the slowest thread
+            schedDynamic = idle > MyConst::SCHEDIMBALANCE * maxBusy * CORENUM;
         }
+    }
+}
 
-    } else {
+void ReadQueue::enableProfiling(const bool counters)
+{
 
-        if (readCounter >= MyConst::CHUNKSIZE)
-            return true;
+    prof.enable(CORENUM, counters);
+}
+
+void ReadQueue::writeProfile(const std::string& path)
+{
+
+    if (!prof.write(path))
+    {
+        std::cerr << "Could not write profile to \"" << path << "\"! Terminating...\n\n";
+        exit(1);
     }
+    std::cout << "Profile written to \"" << path << "\"\n";
+    prof.printCounters(std::cout);
+}
 
-    procReads = readCounter;
-    return false;
+void ReadQueue::printThreadTiming()
+{
+
+    std::cout << "Thread busy time " << sumBusyTime << "s, waiting at batch ends " << sumIdleTime << "s";
+    if (sumBusyTime + sumIdleTime > 0)
+    {
+        std::cout << " (" << 100 * sumIdleTime / (sumBusyTime + sumIdleTime) << "%)";
+    }
+    std::cout << ", " << staticBatches << " static / " << dynamicBatches << " dynamic batches\n";
 }
 
-bool ReadQueue::parseChunkGZ(unsigned int& procReads)
+void ReadQueue::openReads(FastqReader& reader, const std::string& filePath, const bool isGZ)
 {
 
-    std::string id;
+    if (!reader.open(filePath, isGZ))
+    {
+        std::cerr << "Could not open read file \"" << filePath << "\"! Terminating...\n\n";
+        exit(1);
+    }
+    reader.setShard(MyConst::shardIdx, MyConst::shardNum, MyConst::SHARDBLOCK);
+}
 
-    // counter on how many reads have been read so far
-    unsigned int readCounter = 0;
+void ReadQueue::openSample(const size_t first)
+{
 
-    // read first line of read (aka @'SEQID')
-    while (std::getline(igz, id))
+    fastqSpare.close();
+    fastq2Spare.close();
+    readFileIdx = first;
+    inFastq = &fastq;
+    inFastq2 = &fastq2;
+    openReads(fastq, readFiles[first], readFilesGZ);
+    if (isPaired && !interleaved)
+        openReads(fastq2, readFiles2[first], readFilesGZ);
+    if (readFiles.size() > first + 1)
     {
+        openReads(fastqSpare, readFiles[first + 1], readFilesGZ);
+        if (isPaired && !interleaved)
+            openReads(fastq2Spare, readFiles2[first + 1], readFilesGZ);
+    }
+}
 
-        // read the next line (aka raw sequence)
-        std::string seq;
-        std::getline(igz, seq);
-        // construct read and push it to buffer
-        readBuffer[readCounter] = Read(seq, id);
-        // read the rest of read (aka +'SEQID' and quality score sequence)
-        std::getline(igz,id);
-        std::getline(igz,seq);
+bool ReadQueue::nextReadFile()
+{
 
-        ++readCounter;
+    if (readFileIdx + 1 >= readFiles.size())
+        return false;
 
-        // if buffer is read completely, return
-        if (readCounter >= MyConst::CHUNKSIZE)
-        {
-            procReads = MyConst::CHUNKSIZE;
-            break;
+    ++readFileIdx;
+    FastqReader* done = inFastq;
+    inFastq = inFastq == &fastq ? &fastqSpare : &fastq;
+    done->close();
+    if (readFileIdx + 1 < readFiles.size())
+        openReads(*done, readFiles[readFileIdx + 1], readFilesGZ);
+    if (isPaired && !interleaved)
+    {
+        FastqReader* done2 = inFastq2;
+        inFastq2 = inFastq2 == &fastq2 ? &fastq2Spare : &fastq2;
+        done2->close();
+        if (readFileIdx + 1 < readFiles2.size())
+            openReads(*done2, readFiles2[readFileIdx + 1], readFilesGZ);
+    }
+    return true;
+}
 
-        }
+bool ReadQueue::parseSample(ReadBatch& buf, ReadBatch& buf2, unsigned int& procReads, InputPos& pos)
+{
+
+    bool isFull = parseChunkStream(*inFastq, *inFastq2, buf, buf2, procReads, 0);
+    // a chunk ending with a file is filled up from the next files, such that all chunks but the last are full
+    while (!isFull && nextReadFile())
+    {
+        isFull = parseChunkStream(*inFastq, *inFastq2, buf, buf2, procReads, procReads);
     }
-    // if needed, read paired reads
+    pos.fileIdx = readFileIdx;
+    pos.records = inFastq->records();
+    pos.offset = inFastq->offset();
+    pos.records2 = inFastq2->records();
+    pos.offset2 = inFastq2->offset();
+    return isFull;
+}
+
+bool ReadQueue::parseChunk(unsigned int& procReads)
+{
+
+    return parseSample(readBuffer, readBuffer2, procReads, inputPos);
+}
+
+bool ReadQueue::parseChunkGZ(unsigned int& procReads)
+{
+
+    // decompression is done by the reader
+    return parseSample(readBuffer, readBuffer2, procReads, inputPos);
+}
+
+bool ReadQueue::parseBatch(Batch& b)
+{
+
+    b.reads.keepQualities(unmappedOut.isOpen());
+    b.reads2.keepQualities(unmappedOut.isOpen());
+    // batches are only allocated once the pipeline is used
+    b.reads.reserve(MyConst::chunkSize);
     if (isPaired)
-    {
+        b.reads2.reserve(MyConst::chunkSize);
+    return parseSample(b.reads, b.reads2, b.count, b.pos);
+}
+
+void ReadQueue::swapBatch(Batch& b)
+{
 
-        unsigned int readCounter2 = 0;
-        // read first line of read (aka @'SEQID')
-        while (std::getline(igz2, id))
+    readBuffer.swap(b.reads);
+    readBuffer2.swap(b.reads2);
+    std::swap(inputPos, b.pos);
+    // the read calls of the reads just matched go with them, before the matching the threads hold none
+    if (callOut.isOpen())
+    {
+        b.callText.clear();
+        for (std::string& text : threadCallText)
         {
+            b.callText += text;
+            text.clear();
+        }
+    }
+}
 
-            // read the next line (aka raw sequence)
-            std::string seq;
-            std::getline(igz2, seq);
-            // construct read and push it to buffer
-            readBuffer2[readCounter2] = Read(seq, id);
-            // read the rest of read (aka +'SEQID' and quality score sequence)
-            std::getline(igz2,id);
-            std::getline(igz2,seq);
+bool ReadQueue::parseChunkStream(FastqReader& in, FastqReader& in2, ReadBatch& buf, ReadBatch& buf2, unsigned int& procReads, const unsigned int offset)
+{
 
-            ++readCounter2;
+    Profiler::Scope profScope(prof, prof.parseSlot(), Profiler::PARSE);
 
-            // if buffer is read completely, return
-            if (readCounter2 >= MyConst::CHUNKSIZE)
-            {
-                procReads = MyConst::CHUNKSIZE;
-                return true;
+    // the ids are not copied into the batches unless written per read
+    const bool keepIds = idsKept || alignOut.isOpen() || unmappedOut.isOpen();
+    buf.keepIds(keepIds);
+    buf2.keepIds(keepIds);
+    // reads before offset are kept
+    if (offset == 0)
+    {
+        buf.clear();
+        buf2.clear();
+    }
+    if (source)
+    {
+        procReads = offset + source->read(buf, isPaired ? &buf2 : nullptr, MyConst::chunkSize - offset);
+        buf.bind();
+        if (isPaired)
+            buf2.bind();
+        return procReads >= MyConst::chunkSize;
+    }
+    if (interleaved)
+    {
+        procReads = offset + in.readPairs(buf, buf2, MyConst::chunkSize - offset);
+        buf.bind();
+        buf2.bind();
+        return procReads >= MyConst::chunkSize;
+    }
 
-            }
+    // counter on how many reads have been read so far
+    const unsigned int readCounter = offset + in.read(buf, MyConst::chunkSize - offset);
+    if (readCounter >= MyConst::chunkSize)
+        procReads = MyConst::chunkSize;
+
+    // if needed, read paired reads
+    if (isPaired)
+    {
+
+        const unsigned int readCounter2 = offset + in2.read(buf2, MyConst::chunkSize - offset);
+        if (readCounter2 >= MyConst::chunkSize)
+        {
+            procReads = MyConst::chunkSize;
+            buf.bind();
+            buf2.bind();
+            return true;
         }
         // check if same number of reads is processed so far
         if (readCounter != readCounter2)
@@ -332,11 +634,12 @@ bool ReadQueue::parseChunkGZ(unsigned int& procReads)
                             Single reads have to be processed separately.\n\n";
             exit(1);
         }
-    } else {
 
-        if (readCounter >= MyConst::CHUNKSIZE)
-            return true;
+        buf2.bind();
     }
+    buf.bind();
+    if (!isPaired && readCounter >= MyConst::chunkSize)
+        return true;
 
     procReads = readCounter;
     return false;
@@ -371,7 +674,94 @@ void ReadQueue::decideStrand()
 
 
 
-bool ReadQueue::matchReads(const unsigned int& procReads, uint64_t& succMatch, uint64_t& nonUniqueMatch, uint64_t& unSuccMatch, const bool getStranded)
+void ReadQueue::sampleStrand(const unsigned int& procReads)
+{
+	unsigned int sampled;
+	// budgets must match MyConst::ERRBUDGETS
+	switch (MyConst::errBudget)
+	{
+		case 2:
+			sampled = sampleStrandBudget<2>(procReads);
+			break;
+		case 4:
+			sampled = sampleStrandBudget<4>(procReads);
+			break;
+		case 8:
+			sampled = sampleStrandBudget<8>(procReads);
+			break;
+		default:
+			sampled = sampleStrandBudget<6>(procReads);
+			break;
+	}
+	std::cout << "\nSampled " << sampled << " reads for stranding.";
+	decideStrand();
+}
+
+template <size_t E>
+unsigned int ReadQueue::sampleStrandBudget(const unsigned int& procReads)
+{
+	r1FwdMatches = 0;
+	r1RevMatches = 0;
+	// log likelihood ratio of a fwd match resp. the negated one of a rev match, and the decision bound
+	const double llrStep = std::log(MyConst::STRANDP / (1.0 - MyConst::STRANDP));
+	const double llrBound = std::log((1.0 - MyConst::STRANDERR) / MyConst::STRANDERR);
+
+	unsigned int sampled = 0;
+	while (sampled < procReads)
+	{
+		const unsigned int roundEnd = std::min(procReads, sampled + MyConst::STRANDROUND);
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(CORENUM) schedule(dynamic,16)
+#endif
+		for (unsigned int i = sampled; i < roundEnd; ++i)
+		{
+			const int threadnum = omp_get_thread_num();
+			Read& r = readBuffer[i];
+			const size_t readSize = r.seq.size();
+			std::string& revSeq = revSeqBuf[2 * threadnum];
+			// the read is rejected again when it is matched
+			if (!prepareRead(r, revSeq))
+				continue;
+			if (ref.hasKmerOffsets())
+			{
+				readPacks[2 * threadnum].assign(r.seq.data(), readSize);
+				readPacks[2 * threadnum + 1].assign(revSeq.data(), readSize);
+			}
+			uint16_t qThreshold = ref.qgramThreshold();
+			MATCH::match matchFwd = 0;
+			MATCH::match matchRev = 0;
+			getSeedRefs(r.seq, readSize, qThreshold);
+			ShiftAnd<E>& saFwd = threadAutomaton<E>(threadnum, 0);
+			saFwd.reload(r.seq);
+			const int succQueryFwd = saQuerySeedSetRef(saFwd, readPacks[2 * threadnum], readPacks[2 * threadnum + 1], matchFwd, qThreshold);
+			getSeedRefs(revSeq, readSize, qThreshold);
+			ShiftAnd<E>& saRev = threadAutomaton<E>(threadnum, 1);
+			saRev.reload(revSeq);
+			const int succQueryRev = saQuerySeedSetRef(saRev, readPacks[2 * threadnum + 1], readPacks[2 * threadnum], matchRev, qThreshold);
+			overBudget[threadnum] = 0;
+
+			// only reads with a unique best match on one strand count, as in resolveSingleMatch
+			if (succQueryFwd == 1 && (succQueryRev == 0 || MATCH::getErrNum(matchFwd) < MATCH::getErrNum(matchRev)))
+			{
+#pragma omp atomic
+				++r1FwdMatches;
+			} else if (succQueryRev == 1 && (succQueryFwd == 0 || MATCH::getErrNum(matchRev) < MATCH::getErrNum(matchFwd))) {
+#pragma omp atomic
+				++r1RevMatches;
+			}
+		}
+		sampled = roundEnd;
+
+		const double llr = (static_cast<double>(r1FwdMatches) - static_cast<double>(r1RevMatches)) * llrStep;
+		if (r1FwdMatches + r1RevMatches >= MyConst::STRANDMINMATCH && std::abs(llr) >= llrBound)
+			break;
+	}
+	return sampled;
+}
+
+
+template <size_t E, size_t A>
+bool ReadQueue::matchReadsImpl(const unsigned int& procReads, uint64_t& succMatch, uint64_t& nonUniqueMatch, uint64_t& unSuccMatch, const bool getStranded, const std::vector<uint32_t>* readIds, const bool firstTier)
 {
 
     // reset all counters
@@ -380,84 +770,34 @@ bool ReadQueue::matchReads(const unsigned int& procReads, uint64_t& succMatch, u
         matchStats[i] = 0;
         nonUniqueStats[i] = 0;
         noMatchStats[i] = 0;
+        // buckets held by seedAhead belong to the reads of the last call
+        seedGroups[i].first = 0;
+        seedGroups[i].last = 0;
     }
 
 #ifdef _OPENMP
-#pragma omp parallel for num_threads(CORENUM) schedule(static)
+#pragma omp parallel for num_threads(CORENUM) schedule(runtime)
 #endif
-    for (unsigned int i = 0; i < procReads; ++i)
+    for (unsigned int j = 0; j < procReads; ++j)
     {
 
+        const unsigned int i = readIds ? (*readIds)[j] : j;
         int threadnum = omp_get_thread_num();
+        BusyTimer busyTimer(threadBusy[threadnum]);
+        Profiler::Scope profScope(prof, threadnum, Profiler::OTHER);
 
-        uint64_t& succMatchT = matchStats[threadnum];
-        uint64_t& nonUniqueMatchT = nonUniqueStats[threadnum];
-        uint64_t& unSuccMatchT = noMatchStats[threadnum];
         Read& r = readBuffer[i];
+        if (isSC)
+            threadCell[threadnum] = readCells[i];
+        threadWeight[threadnum] = MyConst::readCache ? readWeight[i] : 1;
+        threadRead[threadnum] = i;
 
         const size_t readSize = r.seq.size();
-
-        if (readSize < MyConst::READLEN - 20)
-        {
-
-            r.isInvalid = true;
-            continue;
-        }
-
-        // flag stating if read contains N
-        // reads with N are ignored
-        bool nflag = false;
-
-        // get correct offset for reverse strand (strand orientation must be correct)
-        size_t revPos = readSize - 1;
-
-        // std::chrono::high_resolution_clock::time_point startTime = std::chrono::high_resolution_clock::now();
         // string containing reverse complement (under FULL alphabet)
-        std::string revSeq;
-        revSeq.resize(readSize);
-
-        // construct reduced alphabet sequence for forward and reverse strand
-        for (size_t pos = 0; pos < readSize; ++pos, --revPos)
-        {
-
-            switch (r.seq[pos])
-            {
-                case 'A':
-
-                    revSeq[revPos] = 'T';
-                    break;
-
-                case 'C':
-
-                    revSeq[revPos] = 'G';
-                    break;
-
-                case 'G':
-
-                    revSeq[revPos] = 'C';
-                    break;
-
-                case 'T':
-
-                    revSeq[revPos] = 'A';
-                    break;
-
-                case 'N':
-
-                    nflag = true;
-                    break;
-
-                default:
-
-                    std::cerr << "Unknown character '" << r.seq[pos] << "' in read with sequence id " << r.id << std::endl;
-            }
-        }
-
-        if (nflag)
-        {
-            r.isInvalid = true;
+        std::string& revSeq = revSeqBuf[2 * threadnum];
+        if (!prepareRead(r, revSeq))
             continue;
-        }
+        tierOverlap[threadnum] = 0;
 
         // std::chrono::high_resolution_clock::time_point endTime = std::chrono::high_resolution_clock::now();
         // auto runtime = std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime).count();
@@ -465,8 +805,15 @@ bool ReadQueue::matchReads(const unsigned int& procReads, uint64_t& succMatch, u
         // of << runtime << "\n";
 		//
 
+        // packed read and reverse complement for the exact match fast path, which needs the predicted positions
+        if (ref.hasKmerOffsets())
+        {
+            readPacks[2 * threadnum].assign(r.seq.data(), readSize);
+            readPacks[2 * threadnum + 1].assign(revSeq.data(), readSize);
+        }
+
         // set qgram threshold
-		uint16_t qThreshold = MyConst::QTHRESH;
+		uint16_t qThreshold = ref.qgramThreshold();
         // TODO
         // startTime = std::chrono::high_resolution_clock::now();
         MATCH::match matchFwd = 0;
@@ -496,17 +843,39 @@ bool ReadQueue::matchReads(const unsigned int& procReads, uint64_t& succMatch, u
         // }
         // startTime = std::chrono::high_resolution_clock::now();
 		int succQueryFwd = 0;
-		if (bothStrandsFlag || getStranded || matchR1Fwd)
+		int succQueryRev = 0;
+		MATCH::match matchRev = 0;
+		// both patterns are verified in one pass (the adaptive error bound of the reverse complement needs the result
+		// of the read first)
+		const bool joint = MyConst::jointStrands && !MyConst::adaptiveErrors && (bothStrandsFlag || getStranded);
+		// the buckets of this read were looked up together with those of the next reads of the thread
+		const bool grouped = MyConst::interleave > 1 && !joint;
+		if (grouped)
+			seedAhead(j, procReads, readIds, bothStrandsFlag || getStranded || matchR1Fwd, bothStrandsFlag || getStranded || !matchR1Fwd, threadnum);
+		if (joint)
 		{
+			std::array<int, 2> succQuery = {{0, 0}};
+			std::array<MATCH::match, 2> matches = {{0, 0}};
+			matchBothPatterns<E>(i, revSeq, qThreshold, succQuery, matches);
+			succQueryFwd = succQuery[0];
+			matchFwd = matches[0];
+			succQueryRev = succQuery[1];
+			matchRev = matches[1];
+
+		} else if (bothStrandsFlag || getStranded || matchR1Fwd)
+		{
+			if (grouped)
+				takeSeeds(j, 0, threadnum);
 			getSeedRefs(r.seq, readSize, qThreshold);
-			ShiftAnd<MyConst::MISCOUNT + MyConst::ADDMIS> saFwd(r.seq, lmap);
+			ShiftAnd<E>& saFwd = threadAutomaton<E>(threadnum, 0);
+			saFwd.reload(r.seq);
 			// endTime = std::chrono::high_resolution_clock::now();
 			// runtime = std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime).count();
 			// of << runtime << "\t";
 			// startTime = std::chrono::high_resolution_clock::now();
 			// of << "--------------------------------\n\n";
 			// of << "Matching read " << r.id << "\n\n";
-			succQueryFwd = saQuerySeedSetRef(saFwd, matchFwd, qThreshold);
+			succQueryFwd = saQuerySeedSetRef(saFwd, readPacks[2 * threadnum], readPacks[2 * threadnum + 1], matchFwd, qThreshold);
 			// succQueryFwd = matchSingle(r.seq, qThreshold, saFwd, matchFwd, threadnum);
 		}
 
@@ -516,7 +885,6 @@ bool ReadQueue::matchReads(const unsigned int& procReads, uint64_t& succMatch, u
         // of << runtime << "\n";
         //
         // startTime = std::chrono::high_resolution_clock::now();
-        MATCH::match matchRev = 0;
         // if (!succFlag)
         // {
         //     ++readCount;
@@ -557,16 +925,21 @@ bool ReadQueue::matchReads(const unsigned int& procReads, uint64_t& succMatch, u
         // }
         // startTime = std::chrono::high_resolution_clock::now();
         // std::cout << revSeq << "\n";
-		int succQueryRev = 0;
-		if (bothStrandsFlag || getStranded || !matchR1Fwd)
+		if (!joint && (bothStrandsFlag || getStranded || !matchR1Fwd))
 		{
+			if (grouped)
+				takeSeeds(j, 1, threadnum);
 			getSeedRefs(revSeq, readSize, qThreshold);
-			ShiftAnd<MyConst::MISCOUNT + MyConst::ADDMIS> saRev(revSeq, lmap);
+			ShiftAnd<E>& saRev = threadAutomaton<E>(threadnum, 1);
+			saRev.reload(revSeq);
+			// only rev matches with at most one error more than the fwd match can change the result
+			if (MyConst::adaptiveErrors && succQueryFwd != 0)
+				saRev.setErrorBound(MATCH::getErrNum(matchFwd) + 1);
 			// endTime = std::chrono::high_resolution_clock::now();
 			// runtime = std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime).count();
 			// of << runtime << "\n";
 			// startTime = std::chrono::high_resolution_clock::now();
-			succQueryRev = saQuerySeedSetRef(saRev, matchRev, qThreshold);
+			succQueryRev = saQuerySeedSetRef(saRev, readPacks[2 * threadnum + 1], readPacks[2 * threadnum], matchRev, qThreshold);
 			// succQueryRev = matchSingle(revSeq, qThreshold, saRev, matchRev, threadnum);
 		}
 
@@ -596,502 +969,790 @@ bool ReadQueue::matchReads(const unsigned int& procReads, uint64_t& succMatch, u
             // of << "Meta CpGs passing q-gram (q=" << qThreshold << ") filter: " << qcount << "\n";
         // }
 
-        // found match for fwd and rev automaton
-        if (succQueryFwd == 1 && succQueryRev == 1)
+        // no match with few errors, or one the full budget may attribute to another window (see
+        // inWindowOverlap), leave the read to the pass with the full budget
+        // same for reads with several matches: the automaton reports one match per run of matching positions,
+        // and the runs of the full budget may join matches that are apart with few errors
+        if (firstTier && ((succQueryFwd == 0 && succQueryRev == 0) || succQueryFwd < 0 || succQueryRev < 0 || tierOverlap[threadnum]))
         {
+            tierRetryBuf[threadnum].push_back(i);
+            continue;
+        }
+        resolveSingleMatch<A>(r, revSeq, succQueryFwd, matchFwd, succQueryRev, matchRev, threadnum, getStranded);
+    }
 
-            uint8_t fwdErr = MATCH::getErrNum(matchFwd);
-            uint8_t revErr = MATCH::getErrNum(matchRev);
-            // of << "Found match with read and reverse complement. Errors (fwd/rev): " << fwdErr << "/" << revErr;
-            // of << "\nMatching strands are (fwd/rev): " << MATCH::isFwd(matchFwd) << "/" << MATCH::isFwd(matchRev) << "\n";
+    if (dedup)
+        countUnique<A>();
+    mergeMethEvents();
 
-            // check which one has fewer errors
-            if (fwdErr < revErr)
-            {
+    // sum up counts
+    for (unsigned int i = 0; i < CORENUM; ++i)
+    {
+        succMatch += matchStats[i];
+        nonUniqueMatch += nonUniqueStats[i];
+        unSuccMatch += noMatchStats[i];
+    }
+    return true;
+}
 
-				if (getStranded)
-#pragma omp atomic
-					++r1FwdMatches;
-                ++succMatchT;
-                r.mat = matchFwd;
-                // startTime = std::chrono::high_resolution_clock::now();
-                computeMethLvl(matchFwd, r.seq);
-                // endTime = std::chrono::high_resolution_clock::now();
-                // runtime = std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime).count();
-                // of << runtime << "\n";
+template <size_t E>
+inline void ReadQueue::resolveSingleMatch(Read& r, std::string& revSeq, const int succQueryFwd, MATCH::match matchFwd, const int succQueryRev, MATCH::match matchRev, const int threadnum, const bool getStranded)
+{
+    uint64_t& succMatchT = matchStats[threadnum];
+    uint64_t& nonUniqueMatchT = nonUniqueStats[threadnum];
+    uint64_t& unSuccMatchT = noMatchStats[threadnum];
+    // the read counts for all reads collapsed into it
+    const uint64_t weight = threadWeight[threadnum];
+    // a pattern of the read exceeded the candidate budget (see overCandidateBudget), which is why it is not unique
+    const bool overBudgetRead = overBudget[threadnum];
+    overBudget[threadnum] = 0;
+    const UNMAPPED::REASON nonUnique = overBudgetRead ? UNMAPPED::OVERBUDGET : UNMAPPED::NONUNIQUE;
+
+    // found match for fwd and rev automaton
+    if (succQueryFwd == 1 && succQueryRev == 1)
+    {
 
-            } else {
+        uint8_t fwdErr = MATCH::getErrNum(matchFwd);
+        uint8_t revErr = MATCH::getErrNum(matchRev);
 
-                if (fwdErr > revErr)
-                {
+        // check which one has fewer errors
+        if (fwdErr < revErr)
+        {
 
-					if (getStranded)
+            if (getStranded)
 #pragma omp atomic
-						++r1RevMatches;
-                    ++succMatchT;
-                    r.mat = matchRev;
-                    // startTime = std::chrono::high_resolution_clock::now();
-                    computeMethLvl(matchRev, revSeq);
-                    // endTime = std::chrono::high_resolution_clock::now();
-                    // runtime = std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime).count();
-                    // of << runtime << "\n";
-
-                // if same number of errors, then not unique
-                } else {
+                r1FwdMatches += weight;
+            succMatchT += weight;
+            r.mat = matchFwd;
+            computeMethLvl<E>(matchFwd, r.seq, false);
+
+        } else {
 
-                    const uint32_t metaFwd = MATCH::getMetaID(matchFwd);
-                    const uint32_t metaRev = MATCH::getMetaID(matchRev);
-                    const uint64_t offFwd = MATCH::getOffset(matchFwd);
-                    const uint64_t offRev = MATCH::getOffset(matchRev);
-                    const bool m1_isFwd = MATCH::isFwd(matchFwd);
-                    const bool m2_isFwd = MATCH::isFwd(matchRev);
-                    const bool m1_isStart = MATCH::isStart(matchFwd);
-                    const bool m2_isStart = MATCH::isStart(matchRev);
-                    uint32_t m1_pos;
-                    uint32_t m2_pos;
-                    if (m1_isStart && m2_isStart)
-                    {
-
-                        m1_pos = offFwd;
-                        m2_pos = offRev;
-
-                    } else {
-
-                        m1_pos = ref.metaWindows[metaFwd].startPos + offFwd;
-                        m2_pos = ref.metaWindows[metaRev].startPos + offRev;
-                    }
-                    // test if same match in same region
-                    if ((m1_isStart == m2_isStart) && (m1_isFwd == m2_isFwd) && (m1_pos == m2_pos))
-                    {
-                        ++succMatchT;
-						if (getStranded)
+            if (fwdErr > revErr)
+            {
+
+                if (getStranded)
 #pragma omp atomic
-							++r1FwdMatches;
-                        r.mat = matchFwd;
-                        // startTime = std::chrono::high_resolution_clock::now();
-                        computeMethLvl(matchFwd, r.seq);
-                        // endTime = std::chrono::high_resolution_clock::now();
-                        // runtime = std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime).count();
-                        // of << runtime << "\n";
+                    r1RevMatches += weight;
+                succMatchT += weight;
+                r.mat = MATCH::setRevComp(matchRev);
+                computeMethLvl<E>(matchRev, revSeq, true);
 
-                    } else {
+            // if same number of errors, then not unique
+            } else {
 
-                        ++nonUniqueMatchT;
+                const uint32_t metaFwd = MATCH::getMetaID(matchFwd);
+                const uint32_t metaRev = MATCH::getMetaID(matchRev);
+                const uint64_t offFwd = MATCH::getOffset(matchFwd);
+                const uint64_t offRev = MATCH::getOffset(matchRev);
+                const bool m1_isFwd = MATCH::isFwd(matchFwd);
+                const bool m2_isFwd = MATCH::isFwd(matchRev);
+                const bool m1_isStart = MATCH::isStart(matchFwd);
+                const bool m2_isStart = MATCH::isStart(matchRev);
+                uint32_t m1_pos;
+                uint32_t m2_pos;
+                if (m1_isStart && m2_isStart)
+                {
 
-                        r.isInvalid = true;
-                    }
-                }
-            }
-        // unique match on forward strand
-        } else if (succQueryFwd == 1) {
+                    m1_pos = offFwd;
+                    m2_pos = offRev;
 
-            if (succQueryRev == -1)
-            {
-                if (MATCH::getErrNum(matchFwd) < MATCH::getErrNum(matchRev))
+                } else {
+
+                    m1_pos = ref.metaWindows[metaFwd].startPos + offFwd;
+                    m2_pos = ref.metaWindows[metaRev].startPos + offRev;
+                }
+                // test if same match in same region
+                if ((m1_isStart == m2_isStart) && (m1_isFwd == m2_isFwd) && (m1_pos == m2_pos))
                 {
-                    // of << "Match with FWD automaton. Strand is " << MATCH::isFwd(matchFwd) << "\n";
-                    ++succMatchT;
-					if (getStranded)
+                    succMatchT += weight;
+                    if (getStranded)
 #pragma omp atomic
-						++r1FwdMatches;
+                        r1FwdMatches += weight;
                     r.mat = matchFwd;
-                    // startTime = std::chrono::high_resolution_clock::now();
-                    computeMethLvl(matchFwd, r.seq);
-                    // endTime = std::chrono::high_resolution_clock::now();
-                    // runtime = std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime).count();
-                    // of << runtime << "\n";
+                    computeMethLvl<E>(matchFwd, r.seq, false);
+
                 } else {
 
-                    ++nonUniqueMatchT;
-                    r.isInvalid = true;
+                    nonUniqueMatchT += weight;
+
+                    r.invalidate(nonUnique);
                 }
-            } else {
+            }
+        }
+    // unique match on forward strand
+    } else if (succQueryFwd == 1) {
 
-                // of << "Match with FWD automaton. Strand is " << MATCH::isFwd(matchFwd) << "\n";
-                ++succMatchT;
-				if (getStranded)
+        if (succQueryRev == -1)
+        {
+            if (MATCH::getErrNum(matchFwd) < MATCH::getErrNum(matchRev))
+            {
+                succMatchT += weight;
+                if (getStranded)
 #pragma omp atomic
-					++r1FwdMatches;
+                    r1FwdMatches += weight;
                 r.mat = matchFwd;
-                // startTime = std::chrono::high_resolution_clock::now();
-                computeMethLvl(matchFwd, r.seq);
-                // endTime = std::chrono::high_resolution_clock::now();
-                // runtime = std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime).count();
-                // of << runtime << "\n";
+                computeMethLvl<E>(matchFwd, r.seq, false);
+            } else {
+
+                nonUniqueMatchT += weight;
+                r.invalidate(nonUnique);
             }
+        } else {
+
+            succMatchT += weight;
+            if (getStranded)
+#pragma omp atomic
+                r1FwdMatches += weight;
+            r.mat = matchFwd;
+            computeMethLvl<E>(matchFwd, r.seq, false);
+        }
 
-        // unique match on backward strand
-        } else if (succQueryRev == 1) {
+    // unique match on backward strand
+    } else if (succQueryRev == 1) {
 
-            if (succQueryFwd == -1)
+        if (succQueryFwd == -1)
+        {
+            if (MATCH::getErrNum(matchRev) < MATCH::getErrNum(matchFwd))
             {
-                if (MATCH::getErrNum(matchRev) < MATCH::getErrNum(matchFwd))
-                {
-                    // of << "Match with REV automaton. Strand is " << MATCH::isFwd(matchRev) << "\n";
-                    ++succMatchT;
-					if (getStranded)
+                succMatchT += weight;
+                if (getStranded)
 #pragma omp atomic
-						++r1RevMatches;
-                    r.mat = matchRev;
-                    // startTime = std::chrono::high_resolution_clock::now();
-                    computeMethLvl(matchRev, revSeq);
-                    // endTime = std::chrono::high_resolution_clock::now();
-                    // runtime = std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime).count();
-                    // of << runtime << "\n";
-                } else {
-
-                    ++nonUniqueMatchT;
-                    r.isInvalid = true;
-                }
+                    r1RevMatches += weight;
+                r.mat = MATCH::setRevComp(matchRev);
+                computeMethLvl<E>(matchRev, revSeq, true);
             } else {
 
-                // of << "Match with REV automaton. Strand is " << MATCH::isFwd(matchRev) << "\n";
-                ++succMatchT;
-				if (getStranded)
-#pragma omp atomic
-					++r1RevMatches;
-                r.mat = matchRev;
-                // startTime = std::chrono::high_resolution_clock::now();
-                computeMethLvl(matchRev, revSeq);
-                // endTime = std::chrono::high_resolution_clock::now();
-                // runtime = std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime).count();
-                // of << runtime << "\n";
+                nonUniqueMatchT += weight;
+                r.invalidate(nonUnique);
             }
-
-        // no match found at all
         } else {
 
-            r.isInvalid = true;
-            if (succQueryFwd == -1 || succQueryRev == -1)
-            {
+            succMatchT += weight;
+            if (getStranded)
+#pragma omp atomic
+                r1RevMatches += weight;
+            r.mat = MATCH::setRevComp(matchRev);
+            computeMethLvl<E>(matchRev, revSeq, true);
+        }
 
-                // of << "Nonunique match.\n";
-                ++nonUniqueMatchT;
+    // no match found at all
+    } else {
 
-            } else {
+        if (succQueryFwd == -1 || succQueryRev == -1)
+        {
 
-                // of << "No match.\n";
-                ++unSuccMatchT;
+            r.invalidate(nonUnique);
+            nonUniqueMatchT += weight;
 
-        //     }
-        // }
+        } else {
 
-// #ifdef _OPENMP
-// #pragma omp critical
-// #endif
-// {
-//                 // construct hash and look up the hash table entries
-//                 size_t lPos = r.id.find_last_of('_');
-//                 std::string stringOffset (r.id.begin() + lPos + 1, r.id.end());
-//                 size_t rPos = r.id.find_last_of('R');
-//                 std::string stringChrom (r.id.begin() + 1 + rPos, r.id.begin() + lPos);
-//                 uint8_t chrom = std::stoul(stringChrom);
-//                 unsigned long offset = std::stoul(stringOffset);
-//                 of << "\nreal seq/real revSeq/sequence in genome: " << r.id << "\n" << r.seq << "\n" << revSeq << "\n" << std::string(ref.fullSeq[chrom].begin() + offset, ref.fullSeq[chrom].begin() + offset + 100) << "\n\n\n";
-//
-//
-//                 uint64_t hVal;
-// 				uint64_t sVal = ntHash::NTPS64(r.seq.data(), MyConst::SEED, MyConst::KMERLEN, hVal) % MyConst::HTABSIZE;
-//                 auto startIt = ref.kmerTableSmall.begin() + ref.tabIndex[sVal];
-//                 auto endIt = ref.kmerTableSmall.begin() + ref.tabIndex[sVal + 1];
-//                 auto tit = ref.strandTable.begin() + ref.tabIndex[sVal];
-//                 for (auto it = startIt; it != endIt; ++it, ++tit)
-//                 {
-//                     KMER_S::kmer& k = *it;
-//                     const uint32_t m = KMER_S::getMetaCpG(k);
-//                     const bool isStart = KMER_S::isStartCpG(k);
-//                     if (!isStart)
-//                     {
-//                         const struct CpG& startCpg = ref.cpgTable[ref.metaCpGs[m].start];
-//                         if (*tit)
-//                         {
-//                             auto stIt = ref.fullSeq[startCpg.chrom].begin() + startCpg.pos;
-//                             auto enIt = ref.fullSeq[startCpg.chrom].begin() + 2*MyConst::READLEN - 2 + startCpg.pos;
-//                             of << std::string(stIt, enIt) << "\n";
-//                         }
-//                     }
-//                 }
-//                 of << "Last Sequence part:\n";
-//                 hVal = 0;
-// 				sVal = ntHash::NTPS64(r.seq.data()+70, MyConst::SEED, MyConst::KMERLEN, hVal) % MyConst::HTABSIZE;
-//                 startIt = ref.kmerTableSmall.begin() + ref.tabIndex[sVal];
-//                 endIt = ref.kmerTableSmall.begin() + ref.tabIndex[sVal + 1];
-//                 tit = ref.strandTable.begin() + ref.tabIndex[sVal];
-//                 for (auto it = startIt; it != endIt; ++it, ++tit)
-//                 {
-//                     KMER_S::kmer& k = *it;
-//                     const uint32_t m = KMER_S::getMetaCpG(k);
-//                     const bool isStart = KMER_S::isStartCpG(k);
-//                     if (!isStart)
-//                     {
-//                         const struct CpG& startCpg = ref.cpgTable[ref.metaCpGs[m].start];
-//                         if (*tit)
-//                         {
-//                             auto stIt = ref.fullSeq[startCpg.chrom].begin() + startCpg.pos;
-//                             auto enIt = ref.fullSeq[startCpg.chrom].begin() + 2*MyConst::READLEN - 2 + startCpg.pos;
-//                             of << std::string(stIt, enIt) << "\n";
-//                         }
-//                     }
-//                 }
-//
-//                 of << "\n\nReverse seq matches\n";
-//                 hVal = 0;
-// 				sVal = ntHash::NTPS64(revSeq.data(), MyConst::SEED, MyConst::KMERLEN, hVal) % MyConst::HTABSIZE;
-//                 startIt = ref.kmerTableSmall.begin() + ref.tabIndex[sVal];
-//                 endIt = ref.kmerTableSmall.begin() + ref.tabIndex[sVal + 1];
-//                 tit = ref.strandTable.begin() + ref.tabIndex[sVal];
-//                 for (auto it = startIt; it != endIt; ++it, ++tit)
-//                 {
-//                     KMER_S::kmer& k = *it;
-//                     const uint64_t m = KMER_S::getMetaCpG(k);
-//                     const bool isStart = KMER_S::isStartCpG(k);
-//                     if (!isStart)
-//                     {
-//                         const struct CpG& startCpg = ref.cpgTable[ref.metaCpGs[m].start];
-//                         if (*tit)
-//                         {
-//                             auto stIt = ref.fullSeq[startCpg.chrom].begin() + startCpg.pos;
-//                             auto enIt = ref.fullSeq[startCpg.chrom].begin() + 2*MyConst::READLEN - 2 + startCpg.pos;
-//                             of << std::string(stIt, enIt) << "\n";
-//                         }
-//                     }
-//                 }
-//                 of << "Last Sequence part:\n";
-//                 hVal = 0;
-// 				sVal = ntHash::NTPS64(revSeq.data()+70, MyConst::SEED, MyConst::KMERLEN, hVal) % MyConst::HTABSIZE;
-//                 startIt = ref.kmerTableSmall.begin() + ref.tabIndex[sVal];
-//                 endIt = ref.kmerTableSmall.begin() + ref.tabIndex[sVal + 1];
-//                 tit = ref.strandTable.begin() + ref.tabIndex[sVal];
-//                 for (auto it = startIt; it != endIt; ++it, ++tit)
-//                 {
-//                     KMER_S::kmer& k = *it;
-//                     const uint64_t m = KMER_S::getMetaCpG(k);
-//                     const bool isStart = KMER_S::isStartCpG(k);
-//                     if (!isStart)
-//                     {
-//                         const struct CpG& startCpg = ref.cpgTable[ref.metaCpGs[m].start];
-//                         if (*tit)
-//                         {
-//                             auto stIt = ref.fullSeq[startCpg.chrom].begin() + startCpg.pos;
-//                             auto enIt = ref.fullSeq[startCpg.chrom].begin() + 2*MyConst::READLEN - 2 + startCpg.pos;
-//                             of << std::string(stIt, enIt) << "\n";
-//                         }
-//                     }
-//                 }
-//                 of << "\n\n--------------------\n\n";
-//
-//
-// // END PRAGMA OMP CRITICAL
-// }
-            }
-            // if (unSuccMatch > 10)
-            // {
-            //     of.close();
-            //     exit(1);
-            // }
+            r.invalidate(UNMAPPED::NOMATCH);
+            unSuccMatchT += weight;
         }
     }
+    if (overBudgetRead && r.reason == UNMAPPED::OVERBUDGET)
+        overBudgetStats[threadnum] += weight;
+}
 
-    // sum up counts
-    for (unsigned int i = 0; i < CORENUM; ++i)
+inline bool ReadQueue::prepareRead(Read& r, std::string& revSeq)
+{
+    const size_t readSize = r.seq.size();
+
+    if (!acceptLength(readSize, false) || !acceptNs(r))
     {
-        succMatch += matchStats[i];
-        nonUniqueMatch += nonUniqueStats[i];
-        unSuccMatch += noMatchStats[i];
+
+        r.invalidate(!acceptLength(readSize, false) ? UNMAPPED::LENGTH : UNMAPPED::NLETTERS);
+        return false;
     }
+
+    // the reverse complement was computed when the read was parsed
+    revSeq.assign(r.rev.data(), readSize);
     return true;
 }
 
-bool ReadQueue::matchPairedReads(const unsigned int& procReads, uint64_t& succMatch, uint64_t& nonUniqueMatch, uint64_t& unSuccMatch, uint64_t& succPairedMatch, uint64_t& tooShortCountMatch, const bool getStranded)
+template <size_t E>
+bool ReadQueue::matchReadsBatched(const unsigned int& procReads, uint64_t& succMatch, uint64_t& nonUniqueMatch, uint64_t& unSuccMatch, const bool getStranded)
 {
 
-
     // reset all counters
     for (unsigned int i = 0; i < CORENUM; ++i)
     {
         matchStats[i] = 0;
         nonUniqueStats[i] = 0;
         noMatchStats[i] = 0;
-        matchPairedStats[i] = 0;
-		tooShortCounts[i] = 0;
+        batchTasks[i].clear();
+        batchMatchings[i].clear();
+        batchErrors[i].clear();
     }
+    batchReadTasks.resize(procReads);
+    batchOverBudget.resize(procReads);
+    if (batchRevSeqs.size() < procReads)
+        batchRevSeqs.resize(procReads);
 
-	// TODO
-	// std::ofstream of2 ("errOut2.txt");
-
+    // 1. seed all reads and collect the windows each of their patterns has to be verified against
 #ifdef _OPENMP
-#pragma omp parallel for num_threads(CORENUM) schedule(dynamic,50)
+#pragma omp parallel for num_threads(CORENUM) schedule(runtime)
 #endif
     for (unsigned int i = 0; i < procReads; ++i)
     {
 
         int threadnum = omp_get_thread_num();
+        BusyTimer busyTimer(threadBusy[threadnum]);
+        Profiler::Scope profScope(prof, threadnum, Profiler::OTHER);
 
-        uint64_t& succMatchT = matchStats[threadnum];
-        uint64_t& nonUniqueMatchT = nonUniqueStats[threadnum];
-        uint64_t& unSuccMatchT = noMatchStats[threadnum];
-        uint64_t& succPairedMatchT = matchPairedStats[threadnum];
-		uint64_t& tooShortCount = tooShortCounts[threadnum];
-        Read& r1 = readBuffer[i];
-        Read& r2 = readBuffer2[i];
-
-        const size_t readSize1 = r1.seq.size();
-        const size_t readSize2 = r2.seq.size();
+        std::vector<VerifyTask>& tasks = batchTasks[threadnum];
+        Read& r = readBuffer[i];
+        std::string& revSeq = batchRevSeqs[i];
+        batchReadTasks[i] = {{static_cast<uint32_t>(threadnum), static_cast<uint32_t>(tasks.size()), static_cast<uint32_t>(tasks.size())}};
+        // duplicates take the result of their read cache entry
+        if (MyConst::readCache && readWeight[i] == 0)
+        {
+            batchReadTasks[i][0] = std::numeric_limits<uint32_t>::max();
+            continue;
+        }
+        if (!prepareRead(r, revSeq))
+        {
+            // no evaluation for this read
+            batchReadTasks[i][0] = std::numeric_limits<uint32_t>::max();
+            continue;
+        }
 
-        if (readSize1 < ceil((float)MyConst::READLEN*0.75))
+        const size_t readSize = r.seq.size();
+        if (ref.hasKmerOffsets())
         {
+            readPacks[2 * threadnum].assign(r.seq.data(), readSize);
+            readPacks[2 * threadnum + 1].assign(revSeq.data(), readSize);
+        }
+        uint16_t qThreshold = ref.qgramThreshold();
 
-            r1.isInvalid = true;
+        batchOverBudget[i] = 0;
+        if (bothStrandsFlag || getStranded || matchR1Fwd)
+        {
+            getSeedRefs(r.seq, readSize, qThreshold);
+            if (!collectVerifyTasks<E>(i, false, readSize, qThreshold, tasks))
+                batchOverBudget[i] |= 1;
         }
-        if (readSize2 < ceil((float)MyConst::READLEN*0.75))
+        if (bothStrandsFlag || getStranded || !matchR1Fwd)
         {
+            getSeedRefs(revSeq, readSize, qThreshold);
+            if (!collectVerifyTasks<E>(i, true, readSize, qThreshold, tasks))
+                batchOverBudget[i] |= 2;
+        }
+        overBudget[threadnum] = 0;
+        batchReadTasks[i][2] = tasks.size();
+    }
 
-            r2.isInvalid = true;
+    // 2. sort the windows to verify over the whole batch, reads hitting the same window become neighbours
+    batchOrder.clear();
+    for (unsigned int t = 0; t < CORENUM; ++t)
+    {
+        for (uint32_t k = 0; k < batchTasks[t].size(); ++k)
+        {
+            const VerifyTask& task = batchTasks[t][k];
+            if (task.exactEnd < 0)
+                batchOrder.emplace_back(static_cast<uint64_t>(task.metaId) << 1 | task.isFwd, static_cast<uint64_t>(t) << 32 | k);
         }
-		if (r1.isInvalid || r2.isInvalid)
-		{
-			++tooShortCount;
-		}
+    }
+    std::sort(batchOrder.begin(), batchOrder.end());
 
-        // get correct offset for reverse strand (strand orientation must be correct)
-        size_t revPos = readSize1 - 1;
+    // 3. verify SALANES tasks at a time, every lane with the automaton of its own read and in its own direction
+    // (or all of them at once in the kernel of DeviceVerify)
+    if (MyConst::offload)
+    {
+        verifyBatchDevice<E>(procReads);
 
-        // string containing reverse complement (under FULL alphabet)
-        std::string revSeq1;
-        revSeq1.resize(readSize1);
+    } else {
 
-        // construct reduced alphabet sequence for forward and reverse strand
-        for (size_t pos = 0; pos < readSize1; ++pos, --revPos)
+        // static schedule: each thread walks a contiguous range of windows, such that the reference stays in its cache
+        const size_t groups = (batchOrder.size() + SALANES - 1) / SALANES;
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(CORENUM) schedule(static)
+#endif
+        for (size_t g = 0; g < groups; ++g)
         {
 
-            switch (r1.seq[pos])
-            {
-                case 'A':
-
-                    revSeq1[revPos] = 'T';
-                    break;
+            int threadnum = omp_get_thread_num();
+            BusyTimer busyTimer(threadBusy[threadnum]);
+            Profiler::Scope profScope(prof, threadnum, Profiler::SHIFTAND);
 
-                case 'C':
+            std::array<ShiftAnd<E>*, SALANES> sas;
+            std::array<VerifyTask*, SALANES> laneTasks;
 
-                    revSeq1[revPos] = 'G';
-                    break;
+            const size_t first = g * SALANES;
+            const size_t lanes = std::min(SALANES, batchOrder.size() - first);
+            for (size_t l = 0; l < lanes; ++l)
+            {
+                const uint64_t pos = batchOrder[first + l].second;
+                VerifyTask& task = batchTasks[pos >> 32][pos & 0xffffffffULL];
+                laneTasks[l] = &task;
+                sas[l] = &threadAutomaton<E>(threadnum, l);
+                sas[l]->reload(task.isRc ? SeqView(batchRevSeqs[task.read]) : readBuffer[task.read].seq);
+            }
+            verifyTaskLanes<E>(sas, laneTasks, lanes, threadnum);
+        }
+    }
 
-                case 'G':
+    // 4. evaluate the matchings of every read as saQuerySeedSetRef does
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(CORENUM) schedule(runtime)
+#endif
+    for (unsigned int i = 0; i < procReads; ++i)
+    {
 
-                    revSeq1[revPos] = 'C';
-                    break;
+        if (batchReadTasks[i][0] == std::numeric_limits<uint32_t>::max())
+            continue;
 
-                case 'T':
+        int threadnum = omp_get_thread_num();
+        BusyTimer busyTimer(threadBusy[threadnum]);
+        Profiler::Scope profScope(prof, threadnum, Profiler::OTHER);
 
-                    revSeq1[revPos] = 'A';
-                    break;
+        Read& r = readBuffer[i];
+        if (isSC)
+            threadCell[threadnum] = readCells[i];
+        threadWeight[threadnum] = MyConst::readCache ? readWeight[i] : 1;
+        threadRead[threadnum] = i;
+        const std::vector<VerifyTask>& tasks = batchTasks[batchReadTasks[i][0]];
+
+        std::array<int, 2> succQuery = {{0, 0}};
+        std::array<MATCH::match, 2> matches = {{0, 0}};
+        evaluateVerifyTasks<E>(tasks, batchReadTasks[i][1], batchReadTasks[i][2], succQuery, matches);
+        // a pattern over the candidate budget has no tasks, it counts as not unique
+        for (unsigned int p = 0; p < 2; ++p)
+        {
+            if (batchOverBudget[i] & (1 << p))
+            {
+                succQuery[p] = -1;
+                matches[p] = 0;
+                overBudget[threadnum] = 1;
+            }
+        }
 
-                case 'N':
+        resolveSingleMatch<E>(r, batchRevSeqs[i], succQuery[0], matches[0], succQuery[1], matches[1], threadnum, getStranded);
+    }
 
-                    r1.isInvalid = true;
-                    break;
+    if (dedup)
+        countUnique<E>();
+    mergeMethEvents();
 
-                default:
+    // sum up counts
+    for (unsigned int i = 0; i < CORENUM; ++i)
+    {
+        succMatch += matchStats[i];
+        nonUniqueMatch += nonUniqueStats[i];
+        unSuccMatch += noMatchStats[i];
+    }
+    return true;
+}
 
-                    std::cerr << "Unknown character '" << r1.seq[pos] << "' in read with sequence id " << r1.id << std::endl;
-                    r1.isInvalid = true;
+inline bool ReadQueue::overCandidateBudget(const uint16_t qThreshold)
+{
+    const int threadnum = omp_get_thread_num();
+    size_t n = 0;
+    for (const MetaCounter* metaIDs_t : {&fwdMetaIDs[threadnum], &revMetaIDs[threadnum]})
+    {
+        for (const uint32_t metaId : metaIDs_t->ids())
+        {
+            if (metaIDs_t->count(metaId) >= qThreshold && ++n > MyConst::candidateBudget)
+            {
+                overBudget[threadnum] = 1;
+                return true;
             }
         }
+    }
+    return false;
+}
+
+template <size_t E>
+inline bool ReadQueue::collectVerifyTasks(const uint32_t i, const bool isRc, const size_t readSize, const uint16_t qThreshold, std::vector<VerifyTask>& tasks)
+{
+    const int threadnum = omp_get_thread_num();
+    if (MyConst::candidateBudget && overCandidateBudget(qThreshold))
+        return false;
+    std::vector<uint32_t>& candidates = candidateBuf[threadnum];
+    const PackedSeq& pat = readPacks[2 * threadnum + isRc];
+    const PackedSeq& patRc = readPacks[2 * threadnum + !isRc];
+    for (const bool isFwd : {true, false})
+    {
+        MetaCounter& metaIDs_t = isFwd ? fwdMetaIDs[threadnum] : revMetaIDs[threadnum];
+        candidates.clear();
+        for (const uint32_t metaId : metaIDs_t.ids())
+        {
+            if (metaIDs_t.count(metaId) >= qThreshold)
+                candidates.push_back(metaId);
+        }
+        prof.hist(threadnum, Profiler::CANDIDATES, candidates.size());
+        std::sort(candidates.begin(), candidates.end());
+        for (const uint32_t metaId : candidates)
+        {
+            const std::pair<int32_t, int32_t> range = scanRange(metaIDs_t, metaId, readSize, isFwd);
+            const int32_t exactEnd = exactMatchEnd<E>(metaIDs_t, metaId, isFwd ? pat : patRc, readSize, isFwd);
+            tasks.push_back({i, metaId, range.first, range.second, exactEnd, isRc, isFwd, 0, 0, 0});
+        }
+    }
+    return true;
+}
 
-        // get correct offset for reverse strand (strand orientation must be correct)
-        revPos = readSize2 - 1;
+template <size_t E>
+inline void ReadQueue::verifyTaskLanes(const std::array<ShiftAnd<E>*, SALANES>& sas, const std::array<VerifyTask*, SALANES>& laneTasks, const size_t lanes, const int threadnum)
+{
+    std::array<std::vector<uint64_t>, SALANES>& laneMatchings = laneMatchBuf[threadnum];
+    std::array<std::vector<uint8_t>, SALANES>& laneErrors = laneErrBuf[threadnum];
+    std::array<PackedSeq::const_iterator, SALANES> startIts;
+    std::array<PackedSeq::const_iterator, SALANES> endIts;
+    std::array<bool, SALANES> isFwd;
+    for (size_t l = 0; l < lanes; ++l)
+    {
+        const VerifyTask& task = *laneTasks[l];
+        isFwd[l] = task.isFwd;
+        laneMatchings[l].clear();
+        laneErrors[l].clear();
+        windowSlice(task.metaId, std::make_pair(task.first, task.second), task.isFwd, startIts[l], endIts[l]);
+    }
+    ShiftAnd<E>::queryMixedMultiPattern(sas, startIts, endIts, isFwd, lanes, laneMatchings, laneErrors);
 
-        // string containing reverse complement (under FULL alphabet)
-        std::string revSeq2;
-        revSeq2.resize(readSize2);
+    for (size_t l = 0; l < lanes; ++l)
+    {
+        VerifyTask& task = *laneTasks[l];
+        task.resThread = threadnum;
+        task.resOff = batchMatchings[threadnum].size();
+        task.resLen = laneMatchings[l].size();
+        // matchings relative to the window
+        for (const uint64_t match : laneMatchings[l])
+            batchMatchings[threadnum].push_back(match + task.first);
+        batchErrors[threadnum].insert(batchErrors[threadnum].end(), laneErrors[l].begin(), laneErrors[l].end());
+    }
+}
 
-        // construct reduced alphabet sequence for forward and reverse strand
-        for (size_t pos = 0; pos < readSize2; ++pos, --revPos)
+template <size_t E>
+inline void ReadQueue::evaluateVerifyTasks(const std::vector<VerifyTask>& tasks, size_t k, const size_t end, std::array<int, 2>& succQuery, std::array<MATCH::match, 2>& matches)
+{
+    while (k < end)
+    {
+        const bool isRc = tasks[k].isRc;
+        std::array<uint8_t, E + 1> multiMatch;
+        multiMatch.fill(0);
+        std::array<MATCH::match, E + 1> uniqueMatches;
+        chromId prevChr = 0;
+        uint64_t prevOff = 0xffffffffffffffffULL;
+        bool isUnique = true;
+        for (bool isFwd = true; k < end && tasks[k].isRc == isRc; ++k)
         {
-
-            switch (r2.seq[pos])
+            const VerifyTask& task = tasks[k];
+            if (!isUnique)
+                continue;
+            // windows of the other strand start over
+            if (task.isFwd != isFwd)
+            {
+                isFwd = task.isFwd;
+                prevChr = 0;
+                prevOff = 0xffffffffffffffffULL;
+            }
+            if (task.exactEnd >= 0)
             {
-                case 'A':
+                const uint64_t match = task.exactEnd;
+                const uint8_t err = 0;
+                isUnique = addWindowMatches<E>(task.metaId, isFwd, &match, &err, 1, multiMatch, uniqueMatches, prevChr, prevOff);
+            } else {
+                isUnique = addWindowMatches<E>(task.metaId, isFwd, batchMatchings[task.resThread].data() + task.resOff, batchErrors[task.resThread].data() + task.resOff, task.resLen, multiMatch, uniqueMatches, prevChr, prevOff);
+            }
+        }
+        succQuery[isRc] = isUnique ? uniqueMatchResult<E>(multiMatch, uniqueMatches, matches[isRc]) : -1;
+    }
+}
+
+template <size_t E>
+inline void ReadQueue::matchBothPatterns(const uint32_t i, std::string& revSeq, const uint16_t qThreshold, std::array<int, 2>& succQuery, std::array<MATCH::match, 2>& matches)
+{
+    const int threadnum = omp_get_thread_num();
+    const Read& r = readBuffer[i];
+    const size_t readSize = r.seq.size();
+    std::vector<VerifyTask>& tasks = batchTasks[threadnum];
+    tasks.clear();
+    getSeedRefs(r.seq, readSize, qThreshold);
+    const bool fwdInBudget = collectVerifyTasks<E>(i, false, readSize, qThreshold, tasks);
+    getSeedRefs(revSeq, readSize, qThreshold);
+    const bool revInBudget = collectVerifyTasks<E>(i, true, readSize, qThreshold, tasks);
 
-                    revSeq2[revPos] = 'T';
-                    break;
+    {
+        Profiler::Scope profScope(prof, threadnum, Profiler::SHIFTAND);
+        std::array<ShiftAnd<E>*, SALANES> pats = {{&threadAutomaton<E>(threadnum, 0), &threadAutomaton<E>(threadnum, 1)}};
+        pats[0]->reload(r.seq);
+        pats[1]->reload(revSeq);
+        batchMatchings[threadnum].clear();
+        batchErrors[threadnum].clear();
+        // windows of both patterns on both strands fill the lanes of one query
+        std::array<ShiftAnd<E>*, SALANES> sas;
+        std::array<VerifyTask*, SALANES> laneTasks;
+        size_t lanes = 0;
+        for (VerifyTask& task : tasks)
+        {
+            if (task.exactEnd >= 0)
+                continue;
+            sas[lanes] = pats[task.isRc];
+            laneTasks[lanes++] = &task;
+            if (lanes == SALANES)
+            {
+                verifyTaskLanes<E>(sas, laneTasks, lanes, threadnum);
+                lanes = 0;
+            }
+        }
+        if (lanes)
+            verifyTaskLanes<E>(sas, laneTasks, lanes, threadnum);
+    }
+    evaluateVerifyTasks<E>(tasks, 0, tasks.size(), succQuery, matches);
+    // a pattern over the candidate budget has no tasks, it counts as not unique
+    if (!fwdInBudget)
+    {
+        succQuery[0] = -1;
+        matches[0] = 0;
+    }
+    if (!revInBudget)
+    {
+        succQuery[1] = -1;
+        matches[1] = 0;
+    }
+}
 
-                case 'C':
+template <size_t E>
+void ReadQueue::verifyBatchDevice(const unsigned int procReads)
+{
 
-                    revSeq2[revPos] = 'G';
-                    break;
+    if (!devVerify)
+    {
+        devVerify.reset(new DeviceVerify(ref.fullSeq));
+        std::cout << "Verifying candidate windows " << (devVerify->onDevice() ? "on the offload device" : "in the host kernel (no offload device)") << "\n";
+    }
 
-                case 'G':
+    // automata of both patterns of every read
+    devPatterns.resize(2 * procReads);
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(CORENUM) schedule(static)
+#endif
+    for (unsigned int i = 0; i < procReads; ++i)
+    {
 
-                    revSeq2[revPos] = 'C';
-                    break;
+        if (batchReadTasks[i][0] == std::numeric_limits<uint32_t>::max())
+            continue;
 
-                case 'T':
+        int threadnum = omp_get_thread_num();
+        BusyTimer busyTimer(threadBusy[threadnum]);
+        Profiler::Scope profScope(prof, threadnum, Profiler::SHIFTAND);
+
+        ShiftAnd<E>& sa = threadAutomaton<E>(threadnum, 0);
+        sa.reload(readBuffer[i].seq);
+        DeviceVerify::loadPattern(sa, devPatterns[2 * i]);
+        sa.reload(SeqView(batchRevSeqs[i]));
+        DeviceVerify::loadPattern(sa, devPatterns[2 * i + 1]);
+    }
 
-                    revSeq2[revPos] = 'A';
-                    break;
+    // the reference slices, in window order as for the host verification
+    const size_t n = batchOrder.size();
+    devTasks.resize(n);
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(CORENUM) schedule(static)
+#endif
+    for (size_t j = 0; j < n; ++j)
+    {
 
-                case 'N':
+        const uint64_t pos = batchOrder[j].second;
+        const VerifyTask& task = batchTasks[pos >> 32][pos & 0xffffffffULL];
+        const metaWindow& w = ref.metaWindows[task.metaId];
+        PackedSeq::const_iterator start;
+        PackedSeq::const_iterator end;
+        windowSlice(task.metaId, std::make_pair(task.first, task.second), task.isFwd, start, end, false);
+
+        DeviceVerify::Task& devTask = devTasks[j];
+        devTask.start = start - ref.fullSeq[w.chrom].begin();
+        if (task.isFwd)
+            devTask.len = start < end ? end - start : 0;
+        else
+            devTask.len = end < start ? start - end : 0;
+        devTask.pattern = 2 * task.read + task.isRc;
+        devTask.chrom = w.chrom;
+        devTask.isFwd = task.isFwd;
+    }
 
-                    r2.isInvalid = true;
-                    break;
+    std::vector<uint64_t>& devMatchings = batchMatchings[CORENUM];
+    std::vector<uint8_t>& devErrors = batchErrors[CORENUM];
+    devMatchings.resize(n * DeviceVerify::MAXMATCHES);
+    devErrors.resize(n * DeviceVerify::MAXMATCHES);
+    devCounts.resize(n);
+    devVerify->verify<E>(devPatterns.data(), devPatterns.size(), devTasks.data(), n, devCounts.data(), devMatchings.data(), devErrors.data());
 
-                default:
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(CORENUM) schedule(static)
+#endif
+    for (size_t j = 0; j < n; ++j)
+    {
 
-                    std::cerr << "Unknown character '" << r2.seq[pos] << "' in read with sequence id " << r2.id << std::endl;
-                    r2.isInvalid = true;
-            }
-        }
+        int threadnum = omp_get_thread_num();
+        BusyTimer busyTimer(threadBusy[threadnum]);
+        Profiler::Scope profScope(prof, threadnum, Profiler::SHIFTAND);
 
-        if (r1.isInvalid || r2.isInvalid)
+        const uint64_t pos = batchOrder[j].second;
+        VerifyTask& task = batchTasks[pos >> 32][pos & 0xffffffffULL];
+        if (devCounts[j] <= DeviceVerify::MAXMATCHES)
         {
-            tooShortCount += 2;
+            task.resThread = CORENUM;
+            task.resOff = j * DeviceVerify::MAXMATCHES;
+            task.resLen = devCounts[j];
+            // matchings relative to the window
+            for (uint32_t k = 0; k < task.resLen; ++k)
+                devMatchings[task.resOff + k] += task.first;
             continue;
         }
 
-        // set qgram threshold
-        // uint16_t qThreshold = std::min(readSize1, readSize2) - MyConst::KMERLEN - (MyConst::KMERLEN * MyConst::MISCOUNT) + 1;
-        // if (qThreshold > readSize1)
-        //     qThreshold = 0;
-        //
-		// TODO
-		const uint16_t qThreshold = MyConst::QTHRESH;
-		// of << "\nq-gram: " << qThreshold << "\n";
+        // more matchings than the kernel returns, query the window again
+        ShiftAnd<E>& sa = threadAutomaton<E>(threadnum, 0);
+        sa.reload(task.isRc ? SeqView(batchRevSeqs[task.read]) : readBuffer[task.read].seq);
+        std::vector<uint64_t>& matchings = saMatchings[threadnum];
+        std::vector<uint8_t>& errors = saErrors[threadnum];
+        matchings.clear();
+        errors.clear();
+        PackedSeq::const_iterator start;
+        PackedSeq::const_iterator end;
+        windowSlice(task.metaId, std::make_pair(task.first, task.second), task.isFwd, start, end);
+        if (task.isFwd)
+            sa.querySeq(start, end, matchings, errors);
+        else
+            sa.queryRevSeq(start, end, matchings, errors);
+
+        task.resThread = threadnum;
+        task.resOff = batchMatchings[threadnum].size();
+        task.resLen = matchings.size();
+        for (const uint64_t match : matchings)
+            batchMatchings[threadnum].push_back(match + task.first);
+        batchErrors[threadnum].insert(batchErrors[threadnum].end(), errors.begin(), errors.end());
+    }
+}
 
-// #pragma omp critical
-// {
-//
-//         // construct hash and look up the hash table entries
-//         size_t lPos = r1.id.find_last_of('_');
-//         std::string stringOffset (r1.id.begin() + lPos + 1, r1.id.end());
-//         size_t rPos = r1.id.find_last_of('r');
-//         std::string stringChrom (r1.id.begin() + 1 + rPos, r1.id.begin() + lPos);
-//         uint8_t chrom = std::stoul(stringChrom);
-//         unsigned long offset = std::stoul(stringOffset);
-//         of << "\nRead1 real seq/real revSeq/sequence in genome: " << r1.id << "\n" << r1.seq << "\n" << revSeq1 << "\n" << std::string(ref.fullSeq[chrom].begin() + offset, ref.fullSeq[chrom].begin() + offset + 100) << "\n\n\n";
-//         lPos = r2.id.find_last_of('_');
-//         stringOffset = std::string(r2.id.begin() + lPos + 1, r2.id.end());
-//         rPos = r2.id.find_last_of('r');
-//         stringChrom = std::string(r2.id.begin() + 1 + rPos, r2.id.begin() + lPos);
-//         chrom = std::stoul(stringChrom);
-//         offset = std::stoul(stringOffset);
-//         of << "\nRead2 real seq/real revSeq/sequence in genome: " << r2.id << "\n" << r2.seq << "\n" << revSeq2 << "\n" << std::string(ref.fullSeq[chrom].begin() + offset, ref.fullSeq[chrom].begin() + offset + 100) << "\n\n\n";
-//
-// }
+template <size_t E, size_t A>
+bool ReadQueue::matchPairedReadsImpl(const unsigned int& procReads, uint64_t& succMatch, uint64_t& nonUniqueMatch, uint64_t& unSuccMatch, uint64_t& succPairedMatch, uint64_t& tooShortCountMatch, const bool getStranded, const std::vector<uint32_t>* readIds, const bool firstTier)
+{
 
-    // POSSIBLE ORIENTATION 1
-		std::vector<MATCH::match> matches1Fwd;
-		std::vector<MATCH::match> matches2Rev;
 
-		// std::chrono::high_resolution_clock::time_point startTime;
+    // reset all counters
+    for (unsigned int i = 0; i < CORENUM; ++i)
+    {
+        matchStats[i] = 0;
+        nonUniqueStats[i] = 0;
+        noMatchStats[i] = 0;
+        matchPairedStats[i] = 0;
+		tooShortCounts[i] = 0;
+    }
+
+	// TODO
+	// std::ofstream of2 ("errOut2.txt");
+
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(CORENUM) schedule(runtime)
+#endif
+    for (unsigned int j = 0; j < procReads; ++j)
+    {
+
+        const unsigned int i = readIds ? (*readIds)[j] : j;
+        int threadnum = omp_get_thread_num();
+        BusyTimer busyTimer(threadBusy[threadnum]);
+        Profiler::Scope profScope(prof, threadnum, Profiler::OTHER);
+
+        uint64_t& succMatchT = matchStats[threadnum];
+        uint64_t& nonUniqueMatchT = nonUniqueStats[threadnum];
+        uint64_t& unSuccMatchT = noMatchStats[threadnum];
+        uint64_t& succPairedMatchT = matchPairedStats[threadnum];
+		uint64_t& tooShortCount = tooShortCounts[threadnum];
+        Read& r1 = readBuffer[i];
+        Read& r2 = readBuffer2[i];
+        if (isSC)
+            threadCell[threadnum] = readCells[i];
+        threadRead[threadnum] = i;
+
+        const size_t readSize1 = r1.seq.size();
+        const size_t readSize2 = r2.seq.size();
+
+        if (!acceptLength(readSize1, true))
+        {
+
+            r1.invalidate(UNMAPPED::LENGTH);
+        }
+        if (!acceptLength(readSize2, true))
+        {
+
+            r2.invalidate(UNMAPPED::LENGTH);
+        }
+		if (r1.isInvalid || r2.isInvalid)
+		{
+			++tooShortCount;
+		}
+
+        // strings containing reverse complement (under FULL alphabet), computed when the reads were parsed
+        std::string& revSeq1 = revSeqBuf[2 * threadnum];
+        revSeq1.assign(r1.rev.data(), readSize1);
+        std::string& revSeq2 = revSeqBuf[2 * threadnum + 1];
+        revSeq2.assign(r2.rev.data(), readSize2);
+        if (!acceptNs(r1) && !r1.isInvalid)
+            r1.invalidate(UNMAPPED::NLETTERS);
+        if (!acceptNs(r2) && !r2.isInvalid)
+            r2.invalidate(UNMAPPED::NLETTERS);
+
+        if (r1.isInvalid || r2.isInvalid)
+        {
+            tooShortCount += 2;
+            continue;
+        }
+
+        // set qgram threshold
+        // uint16_t qThreshold = std::min(readSize1, readSize2) - MyConst::KMERLEN - (MyConst::KMERLEN * MyConst::MISCOUNT) + 1;
+        // if (qThreshold > readSize1)
+        //     qThreshold = 0;
+        //
+		// TODO
+		const uint16_t qThreshold = ref.qgramThreshold();
+		// of << "\nq-gram: " << qThreshold << "\n";
+
+// #pragma omp critical
+// {
+//
+//         // construct hash and look up the hash table entries
+//         size_t lPos = r1.id.find_last_of('_');
+//         std::string stringOffset (r1.id.begin() + lPos + 1, r1.id.end());
+//         size_t rPos = r1.id.find_last_of('r');
+//         std::string stringChrom (r1.id.begin() + 1 + rPos, r1.id.begin() + lPos);
+//         uint8_t chrom = std::stoul(stringChrom);
+//         unsigned long offset = std::stoul(stringOffset);
+//         of << "\nRead1 real seq/real revSeq/sequence in genome: " << r1.id << "\n" << r1.seq << "\n" << revSeq1 << "\n" << std::string(ref.fullSeq[chrom].begin() + offset, ref.fullSeq[chrom].begin() + offset + 100) << "\n\n\n";
+//         lPos = r2.id.find_last_of('_');
+//         stringOffset = std::string(r2.id.begin() + lPos + 1, r2.id.end());
+//         rPos = r2.id.find_last_of('r');
+//         stringChrom = std::string(r2.id.begin() + 1 + rPos, r2.id.begin() + lPos);
+//         chrom = std::stoul(stringChrom);
+//         offset = std::stoul(stringOffset);
+//         of << "\nRead2 real seq/real revSeq/sequence in genome: " << r2.id << "\n" << r2.seq << "\n" << revSeq2 << "\n" << std::string(ref.fullSeq[chrom].begin() + offset, ref.fullSeq[chrom].begin() + offset + 100) << "\n\n\n";
+//
+// }
+
+    // POSSIBLE ORIENTATION 1
+		std::vector<MATCH::match>& matches1Fwd = pairedMatchBuf[threadnum][0];
+		std::vector<MATCH::match>& matches2Rev = pairedMatchBuf[threadnum][1];
+		matches1Fwd.clear();
+		matches2Rev.clear();
+
+		// std::chrono::high_resolution_clock::time_point startTime;
 		// std::chrono::high_resolution_clock::time_point endTime;
 
-		if (bothStrandsFlag || getStranded || matchR1Fwd)
+		// orientations whose pair was decided by mate rescue
+		bool rescuedFwd = false;
+		bool rescuedRev = false;
+		if (MyConst::mateRescue && (bothStrandsFlag || getStranded || matchR1Fwd))
+		{
+			rescuedFwd = matchPairRescue(r1.seq, revSeq2, threadAutomaton<E>(threadnum, 0), threadAutomaton<E>(threadnum, 1), matches1Fwd, matches2Rev, qThreshold);
+
+		} else if (bothStrandsFlag || getStranded || matchR1Fwd)
 		{
 
 			// startTime = std::chrono::high_resolution_clock::now();
 
-			const uint16_t qAdapt1 = getSeedRefsFirstRead(r1.seq, readSize1, qThreshold);
+			const uint16_t qAdapt1 = MyConst::fusedPairs ? 0 : getSeedRefsFirstRead(r1.seq, readSize1, qThreshold);
 // #pragma omp critical
 // 				{
 // 					of << "Found metas after first seeding: " << paired_fwdMetaIDs[threadnum].size() << "\t" << paired_revMetaIDs[threadnum].size() << "\n";
@@ -1117,11 +1778,11 @@ bool ReadQueue::matchPairedReads(const unsigned int& procReads, uint64_t& succMa
 			// auto runtime = std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime).count();
 			// of << "\nHashtable sizes after first read: " << paired_fwdMetaIDs[threadnum].size() << "/"<< paired_fwdMetaIDs[threadnum].size()<< "\t\tRuntime: "  << runtime << "\t\tCandidates1: " << candCount << "\n";
 
-			if ((paired_fwdMetaIDs[threadnum].size() || paired_revMetaIDs[threadnum].size()) )
+			if (MyConst::fusedPairs || paired_fwdMetaIDs[threadnum].size() || paired_revMetaIDs[threadnum].size())
 			{
 				// startTime = std::chrono::high_resolution_clock::now();
 
-				const bool hasCpG = getSeedRefsSecondRead(revSeq2, readSize2, qThreshold);
+				const bool hasCpG = MyConst::fusedPairs ? getSeedRefsPaired(r1.seq, revSeq2, qThreshold) : getSeedRefsSecondRead(revSeq2, readSize2, qThreshold);
 // #pragma omp critical
 // 				{
 // 					of << "Found metas after second seeding: " << paired_fwdMetaIDs[threadnum].size() << "\t" << paired_revMetaIDs[threadnum].size() << "\n";
@@ -1177,8 +1838,10 @@ bool ReadQueue::matchPairedReads(const unsigned int& procReads, uint64_t& succMa
 				// {
 				if (hasCpG)
 				{
-					ShiftAnd<MyConst::MISCOUNT + MyConst::ADDMIS> saFwd(r1.seq, lmap);
-					ShiftAnd<MyConst::MISCOUNT + MyConst::ADDMIS> saRev2(revSeq2, lmap);
+					ShiftAnd<E>& saFwd = threadAutomaton<E>(threadnum, 0);
+					saFwd.reload(r1.seq);
+					ShiftAnd<E>& saRev2 = threadAutomaton<E>(threadnum, 1);
+					saRev2.reload(revSeq2);
 
 					// endTime = std::chrono::high_resolution_clock::now();
 					// runtime = std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime).count();
@@ -1199,15 +1862,24 @@ bool ReadQueue::matchPairedReads(const unsigned int& procReads, uint64_t& succMa
 			}
 		}
 
+		// the first tier decides a pair only if the full budget verifies the same windows (see tierWindowsMatched)
+		bool tierUnsure = firstTier && (bothStrandsFlag || getStranded || matchR1Fwd) && !tierWindowsMatched(matches1Fwd, matches2Rev, qThreshold);
+
     // POSSIBLE ORIENTATION 2
-		std::vector<MATCH::match> matches1Rev;
-		std::vector<MATCH::match> matches2Fwd;
+		std::vector<MATCH::match>& matches1Rev = pairedMatchBuf[threadnum][2];
+		std::vector<MATCH::match>& matches2Fwd = pairedMatchBuf[threadnum][3];
+		matches1Rev.clear();
+		matches2Fwd.clear();
 
-		if (bothStrandsFlag || getStranded || !matchR1Fwd)
+		if (MyConst::mateRescue && (bothStrandsFlag || getStranded || !matchR1Fwd))
+		{
+			rescuedRev = matchPairRescue(revSeq1, r2.seq, threadAutomaton<E>(threadnum, 2), threadAutomaton<E>(threadnum, 3), matches1Rev, matches2Fwd, qThreshold);
+
+		} else if (bothStrandsFlag || getStranded || !matchR1Fwd)
 		{
 			// startTime = std::chrono::high_resolution_clock::now();
 
-			const uint16_t qAdapt1 = getSeedRefsFirstRead(revSeq1, readSize1, qThreshold);
+			const uint16_t qAdapt1 = MyConst::fusedPairs ? 0 : getSeedRefsFirstRead(revSeq1, readSize1, qThreshold);
 			// if (qAdapt1)
 			// {
 
@@ -1215,18 +1887,20 @@ bool ReadQueue::matchPairedReads(const unsigned int& procReads, uint64_t& succMa
 			// auto runtime = std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime).count();
 			// of << "\nHashtable sizes after first read: " << paired_fwdMetaIDs[threadnum].size() << "/"<< paired_fwdMetaIDs[threadnum].size()<< "\tRuntime: "  << runtime << "\n";
 
-			if ((paired_fwdMetaIDs[threadnum].size() || paired_revMetaIDs[threadnum].size()))
+			if (MyConst::fusedPairs || paired_fwdMetaIDs[threadnum].size() || paired_revMetaIDs[threadnum].size())
 			{
 				// startTime = std::chrono::high_resolution_clock::now();
 
 
-				const bool hasCpG = getSeedRefsSecondRead(r2.seq, readSize2, qThreshold);
+				const bool hasCpG = MyConst::fusedPairs ? getSeedRefsPaired(revSeq1, r2.seq, qThreshold) : getSeedRefsSecondRead(r2.seq, readSize2, qThreshold);
 				// if (qAdapt2)
 				// {
 				if (hasCpG)
 				{
-					ShiftAnd<MyConst::MISCOUNT + MyConst::ADDMIS> saRev(revSeq1, lmap);
-					ShiftAnd<MyConst::MISCOUNT + MyConst::ADDMIS> saFwd2(r2.seq, lmap);
+					ShiftAnd<E>& saRev = threadAutomaton<E>(threadnum, 2);
+					saRev.reload(revSeq1);
+					ShiftAnd<E>& saFwd2 = threadAutomaton<E>(threadnum, 3);
+					saFwd2.reload(r2.seq);
 
 					// endTime = std::chrono::high_resolution_clock::now();
 					// runtime = std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime).count();
@@ -1247,17 +1921,24 @@ bool ReadQueue::matchPairedReads(const unsigned int& procReads, uint64_t& succMa
 			// }
 		}
 
+		tierUnsure |= firstTier && (bothStrandsFlag || getStranded || !matchR1Fwd) && !tierWindowsMatched(matches1Rev, matches2Fwd, qThreshold);
+
     // TEST IF MATCHING WAS SUCCESSFULL
 
         if ((matches1Fwd.size() == 0 && matches1Rev.size() == 0) || (matches2Fwd.size() == 0 && matches2Rev.size() == 0))
         {
+            if (firstTier)
+            {
+                tierRetryBuf[threadnum].push_back(i);
+                continue;
+            }
 // #pragma omp critical
 // 			{
 // 			of << "No Meta candidates found:\n\t" << r1.id << "\n\t" << r1.seq << "\n\t" << r2.id << "\n\t" << r2.seq << "\n\n";
 // 			of << "-----------------------------\n\n\n\n";
 // 			}
-            r1.isInvalid = true;
-            r2.isInvalid = true;
+            r1.invalidate(UNMAPPED::NOMATCH);
+            r2.invalidate(UNMAPPED::NOMATCH);
             unSuccMatchT += 2;
             continue;
         }
@@ -1267,7 +1948,7 @@ bool ReadQueue::matchPairedReads(const unsigned int& procReads, uint64_t& succMa
         // of << "Matching sizes: " << matches1Fwd.size() << "/" << matches2Rev.size() << "\tTimings: ";
         // startTime = std::chrono::high_resolution_clock::now();
         // current best matching pair (sum of errors)
-        int bestErrNum = 2*(MyConst::MISCOUNT + MyConst::ADDMIS) + 1;
+        int bestErrNum = 2*E + 1;
         MATCH::match bestMatch1;
         MATCH::match bestMatch2;
         bool nonUniqueFlag = false;
@@ -1278,35 +1959,7 @@ bool ReadQueue::matchPairedReads(const unsigned int& procReads, uint64_t& succMa
 
 		if (bothStrandsFlag || getStranded || matchR1Fwd)
 		{
-			// uint32_t i = 0;
-			for (auto m1It = matches1Fwd.begin(); m1It != matches1Fwd.end(); ++m1It)
-			{
-				// std::cout << i << "\n";
-				MATCH::match& mat1 = *m1It;
-				// ++i;
-				for (auto m2It = matches2Rev.begin(); m2It != matches2Rev.end(); ++m2It)
-				{
-					// std::cout << i << "\n";
-					MATCH::match& mat2Rev = *m2It;
-					// ++i;
-					int extractedMatchErrs = extractPairedMatch(mat1, mat2Rev);
-					if (extractedMatchErrs >= 0)
-					{
-						if (extractedMatchErrs == bestErrNum)
-						{
-							nonUniqueFlag = true;
-
-						} else if (extractedMatchErrs < bestErrNum) {
-
-							bestErrNum = extractedMatchErrs;
-							bestMatch1 = mat1;
-							bestMatch2 = mat2Rev;
-							nonUniqueFlag = false;
-
-						}
-					}
-				}
-			}
+			pairMatches<E>(matches1Fwd, matches2Rev, bestErrNum, bestMatch1, bestMatch2, nonUniqueFlag);
 		}
         // endTime = std::chrono::high_resolution_clock::now();
         // auto runtime = std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime).count();
@@ -1315,31 +1968,24 @@ bool ReadQueue::matchPairedReads(const unsigned int& procReads, uint64_t& succMa
         // startTime = std::chrono::high_resolution_clock::now();
 		if (bothStrandsFlag || getStranded || !matchR1Fwd)
 		{
-			for (auto m1It = matches1Rev.begin(); m1It != matches1Rev.end(); ++m1It)
-			{
-				MATCH::match& mat1 = *m1It;
-				for (auto m2It = matches2Fwd.begin(); m2It != matches2Fwd.end(); ++m2It)
-				{
-					MATCH::match& mat2Fwd = *m2It;
-					int extractedMatchErrs = extractPairedMatch(mat1, mat2Fwd);
-					if (extractedMatchErrs >= 0)
-					{
-						if (extractedMatchErrs == bestErrNum)
-						{
-							nonUniqueFlag = true;
-
-						} else if (extractedMatchErrs < bestErrNum) {
-
-							bestErrNum = extractedMatchErrs;
-							bestMatch1 = mat1;
-							bestMatch2 = mat2Fwd;
-							mat1OriginalStrand = false;
-							nonUniqueFlag = false;
-
-						}
-					}
-				}
-			}
+			if (pairMatches<E>(matches1Rev, matches2Fwd, bestErrNum, bestMatch1, bestMatch2, nonUniqueFlag))
+				mat1OriginalStrand = false;
+		}
+		// a pair decided by mate rescue may tie with the other orientation only because the seeded path would not
+		// have found it, then the rescued orientations are matched as without mate rescue and paired again
+		if (nonUniqueFlag && (rescuedFwd || rescuedRev))
+		{
+			if (rescuedFwd)
+				matchPairSeeded(r1.seq, revSeq2, threadAutomaton<E>(threadnum, 0), threadAutomaton<E>(threadnum, 1), matches1Fwd, matches2Rev, qThreshold);
+			if (rescuedRev)
+				matchPairSeeded(revSeq1, r2.seq, threadAutomaton<E>(threadnum, 2), threadAutomaton<E>(threadnum, 3), matches1Rev, matches2Fwd, qThreshold);
+			bestErrNum = 2*E + 1;
+			nonUniqueFlag = false;
+			mat1OriginalStrand = true;
+			if (bothStrandsFlag || getStranded || matchR1Fwd)
+				pairMatches<E>(matches1Fwd, matches2Rev, bestErrNum, bestMatch1, bestMatch2, nonUniqueFlag);
+			if ((bothStrandsFlag || getStranded || !matchR1Fwd) && pairMatches<E>(matches1Rev, matches2Fwd, bestErrNum, bestMatch1, bestMatch2, nonUniqueFlag))
+				mat1OriginalStrand = false;
 		}
         // endTime = std::chrono::high_resolution_clock::now();
         // runtime = std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime).count();
@@ -1446,8 +2092,22 @@ bool ReadQueue::matchPairedReads(const unsigned int& procReads, uint64_t& succMa
 // }
 
 
+        // a pair with more errors than the first tier budget may be beaten by one that pairs a match with
+        // fewer errors and a match with more than TIERBUDGET errors, only the full budget can decide; the same
+        // holds for pairs that are not unique (see matchReadsImpl), for pairs with a match in the overlap of
+        // two windows (see inWindowOverlap) and for pairs whose windows the full budget may verify differently
+        const auto overlaps = [](const std::vector<MATCH::match>& mats)
+        {
+            return std::any_of(mats.begin(), mats.end(), [](const MATCH::match& m) { return inWindowOverlap(MATCH::getOffset(m)); });
+        };
+        if (firstTier && (bestErrNum > static_cast<int>(MyConst::TIERBUDGET) || nonUniqueFlag || tierUnsure || overlaps(matches1Fwd) || overlaps(matches1Rev) || overlaps(matches2Fwd) || overlaps(matches2Rev)))
+        {
+            tierRetryBuf[threadnum].push_back(i);
+            continue;
+        }
+
         // Check if no pairing possible
-        if (bestErrNum == 2*(MyConst::MISCOUNT + MyConst::ADDMIS) + 1)
+        if (bestErrNum == 2*E + 1)
         {
 // #pragma omp critical
 // {
@@ -1513,8 +2173,8 @@ bool ReadQueue::matchPairedReads(const unsigned int& procReads, uint64_t& succMa
 // }
             // }
 			// of << "\nNo Match\n";
-            r1.isInvalid = true;
-            r2.isInvalid = true;
+            r1.invalidate(UNMAPPED::NOMATCH);
+            r2.invalidate(UNMAPPED::NOMATCH);
             unSuccMatchT += 2;
 
         } else if (nonUniqueFlag)
@@ -1551,8 +2211,8 @@ bool ReadQueue::matchPairedReads(const unsigned int& procReads, uint64_t& succMa
 // }
 			// of << "\nWas nonunique\n";
             nonUniqueMatchT += 2;
-            r1.isInvalid = true;
-            r2.isInvalid = true;
+            r1.invalidate(UNMAPPED::NONUNIQUE);
+            r2.invalidate(UNMAPPED::NONUNIQUE);
 
         } else {
 
@@ -1560,8 +2220,9 @@ bool ReadQueue::matchPairedReads(const unsigned int& procReads, uint64_t& succMa
 // {
 // 			of << "\nWas match\n";
 // }
-            r1.mat = bestMatch1;
-            r2.mat = bestMatch2;
+            // the mate that is not matched on its original strand is matched as reverse complement
+            r1.mat = mat1OriginalStrand ? bestMatch1 : MATCH::setRevComp(bestMatch1);
+            r2.mat = mat1OriginalStrand ? MATCH::setRevComp(bestMatch2) : bestMatch2;
 			// TODO
 // #pragma omp critical
 // 			{
@@ -1570,6 +2231,8 @@ bool ReadQueue::matchPairedReads(const unsigned int& procReads, uint64_t& succMa
 // 				of << r2.id << "\n\t" << static_cast<uint64_t>(ref.metaWindows[MATCH::getMetaID(r2.mat)].chrom) << "\t" << MATCH::getOffset(r2.mat) + ref.metaWindows[MATCH::getMetaID(r2.mat)].startPos << "\t" << (MATCH::isFwd(r2.mat) ? "fwd" : "rev") << "\t" << (ref.metaWindows[MATCH::getMetaID(r2.mat)].startInd == MyConst::CPGDUMMY ? "F" : "T");
 // 			}
 
+            if (!qcCounts.empty())
+                addInsertSize(r1.mat, r1.seq.size(), r2.mat, r2.seq.size());
             if (mat1OriginalStrand)
             {
 				if (getStranded)
@@ -1577,8 +2240,10 @@ bool ReadQueue::matchPairedReads(const unsigned int& procReads, uint64_t& succMa
 #pragma omp atomic
 					++r1FwdMatches;
 				}
-                computeMethLvl(r1.mat, r1.seq);
-                computeMethLvl(r2.mat, revSeq2);
+                threadReadFlags[threadnum] = READCALLS::PAIRED;
+                computeMethLvl<A>(r1.mat, r1.seq, false);
+                threadReadFlags[threadnum] = READCALLS::PAIRED | READCALLS::MATE2;
+                computeMethLvl<A>(r2.mat, revSeq2, true);
 
             } else {
 
@@ -1587,8 +2252,10 @@ bool ReadQueue::matchPairedReads(const unsigned int& procReads, uint64_t& succMa
 #pragma omp atomic
 					++r1RevMatches;
 				}
-                computeMethLvl(r1.mat, revSeq1);
-                computeMethLvl(r2.mat, r2.seq);
+                threadReadFlags[threadnum] = READCALLS::PAIRED;
+                computeMethLvl<A>(r1.mat, revSeq1, true);
+                threadReadFlags[threadnum] = READCALLS::PAIRED | READCALLS::MATE2;
+                computeMethLvl<A>(r2.mat, r2.seq, false);
 
             }
 			if (ref.metaWindows[MATCH::getMetaID(r1.mat)].startInd == MyConst::CPGDUMMY && ref.metaWindows[MATCH::getMetaID(r2.mat)].startInd == MyConst::CPGDUMMY)
@@ -1606,288 +2273,1884 @@ bool ReadQueue::matchPairedReads(const unsigned int& procReads, uint64_t& succMa
 				}
 			}
         }
-// #pragma omp critical
-// {
-// 		of << "---------------------------\n\n\n\n";
-// }
+// #pragma omp critical
+// {
+// 		of << "---------------------------\n\n\n\n";
+// }
+    }
+
+    if (dedup)
+        countUnique<A>();
+    mergeMethEvents();
+
+    // sum up counts
+    for (unsigned int i = 0; i < CORENUM; ++i)
+    {
+        succMatch += matchStats[i];
+        nonUniqueMatch += nonUniqueStats[i];
+        unSuccMatch += noMatchStats[i];
+        succPairedMatch += matchPairedStats[i];
+		tooShortCountMatch += tooShortCounts[i];
+    }
+    return true;
+}
+
+
+
+
+template <size_t E>
+bool ReadQueue::matchReadsBudget(const unsigned int& procReads, uint64_t& succMatch, uint64_t& nonUniqueMatch, uint64_t& unSuccMatch, const bool getStranded)
+{
+    // tiered matching: a read with a match of at most TIERBUDGET errors gets the same result under budget E,
+    // since only the matches with the fewest errors decide, so only the other reads are matched again
+    // with the read cache only the first of the identical reads are matched (the batched verification skips
+    // the others itself)
+    const std::vector<uint32_t>* readIds = MyConst::readCache ? &cacheReads : nullptr;
+    const unsigned int readNum = MyConst::readCache ? cacheReads.size() : procReads;
+    if (MyConst::tieredErrors && E > MyConst::TIERBUDGET)
+    {
+        matchReadsImpl<MyConst::TIERBUDGET, E>(readNum, succMatch, nonUniqueMatch, unSuccMatch, getStranded, readIds, true);
+        collectTierRetries();
+        return matchReadsImpl<E>(tierReads.size(), succMatch, nonUniqueMatch, unSuccMatch, getStranded, &tierReads, false);
+    }
+    // the adaptive error bound depends on the windows verified before, so it is not batched
+    if ((MyConst::batchVerify || MyConst::offload) && !MyConst::adaptiveErrors)
+        return matchReadsBatched<E>(procReads, succMatch, nonUniqueMatch, unSuccMatch, getStranded);
+
+    return matchReadsImpl<E>(readNum, succMatch, nonUniqueMatch, unSuccMatch, getStranded, readIds, false);
+}
+
+template <size_t E>
+bool ReadQueue::matchPairedReadsBudget(const unsigned int& procReads, uint64_t& succMatch, uint64_t& nonUniqueMatch, uint64_t& unSuccMatch, uint64_t& succPairedMatch, uint64_t& tooShortCountMatch, const bool getStranded)
+{
+    // tiered matching (see matchReadsBudget), a pair is matched again unless it has a unique pair of matches with
+    // at most TIERBUDGET errors in sum that the full budget finds the same way (see matchPairedReadsImpl)
+    if (MyConst::tieredErrors && E > MyConst::TIERBUDGET)
+    {
+        matchPairedReadsImpl<MyConst::TIERBUDGET, E>(procReads, succMatch, nonUniqueMatch, unSuccMatch, succPairedMatch, tooShortCountMatch, getStranded, nullptr, true);
+        collectTierRetries();
+        return matchPairedReadsImpl<E>(tierReads.size(), succMatch, nonUniqueMatch, unSuccMatch, succPairedMatch, tooShortCountMatch, getStranded, &tierReads, false);
+    }
+    return matchPairedReadsImpl<E>(procReads, succMatch, nonUniqueMatch, unSuccMatch, succPairedMatch, tooShortCountMatch, getStranded, nullptr, false);
+}
+
+bool ReadQueue::matchReads(const unsigned int& procReads, uint64_t& succMatch, uint64_t& nonUniqueMatch, uint64_t& unSuccMatch, const bool getStranded)
+{
+
+    if (MyConst::readCache)
+        collapseReads(procReads);
+    beginSchedule(procReads);
+    bool ret;
+    // budgets must match MyConst::ERRBUDGETS
+    switch (MyConst::errBudget)
+    {
+        case 2:
+            ret = matchReadsBudget<2>(procReads, succMatch, nonUniqueMatch, unSuccMatch, getStranded);
+            break;
+        case 4:
+            ret = matchReadsBudget<4>(procReads, succMatch, nonUniqueMatch, unSuccMatch, getStranded);
+            break;
+        case 8:
+            ret = matchReadsBudget<8>(procReads, succMatch, nonUniqueMatch, unSuccMatch, getStranded);
+            break;
+        default:
+            ret = matchReadsBudget<6>(procReads, succMatch, nonUniqueMatch, unSuccMatch, getStranded);
+            break;
+    }
+    endSchedule();
+    if (MyConst::readCache)
+        expandReads(procReads);
+    return ret;
+}
+
+bool ReadQueue::matchPairedReads(const unsigned int& procReads, uint64_t& succMatch, uint64_t& nonUniqueMatch, uint64_t& unSuccMatch, uint64_t& succPairedMatch, uint64_t& tooShortCountMatch, const bool getStranded)
+{
+
+    beginSchedule(procReads);
+    bool ret;
+    // budgets must match MyConst::ERRBUDGETS
+    switch (MyConst::errBudget)
+    {
+        case 2:
+            ret = matchPairedReadsBudget<2>(procReads, succMatch, nonUniqueMatch, unSuccMatch, succPairedMatch, tooShortCountMatch, getStranded);
+            break;
+        case 4:
+            ret = matchPairedReadsBudget<4>(procReads, succMatch, nonUniqueMatch, unSuccMatch, succPairedMatch, tooShortCountMatch, getStranded);
+            break;
+        case 8:
+            ret = matchPairedReadsBudget<8>(procReads, succMatch, nonUniqueMatch, unSuccMatch, succPairedMatch, tooShortCountMatch, getStranded);
+            break;
+        default:
+            ret = matchPairedReadsBudget<6>(procReads, succMatch, nonUniqueMatch, unSuccMatch, succPairedMatch, tooShortCountMatch, getStranded);
+            break;
+    }
+    endSchedule();
+    return ret;
+}
+
+void ReadQueue::collectTierRetries()
+{
+    tierReads.clear();
+    for (auto& retries : tierRetryBuf)
+    {
+        tierReads.insert(tierReads.end(), retries.begin(), retries.end());
+        retries.clear();
+    }
+    // keep the batch order, the threads took the reads in chunks
+    std::sort(tierReads.begin(), tierReads.end());
+}
+
+void ReadQueue::collapseReads(const unsigned int procReads)
+{
+
+    cacheOrder.resize(procReads);
+    readRep.resize(procReads);
+    readWeight.assign(procReads, 0);
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(CORENUM) schedule(static)
+#endif
+    for (unsigned int i = 0; i < procReads; ++i)
+    {
+        // FNV-1a over the sequence, in single cell mode the cell is part of the key
+        const SeqView seq = readBuffer[i].seq;
+        uint64_t h = 0xcbf29ce484222325ULL;
+        for (size_t pos = 0; pos < seq.size(); ++pos)
+        {
+            h ^= static_cast<uint8_t>(seq[pos]);
+            h *= 0x100000001b3ULL;
+        }
+        if (isSC)
+            h ^= static_cast<uint64_t>(readCells[i]) * 0x9e3779b97f4a7c15ULL;
+        cacheOrder[i] = std::make_pair(h, i);
+    }
+    std::sort(cacheOrder.begin(), cacheOrder.end());
+
+    // every read takes the result of the first read of its run of equal hashes if they are identical
+    cacheReads.clear();
+    for (size_t k = 0; k < cacheOrder.size(); )
+    {
+        size_t end = k + 1;
+        while (end < cacheOrder.size() && cacheOrder[end].first == cacheOrder[k].first)
+            ++end;
+        const uint32_t first = cacheOrder[k].second;
+        const SeqView firstSeq = readBuffer[first].seq;
+        for (size_t l = k; l < end; ++l)
+        {
+            const uint32_t i = cacheOrder[l].second;
+            const SeqView seq = readBuffer[i].seq;
+            const bool same = seq.size() == firstSeq.size() && std::equal(seq.begin(), seq.end(), firstSeq.begin()) && (!isSC || readCells[i] == readCells[first]);
+            readRep[i] = same ? first : i;
+            ++readWeight[readRep[i]];
+        }
+        k = end;
+    }
+    for (unsigned int i = 0; i < procReads; ++i)
+    {
+        if (readWeight[i] > 0)
+            cacheReads.push_back(i);
+    }
+    cachedReads += procReads - cacheReads.size();
+}
+
+void ReadQueue::expandReads(const unsigned int procReads)
+{
+    for (unsigned int i = 0; i < procReads; ++i)
+    {
+        if (readRep[i] != i)
+        {
+            readBuffer[i].mat = readBuffer[readRep[i]].mat;
+            readBuffer[i].isInvalid = readBuffer[readRep[i]].isInvalid;
+            readBuffer[i].reason = readBuffer[readRep[i]].reason;
+        }
+    }
+}
+
+bool ReadQueue::matchSCCells(const std::vector<scCell>& cells, const bool isGZ)
+{
+
+    // counter
+    uint64_t succPairedMatch = 0;
+    uint64_t succMatch = 0;
+    uint64_t nonUniqueMatch = 0;
+    uint64_t unSuccMatch = 0;
+	uint64_t tooShortCount = 0;
+	uint64_t overallReads = 0;
+
+	readCells.resize(MyConst::chunkSize);
+	cellCounts.assign(cells.size(), std::vector<CellCounts>());
+	std::vector<uint64_t> cellReads(cells.size(), 0);
+	auto closeFiles = [&]()
+	{
+		fastq.close();
+		fastq2.close();
+	};
+
+	// stranding is decided once for the whole library on a sample of the first batch
+	bool getStranded = !bothStrandsFlag;
+
+	// index of the next cell to open
+	size_t nextCell = 0;
+	// cell whose files are currently read
+	size_t curCell = 0;
+	bool cellOpen = false;
+	while (cellOpen || nextCell < cells.size())
+	{
+
+		// cells whose reads are completely contained in this or previous batches
+		std::vector<size_t> finished;
+		unsigned int batchReads = 0;
+		while (batchReads < MyConst::chunkSize && (cellOpen || nextCell < cells.size()))
+		{
+
+			if (!cellOpen)
+			{
+				curCell = nextCell++;
+				const scCell& cell = cells[curCell];
+				if (!fastq.open(cell.file1, isGZ) || (isPaired && !fastq2.open(cell.file2, isGZ)))
+				{
+					std::cerr << "ERROR: Opening files of cell `" << cell.id << "' failed, skipping cell.\n";
+					closeFiles();
+					continue;
+				}
+				cellCounts[curCell].resize(CORENUM);
+				cellOpen = true;
+			}
+
+			unsigned int filled;
+			const bool isFull = parseChunkStream(fastq, fastq2, readBuffer, readBuffer2, filled, batchReads);
+			std::fill(readCells.begin() + batchReads, readCells.begin() + filled, curCell);
+			cellReads[curCell] += filled - batchReads;
+			batchReads = filled;
+			if (!isFull)
+			{
+				closeFiles();
+				finished.push_back(curCell);
+				cellOpen = false;
+			}
+		}
+
+		if (getStranded)
+		{
+			sampleStrand(batchReads);
+			getStranded = false;
+		}
+		if (isPaired)
+		{
+			matchPairedReads(batchReads, succMatch, nonUniqueMatch, unSuccMatch, succPairedMatch, tooShortCount, false);
+		} else {
+			matchReads(batchReads, succMatch, nonUniqueMatch, unSuccMatch, false);
+		}
+		overallReads += batchReads;
+		std::cout << "Processed " << overallReads << (isPaired ? " paired reads\n" : " reads\n");
+
+		for (const size_t c : finished)
+		{
+			std::cout << "Finished cell " << cells[c].id << " (" << cellReads[c] << (isPaired ? " read pairs)\n" : " reads)\n");
+			finishCell(cells[c], c);
+		}
+	}
+
+	std::cout << "\nOverall number of reads: " << (isPaired ? "(2*)" : "") << overallReads;
+    std::cout << "\tOverall successfully matched: " << succMatch << "\n\tUnsuccessfully matched: " << unSuccMatch << "\n\tNonunique matches: " << nonUniqueMatch << "\n";
+	if (isPaired)
+	{
+		std::cout << "\nInvalid reads (containing N or too short): " << tooShortCount << "\n\nFully matched pairs: " << succPairedMatch << "\n";
+	}
+	std::cout << "\n\n";
+	return true;
+}
+
+bool ReadQueue::matchSCBarcodes(const CellBarcodes& barcodes, const std::vector<std::string>& files, const std::vector<std::string>& files2, const bool isGZ)
+{
+
+    // counter
+    uint64_t succPairedMatch = 0;
+    uint64_t succMatch = 0;
+    uint64_t nonUniqueMatch = 0;
+    uint64_t unSuccMatch = 0;
+	uint64_t tooShortCount = 0;
+	uint64_t overallReads = 0;
+	uint64_t unassigned = 0;
+
+	readCells.resize(MyConst::chunkSize);
+	cellCounts.assign(barcodes.size(), std::vector<CellCounts>(CORENUM));
+	std::vector<uint64_t> cellReads(barcodes.size(), 0);
+	// the barcode is in read 1, read 2 follows it
+	fastq.setBarcodes(&barcodes);
+
+	bool getStranded = !bothStrandsFlag;
+
+	size_t nextFile = 0;
+	bool fileOpen = false;
+	while (fileOpen || nextFile < files.size())
+	{
+
+		unsigned int batchReads = 0;
+		while (batchReads < MyConst::chunkSize && (fileOpen || nextFile < files.size()))
+		{
+
+			if (!fileOpen)
+			{
+				if (!fastq.open(files[nextFile], isGZ) || (isPaired && !fastq2.open(files2[nextFile], isGZ)))
+				{
+					std::cerr << "Could not open read file " << files[nextFile] << (isPaired ? " or its mate file" : "") << "! Terminating...\n\n";
+					exit(1);
+				}
+				++nextFile;
+				fileOpen = true;
+			}
+
+			unsigned int filled;
+			const bool isFull = parseChunkStream(fastq, fastq2, readBuffer, readBuffer2, filled, batchReads);
+			// the reads (pairs) of a cell of the whitelist are moved to the front
+			const std::vector<uint32_t>& tags = fastq.cells();
+			unsigned int kept = batchReads;
+			for (unsigned int i = batchReads; i < filled; ++i)
+			{
+				const uint32_t cell = tags[i - batchReads];
+				if (cell == CellBarcodes::NOCELL)
+				{
+					++unassigned;
+					continue;
+				}
+				readBuffer.swapReads(kept, i);
+				if (isPaired)
+					readBuffer2.swapReads(kept, i);
+				readCells[kept++] = cell;
+				++cellReads[cell];
+			}
+			readBuffer.truncate(kept);
+			if (isPaired)
+				readBuffer2.truncate(kept);
+			batchReads = kept;
+			if (!isFull)
+			{
+				fastq.close();
+				fastq2.close();
+				fileOpen = false;
+			}
+		}
+		if (batchReads == 0)
+			continue;
+
+		if (getStranded)
+		{
+			sampleStrand(batchReads);
+			getStranded = false;
+		}
+		if (isPaired)
+		{
+			matchPairedReads(batchReads, succMatch, nonUniqueMatch, unSuccMatch, succPairedMatch, tooShortCount, false);
+		} else {
+			matchReads(batchReads, succMatch, nonUniqueMatch, unSuccMatch, false);
+		}
+		overallReads += batchReads;
+		std::cout << "Processed " << overallReads << (isPaired ? " paired reads\n" : " reads\n");
+	}
+	fastq.setBarcodes(nullptr);
+
+	size_t cellsWithReads = 0;
+	for (uint32_t c = 0; c < barcodes.size(); ++c)
+	{
+		if (cellReads[c] == 0)
+		{
+			std::vector<CellCounts>().swap(cellCounts[c]);
+			continue;
+		}
+		++cellsWithReads;
+		scCell cell;
+		cell.id = barcodes.name(c);
+		finishCell(cell, c);
+	}
+
+	std::cout << "\nOverall number of reads: " << (isPaired ? "(2*)" : "") << overallReads;
+    std::cout << "\tOverall successfully matched: " << succMatch << "\n\tUnsuccessfully matched: " << unSuccMatch << "\n\tNonunique matches: " << nonUniqueMatch << "\n";
+	if (isPaired)
+	{
+		std::cout << "\nInvalid reads (containing N or too short): " << tooShortCount << "\n\nFully matched pairs: " << succPairedMatch << "\n";
+	}
+	std::cout << "\nReads without a barcode of the whitelist: " << unassigned << "\nCells with reads: " << cellsWithReads << " of " << barcodes.size() << "\n";
+	std::cout << "\n\n";
+	return true;
+}
+
+void ReadQueue::finishCell(const scCell& cell, const size_t cellIdx)
+{
+
+	std::vector<CellCounts>& counts = cellCounts[cellIdx];
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(CORENUM) schedule(dynamic,1)
+#endif
+	for (unsigned int b = 0; b < counts.size(); ++b)
+	{
+		const uint64_t first = b * methBucketSize;
+		counts[b].forEach([&](const uint32_t cpg, const unsigned int c, const uint32_t n)
+		{
+			for (uint32_t k = 0; k < n; ++k)
+				applyMethEvent((first + cpg) << 2 | c, b);
+		});
+	}
+	std::vector<CellCounts>().swap(counts);
+	if (binMatrix.isOpen())
+	{
+		// before the counts are reset by printing them
+		std::vector<BINFILE::cellRecord> recs;
+		collectBins(scSparse, recs);
+		const uint32_t idLen = cell.id.size();
+		const uint32_t recNum = recs.size();
+		binMatrix.write(reinterpret_cast<const char*>(&idLen), sizeof(idLen));
+		binMatrix.write(cell.id);
+		binMatrix.write(reinterpret_cast<const char*>(&recNum), sizeof(recNum));
+		binMatrix.write(reinterpret_cast<const char*>(recs.data()), sizeof(BINFILE::cellRecord) * recs.size());
+	}
+	printSCMethylationLevels(cell.id);
+}
+
+void ReadQueue::mergeMethEvents()
+{
+
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(CORENUM) schedule(dynamic,1)
+#endif
+    for (unsigned int b = 0; b < CORENUM; ++b)
+    {
+
+        for (unsigned int t = 0; t < CORENUM; ++t)
+        {
+
+            auto& events = methEvents[t][b];
+            for (const uint64_t e : events)
+            {
+
+                if (isSC)
+                {
+                    const uint64_t ev = e & ((1ULL << METHCELLSHIFT) - 1);
+                    cellCounts[e >> METHCELLSHIFT][b].add((ev >> 2) - b * methBucketSize, ev & 3);
+                    uint16_t& cntSc = methCounter(methLevelsSc[ev >> 2], static_cast<METHCOUNTER>(ev & 3));
+                    if (cntSc < std::numeric_limits<uint16_t>::max())
+                        ++cntSc;
+
+                } else {
+
+                    applyMethEvent(e, b);
+                }
+            }
+            if (keepMethDeltas && !isSC)
+                methDeltaEvents[b].insert(methDeltaEvents[b].end(), events.begin(), events.end());
+            events.clear();
+        }
+        // non CpG sites, bucketed in the same way
+        for (unsigned int t = 0; t < ctxEvents.size(); ++t)
+        {
+
+            auto& events = ctxEvents[t][b];
+            for (const uint64_t e : events)
+            {
+                uint32_t& cnt = ctxLevels[e >> 1][e & 1];
+                if (cnt < std::numeric_limits<uint32_t>::max())
+                    ++cnt;
+            }
+            events.clear();
+        }
+    }
+}
+
+void ReadQueue::takeMethDeltas(std::vector<MethDelta>& deltas)
+{
+
+    // every range of CpGs is counted on its own and the ranges are concatenated in order
+    std::vector<std::vector<MethDelta> > rangeDeltas(CORENUM);
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(CORENUM) schedule(dynamic,1)
+#endif
+    for (unsigned int b = 0; b < CORENUM; ++b)
+    {
+
+        std::vector<uint64_t>& events = methDeltaEvents[b];
+        std::sort(events.begin(), events.end());
+        for (const uint64_t ev : events)
+        {
+            if (rangeDeltas[b].empty() || rangeDeltas[b].back().cpgId != ev >> 2)
+                rangeDeltas[b].push_back({ev >> 2, 0, 0, 0, 0});
+            MethDelta& d = rangeDeltas[b].back();
+            switch (static_cast<METHCOUNTER>(ev & 3))
+            {
+                case METHFWD: ++d.methFwd; break;
+                case UNMETHFWD: ++d.unmethFwd; break;
+                case METHREV: ++d.methRev; break;
+                case UNMETHREV: ++d.unmethRev; break;
+            }
+        }
+        events.clear();
+    }
+    deltas.clear();
+    for (const std::vector<MethDelta>& d : rangeDeltas)
+        deltas.insert(deltas.end(), d.begin(), d.end());
+}
+
+void ReadQueue::printMethylationLevels(std::string& filename, const METHFILE::FORMAT fmt)
+{
+
+    Profiler::Scope profScope(prof, prof.outputSlot(), Profiler::OUTPUT);
+
+    // the text tables of a combined index are written per genome, the binary table keeps the CpGs of the index
+    const std::vector<std::string>& tags = ref.genomes();
+    const int genomeNum = fmt == METHFILE::BINARY ? 0 : tags.size();
+    for (int g = genomeNum == 0 ? -1 : 0; g < genomeNum; ++g)
+    {
+        const std::string base = g < 0 ? filename : filename + "_" + tags[g];
+        std::string path = base + "_cpg.tsv";
+        if (fmt == METHFILE::BGZF)
+        {
+            path += ".gz";
+
+        } else if (fmt == METHFILE::BINARY) {
+
+            path = base + "_cpg.bin";
+        }
+        std::cout << "\nStart writing Methylation levels to \"" << path << "\"\n\n";
+
+        // the compressed table is indexed for region queries (tabix)
+        MethWriter cpgFile;
+        if (!cpgFile.open(path, fmt == METHFILE::BGZF, fmt == METHFILE::BGZF))
+        {
+            std::cerr << "Could not open file \"" << path << "\" for writing! Terminating...\n\n";
+            exit(1);
+        }
+        writeMethLevels(cpgFile, fmt, g);
+        cpgFile.close();
+    }
+    std::cout << "Finished writing methylation levels to file\n\n";
+    if (!tags.empty())
+    {
+        printGenomeSummary(filename + "_genomes.tsv");
+    }
+}
+
+void ReadQueue::printGenomeSummary(const std::string& path)
+{
+
+    const std::vector<std::string>& tags = ref.genomes();
+    std::vector<uint64_t> reads(tags.size(), 0);
+    std::vector<uint64_t> cpgs(tags.size(), 0);
+    std::vector<uint64_t> meth(tags.size(), 0);
+    std::vector<uint64_t> unmeth(tags.size(), 0);
+    for (unsigned int t = 0; t < genomeReads.size(); ++t)
+    {
+        for (size_t g = 0; g < tags.size(); ++g)
+        {
+            reads[g] += genomeReads[t][g];
+        }
+    }
+    for (size_t cpgID = 0; cpgID < ref.cpgTable.size(); ++cpgID)
+    {
+        const uint8_t g = ref.genomeOf(ref.cpgTable[cpgID].chrom);
+        const uint64_t m = getMethCount(cpgID, METHFWD) + getMethCount(cpgID, METHREV);
+        const uint64_t u = getMethCount(cpgID, UNMETHFWD) + getMethCount(cpgID, UNMETHREV);
+        ++cpgs[g];
+        meth[g] += m;
+        unmeth[g] += u;
+    }
+    uint64_t readSum = 0;
+    for (const uint64_t r : reads)
+    {
+        readSum += r;
+    }
+
+    std::ofstream out(path);
+    if (!out)
+    {
+        std::cerr << "Could not open file \"" << path << "\" for writing! Terminating...\n\n";
+        exit(1);
+    }
+    out << "genome\taligned\tfraction\tcpgs\tmethylated\tunmethylated\n";
+    std::cout << "Reads (mates) aligned uniquely per genome:\n";
+    for (size_t g = 0; g < tags.size(); ++g)
+    {
+        const double frac = readSum == 0 ? 0.0 : static_cast<double>(reads[g]) / readSum;
+        out << tags[g] << "\t" << reads[g] << "\t" << frac << "\t" << cpgs[g] << "\t" << meth[g] << "\t" << unmeth[g] << "\n";
+        char pct[16];
+        std::snprintf(pct, sizeof(pct), "%.2f", 100 * frac);
+        std::cout << "\t" << tags[g] << ":\t" << reads[g] << " (" << pct << "%)\n";
+    }
+    std::cout << "\n";
+}
+
+void ReadQueue::writeMethLevels(MethWriter& cpgFile, const METHFILE::FORMAT fmt, const int genome)
+{
+
+    // look up chromosome names once instead of for every line
+    // (the chromosomes of one genome of a combined index are named without the tag of the genome)
+    std::vector<std::string> chrNames = getChromNames();
+    if (genome >= 0)
+    {
+        const size_t prefixLen = ref.genomes()[genome].size() + 1;
+        for (chromId c = 0; c < chrNames.size(); ++c)
+        {
+            if (ref.genomeOf(c) == genome)
+            {
+                chrNames[c].erase(0, prefixLen);
+            }
+        }
+    }
+    size_t maxNameLen = 0;
+    for (const std::string& name : chrNames)
+    {
+        maxNameLen = std::max(maxNameLen, name.size());
+    }
+
+    if (fmt == METHFILE::BINARY)
+    {
+        METHFILE::header hdr;
+        hdr.magic = METHFILE::MAGIC;
+        hdr.version = METHFILE::VERSION;
+        hdr.chrNum = ref.chrMap.size();
+        hdr.cpgNum = ref.cpgTable.size();
+        hdr.fingerprint = ref.fingerprint();
+        cpgFile.write(reinterpret_cast<const char*>(&hdr), sizeof(hdr));
+        for (const auto& chr : ref.chrMap)
+        {
+            const uint32_t len = chr.second.size();
+            const chromId id = chr.first;
+            cpgFile.write(reinterpret_cast<const char*>(&id), sizeof(id));
+            cpgFile.write(reinterpret_cast<const char*>(&len), sizeof(len));
+            cpgFile.write(chr.second);
+        }
+    }
+
+    // every thread formats a slice of CpGs per round, slices are written in order
+    constexpr size_t sliceLen = 1 << 16;
+    // chromosome, position and four counts plus separators
+    const size_t lineLen = std::max(maxNameLen + 5 * 20 + 5, sizeof(METHFILE::record));
+    std::vector<std::vector<char> > slices(CORENUM, std::vector<char>(sliceLen * lineLen));
+    std::vector<size_t> sliceBytes(CORENUM);
+    // the table is sorted by chromosome and position, the binary file keeps the order of the index
+    std::vector<uint32_t> order = fmt == METHFILE::BINARY ? std::vector<uint32_t>() : MethWriter::tableOrder(ref.cpgTable.size(),
+            [&](const size_t i) -> const std::string& { return chrNames[ref.cpgTable[i].chrom]; },
+            [&](const size_t i) -> uint32_t { return ref.cpgTable[i].pos + MyConst::READLEN - 2 + ref.chrOffsets[ref.cpgTable[i].chrom]; });
+    if (genome >= 0)
+    {
+        // (an empty order stands for the order of the table)
+        if (order.empty())
+        {
+            order.resize(ref.cpgTable.size());
+            std::iota(order.begin(), order.end(), 0);
+        }
+        order.erase(std::remove_if(order.begin(), order.end(),
+                    [&](const uint32_t i) { return ref.genomeOf(ref.cpgTable[i].chrom) != genome; }), order.end());
+    }
+    const bool inTableOrder = order.empty() && genome < 0;
+    const size_t cpgNum = inTableOrder ? ref.cpgTable.size() : order.size();
+
+    for (size_t roundStart = 0; roundStart < cpgNum; roundStart += sliceLen * CORENUM)
+    {
+
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(CORENUM) schedule(static,1)
+#endif
+        for (unsigned int t = 0; t < CORENUM; ++t)
+        {
+
+            const size_t sliceStart = std::min(cpgNum, roundStart + t * sliceLen);
+            const size_t sliceEnd = std::min(cpgNum, sliceStart + sliceLen);
+            char* out = slices[t].data();
+            for (size_t k = sliceStart; k < sliceEnd; ++k)
+            {
+
+                const size_t cpgID = inTableOrder ? k : order[k];
+                const struct CpG& cpg = ref.cpgTable[cpgID];
+                if (fmt == METHFILE::BINARY)
+                {
+
+                    METHFILE::record rec;
+                    rec.pos = cpg.pos + MyConst::READLEN - 2 + ref.chrOffsets[cpg.chrom];
+                    rec.chrom = cpg.chrom;
+                    rec.methFwd = getMethCount(cpgID, METHFWD);
+                    rec.unmethFwd = getMethCount(cpgID, UNMETHFWD);
+                    rec.methRev = getMethCount(cpgID, METHREV);
+                    rec.unmethRev = getMethCount(cpgID, UNMETHREV);
+                    std::memcpy(out, &rec, sizeof(rec));
+                    out += sizeof(rec);
+                    continue;
+                }
+                // print the position of the (C of the) CpG
+                const std::string& name = chrNames[cpg.chrom];
+                std::memcpy(out, name.data(), name.size());
+                out += name.size();
+                *out++ = '\t';
+                out += MethWriter::formatUInt(out, cpg.pos + MyConst::READLEN - 2 + ref.chrOffsets[cpg.chrom]);
+                *out++ = '\t';
+                // print the counts
+                // fwd counts
+                out += MethWriter::formatUInt(out, getMethCount(cpgID, METHFWD));
+                *out++ = '\t';
+                out += MethWriter::formatUInt(out, getMethCount(cpgID, UNMETHFWD));
+                *out++ = '\t';
+                // rev counts
+                out += MethWriter::formatUInt(out, getMethCount(cpgID, METHREV));
+                *out++ = '\t';
+                out += MethWriter::formatUInt(out, getMethCount(cpgID, UNMETHREV));
+                *out++ = '\n';
+            }
+            sliceBytes[t] = out - slices[t].data();
+        }
+        for (unsigned int t = 0; t < CORENUM; ++t)
+        {
+            cpgFile.write(slices[t].data(), sliceBytes[t]);
+        }
+    }
+}
+
+// appends the n lowest bytes of v to out, least significant first (BAM is little endian)
+static inline void appendLE(std::string& out, const uint64_t v, const unsigned int n)
+{
+    for (unsigned int i = 0; i < n; ++i)
+    {
+        out.push_back(static_cast<char>((v >> (8 * i)) & 0xff));
+    }
+}
+
+// BAM bin of the reference interval [beg, end) (see the SAM specification, section 5.3)
+static inline uint32_t bamBin(const int64_t beg, int64_t end)
+{
+    --end;
+    if (beg >> 14 == end >> 14) return ((1 << 15) - 1) / 7 + (beg >> 14);
+    if (beg >> 17 == end >> 17) return ((1 << 12) - 1) / 7 + (beg >> 17);
+    if (beg >> 20 == end >> 20) return ((1 << 9) - 1) / 7 + (beg >> 20);
+    if (beg >> 23 == end >> 23) return ((1 << 6) - 1) / 7 + (beg >> 23);
+    if (beg >> 26 == end >> 26) return ((1 << 3) - 1) / 7 + (beg >> 26);
+    return 0;
+}
+
+void ReadQueue::openAlignments(const std::string& path)
+{
+
+    const auto endsWith = [&](const std::string& suffix)
+    {
+        return path.size() >= suffix.size() && path.compare(path.size() - suffix.size(), suffix.size(), suffix) == 0;
+    };
+    alignBam = endsWith(".bam");
+    if (!alignOut.open(path, alignBam || endsWith(".gz")))
+    {
+        std::cerr << "Could not open file \"" << path << "\" for the alignments! Terminating...\n\n";
+        exit(1);
+    }
+
+    // the sequences of a targeted index named after the same chromosome are one reference sequence
+    const std::vector<std::string> chrNames = getChromNames();
+    std::unordered_map<std::string, uint32_t> nameIds;
+    std::vector<uint64_t> refLens;
+    alignRefIds.resize(chrNames.size());
+    alignRefNames.clear();
+    for (chromId c = 0; c < chrNames.size(); ++c)
+    {
+        const auto ins = nameIds.emplace(chrNames[c], alignRefNames.size());
+        if (ins.second)
+        {
+            alignRefNames.push_back(chrNames[c]);
+            refLens.push_back(0);
+        }
+        alignRefIds[c] = ins.first->second;
+        refLens[alignRefIds[c]] = std::max<uint64_t>(refLens[alignRefIds[c]], ref.chrOffsets[c] + ref.fullSeq[c].size());
+    }
+    std::string text = "@HD\tVN:1.6\tSO:unsorted\n";
+    for (size_t i = 0; i < alignRefNames.size(); ++i)
+    {
+        text += "@SQ\tSN:" + alignRefNames[i] + "\tLN:" + std::to_string(refLens[i]) + "\n";
+    }
+    text += "@PG\tID:FAME\tPN:FAME\n";
+    if (!alignBam)
+    {
+        alignOut.write(text);
+        return;
+    }
+    // magic, header text and the names and lengths of the reference sequences
+    std::string head("BAM\1", 4);
+    appendLE(head, text.size(), 4);
+    head += text;
+    appendLE(head, alignRefNames.size(), 4);
+    for (size_t i = 0; i < alignRefNames.size(); ++i)
+    {
+        appendLE(head, alignRefNames[i].size() + 1, 4);
+        head += alignRefNames[i];
+        head.push_back('\0');
+        appendLE(head, refLens[i], 4);
+    }
+    alignOut.write(head);
+}
+
+void ReadQueue::formatBatch(Batch& b)
+{
+
+    b.alignText.clear();
+    b.unmappedText.clear();
+    if (alignOut.isOpen())
+    {
+        // budgets must match MyConst::ERRBUDGETS
+        switch (MyConst::errBudget)
+        {
+            case 2:
+                formatAlignments<2>(b);
+                break;
+            case 4:
+                formatAlignments<4>(b);
+                break;
+            case 8:
+                formatAlignments<8>(b);
+                break;
+            default:
+                formatAlignments<6>(b);
+                break;
+        }
+    }
+    if (unmappedOut.isOpen())
+        formatUnmapped(b);
+}
+
+void ReadQueue::writeBatch(Batch& b)
+{
+
+    Profiler::Scope profScope(prof, prof.outputSlot(), Profiler::OUTPUT);
+    if (alignOut.isOpen())
+        alignOut.write(b.alignText);
+    if (callOut.isOpen())
+        callOut.write(b.callText);
+    // the writer thread takes over the records
+    if (unmappedOut.isOpen())
+        unmappedOut.write(b.unmappedText);
+}
+
+void ReadQueue::openReadCalls(const std::string& path)
+{
+
+    if (!callOut.open(path, true))
+    {
+        std::cerr << "Could not open file \"" << path << "\" for the read level methylation calls! Terminating...\n\n";
+        exit(1);
+    }
+    READCALLS::header hdr;
+    hdr.magic = READCALLS::MAGIC;
+    hdr.version = READCALLS::VERSION;
+    hdr.chrNum = ref.chrMap.size();
+    hdr.fingerprint = ref.fingerprint();
+    callOut.write(reinterpret_cast<const char*>(&hdr), sizeof(hdr));
+    for (const auto& chr : ref.chrMap)
+    {
+        const uint32_t len = chr.second.size();
+        const chromId id = chr.first;
+        callOut.write(reinterpret_cast<const char*>(&id), sizeof(id));
+        callOut.write(reinterpret_cast<const char*>(&len), sizeof(len));
+        callOut.write(chr.second);
+    }
+}
+
+void ReadQueue::addReadCalls(const MATCH::match& mat, const size_t readLen)
+{
+
+    const int t = omp_get_thread_num();
+    std::vector<uint64_t>& calls = threadCalls[t];
+    if (calls.empty())
+        return;
+    // the calls of erroneous matches are found from the back of the read
+    std::sort(calls.begin(), calls.end());
+    const uint64_t first = calls.front() >> 1;
+    const uint64_t span = std::min<uint64_t>((calls.back() >> 1) - first + 1, std::numeric_limits<uint16_t>::max());
+    const metaWindow& m = ref.metaWindows[MATCH::getMetaID(mat)];
+    const struct CpG& cpg = ref.cpgTable[first];
+
+    READCALLS::record rec;
+    rec.firstCpG = first;
+    rec.chrom = cpg.chrom;
+    rec.start = m.startPos + MATCH::getOffset(mat) - (readLen - 1) + ref.chrOffsets[cpg.chrom];
+    rec.span = span;
+    rec.flags = threadReadFlags[t] | (MATCH::isFwd(mat) ? 0 : READCALLS::REV);
+    rec.reserved = 0;
+    const size_t setBytes = (span + 7) / 8;
+    std::string& out = threadCallText[t];
+    const size_t recStart = out.size();
+    out.append(reinterpret_cast<const char*>(&rec), sizeof(rec));
+    out.append(2 * setBytes, '\0');
+    char* called = &out[recStart + sizeof(rec)];
+    char* meth = called + setBytes;
+    for (const uint64_t call : calls)
+    {
+        const uint64_t i = (call >> 1) - first;
+        if (i >= span)
+            break;
+        called[i / 8] |= 1 << (i % 8);
+        if (call & 1)
+            meth[i / 8] |= 1 << (i % 8);
+    }
+    calls.clear();
+    // every read the read stands for (see threadWeight) gets its record
+    if (threadWeight[t] > 1)
+    {
+        const std::string one = out.substr(recStart);
+        for (uint32_t w = 1; w < threadWeight[t]; ++w)
+            out += one;
+    }
+}
+
+void ReadQueue::openUnmapped(const std::string& path)
+{
+
+    const bool isGZ = path.size() >= 3 && path.compare(path.size() - 3, 3, ".gz") == 0;
+    if (!unmappedOut.open(path, isGZ))
+    {
+        std::cerr << "Could not open file \"" << path << "\" for the unaligned reads! Terminating...\n\n";
+        exit(1);
+    }
+    readBuffer.keepQualities(true);
+    readBuffer2.keepQualities(true);
+}
+
+void ReadQueue::formatUnmapped(Batch& b)
+{
+
+    // unaligned reads are few, formatting them takes a single pass over the flags
+    std::string& out = b.unmappedText;
+    for (unsigned int i = 0; i < b.count; ++i)
+    {
+        const Read& r1 = b.reads[i];
+        if (!isPaired)
+        {
+            if (r1.isInvalid)
+                appendFastq(out, r1, r1.reason);
+            continue;
+        }
+        const Read& r2 = b.reads2[i];
+        if (!r1.isInvalid && !r2.isInvalid)
+            continue;
+        // a valid mate is not aligned because of the other one
+        appendFastq(out, r1, r1.reason != UNMAPPED::NONE ? r1.reason : r2.reason);
+        appendFastq(out, r2, r2.reason != UNMAPPED::NONE ? r2.reason : r1.reason);
+    }
+}
+
+void ReadQueue::appendFastq(std::string& out, const Read& r, const UNMAPPED::REASON reason)
+{
+
+    static const char* const REASONNAMES[] = {"aligned", "length", "n_letters", "no_match", "non_unique", "over_budget"};
+    // the name without comment, ids read from FASTQ start with '@'
+    const size_t nameBeg = r.id.size() > 0 && r.id[0] == '@' ? 1 : 0;
+    size_t nameEnd = nameBeg;
+    while (nameEnd < r.id.size() && r.id[nameEnd] != ' ' && r.id[nameEnd] != '\t')
+        ++nameEnd;
+    out.push_back('@');
+    out.append(r.id.data() + nameBeg, nameEnd - nameBeg);
+    out += " reason=";
+    out += REASONNAMES[reason];
+    out.push_back('\n');
+    out.append(r.seq.data(), r.seq.size());
+    out += "\n+\n";
+    if (r.qual.size() == r.seq.size())
+        out.append(r.qual.data(), r.qual.size());
+    else
+        out.append(r.seq.size(), 'I');
+    out.push_back('\n');
+}
+
+template <size_t E>
+void ReadQueue::formatAlignments(Batch& b)
+{
+
+    std::string& out = b.alignText;
+    AlignPos al1;
+    AlignPos al2;
+    for (unsigned int i = 0; i < b.count; ++i)
+    {
+        Read& r1 = b.reads[i];
+        if (!isPaired)
+        {
+            placeRead<E>(r1, !r1.isInvalid, al1, b.refWin);
+            appendRecord(out, r1, al1, nullptr, 0);
+            continue;
+        }
+        // pairs are matched as a whole, a mate is left unmatched only together with the other
+        Read& r2 = b.reads2[i];
+        const bool mapped = !r1.isInvalid && !r2.isInvalid;
+        placeRead<E>(r1, mapped, al1, b.refWin);
+        placeRead<E>(r2, mapped, al2, b.refWin);
+        if (al1.mapped != al2.mapped)
+        {
+            al1.mapped = false;
+            al2.mapped = false;
+        }
+        appendRecord(out, r1, al1, &al2, 0x40);
+        appendRecord(out, r2, al2, &al1, 0x80);
+    }
+}
+
+template <size_t E>
+inline void ReadQueue::placeRead(Read& r, const bool mapped, AlignPos& al, std::vector<char>& refWin)
+{
+
+    al.mapped = mapped;
+    al.reverse = false;
+    al.cigar.clear();
+    if (!mapped)
+        return;
+
+    const MATCH::match mat = r.mat;
+    const bool revComp = MATCH::isRevComp(mat);
+    const bool isFwd = MATCH::isFwd(mat);
+    // the sequence that was matched is aligned to the forward strand as it is, or its reverse complement to the
+    // reverse strand; the record holds the read as it lies on the forward strand
+    al.reverse = revComp == isFwd;
+    al.convGA = !isFwd;
+    const metaWindow& m = ref.metaWindows[MATCH::getMetaID(mat)];
+    al.refId = alignRefIds[m.chrom];
+    // last reference letter of the match
+    uint64_t end = static_cast<uint64_t>(m.startPos) + MATCH::getOffset(mat);
+    const SeqView seq = revComp ? r.rev : r.seq;
+    if (MATCH::getErrNum(mat) == 0)
+    {
+        al.cigar.push_back(seq.size() << 4);
+        al.refLen = seq.size();
+        al.edits = 0;
+
+    } else {
+
+        // the same banded alignment as in computeMethLvl, its operations run from left to right on the
+        // forward strand for both strands
+        refWin.resize(seq.size() + E);
+        ref.unpackNear(MATCH::getMetaID(mat), m.chrom, static_cast<std::ptrdiff_t>(end) - (seq.size() + E - 1), refWin.size(), refWin.data());
+        std::vector<ERROR_T> alignment;
+        const unsigned int dist = alignToRef<E>(seq, refWin.data() + refWin.size() - 1, isFwd, MATCH::getErrNum(mat), alignment);
+        // the alignment may end before the last letter of the match, each letter left out counts as an error
+        end -= dist - std::count_if(alignment.begin(), alignment.end(), [](const ERROR_T a) { return a != MATCHING; });
+        // deletions at the ends are no part of the alignment
+        size_t first = 0;
+        size_t last = alignment.size();
+        while (first < last && alignment[first] == DELETION)
+            ++first;
+        while (last > first && alignment[last - 1] == DELETION)
+            --last;
+        al.refLen = 0;
+        al.edits = 0;
+        for (size_t i = first; i < last; ++i)
+        {
+            // BAM operation codes M, I, D
+            const uint32_t op = alignment[i] == INSERTION ? 1 : (alignment[i] == DELETION ? 2 : 0);
+            al.refLen += op != 1;
+            al.edits += alignment[i] != MATCHING;
+            if (!al.cigar.empty() && (al.cigar.back() & 0xf) == op)
+                al.cigar.back() += 1 << 4;
+            else
+                al.cigar.push_back((1 << 4) | op);
+        }
+    }
+    // a read overhanging the start of its sequence is not placed
+    if (end + 1 < al.refLen)
+    {
+        al.mapped = false;
+        al.reverse = false;
+        return;
+    }
+    al.pos = ref.chrOffsets[m.chrom] + end + 1 - al.refLen;
+}
+
+void ReadQueue::appendRecord(std::string& out, const Read& r, const AlignPos& al, const AlignPos* mate, const uint16_t pairFlag)
+{
+
+    // the name up to the first white space, without the leading @ and a trailing /1 or /2
+    const char* name = r.id.data();
+    size_t nameLen = r.id.size();
+    if (nameLen && name[0] == '@')
+    {
+        ++name;
+        --nameLen;
+    }
+    nameLen = std::find_if(name, name + nameLen, [](const char c) { return c == ' ' || c == '\t' || c == '\r'; }) - name;
+    if (nameLen > 2 && name[nameLen - 2] == '/' && (name[nameLen - 1] == '1' || name[nameLen - 1] == '2'))
+        nameLen -= 2;
+    // BAM limits names to 254 letters
+    nameLen = std::min<size_t>(nameLen, 254);
+    if (nameLen == 0)
+    {
+        name = "*";
+        nameLen = 1;
+    }
+
+    uint16_t flag = pairFlag;
+    if (!al.mapped)
+        flag |= 0x4;
+    if (al.reverse)
+        flag |= 0x10;
+    int64_t tlen = 0;
+    if (mate != nullptr)
+    {
+        flag |= 0x1;
+        if (!mate->mapped)
+            flag |= 0x8;
+        if (mate->reverse)
+            flag |= 0x20;
+        if (al.mapped && mate->mapped)
+        {
+            flag |= 0x2;
+            // signed distance of the outer ends, positive for the leftmost mate (read 1 on ties)
+            if (al.refId == mate->refId)
+            {
+                const uint64_t beg = std::min(al.pos, mate->pos);
+                const uint64_t fin = std::max(al.pos + al.refLen, mate->pos + mate->refLen);
+                const bool leftmost = al.pos < mate->pos || (al.pos == mate->pos && pairFlag == 0x40);
+                tlen = leftmost ? static_cast<int64_t>(fin - beg) : -static_cast<int64_t>(fin - beg);
+            }
+        }
+    }
+    const SeqView seq = al.reverse ? r.rev : r.seq;
+    const bool mateMapped = mate != nullptr && mate->mapped;
+
+    if (!alignBam)
+    {
+        out.append(name, nameLen);
+        out += '\t' + std::to_string(flag) + '\t';
+        if (al.mapped)
+        {
+            out += alignRefNames[al.refId] + '\t' + std::to_string(al.pos + 1) + '\t' + std::to_string(MyConst::ALIGNMAPQ) + '\t';
+            for (const uint32_t op : al.cigar)
+            {
+                out += std::to_string(op >> 4);
+                out += "MID"[op & 0xf];
+            }
+        } else {
+            out += "*\t0\t0\t*";
+        }
+        out += '\t';
+        if (mateMapped)
+            out += (al.mapped && mate->refId == al.refId ? std::string("=") : alignRefNames[mate->refId]) + '\t' + std::to_string(mate->pos + 1);
+        else
+            out += "*\t0";
+        out += '\t' + std::to_string(tlen) + '\t';
+        out.append(seq.data(), seq.size());
+        out += "\t*";
+        if (al.mapped)
+            out += "\tNM:i:" + std::to_string(al.edits) + (al.convGA ? "\tXG:Z:GA" : "\tXG:Z:CT");
+        out += '\n';
+        return;
+    }
+
+    // BAM record, block_size is filled in at the end
+    const size_t start = out.size();
+    appendLE(out, 0, 4);
+    appendLE(out, al.mapped ? al.refId : -1, 4);
+    appendLE(out, al.mapped ? al.pos : -1, 4);
+    appendLE(out, nameLen + 1, 1);
+    appendLE(out, al.mapped ? MyConst::ALIGNMAPQ : 0, 1);
+    appendLE(out, al.mapped ? bamBin(al.pos, al.pos + std::max<uint32_t>(al.refLen, 1)) : 4680, 2);
+    appendLE(out, al.cigar.size(), 2);
+    appendLE(out, flag, 2);
+    appendLE(out, seq.size(), 4);
+    appendLE(out, mateMapped ? mate->refId : -1, 4);
+    appendLE(out, mateMapped ? mate->pos : -1, 4);
+    appendLE(out, tlen, 4);
+    out.append(name, nameLen);
+    out.push_back('\0');
+    for (const uint32_t op : al.cigar)
+    {
+        appendLE(out, op, 4);
+    }
+    // 4 bit letters, two per byte (=ACMGRSVTWYHKDBN)
+    for (size_t i = 0; i < seq.size(); i += 2)
+    {
+        const auto code = [](const char c) -> uint8_t
+        {
+            return c == 'A' ? 1 : (c == 'C' ? 2 : (c == 'G' ? 4 : (c == 'T' ? 8 : 15)));
+        };
+        out.push_back(static_cast<char>((code(seq[i]) << 4) | (i + 1 < seq.size() ? code(seq[i + 1]) : 0)));
+    }
+    // no base qualities
+    out.append(seq.size(), static_cast<char>(0xff));
+    if (al.mapped)
+    {
+        out += "NMi";
+        appendLE(out, al.edits, 4);
+        out += al.convGA ? "XGZGA" : "XGZCT";
+        out.push_back('\0');
+    }
+    const uint32_t blockSize = out.size() - start - 4;
+    for (unsigned int i = 0; i < 4; ++i)
+    {
+        out[start + i] = static_cast<char>((blockSize >> (8 * i)) & 0xff);
+    }
+}
+
+void ReadQueue::writeCheckpoint(const std::string& path, CHECKPOINT::header& ckpt)
+{
+
+    Profiler::Scope profScope(prof, prof.outputSlot(), Profiler::OUTPUT);
+
+    ckpt.magic = CHECKPOINT::MAGIC;
+    ckpt.version = CHECKPOINT::VERSION;
+    ckpt.paired = isPaired;
+    ckpt.fingerprint = ref.fingerprint();
+    ckpt.fileIdx = inputPos.fileIdx;
+    ckpt.records = inputPos.records;
+    ckpt.offset = inputPos.offset;
+    ckpt.records2 = inputPos.records2;
+    ckpt.offset2 = inputPos.offset2;
+    ckpt.r1FwdMatches = r1FwdMatches;
+    ckpt.r1RevMatches = r1RevMatches;
+    ckpt.matchR1Fwd = matchR1Fwd;
+    ckpt.padding = 0;
+
+    // a checkpoint interrupted while being written must not replace the previous one
+    const std::string tmpPath = path + ".tmp";
+    MethWriter ckptFile;
+    if (!ckptFile.open(tmpPath, false))
+    {
+        std::cerr << "Could not open checkpoint file \"" << tmpPath << "\" for writing, skipping checkpoint\n";
+        return;
+    }
+    ckptFile.write(reinterpret_cast<const char*>(&ckpt), sizeof(ckpt));
+    writeMethLevels(ckptFile, METHFILE::BINARY, -1);
+    ckptFile.close();
+    if (std::rename(tmpPath.c_str(), path.c_str()) != 0)
+    {
+        std::cerr << "Could not move checkpoint to \"" << path << "\"\n";
+        return;
+    }
+    std::cout << "Checkpoint written after " << ckpt.batches << " batches\n";
+}
+
+bool ReadQueue::loadCheckpoint(const std::string& path, CHECKPOINT::header& ckpt)
+{
+
+    std::ifstream in(path, std::ifstream::binary);
+    if (!in.is_open())
+        return false;
+
+    in.read(reinterpret_cast<char*>(&ckpt), sizeof(ckpt));
+    METHFILE::header hdr;
+    in.read(reinterpret_cast<char*>(&hdr), sizeof(hdr));
+    if (!in || ckpt.magic != CHECKPOINT::MAGIC || ckpt.version != CHECKPOINT::VERSION || hdr.magic != METHFILE::MAGIC || hdr.version != METHFILE::VERSION)
+    {
+        std::cerr << "File \"" << path << "\" is no valid checkpoint! Terminating...\n\n";
+        exit(1);
+    }
+    const uint64_t fingerprint = ref.fingerprint();
+    if (ckpt.fingerprint != fingerprint || hdr.fingerprint != fingerprint || hdr.cpgNum != ref.cpgTable.size())
+    {
+        std::cerr << "Checkpoint \"" << path << "\" was written with another index! Terminating...\n\n";
+        exit(1);
+    }
+    if (ckpt.paired != static_cast<uint32_t>(isPaired) || ckpt.fileIdx >= readFiles.size())
+    {
+        std::cerr << "Checkpoint \"" << path << "\" was written for other read files! Terminating...\n\n";
+        exit(1);
+    }
+
+    // chromosome names
+    for (uint32_t c = 0; c < hdr.chrNum; ++c)
+    {
+        uint32_t len;
+        in.ignore(sizeof(chromId));
+        in.read(reinterpret_cast<char*>(&len), sizeof(len));
+        in.ignore(len);
+    }
+    std::vector<METHFILE::record> block(1 << 16);
+    for (size_t start = 0; start < hdr.cpgNum; start += block.size())
+    {
+        const size_t n = std::min<size_t>(block.size(), hdr.cpgNum - start);
+        in.read(reinterpret_cast<char*>(block.data()), sizeof(METHFILE::record) * n);
+        if (static_cast<size_t>(in.gcount()) != sizeof(METHFILE::record) * n)
+        {
+            std::cerr << "Checkpoint \"" << path << "\" is truncated! Terminating...\n\n";
+            exit(1);
+        }
+        for (size_t i = 0; i < n; ++i)
+        {
+            setMethCount(start + i, METHFWD, block[i].methFwd);
+            setMethCount(start + i, UNMETHFWD, block[i].unmethFwd);
+            setMethCount(start + i, METHREV, block[i].methRev);
+            setMethCount(start + i, UNMETHREV, block[i].unmethRev);
+        }
     }
 
-    // sum up counts
-    for (unsigned int i = 0; i < CORENUM; ++i)
+    r1FwdMatches = ckpt.r1FwdMatches;
+    r1RevMatches = ckpt.r1RevMatches;
+    matchR1Fwd = ckpt.matchR1Fwd;
+
+    // continue after the last read of the checkpoint
+    openSample(ckpt.fileIdx);
+    if (!fastq.skipTo(ckpt.offset, ckpt.records) || (isPaired && !interleaved && !fastq2.skipTo(ckpt.offset2, ckpt.records2)))
     {
-        succMatch += matchStats[i];
-        nonUniqueMatch += nonUniqueStats[i];
-        unSuccMatch += noMatchStats[i];
-        succPairedMatch += matchPairedStats[i];
-		tooShortCountMatch += tooShortCounts[i];
+        std::cerr << "Read files end before the position of checkpoint \"" << path << "\"! Terminating...\n\n";
+        exit(1);
     }
+    std::cout << "Resuming from checkpoint \"" << path << "\" after " << ckpt.batches << " batches\n";
     return true;
 }
+void ReadQueue::printSCMethylationLevels(const std::string scID)
+{
 
+	Profiler::Scope profScope(prof, prof.outputSlot(), Profiler::OUTPUT);
 
+	if (scSparse)
+	{
+		printSparseSCMethylationLevels(scID);
+		return;
+	}
 
+	const std::array<METHCOUNTER, 4> counters = {{METHFWD, UNMETHFWD, METHREV, UNMETHREV}};
+	// the last row keeps its historic label
+	const std::array<const char*, 4> labels = {{"\tmethFwd\t", "\tunmethFwd\t", "\tmethRev\t", "\tunmethFwd\t"}};
+	for (unsigned int c = 0; c < 4; ++c)
+	{
+		scOutput.put('\n');
+		scOutput.write(scID);
+		scOutput.write(labels[c], std::strlen(labels[c]));
+		for (size_t cpgID = 0; cpgID < ref.cpgTable.size(); ++cpgID)
+		{
+			scOutput.putUInt(getMethCount(cpgID, counters[c]));
+			scOutput.put('\t');
+			resetMethCount(cpgID, counters[c]);
+		}
+	}
+}
 
-bool ReadQueue::matchSCBatch(const char* scFile, const std::string scId, const bool isGZ)
+void ReadQueue::printSparseSCMethylationLevels(const std::string& scID)
 {
-    unsigned int readCounter = 0;
-    unsigned int i = 0;
-    // counter
-    uint64_t succMatch = 0;
-    uint64_t nonUniqueMatch = 0;
-    uint64_t unSuccMatch = 0;
 
-    if (isGZ)
-    {
+	// ranges of CpGs are disjoint and in order, so sorting each range sorts all touched CpGs
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(CORENUM) schedule(dynamic,1)
+#endif
+	for (unsigned int b = 0; b < CORENUM; ++b)
+	{
+		std::sort(methTouched[b].begin(), methTouched[b].end());
+	}
 
-        igz.open(scFile);
-		if (!igz.good())
+	const std::vector<std::string> chrNames = getChromNames();
+	for (auto& touched : methTouched)
+	{
+		for (const uint32_t cpgID : touched)
 		{
-			std::cerr << "ERROR: Opening file `" << std::string(scFile) << "' failed.\n";
-			return EXIT_FAILURE;
+			scOutput.write(scID);
+			scOutput.put('\t');
+			scOutput.write(chrNames[ref.cpgTable[cpgID].chrom]);
+			scOutput.put('\t');
+			scOutput.putUInt(ref.cpgTable[cpgID].pos + MyConst::READLEN - 2 + ref.chrOffsets[ref.cpgTable[cpgID].chrom]);
+			for (const METHCOUNTER c : {METHFWD, UNMETHFWD, METHREV, UNMETHREV})
+			{
+				scOutput.put('\t');
+				scOutput.putUInt(getMethCount(cpgID, c));
+				resetMethCount(cpgID, c);
+			}
+			scOutput.put('\n');
 		}
+		touched.clear();
+	}
+}
 
-    } else {
-
-        file.open(scFile);
-    }
-	r1FwdMatches = 0;
-	r1RevMatches = 0;
-
+std::vector<std::string> ReadQueue::getChromNames()
+{
 
-    // fill counting structure for parallelization
-    for (unsigned int j = 0; j < CORENUM; ++j)
+    std::vector<std::string> names(ref.chrMap.size());
+    for (const auto& chr : ref.chrMap)
     {
+        names[chr.first] = chr.second;
+    }
+    return names;
+}
 
-        // fwdMetaIDs[j] = google::dense_hash_map<uint32_t, uint16_t, MetaHash>();
-        // revMetaIDs[j] = google::dense_hash_map<uint32_t, uint16_t, MetaHash>();
-        // fwdMetaIDs[j].set_deleted_key(ref.metaWindows.size() + 10);
-        // revMetaIDs[j].set_deleted_key(ref.metaWindows.size() + 10);
-        // fwdMetaIDs[j].set_empty_key(ref.metaWindows.size() + 11);
-        // revMetaIDs[j].set_empty_key(ref.metaWindows.size() + 11);
-		fwdMetaIDs[i] = tsl::hopscotch_map<uint32_t, uint16_t, MetaHash>();
-		revMetaIDs[i] = tsl::hopscotch_map<uint32_t, uint16_t, MetaHash>();
+constexpr uint32_t ReadQueue::NOBIN;
 
-    }
-	if (!bothStrandsFlag)
-	{
-		++i;
-		isGZ ? parseChunkGZ(readCounter) : parseChunk(readCounter);
-		matchReads(readCounter, succMatch, nonUniqueMatch, unSuccMatch, true);
-		decideStrand();
-        std::cout << "Processed " << MyConst::CHUNKSIZE * (i) << " paired reads\n";
-	}
+void ReadQueue::setBins(const uint32_t tileLen, const regionMap& regions)
+{
 
-    while(isGZ ? parseChunkGZ(readCounter) : parseChunk(readCounter))
+    const std::vector<std::string> chrNames = getChromNames();
+    std::unordered_map<std::string, uint32_t> nameIds;
+    std::vector<uint32_t> chrBinIds(chrNames.size());
+    std::vector<uint64_t> chrLens;
+    binChroms.clear();
+    for (chromId c = 0; c < chrNames.size(); ++c)
     {
-        ++i;
-        matchReads(readCounter, succMatch, nonUniqueMatch, unSuccMatch, false);
-        std::cout << "Processed " << MyConst::CHUNKSIZE * (i) << " paired reads\n";
+        const auto ins = nameIds.emplace(chrNames[c], binChroms.size());
+        if (ins.second)
+        {
+            binChroms.push_back(chrNames[c]);
+            chrLens.push_back(0);
+        }
+        chrBinIds[c] = ins.first->second;
+        chrLens[chrBinIds[c]] = std::max<uint64_t>(chrLens[chrBinIds[c]], ref.chrOffsets[c] + ref.fullSeq[c].size());
     }
-    // match remaining reads
-    matchReads(readCounter, succMatch, nonUniqueMatch, unSuccMatch, false);
-	std::cout << "Processed " << MyConst::CHUNKSIZE * (i+1) << " paired reads\n";
-
-	std::cout << "Finished " << std::string(scFile) << "\n\n";
-	std::cout << "\nOverall number of reads for cell " << scId << ": " << MyConst::CHUNKSIZE * i + readCounter;
-    std::cout << "\tOverall successfully matched: " << succMatch << "\n\tUnsuccessfully matched: " << unSuccMatch << "\n\tNonunique matches: " << nonUniqueMatch << "\n";
-	std::cout << "\n\nAlignment rate: " << (double)succMatch/(double)(2*(MyConst::CHUNKSIZE * i + readCounter)) << "\n\n\n";
 
-    if (isGZ)
+    // bins are built along the CpGs in the order of the methylation table
+    const size_t cpgNum = ref.cpgTable.size();
+    const auto posOf = [&](const size_t i) -> uint32_t { return ref.cpgTable[i].pos + MyConst::READLEN - 2 + ref.chrOffsets[ref.cpgTable[i].chrom]; };
+    const std::vector<uint32_t> order = MethWriter::tableOrder(cpgNum,
+            [&](const size_t i) -> const std::string& { return chrNames[ref.cpgTable[i].chrom]; }, posOf);
+    cpgBins.assign(cpgNum, NOBIN);
+    bins.clear();
+    const std::vector<std::pair<uint32_t, uint32_t> > noRegions;
+    size_t k = 0;
+    while (k < cpgNum)
     {
 
-		// if (igz.eof())
-		// {
-		// 	std::cerr << "ERROR: Reading file `" << std::string(scFile) << "' failed.\n";
-		// 	return EXIT_FAILURE;
-		// }
-        igz.close();
-		igz.clear();
-		// if (igz.good())
-		// {
-		// 	std::cerr << "ERROR: Closing file `" << std::string(scFile) << "' failed.\n";
-		// 	return EXIT_FAILURE;
-		// }
+        // CpGs of one chromosome
+        const uint32_t chrom = chrBinIds[ref.cpgTable[order.empty() ? k : order[k]].chrom];
+        const auto chrRegions = regions.find(binChroms[chrom]);
+        const std::vector<std::pair<uint32_t, uint32_t> >& regs = chrRegions == regions.end() ? noRegions : chrRegions->second;
+        size_t r = 0;
+        for (; k < cpgNum; ++k)
+        {
 
-    } else {
+            const size_t cpgID = order.empty() ? k : order[k];
+            if (chrBinIds[ref.cpgTable[cpgID].chrom] != chrom)
+                break;
+            const uint32_t pos = posOf(cpgID);
+            uint32_t start;
+            uint32_t end;
+            if (tileLen > 0)
+            {
+                start = pos - pos % tileLen;
+                end = std::min<uint64_t>(static_cast<uint64_t>(start) + tileLen, chrLens[chrom]);
+
+            } else {
 
-        file.close();
-		file.clear();
+                // regions are sorted and disjoint
+                while (r < regs.size() && regs[r].second <= pos)
+                    ++r;
+                if (r == regs.size() || pos < regs[r].first)
+                    continue;
+                start = regs[r].first;
+                end = regs[r].second;
+            }
+            if (bins.empty() || bins.back().chrom != chrom || bins.back().start != start)
+                bins.push_back({chrom, start, end});
+            cpgBins[cpgID] = bins.size() - 1;
+        }
     }
-	printSCMethylationLevels(scId);
-	return true;
+    binSums.assign(bins.size(), {{0, 0}});
+    binTouched.clear();
+    std::cout << "Aggregating the methylation levels over " << bins.size() << " bins\n";
 }
-bool ReadQueue::matchSCBatchPaired(const char* scFile1, const char* scFile2, const std::string scId, const bool isGZ)
+
+void ReadQueue::collectBins(const bool touchedOnly, std::vector<BINFILE::cellRecord>& recs)
 {
-    unsigned int readCounter = 0;
-    unsigned int i = 0;
-    // counter
-    uint64_t succPairedMatch = 0;
-    uint64_t succMatch = 0;
-    uint64_t nonUniqueMatch = 0;
-    uint64_t unSuccMatch = 0;
-	uint64_t tooShortCount = 0;
 
-    if (isGZ)
+    const auto addCpG = [&](const size_t cpgID)
     {
-
-        igz.open(scFile1);
-        igz2.open(scFile2);
-		if (!igz.good())
-		{
-			std::cerr << "ERROR: Opening file `" << std::string(scFile1) << "' failed.\n";
-			return EXIT_FAILURE;
-		}
-		if (!igz2.good())
-		{
-			std::cerr << "ERROR: Opening file `" << std::string(scFile2) << "' failed.\n";
-			return EXIT_FAILURE;
-		}
+        const uint32_t b = cpgBins[cpgID];
+        if (b == NOBIN)
+            return;
+        const uint64_t meth = getMethCount(cpgID, METHFWD) + getMethCount(cpgID, METHREV);
+        const uint64_t unmeth = getMethCount(cpgID, UNMETHFWD) + getMethCount(cpgID, UNMETHREV);
+        if (meth + unmeth == 0)
+            return;
+        if (binSums[b][0] + binSums[b][1] == 0)
+            binTouched.push_back(b);
+        binSums[b][0] += meth;
+        binSums[b][1] += unmeth;
+    };
+    if (touchedOnly)
+    {
+        for (const auto& touched : methTouched)
+        {
+            for (const uint32_t cpgID : touched)
+                addCpG(cpgID);
+        }
 
     } else {
 
-        file.open(scFile1);
-        file2.open(scFile2);
+        for (size_t cpgID = 0; cpgID < cpgBins.size(); ++cpgID)
+            addCpG(cpgID);
     }
-	r1FwdMatches = 0;
-	r1RevMatches = 0;
 
-    // fill counting structure for parallelization
-    for (unsigned int j = 0; j < CORENUM; ++j)
+    std::sort(binTouched.begin(), binTouched.end());
+    recs.resize(binTouched.size());
+    for (size_t i = 0; i < binTouched.size(); ++i)
     {
-
-		paired_fwdMetaIDs[j] = tsl::hopscotch_map<uint32_t, std::tuple<uint8_t, uint8_t, bool, bool>, MetaHash>();
-		paired_revMetaIDs[j] = tsl::hopscotch_map<uint32_t, std::tuple<uint8_t, uint8_t, bool, bool>, MetaHash>();
+        std::array<uint64_t, 2>& sum = binSums[binTouched[i]];
+        recs[i].bin = binTouched[i];
+        recs[i].meth = std::min<uint64_t>(sum[0], std::numeric_limits<uint32_t>::max());
+        recs[i].unmeth = std::min<uint64_t>(sum[1], std::numeric_limits<uint32_t>::max());
+        sum = {{0, 0}};
     }
-	if (!bothStrandsFlag)
-	{
-		++i;
-		isGZ ? parseChunkGZ(readCounter) : parseChunk(readCounter);
-		matchPairedReads(readCounter, succMatch, nonUniqueMatch, unSuccMatch, succPairedMatch, tooShortCount, true);
-		decideStrand();
-        std::cout << "Processed " << MyConst::CHUNKSIZE * (i) << " paired reads\n";
-	}
+    binTouched.clear();
+}
+
+void ReadQueue::printBins(const std::string& filename)
+{
+
+    if (bins.empty())
+        return;
 
-    while(isGZ ? parseChunkGZ(readCounter) : parseChunk(readCounter))
+    Profiler::Scope profScope(prof, prof.outputSlot(), Profiler::OUTPUT);
+
+    const std::string path = filename + "_bins.bedGraph";
+    MethWriter out;
+    if (!out.open(path, false))
+    {
+        std::cerr << "Could not open file \"" << path << "\" for writing! Terminating...\n\n";
+        exit(1);
+    }
+    std::vector<BINFILE::cellRecord> recs;
+    collectBins(false, recs);
+    out.write("track type=bedGraph name=\"CpG methylation\"\n");
+    char level[32];
+    for (const BINFILE::cellRecord& rec : recs)
     {
-        ++i;
-		// if (i>2)
-		// 	break;
-        matchPairedReads(readCounter, succMatch, nonUniqueMatch, unSuccMatch, succPairedMatch, tooShortCount, false);
-        std::cout << "Processed " << MyConst::CHUNKSIZE * (i) << " paired reads\n";
+        const BINFILE::bin& bin = bins[rec.bin];
+        out.write(binChroms[bin.chrom]);
+        out.put('\t');
+        out.putUInt(bin.start);
+        out.put('\t');
+        out.putUInt(bin.end);
+        out.put('\t');
+        out.write(level, std::snprintf(level, sizeof(level), "%.2f", 100.0 * rec.meth / (static_cast<uint64_t>(rec.meth) + rec.unmeth)));
+        out.put('\n');
     }
-    // match remaining reads
-    matchPairedReads(readCounter, succMatch, nonUniqueMatch, unSuccMatch, succPairedMatch, tooShortCount, false);
-	std::cout << "Processed " << MyConst::CHUNKSIZE * (i+1) << " paired reads\n";
+    out.close();
+    std::cout << "Finished writing the methylation levels of " << recs.size() << " bins to \"" << path << "\"\n\n";
+}
 
-	std::cout << "Finished " << std::string(scFile1) << " + " << std::string(scFile2) << "\n\n";
-	std::cout << "\nOverall number of reads for cell " << scId << ": (2*)" << MyConst::CHUNKSIZE * i + readCounter;
-    std::cout << "\tOverall successfully matched: " << succMatch << "\n\tUnsuccessfully matched: " << unSuccMatch << "\n\tNonunique matches: " << nonUniqueMatch << "\n\nInvalid reads (containing N or too short): " << tooShortCount << "\n\nFully matched pairs: " << succPairedMatch << "\n";
-	std::cout << "\n\nAlignment rate excluding invalid reads: " << succPairedMatch/(MyConst::CHUNKSIZE * i + readCounter - (tooShortCount/2)) << "\n\n\n";
+void ReadQueue::enableDedup()
+{
 
-    if (isGZ)
-    {
+    dedup = true;
+    dedupReads.assign(CORENUM, std::vector<DedupRead>());
+    dedupSeen.assign(CORENUM, tsl::hopscotch_set<DedupKey, DedupHash>());
+    dedupShardKeys.assign(CORENUM, std::vector<std::vector<std::tuple<DedupKey, uint32_t, uint32_t> > >(CORENUM));
+}
 
-		// if (igz.eof())
-		// {
-		// 	std::cerr << "ERROR: Reading file `" << std::string(scFile1) << "' failed.\n";
-		// 	return EXIT_FAILURE;
-		// }
-		// if (igz2.eof())
-		// {
-		// 	std::cerr << "ERROR: Reading file `" << std::string(scFile2) << "' failed.\n";
-		// 	return EXIT_FAILURE;
-		// }
-        igz.close();
-        igz2.close();
-		igz.clear();
-		igz2.clear();
-		// if (igz.good())
-		// {
-		// 	std::cerr << "ERROR: Closing file `" << std::string(scFile1) << "' failed.\n";
-		// 	return EXIT_FAILURE;
-		// }
-		// if (igz2.good())
-		// {
-		// 	std::cerr << "ERROR: Closing file `" << std::string(scFile2) << "' failed.\n";
-		// 	return EXIT_FAILURE;
-		// }
+template <size_t E>
+void ReadQueue::countUnique()
+{
 
-    } else {
+    // 5' position of a read with its strands: the start of the match for a read matched as it is, the end for a
+    // read matched as reverse complement; the ends are not moved by trimming at the 3' end
+    const auto fivePrime = [&](const DedupRead& d, const size_t len)
+    {
+        const metaWindow& m = ref.metaWindows[MATCH::getMetaID(d.mat)];
+        const uint64_t end = static_cast<uint64_t>(m.startPos) + MATCH::getOffset(d.mat);
+        const uint64_t pos = d.revComp ? end : end + 1 - std::min<uint64_t>(len, end + 1);
+        return (static_cast<uint64_t>(m.chrom) << 40) | (pos << 2) | (d.revComp << 1) | MATCH::isFwd(d.mat);
+    };
 
-        file.close();
-        file2.close();
-		file.clear();
-		file2.clear();
+    // 1. keys of the deferred reads (pairs), sorted into the shards
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(CORENUM) schedule(static,1)
+#endif
+    for (unsigned int t = 0; t < CORENUM; ++t)
+    {
+        std::vector<DedupRead>& reads = dedupReads[t];
+        for (uint32_t k = 0; k < reads.size(); ++k)
+        {
+            DedupRead& d = reads[k];
+            d.keep = false;
+            DedupKey key;
+            key.cell = isSC ? readCells[d.read] : 0;
+            key.pos = fivePrime(d, readBuffer[d.read].seq.size());
+            key.matePos = std::numeric_limits<uint64_t>::max();
+            if ((d.flags & READCALLS::PAIRED) && k + 1 < reads.size() && reads[k + 1].read == d.read)
+                key.matePos = fivePrime(reads[k + 1], readBuffer2[d.read].seq.size());
+            dedupShardKeys[t][DedupHash()(key) % CORENUM].emplace_back(key, t, k);
+            if (key.matePos != std::numeric_limits<uint64_t>::max())
+                ++k;
+        }
     }
-	printSCMethylationLevels(scId);
-	return true;
-}
 
+    // 2. every shard takes the keys in the order of the reads, the first read of a key is kept
+    std::vector<uint64_t> shardDups(CORENUM, 0);
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(CORENUM) schedule(dynamic,1)
+#endif
+    for (unsigned int s = 0; s < CORENUM; ++s)
+    {
+        std::vector<std::tuple<DedupKey, uint32_t, uint32_t> > keys;
+        for (unsigned int t = 0; t < CORENUM; ++t)
+        {
+            keys.insert(keys.end(), dedupShardKeys[t][s].begin(), dedupShardKeys[t][s].end());
+            dedupShardKeys[t][s].clear();
+        }
+        std::sort(keys.begin(), keys.end(), [&](const std::tuple<DedupKey, uint32_t, uint32_t>& a, const std::tuple<DedupKey, uint32_t, uint32_t>& b)
+        {
+            return dedupReads[std::get<1>(a)][std::get<2>(a)].read < dedupReads[std::get<1>(b)][std::get<2>(b)].read;
+        });
+        for (const auto& key : keys)
+        {
+            DedupRead& d = dedupReads[std::get<1>(key)][std::get<2>(key)];
+            d.keep = dedupSeen[s].insert(std::get<0>(key)).second;
+            // the reads collapsed into d are identical to it, i.e. duplicates as well
+            shardDups[s] += d.keep ? d.weight - 1 : d.weight;
+        }
+    }
+    for (const uint64_t n : shardDups)
+        dupCount += n;
 
+    // 3. count the kept reads
+    dedupPass = true;
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(CORENUM) schedule(dynamic,1)
+#endif
+    for (unsigned int t = 0; t < CORENUM; ++t)
+    {
+        const int threadnum = omp_get_thread_num();
+        std::vector<DedupRead>& reads = dedupReads[t];
+        for (uint32_t k = 0; k < reads.size(); ++k)
+        {
+            DedupRead& d = reads[k];
+            const bool paired = (d.flags & READCALLS::PAIRED) && k + 1 < reads.size() && reads[k + 1].read == d.read;
+            if (d.keep)
+            {
+                if (isSC)
+                    threadCell[threadnum] = readCells[d.read];
+                threadWeight[threadnum] = 1;
+                for (uint32_t mate = 0; mate < (paired ? 2u : 1u); ++mate)
+                {
+                    DedupRead& m = reads[k + mate];
+                    Read& r = mate == 0 ? readBuffer[m.read] : readBuffer2[m.read];
+                    threadReadFlags[threadnum] = m.flags;
+                    computeMethLvl<E>(m.mat, m.revComp ? r.rev : r.seq, m.revComp);
+                }
+            }
+            if (paired)
+                ++k;
+        }
+        reads.clear();
+    }
+    dedupPass = false;
+}
 
+void ReadQueue::openQc(const std::string& path)
+{
 
+    // fail early on an unwritable path instead of after the alignment
+    std::ofstream test(path);
+    if (!test)
+    {
+        std::cerr << "Could not open file \"" << path << "\" for the QC report! Terminating...\n\n";
+        exit(1);
+    }
+    qcPath = path;
+    qcCounts.assign(CORENUM, QcCounts());
+    for (QcCounts& qc : qcCounts)
+    {
+        qc.conversion.assign(ref.chrMap.size(), {{0, 0}});
+    }
+    // the alignments are computed as for the context calls
+    ctxAlignBuf.resize(CORENUM);
+}
 
-void ReadQueue::printMethylationLevels(std::string& filename)
+void ReadQueue::writeQc()
 {
 
-    std::cout << "\nStart writing Methylation levels to \"" << filename << "_cpg.tsv\"\n\n";
-	std::ofstream cpgFile(filename + "_cpg.tsv");
+    if (qcCounts.empty())
+        return;
 
-    // go over remaining CpGs
-    for (size_t cpgID = 0; cpgID < ref.cpgTable.size(); ++cpgID)
+    // sums of all threads, a histogram of a thread covers the values it has seen
+    const auto addHist = [](std::vector<uint64_t>& sum, const std::vector<uint64_t>& hist)
     {
+        if (sum.size() < hist.size())
+            sum.resize(hist.size(), 0);
+        for (size_t i = 0; i < hist.size(); ++i)
+            sum[i] += hist[i];
+    };
+    QcCounts all;
+    const std::vector<std::string> chrNames = getChromNames();
+    // the sequences of a targeted index named after the same chromosome are one chromosome
+    std::vector<std::string> convNames;
+    std::unordered_map<std::string, size_t> convIds;
+    for (const std::string& name : chrNames)
+    {
+        if (convIds.emplace(name, convNames.size()).second)
+            convNames.push_back(name);
+    }
+    all.conversion.assign(convNames.size(), {{0, 0}});
+    for (const QcCounts& qc : qcCounts)
+    {
+        for (unsigned int mate = 0; mate < 2; ++mate)
+        {
+            if (all.mbias[mate].size() < qc.mbias[mate].size())
+                all.mbias[mate].resize(qc.mbias[mate].size(), {{0, 0}});
+            for (size_t i = 0; i < qc.mbias[mate].size(); ++i)
+            {
+                all.mbias[mate][i][0] += qc.mbias[mate][i][0];
+                all.mbias[mate][i][1] += qc.mbias[mate][i][1];
+            }
+            addHist(all.readLens[mate], qc.readLens[mate]);
+            addHist(all.readErrs[mate], qc.readErrs[mate]);
+        }
+        for (chromId c = 0; c < qc.conversion.size(); ++c)
+        {
+            all.conversion[convIds[chrNames[c]]][0] += qc.conversion[c][0];
+            all.conversion[convIds[chrNames[c]]][1] += qc.conversion[c][1];
+        }
+        addHist(all.insertSizes, qc.insertSizes);
+    }
 
-		// if (methLevels[cpgID].methFwd + methLevels[cpgID].unmethFwd == 0)
-		// {
-		// 	of << "Unmapped CpG fwd: " << ref.chrMap[ref.cpgTable[cpgID].chrom] << "\t" << ref.cpgTable[cpgID].pos + MyConst::READLEN - 2 << "\n";
-		// 	of << std::string(ref.fullSeq[ref.cpgTable[cpgID].chrom].begin() + ref.cpgTable[cpgID].pos, std::min(ref.fullSeq[ref.cpgTable[cpgID].chrom].begin() + ref.cpgTable[cpgID].pos + 2*MyConst::READLEN, ref.fullSeq[ref.cpgTable[cpgID].chrom].end())) << "\n\n";
-		// }
-		// if (methLevels[cpgID].methRev + methLevels[cpgID].unmethRev == 0)
-		// {
-		// 	of << "Unmapped CpG rev: " << ref.chrMap[ref.cpgTable[cpgID].chrom] << "\t" << ref.cpgTable[cpgID].pos + MyConst::READLEN - 2 << "\n";
-		// 	of << std::string(ref.fullSeq[ref.cpgTable[cpgID].chrom].begin() + ref.cpgTable[cpgID].pos, std::min(ref.fullSeq[ref.cpgTable[cpgID].chrom].begin() + ref.cpgTable[cpgID].pos + 2*MyConst::READLEN, ref.fullSeq[ref.cpgTable[cpgID].chrom].end())) << "\n\n";
-		// }
-        // print the position of the (C of the) CpG
-        cpgFile << ref.chrMap[ref.cpgTable[cpgID].chrom] << "\t" << ref.cpgTable[cpgID].pos + MyConst::READLEN - 2 << "\t";
+    const auto ratio = [](const uint64_t a, const uint64_t b) { return a + b > 0 ? static_cast<double>(a) / (a + b) : 0.0; };
+    std::ofstream report(qcPath);
+    const unsigned int mates = isPaired ? 2 : 1;
+    uint64_t meth = 0;
+    uint64_t unmeth = 0;
+    uint64_t unconv = 0;
+    uint64_t conv = 0;
+    for (unsigned int mate = 0; mate < mates; ++mate)
+    {
+        for (const std::array<uint64_t, 2>& cnt : all.mbias[mate])
+        {
+            meth += cnt[0];
+            unmeth += cnt[1];
+        }
+    }
+    for (const std::array<uint64_t, 2>& cnt : all.conversion)
+    {
+        unconv += cnt[0];
+        conv += cnt[1];
+    }
+    report << "#type\tname\tvalue\n";
+    for (unsigned int mate = 0; mate < mates; ++mate)
+    {
+        uint64_t reads = 0;
+        for (const uint64_t n : all.readLens[mate])
+            reads += n;
+        report << "summary\taligned_reads_mate" << mate + 1 << "\t" << reads << "\n";
+    }
+    report << "summary\tcpg_methylation\t" << ratio(meth, unmeth) << "\n";
+    report << "summary\tnon_cpg_conversion\t" << ratio(conv, unconv) << "\n";
 
-        // print the counts
-        // fwd counts
-        cpgFile << methLevels[cpgID].methFwd << "\t" << methLevels[cpgID].unmethFwd << "\t";
-        // rev counts
-        cpgFile << methLevels[cpgID].methRev << "\t" << methLevels[cpgID].unmethRev << "\n";
+    // positions are one based as in the usual M-bias plots
+    report << "#type\tmate\tposition\tmethylated\tunmethylated\tmethylation\n";
+    for (unsigned int mate = 0; mate < mates; ++mate)
+    {
+        for (size_t i = 0; i < all.mbias[mate].size(); ++i)
+        {
+            const std::array<uint64_t, 2>& cnt = all.mbias[mate][i];
+            report << "mbias\t" << mate + 1 << "\t" << i + 1 << "\t" << cnt[0] << "\t" << cnt[1] << "\t" << ratio(cnt[0], cnt[1]) << "\n";
+        }
+    }
+    report << "#type\tchromosome\tunconverted\tconverted\tconversion\n";
+    for (size_t c = 0; c < convNames.size(); ++c)
+    {
+        const std::array<uint64_t, 2>& cnt = all.conversion[c];
+        if ((cnt[0] | cnt[1]) == 0)
+            continue;
+        report << "conversion\t" << convNames[c] << "\t" << cnt[0] << "\t" << cnt[1] << "\t" << ratio(cnt[1], cnt[0]) << "\n";
+    }
+    report << "#type\tname\tvalue\tcount\n";
+    const auto writeHist = [&](const std::string& name, const std::vector<uint64_t>& hist)
+    {
+        for (size_t i = 0; i < hist.size(); ++i)
+        {
+            if (hist[i] > 0)
+                report << "hist\t" << name << "\t" << i << "\t" << hist[i] << "\n";
+        }
+    };
+    for (unsigned int mate = 0; mate < mates; ++mate)
+    {
+        writeHist("read_length_mate" + std::to_string(mate + 1), all.readLens[mate]);
+        writeHist("match_errors_mate" + std::to_string(mate + 1), all.readErrs[mate]);
+    }
+    writeHist("insert_size", all.insertSizes);
+    report.close();
+    if (!report)
+    {
+        std::cerr << "Could not write QC report to \"" << qcPath << "\"! Terminating...\n\n";
+        exit(1);
+    }
+    std::cout << "QC report written to \"" << qcPath << "\"\n";
+}
 
+void ReadQueue::enableContextCalls()
+{
 
-    }
-    cpgFile.close();
-    std::cout << "Finished writing methylation levels to file\n\n";
+    ref.buildContextSites();
+    ctxLevels.assign(ref.ctxSites.size(), {{0, 0}});
+    ctxBucketSize = ref.ctxSites.size() / CORENUM + 1;
+    ctxEvents.assign(CORENUM, std::vector<std::vector<uint64_t> >(CORENUM));
+    ctxAlignBuf.resize(CORENUM);
 }
-void ReadQueue::printSCMethylationLevels(const std::string scID)
+
+void ReadQueue::printContextLevels(const std::string& filename, const METHFILE::FORMAT fmt)
 {
 
-	scOutput << "\n" << scID << "\tmethFwd\t";
-    for (size_t cpgID = 0; cpgID < ref.cpgTable.size(); ++cpgID)
+    if (ctxLevels.empty())
+        return;
+
+    Profiler::Scope profScope(prof, prof.outputSlot(), Profiler::OUTPUT);
+
+    std::string path = filename + "_context.tsv";
+    if (fmt == METHFILE::BGZF)
+        path += ".gz";
+    MethWriter out;
+    if (!out.open(path, fmt == METHFILE::BGZF, fmt == METHFILE::BGZF))
     {
-        scOutput << methLevels[cpgID].methFwd << "\t";
-		methLevels[cpgID].methFwd = 0;
+        std::cerr << "Could not open file \"" << path << "\" for writing! Terminating...\n\n";
+        exit(1);
     }
-	scOutput << "\n" << scID << "\tunmethFwd\t";
-    for (size_t cpgID = 0; cpgID < ref.cpgTable.size(); ++cpgID)
+
+    // sequences in the order of the methylation table, the sequences of a targeted index named after the same
+    // chromosome are disjoint and follow each other by their offset
+    const std::vector<std::string> chrNames = getChromNames();
+    std::unordered_map<std::string, size_t> nameRanks;
+    std::vector<size_t> chrRanks(chrNames.size());
+    for (const struct CpG& cpg : ref.cpgTable)
     {
-        scOutput << methLevels[cpgID].unmethFwd << "\t";
-		methLevels[cpgID].unmethFwd = 0;
+        nameRanks.emplace(chrNames[cpg.chrom], nameRanks.size());
     }
-	scOutput << "\n" << scID << "\tmethRev\t";
-    for (size_t cpgID = 0; cpgID < ref.cpgTable.size(); ++cpgID)
+    for (chromId c = 0; c < chrNames.size(); ++c)
     {
-        scOutput << methLevels[cpgID].methRev << "\t";
-		methLevels[cpgID].methRev = 0;
+        chrRanks[c] = nameRanks.emplace(chrNames[c], nameRanks.size()).first->second;
     }
-	scOutput << "\n" << scID << "\tunmethFwd\t";
-    for (size_t cpgID = 0; cpgID < ref.cpgTable.size(); ++cpgID)
+    std::vector<chromId> chrOrder(chrNames.size());
+    std::iota(chrOrder.begin(), chrOrder.end(), 0);
+    std::sort(chrOrder.begin(), chrOrder.end(), [&](const chromId a, const chromId b)
+    {
+        return chrRanks[a] < chrRanks[b] || (chrRanks[a] == chrRanks[b] && ref.chrOffsets[a] < ref.chrOffsets[b]);
+    });
+
+    uint64_t covered = 0;
+    for (const chromId c : chrOrder)
+    {
+        const std::string& name = chrNames[c];
+        for (uint64_t s = ref.ctxStart[c]; s < ref.ctxStart[c + 1]; ++s)
+        {
+            const std::array<uint32_t, 2>& cnt = ctxLevels[s];
+            if ((cnt[0] | cnt[1]) == 0)
+                continue;
+            const uint8_t type = ref.ctxTypes[s];
+            out.write(name);
+            out.put('\t');
+            out.putUInt(ref.ctxSites[s] + ref.chrOffsets[c]);
+            out.write(type & RefGenome::CTX_REV ? "\t-\t" : "\t+\t", 3);
+            out.write(type & RefGenome::CTX_CHH ? "CHH\t" : "CHG\t", 4);
+            out.putUInt(cnt[0]);
+            out.put('\t');
+            out.putUInt(cnt[1]);
+            out.put('\n');
+            ++covered;
+        }
+    }
+    out.close();
+    std::cout << "Finished writing the counts of " << covered << " non CpG sites to \"" << path << "\"\n\n";
+}
+
+void ReadQueue::openBinMatrix(const std::string& filename)
+{
+
+    const std::string path = filename + "_bins.bin";
+    if (!binMatrix.open(path, false))
+    {
+        std::cerr << "Could not open file \"" << path << "\" for writing! Terminating...\n\n";
+        exit(1);
+    }
+    BINFILE::header hdr;
+    hdr.magic = BINFILE::MAGIC;
+    hdr.version = BINFILE::VERSION;
+    hdr.chrNum = binChroms.size();
+    hdr.binNum = bins.size();
+    hdr.fingerprint = ref.fingerprint();
+    binMatrix.write(reinterpret_cast<const char*>(&hdr), sizeof(hdr));
+    for (const std::string& name : binChroms)
     {
-        scOutput << methLevels[cpgID].unmethRev << "\t";
-		methLevels[cpgID].unmethRev = 0;
+        const uint32_t len = name.size();
+        binMatrix.write(reinterpret_cast<const char*>(&len), sizeof(len));
+        binMatrix.write(name);
     }
+    binMatrix.write(reinterpret_cast<const char*>(bins.data()), sizeof(BINFILE::bin) * bins.size());
 }
 
 
@@ -1895,214 +4158,207 @@ void ReadQueue::printSCMethylationLevels(const std::string scID)
 
 
 
-inline int ReadQueue::saQuerySeedSetRef(ShiftAnd<MyConst::MISCOUNT + MyConst::ADDMIS>& sa, MATCH::match& mat, uint16_t& qThreshold)
+template <size_t E>
+inline int ReadQueue::saQuerySeedSetRef(ShiftAnd<E>& sa, const PackedSeq& pat, const PackedSeq& patRc, MATCH::match& mat, uint16_t& qThreshold)
 {
+	Profiler::Scope profScope(prof, omp_get_thread_num(), Profiler::SHIFTAND);
 
-	// use counters to flag what has been processed so far
-	auto& fwdMetaIDs_t = fwdMetaIDs[omp_get_thread_num()];
-	auto& revMetaIDs_t = revMetaIDs[omp_get_thread_num()];
+	// too many windows to verify, such reads are rarely unique
+	if (MyConst::candidateBudget && overCandidateBudget(qThreshold))
+	{
+		mat = 0;
+		return -1;
+	}
 
 	// counter for how often we had a match
-	std::array<uint8_t, MyConst::ADDMIS + MyConst::MISCOUNT + 1> multiMatch;
+	std::array<uint8_t, E + 1> multiMatch;
 	multiMatch.fill(0);
 
 	// will contain matches iff match is found for number of errors specified by index
-	std::array<MATCH::match, MyConst::ADDMIS + MyConst::MISCOUNT + 1> uniqueMatches;
+	std::array<MATCH::match, E + 1> uniqueMatches;
 	// store the last match found in current MetaCpG
-	uint8_t prevChr = 0;
+	chromId prevChr = 0;
 	uint64_t prevOff = 0xffffffffffffffffULL;
 
-
-	// check all fwd meta CpGs
-	for (const auto& m : fwdMetaIDs_t)
+	// windows that need to be verified and the per lane state of the vectorized shift and queries
+	std::vector<uint32_t>& candidates = candidateBuf[omp_get_thread_num()];
+	std::array<PackedSeq::const_iterator, SALANES> startIts;
+	std::array<PackedSeq::const_iterator, SALANES> endIts;
+	std::array<std::vector<uint64_t>, SALANES>& laneMatchings = laneMatchBuf[omp_get_thread_num()];
+	std::array<std::vector<uint8_t>, SALANES>& laneErrors = laneErrBuf[omp_get_thread_num()];
+	// window offset of the first letter each lane verifies
+	std::array<int32_t, SALANES> laneBase;
+
+	// adaptive error bound (see MyConst::adaptiveErrors): only the matches with the fewest errors decide the
+	// result, so windows are searched for at most one error more than the best match found so far
+	auto shrinkErrorBound = [&]()
 	{
-		// apply qgram lemma
-		if (m.second < qThreshold)
-			continue;
-
-		auto startIt = ref.fullSeq[ref.metaWindows[m.first].chrom].begin() + ref.metaWindows[m.first].startPos;
-		auto endIt = ref.fullSeq[ref.metaWindows[m.first].chrom].begin() + ref.metaWindows[m.first].startPos + MyConst::WINLEN + MyConst::MISCOUNT + MyConst::ADDMIS - 1;
-
-		// check if CpG was too near to the end
-		if (endIt > ref.fullSeq[ref.metaWindows[m.first].chrom].end())
+		for (size_t e = 0; e + 1 < sa.errorBound(); ++e)
 		{
-			endIt = ref.fullSeq[ref.metaWindows[m.first].chrom].end();
+			if (multiMatch[e])
+			{
+				sa.setErrorBound(e + 1);
+				return;
+			}
 		}
+	};
 
-		// use shift and to find all matchings
-		std::vector<uint64_t> matchings;
-		std::vector<uint8_t> errors;
-		sa.querySeq(startIt, endIt, matchings, errors);
-
-		size_t i = 0;
-		// compare first found match with last found match of previous meta CpG
-		if (matchings.size() > 0)
+	// check all fwd meta CpGs, then all rev ones
+	for (const bool isFwd : {true, false})
+	{
+		// use counters to flag what has been processed so far
+		MetaCounter& metaIDs_t = isFwd ? fwdMetaIDs[omp_get_thread_num()] : revMetaIDs[omp_get_thread_num()];
+		// collect all windows that pass the qgram lemma, they are queried SALANES at a time
+		candidates.clear();
+		for (const uint32_t metaId : metaIDs_t.ids())
 		{
-			// compare chromosome and offset
-			if (matchings[0] + ref.metaWindows[m.first].startPos == prevOff && ref.metaWindows[m.first].chrom == prevChr)
-			{
-				++i;
-			}
+			if (metaIDs_t.count(metaId) >= qThreshold)
+				candidates.push_back(metaId);
 		}
-		// go through matching and see if we had such a match (with that many errors) before - if so,
-		// return to caller reporting no match
-		for (; i < matchings.size(); ++i)
+		prof.hist(omp_get_thread_num(), Profiler::CANDIDATES, candidates.size());
+		// windows in order, such that matches in the overlap of neighbouring windows are recognized
+		std::sort(candidates.begin(), candidates.end());
+		prevChr = 0;
+		prevOff = 0xffffffffffffffffULL;
+		// with interleaved reads (see MyConst::interleave) the letters of the next lanes are prefetched
+		// while the current ones are verified
+		const bool prefetchLanes = MyConst::interleave > 1 && !ref.hasWindowRecords();
+		auto prefetchGroup = [&](const size_t first)
 		{
-
-			// check if we had a match with that many errors before
-			if (multiMatch[errors[i]])
+			for (size_t n = first; n < std::min(first + SALANES, candidates.size()); ++n)
+				prefetchWindow(candidates[n], scanRange(metaIDs_t, candidates[n], sa.size(), isFwd));
+		};
+		if (prefetchLanes)
+			prefetchGroup(0);
+		for (size_t c = 0; c < candidates.size(); c += SALANES)
+		{
+			const size_t lanes = std::min(SALANES, candidates.size() - c);
+			bool needsQuery = false;
+			if (prefetchLanes)
+				prefetchGroup(c + SALANES);
+			for (size_t l = 0; l < lanes; ++l)
 			{
-
-				MATCH::match& match_2 = uniqueMatches[errors[i]];
-				const bool isStart = MATCH::isStart(match_2);
-				const bool isFwd = MATCH::isFwd(match_2);
-				// check if same k-mer (borders of meta CpGs)
-				if (isFwd && !isStart && ref.metaWindows[MATCH::getMetaID(match_2)].startPos + MATCH::getOffset(match_2) == ref.metaWindows[m.first].startPos + matchings[i])
+				const metaWindow& w = ref.metaWindows[candidates[c + l]];
+				laneMatchings[l].clear();
+				laneErrors[l].clear();
+				// exact match fast path: a match without errors at the position predicted by all seeds of the
+				// window is taken as its result, any other match in the window has errors and cannot change the result
+				const int32_t exactEnd = exactMatchEnd<E>(metaIDs_t, candidates[c + l], isFwd ? pat : patRc, sa.size(), isFwd);
+				if (exactEnd >= 0)
 				{
+					laneBase[l] = 0;
+					laneMatchings[l].push_back(exactEnd);
+					laneErrors[l].push_back(0);
+					startIts[l] = endIts[l] = ref.fullSeq[w.chrom].begin();
 					continue;
-
-				} else {
-
-					// check if this is a match without errors
-					if (!errors[i])
-					{
-
-						// if so, return without a match
-						return -1;
-
-					}
-					// set the number of matches with that many errors to 2
-					// indicating that we do not have a unique match with that many errors
-					multiMatch[errors[i]] = 2;
 				}
-
-
-			} else {
-
-				// update qgram lemma
-				// uint16_t newQ = sa.size() - MyConst::KMERLEN - (MyConst::KMERLEN * errors[i]);
-				// check for overflow and if we improved old q
-				// if (newQ < sa.size() && newQ > qThreshold)
-				// 	qThreshold = newQ;
-
-
-				// we don't have such a match yet,
-				// so save this match at the correct position
-				uniqueMatches[errors[i]] = MATCH::constructMatch(matchings[i], errors[i], 1, 0, m.first);
-				multiMatch[errors[i]] = 1;
+				needsQuery = true;
+				const std::pair<int32_t, int32_t> range = scanRange(metaIDs_t, candidates[c + l], sa.size(), isFwd);
+				laneBase[l] = range.first;
+				windowSlice(candidates[c + l], range, isFwd, startIts[l], endIts[l]);
 			}
-		}
-		if (matchings.size() > 0)
-		{
-
-			prevChr = ref.metaWindows[m.first].chrom;
-			prevOff = ref.metaWindows[m.first].startPos + matchings[matchings.size() - 1];
 
-		} else {
+			// use shift and to find all matchings
+			if (MyConst::adaptiveErrors)
+				shrinkErrorBound();
+			if (needsQuery)
+			{
+				if (isFwd)
+					sa.querySeqMulti(startIts, endIts, lanes, laneMatchings, laneErrors);
+				else
+					sa.queryRevSeqMulti(startIts, endIts, lanes, laneMatchings, laneErrors);
+			}
 
-			prevChr = 0;
-			prevOff = 0xffffffffffffffffULL;
+			for (size_t l = 0; l < lanes; ++l)
+			{
+				// matchings relative to the window
+				for (uint64_t& m : laneMatchings[l])
+					m += laneBase[l];
+				if (!addWindowMatches<E>(candidates[c + l], isFwd, laneMatchings[l].data(), laneErrors[l].data(), laneMatchings[l].size(), multiMatch, uniqueMatches, prevChr, prevOff))
+					return -1;
+			}
 		}
 	}
-	prevChr = 0;
-	prevOff = 0xffffffffffffffffULL;
-	// go through reverse sequences
-	for (const auto& m : revMetaIDs_t)
-	{
-
-		// apply qgram lemma
-		if (m.second < qThreshold)
-			continue;
+	return uniqueMatchResult<E>(multiMatch, uniqueMatches, mat);
+}
 
-		// retrieve sequence
-		auto endIt = ref.fullSeq[ref.metaWindows[m.first].chrom].begin();
 
-		if (ref.metaWindows[m.first].startPos > 0)
+template <size_t E>
+inline bool ReadQueue::addWindowMatches(const uint32_t mId, const bool isFwd, const uint64_t* matchings, const uint8_t* errors, const size_t n, std::array<uint8_t, E + 1>& multiMatch, std::array<MATCH::match, E + 1>& uniqueMatches, chromId& prevChr, uint64_t& prevOff)
+{
+	const metaWindow& w = ref.metaWindows[mId];
+	if (MyConst::tieredErrors)
+	{
+		for (size_t j = 0; j < n; ++j)
+			tierOverlap[omp_get_thread_num()] |= inWindowOverlap(matchings[j]);
+	}
+	size_t i = 0;
+	// compare first found match with last found match of previous meta CpG
+	if (n > 0)
+	{
+		// compare chromosome and offset
+		if (matchings[0] + w.startPos == prevOff && w.chrom == prevChr)
 		{
-			endIt += ref.metaWindows[m.first].startPos - 1;
+			++i;
 		}
+	}
+	// go through matching and see if we had such a match (with that many errors) before - if so,
+	// report no match to the caller
+	for (; i < n; ++i)
+	{
 
-		auto startIt = ref.fullSeq[ref.metaWindows[m.first].chrom].begin() + ref.metaWindows[m.first].startPos + MyConst::WINLEN + MyConst::MISCOUNT + MyConst::ADDMIS - 1;
-		if (startIt >= ref.fullSeq[ref.metaWindows[m.first].chrom].end())
+		// check if we had a match with that many errors before
+		if (multiMatch[errors[i]])
 		{
-			startIt = ref.fullSeq[ref.metaWindows[m.first].chrom].end() - 1;
-		}
-
-		// use shift and to find all matchings
-		std::vector<uint64_t> matchings;
-		std::vector<uint8_t> errors;
-		sa.queryRevSeq(startIt, endIt, matchings, errors);
 
-		size_t i = 0;
-		// compare first found match with last found match of previous meta CpG
-		if (matchings.size() > 0)
-		{
-			// compare chromosome and offset
-			if (matchings[0] + ref.metaWindows[m.first].startPos == prevOff && ref.metaWindows[m.first].chrom == prevChr)
+			MATCH::match& match_2 = uniqueMatches[errors[i]];
+			// check if same k-mer (borders of meta CpGs)
+			if (MATCH::isFwd(match_2) == isFwd && !MATCH::isStart(match_2) && ref.metaWindows[MATCH::getMetaID(match_2)].startPos + MATCH::getOffset(match_2) == w.startPos + matchings[i])
 			{
-				++i;
-			}
-		}
-		// go through matching and see if we had such a match (with that many errors) before - if so,
-		// return to caller reporting no match
-		for (; i < matchings.size(); ++i)
-		{
+				continue;
 
-			// check if we had a match with that many errors before
-			if (multiMatch[errors[i]])
-			{
+			} else {
 
-				MATCH::match& match_2 = uniqueMatches[errors[i]];
-				const bool isStart = MATCH::isStart(match_2);
-				const bool isFwd = MATCH::isFwd(match_2);
-				// check if same k-mer (borders of meta CpGs)
-				if (!isFwd && !isStart && ref.metaWindows[MATCH::getMetaID(match_2)].startPos + MATCH::getOffset(match_2) == ref.metaWindows[m.first].startPos + matchings[i])
+				// check if this is a match without errors
+				if (!errors[i])
 				{
-					continue;
-
-				} else {
-
-					// check if this is a match without errors
-					if (!errors[i])
-					{
 
-						// if so, return without a match
-						return -1;
+					// if so, there is no unique match
+					return false;
 
-					}
-					// set the number of matches with that many errors to 2
-					// indicating that we do not have a unique match with that many errors
-					multiMatch[errors[i]] = 2;
 				}
+				// set the number of matches with that many errors to 2
+				// indicating that we do not have a unique match with that many errors
+				multiMatch[errors[i]] = 2;
+			}
 
 
-			} else {
-
-				// update qgram lemma
-				// uint16_t newQ = sa.size() - MyConst::KMERLEN - (MyConst::KMERLEN * errors[i]);
-				// check for overflow and if we improved old q
-				// if (newQ < sa.size() && newQ > qThreshold)
-				// 	qThreshold = newQ;
+		} else {
 
-				// we don't have such a match yet,
-				// so save this match at the correct position
-				uniqueMatches[errors[i]] = MATCH::constructMatch(matchings[i], errors[i], 0, 0, m.first);
-				multiMatch[errors[i]] = 1;
-			}
+			// we don't have such a match yet,
+			// so save this match at the correct position
+			uniqueMatches[errors[i]] = MATCH::constructMatch(matchings[i], errors[i], isFwd ? 1 : 0, 0, mId);
+			multiMatch[errors[i]] = 1;
 		}
-		if (matchings.size() > 0)
-		{
+	}
+	if (n > 0)
+	{
 
-			prevChr = ref.metaWindows[m.first].chrom;
-			prevOff = ref.metaWindows[m.first].startPos + matchings[matchings.size() - 1];
+		prevChr = w.chrom;
+		prevOff = w.startPos + matchings[n - 1];
 
-		} else {
+	} else {
 
-			prevChr = 0;
-			prevOff = 0xffffffffffffffffULL;
-		}
+		prevChr = 0;
+		prevOff = 0xffffffffffffffffULL;
 	}
+	return true;
+}
 
+
+template <size_t E>
+inline int ReadQueue::uniqueMatchResult(const std::array<uint8_t, E + 1>& multiMatch, const std::array<MATCH::match, E + 1>& uniqueMatches, MATCH::match& mat)
+{
 	// go through found matches for each [0,maxErrorNumber] and see if it is unique
 	for (size_t i = 0; i < multiMatch.size(); ++i)
 	{
@@ -2134,21 +4390,26 @@ inline int ReadQueue::saQuerySeedSetRef(ShiftAnd<MyConst::MISCOUNT + MyConst::AD
 
 
 
-inline void ReadQueue::saQuerySeedSetRefFirst(ShiftAnd<MyConst::MISCOUNT + MyConst::ADDMIS>& sa, std::vector<MATCH::match>& mats, const uint16_t& qThreshold)
+template <size_t E>
+inline void ReadQueue::saQuerySeedSetRefFirst(ShiftAnd<E>& sa, std::vector<MATCH::match>& mats, const uint16_t& qThreshold)
 {
+	Profiler::Scope profScope(prof, omp_get_thread_num(), Profiler::SHIFTAND);
 
 	// use counters to flag what has been processed so far
 	auto& fwdMetaIDs_t = paired_fwdMetaIDs[omp_get_thread_num()];
 	auto& revMetaIDs_t = paired_revMetaIDs[omp_get_thread_num()];
 
 	// store the last match found in current MetaCpG
-	uint8_t prevChr = 0;
+	chromId prevChr = 0;
 	uint64_t prevOff = 0xffffffffffffffffULL;
 
-	std::vector<std::pair<uint32_t, std::tuple<uint8_t, uint8_t, bool, bool> > > fwdMetas(fwdMetaIDs_t.begin(), fwdMetaIDs_t.end());
+	auto& fwdMetas = pairedMetaBuf[omp_get_thread_num()][0];
+	fwdMetas.assign(fwdMetaIDs_t.begin(), fwdMetaIDs_t.end());
 	std::sort(fwdMetas.begin(), fwdMetas.end(), cmpMetaFirst);
-	std::vector<std::pair<uint32_t, std::tuple<uint8_t, uint8_t, bool, bool> > > revMetas(revMetaIDs_t.begin(), revMetaIDs_t.end());
+	auto& revMetas = pairedMetaBuf[omp_get_thread_num()][1];
+	revMetas.assign(revMetaIDs_t.begin(), revMetaIDs_t.end());
 	std::sort(revMetas.begin(), revMetas.end(), cmpMetaFirst);
+	prof.hist(omp_get_thread_num(), Profiler::CANDIDATES, fwdMetas.size() + revMetas.size());
 	// current best k-mer count of true match
 	int32_t bmCount = 0;
 	if (fwdMetas.size() > 0)
@@ -2216,19 +4477,24 @@ inline void ReadQueue::saQuerySeedSetRefFirst(ShiftAnd<MyConst::MISCOUNT + MyCon
 
 
 
-inline void ReadQueue::saQuerySeedSetRefSecond(ShiftAnd<MyConst::MISCOUNT + MyConst::ADDMIS>& sa, std::vector<MATCH::match>& mats, const uint16_t& qThreshold)
+template <size_t E>
+inline void ReadQueue::saQuerySeedSetRefSecond(ShiftAnd<E>& sa, std::vector<MATCH::match>& mats, const uint16_t& qThreshold)
 {
+	Profiler::Scope profScope(prof, omp_get_thread_num(), Profiler::SHIFTAND);
 	auto& fwdMetaIDs_t = paired_fwdMetaIDs[omp_get_thread_num()];
 	auto& revMetaIDs_t = paired_revMetaIDs[omp_get_thread_num()];
 
 	// store the last match found in current MetaCpG
-	uint8_t prevChr = 0;
+	chromId prevChr = 0;
 	uint64_t prevOff = 0xffffffffffffffffULL;
 
-	std::vector<std::pair<uint32_t, std::tuple<uint8_t, uint8_t, bool, bool> > > fwdMetas(fwdMetaIDs_t.begin(), fwdMetaIDs_t.end());
+	auto& fwdMetas = pairedMetaBuf[omp_get_thread_num()][0];
+	fwdMetas.assign(fwdMetaIDs_t.begin(), fwdMetaIDs_t.end());
 	std::sort(fwdMetas.begin(), fwdMetas.end(), cmpMetaSecond);
-	std::vector<std::pair<uint32_t, std::tuple<uint8_t, uint8_t, bool, bool> > > revMetas(revMetaIDs_t.begin(), revMetaIDs_t.end());
+	auto& revMetas = pairedMetaBuf[omp_get_thread_num()][1];
+	revMetas.assign(revMetaIDs_t.begin(), revMetaIDs_t.end());
 	std::sort(revMetas.begin(), revMetas.end(), cmpMetaSecond);
+	prof.hist(omp_get_thread_num(), Profiler::CANDIDATES, fwdMetas.size() + revMetas.size());
 	// current best k-mer count of true match
 	int32_t bmCount = 0;
 	if (fwdMetas.size() > 0)
@@ -2296,94 +4562,133 @@ inline void ReadQueue::saQuerySeedSetRefSecond(ShiftAnd<MyConst::MISCOUNT + MyCo
 
 
 
-inline void ReadQueue::getSeedRefs(const std::string& seq, const size_t& readSize, const uint16_t qThreshold)
+inline void ReadQueue::seedAhead(const unsigned int j, const unsigned int procReads, const std::vector<uint32_t>* readIds, const bool fwd, const bool rev, const int threadnum)
 {
 
-	auto& fwdMetaIDs_t = fwdMetaIDs[omp_get_thread_num()];
-	auto& revMetaIDs_t = revMetaIDs[omp_get_thread_num()];
-	uint32_t kmerNum = 1;
-	uint32_t bucketCount = 0;
+	SeedGroup& g = seedGroups[threadnum];
+	if (j >= g.first && j < g.last)
+		return;
+	g.first = j;
+	g.last = std::min(procReads, j + MyConst::interleave);
+	g.buckets.resize(MyConst::interleave);
+	g.prints.resize(MyConst::interleave);
+	std::vector<uint64_t>& hashBuf = seedHashes[threadnum];
+	// bucket directory entries of all reads, the buckets of reads that are not matched stay empty
+	for (unsigned int k = j; k < g.last; ++k)
+	{
+		const Read& r = readBuffer[readIds ? (*readIds)[k] : k];
+		const size_t readSize = r.seq.size();
+		auto& b = g.buckets[k - j];
+		b[0].clear();
+		b[1].clear();
+		if (!acceptLength(readSize, false) || !acceptNs(r))
+			continue;
+		if (fwd)
+			ref.seedKeys(r.seq, b[0], hashBuf, g.prints[k - j][0]);
+		if (rev)
+			ref.seedKeys(r.rev, b[1], hashBuf, g.prints[k - j][1]);
+	}
+	// their buckets
+	for (unsigned int k = j; k < g.last; ++k)
 	{
-		// retrieve kmers for first hash
-		uint64_t fhVal;
-		uint64_t sfVal = ntHash::NTPS64(seq.data(), MyConst::SEED, MyConst::KMERLEN, fhVal);
+		for (auto& b : g.buckets[k - j])
+			ref.seedRanges(b);
+	}
+}
 
-		uint64_t key = sfVal % MyConst::HTABSIZE;
-		bucketCount += ref.tabIndex[key+1] - ref.tabIndex[key];
+inline void ReadQueue::takeSeeds(const unsigned int j, const unsigned int strand, const int threadnum)
+{
 
-		for (unsigned int cIdx = 0; cIdx < (seq.size() - MyConst::KMERLEN); ++cIdx)
-		{
+	SeedGroup& g = seedGroups[threadnum];
+	seedBuckets[threadnum].swap(g.buckets[j - g.first][strand]);
+	seedPrints[threadnum].swap(g.prints[j - g.first][strand]);
+	g.taken = true;
+}
 
-			// use rolling hash
-			sfVal = ntHash::NTPS64(seq.data()+cIdx+1, MyConst::SEED, seq[cIdx], seq[cIdx + MyConst::KMERLEN], MyConst::KMERLEN, fhVal);
+inline void ReadQueue::getSeedRefs(const SeqView& seq, const size_t& readSize, const uint16_t qThreshold)
+{
+	Profiler::Scope profScope(prof, omp_get_thread_num(), Profiler::SEED);
 
-			key = sfVal % MyConst::HTABSIZE;
-			bucketCount += ref.tabIndex[key+1] - ref.tabIndex[key];
-			++kmerNum;
-		}
+	auto& fwdMetaIDs_t = fwdMetaIDs[omp_get_thread_num()];
+	auto& revMetaIDs_t = revMetaIDs[omp_get_thread_num()];
+	auto& buckets = seedBuckets[omp_get_thread_num()];
+	// buckets looked up together with those of the following reads (see seedAhead)
+	bool& taken = seedGroups[omp_get_thread_num()].taken;
+	if (taken)
+		taken = false;
+	else
+		ref.getSeedBuckets(seq, buckets, seedHashes[omp_get_thread_num()], seedPrints[omp_get_thread_num()]);
+	if (prof.enabled())
+	{
+		for (const auto& b : buckets)
+			prof.hist(omp_get_thread_num(), Profiler::BUCKETS, b.second - b.first);
 	}
-	bucketCount = bucketCount / 5;
-	auto newmap = tsl::hopscotch_map<uint32_t, uint16_t, MetaHash>(bucketCount);
-	fwdMetaIDs_t.swap(newmap);
-	newmap = tsl::hopscotch_map<uint32_t, uint16_t, MetaHash>(bucketCount);
-	revMetaIDs_t.swap(newmap);
-
-	// retrieve kmers for first hash
-	uint64_t fhVal;
-	uint64_t sfVal = ntHash::NTPS64(seq.data(), MyConst::SEED, MyConst::KMERLEN, fhVal);
-
-	uint64_t key = sfVal % MyConst::HTABSIZE;
+	fwdMetaIDs_t.clear();
+	revMetaIDs_t.clear();
 
 	uint64_t lastId = 0xffffffffffffffffULL;
 	bool wasFwd = false;
-
-	// maximum position until we can insert completely new meta cpgs
-	uint32_t maxQPos = seq.size() - MyConst::KMERLEN + 1 - qThreshold;
-
-	uint64_t endIdx = ref.tabIndex[key+1];
-	for (uint64_t i = ref.tabIndex[key]; i < endIdx; ++i)
+	// predicted match ends of the seeds are kept per window iff the index has k-mer offsets
+	const bool useOffs = ref.hasKmerOffsets();
+
+	// k-mers in the order they are probed: the qThreshold - 1 ones with the largest buckets come last and only
+	// count windows found before, since a window with qThreshold hits has a hit among the others
+	// the many windows of repetitive k-mers that cannot pass the threshold are thus never inserted
+	const size_t kmerNum = seq.size() - MyConst::KMERLEN + 1;
+	const size_t existingOnly = qThreshold <= kmerNum ? qThreshold - 1 : 0;
+	std::vector<std::pair<uint64_t, uint32_t> >& order = seedOrder[omp_get_thread_num()];
+	order.resize(kmerNum);
+	for (size_t k = 0; k < kmerNum; ++k)
 	{
+		uint64_t hits = 0;
+		for (unsigned int s = 0; s < ref.seeds(); ++s)
+			hits += buckets[k * ref.seeds() + s].second - buckets[k * ref.seeds() + s].first;
+		order[k] = std::make_pair(hits, static_cast<uint32_t>(k));
+	}
+	if (existingOnly > 0)
+		std::nth_element(order.begin(), order.end() - existingOnly, order.end());
 
-		const uint32_t metaId = KMER_S::getMetaCpG(ref.kmerTableSmall[i]);
-		const bool isFwd = ref.strandTable[i];
-		// check if we visited meta CpG before
-		if (metaId == lastId && isFwd == wasFwd)
-		{
-			continue;
-		}
+	// entry of kmerTableSmall and seed of its bucket
+	uint64_t i;
+	unsigned int seed;
+	for (size_t o = 0; o < kmerNum; ++o)
+	{
 
-		// update vars for last checked metaCpG
-		lastId = metaId;
-		wasFwd = isFwd;
+		const uint32_t kIdx = order[o].second;
+		const bool insert = o + existingOnly < kmerNum;
+		// no window can pass if the other k-mers found none
+		if (!insert && fwdMetaIDs_t.size() == 0 && revMetaIDs_t.size() == 0)
+			break;
+		lastId = 0xffffffffffffffffULL;
+		wasFwd = false;
 
-		if (isFwd)
+		// the windows of a hot bucket are read from its list, without repeats (see RefGenome::hotBucket)
+		const uint8_t* hotEnd;
+		if (const uint8_t* hot = ref.hotBucket(buckets[kIdx], hotEnd))
 		{
-			++fwdMetaIDs_t[metaId];
-
-		} else {
+			uint32_t metaId;
+			bool isFwd;
+			for (RefGenome::HotWindows wins(hot, hotEnd); wins.next(metaId, isFwd); )
+			{
+				MetaCounter& metaIDs_t = isFwd ? fwdMetaIDs_t : revMetaIDs_t;
+				if (insert)
+				{
+					metaIDs_t.add(metaId, 0);
 
-			++revMetaIDs_t[metaId];
+				} else {
 
+					metaIDs_t.addExisting(metaId, 0);
+				}
+			}
+			continue;
 		}
-	}
-
-	for (unsigned int cIdx = 0; cIdx < (seq.size() - MyConst::KMERLEN); ++cIdx)
-	{
-
-		// use rolling hash
-		sfVal = ntHash::NTPS64(seq.data()+cIdx+1, MyConst::SEED, seq[cIdx], seq[cIdx + MyConst::KMERLEN], MyConst::KMERLEN, fhVal);
-
-		key = sfVal % MyConst::HTABSIZE;
-
-		lastId = 0xffffffffffffffffULL;
-		wasFwd = false;
 
-		endIdx = ref.tabIndex[key+1];
-		for (uint64_t i = ref.tabIndex[key]; i < endIdx; ++i)
+		for (RefGenome::SeedHits hits(ref, buckets, seedPrints[omp_get_thread_num()], kIdx); hits.next(i, seed); )
 		{
 
-			const uint32_t metaId = KMER_S::getMetaCpG(ref.kmerTableSmall[i]);
-			const bool isFwd = ref.strandTable[i];
+			const KMER_S::kmer currentKmer = ref.kmerTableSmall[i];
+			const uint32_t metaId = KMER_S::getMetaCpG(currentKmer);
+			const bool isFwd = KMER_S::isFwd(currentKmer);
 			// check if we visited meta CpG before
 			if (metaId == lastId && isFwd == wasFwd)
 			{
@@ -2393,38 +4698,17 @@ inline void ReadQueue::getSeedRefs(const std::string& seq, const size_t& readSiz
 			// update vars for last checked metaCpG
 			lastId = metaId;
 			wasFwd = isFwd;
+			const int32_t matchEnd = useOffs ? seedMatchEnd(i, kIdx, seq.size(), isFwd) : 0;
+			MetaCounter& metaIDs_t = isFwd ? fwdMetaIDs_t : revMetaIDs_t;
 
-			if (isFwd)
+			// check if it is at all possible to have newly inserted element passing q
+			if (insert)
 			{
-				// check if it is at all possible to have newly inserted element passing q
-				if (cIdx < maxQPos)
-				{
-					++fwdMetaIDs_t[metaId];
-
-				} else {
-
-					auto it = fwdMetaIDs_t.find(metaId);
-					if (it != fwdMetaIDs_t.end())
-					{
-						++(it.value());
-					}
-				}
+				metaIDs_t.add(metaId, matchEnd);
 
 			} else {
 
-				if (cIdx < maxQPos)
-				{
-					++revMetaIDs_t[metaId];
-
-				} else {
-
-					auto it = revMetaIDs_t.find(metaId);
-					if (it != revMetaIDs_t.end())
-					{
-						++(it.value());
-					}
-				}
-
+				metaIDs_t.addExisting(metaId, matchEnd);
 			}
 		}
 	}
@@ -2435,8 +4719,9 @@ inline void ReadQueue::getSeedRefs(const std::string& seq, const size_t& readSiz
 
 
 
-inline uint16_t ReadQueue::getSeedRefsFirstRead(const std::string& seq, const size_t& readSize, const uint16_t qThreshold)
+inline uint16_t ReadQueue::getSeedRefsFirstRead(const SeqView& seq, const size_t& readSize, const uint16_t qThreshold)
 {
+	Profiler::Scope profScope(prof, omp_get_thread_num(), Profiler::SEED);
 
 	// std::vector<uint16_t>& threadCountFwdStart = countsFwdStart[omp_get_thread_num()];
 	// std::vector<uint16_t>& threadCountRevStart = countsRevStart[omp_get_thread_num()];
@@ -2450,26 +4735,12 @@ inline uint16_t ReadQueue::getSeedRefsFirstRead(const std::string& seq, const si
 	// revMetaIDs_t.clear();
 	// fwdMetaIDs_t.resize(800);
 	// revMetaIDs_t.resize(800);
-	uint32_t kmerNum = 1;
-	uint32_t bucketCount = 0;
+	auto& buckets = seedBuckets[omp_get_thread_num()];
+	uint32_t bucketCount = ref.getSeedBuckets(seq, buckets, seedHashes[omp_get_thread_num()], seedPrints[omp_get_thread_num()]);
+	if (prof.enabled())
 	{
-		// retrieve kmers for first hash
-		uint64_t fhVal;
-		uint64_t sfVal = ntHash::NTPS64(seq.data(), MyConst::SEED, MyConst::KMERLEN, fhVal);
-
-		uint64_t key = sfVal % MyConst::HTABSIZE;
-		bucketCount += ref.tabIndex[key+1] - ref.tabIndex[key];
-
-		for (unsigned int cIdx = 0; cIdx < (seq.size() - MyConst::KMERLEN); ++cIdx)
-		{
-
-			// use rolling hash
-			sfVal = ntHash::NTPS64(seq.data()+cIdx+1, MyConst::SEED, seq[cIdx], seq[cIdx + MyConst::KMERLEN], MyConst::KMERLEN, fhVal);
-
-			key = sfVal % MyConst::HTABSIZE;
-			bucketCount += ref.tabIndex[key+1] - ref.tabIndex[key];
-			++kmerNum;
-		}
+		for (const auto& b : buckets)
+			prof.hist(omp_get_thread_num(), Profiler::BUCKETS, b.second - b.first);
 	}
 // #pragma omp critical
 // 	{
@@ -2481,20 +4752,19 @@ inline uint16_t ReadQueue::getSeedRefsFirstRead(const std::string& seq, const si
 	newmap = tsl::hopscotch_map<uint32_t, std::tuple<uint8_t, uint8_t, bool, bool>, MetaHash>(bucketCount);
 	revMetaIDs_t.swap(newmap);
 
-	// retrieve kmers for first hash
-	uint64_t fhVal;
-	uint64_t sfVal = ntHash::NTPS64(seq.data(), MyConst::SEED, MyConst::KMERLEN, fhVal);
-
-	uint64_t key = sfVal % MyConst::HTABSIZE;
-
 	uint64_t lastId = 0xffffffffffffffffULL;
 	bool wasFwd = false;
 	bool wasStart = false;
+	// predicted match ends of the seeds per window (see getSeedRefs)
+	const bool useOffs = ref.hasKmerOffsets();
+	MetaCounter& fwdSpans = paired_fwdSpans[omp_get_thread_num()][0];
+	MetaCounter& revSpans = paired_revSpans[omp_get_thread_num()][0];
+	fwdSpans.clear();
+	revSpans.clear();
 
 	// compute bitmask for all positions where C occurrs
+	// blacklisted k-mers have empty buckets (see RefGenome::getSeedBuckets)
 	uint32_t cMask = 0;
-	// also compute perfect hash
-	uint32_t kSeq = 0;
 	for (unsigned int i = 0; i < MyConst::KMERLEN; ++i)
 	{
 		cMask = cMask << 1;
@@ -2502,22 +4772,6 @@ inline uint16_t ReadQueue::getSeedRefsFirstRead(const std::string& seq, const si
 		{
 			cMask |= 1;
 		}
-		kSeq = kSeq << 2;
-		switch (seq[i])
-		{
-
-			case 'C':
-			case 'T':
-
-				kSeq += 3;
-				break;
-
-			case 'G':
-
-				kSeq += 2;
-				break;
-		// end switch
-		}
 	}
 	// uint16_t qAdapt = 0;
 	// maximum position until we can insert completely new meta cpgs
@@ -2529,18 +4783,20 @@ inline uint16_t ReadQueue::getSeedRefsFirstRead(const std::string& seq, const si
 	// }
 
 
-	uint64_t endIdx = ref.tabIndex[key+1];
-	for (uint64_t i = ref.tabIndex[key]; i < endIdx; ++i)
+	// entry of kmerTableSmall and seed of its bucket
+	uint64_t i;
+	unsigned int seed;
+	for (RefGenome::SeedHits hits(ref, buckets, seedPrints[omp_get_thread_num()], 0); hits.next(i, seed); )
 	{
 
 		const KMER_S::kmer currentKmer = ref.kmerTableSmall[i];
 		const uint32_t metaId = KMER_S::getMetaCpG(currentKmer);
 		// test for asymmetric mapping
-		if (cMask & MyConst::SEEDBITS & currentKmer.tmask)
+		if (cMask & MyConst::SEEDSET[seed] & currentKmer.tmask)
 		{
 			continue;
 		}
-		const bool isFwd = ref.strandTable[i];
+		const bool isFwd = KMER_S::isFwd(currentKmer);
 		const bool isStart = KMER_S::isStartCpG(currentKmer);
 		// check if we visited meta CpG before
 		if (metaId == lastId && isFwd == wasFwd && isStart == wasStart)
@@ -2569,10 +4825,14 @@ inline uint16_t ReadQueue::getSeedRefsFirstRead(const std::string& seq, const si
 			if (isFwd)
 			{
 				++std::get<0>(fwdMetaIDs_t[metaId]);
+				if (useOffs)
+					fwdSpans.add(metaId, seedMatchEnd(i, 0, seq.size(), true));
 
 			} else {
 
 				++std::get<0>(revMetaIDs_t[metaId]);
+				if (useOffs)
+					revSpans.add(metaId, seedMatchEnd(i, 0, seq.size(), false));
 
 			}
 		// }
@@ -2581,22 +4841,6 @@ inline uint16_t ReadQueue::getSeedRefsFirstRead(const std::string& seq, const si
 	for (unsigned int cIdx = 0; cIdx < (seq.size() - MyConst::KMERLEN); ++cIdx)
 	{
 
-		kSeq = kSeq << 2;
-		switch (seq[MyConst::KMERLEN + cIdx])
-		{
-
-			case 'C':
-			case 'T':
-
-				kSeq += 3;
-				break;
-
-			case 'G':
-
-				kSeq += 2;
-				break;
-		// end switch
-		}
 		// TODO: check if correct for k-mer lengths < 32
 		cMask = (cMask << 1) & MyConst::KMERMASK;
 		if (seq[MyConst::KMERLEN + cIdx] == 'C')
@@ -2604,37 +4848,20 @@ inline uint16_t ReadQueue::getSeedRefsFirstRead(const std::string& seq, const si
 			cMask |= 1;
 		}
 
-		// use rolling hash
-		sfVal = ntHash::NTPS64(seq.data()+cIdx+1, MyConst::SEED, seq[cIdx], seq[cIdx + MyConst::KMERLEN], MyConst::KMERLEN, fhVal);
-
-		key = sfVal % MyConst::HTABSIZE;
-
-		// test if kmer is blacklisted
-		if (ref.filteredKmers.find(kSeq) != ref.filteredKmers.end())
-		{
-			// ++maxQPos;
-			// ++qAdapt;
-			// if (qAdapt >= qThreshold)
-			// {
-			// 	return 0;
-			// }
-			continue;
-		}
 		lastId = 0xffffffffffffffffULL;
 		wasFwd = false;
 		wasStart = false;
 
-		endIdx = ref.tabIndex[key+1];
-		for (uint64_t i = ref.tabIndex[key]; i < endIdx; ++i)
+		for (RefGenome::SeedHits hits(ref, buckets, seedPrints[omp_get_thread_num()], cIdx + 1); hits.next(i, seed); )
 		{
 
 			const KMER_S::kmer currentKmer = ref.kmerTableSmall[i];
 			const uint32_t metaId = KMER_S::getMetaCpG(currentKmer);
-			if (cMask & MyConst::SEEDBITS & currentKmer.tmask)
+			if (cMask & MyConst::SEEDSET[seed] & currentKmer.tmask)
 			{
 				continue;
 			}
-			const bool isFwd = ref.strandTable[i];
+			const bool isFwd = KMER_S::isFwd(currentKmer);
 			const bool isStart = KMER_S::isStartCpG(currentKmer);
 			// check if we visited meta CpG before
 			if (metaId == lastId && isFwd == wasFwd && isStart == wasStart)
@@ -2667,6 +4894,8 @@ inline uint16_t ReadQueue::getSeedRefsFirstRead(const std::string& seq, const si
 					if (cIdx < maxQPos)
 					{
 						++std::get<0>(fwdMetaIDs_t[metaId]);
+						if (useOffs)
+							fwdSpans.add(metaId, seedMatchEnd(i, cIdx + 1, seq.size(), true));
 
 					} else {
 
@@ -2674,6 +4903,8 @@ inline uint16_t ReadQueue::getSeedRefsFirstRead(const std::string& seq, const si
 						if (it != fwdMetaIDs_t.end())
 						{
 							++std::get<0>(it.value());
+							if (useOffs)
+								fwdSpans.addExisting(metaId, seedMatchEnd(i, cIdx + 1, seq.size(), true));
 						}
 					}
 
@@ -2682,6 +4913,8 @@ inline uint16_t ReadQueue::getSeedRefsFirstRead(const std::string& seq, const si
 					if (cIdx < maxQPos)
 					{
 						++std::get<0>(revMetaIDs_t[metaId]);
+						if (useOffs)
+							revSpans.add(metaId, seedMatchEnd(i, cIdx + 1, seq.size(), false));
 
 					} else {
 
@@ -2689,6 +4922,8 @@ inline uint16_t ReadQueue::getSeedRefsFirstRead(const std::string& seq, const si
 						if (it != revMetaIDs_t.end())
 						{
 							++std::get<0>(it.value());
+							if (useOffs)
+								revSpans.addExisting(metaId, seedMatchEnd(i, cIdx + 1, seq.size(), false));
 						}
 					}
 
@@ -2768,25 +5003,33 @@ inline uint16_t ReadQueue::getSeedRefsFirstRead(const std::string& seq, const si
 
 
 
-inline bool ReadQueue::getSeedRefsSecondRead(const std::string& seq, const size_t& readSize, const uint16_t qThreshold)
+inline bool ReadQueue::getSeedRefsSecondRead(const SeqView& seq, const size_t& readSize, const uint16_t qThreshold)
 {
+	Profiler::Scope profScope(prof, omp_get_thread_num(), Profiler::SEED);
 
 	auto& fwdMetaIDs_t = paired_fwdMetaIDs[omp_get_thread_num()];
 	auto& revMetaIDs_t = paired_revMetaIDs[omp_get_thread_num()];
 
-	// retrieve kmers for first hash
-	uint64_t fhVal;
-	uint64_t sfVal = ntHash::NTPS64(seq.data(), MyConst::SEED, MyConst::KMERLEN, fhVal);
-
-	uint64_t key = sfVal % MyConst::HTABSIZE;
+	auto& buckets = seedBuckets[omp_get_thread_num()];
+	ref.getSeedBuckets(seq, buckets, seedHashes[omp_get_thread_num()], seedPrints[omp_get_thread_num()]);
+	if (prof.enabled())
+	{
+		for (const auto& b : buckets)
+			prof.hist(omp_get_thread_num(), Profiler::BUCKETS, b.second - b.first);
+	}
 
 	uint64_t lastId = 0xffffffffffffffffULL;
 	bool wasFwd = false;
+	// predicted match ends of the seeds per window (see getSeedRefs)
+	const bool useOffs = ref.hasKmerOffsets();
+	MetaCounter& fwdSpans = paired_fwdSpans[omp_get_thread_num()][1];
+	MetaCounter& revSpans = paired_revSpans[omp_get_thread_num()][1];
+	fwdSpans.clear();
+	revSpans.clear();
 
 	// compute bitmask for all positions where C occurrs
+	// blacklisted k-mers have empty buckets (see RefGenome::getSeedBuckets)
 	uint32_t cMask = 0;
-	// also compute perfect hash
-	uint32_t kSeq = 0;
 	for (unsigned int i = 0; i < MyConst::KMERLEN; ++i)
 	{
 		cMask = cMask << 1;
@@ -2794,22 +5037,6 @@ inline bool ReadQueue::getSeedRefsSecondRead(const std::string& seq, const size_
 		{
 			cMask |= 1;
 		}
-		kSeq = kSeq << 2;
-		switch (seq[i])
-		{
-
-			case 'C':
-			case 'T':
-
-				kSeq += 3;
-				break;
-
-			case 'G':
-
-				kSeq += 2;
-				break;
-		// end switch
-		}
 	}
 	// maximum position until we can insert completely new meta cpgs
 	uint32_t maxQPos = seq.size() - MyConst::KMERLEN + 1 - qThreshold;
@@ -2825,18 +5052,20 @@ inline bool ReadQueue::getSeedRefsSecondRead(const std::string& seq, const size_
 	// TODO
 	// count how often we have a meta CpG candidate for matching
 	// unsigned int candCount = 0;
-	uint64_t endIdx = ref.tabIndex[key+1];
-	for (uint64_t i = ref.tabIndex[key]; i < endIdx; ++i)
+	// entry of kmerTableSmall and seed of its bucket
+	uint64_t i;
+	unsigned int seed;
+	for (RefGenome::SeedHits hits(ref, buckets, seedPrints[omp_get_thread_num()], 0); hits.next(i, seed); )
 	{
 
 		const KMER_S::kmer currentKmer = ref.kmerTableSmall[i];
 		const uint32_t metaId = KMER_S::getMetaCpG(currentKmer);
 		// test for asymmetric mapping
-		if (cMask & MyConst::SEEDBITS & currentKmer.tmask)
+		if (cMask & MyConst::SEEDSET[seed] & currentKmer.tmask)
 		{
 			continue;
 		}
-		const bool isFwd = ref.strandTable[i];
+		const bool isFwd = KMER_S::isFwd(currentKmer);
 		// check if we visited meta CpG before
 		if (metaId == lastId && isFwd == wasFwd)
 		{
@@ -2859,6 +5088,8 @@ inline bool ReadQueue::getSeedRefsSecondRead(const std::string& seq, const size_
 					// if (std::get<0>(foundMeta->second) >= qThreshold)
 					// {
 						++std::get<1>(fwdMetaIDs_t[metaId]);
+						if (useOffs)
+							fwdSpans.add(metaId, seedMatchEnd(i, 0, seq.size(), true));
 						break;
 						// propagate information to adjacent meta CpGs if enough kmers are matched
 						// if (std::get<1>(fwdMetaIDs_t[metaId]) == qThreshold)
@@ -2888,6 +5119,8 @@ inline bool ReadQueue::getSeedRefsSecondRead(const std::string& seq, const size_
 					// if (std::get<0>(foundMeta->second) >= qThreshold)
 					// {
 						++std::get<1>(revMetaIDs_t[metaId]);
+						if (useOffs)
+							revSpans.add(metaId, seedMatchEnd(i, 0, seq.size(), false));
 						break;
 						// propagate information to adjacent meta CpGs if enough kmers are matched
 						// if (std::get<1>(revMetaIDs_t[metaId]) == qThreshold)
@@ -2914,57 +5147,24 @@ inline bool ReadQueue::getSeedRefsSecondRead(const std::string& seq, const size_
 	for (unsigned int cIdx = 0; cIdx < (seq.size() - MyConst::KMERLEN); ++cIdx)
 	{
 
-		kSeq = kSeq << 2;
-		switch (seq[MyConst::KMERLEN + cIdx])
-		{
-
-			case 'C':
-			case 'T':
-
-				kSeq += 3;
-				break;
-
-			case 'G':
-
-				kSeq += 2;
-				break;
-		// end switch
-		}
 		cMask = (cMask << 1) & MyConst::KMERMASK;
 		if (seq[MyConst::KMERLEN + cIdx] == 'C')
 		{
 			cMask |= 1;
 		}
-		// use rolling hash
-		sfVal = ntHash::NTPS64(seq.data()+cIdx+1, MyConst::SEED, seq[cIdx], seq[cIdx + MyConst::KMERLEN], MyConst::KMERLEN, fhVal);
-
-		key = sfVal % MyConst::HTABSIZE;
-
-		// test if kmer is blacklisted
-		if (ref.filteredKmers.find(kSeq) != ref.filteredKmers.end())
-		{
-			// ++maxQPos;
-			// ++qAdapt;
-			// if (qAdapt >= qThreshold)
-			// {
-			// 	return 0;
-			// }
-			continue;
-		}
 		lastId = 0xffffffffffffffffULL;
 		wasFwd = false;
 
-		endIdx = ref.tabIndex[key+1];
-		for (uint64_t i = ref.tabIndex[key]; i < endIdx; ++i)
+		for (RefGenome::SeedHits hits(ref, buckets, seedPrints[omp_get_thread_num()], cIdx + 1); hits.next(i, seed); )
 		{
 
 			const KMER_S::kmer currentKmer = ref.kmerTableSmall[i];
 			const uint32_t metaId = KMER_S::getMetaCpG(currentKmer);
-			if (cMask & MyConst::SEEDBITS & currentKmer.tmask)
+			if (cMask & MyConst::SEEDSET[seed] & currentKmer.tmask)
 			{
 				continue;
 			}
-			const bool isFwd = ref.strandTable[i];
+			const bool isFwd = KMER_S::isFwd(currentKmer);
 			// check if we visited meta CpG before
 			if (metaId == lastId && isFwd == wasFwd)
 			{
@@ -2990,6 +5190,8 @@ inline bool ReadQueue::getSeedRefsSecondRead(const std::string& seq, const size_
 							// if (std::get<0>(foundMeta->second) >= qThreshold)
 							// {
 								++std::get<1>(fwdMetaIDs_t[metaId]);
+								if (useOffs)
+									fwdSpans.add(metaId, seedMatchEnd(i, cIdx + 1, seq.size(), true));
 								break;
 							// }
 						}
@@ -3003,6 +5205,8 @@ inline bool ReadQueue::getSeedRefsSecondRead(const std::string& seq, const size_
 							// if (std::get<0>(foundMeta->second) >= qThreshold)
 							// {
 								++std::get<1>(revMetaIDs_t[metaId]);
+								if (useOffs)
+									revSpans.add(metaId, seedMatchEnd(i, cIdx + 1, seq.size(), false));
 								break;
 							// }
 						}
@@ -3017,6 +5221,8 @@ inline bool ReadQueue::getSeedRefsSecondRead(const std::string& seq, const size_
 					if (it != fwdMetaIDs_t.end())
 					{
 						++std::get<1>(it.value());
+						if (useOffs)
+							fwdSpans.add(metaId, seedMatchEnd(i, cIdx + 1, seq.size(), true));
 						// propagate information to adjacent meta CpGs if enough kmers are matched
 						// if (std::get<1>(it->second) == qThreshold)
 						// {
@@ -3039,6 +5245,8 @@ inline bool ReadQueue::getSeedRefsSecondRead(const std::string& seq, const size_
 					if (it != revMetaIDs_t.end())
 					{
 						++std::get<1>(it.value());
+						if (useOffs)
+							revSpans.add(metaId, seedMatchEnd(i, cIdx + 1, seq.size(), false));
 						// propagate information to adjacent meta CpGs if enough kmers are matched
 						// if (std::get<1>(it->second) == qThreshold)
 						// {
@@ -3138,10 +5346,247 @@ inline bool ReadQueue::getSeedRefsSecondRead(const std::string& seq, const size_
 
 
 
+inline void ReadQueue::collectPairHits(const SeqView& seq, const uint16_t qThreshold, const bool withStart, std::vector<PairHit>& hits)
+{
+	auto& buckets = seedBuckets[omp_get_thread_num()];
+	ref.getSeedBuckets(seq, buckets, seedHashes[omp_get_thread_num()], seedPrints[omp_get_thread_num()]);
+	if (prof.enabled())
+	{
+		for (const auto& b : buckets)
+			prof.hist(omp_get_thread_num(), Profiler::BUCKETS, b.second - b.first);
+	}
+	const bool useOffs = ref.hasKmerOffsets();
+	// maximum position until we can insert completely new meta cpgs
+	const uint32_t maxQPos = seq.size() - MyConst::KMERLEN + 1 - qThreshold;
+
+	uint32_t cMask = 0;
+	for (unsigned int i = 0; i < MyConst::KMERLEN - 1; ++i)
+	{
+		cMask = cMask << 1;
+		if (seq[i] == 'C')
+		{
+			cMask |= 1;
+		}
+	}
+	// the hits of every k-mer, in descending order of keys (see PairHit) as the buckets are sorted by window
+	std::vector<std::pair<size_t, size_t> >& runs = pairRuns[omp_get_thread_num()];
+	hits.clear();
+	runs.clear();
+	uint64_t i;
+	unsigned int seed;
+	for (unsigned int p = 0; p <= seq.size() - MyConst::KMERLEN; ++p)
+	{
+
+		cMask = (cMask << 1) & MyConst::KMERMASK;
+		if (seq[MyConst::KMERLEN - 1 + p] == 'C')
+		{
+			cMask |= 1;
+		}
+		const bool early = p == 0 || p - 1 < maxQPos;
+
+		uint64_t lastId = 0xffffffffffffffffULL;
+		bool wasFwd = false;
+		bool wasStart = false;
+		const size_t runStart = hits.size();
+		for (RefGenome::SeedHits hits_p(ref, buckets, seedPrints[omp_get_thread_num()], p); hits_p.next(i, seed); )
+		{
+
+			const KMER_S::kmer currentKmer = ref.kmerTableSmall[i];
+			const uint32_t metaId = KMER_S::getMetaCpG(currentKmer);
+			// test for asymmetric mapping
+			if (cMask & MyConst::SEEDSET[seed] & currentKmer.tmask)
+			{
+				continue;
+			}
+			const bool isFwd = KMER_S::isFwd(currentKmer);
+			const bool isStart = withStart && KMER_S::isStartCpG(currentKmer);
+			// check if we visited meta CpG before
+			if (metaId == lastId && isFwd == wasFwd && isStart == wasStart)
+			{
+				continue;
+			}
+			lastId = metaId;
+			wasFwd = isFwd;
+			wasStart = isStart;
+
+			PairHit h;
+			h.key = (static_cast<uint64_t>(metaId) << 1) | !isFwd;
+			h.end = useOffs ? seedMatchEnd(i, p, seq.size(), isFwd) : 0;
+			h.early = early;
+			hits.push_back(h);
+		}
+		if (hits.size() > runStart)
+			runs.emplace_back(runStart, hits.size());
+	}
+
+	// short runs (unique k-mers) are sorted as a whole, which is cheaper than merging them
+	if (hits.size() < PAIRMERGERUN * runs.size())
+	{
+		std::sort(hits.begin(), hits.end(), [](const PairHit& a, const PairHit& b) { return a.key < b.key; });
+		return;
+	}
+	// only hits of the same window can be out of order (reverse before forward strand)
+	for (const std::pair<size_t, size_t>& run : runs)
+	{
+		for (size_t h = run.first + 1; h < run.second; ++h)
+		{
+			for (size_t g = h; g > run.first && hits[g - 1].key < hits[g].key; --g)
+				std::swap(hits[g - 1], hits[g]);
+		}
+	}
+	// k-way merge as a tournament of the runs: neighbouring runs are merged pairwise, such that every hit is
+	// moved O(log runs) times in sequential passes
+	const auto descending = [](const PairHit& x, const PairHit& y) { return x.key > y.key; };
+	std::vector<PairHit>& runHits = pairRunHits[omp_get_thread_num()];
+	runHits.resize(hits.size());
+	while (runs.size() > 1)
+	{
+		size_t merged = 0;
+		for (size_t r = 0; r + 1 < runs.size(); r += 2)
+		{
+			std::merge(hits.begin() + runs[r].first, hits.begin() + runs[r].second, hits.begin() + runs[r + 1].first, hits.begin() + runs[r + 1].second, runHits.begin() + runs[r].first, descending);
+			runs[merged++] = std::make_pair(runs[r].first, runs[r + 1].second);
+		}
+		if (runs.size() % 2)
+		{
+			std::copy(hits.begin() + runs.back().first, hits.begin() + runs.back().second, runHits.begin() + runs.back().first);
+			runs[merged++] = runs.back();
+		}
+		runs.resize(merged);
+		hits.swap(runHits);
+	}
+	std::reverse(hits.begin(), hits.end());
+}
+
+
+
+
+
+inline bool ReadQueue::getSeedRefsPaired(const SeqView& seq1, const SeqView& seq2, const uint16_t qThreshold)
+{
+	Profiler::Scope profScope(prof, omp_get_thread_num(), Profiler::SEED);
+
+	auto& fwdMetaIDs_t = paired_fwdMetaIDs[omp_get_thread_num()];
+	auto& revMetaIDs_t = paired_revMetaIDs[omp_get_thread_num()];
+	// fresh maps of the initial size of getSeedRefsFirstRead, such that the windows are iterated in the same order
+	auto newFwdMetas = tsl::hopscotch_map<uint32_t, std::tuple<uint8_t, uint8_t, bool, bool>, MetaHash>(20);
+	auto newRevMetas = tsl::hopscotch_map<uint32_t, std::tuple<uint8_t, uint8_t, bool, bool>, MetaHash>(20);
+	fwdMetaIDs_t.swap(newFwdMetas);
+	revMetaIDs_t.swap(newRevMetas);
+	const bool useOffs = ref.hasKmerOffsets();
+	std::array<MetaCounter, 2>& fwdSpans = paired_fwdSpans[omp_get_thread_num()];
+	std::array<MetaCounter, 2>& revSpans = paired_revSpans[omp_get_thread_num()];
+	fwdSpans[0].clear();
+	revSpans[0].clear();
+	fwdSpans[1].clear();
+	revSpans[1].clear();
+
+	// windows of the first read passing the qgram lemma, a window counts all its hits if at least one of
+	// them is early (as the hash map of getSeedRefsFirstRead does)
+	std::vector<PairHit>& hits1 = pairHits[omp_get_thread_num()][0];
+	collectPairHits(seq1, qThreshold, true, hits1);
+	std::vector<PairWindow>& windows = pairWindows[omp_get_thread_num()];
+	windows.clear();
+	for (size_t a = 0, b = 0; a < hits1.size(); a = b)
+	{
+		bool early = false;
+		for (b = a; b < hits1.size() && hits1[b].key == hits1[a].key; ++b)
+			early |= hits1[b].early;
+		if (!early)
+			continue;
+		if (useOffs)
+		{
+			MetaCounter& spans = (hits1[a].key & 1) ? revSpans[0] : fwdSpans[0];
+			for (size_t h = a; h < b; ++h)
+				spans.add(static_cast<uint32_t>(hits1[h].key >> 1), hits1[h].end);
+		}
+		if (b - a >= qThreshold)
+			windows.push_back({hits1[a].key, static_cast<uint8_t>(b - a), 0, false});
+	}
+	if (windows.empty())
+		return false;
+
+	// how many windows we need to look for around current meta CpG, as a difference of keys
+	constexpr uint64_t contextKeys = 2 * ((int)(((double)MyConst::MAXPDIST / MyConst::WINLEN)) + 1);
+	std::vector<PairHit>& hits2 = pairHits[omp_get_thread_num()][1];
+	collectPairHits(seq2, qThreshold, false, hits2);
+	// sweep over the windows of the second read, next is the first window of the first read not lying more
+	// than contextWLen windows before the current one
+	const size_t firstNum = windows.size();
+	size_t next = 0;
+	for (size_t a = 0, b = 0; a < hits2.size(); a = b)
+	{
+		const uint64_t key = hits2[a].key;
+		uint32_t earlyNum = 0;
+		for (b = a; b < hits2.size() && hits2[b].key == key; ++b)
+			earlyNum += hits2[b].early;
+		while (next < firstNum && windows[next].key + contextKeys < key)
+			++next;
+		// a window of the first read within contextWLen windows on the same strand
+		bool near = false;
+		size_t own = firstNum;
+		for (size_t w = next; w < firstNum && windows[w].key <= key + contextKeys; ++w)
+		{
+			if ((windows[w].key & 1) == (key & 1))
+				near = true;
+			if (windows[w].key == key)
+				own = w;
+		}
+		if (!near)
+			continue;
+		const bool isFirst = own < firstNum;
+		// late hits only count for windows present already, which is any window with an early hit
+		if (!isFirst && earlyNum == 0)
+			continue;
+		if (useOffs)
+		{
+			MetaCounter& spans = (key & 1) ? revSpans[1] : fwdSpans[1];
+			for (size_t h = a; h < b; ++h)
+				spans.add(static_cast<uint32_t>(key >> 1), hits2[h].end);
+		}
+		const size_t count = b - a;
+		if (isFirst)
+			windows[own].count2 = static_cast<uint8_t>(count);
+		else
+			windows.push_back({key, 0, static_cast<uint8_t>(count), false});
+	}
+	std::inplace_merge(windows.begin(), windows.begin() + firstNum, windows.end(), [](const PairWindow& a, const PairWindow& b) { return a.key < b.key; });
+
+	// flag the windows with enough k-mers of the second read and their neighbours within contextWLen
+	for (size_t w = 0; w < windows.size(); ++w)
+	{
+		if (windows[w].count2 < qThreshold)
+			continue;
+		windows[w].flagged = true;
+		for (size_t n = w; n > 0 && windows[n - 1].key + contextKeys >= windows[w].key; --n)
+			windows[n - 1].flagged |= (windows[n - 1].key & 1) == (windows[w].key & 1);
+		for (size_t n = w + 1; n < windows.size() && windows[n].key <= windows[w].key + contextKeys; ++n)
+			windows[n].flagged |= (windows[n].key & 1) == (windows[w].key & 1);
+	}
+
+	bool hasCpG = false;
+	for (const PairWindow& w : windows)
+	{
+		const uint32_t metaId = static_cast<uint32_t>(w.key >> 1);
+		auto& metaIDs_t = (w.key & 1) ? revMetaIDs_t : fwdMetaIDs_t;
+		metaIDs_t[metaId] = std::make_tuple(w.count1, w.count2, w.flagged, false);
+		if (w.flagged && ref.metaWindows[metaId].startInd != MyConst::CPGDUMMY)
+			hasCpG = true;
+	}
+	return hasCpG;
+}
+
+
+
+
+
+
+template <size_t E>
 inline bool ReadQueue::extractSingleMatch(std::vector<MATCH::match>& fwdMatches, std::vector<MATCH::match>& revMatches, Read& r, std::string& revSeq)
 {
+	Profiler::Scope profScope(prof, omp_get_thread_num(), Profiler::EXTRACT);
 	// Construct artificial best match
-	MATCH::match bestMat = MATCH::constructMatch(0, MyConst::MISCOUNT + MyConst::ADDMIS + 1,0,0,0);
+	MATCH::match bestMat = MATCH::constructMatch(0, E + 1,0,0,0);
 	bool isUnique = true;
 	// indicates which of the reads had the best match
 	// 1 = original read
@@ -3199,21 +5644,21 @@ inline bool ReadQueue::extractSingleMatch(std::vector<MATCH::match>& fwdMatches,
 	// check if found match is unique
 	if (isUnique)
 	{
-		r.mat = bestMat;
+		r.mat = matchedReadID == 2 ? MATCH::setRevComp(bestMat) : bestMat;
 		if (matchedReadID == 1)
 		{
-			computeMethLvl(bestMat, r.seq);
+			computeMethLvl<E>(bestMat, r.seq, false);
 
 		} else if (matchedReadID == 2) {
 
-			computeMethLvl(bestMat, revSeq);
+			computeMethLvl<E>(bestMat, revSeq, true);
 		} else {
 			std::cerr << "You should not reach this code.\n\n";
 		}
 
 	} else {
 
-		r.isInvalid = true;
+		r.invalidate(UNMAPPED::NONUNIQUE);
 	}
 	return isUnique;
 }
@@ -3222,7 +5667,7 @@ inline bool ReadQueue::extractSingleMatch(std::vector<MATCH::match>& fwdMatches,
 
 
 
-inline int ReadQueue::extractPairedMatch(MATCH::match& mat1, MATCH::match& mat2)
+inline int ReadQueue::extractPairedMatch(const MATCH::match& mat1, const MATCH::match& mat2)
 {
 
 	// check if on same chromosome
@@ -3246,26 +5691,354 @@ inline int ReadQueue::extractPairedMatch(MATCH::match& mat1, MATCH::match& mat2)
 
 
 
+template <size_t E>
+inline bool ReadQueue::pairMatches(const std::vector<MATCH::match>& m1, const std::vector<MATCH::match>& m2, int& bestErrNum, MATCH::match& best1, MATCH::match& best2, bool& nonUnique)
+{
+	Profiler::Scope profScope(prof, omp_get_thread_num(), Profiler::EXTRACT);
+
+	if (m1.empty() || m2.empty())
+		return false;
+	std::vector<std::pair<uint64_t, uint32_t> >& keys1 = pairKeys[2 * omp_get_thread_num()];
+	std::vector<std::pair<uint64_t, uint32_t> >& keys2 = pairKeys[2 * omp_get_thread_num() + 1];
+	auto toKeys = [&](const std::vector<MATCH::match>& mats, std::vector<std::pair<uint64_t, uint32_t> >& keys)
+	{
+		keys.resize(mats.size());
+		for (uint32_t i = 0; i < mats.size(); ++i)
+		{
+			const metaWindow& w = ref.metaWindows[MATCH::getMetaID(mats[i])];
+			const uint32_t pos = w.startPos + MATCH::getOffset(mats[i]);
+			keys[i] = std::make_pair((static_cast<uint64_t>(w.chrom) << 32) | pos, i);
+		}
+		std::sort(keys.begin(), keys.end());
+	};
+	toKeys(m1, keys1);
+	toKeys(m2, keys2);
+
+	// matches of read 2 in the window [lo, hi) of keys2 per number of errors
+	constexpr uint64_t posMask = 0xffffffffULL;
+	const uint64_t maxDist = MyConst::MAXPDIST + MyConst::READLEN;
+	std::array<uint32_t, E + 1> errCount;
+	errCount.fill(0);
+	size_t lo = 0;
+	size_t hi = 0;
+	int minErr = 2 * E + 1;
+	uint32_t minCount = 0;
+	uint32_t minInd1 = 0;
+	for (const std::pair<uint64_t, uint32_t>& k1 : keys1)
+	{
+		const uint64_t chromBase = k1.first & ~posMask;
+		const uint64_t pos = k1.first & posMask;
+		for (; hi < keys2.size() && keys2[hi].first <= chromBase + std::min(pos + maxDist, posMask); ++hi)
+			++errCount[MATCH::getErrNum(m2[keys2[hi].second])];
+		for (; lo < hi && keys2[lo].first < chromBase + (pos > maxDist ? pos - maxDist : 0); ++lo)
+			--errCount[MATCH::getErrNum(m2[keys2[lo].second])];
+		// the fewest errors of a mate in the window decide
+		const int err1 = MATCH::getErrNum(m1[k1.second]);
+		for (int err2 = 0; err2 <= static_cast<int>(E) && err1 + err2 <= minErr; ++err2)
+		{
+			if (errCount[err2] == 0)
+				continue;
+			if (err1 + err2 < minErr)
+			{
+				minErr = err1 + err2;
+				minCount = 0;
+				minInd1 = k1.second;
+			}
+			minCount += errCount[err2];
+			break;
+		}
+	}
+
+	if (minCount == 0 || minErr > bestErrNum)
+		return false;
+	if (minErr == bestErrNum)
+	{
+		nonUnique = true;
+		return false;
+	}
+	bestErrNum = minErr;
+	nonUnique = minCount > 1;
+	// the mate of the best match of read 1, the only one unless the pair is not unique
+	best1 = m1[minInd1];
+	for (const MATCH::match& mat2 : m2)
+	{
+		if (extractPairedMatch(best1, mat2) == minErr)
+		{
+			best2 = mat2;
+			break;
+		}
+	}
+	return true;
+}
+
+template <size_t E>
+inline bool ReadQueue::matchPairRescue(const SeqView& seq1, const SeqView& seq2, ShiftAnd<E>& sa1, ShiftAnd<E>& sa2, std::vector<MATCH::match>& matches1, std::vector<MATCH::match>& matches2, const uint16_t qThreshold)
+{
+	auto& fwdMetaIDs_t = paired_fwdMetaIDs[omp_get_thread_num()];
+	auto& revMetaIDs_t = paired_revMetaIDs[omp_get_thread_num()];
+	getSeedRefsFirstRead(seq1, seq1.size(), qThreshold);
+	if (fwdMetaIDs_t.empty() && revMetaIDs_t.empty())
+		return false;
+
+	sa1.reload(seq1);
+	sa2.reload(seq2);
+	if (flagFirstReadWindows(qThreshold))
+	{
+		saQuerySeedSetRefFirst(sa1, matches1, qThreshold);
+		// the seeded path verifies read 1 in a subset of these windows, it finds no match either
+		if (matches1.empty())
+			return false;
+
+		MATCH::match anchor;
+		int otherErr;
+		if (confidentMatch(matches1, anchor, otherErr))
+		{
+			rescueMate(sa2, anchor, matches2);
+			// the rescued mate decides the pair only if it is unique and no other match of read 1 can form a pair
+			// with as few errors, otherwise pairMatches could pick another pair after seeding
+			uint8_t mateErr = E + 1;
+			uint32_t mateCount = 0;
+			for (const MATCH::match m : matches2)
+			{
+				if (MATCH::getErrNum(m) < mateErr)
+				{
+					mateErr = MATCH::getErrNum(m);
+					mateCount = 0;
+				}
+				mateCount += MATCH::getErrNum(m) == mateErr;
+			}
+			if (mateCount == 1 && static_cast<int>(MATCH::getErrNum(anchor) + mateErr) < otherErr)
+				return true;
+		}
+	}
+
+	// replay the seeded path of matchPairedReadsImpl: read 2 is seeded before read 1 is verified, since its seeds
+	// add the windows next to those of read 1 and flag the windows both reads are verified in
+	for (auto* metaIDs_t : {&fwdMetaIDs_t, &revMetaIDs_t})
+	{
+		for (auto mInfo = metaIDs_t->begin(); mInfo != metaIDs_t->end(); ++mInfo)
+		{
+			std::get<2>(mInfo.value()) = false;
+			std::get<3>(mInfo.value()) = false;
+		}
+	}
+	matches1.clear();
+	matches2.clear();
+	if (getSeedRefsSecondRead(seq2, seq2.size(), qThreshold))
+	{
+		saQuerySeedSetRefFirst(sa1, matches1, qThreshold);
+		if (!matches1.empty())
+			saQuerySeedSetRefSecond(sa2, matches2, qThreshold);
+	}
+	return false;
+}
+
+
+template <size_t E>
+inline void ReadQueue::matchPairSeeded(const SeqView& seq1, const SeqView& seq2, ShiftAnd<E>& sa1, ShiftAnd<E>& sa2, std::vector<MATCH::match>& matches1, std::vector<MATCH::match>& matches2, const uint16_t qThreshold)
+{
+	matches1.clear();
+	matches2.clear();
+	if (!MyConst::fusedPairs)
+	{
+		getSeedRefsFirstRead(seq1, seq1.size(), qThreshold);
+		if (paired_fwdMetaIDs[omp_get_thread_num()].empty() && paired_revMetaIDs[omp_get_thread_num()].empty())
+			return;
+	}
+	if (!(MyConst::fusedPairs ? getSeedRefsPaired(seq1, seq2, qThreshold) : getSeedRefsSecondRead(seq2, seq2.size(), qThreshold)))
+		return;
+	sa1.reload(seq1);
+	sa2.reload(seq2);
+	saQuerySeedSetRefFirst(sa1, matches1, qThreshold);
+	if (!matches1.empty())
+		saQuerySeedSetRefSecond(sa2, matches2, qThreshold);
+}
+
+
+inline bool ReadQueue::tierWindowsMatched(const std::vector<MATCH::match>& matches1, const std::vector<MATCH::match>& matches2, const uint16_t qThreshold)
+{
+	const auto hasMatch = [](const std::vector<MATCH::match>& mats, const uint32_t metaId, const bool isFwd)
+	{
+		return std::any_of(mats.begin(), mats.end(), [&](const MATCH::match& m) { return MATCH::getMetaID(m) == metaId && MATCH::isFwd(m) == isFwd; });
+	};
+	for (const bool isFwd : {true, false})
+	{
+		const auto& metaIDs_t = isFwd ? paired_fwdMetaIDs[omp_get_thread_num()] : paired_revMetaIDs[omp_get_thread_num()];
+		for (auto mInfo = metaIDs_t.begin(); mInfo != metaIDs_t.end(); ++mInfo)
+		{
+			// windows the first resp. second read may be verified in (see matchFwdFirst and matchFwdSecond)
+			if (std::get<2>(mInfo->second) && std::get<0>(mInfo->second) >= qThreshold && !hasMatch(matches1, mInfo->first, isFwd))
+				return false;
+			if (std::get<3>(mInfo->second) && std::get<1>(mInfo->second) >= qThreshold && !hasMatch(matches2, mInfo->first, isFwd))
+				return false;
+		}
+	}
+	return true;
+}
+
+
+inline bool ReadQueue::flagFirstReadWindows(const uint16_t qThreshold)
+{
+	bool hasCpG = false;
+	for (auto* metaIDs_t : {&paired_fwdMetaIDs[omp_get_thread_num()], &paired_revMetaIDs[omp_get_thread_num()]})
+	{
+		for (auto mInfo = metaIDs_t->begin(); mInfo != metaIDs_t->end(); ++mInfo)
+		{
+			if (std::get<0>(mInfo->second) >= qThreshold)
+			{
+				std::get<2>(mInfo.value()) = true;
+				hasCpG |= ref.metaWindows[mInfo->first].startInd != MyConst::CPGDUMMY;
+			}
+		}
+	}
+	return hasCpG;
+}
+
+
+inline bool ReadQueue::confidentMatch(const std::vector<MATCH::match>& mats, MATCH::match& anchor, int& otherErr)
+{
+	anchor = mats[0];
+	for (const MATCH::match m : mats)
+	{
+		if (MATCH::getErrNum(m) < MATCH::getErrNum(anchor))
+			anchor = m;
+	}
+	const uint64_t anchorPos = getMatchPos(anchor);
+	otherErr = std::numeric_limits<int>::max();
+	for (const MATCH::match m : mats)
+	{
+		// the same match found in the overlap of two windows
+		if (MATCH::isFwd(m) == MATCH::isFwd(anchor) && getMatchPos(m) == anchorPos && ref.metaWindows[MATCH::getMetaID(m)].chrom == ref.metaWindows[MATCH::getMetaID(anchor)].chrom)
+			continue;
+		otherErr = std::min<int>(otherErr, MATCH::getErrNum(m));
+	}
+	return otherErr >= static_cast<int>(MATCH::getErrNum(anchor)) + 2;
+}
+
+
+template <size_t E>
+inline void ReadQueue::rescueMate(ShiftAnd<E>& sa, const MATCH::match anchor, std::vector<MATCH::match>& mats)
+{
+	Profiler::Scope profScope(prof, omp_get_thread_num(), Profiler::SHIFTAND);
+
+	// windows of a chromosome are consecutive and overlap, the mate lies in the window of the anchor or a neighbour
+	constexpr int contextWLen = (int)(((double)MyConst::MAXPDIST / MyConst::WINLEN)) + 1;
+	const bool isFwd = MATCH::isFwd(anchor);
+	const uint32_t anchorId = MATCH::getMetaID(anchor);
+	const chromId chrom = ref.metaWindows[anchorId].chrom;
+	const int64_t anchorPos = getMatchPos(anchor);
+	// every mate whose last letter is at most MAXPDIST + READLEN letters away from the last letter of the anchor, in
+	// either direction, pairs with it (see extractPairedMatch)
+	constexpr int64_t maxDist = MyConst::MAXPDIST + MyConst::READLEN;
+	const int64_t minPos = anchorPos - maxDist;
+	const int64_t maxPos = anchorPos + maxDist;
+	const int32_t full = isFwd ? MyConst::WINLEN + E - 1 : MyConst::WINLEN + E;
+
+	std::array<PackedSeq::const_iterator, SALANES> startIts;
+	std::array<PackedSeq::const_iterator, SALANES> endIts;
+	std::array<std::vector<uint64_t>, SALANES>& laneMatchings = laneMatchBuf[omp_get_thread_num()];
+	std::array<std::vector<uint8_t>, SALANES>& laneErrors = laneErrBuf[omp_get_thread_num()];
+	std::array<uint32_t, SALANES> laneIds;
+	std::array<int32_t, SALANES> laneBase;
+	size_t lanes = 0;
+	static_assert(2 * contextWLen + 1 <= static_cast<int>(SALANES), "mate rescue queries all windows around the anchor at once");
+
+	for (int64_t id = static_cast<int64_t>(anchorId) - contextWLen; id <= static_cast<int64_t>(anchorId) + contextWLen; ++id)
+	{
+		if (id < 0 || id >= static_cast<int64_t>(ref.metaWindows.size()) || ref.metaWindows[id].chrom != chrom)
+			continue;
+		const metaWindow& w = ref.metaWindows[id];
+		// letters of all matches of the window whose end pairs with the anchor (see scanRange)
+		const int64_t lo = minPos - w.startPos;
+		const int64_t hi = maxPos - w.startPos;
+		std::pair<int32_t, int32_t> range(std::max<int64_t>(0, lo - static_cast<int64_t>(sa.size() + E) + 1), std::min<int64_t>(full, hi + E + 1));
+		// windowSlice cannot frame the first letter of a chromosome for the reverse strand without shifting the offsets
+		if (!isFwd && w.startPos + range.first == 0)
+			range.first = 1;
+		if (range.first >= range.second)
+			continue;
+		laneIds[lanes] = id;
+		laneBase[lanes] = range.first;
+		laneMatchings[lanes].clear();
+		laneErrors[lanes].clear();
+		windowSlice(id, range, isFwd, startIts[lanes], endIts[lanes]);
+		++lanes;
+	}
+	if (lanes == 0)
+		return;
+	if (isFwd)
+		sa.querySeqMulti(startIts, endIts, lanes, laneMatchings, laneErrors);
+	else
+		sa.queryRevSeqMulti(startIts, endIts, lanes, laneMatchings, laneErrors);
+
+	for (size_t l = 0; l < lanes; ++l)
+	{
+		const uint32_t startPos = ref.metaWindows[laneIds[l]].startPos;
+		for (size_t i = 0; i < laneMatchings[l].size(); ++i)
+		{
+			// matchings relative to the window
+			const uint64_t off = laneMatchings[l][i] + laneBase[l];
+			const int64_t pos = startPos + off;
+			if (pos < minPos || pos > maxPos)
+				continue;
+			// matches in the overlap of neighbouring windows are reported once
+			bool isDuplicate = false;
+			for (const MATCH::match m : mats)
+				isDuplicate |= static_cast<int64_t>(getMatchPos(m)) == pos;
+			if (!isDuplicate)
+				mats.push_back(MATCH::constructMatch(off, laneErrors[l][i], isFwd ? 1 : 0, 0, laneIds[l]));
+		}
+	}
+}
+
+
+
 
 
 
 
-inline void ReadQueue::computeMethLvl(MATCH::match& mat, std::string& seq)
+template <size_t E>
+inline void ReadQueue::computeMethLvl(MATCH::match& mat, SeqView seq, const bool revComp)
 {
 
+	// counted by countUnique unless it is a duplicate
+	if (dedup && !dedupPass)
+	{
+		const int t = omp_get_thread_num();
+		dedupReads[t].push_back({mat, threadRead[t], threadReadFlags[t], revComp, false, threadWeight[t]});
+		return;
+	}
+	Profiler::Scope profScope(prof, omp_get_thread_num(), Profiler::METHLVL);
+
 	// retrieve matched metaId
 	bool isFwd = MATCH::isFwd(mat);
 	uint32_t metaID = MATCH::getMetaID(mat);
 	uint16_t offset = MATCH::getOffset(mat);
 	uint8_t errNum = MATCH::getErrNum(mat);
+	// the genome of a combined index the read stems from is the one of the chromosome of its unique match
+	if (!genomeReads.empty())
+	{
+		const int t = omp_get_thread_num();
+		genomeReads[t][ref.genomeOf(ref.metaWindows[metaID].chrom)] += threadWeight[t];
+	}
 	// if no cpg in window, do not carry out alignment
 	if (ref.metaWindows[metaID].startInd == MyConst::CPGDUMMY)
 	{
+		if (!ctxLevels.empty() || !qcCounts.empty())
+			countAligned<E>(mat, seq, revComp);
 		return;
 	}
+	// position of the C of CpG id that reads are called at, from the window record if there is one
+	const int16_t* winCpGs = ref.hasWindowRecords() ? ref.windowCpGs(metaID) : nullptr;
+	const uint32_t winFirstCpG = ref.metaWindows[metaID].startInd;
+	const uint32_t winStart = ref.metaWindows[metaID].startPos;
+	const auto cpgPos = [&](const uint32_t id) -> uint32_t
+	{
+		return winCpGs ? winStart + winCpGs[id - winFirstCpG] : ref.cpgTable[id].pos + MyConst::READLEN - 2;
+	};
 
-	// if no errors -> simple lookup of sequences
-	if (errNum == 0)
+	// if no errors -> simple lookup of sequences, as well as for errors that are all mismatches
+	if (errNum == 0 || (MyConst::substitutionCalls && substitutionsOnly(mat, seq)))
 	{
 
 		// retrieve chromosome and position of match
@@ -3329,55 +6102,45 @@ inline void ReadQueue::computeMethLvl(MATCH::match& mat, std::string& seq)
 			uint32_t metaPos = m.startPos;
 			const uint32_t minPos = metaPos + offset - (seq.size() - 1);
 			const uint32_t maxPos = metaPos + offset;
-			for (uint32_t cpgId = m.startInd; cpgId <= m.endInd; ++cpgId)
+			// with window records the covered CpGs are counted in the CpG bitmap instead of checked one by one
+			uint32_t firstCpG = m.startInd;
+			uint32_t endCpG = m.endInd + 1;
+			if (winCpGs)
+			{
+				firstCpG += ref.windowCpGRank(metaID, minPos);
+				endCpG = m.startInd + ref.windowCpGRank(metaID, isFwd ? static_cast<int64_t>(maxPos) + 1 : maxPos);
+			}
+			for (uint32_t cpgId = firstCpG; cpgId < endCpG; ++cpgId)
 			{
 				// check if CpG is too far downstream of read match
 				// i.e. no overlap
-				if (ref.cpgTable[cpgId].pos + MyConst::READLEN - 2 < minPos)
+				if (cpgPos(cpgId) < minPos)
 					continue;
 				// check if too far upstream
 				if (isFwd)
 				{
-					if (ref.cpgTable[cpgId].pos + MyConst::READLEN - 2 > maxPos)
+					if (cpgPos(cpgId) > maxPos)
 						break;
 				} else {
-					if (ref.cpgTable[cpgId].pos + MyConst::READLEN - 1 > maxPos)
+					if (cpgPos(cpgId) + 1 > maxPos)
 						break;
 				}
 
 
 
 				// position of CpG in read
-				uint32_t readCpGPos = ref.cpgTable[cpgId].pos + MyConst::READLEN - 2 - (metaPos + offset - (seq.size() - 1));
+				uint32_t readCpGPos = cpgPos(cpgId) - (metaPos + offset - (seq.size() - 1));
+				if (!qcCounts.empty())
+					addMbias(seq, isFwd ? readCpGPos : seq.size() - readCpGPos - 2, revComp);
 				if (isFwd)
 				{
 					if (seq[readCpGPos] == 'T')
 					{
-#ifdef _OPENMP
-#pragma omp atomic
-#endif
-						++methLevels[cpgId].unmethFwd;
-						if (isSC)
-						{
-#ifdef _OPENMP
-#pragma omp atomic
-#endif
-							++methLevelsSc[cpgId].unmethFwd;
-						}
+						addMethEvent(cpgId, UNMETHFWD);
 					}
 					else if (seq[readCpGPos] == 'C')
 					{
-#ifdef _OPENMP
-#pragma omp atomic
-#endif
-						++methLevels[cpgId].methFwd;
-						if (isSC)
-						{
-#ifdef _OPENMP
-#pragma omp atomic
-#endif
-							++methLevelsSc[cpgId].methFwd;
-						}
+						addMethEvent(cpgId, METHFWD);
 					// TODO
 // 					} else {
 //
@@ -3394,31 +6157,11 @@ inline void ReadQueue::computeMethLvl(MATCH::match& mat, std::string& seq)
 
 					if (seq[seq.size() - readCpGPos - 2] == 'T')
 					{
-#ifdef _OPENMP
-#pragma omp atomic
-#endif
-						++methLevels[cpgId].unmethRev;
-						if (isSC)
-						{
-#ifdef _OPENMP
-#pragma omp atomic
-#endif
-							++methLevelsSc[cpgId].unmethRev;
-						}
+						addMethEvent(cpgId, UNMETHREV);
 					}
 					else  if (seq[seq.size() - readCpGPos - 2] == 'C')
 					{
-#ifdef _OPENMP
-#pragma omp atomic
-#endif
-						++methLevels[cpgId].methRev;
-						if (isSC)
-						{
-#ifdef _OPENMP
-#pragma omp atomic
-#endif
-							++methLevelsSc[cpgId].methRev;
-						}
+						addMethEvent(cpgId, METHREV);
 					// TODO
 // 					} else {
 //
@@ -3444,7 +6187,7 @@ inline void ReadQueue::computeMethLvl(MATCH::match& mat, std::string& seq)
 // 			const char* refSeq = ref.fullSeq[chrom].data() + offset;
 //
 // 			// init levenshtein DP algo
-// 			LevenshtDP<uint16_t, MyConst::MISCOUNT + MyConst::ADDMIS> lev(seq, refSeq);
+// 			LevenshtDP<uint16_t, E> lev(seq, refSeq);
 // 			std::vector<ERROR_T> alignment;
 //
 // 			// minimum position for overlap
@@ -3580,14 +6323,16 @@ inline void ReadQueue::computeMethLvl(MATCH::match& mat, std::string& seq)
 
 			// struct metaCpG& m = ref.metaCpGs[metaID];
 			metaWindow& m = ref.metaWindows[metaID];
-			uint8_t chrom = ref.cpgTable[m.startInd].chrom;
+			chromId chrom = m.chrom;
 			// uint32_t metaPos = ref.cpgTable[m.startInd].pos;
 			uint32_t metaPos = m.startPos;
 
-			const char* refSeq = ref.fullSeq[chrom].data() + metaPos + offset;
+			// the DP reads the reference backwards from refSeq, at most seq.size() + E letters
+			std::vector<char>& refWin = refWinBuf[omp_get_thread_num()];
+			refWin.resize(seq.size() + E);
+			ref.unpackNear(metaID, chrom, static_cast<std::ptrdiff_t>(metaPos + offset) - (seq.size() + E - 1), refWin.size(), refWin.data());
+			const char* refSeq = refWin.data() + refWin.size() - 1;
 
-			// init levenshtein DP algo
-			LevenshtDP<uint16_t, MyConst::MISCOUNT + MyConst::ADDMIS> lev(seq, refSeq);
 			std::vector<ERROR_T> alignment;
 
 			// minimum position for overlap
@@ -3596,21 +6341,26 @@ inline void ReadQueue::computeMethLvl(MATCH::match& mat, std::string& seq)
 			// positions of first/ last overlapping CpG
 			int32_t minIndex = m.startInd;
 			int32_t maxIndex = m.endInd;
-			for (int32_t cpgID = m.startInd; cpgID <= m.endInd; ++cpgID)
+			if (winCpGs)
+			{
+				minIndex += ref.windowCpGRank(metaID, minPos);
+				maxIndex = m.startInd + ref.windowCpGRank(metaID, static_cast<int64_t>(maxPos) + 1) - 1;
+			}
+			for (uint32_t cpgID = m.startInd; !winCpGs && cpgID <= m.endInd; ++cpgID)
 			{
-				if (ref.cpgTable[cpgID].pos + MyConst::READLEN - 2 < minPos)
+				if (cpgPos(cpgID) < minPos)
 				{
 					++minIndex;
 
 				} else if (isFwd)
 				{
-					if (ref.cpgTable[cpgID].pos + MyConst::READLEN - 2 > maxPos)
+					if (cpgPos(cpgID) > maxPos)
 					{
 						maxIndex = cpgID - 1;
 						break;
 					}
 				} else {
-					if (ref.cpgTable[cpgID].pos + MyConst::READLEN - 2 > maxPos)
+					if (cpgPos(cpgID) > maxPos)
 					{
 						maxIndex = cpgID - 1;
 						break;
@@ -3622,8 +6372,7 @@ inline void ReadQueue::computeMethLvl(MATCH::match& mat, std::string& seq)
 			{
 
 				// compute alignment
-				lev.runDPFill<CompiFwd>(cmpFwd);
-				lev.backtrackDP<CompiFwd>(cmpFwd, alignment);
+				alignToRef<E>(seq, refSeq, isFwd, errNum, alignment);
 				// current position in read and reference
 				uint32_t refSeqPos = metaPos + offset;
 				int32_t readSeqPos = seq.size() - 1;
@@ -3639,7 +6388,7 @@ inline void ReadQueue::computeMethLvl(MATCH::match& mat, std::string& seq)
 				for (int32_t cpgID = maxIndex; cpgID >= minIndex; --cpgID)
 				{
 					// align until this CpG
-					while (ref.cpgTable[cpgID].pos + MyConst::READLEN - 2 < refSeqPos && alignPos >= 0)
+					while (cpgPos(cpgID) < refSeqPos && alignPos >= 0)
 					{
 						switch (alignment[alignPos])
 						{
@@ -3674,37 +6423,19 @@ inline void ReadQueue::computeMethLvl(MATCH::match& mat, std::string& seq)
 					{
 						break;
 					}
+					if (!qcCounts.empty())
+						addMbias(seq, readSeqPos, revComp);
 					// check if we have a CpG aligned to the reference CpG
 					// if (seq[readSeqPos + 1] == 'G')
 					// {
 						// check for unmethylated C
 						if (seq[readSeqPos] == 'C')
 						{
-#ifdef _OPENMP
-#pragma omp atomic
-#endif
-							++methLevels[cpgID].methFwd;
-							if (isSC)
-							{
-#ifdef _OPENMP
-#pragma omp atomic
-#endif
-								++methLevelsSc[cpgID].methFwd;
-							}
+							addMethEvent(cpgID, METHFWD);
 						}
 						else if (seq[readSeqPos] == 'T')
 						{
-#ifdef _OPENMP
-#pragma omp atomic
-#endif
-							++methLevels[cpgID].unmethFwd;
-							if (isSC)
-							{
-#ifdef _OPENMP
-#pragma omp atomic
-#endif
-								++methLevelsSc[cpgID].unmethFwd;
-							}
+							addMethEvent(cpgID, UNMETHFWD);
 						// TODO
 // 						} else {
 //
@@ -3713,7 +6444,7 @@ inline void ReadQueue::computeMethLvl(MATCH::match& mat, std::string& seq)
 // #endif
 // 							{
 // 							hasShift = true;
-// 							std::cerr << "WHAT on fwd err!?\t" << seq[readSeqPos] << " should match " << ref.fullSeq[chrom].data()[refSeqPos] << " for CpG " << ref.fullSeq[chrom].data()[ref.cpgTable[cpgID].pos + MyConst::READLEN - 2] <<  "\n";
+// 							std::cerr << "WHAT on fwd err!?\t" << seq[readSeqPos] << " should match " << ref.fullSeq[chrom].data()[refSeqPos] << " for CpG " << ref.fullSeq[chrom].data()[cpgPos(cpgID)] <<  "\n";
 // 							std::cerr << "\tPos: " << readSeqPos << "\n";
 // 							std::cerr << "Sequence original/read:\n\t" << std::string(ref.fullSeq[chrom].data() + metaPos + offset - 100, 100) << "\n\t" << seq << "\n";
 // 							}
@@ -3727,12 +6458,10 @@ inline void ReadQueue::computeMethLvl(MATCH::match& mat, std::string& seq)
 
 			} else {
 
-				lev.runDPFillRev<CompiRev>(cmpRev);
-				lev.backtrackDPRev<CompiRev>(cmpRev, alignment);
+				alignToRef<E>(seq, refSeq, isFwd, errNum, alignment);
 				uint32_t refSeqPos = metaPos + offset;
 				int32_t readSeqPos = seq.size() - 1;
 				int32_t alignPos = alignment.size() - 1;
-				std::reverse(seq.begin(),seq.end());
 
 				// go through all overlapping CpGs from back,
 				// move through read and reference according to alignment
@@ -3743,7 +6472,7 @@ inline void ReadQueue::computeMethLvl(MATCH::match& mat, std::string& seq)
 				for (int32_t cpgID = maxIndex; cpgID >= minIndex; --cpgID)
 				{
 					// align until this CpG
-					while (ref.cpgTable[cpgID].pos + MyConst::READLEN - 2 < refSeqPos && alignPos >= 0)
+					while (cpgPos(cpgID) < refSeqPos && alignPos >= 0)
 					{
 						switch (alignment[alignPos])
 						{
@@ -3774,37 +6503,25 @@ inline void ReadQueue::computeMethLvl(MATCH::match& mat, std::string& seq)
 							continue;
 						--alignPos;
 					}
+					// the C of the CpG on the rev strand lies behind the end of the read
+					if (readSeqPos + 1 >= static_cast<int32_t>(seq.size()))
+						continue;
 					// check if we have a CpG aligned to the reference CpG
+					// the alignment runs over the read from its end, the read itself is left as it is (it may be
+					// the sequence of the batch, which is still needed)
+					const char readC = seq[seq.size() - 2 - readSeqPos];
+					if (!qcCounts.empty())
+						addMbias(seq, seq.size() - 2 - readSeqPos, revComp);
 					// if (seq[readSeqPos] == 'G')
 					// {
 						// check for unmethylated C
-						if (seq[readSeqPos + 1] == 'C')
+						if (readC == 'C')
 						{
-#ifdef _OPENMP
-#pragma omp atomic
-#endif
-							++methLevels[cpgID].methRev;
-							if (isSC)
-							{
-#ifdef _OPENMP
-#pragma omp atomic
-#endif
-								++methLevelsSc[cpgID].methRev;
-							}
+							addMethEvent(cpgID, METHREV);
 						}
-						else if (seq[readSeqPos + 1] == 'T')
+						else if (readC == 'T')
 						{
-#ifdef _OPENMP
-#pragma omp atomic
-#endif
-							++methLevels[cpgID].unmethRev;
-							if (isSC)
-							{
-#ifdef _OPENMP
-#pragma omp atomic
-#endif
-								++methLevelsSc[cpgID].unmethRev;
-							}
+							addMethEvent(cpgID, UNMETHREV);
 						// TODO
 						// } else {
                         //
@@ -3832,31 +6549,262 @@ inline void ReadQueue::computeMethLvl(MATCH::match& mat, std::string& seq)
 			}
 		// }
 	}
+	if (callOut.isOpen())
+		addReadCalls(mat, seq.size());
+	if (!ctxLevels.empty() || !qcCounts.empty())
+		countAligned<E>(mat, seq, revComp);
+}
+
+template <size_t E>
+inline unsigned int ReadQueue::alignToRef(SeqView seq, const char* refSeq, const bool isFwd, const unsigned int errNum, std::vector<ERROR_T>& alignment)
+{
+
+	static_assert(MyConst::ERRBUDGETS.back() <= 8, "ReadQueue::alignToRef: no band for error budgets above 8");
+	// a path leaving the band of errNum costs more than errNum errors, hence if the alignment in it has at most
+	// errNum errors, it is the one of the full band (same distances on it and same ties in the backtrack)
+	unsigned int dist = 0;
+	bool aligned;
+	switch (errNum)
+	{
+		case 1:
+			aligned = alignBand<std::min<size_t>(1, E), E>(seq, refSeq, isFwd, alignment, dist);
+			break;
+		case 2:
+			aligned = alignBand<std::min<size_t>(2, E), E>(seq, refSeq, isFwd, alignment, dist);
+			break;
+		case 3:
+			aligned = alignBand<std::min<size_t>(3, E), E>(seq, refSeq, isFwd, alignment, dist);
+			break;
+		case 4:
+			aligned = alignBand<std::min<size_t>(4, E), E>(seq, refSeq, isFwd, alignment, dist);
+			break;
+		case 5:
+			aligned = alignBand<std::min<size_t>(5, E), E>(seq, refSeq, isFwd, alignment, dist);
+			break;
+		case 6:
+			aligned = alignBand<std::min<size_t>(6, E), E>(seq, refSeq, isFwd, alignment, dist);
+			break;
+		case 7:
+			aligned = alignBand<std::min<size_t>(7, E), E>(seq, refSeq, isFwd, alignment, dist);
+			break;
+		default:
+			aligned = false;
+	}
+	if (!aligned)
+		alignBand<E, E>(seq, refSeq, isFwd, alignment, dist);
+	return dist;
+}
+
+template <size_t B, size_t E>
+inline bool ReadQueue::alignBand(SeqView seq, const char* refSeq, const bool isFwd, std::vector<ERROR_T>& alignment, unsigned int& dist)
+{
+
+	LevenshtDP<uint16_t, B> lev(seq, refSeq);
+	if (isFwd)
+		lev.template runDPFill<CompiFwd>(cmpFwd);
+	else
+		lev.template runDPFillRev<CompiRev>(cmpRev);
+	dist = lev.getEditDist();
+	if (dist > B && B < E)
+		return false;
+	if (isFwd)
+		lev.template backtrackDP<CompiFwd>(cmpFwd, alignment);
+	else
+		lev.template backtrackDPRev<CompiRev>(cmpRev, alignment);
+	return true;
+}
+
+inline bool ReadQueue::substitutionsOnly(const MATCH::match& mat, SeqView seq)
+{
+
+	const metaWindow& m = ref.metaWindows[MATCH::getMetaID(mat)];
+	// last reference letter of the match, the read is compared to the seq.size() letters up to it
+	const int64_t end = static_cast<int64_t>(m.startPos) + MATCH::getOffset(mat);
+	const int64_t start = end - static_cast<int64_t>(seq.size() - 1);
+	if (start < 0 || static_cast<uint64_t>(end) >= ref.fullSeq[m.chrom].size())
+		return false;
+	std::vector<char>& refWin = refWinBuf[omp_get_thread_num()];
+	refWin.resize(seq.size());
+	ref.unpackNear(MATCH::getMetaID(mat), m.chrom, start, seq.size(), refWin.data());
+	const unsigned int errNum = MATCH::getErrNum(mat);
+	unsigned int mismatches = 0;
+	// the reverse strand is read from the end of the read, as in the error path of computeMethLvl
+	if (MATCH::isFwd(mat))
+	{
+		for (size_t i = 0; i < seq.size() && mismatches <= errNum; ++i)
+			mismatches += cmpFwd(seq[i], refWin[i]);
+
+	} else {
+
+		for (size_t i = 0; i < seq.size() && mismatches <= errNum; ++i)
+			mismatches += cmpRev(seq[seq.size() - 1 - i], refWin[i]);
+	}
+	return mismatches <= errNum;
+}
+
+template <size_t E>
+inline void ReadQueue::countAligned(const MATCH::match& mat, SeqView seq, const bool revComp)
+{
+
+	const int t = omp_get_thread_num();
+	const bool isFwd = MATCH::isFwd(mat);
+	const metaWindow& m = ref.metaWindows[MATCH::getMetaID(mat)];
+	// last reference letter of the match
+	uint64_t end = static_cast<uint64_t>(m.startPos) + MATCH::getOffset(mat);
+	std::vector<ERROR_T>& alignment = ctxAlignBuf[t];
+	alignment.clear();
+	if (MATCH::getErrNum(mat) == 0)
+	{
+		alignment.resize(seq.size(), MATCHING);
+
+	} else {
+
+		// as in placeRead, the operations run from left to right on the forward strand for both strands
+		std::vector<char>& refWin = refWinBuf[t];
+		refWin.resize(seq.size() + E);
+		ref.unpackNear(MATCH::getMetaID(mat), m.chrom, static_cast<std::ptrdiff_t>(end) - (seq.size() + E - 1), refWin.size(), refWin.data());
+		const unsigned int dist = alignToRef<E>(seq, refWin.data() + refWin.size() - 1, isFwd, MATCH::getErrNum(mat), alignment);
+		end -= dist - std::count_if(alignment.begin(), alignment.end(), [](const ERROR_T a) { return a != MATCHING; });
+		// deletions at the ends are no part of the alignment
+		while (!alignment.empty() && alignment.back() == DELETION)
+			alignment.pop_back();
+		alignment.erase(alignment.begin(), std::find_if(alignment.begin(), alignment.end(), [](const ERROR_T a) { return a != DELETION; }));
+	}
+	const uint64_t refLen = std::count_if(alignment.begin(), alignment.end(), [](const ERROR_T a) { return a != INSERTION; });
+	if (end + 1 < refLen)
+		return;
+	const uint64_t refStart = end + 1 - refLen;
+
+	// non CpG sites of the sequence, the aligned letters and the sites are walked side by side
+	const bool countSites = !ctxLevels.empty();
+	const uint32_t* sites = ref.ctxSites.data();
+	const uint64_t sitesEnd = countSites ? ref.ctxStart[m.chrom + 1] : 0;
+	uint64_t s = countSites ? std::lower_bound(sites + ref.ctxStart[m.chrom], sites + sitesEnd, refStart) - sites : 0;
+	// a read covers the sites of one strand, forward strand reads the Cs, reverse strand reads the Gs
+	const uint8_t strand = isFwd ? 0 : RefGenome::CTX_REV;
+	const uint32_t weight = threadWeight[t];
+
+	// the QC looks at the reference letters around the aligned ones
+	QcCounts* qc = qcCounts.empty() ? nullptr : &qcCounts[t];
+	const char* refLetters = nullptr;
+	unsigned int mate = 0;
+	if (qc)
+	{
+		std::vector<char>& refWin = refWinBuf[t];
+		refWin.resize(refLen + 4);
+		ref.unpackNear(MATCH::getMetaID(mat), m.chrom, static_cast<std::ptrdiff_t>(refStart) - 2, refWin.size(), refWin.data());
+		refLetters = refWin.data() + 2;
+		mate = (threadReadFlags[t] & READCALLS::MATE2) ? 1 : 0;
+		if (qc->readLens[mate].size() <= seq.size())
+			qc->readLens[mate].resize(seq.size() + 1, 0);
+		qc->readLens[mate][seq.size()] += weight;
+		if (qc->readErrs[mate].size() <= MATCH::getErrNum(mat))
+			qc->readErrs[mate].resize(MATCH::getErrNum(mat) + 1, 0);
+		qc->readErrs[mate][MATCH::getErrNum(mat)] += weight;
+	}
+
+	uint64_t refPos = refStart;
+	size_t j = 0;
+	for (const ERROR_T op : alignment)
+	{
+		if (op == INSERTION)
+		{
+			++j;
+			continue;
+		}
+		if (op == DELETION)
+		{
+			++refPos;
+			continue;
+		}
+		// index of the letter in seq and the base read there, C for methylated and T for converted
+		const size_t k = isFwd ? j : seq.size() - 1 - j;
+		const char c = seq[k];
+		if (c == 'C' || c == 'T')
+		{
+			if (countSites)
+			{
+				while (s < sitesEnd && sites[s] < refPos)
+					++s;
+				if (s < sitesEnd && sites[s] == refPos && (ref.ctxTypes[s] & RefGenome::CTX_REV) == strand)
+				{
+					std::vector<uint64_t>& events = ctxEvents[t][s / ctxBucketSize];
+					events.insert(events.end(), weight, (s << 1) | (c == 'T'));
+				}
+			}
+			if (qc)
+			{
+				const char* r = refLetters + (refPos - refStart);
+				// cytosine of the strand of the read outside of a CpG (these count for the M-bias, see addMbias)
+				if (isFwd ? r[0] == 'C' : r[0] == 'G')
+				{
+					const char next = isFwd ? r[1] : r[-1];
+					if (next != (isFwd ? 'G' : 'C') && next != 'N')
+						qc->conversion[m.chrom][c == 'T'] += weight;
+				}
+			}
+		}
+		++j;
+		++refPos;
+	}
+}
+
+inline void ReadQueue::addMbias(SeqView seq, const size_t k, const bool revComp)
+{
+
+	const char c = seq[k];
+	if (c != 'C' && c != 'T')
+		return;
+	const unsigned int t = omp_get_thread_num();
+	QcCounts& qc = qcCounts[t];
+	const unsigned int mate = (threadReadFlags[t] & READCALLS::MATE2) ? 1 : 0;
+	if (qc.mbias[mate].size() < seq.size())
+		qc.mbias[mate].resize(seq.size(), {{0, 0}});
+	// position in the read as sequenced
+	qc.mbias[mate][revComp ? seq.size() - 1 - k : k][c == 'T'] += threadWeight[t];
+}
+
+inline void ReadQueue::addInsertSize(const MATCH::match& mat1, const size_t len1, const MATCH::match& mat2, const size_t len2)
+{
+
+	// ends of the matches on the forward strand, the fragment reaches from the first start to the last end
+	const uint64_t end1 = static_cast<uint64_t>(ref.metaWindows[MATCH::getMetaID(mat1)].startPos) + MATCH::getOffset(mat1);
+	const uint64_t end2 = static_cast<uint64_t>(ref.metaWindows[MATCH::getMetaID(mat2)].startPos) + MATCH::getOffset(mat2);
+	const uint64_t start = std::min(end1 + 1 - std::min<uint64_t>(len1, end1 + 1), end2 + 1 - std::min<uint64_t>(len2, end2 + 1));
+	const uint64_t len = std::max(end1, end2) + 1 - start;
+	std::vector<uint64_t>& hist = qcCounts[omp_get_thread_num()].insertSizes;
+	if (hist.size() <= len)
+		hist.resize(len + 1, 0);
+	hist[len] += threadWeight[omp_get_thread_num()];
 }
 
 
-inline bool ReadQueue::matchFwdFirst(std::pair<uint32_t, std::tuple<uint8_t, uint8_t, bool, bool> >& meta, uint8_t& prevChr, uint64_t& prevOff, std::vector<MATCH::match>& mats, int32_t& bmCount, uint16_t qThreshold, ShiftAnd<MyConst::MISCOUNT + MyConst::ADDMIS>& sa)
+template <size_t E>
+inline bool ReadQueue::matchFwdFirst(std::pair<uint32_t, std::tuple<uint8_t, uint8_t, bool, bool> >& meta, chromId& prevChr, uint64_t& prevOff, std::vector<MATCH::match>& mats, int32_t& bmCount, uint16_t qThreshold, ShiftAnd<E>& sa)
 {
 	constexpr int contextWLen = (int)(((double)MyConst::MAXPDIST / MyConst::WINLEN)) + 1;
 	auto& fwdMetaIDs_t = paired_fwdMetaIDs[omp_get_thread_num()];
-	if (std::get<0>(meta.second) < std::max(bmCount - (int32_t)MyConst::KMERDIST, (int32_t)qThreshold))
+	if (std::get<0>(meta.second) < std::max(bmCount - (int32_t)MyConst::kmerDist, (int32_t)qThreshold))
 		return false;
 	if (!std::get<2>(meta.second))
 		return true;
 	auto& mIt = fwdMetaIDs_t[meta.first];
 
-	auto startIt = ref.fullSeq[ref.metaWindows[meta.first].chrom].begin() + ref.metaWindows[meta.first].startPos;
-	auto endIt = ref.fullSeq[ref.metaWindows[meta.first].chrom].begin() + ref.metaWindows[meta.first].startPos + MyConst::WINLEN + MyConst::MISCOUNT + MyConst::ADDMIS - 1;
-	if (endIt > ref.fullSeq[ref.metaWindows[meta.first].chrom].end())
-	{
-		endIt = ref.fullSeq[ref.metaWindows[meta.first].chrom].end();
-	}
+	const std::pair<int32_t, int32_t> range = scanRange(paired_fwdSpans[omp_get_thread_num()][0], meta.first, sa.size(), true);
+	PackedSeq::const_iterator startIt;
+	PackedSeq::const_iterator endIt;
+	windowSlice(meta.first, range, true, startIt, endIt);
 
 	// use shift and to find all matchings
-	std::vector<uint64_t> matchings;
-	std::vector<uint8_t> errors;
+	std::vector<uint64_t>& matchings = saMatchings[omp_get_thread_num()];
+	std::vector<uint8_t>& errors = saErrors[omp_get_thread_num()];
+	matchings.clear();
+	errors.clear();
 
 	sa.querySeq(startIt, endIt, matchings, errors);
+	// matchings relative to the window
+	for (uint64_t& m : matchings)
+		m += range.first;
 
 	size_t i = 0;
 	// compare first found match with last found match of previous meta CpG
@@ -3902,37 +6850,35 @@ inline bool ReadQueue::matchFwdFirst(std::pair<uint32_t, std::tuple<uint8_t, uin
 
 
 
-inline bool ReadQueue::matchRevFirst(std::pair<uint32_t, std::tuple<uint8_t, uint8_t, bool, bool> >& meta, uint8_t& prevChr, uint64_t& prevOff, std::vector<MATCH::match>& mats, int32_t& bmCount, uint16_t qThreshold, ShiftAnd<MyConst::MISCOUNT + MyConst::ADDMIS>& sa)
+template <size_t E>
+inline bool ReadQueue::matchRevFirst(std::pair<uint32_t, std::tuple<uint8_t, uint8_t, bool, bool> >& meta, chromId& prevChr, uint64_t& prevOff, std::vector<MATCH::match>& mats, int32_t& bmCount, uint16_t qThreshold, ShiftAnd<E>& sa)
 {
 	constexpr int contextWLen = (int)(((double)MyConst::MAXPDIST / MyConst::WINLEN)) + 1;
 	auto& revMetaIDs_t = paired_revMetaIDs[omp_get_thread_num()];
 
-	if (std::get<0>(meta.second) < std::max(bmCount - (int32_t)MyConst::KMERDIST, (int32_t)qThreshold))
+	if (std::get<0>(meta.second) < std::max(bmCount - (int32_t)MyConst::kmerDist, (int32_t)qThreshold))
 		return false;
 	if (!std::get<2>(meta.second))
 		return true;
 
 	auto& mIt = revMetaIDs_t[meta.first];
 
+	const std::pair<int32_t, int32_t> range = scanRange(paired_revSpans[omp_get_thread_num()][0], meta.first, sa.size(), false);
 	// retrieve sequence
-	auto endIt = ref.fullSeq[ref.metaWindows[meta.first].chrom].begin();
-
-	if (ref.metaWindows[meta.first].startPos > 0)
-	{
-		endIt += ref.metaWindows[meta.first].startPos - 1;
-	}
-
-	auto startIt = ref.fullSeq[ref.metaWindows[meta.first].chrom].begin() + ref.metaWindows[meta.first].startPos + MyConst::WINLEN + MyConst::MISCOUNT + MyConst::ADDMIS - 1;
-	if (startIt >= ref.fullSeq[ref.metaWindows[meta.first].chrom].end())
-	{
-		startIt = ref.fullSeq[ref.metaWindows[meta.first].chrom].end() - 1;
-	}
+	PackedSeq::const_iterator startIt;
+	PackedSeq::const_iterator endIt;
+	windowSlice(meta.first, range, false, startIt, endIt);
 
 	// use shift and to find all matchings
-	std::vector<uint64_t> matchings;
-	std::vector<uint8_t> errors;
+	std::vector<uint64_t>& matchings = saMatchings[omp_get_thread_num()];
+	std::vector<uint8_t>& errors = saErrors[omp_get_thread_num()];
+	matchings.clear();
+	errors.clear();
 
 	sa.queryRevSeq(startIt, endIt, matchings, errors);
+	// matchings relative to the window
+	for (uint64_t& m : matchings)
+		m += range.first;
 
 	size_t i = 0;
 	// compare first found match with last found match of previous meta CpG
@@ -3975,24 +6921,28 @@ inline bool ReadQueue::matchRevFirst(std::pair<uint32_t, std::tuple<uint8_t, uin
 }
 
 
-inline bool ReadQueue::matchFwdSecond(std::pair<uint32_t, std::tuple<uint8_t, uint8_t, bool, bool> >& meta, uint8_t& prevChr, uint64_t& prevOff, std::vector<MATCH::match>& mats, int32_t& bmCount, uint16_t qThreshold, ShiftAnd<MyConst::MISCOUNT + MyConst::ADDMIS>& sa)
+template <size_t E>
+inline bool ReadQueue::matchFwdSecond(std::pair<uint32_t, std::tuple<uint8_t, uint8_t, bool, bool> >& meta, chromId& prevChr, uint64_t& prevOff, std::vector<MATCH::match>& mats, int32_t& bmCount, uint16_t qThreshold, ShiftAnd<E>& sa)
 {
-	if (std::get<1>(meta.second) < std::max(bmCount - (int32_t)MyConst::KMERDIST, (int32_t)qThreshold))
+	if (std::get<1>(meta.second) < std::max(bmCount - (int32_t)MyConst::kmerDist, (int32_t)qThreshold))
 		return false;
 	if (!std::get<3>(meta.second))
 		return true;
 
-	auto startIt = ref.fullSeq[ref.metaWindows[meta.first].chrom].begin() + ref.metaWindows[meta.first].startPos;
-	auto endIt = ref.fullSeq[ref.metaWindows[meta.first].chrom].begin() + ref.metaWindows[meta.first].startPos + MyConst::WINLEN + MyConst::MISCOUNT + MyConst::ADDMIS - 1;
-	if (endIt > ref.fullSeq[ref.metaWindows[meta.first].chrom].end())
-	{
-		endIt = ref.fullSeq[ref.metaWindows[meta.first].chrom].end();
-	}
+	const std::pair<int32_t, int32_t> range = scanRange(paired_fwdSpans[omp_get_thread_num()][1], meta.first, sa.size(), true);
+	PackedSeq::const_iterator startIt;
+	PackedSeq::const_iterator endIt;
+	windowSlice(meta.first, range, true, startIt, endIt);
 
 	// use shift and to find all matchings
-	std::vector<uint64_t> matchings;
-	std::vector<uint8_t> errors;
+	std::vector<uint64_t>& matchings = saMatchings[omp_get_thread_num()];
+	std::vector<uint8_t>& errors = saErrors[omp_get_thread_num()];
+	matchings.clear();
+	errors.clear();
 	sa.querySeq(startIt, endIt, matchings, errors);
+	// matchings relative to the window
+	for (uint64_t& m : matchings)
+		m += range.first;
 
 	size_t i = 0;
 	// compare first found match with last found match of previous meta CpG
@@ -4025,25 +6975,29 @@ inline bool ReadQueue::matchFwdSecond(std::pair<uint32_t, std::tuple<uint8_t, ui
 }
 
 
-inline bool ReadQueue::matchRevSecond(std::pair<uint32_t, std::tuple<uint8_t, uint8_t, bool, bool> >& meta, uint8_t& prevChr, uint64_t& prevOff, std::vector<MATCH::match>& mats, int32_t& bmCount, uint16_t qThreshold, ShiftAnd<MyConst::MISCOUNT + MyConst::ADDMIS>& sa)
+template <size_t E>
+inline bool ReadQueue::matchRevSecond(std::pair<uint32_t, std::tuple<uint8_t, uint8_t, bool, bool> >& meta, chromId& prevChr, uint64_t& prevOff, std::vector<MATCH::match>& mats, int32_t& bmCount, uint16_t qThreshold, ShiftAnd<E>& sa)
 {
-	if (std::get<1>(meta.second) < std::max(bmCount - (int32_t)MyConst::KMERDIST, (int32_t)qThreshold))
+	if (std::get<1>(meta.second) < std::max(bmCount - (int32_t)MyConst::kmerDist, (int32_t)qThreshold))
 		return false;
 	if (!std::get<3>(meta.second))
 		return true;
 
+	const std::pair<int32_t, int32_t> range = scanRange(paired_revSpans[omp_get_thread_num()][1], meta.first, sa.size(), false);
 	// retrieve sequence
-	auto endIt = ref.fullSeq[ref.metaWindows[meta.first].chrom].begin() + ref.metaWindows[meta.first].startPos - 1;
-	auto startIt = ref.fullSeq[ref.metaWindows[meta.first].chrom].begin() + ref.metaWindows[meta.first].startPos + MyConst::WINLEN + MyConst::MISCOUNT + MyConst::ADDMIS - 1;
-	if (startIt >= ref.fullSeq[ref.metaWindows[meta.first].chrom].end())
-	{
-		startIt = ref.fullSeq[ref.metaWindows[meta.first].chrom].end() - 1;
-	}
+	PackedSeq::const_iterator startIt;
+	PackedSeq::const_iterator endIt;
+	windowSlice(meta.first, range, false, startIt, endIt);
 
 	// use shift and to find all matchings
-	std::vector<uint64_t> matchings;
-	std::vector<uint8_t> errors;
+	std::vector<uint64_t>& matchings = saMatchings[omp_get_thread_num()];
+	std::vector<uint8_t>& errors = saErrors[omp_get_thread_num()];
+	matchings.clear();
+	errors.clear();
 	sa.queryRevSeq(startIt, endIt, matchings, errors);
+	// matchings relative to the window
+	for (uint64_t& m : matchings)
+		m += range.first;
 
 	size_t i = 0;
 	// compare first found match with last found match of previous meta CpG
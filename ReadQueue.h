@@ -24,6 +24,11 @@
 #include <array>
 #include <algorithm> // reverse, sort
 #include <numeric> // iota
+#include <limits>
+#include <cmath> // ceil
+#include <chrono>
+#include <unordered_map>
+#include <memory>
 
 #ifdef _OPENMP
 #include <omp.h>
@@ -31,13 +36,23 @@
 
 // #include <sparsehash/dense_hash_map>
 #include <hopscotch_map.h>
+#include <hopscotch_set.h>
 
-#include "gzstream/gzstream.h"
 #include "CONST.h"
 #include "RefGenome.h"
 #include "Read.h"
+#include "FastqReader.h"
+#include "ReadSource.h"
+#include "CellBarcodes.h"
+#include "CellCounts.h"
+#include "FastqWriter.h"
+#include "Profiler.h"
+#include "MetaCounter.h"
+#include "MethWriter.h"
 #include "ShiftAnd.h"
 #include "LevenshtDP.h"
+#include "DeviceVerify.h"
+#include "RefReader_istr.h"
 
 
 class ReadQueue
@@ -51,42 +66,104 @@ class ReadQueue
         ReadQueue() = delete;
 
         // ARGUMENTS:
-        //          filePath    path to file containing reads in fastq format
+        //          filePaths   paths to the files containing the reads of the sample in fastq format (e.g. one per
+        //                      lane), read back to back as if they were concatenated
         //          ref         internal representation of reference genome
         //          isGZ        flag - true iff file is gzipped
 		//          bsFlag		flag - true iff there is no orientation of the read (i.e. could be C->T or G->A converted)
-        ReadQueue(const char* filePath, RefGenome& ref, const bool isGZ, const bool bsFlag);
+        ReadQueue(const std::vector<std::string>& filePaths, RefGenome& ref, const bool isGZ, const bool bsFlag);
 
         // for paired end
         // ARGUMENTS:
-        //          filePath    path to file containing read1 of paired reads in fastq format
-        //          filePath2   path to file containing read2 of paired reads in fastq format
+        //          filePaths   paths to the files containing read1 of paired reads in fastq format
+        //          filePaths2  paths to the files containing read2 of paired reads in fastq format, one per file of
+        //                      filePaths; if empty, the files of filePaths are interleaved (read 1 and read 2
+        //                      of a pair in consecutive records)
         //          ref         internal representation of reference genome
         //          isGZ        flag - true iff file is gzipped
 		//          bsFlag		flag - true iff there is no orientation of read 1 of the read pair
         //
         // NOTE:
         //          provided files are ASSUMED to have equal number of reads in correct (paired) order!
-        ReadQueue(const char* filePath, const char* filePath2, RefGenome& reference, const bool isGZ, const bool bsFlag);
+        ReadQueue(const std::vector<std::string>& filePaths, const std::vector<std::string>& filePaths2, RefGenome& reference, const bool isGZ, const bool bsFlag);
+        // for reads that are not parsed from files but pushed into getReads() (and getReads2()) by the caller before
+        // every call to matchReads(...) or matchPairedReads(...); parseChunk(...) must not be called unless a source
+        // is set (see setSource)
+        // ARGUMENTS:
+        //          ref         internal representation of reference genome
+        //          isP         flag - true iff reads are paired
+        //          bsFlag      flag - true iff there is no orientation of the read (of read 1 of a pair)
+        ReadQueue(RefGenome& reference, const bool isP, const bool bsFlag);
 		// for single cell paired end
 		// ARGUMENTS:
 		// 			...
 		// 			scOutputPath	path to file which will contain single cell counts after processing
 		// 			isP				flag if reads are paired
-		ReadQueue(const char* scOutputPath, RefGenome& reference, const bool isGZ, const bool bsFlag, const bool isP);
+		// 			scFormat		format of the single cell output, TSV or BGZF
+		// 			sparse			flag - true iff single cell counts are written as one line per covered CpG
+		ReadQueue(const char* scOutputPath, RefGenome& reference, const bool isGZ, const bool bsFlag, const bool isP, const METHFILE::FORMAT scFormat, const bool sparse);
 
         // -----------
 
-        // Parses a chunk of the ifstream file/ igzstream file, respectively
-        // Reads up to MyConst::CHUNKSIZE many reads and saves them
+        // Parses a chunk of the (gzipped) read file(s) given to the Ctor
+        // Reads up to MyConst::chunkSize many reads and saves them
         // ARGUMENT:
         //          procReads   will contain number of reads that have been read into buffer
         // returns true if neither read error nor EOF occured, false otherwise
         bool parseChunk(unsigned int& procReads);
         bool parseChunkGZ(unsigned int& procReads);
+        // chunks are taken from src instead of the read files (see ReadSource), nullptr for the files again;
+        // src must outlive its use by parseChunk(...)
+        inline void setSource(ReadSource* src) { source = src; }
+        // parsed reads keep their ids (names) only for the outputs that write them (see openAlignments,
+        // openUnmapped), this keeps them also without, e.g. to check the reads against their names
+        inline void keepIds() { idsKept = true; }
+
+        // position in the files of the sample, see CHECKPOINT::header
+        struct InputPos {
+            uint64_t fileIdx;
+            uint64_t records;
+            uint64_t offset;
+            uint64_t records2;
+            uint64_t offset2;
+        };
+        // a chunk of reads (pairs) passed through the stages of the pipeline of queryRoutine (see Pipeline.h)
+        struct Batch
+        {
+            ReadBatch reads;
+            // second reads of pairs
+            ReadBatch reads2;
+            unsigned int count;
+            // input position after the chunk
+            InputPos pos;
+            // records of the alignment output and of the unaligned reads, see formatBatch
+            std::string alignText;
+            std::string unmappedText;
+            // read level methylation calls of the reads, taken over from the matching threads (see openReadCalls)
+            std::string callText;
+            // reference window of the alignment of a read
+            std::vector<char> refWin;
+        };
+        // Same as parseChunk, but parses into b, such that the next chunk can be read while others are matched
+        // RETURN:  true if neither read error nor EOF occured, false otherwise
+        bool parseBatch(Batch& b);
+        // exchanges the reads of b and the read buffers, matchReads(...) matches the reads of b between two calls
+        void swapBatch(Batch& b);
+        // true iff matched batches are written by formatBatch and writeBatch (see openAlignments, openUnmapped)
+        inline bool hasOutput() const { return alignOut.isOpen() || unmappedOut.isOpen() || callOut.isOpen(); }
+        // formats the alignments and unaligned reads of the matched batch b, runs on any thread and independent of
+        // the matching
+        void formatBatch(Batch& b);
+        // writes the records of b formatted by formatBatch, batches must be written in input order
+        void writeBatch(Batch& b);
 
 		// Decides to which strand r1 should always be matched against
 		void decideStrand();
+		// Decides the strand from a sample of the procReads reads (read 1 of pairs) in the read buffer instead of
+		// matching a whole batch with getStranded: the reads are aligned to both strands without output in rounds of
+		// MyConst::STRANDROUND until a sequential test on the counts of r1FwdMatches and r1RevMatches is decided,
+		// then decideStrand() is called
+		void sampleStrand(const unsigned int& procReads);
 
         // Match all reads in readBuffer to reference genome
         // ARGUMENT:
@@ -98,9 +175,131 @@ class ReadQueue
         bool matchReads(const unsigned int& procReads, uint64_t& succMatch, uint64_t& nonUniqueMatch, uint64_t& unSuccMatch, const bool getStranded);
         bool matchPairedReads(const unsigned int& procReads, uint64_t& succMatch, uint64_t& nonUniqueMatch, uint64_t& unSuccMatch, uint64_t& succPairedMatch, uint64_t& tooShortCountMatch, const bool getStranded);
 
-		// Match batch of single cell reads given by file
-		bool matchSCBatch(const char* scFile, const std::string scId, const bool isGZ);
-		bool matchSCBatchPaired(const char* scFile1, const char* scFile2, const std::string scId, const bool isGZ);
+        // prints the time the threads spent matching and waiting for the slowest thread
+        // at the end of the batches matched so far
+        void printThreadTiming();
+
+        // number of reads that took the result of an identical read of their batch (see MyConst::readCache)
+        inline uint64_t getCachedReads() const { return cachedReads; }
+
+        // the counts one batch adds to a CpG
+        struct MethDelta
+        {
+            uint64_t cpgId;
+            uint32_t methFwd;
+            uint32_t unmethFwd;
+            uint32_t methRev;
+            uint32_t unmethRev;
+        };
+        // keep the methylation events of the matched batches until takeMethDeltas(...), besides counting them
+        inline void collectMethDeltas(const bool collect) { keepMethDeltas = collect; }
+        // moves the counts of all events kept since the last call into deltas, one entry per CpG covered, sorted by
+        // CpG id (see collectMethDeltas)
+        void takeMethDeltas(std::vector<MethDelta>& deltas);
+
+        // reads of the chunk matched by the last call to matchReads(...)
+        // read i has a unique match iff !isInvalid, the match is then stored in mat
+        inline ReadBatch& getReads() { return readBuffer; }
+        // second reads of the pairs matched by the last call to matchPairedReads(...)
+        inline ReadBatch& getReads2() { return readBuffer2; }
+        // forward strand position of the last reference letter aligned to the read matched at mat
+        inline uint64_t getMatchPos(const MATCH::match& mat)
+        {
+            return ref.metaWindows[MATCH::getMetaID(mat)].startPos + MATCH::getOffset(mat);
+        }
+        // name of the chromosome of the read matched at mat
+        inline const std::string& getMatchChrom(const MATCH::match& mat)
+        {
+            return ref.chrMap.at(ref.metaWindows[MATCH::getMetaID(mat)].chrom);
+        }
+        // getMatchPos(mat) in the coordinates of the chromosome named getMatchChrom(mat) (see RefGenome::chrOffsets)
+        inline uint64_t getMatchChromPos(const MATCH::match& mat)
+        {
+            return ref.chrOffsets[ref.metaWindows[MATCH::getMetaID(mat)].chrom] + getMatchPos(mat);
+        }
+
+        // enables the per stage profiling of the matching threads, parsing and output (see Profiler), with
+        // hardware counters per stage iff counters
+        void enableProfiling(const bool counters);
+        // writes the profile collected since enableProfiling() as tab separated table, terminates on failure
+        void writeProfile(const std::string& path);
+
+        // comparison of read and reference letters for the alignment (LevenshtDP), 0 iff match
+        // forward strand
+        struct CompiFwd {
+
+            inline uint16_t operator() (const char& cRead, const char& cRef)
+            {
+                // bisulfite antisymmetry
+                if (cRead == 'T')
+                {
+                    if (cRef == 'C')
+                        return 0;
+                }
+                return cRead == cRef ? 0 : 1;
+            }
+
+        };
+        // reverse complement matching using the original strand
+        struct CompiRev {
+
+            inline uint16_t operator() (const char& cRead, const char& cRef)
+            {
+                switch (cRead)
+                {
+                    case ('T') :
+                        // bisulfite antisymmetry
+                        if (cRef == 'A' || cRef == 'G')
+                            return 0;
+                        break;
+                    case ('G') :
+                        if (cRef == 'C')
+                            return 0;
+                        break;
+                    case ('A'):
+                        if (cRef == 'T')
+                            return 0;
+                        break;
+                    case ('C'):
+                        if (cRef == 'G')
+                            return 0;
+                        break;
+                }
+
+                return 1;
+            }
+
+        };
+
+		// a single cell as given in the single cell meta file
+		struct scCell
+		{
+			std::string id;
+			// read file (of first reads if paired)
+			std::string file1;
+			// file of second reads, empty if not paired
+			std::string file2;
+		};
+		// Match the reads of all given cells
+		// Batches are filled with the reads of as many cells as fit, each read is tagged with its cell
+		// such that small cells do not leave threads idle. The counts of a cell are written by
+		// printSCMethylationLevels as soon as all its reads are matched.
+		//
+		// ARGUMENTS:
+		// 			cells	cells to process, in order of output
+		// 			isGZ	flag - true iff read files are gzipped
+		bool matchSCCells(const std::vector<scCell>& cells, const bool isGZ);
+		// Match the reads of a multiplexed single cell run, where the reads of all cells are in the same files
+		// The parser tags every read with the cell of its barcode (see CellBarcodes), reads without a barcode of
+		// the whitelist are dropped. Since every cell may have reads up to the end of the files, the events of all
+		// cells are kept until then; the cells with reads are written in the order of the whitelist.
+		//
+		// ARGUMENTS:
+		// 			barcodes	whitelist of the cells
+		// 			files		read files (of first reads if paired), read back to back
+		// 			files2		files of second reads, one per file of files, empty if not paired
+		// 			isGZ		flag - true iff read files are gzipped
+		bool matchSCBarcodes(const CellBarcodes& barcodes, const std::vector<std::string>& files, const std::vector<std::string>& files2, const bool isGZ);
 
         // Print the CpG methylation levels to the given filename
         // Two files are generated, one called filename_cpg.tsv
@@ -124,11 +323,103 @@ class ReadQueue
         // Rev_methylated is the number of aligned methylated CpGs on the reverse strand CpG
         // Rev_unmethylated  -------" " ---------- unmeethylated --------- " " ------------
         //
+        // With format BGZF the same table is written bgzip compressed to filename_cpg.tsv.gz,
+        // with format BINARY the counts are written to filename_cpg.bin (see namespace METHFILE in structs.h)
+        // For a combined index (see --genomes) the text tables are written per genome to filename_<tag>_cpg.tsv(.gz)
+        // with the chromosome names of the FASTA file, and the reads and calls per genome to filename_genomes.tsv
+        //
         // ARGUMENT:
         //          filename    desired basename for the output files
-        void printMethylationLevels(std::string& filename);
+        //          fmt         output format
+        void printMethylationLevels(std::string& filename, const METHFILE::FORMAT fmt);
+
+        // writes the alignments of all reads matched from now on to path, one record per read with the CIGAR of
+        // the banded alignment; the format follows the file name: BAM for ".bam", bgzip compressed SAM for
+        // ".gz" and SAM otherwise; the records are written by formatBatch and writeBatch
+        void openAlignments(const std::string& path);
+
+        // writes all reads matched from now on that are not aligned to path as FASTQ (gzip compressed if path ends
+        // with ".gz"), the reason (see UNMAPPED::REASON) follows the read name; pairs with an unaligned mate are
+        // written interleaved, the reads keep their base qualities for this
+        void openUnmapped(const std::string& path);
+
+        // collects a bisulfite QC of all reads aligned from now on, written to path by writeQc: M-bias (CpG
+        // methylation by position in the read for each mate), conversion of the cytosines outside of CpGs per
+        // chromosome (e.g. of a lambda spike-in), read length, match error and insert size histograms
+        void openQc(const std::string& path);
+        // writes the QC report as tab separated table, terminates on failure
+        void writeQc();
 
+        // counts the cytosines in CHG and CHH context besides the CpGs from now on, from the alignments of the
+        // reads to the CpG windows (see RefGenome::buildContextSites)
+        void enableContextCalls();
+
+        // counts only the first read (pair) of every position from now on, later reads (pairs) with the same 5'
+        // position, strand and mate position (and cell in single cell mode) are PCR duplicates (see countUnique)
+        void enableDedup();
+        // number of reads (pairs) dropped as duplicates
+        inline uint64_t duplicateCount() const { return dupCount; }
+        // number of reads classed as non-unique for exceeding MyConst::candidateBudget
+        inline uint64_t overBudgetCount() const
+        {
+            uint64_t n = 0;
+            for (const uint64_t c : overBudgetStats)
+                n += c;
+            return n;
+        }
+        // writes the non CpG counts of every covered site to filename_context.tsv, bgzip compressed to
+        // filename_context.tsv.gz for format BGZF (TSV otherwise), one line per site:
+        //
+        // Chromosome	Position	Strand	Context	Methylated	Unmethylated
+        //
+        // Position is the zero based position of the C on its strand in forward strand coordinates, sites are
+        // sorted as the methylation table
+        void printContextLevels(const std::string& filename, const METHFILE::FORMAT fmt);
+
+        // writes the methylation calls of every read aligned from now on to path, one record per read with the
+        // CpGs it covers as a bitset (see namespace READCALLS in structs.h); the calls are collected by the
+        // matching threads and written in the write stage of the pipeline
+        void openReadCalls(const std::string& path);
+
+        // writes the counts so far, together with the input position after the chunk matched last (the front
+        // buffers) and the state in ckpt, to path; the file is replaced atomically
+        // ARGUMENT:
+        //          ckpt    batches and match statistics of the read routine, the rest is filled in
+        void writeCheckpoint(const std::string& path, CHECKPOINT::header& ckpt);
+        // restores the counts and the strand decision of the checkpoint at path and continues reading the input
+        // after the reads it includes, terminates if it belongs to another index or input
+        //
+        // RETURN:  false iff there is no checkpoint at path, ckpt holds its state otherwise
+        bool loadCheckpoint(const std::string& path, CHECKPOINT::header& ckpt);
+
+		// Print the counts of the current cell to the single cell output and reset them
+		// By default four rows (methFwd, unmethFwd, methRev, unmethRev) with a column for every CpG are written.
+		// In sparse mode only CpGs covered by the cell are written, one line each:
+		//
+		// SC_ID	Chromosome	Position	Fwd_methylated	Fwd_unmethylated	Rev_methylated	Rev_unmethylated
+		//
+		// such that the work per cell is linear in the number of covered CpGs
 		void printSCMethylationLevels(const std::string scID);
+		void printSparseSCMethylationLevels(const std::string& scID);
+
+        // aggregate the counts over bins of CpGs: tiles of tileLen bp if tileLen > 0, the regions otherwise (as read
+        // by readTargets, overlapping regions are merged); only bins with at least one CpG of the index are kept
+        void setBins(const uint32_t tileLen, const regionMap& regions);
+        // writes the methylation level (in percent, both strands summed) of every bin with a covered CpG to
+        // filename_bins.bedGraph, in the order of the methylation table
+        void printBins(const std::string& filename);
+        // single cell mode: writes the counts of every bin of each finished cell to filename_bins.bin
+        // (see namespace BINFILE in structs.h)
+        void openBinMatrix(const std::string& filename);
+
+        // true iff a read of readSize letters is matched at all: it is long enough (single-end reads at least
+        // READLEN - 20, mates of a pair at least 3/4 READLEN) and fits into the ShiftAnd automata (at most
+        // MyConst::SAMAXLEN letters), other reads are discarded as UNMAPPED::LENGTH instead of being truncated
+        static inline bool acceptLength(const size_t readSize, const bool paired)
+        {
+            const size_t minSize = paired ? static_cast<size_t>(ceil(static_cast<float>(MyConst::READLEN) * 0.75)) : MyConst::READLEN - 20;
+            return readSize >= minSize && readSize <= MyConst::SAMAXLEN;
+        }
 
 
     private:
@@ -143,19 +434,146 @@ class ReadQueue
                }
         };
 
+        // seed hit of one mate in getSeedRefsPaired
+        struct PairHit
+        {
+            // window id shifted by one, with the lowest bit set for windows on the reverse strand
+            uint64_t key;
+            // predicted match end (see seedMatchEnd), only set for indexes with k-mer offsets
+            int32_t end;
+            // hit of a k-mer before maxQPos, which may add a new window
+            bool early;
+        };
+        // window of getSeedRefsPaired with the k-mer counts of both mates and whether it is verified
+        struct PairWindow
+        {
+            uint64_t key;
+            uint8_t count1;
+            uint8_t count2;
+            bool flagged;
+        };
+        // hash table buckets of the reads a thread seeds together (see MyConst::interleave and seedAhead)
+        struct SeedGroup
+        {
+            // loop positions [first, last) of matchReadsImpl whose buckets are held
+            unsigned int first = 0;
+            unsigned int last = 0;
+            // buckets and fingerprints of read [0] and reverse complement [1] of each read of the group as from
+            // RefGenome::getSeedBuckets, empty for strands not seeded and reads not matched
+            std::vector<std::array<std::vector<std::pair<uint64_t, uint64_t> >, 2> > buckets;
+            std::vector<std::array<std::vector<uint8_t>, 2> > prints;
+            // true iff seedBuckets and seedPrints of the thread were taken from the group and the next
+            // getSeedRefs uses them instead of looking them up
+            bool taken = false;
+        };
+
+		// the matching routines are instantiated for each error budget E in MyConst::ERRBUDGETS
+		// such that the shift-and automata and the banded alignment are specialized
+		// matchReads and matchPairedReads dispatch to them according to MyConst::errBudget
+		// readIds, if given, lists the indices into the read buffers to process (procReads of them)
+		// in a first pass of tiered matching (firstTier, see MyConst::tieredErrors) reads without a match are not
+		// evaluated but collected in tierRetryBuf
+		// the matches found are aligned with error budget A, such that a first pass aligns as the full budget would
+		template <size_t E, size_t A = E>
+		bool matchReadsImpl(const unsigned int& procReads, uint64_t& succMatch, uint64_t& nonUniqueMatch, uint64_t& unSuccMatch, const bool getStranded, const std::vector<uint32_t>* readIds, const bool firstTier);
+		// matchReadsImpl with batched verification (see MyConst::batchVerify): all reads of the batch are seeded
+		// first, then their candidate windows are verified sorted by window, SALANES reads at a time with
+		// ShiftAnd::querySeqMultiPattern, and at last the matches of every read are evaluated as in matchReadsImpl
+		template <size_t E>
+		bool matchReadsBatched(const unsigned int& procReads, uint64_t& succMatch, uint64_t& nonUniqueMatch, uint64_t& unSuccMatch, const bool getStranded);
+		// the verification step of matchReadsBatched with MyConst::offload: all tasks in batchOrder are verified by
+		// one DeviceVerify kernel, tasks with more matchings than the kernel returns are queried again on the host
+		template <size_t E>
+		void verifyBatchDevice(const unsigned int procReads);
+		template <size_t E, size_t A = E>
+		bool matchPairedReadsImpl(const unsigned int& procReads, uint64_t& succMatch, uint64_t& nonUniqueMatch, uint64_t& unSuccMatch, uint64_t& succPairedMatch, uint64_t& tooShortCountMatch, const bool getStranded, const std::vector<uint32_t>* readIds, const bool firstTier);
+		// runs matchReadsImpl (or matchReadsBatched) resp. matchPairedReadsImpl for error budget E, in two passes
+		// if MyConst::tieredErrors is set
+		template <size_t E>
+		bool matchReadsBudget(const unsigned int& procReads, uint64_t& succMatch, uint64_t& nonUniqueMatch, uint64_t& unSuccMatch, const bool getStranded);
+		template <size_t E>
+		bool matchPairedReadsBudget(const unsigned int& procReads, uint64_t& succMatch, uint64_t& nonUniqueMatch, uint64_t& unSuccMatch, uint64_t& succPairedMatch, uint64_t& tooShortCountMatch, const bool getStranded);
+		// sampleStrand for error budget E, returns the number of reads sampled
+		template <size_t E>
+		unsigned int sampleStrandBudget(const unsigned int& procReads);
+		// gathers the reads collected in tierRetryBuf by a first tier pass in tierReads, in batch order
+		void collectTierRetries();
+		// read cache (see MyConst::readCache): finds the reads of the batch with the same sequence (and cell), only
+		// the first of them is matched (listed in cacheReads), counting for all of them (readWeight)
+		void collapseReads(const unsigned int procReads);
+		// gives the duplicates the result of the read they were collapsed into
+		void expandReads(const unsigned int procReads);
+
+		// sizes all per thread structures to the current number of threads CORENUM
+		void initThreadState();
+
+		// picks the schedule of the next batch of procReads reads according to MyConst::schedule
+		// (the matching loops use schedule(runtime))
+		void beginSchedule(const unsigned int procReads);
+		// evaluates the busy times of the threads of the batch just matched
+		// and, in adaptive mode, decides if the next batch is scheduled dynamically
+		void endSchedule();
+
+		// adds the time between its construction and destruction to the given accumulator
+		// (in seconds), used to measure the busy time of each thread per read
+		struct BusyTimer
+		{
+			BusyTimer(double& a) : acc(a), start(std::chrono::steady_clock::now()) {}
+			~BusyTimer()
+			{
+				acc += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			}
+			double& acc;
+			const std::chrono::steady_clock::time_point start;
+		};
+
 		// query the k-mers in internal data structures (countsFwdStart/countsRevStart, paired_counts...) to given modified shift-and automaton
 		// only queries to MetaCpGs with enough k-mers (# >= qThreshold)
 		//
 		// ARGUMENTS:
 		// 			sa			Shift-And automaton for reads sequence
+		// 			pat			pattern of sa, 2 bit packed
+		// 			patRc		reverse complement of the pattern of sa, 2 bit packed
 		// 			mat			empty struct/DS that will hold best match/matches found
 		// 			qThreshold	minimum number of k-mers needed for Meta CpG to be queried to shift-and
 		//
 		// MODIFICATION:
 		// 			Adds the best found match/ matches to mat/mats
-		inline int saQuerySeedSetRef(ShiftAnd<MyConst::MISCOUNT + MyConst::ADDMIS>& sa, MATCH::match& mat, uint16_t& qThreshold);
-		inline void saQuerySeedSetRefFirst(ShiftAnd<MyConst::MISCOUNT + MyConst::ADDMIS>& sa, std::vector<MATCH::match>& mats, const uint16_t& qThreshold);
-		inline void saQuerySeedSetRefSecond(ShiftAnd<MyConst::MISCOUNT + MyConst::ADDMIS>& sa, std::vector<MATCH::match>& mats, const uint16_t& qThreshold);
+		template <size_t E>
+		inline int saQuerySeedSetRef(ShiftAnd<E>& sa, const PackedSeq& pat, const PackedSeq& patRc, MATCH::match& mat, uint16_t& qThreshold);
+		template <size_t E>
+		inline void saQuerySeedSetRefFirst(ShiftAnd<E>& sa, std::vector<MATCH::match>& mats, const uint16_t& qThreshold);
+		// the evaluation of the matchings of saQuerySeedSetRef, shared with matchReadsBatched
+		//
+		// addWindowMatches adds the n matchings (window relative ends and errors) found in window mId on the
+		// given strand to the matches of a read
+		// multiMatch[e] is the number of matches with e errors (1 or 2 for more than one), uniqueMatches[e] the
+		// first of them, prevChr/prevOff the position of the last matching of the previous window
+		// RETURN: false iff the read has two different matches without errors, i.e. no unique match
+		//
+		// uniqueMatchResult returns what saQuerySeedSetRef returns for the collected matches and sets mat to the
+		// match with fewest errors: 1 if it is unique, -1 if not, 0 if there is no match
+		template <size_t E>
+		inline bool addWindowMatches(const uint32_t mId, const bool isFwd, const uint64_t* matchings, const uint8_t* errors, const size_t n, std::array<uint8_t, E + 1>& multiMatch, std::array<MATCH::match, E + 1>& uniqueMatches, chromId& prevChr, uint64_t& prevOff);
+		template <size_t E>
+		inline int uniqueMatchResult(const std::array<uint8_t, E + 1>& multiMatch, const std::array<MATCH::match, E + 1>& uniqueMatches, MATCH::match& mat);
+		// decides between the results of the read (succQueryFwd, matchFwd) and of its reverse complement
+		// (succQueryRev, matchRev) of saQuerySeedSetRef, counts the read in the stats of thread threadnum and
+		// computes the methylation levels of a unique match
+		template <size_t E>
+		inline void resolveSingleMatch(Read& r, std::string& revSeq, const int succQueryFwd, MATCH::match matchFwd, const int succQueryRev, MATCH::match matchRev, const int threadnum, const bool getStranded);
+		// writes the reverse complement of single-end read r to revSeq
+		// RETURN: false (and r flagged invalid) iff r is too short, too long for the automata or has Ns not
+		// accepted (see acceptNs)
+		inline bool prepareRead(Read& r, std::string& revSeq);
+		// true iff read r is matched despite its Ns: it has none, or with MyConst::maskN at most errBudget of them,
+		// which the automata take as mismatches and which do not count at CpGs
+		inline bool acceptNs(const Read& r) const
+		{
+			return r.nNum == 0 || (MyConst::maskN && r.nNum <= MyConst::errBudget);
+		}
+		template <size_t E>
+		inline void saQuerySeedSetRefSecond(ShiftAnd<E>& sa, std::vector<MATCH::match>& mats, const uint16_t& qThreshold);
 
         // count all metaCpG occurences of k-mers appearing in seq
         //
@@ -164,15 +582,187 @@ class ReadQueue
         //
         // MODIFICATION:
         //          The threadCount* fields are modified such that they have the count of metaCpGs after
-        //          a call to this function
-		inline void getSeedRefs(const std::string& seq, const size_t& readSize, const uint16_t qThreshold);
-		inline uint16_t getSeedRefsFirstRead(const std::string& seq, const size_t& readSize, const uint16_t qThreshold);
-		inline bool getSeedRefsSecondRead(const std::string& seq, const size_t& readSize, const uint16_t qThreshold);
+        //          a call to this function; windows below qThreshold may be missing or miscounted
+		inline void getSeedRefs(const SeqView& seq, const size_t& readSize, const uint16_t qThreshold);
+		// looks up the buckets of loop position j and the following ones up to MyConst::interleave reads
+		// (of readIds resp. the read buffer) at once unless they are held already, first the bucket directory
+		// entries of all reads and strands, then their buckets, such that the memory accesses of all of them
+		// overlap; the strands seeded are those matchReadsImpl seeds (fwd and rev)
+		inline void seedAhead(const unsigned int j, const unsigned int procReads, const std::vector<uint32_t>* readIds, const bool fwd, const bool rev, const int threadnum);
+		// hands the buckets of strand (0 read, 1 reverse complement) of loop position j held by seedAhead
+		// to the next getSeedRefs of the thread
+		inline void takeSeeds(const unsigned int j, const unsigned int strand, const int threadnum);
+		// prefetches the reference letters windowSlice yields for window metaId and range, a cache line each
+		inline void prefetchWindow(const uint32_t metaId, const std::pair<int32_t, int32_t>& range) const
+		{
+			const metaWindow& w = ref.metaWindows[metaId];
+			const PackedSeq& seq = ref.fullSeq[w.chrom];
+			const int64_t first = std::max<int64_t>(static_cast<int64_t>(w.startPos) + range.first - 1, 0);
+			const int64_t last = std::min<int64_t>(static_cast<int64_t>(w.startPos) + range.second, seq.size());
+			const uint64_t* words = seq.seqData().data();
+			// 256 letters per cache line of 2 bit letters
+			for (int64_t p = first; p < last; p += 256)
+				__builtin_prefetch(words + (p >> 5));
+			if (last > first)
+				__builtin_prefetch(words + ((last - 1) >> 5));
+		}
+
+		// shift and automaton slot of thread t for error budget E, reloaded with the pattern of each read
+		// single-end reads use slots 0 (read) and 1 (reverse complement), read pairs all SASLOTS
+		template <size_t E>
+		inline ShiftAnd<E>& threadAutomaton(const unsigned int t, const unsigned int slot)
+		{
+			return std::get<std::vector<ShiftAnd<E> > >(automata)[SASLOTS * t + slot];
+		}
+
+		// window relative position of the last letter of a match of a read of length readLen, as predicted by
+		// the k-mer at read position p that hit kmerTableSmall[i] (needs an index with k-mer offsets)
+		inline int32_t seedMatchEnd(const uint64_t i, const uint32_t p, const size_t readLen, const bool isFwd)
+		{
+			const int32_t o = ref.kmerOffsets[i];
+			return isFwd ? o - static_cast<int32_t>(p) + static_cast<int32_t>(readLen) - 1 : o + static_cast<int32_t>(p) + static_cast<int32_t>(MyConst::KMERLEN) - 1;
+		}
+		// true iff pat matches the reference of window w without errors under the bisulfite rule with its last letter
+		// at window offset end, compared a word of 32 letters at a time
+		// tcRule: a pattern T also matches a reference C (pattern versus the forward strand), otherwise a pattern A
+		// also matches a reference G (reverse complement of the pattern versus the forward strand, which is the
+		// pattern versus the reverse strand)
+		inline bool isExactMatch(const PackedSeq& pat, const uint32_t metaId, const int32_t end, const bool tcRule)
+		{
+			const metaWindow& w = ref.metaWindows[metaId];
+			const int64_t chrFirst = static_cast<int64_t>(w.startPos) + end - static_cast<int64_t>(pat.size()) + 1;
+			if (chrFirst < 0 || static_cast<size_t>(chrFirst) + pat.size() > ref.fullSeq[w.chrom].size())
+				return false;
+			// the letters of the window record if it holds them
+			PackedSeq rec;
+			int64_t recFirst = 0;
+			if (ref.hasWindowRecords())
+				ref.windowLetters(metaId, rec, recFirst);
+			const bool inRec = ref.hasWindowRecords() && chrFirst >= recFirst && static_cast<size_t>(chrFirst - recFirst) + pat.size() <= rec.size();
+			const PackedSeq& seq = inRec ? rec : ref.fullSeq[w.chrom];
+			const int64_t first = inRec ? chrFirst - recFirst : chrFirst;
+			// Ns never match
+			for (size_t i = 0; i < pat.size(); i += 64)
+			{
+				uint64_t nm = seq.nMaskAt(first + i);
+				if (pat.size() - i < 64)
+					nm &= (1ULL << (pat.size() - i)) - 1;
+				if (nm)
+					return false;
+			}
+			// per letter, the lower bit of its 2 bit field is set iff the letters differ and the difference is not allowed
+			constexpr uint64_t LOW = 0x5555555555555555ULL;
+			for (size_t i = 0; i < pat.size(); i += 32)
+			{
+				const uint64_t p = pat.seqWordAt(i);
+				const uint64_t g = seq.seqWordAt(first + i);
+				const uint64_t diff = (p ^ g) | ((p ^ g) >> 1);
+				const uint64_t allowed = tcRule ? (p & (p >> 1) & g & ~(g >> 1)) : (~p & ~(p >> 1) & ~g & (g >> 1));
+				uint64_t bad = diff & ~allowed & LOW;
+				if (pat.size() - i < 32)
+					bad &= (1ULL << (2 * (pat.size() - i))) - 1;
+				if (bad)
+					return false;
+			}
+			return true;
+		}
+		// window offset of the last letter of the match without errors the exact match fast path of saQuerySeedSetRef
+		// finds for pattern p (of length readLen) in window metaId, or -1: all seeds of the window must predict the
+		// same position (needs k-mer offsets), which has to lie inside the letters verified otherwise (see scanRange)
+		template <size_t E>
+		inline int32_t exactMatchEnd(const MetaCounter& spans, const uint32_t metaId, const PackedSeq& p, const size_t readLen, const bool isFwd)
+		{
+			if (!ref.hasKmerOffsets())
+				return -1;
+			const std::pair<int32_t, int32_t> span = spans.span(metaId);
+			if (span.first != span.second)
+				return -1;
+			const std::pair<int32_t, int32_t> range = scanRange(spans, metaId, readLen, isFwd);
+			if (span.first - static_cast<int32_t>(readLen) + 1 < range.first || span.first >= range.second)
+				return -1;
+			return isExactMatch(p, metaId, span.first, isFwd) ? span.first : -1;
+		}
+		// iterators over the reference letters of window metaId that shift and verifies for the window relative range
+		// (see scanRange), for reverse strand windows start is the last letter and end the one before the first
+		// the iterators read the window record (see RefGenome::buildWindowRecords) if there is one, unless
+		// fromRecord is unset: then they are iterators of ref.fullSeq
+		inline void windowSlice(const uint32_t metaId, const std::pair<int32_t, int32_t>& range, const bool isFwd, PackedSeq::const_iterator& start, PackedSeq::const_iterator& end, const bool fromRecord = true)
+		{
+			const metaWindow& w = ref.metaWindows[metaId];
+			const PackedSeq& seq = ref.fullSeq[w.chrom];
+			const int64_t len = seq.size();
+			int64_t startPos;
+			int64_t endPos;
+			if (isFwd)
+			{
+				startPos = static_cast<int64_t>(w.startPos) + range.first;
+				// check if CpG was too near to the end
+				endPos = std::min<int64_t>(static_cast<int64_t>(w.startPos) + range.second, len);
 
-		inline bool matchFwdFirst(std::pair<uint32_t, std::tuple<uint8_t, uint8_t, bool, bool> >& meta, uint8_t& prevChr, uint64_t& prevOff, std::vector<MATCH::match>& mats, int32_t& bmCount, uint16_t qThreshold, ShiftAnd<MyConst::MISCOUNT + MyConst::ADDMIS>& sa);
-		inline bool matchRevFirst(std::pair<uint32_t, std::tuple<uint8_t, uint8_t, bool, bool> >& meta, uint8_t& prevChr, uint64_t& prevOff, std::vector<MATCH::match>& mats, int32_t& bmCount, uint16_t qThreshold, ShiftAnd<MyConst::MISCOUNT + MyConst::ADDMIS>& sa);
-		inline bool matchFwdSecond(std::pair<uint32_t, std::tuple<uint8_t, uint8_t, bool, bool> >& meta, uint8_t& prevChr, uint64_t& prevOff, std::vector<MATCH::match>& mats, int32_t& bmCount, uint16_t qThreshold, ShiftAnd<MyConst::MISCOUNT + MyConst::ADDMIS>& sa);
-		inline bool matchRevSecond(std::pair<uint32_t, std::tuple<uint8_t, uint8_t, bool, bool> >& meta, uint8_t& prevChr, uint64_t& prevOff, std::vector<MATCH::match>& mats, int32_t& bmCount, uint16_t qThreshold, ShiftAnd<MyConst::MISCOUNT + MyConst::ADDMIS>& sa);
+			} else {
+
+				// one before the first letter, also for the first window of a sequence (see PackedSeq::const_iterator)
+				endPos = static_cast<int64_t>(w.startPos) + range.first - 1;
+				startPos = std::min<int64_t>(static_cast<int64_t>(w.startPos) + range.second - 1, len - 1);
+			}
+			PackedSeq::const_iterator letters = seq.begin();
+			if (fromRecord && ref.hasWindowRecords())
+			{
+				PackedSeq rec;
+				int64_t first;
+				ref.windowLetters(metaId, rec, first);
+				letters = rec.begin() - first;
+			}
+			start = letters + startPos;
+			end = letters + endPos;
+		}
+		// window relative letters [first, second) ShiftAnd verifies for a read of length readLen in window metaId
+		// the whole window, unless the index has k-mer offsets: then only the letters of matches ending in the span
+		// of the predicted match ends (see seedMatchEnd) with up to MyConst::errBudget indels
+		// reverse strand windows are queried up to one letter further (see saQuerySeedSetRef)
+		// the letters depend on the configured budget only, not on the automaton, such that the first pass of
+		// tiered matching (see MyConst::tieredErrors) finds the matches the full budget finds with as few errors
+		inline std::pair<int32_t, int32_t> scanRange(const MetaCounter& spans, const uint32_t metaId, const size_t readLen, const bool isFwd)
+		{
+			const int32_t E = MyConst::errBudget;
+			const int32_t full = isFwd ? MyConst::WINLEN + E - 1 : MyConst::WINLEN + E;
+			if (!ref.hasKmerOffsets() || spans.count(metaId) == 0)
+				return std::make_pair(0, full);
+			const std::pair<int32_t, int32_t> span = spans.span(metaId);
+			return std::make_pair(std::max(0, span.first - static_cast<int32_t>(readLen) - E + 1), std::min(full, span.second + E + 1));
+		}
+		// true iff a match ending at offset off of a window may be reported by a neighbouring window as well: the
+		// windows overlap by READLEN letters (see RefGenome::generateWindows) and the slices reach up to
+		// 2 * errBudget letters beyond them; of two matches at the same position the one of the earlier window is
+		// kept (see addWindowMatches), which depends on its matches with more errors, and only that window counts
+		// the CpGs of the overlap, hence the first pass of tiered matching leaves such reads to the full budget
+		static inline bool inWindowOverlap(const uint64_t off)
+		{
+			return off <= MyConst::READLEN + 2 * MyConst::errBudget || off + MyConst::READLEN >= MyConst::WINLEN;
+		}
+		inline uint16_t getSeedRefsFirstRead(const SeqView& seq, const size_t& readSize, const uint16_t qThreshold);
+		inline bool getSeedRefsSecondRead(const SeqView& seq, const size_t& readSize, const uint16_t qThreshold);
+		// fused replacement of getSeedRefsFirstRead followed by getSeedRefsSecondRead (see MyConst::fusedPairs)
+		// the seed hits of both mates are collected into plain vectors, ordered by window and the pairing with
+		// the windows of seq1 within MAXPDIST is resolved in one linear sweep over both; fills the same maps
+		// and spans as the two calls, except that windows of seq2 only pair with windows of seq1 passing the
+		// qgram lemma, not with other windows of seq2 paired before
+		// RETURN: true iff a window flagged for verification contains a CpG
+		inline bool getSeedRefsPaired(const SeqView& seq1, const SeqView& seq2, const uint16_t qThreshold);
+		// fills hits with the seed hits of seq (with the filters of getSeedRefsFirstRead resp.
+		// getSeedRefsSecondRead if withStart is set resp. not) in ascending order of keys
+		// the hits of every k-mer come in window order, if they are PAIRMERGERUN hits per k-mer or more on average
+		// (repetitive buckets) they are merged pairwise instead of sorted
+		inline void collectPairHits(const SeqView& seq, const uint16_t qThreshold, const bool withStart, std::vector<PairHit>& hits);
+
+		template <size_t E>
+		inline bool matchFwdFirst(std::pair<uint32_t, std::tuple<uint8_t, uint8_t, bool, bool> >& meta, chromId& prevChr, uint64_t& prevOff, std::vector<MATCH::match>& mats, int32_t& bmCount, uint16_t qThreshold, ShiftAnd<E>& sa);
+		template <size_t E>
+		inline bool matchRevFirst(std::pair<uint32_t, std::tuple<uint8_t, uint8_t, bool, bool> >& meta, chromId& prevChr, uint64_t& prevOff, std::vector<MATCH::match>& mats, int32_t& bmCount, uint16_t qThreshold, ShiftAnd<E>& sa);
+		template <size_t E>
+		inline bool matchFwdSecond(std::pair<uint32_t, std::tuple<uint8_t, uint8_t, bool, bool> >& meta, chromId& prevChr, uint64_t& prevOff, std::vector<MATCH::match>& mats, int32_t& bmCount, uint16_t qThreshold, ShiftAnd<E>& sa);
+		template <size_t E>
+		inline bool matchRevSecond(std::pair<uint32_t, std::tuple<uint8_t, uint8_t, bool, bool> >& meta, chromId& prevChr, uint64_t& prevOff, std::vector<MATCH::match>& mats, int32_t& bmCount, uint16_t qThreshold, ShiftAnd<E>& sa);
 
 		inline void sort_by_n(std::vector<unsigned int>::iterator it_start, std::vector<unsigned int>::iterator it_n, std::vector<unsigned int>::iterator it_end, std::vector<uint64_t>& sliceOff, std::vector<bool>& sliceIsDone)
 		{
@@ -203,7 +793,7 @@ class ReadQueue
 						} else {
 							// test for strand if windows are equal
 							if (id1meta == id2meta &&
-									(ref.strandTable[sliceOff[id1]] > ref.strandTable[sliceOff[id2]]))
+									(KMER_S::isFwd(ref.kmerTableSmall[sliceOff[id1]]) > KMER_S::isFwd(ref.kmerTableSmall[sliceOff[id2]])))
 							{
 								// Case id2 window is reverse strand, id1 window is fwd strand
 								return true;
@@ -225,6 +815,7 @@ class ReadQueue
         //
         // RETURN:  true iff successfully extracted match
         //
+        template <size_t E>
         inline bool extractSingleMatch(std::vector<MATCH::match>& fwdMatches, std::vector<MATCH::match>& revMatches, Read& r, std::string& revSeq);
 
         // Examines if two matchings build a pair
@@ -237,7 +828,50 @@ class ReadQueue
         //          -1      iff no pairing
         //          n       iff pairing, where n is the number of errors summed over both matchings
         //
-        inline int extractPairedMatch(MATCH::match& mat1, MATCH::match& mat2);
+        inline int extractPairedMatch(const MATCH::match& mat1, const MATCH::match& mat2);
+
+        // pairs the matches m1 of read 1 with the matches m2 of read 2 as extractPairedMatch would for all
+        // combinations: both lists are turned into sorted (chromosome, position) keys once, a window over the keys of
+        // m2 slides along the ones of m1 and counts the matches it holds per number of errors
+        //
+        // ARGUMENTS:
+        //          bestErrNum  error sum of the best pair of the lists paired before, updated
+        //          best1/2     best pair, replaced iff a pair of these lists has fewer errors
+        //          nonUnique   true iff several pairs have bestErrNum errors, updated
+        //
+        // RETURN:  true iff the best pair was replaced
+        template <size_t E>
+        inline bool pairMatches(const std::vector<MATCH::match>& m1, const std::vector<MATCH::match>& m2, int& bestErrNum, MATCH::match& best1, MATCH::match& best2, bool& nonUnique);
+
+        // mate rescue (see MyConst::mateRescue)
+        //
+        // matches one orientation of a read pair, seq1 is matched by sa1 and seq2 by sa2: read 1 is verified in all
+        // windows passing the qgram lemma, if it has a confident match read 2 is only verified around it (rescueMate),
+        // otherwise (or if this finds no unique best mate, or another match of read 1 may form an equally good pair)
+        // both reads are matched as without mate rescue
+        // RETURN: true iff the pair was decided by the rescued mate
+        template <size_t E>
+        inline bool matchPairRescue(const SeqView& seq1, const SeqView& seq2, ShiftAnd<E>& sa1, ShiftAnd<E>& sa2, std::vector<MATCH::match>& matches1, std::vector<MATCH::match>& matches2, const uint16_t qThreshold);
+        // matches one orientation of a read pair as without mate rescue (see matchPairedReadsImpl)
+        template <size_t E>
+        inline void matchPairSeeded(const SeqView& seq1, const SeqView& seq2, ShiftAnd<E>& sa1, ShiftAnd<E>& sa2, std::vector<MATCH::match>& matches1, std::vector<MATCH::match>& matches2, const uint16_t qThreshold);
+        // tiered matching (see MyConst::tieredErrors) of one orientation of a read pair: the windows are verified in the
+        // order of their k-mer counts until the count drops too far below the one of the best window with a match, so
+        // matches with more errors than TIERBUDGET can stop the full budget before windows the first tier verifies
+        // RETURN: true iff each window the first (second) read may have been verified in holds a match in matches1
+        //         (matches2), then the full budget verifies the same windows
+        inline bool tierWindowsMatched(const std::vector<MATCH::match>& matches1, const std::vector<MATCH::match>& matches2, const uint16_t qThreshold);
+        // flags all windows of the first read passing the qgram lemma for verification
+        // RETURN: true iff one of them contains a CpG
+        inline bool flagFirstReadWindows(const uint16_t qThreshold);
+        // RETURN: true iff mats has a single match (up to duplicates in overlapping windows) with the fewest errors
+        //         and all other matches have at least two errors more, anchor is set to this match and otherErr to
+        //         the fewest errors of the other matches (the largest int if there are none)
+        inline bool confidentMatch(const std::vector<MATCH::match>& mats, MATCH::match& anchor, int& otherErr);
+        // adds the matches of sa on the strand of anchor that pair with anchor (see extractPairedMatch) to mats, the
+        // windows covering these positions are queried at once with ShiftAnd::querySeqMulti
+        template <size_t E>
+        inline void rescueMate(ShiftAnd<E>& sa, const MATCH::match anchor, std::vector<MATCH::match>& mats);
 
 
         // compute the methylation levels for the given read by traversing the CpGs of the matched meta CpG
@@ -245,26 +879,198 @@ class ReadQueue
         // ARGUMENTS:
         //          mat     match to process
         //          seq     sequence that was matched (i.e. r.seq or revSeq in main query routine)
+        //          revComp true iff seq is the reverse complement of the read (revSeq)
         //
         // MODIFICATIONS:
-        //              will modify internal methLevel counters
-        inline void computeMethLvl(MATCH::match& mat, std::string& seq);
+        //              will record methylation events, see addMethEvent
+        template <size_t E>
+        inline void computeMethLvl(MATCH::match& mat, SeqView seq, const bool revComp);
+        // RETURN:  true iff seq, matched by mat with errors, has at most as many mismatches to the reference without
+        //          a shift as errors, i.e. its calls can be taken without the banded alignment (see
+        //          MyConst::substitutionCalls)
+        inline bool substitutionsOnly(const MATCH::match& mat, SeqView seq);
+        // counts the reads (pairs) deferred by computeMethLvl since the last call unless they are duplicates of a
+        // read (pair) counted before
+        // The keys are split into CORENUM shards by their hash, each shard is visited in the order of the reads in
+        // the batch by one thread, such that the first read of a position is kept no matter which thread matched it.
+        template <size_t E>
+        void countUnique();
+        // counts the CHG and CHH sites (see enableContextCalls) and the QC statistics (see openQc) of the read seq
+        // matched by mat, from the same banded alignment as computeMethLvl
+        template <size_t E>
+        inline void countAligned(const MATCH::match& mat, SeqView seq, const bool revComp);
+        // banded alignment (see LevenshtDP) of seq matched with errNum errors, on the forward strand iff isFwd, to the
+        // reference read backwards from refSeq; the band is errNum wide (instead of the budget E) unless the
+        // alignment needs more errors, which gives the same alignment as the full band
+        //
+        // RETURN:  edit distance of the alignment
+        template <size_t E>
+        inline unsigned int alignToRef(SeqView seq, const char* refSeq, const bool isFwd, const unsigned int errNum, std::vector<ERROR_T>& alignment);
+        // alignToRef with a band of B
+        // RETURN:  false iff the edit distance exceeds B while B < E, alignment is left empty then
+        template <size_t B, size_t E>
+        inline bool alignBand(SeqView seq, const char* refSeq, const bool isFwd, std::vector<ERROR_T>& alignment, unsigned int& dist);
+        // adds the CpG call at index k of seq to the M-bias of the QC, revComp as for computeMethLvl
+        inline void addMbias(SeqView seq, const size_t k, const bool revComp);
+        // adds the fragment of the pair matched by mat1 and mat2 to the insert size histogram of the QC
+        inline void addInsertSize(const MATCH::match& mat1, const size_t len1, const MATCH::match& mat2, const size_t len2);
+
+        // the four counters of a CpG
+        enum METHCOUNTER : uint8_t {METHFWD = 0, UNMETHFWD, METHREV, UNMETHREV};
+
+        // record that counter c of CpG cpgId has to be increased
+        // the event is stored in a buffer of the calling thread and applied by mergeMethEvents
+        // in single cell mode the event is tagged with the cell of the read the calling thread works on
+        // with the read cache the event is recorded once for every read the current read stands for (see threadWeight)
+        inline void addMethEvent(const uint64_t cpgId, const METHCOUNTER c)
+        {
+            const int t = omp_get_thread_num();
+            const uint64_t cellTag = isSC ? static_cast<uint64_t>(threadCell[t]) << METHCELLSHIFT : 0;
+            std::vector<uint64_t>& events = methEvents[t][cpgId / methBucketSize];
+            events.insert(events.end(), threadWeight[t], cellTag | (cpgId << 2) | c);
+            if (callOut.isOpen())
+                threadCalls[t].push_back(cpgId << 1 | (c == METHFWD || c == METHREV));
+        }
+        // appends the calls of the read just processed by computeMethLvl to the read call records of the thread
+        void addReadCalls(const MATCH::match& mat, const size_t readLen);
+        // apply all recorded events to methLevels
+        // in single cell mode the events are moved to the compact counts of their cells instead (see cellCounts)
+        // and only methLevelsSc is updated
+        // each thread is responsible for one range of CpGs, hence no synchronization is needed inside
+        // MUST NOT be called inside a parallel region
+        void mergeMethEvents();
+        // increase the counter given by event ev = (cpgId << 2 | METHCOUNTER) in methLevels
+        // b is the range of CpGs that cpgId belongs to
+        inline void applyMethEvent(const uint64_t ev, const unsigned int b)
+        {
+            const uint64_t cpgId = ev >> 2;
+            methLvl& lvl = methLevels[cpgId];
+            // remember CpGs that are covered for the first time since the last reset
+            if (scSparse && (lvl.methFwd | lvl.unmethFwd | lvl.methRev | lvl.unmethRev) == 0)
+            {
+                methTouched[b].push_back(cpgId);
+            }
+            uint16_t& cnt = methCounter(lvl, static_cast<METHCOUNTER>(ev & 3));
+            // counter is saturated, count the rest separately
+            if (cnt == std::numeric_limits<uint16_t>::max())
+            {
+                ++methOverflow[b][ev];
+
+            } else {
+
+                ++cnt;
+            }
+        }
+        // applies the recorded events of cell cellIdx to methLevels, prints the counts and frees its event lists
+        void finishCell(const scCell& cell, const size_t cellIdx);
+        // returns the value of counter c of CpG cpgId including the counts that do not fit into methLvl
+        inline uint64_t getMethCount(const uint64_t cpgId, const METHCOUNTER c)
+        {
+            const uint16_t cnt = methCounter(methLevels[cpgId], c);
+            if (cnt < std::numeric_limits<uint16_t>::max())
+                return cnt;
+            const auto& ov = methOverflow[cpgId / methBucketSize];
+            const auto it = ov.find((cpgId << 2) | c);
+            return it == ov.end() ? cnt : cnt + it->second;
+        }
+        // sets counter c of CpG cpgId, which must be zero, to val
+        inline void setMethCount(const uint64_t cpgId, const METHCOUNTER c, const uint64_t val)
+        {
+            constexpr uint64_t cntMax = std::numeric_limits<uint16_t>::max();
+            methCounter(methLevels[cpgId], c) = std::min(val, cntMax);
+            if (val >= cntMax)
+                methOverflow[cpgId / methBucketSize][(cpgId << 2) | c] = val - cntMax;
+        }
+        // resets counter c of CpG cpgId to zero
+        inline void resetMethCount(const uint64_t cpgId, const METHCOUNTER c)
+        {
+            uint16_t& cnt = methCounter(methLevels[cpgId], c);
+            if (cnt == std::numeric_limits<uint16_t>::max())
+                methOverflow[cpgId / methBucketSize].erase((cpgId << 2) | c);
+            cnt = 0;
+        }
 
-        // input stream of file given as path to Ctor
-        std::ifstream file;
-        igzstream igz;
+        // parse up to MyConst::chunkSize many reads from is (and is2 if paired) into buf (and buf2)
+        // reading starts at position offset of the buffers, procReads counts the reads before offset as well
+        // returns true iff the buffers are full
+        bool parseChunkStream(FastqReader& in, FastqReader& in2, ReadBatch& buf, ReadBatch& buf2, unsigned int& procReads, const unsigned int offset);
+        // opens read file filePath in reader, terminates if file cannot be opened
+        void openReads(FastqReader& reader, const std::string& filePath, const bool isGZ);
+        // opens file (pair) first of readFiles (and readFiles2), the next ones are opened in the spare readers
+        void openSample(const size_t first);
+        // closes the exhausted read file(s) and continues with the next file (pair) of the sample
+        // RETURN:  false iff there is no further file
+        bool nextReadFile();
+        // parses the next chunk of the sample into buf (and buf2), continuing in the next files at the end of a file
+        // pos is set to the position after the chunk
+        bool parseSample(ReadBatch& buf, ReadBatch& buf2, unsigned int& procReads, InputPos& pos);
+        // writes the methylation levels to out, with header and chromosome names for BINARY
+        // genome >= 0 restricts a text table to the CpGs of this genome of a combined index, -1 writes all
+        void writeMethLevels(MethWriter& out, const METHFILE::FORMAT fmt, const int genome);
+        // writes the uniquely aligned reads and the calls per genome of a combined index to path and stdout
+        void printGenomeSummary(const std::string& path);
+
+        // chromosome names indexed by internal chromosome id
+        std::vector<std::string> getChromNames();
+        // sums the counts of the CpGs in every bin, of the touched CpGs only in sparse single cell mode
+        // ARGUMENT:
+        //          recs    filled with the bins with a covered CpG, in the order of the bins
+        void collectBins(const bool touchedOnly, std::vector<BINFILE::cellRecord>& recs);
+
+        // placement of a read in the alignment output
+        struct AlignPos
+        {
+            bool mapped;
+            // true iff the record holds the reverse complement of the read (SAM flag 0x10)
+            bool reverse;
+            // true iff the read was aligned with G to A conversion (tag XG:Z:GA), C to T otherwise (XG:Z:CT)
+            bool convGA;
+            uint32_t refId;
+            // zero based leftmost position and number of reference letters covered
+            uint64_t pos;
+            uint32_t refLen;
+            // mismatches and indels of the alignment (tag NM), bisulfite conversions are no mismatches
+            uint32_t edits;
+            // CIGAR operations in BAM encoding (length << 4 | operation)
+            std::vector<uint32_t> cigar;
+        };
+        // formats a record for every read (pair) of b into b.alignText, in input order
+        // reads (pairs) without a unique match are reported unmapped
+        template <size_t E>
+        void formatAlignments(Batch& b);
+        // formats the FASTQ records of the unaligned reads (pairs) of b into b.unmappedText, in input order
+        void formatUnmapped(Batch& b);
+        // appends the FASTQ record of r to out, tagged with reason
+        static void appendFastq(std::string& out, const Read& r, const UNMAPPED::REASON reason);
+        // places read r by its match r.mat, errors are located by the banded alignment of computeMethLvl
+        // refWin is the buffer of the reference window
+        template <size_t E>
+        inline void placeRead(Read& r, const bool mapped, AlignPos& al, std::vector<char>& refWin);
+        // appends the SAM line or BAM record of read r placed at al to out
+        // mate is the placement of the other read of the pair (nullptr for single end reads) and pairFlag the
+        // SAM flag of the position of r in the pair
+        void appendRecord(std::string& out, const Read& r, const AlignPos& al, const AlignPos* mate, const uint16_t pairFlag);
+
+        // reader of file given as path to Ctor
+        FastqReader fastq;
         // second file if paired
-        std::ifstream file2;
-        igzstream igz2;
+        FastqReader fastq2;
+        // files of the sample (see readFileIdx)
+        std::vector<std::string> readFiles;
+        std::vector<std::string> readFiles2;
+        // the reader of the next file is opened while the current one is parsed, such that the inflater
+        // thread of a compressed file starts before the previous file ends
+        FastqReader fastqSpare;
+        FastqReader fastq2Spare;
 
 
         // representation of the reference genome
         RefGenome& ref;
 
-        // buffer holding MyConst::CHUNKSIZE many reads
-        std::vector<Read> readBuffer;
+        // buffer holding MyConst::chunkSize many reads
+        ReadBatch readBuffer;
         // second buffer for paired reads
-        std::vector<Read> readBuffer2;
+        ReadBatch readBuffer2;
 
         // mapping of letters to array indices for shift and algorithm
         // 'A' -> 0
@@ -273,8 +1079,9 @@ class ReadQueue
         // 'T' -> 3
         std::array<uint8_t, 16> lmap;
 
-        std::array<tsl::hopscotch_map<uint32_t, uint16_t, MetaHash>, CORENUM> fwdMetaIDs;
-        std::array<tsl::hopscotch_map<uint32_t, uint16_t, MetaHash>, CORENUM> revMetaIDs;
+        // k-mer counts of the windows of the read each thread works on, per strand (see getSeedRefs)
+        std::vector<MetaCounter> fwdMetaIDs;
+        std::vector<MetaCounter> revMetaIDs;
         // Holds counts for each thread for counting heuristic
         // KEY: Meta CpG ID
         // VALUE:
@@ -285,57 +1092,23 @@ class ReadQueue
         //
         // std::array<google::dense_hash_map<uint32_t, std::tuple<uint8_t, uint8_t, bool, bool>, MetaHash>, CORENUM> paired_fwdMetaIDs;
         // std::array<google::dense_hash_map<uint32_t, std::tuple<uint8_t, uint8_t, bool, bool>, MetaHash>, CORENUM> paired_revMetaIDs;
-        std::array<tsl::hopscotch_map<uint32_t, std::tuple<uint8_t, uint8_t, bool, bool>, MetaHash>, CORENUM> paired_fwdMetaIDs;
-        std::array<tsl::hopscotch_map<uint32_t, std::tuple<uint8_t, uint8_t, bool, bool>, MetaHash>, CORENUM> paired_revMetaIDs;
+        std::vector<tsl::hopscotch_map<uint32_t, std::tuple<uint8_t, uint8_t, bool, bool>, MetaHash> > paired_fwdMetaIDs;
+        std::vector<tsl::hopscotch_map<uint32_t, std::tuple<uint8_t, uint8_t, bool, bool>, MetaHash> > paired_revMetaIDs;
+        // predicted match ends of the seeds of the first [0] and second [1] read per window (see scanRange),
+        // only filled if the index has k-mer offsets
+        std::vector<std::array<MetaCounter, 2> > paired_fwdSpans;
+        std::vector<std::array<MetaCounter, 2> > paired_revSpans;
 
         bool isPaired;
 		bool isSC;
+		// true iff single cell counts are written in sparse format
+		bool scSparse;
+        // true iff both reads of a pair come from the files of readFiles, in consecutive records
+        bool interleaved;
 
-        // comparison for match
-        struct CompiFwd {
-
-            inline uint16_t operator() (const char& cRead, const char& cRef)
-            {
-                // bisulfite antisymmetry
-                if (cRead == 'T')
-                {
-                    if (cRef == 'C')
-                        return 0;
-                }
-                return cRead == cRef ? 0 : 1;
-            }
-
-        } cmpFwd;
-        // reverse complement matching using the original strand
-        struct CompiRev {
-
-            inline uint16_t operator() (const char& cRead, const char& cRef)
-            {
-                switch (cRead)
-                {
-                    case ('T') :
-                        // bisulfite antisymmetry
-                        if (cRef == 'A' || cRef == 'G')
-                            return 0;
-                        break;
-                    case ('G') :
-                        if (cRef == 'C')
-                            return 0;
-                        break;
-                    case ('A'):
-                        if (cRef == 'T')
-                            return 0;
-                        break;
-                    case ('C'):
-                        if (cRef == 'G')
-                            return 0;
-                        break;
-                }
-
-                return 1;
-            }
-
-        } cmpRev;
+        // letter comparisons of the alignment, see CompiFwd/CompiRev
+        CompiFwd cmpFwd;
+        CompiRev cmpRev;
 
 		struct CompiMetaFirst {
 			bool operator()(std::pair<uint32_t, std::tuple<uint8_t, uint8_t, bool, bool>>& a, std::pair<uint32_t, std::tuple<uint8_t, uint8_t, bool, bool>>& b) const
@@ -361,6 +1134,20 @@ class ReadQueue
             uint16_t methRev;
             uint16_t unmethRev;
         };
+        static inline uint16_t& methCounter(methLvl& lvl, const METHCOUNTER c)
+        {
+            switch (c)
+            {
+                case METHFWD:
+                    return lvl.methFwd;
+                case UNMETHFWD:
+                    return lvl.unmethFwd;
+                case METHREV:
+                    return lvl.methRev;
+                default:
+                    return lvl.unmethRev;
+            }
+        }
         // holds the counts for each CpG
         // indexed by the same indices as of the cpgTable vector in RefGenome class
         std::vector<struct methLvl> methLevels;
@@ -369,17 +1156,260 @@ class ReadQueue
 		// Information for single cell data
 		// Holds for the most recent single cell the individual counts
 		std::vector<struct methLvl> methLevelsSc;
+
+        // pending counter updates of the current batch
+        // methEvents[t][b] holds the events (cpgId << 2 | METHCOUNTER) of thread t for CpGs in the
+        // range [b * methBucketSize, (b+1) * methBucketSize)
+        std::vector<std::vector<std::vector<uint64_t> > > methEvents;
+        uint64_t methBucketSize;
+        // events applied by mergeMethEvents, per range of CpGs as in methEvents, kept for takeMethDeltas
+        std::vector<std::vector<uint64_t> > methDeltaEvents;
+        bool keepMethDeltas;
+        // non CpG counts (see enableContextCalls), methylated and unmethylated calls of every site of
+        // RefGenome::ctxSites; empty if not requested
+        std::vector<std::array<uint32_t, 2> > ctxLevels;
+        // pending updates of ctxLevels as methEvents, (site << 1 | unmethylated)
+        std::vector<std::vector<std::vector<uint64_t> > > ctxEvents;
+        uint64_t ctxBucketSize;
+        // alignment of the read each thread counts the sites of
+        std::vector<std::vector<ERROR_T> > ctxAlignBuf;
+
+        // bisulfite QC of the aligned reads of one thread (see openQc), merged by writeQc
+        struct QcCounts
+        {
+            // [mate][position in the read] methylated and unmethylated CpG calls (M-bias)
+            std::array<std::vector<std::array<uint64_t, 2> >, 2> mbias;
+            // [chromosome id] unconverted (C) and converted (T) cytosines outside of CpGs
+            std::vector<std::array<uint64_t, 2> > conversion;
+            // [mate][length] aligned reads
+            std::array<std::vector<uint64_t>, 2> readLens;
+            // [mate][errors] aligned reads by the errors of their match
+            std::array<std::vector<uint64_t>, 2> readErrs;
+            // [length] fragments of the aligned pairs
+            std::vector<uint64_t> insertSizes;
+        };
+        // empty if no QC report is requested
+        std::vector<QcCounts> qcCounts;
+        std::string qcPath;
+        // duplicate removal (see enableDedup): computeMethLvl defers the reads to countUnique unless dedupPass
+        bool dedup;
+        bool dedupPass;
+        uint64_t dupCount;
+        // a read whose counting is deferred, the two mates of a pair follow each other
+        struct DedupRead
+        {
+            MATCH::match mat;
+            // index of the read in the batch, flags as threadReadFlags
+            uint32_t read;
+            uint8_t flags;
+            bool revComp;
+            bool keep;
+            // number of reads it stands for, see threadWeight
+            uint32_t weight;
+        };
+        std::vector<std::vector<DedupRead> > dedupReads;
+        // position of a read (pair): chromosome, 5' position and strands of the mates, and the cell
+        struct DedupKey
+        {
+            uint64_t pos;
+            uint64_t matePos;
+            uint32_t cell;
+            inline bool operator==(const DedupKey& k) const { return pos == k.pos && matePos == k.matePos && cell == k.cell; }
+        };
+        struct DedupHash
+        {
+            inline size_t operator()(const DedupKey& k) const
+            {
+                return (k.pos * 0x9e3779b97f4a7c15ULL) ^ ((k.matePos + k.cell) * 0xc2b2ae3d27d4eb4fULL);
+            }
+        };
+        // keys of the reads counted so far, one shard per thread
+        std::vector<tsl::hopscotch_set<DedupKey, DedupHash> > dedupSeen;
+        // [thread][shard] keys of the deferred reads, with the thread and index in dedupReads of their (first) read
+        std::vector<std::vector<std::vector<std::tuple<DedupKey, uint32_t, uint32_t> > > > dedupShardKeys;
+        // read index of every thread while matching, see DedupRead
+        std::vector<uint32_t> threadRead;
+        // counts exceeding the range of methLvl counters, for each range of CpGs as above
+        // key is (cpgId << 2 | METHCOUNTER), value is the count that did not fit into methLevels
+        std::vector<std::unordered_map<uint64_t, uint64_t> > methOverflow;
+        // in sparse single cell mode the ids of CpGs that received their first count since the last reset,
+        // for each range of CpGs as above
+        std::vector<std::vector<uint32_t> > methTouched;
+        // reverse complements of the reads each thread works on (two per thread for paired reads)
+        // kept such that their memory is reused for all reads
+        std::vector<std::string> revSeqBuf;
+        // unpacked reference window each thread aligns a read to in computeMethLvl
+        std::vector<std::vector<char> > refWinBuf;
+        // 2 bit packed read [2t] and reverse complement [2t + 1] thread t works on (see isExactMatch)
+        std::vector<PackedSeq> readPacks;
+        // hash table buckets of the k-mers of the read each thread works on (see RefGenome::getSeedBuckets)
+        std::vector<std::vector<std::pair<uint64_t, uint64_t> > > seedBuckets;
+        // hashes of the k-mers of the read each thread works on (see RefGenome::hashKmers)
+        std::vector<std::vector<uint64_t> > seedHashes;
+        // fingerprints of the k-mers of the read each thread works on, empty without fingerprints in the index
+        std::vector<std::vector<uint8_t> > seedPrints;
+        // reads each thread seeds together (see MyConst::interleave)
+        std::vector<SeedGroup> seedGroups;
+        // bucket sizes and positions of the k-mers of the read each thread seeds, in the order getSeedRefs probes them
+        std::vector<std::vector<std::pair<uint64_t, uint32_t> > > seedOrder;
+        // (chromosome, position) keys and list positions of the matches of read 1 [2t] and read 2 [2t + 1] thread t
+        // pairs (see pairMatches)
+        std::vector<std::vector<std::pair<uint64_t, uint32_t> > > pairKeys;
+        // seed hits of read 1 [0] and read 2 [1] and the windows of both (see getSeedRefsPaired), for each thread
+        std::vector<std::array<std::vector<PairHit>, 2> > pairHits;
+        std::vector<std::vector<PairWindow> > pairWindows;
+        // bounds of the hits of every k-mer in collectPairHits and the buffer merging them, for each thread
+        std::vector<std::vector<std::pair<size_t, size_t> > > pairRuns;
+        std::vector<std::vector<PairHit> > pairRunHits;
+        // collectPairHits merges the hits of the k-mers instead of sorting them from this many hits per k-mer
+        static constexpr size_t PAIRMERGERUN = 2;
+        // shift and automata of each thread for every error budget in MyConst::ERRBUDGETS (see threadAutomaton)
+        static constexpr unsigned int SASLOTS = 4;
+        std::tuple<std::vector<ShiftAnd<2> >, std::vector<ShiftAnd<4> >, std::vector<ShiftAnd<6> >, std::vector<ShiftAnd<8> > > automata;
+        // matchings and errors of the shift and query of a single window (see matchFwdFirst), for each thread
+        std::vector<std::vector<uint64_t> > saMatchings;
+        std::vector<std::vector<uint8_t> > saErrors;
+        // candidate windows and per lane matchings and errors of saQuerySeedSetRef, for each thread
+        std::vector<std::vector<uint32_t> > candidateBuf;
+        std::vector<std::array<std::vector<uint64_t>, SALANES> > laneMatchBuf;
+        std::vector<std::array<std::vector<uint8_t>, SALANES> > laneErrBuf;
+        // reads (or pairs) of the current batch left for the full error budget by the first pass of tiered
+        // matching, for each thread, and all of them
+        std::vector<std::vector<uint32_t> > tierRetryBuf;
+        std::vector<uint32_t> tierReads;
+        // for each thread, set iff a match of the current read lies in the overlap of two windows (see
+        // inWindowOverlap), only maintained with MyConst::tieredErrors
+        std::vector<char> tierOverlap;
+        // read cache: (hash of the sequence, read) of the reads of the batch, the read whose result each read takes,
+        // the number of reads each read is matched for (0 for duplicates) and the reads to match
+        // (the number of duplicates skipped in all batches is cachedReads)
+        std::vector<std::pair<uint64_t, uint32_t> > cacheOrder;
+        std::vector<uint32_t> readRep;
+        std::vector<uint32_t> readWeight;
+        std::vector<uint32_t> cacheReads;
+        // number of reads the read each thread works on stands for, methylation events and matching statistics
+        // are counted that often
+        std::vector<uint32_t> threadWeight;
+        // reads (mates) aligned uniquely per thread and genome of a combined index, empty for a single genome
+        std::vector<std::vector<uint64_t> > genomeReads;
+        // batched verification (see matchReadsBatched)
+        // a window a pattern of a read is verified against, with the matchings found there
+        struct VerifyTask
+        {
+            uint32_t read;
+            uint32_t metaId;
+            // window relative letters to verify (see scanRange)
+            int32_t first;
+            int32_t second;
+            // end of the match found by the exact match fast path, or -1 if the window must be verified
+            int32_t exactEnd;
+            // pattern is the reverse complement of the read
+            bool isRc;
+            // window is verified on the forward strand
+            bool isFwd;
+            // matchings of the window are batchMatchings[resThread][resOff, resOff + resLen) (same for batchErrors)
+            uint16_t resThread;
+            uint32_t resOff;
+            uint32_t resLen;
+        };
+        // tasks of the reads seeded by each thread, the tasks of a read are consecutive and in the order
+        // saQuerySeedSetRef visits the windows (also the tasks of the read of matchBothPatterns)
+        std::vector<std::vector<VerifyTask> > batchTasks;
+        // for each read of the batch the thread that seeded it and its range of tasks in batchTasks of that thread
+        std::vector<std::array<uint32_t, 3> > batchReadTasks;
+        // reverse complement of each read of the batch
+        std::vector<std::string> batchRevSeqs;
+        // appends the windows pattern isRc (read or reverse complement) of read i has to be verified against to
+        // tasks, in the order saQuerySeedSetRef visits them; the pattern must be seeded (see getSeedRefs)
+        // RETURN: false iff the pattern has more windows than MyConst::candidateBudget, none are appended then
+        template <size_t E>
+        inline bool collectVerifyTasks(const uint32_t i, const bool isRc, const size_t readSize, const uint16_t qThreshold, std::vector<VerifyTask>& tasks);
+        // for each read of the batch, bit isRc is set iff collectVerifyTasks rejected pattern isRc
+        std::vector<uint8_t> batchOverBudget;
+        // true iff the seeded pattern (see getSeedRefs) has more windows passing qThreshold than
+        // MyConst::candidateBudget; the thread then marks its current read in overBudget
+        inline bool overCandidateBudget(const uint16_t qThreshold);
+        // per thread: the read the thread resolves next exceeded the candidate budget with one of its patterns
+        std::vector<uint8_t> overBudget;
+        // per thread: reads classed as non-unique for exceeding the candidate budget
+        std::vector<uint64_t> overBudgetStats;
+        // verifies the first lanes laneTasks, lane l with automaton sas[l], and stores their matchings in
+        // batchMatchings[threadnum] resp. batchErrors[threadnum]
+        template <size_t E>
+        inline void verifyTaskLanes(const std::array<ShiftAnd<E>*, SALANES>& sas, const std::array<VerifyTask*, SALANES>& laneTasks, const size_t lanes, const int threadnum);
+        // evaluates the verified tasks [k, end) of one read as saQuerySeedSetRef does, succQuery[isRc] and
+        // matches[isRc] are set to what saQuerySeedSetRef returns for the read (isRc = 0) and its reverse complement
+        template <size_t E>
+        inline void evaluateVerifyTasks(const std::vector<VerifyTask>& tasks, size_t k, const size_t end, std::array<int, 2>& succQuery, std::array<MATCH::match, 2>& matches);
+        // MyConst::jointStrands: seeds read i and its reverse complement revSeq and verifies the windows of both
+        // patterns on both strands together, SALANES at a time (same results as saQuerySeedSetRef for each)
+        template <size_t E>
+        inline void matchBothPatterns(const uint32_t i, std::string& revSeq, const uint16_t qThreshold, std::array<int, 2>& succQuery, std::array<MATCH::match, 2>& matches);
+        // tasks that are verified by shift and, as (strand, window) key and (thread << 32 | task index)
+        std::vector<std::pair<uint64_t, uint64_t> > batchOrder;
+        // matchings and errors found in the windows of the tasks verified by each thread,
+        // the additional last entry holds the output of the DeviceVerify kernel (see verifyBatchDevice)
+        std::vector<std::vector<uint64_t> > batchMatchings;
+        std::vector<std::vector<uint8_t> > batchErrors;
+        // MyConst::offload: kernel holding the reference (created with the first batch), the automata of the read
+        // [2i] and reverse complement [2i + 1] of every read i, the tasks in batchOrder and their numbers of matchings
+        std::unique_ptr<DeviceVerify> devVerify;
+        std::vector<DeviceVerify::Pattern> devPatterns;
+        std::vector<DeviceVerify::Task> devTasks;
+        std::vector<uint32_t> devCounts;
+        // sorted fwd [0] and rev [1] candidate windows of saQuerySeedSetRefFirst/Second, for each thread
+        std::vector<std::array<std::vector<std::pair<uint32_t, std::tuple<uint8_t, uint8_t, bool, bool> > >, 2> > pairedMetaBuf;
+        // matches of the read pair each thread works on, in the order matches1Fwd, matches2Rev, matches1Rev, matches2Fwd
+        std::vector<std::array<std::vector<MATCH::match>, 4> > pairedMatchBuf;
+        // single cell mode: index of the cell of each read in readBuffer
+        std::vector<uint32_t> readCells;
+        // single cell mode: cell of the read each thread currently works on
+        std::vector<uint32_t> threadCell;
+        // single cell mode: counts of each cell whose reads are matched, applied to methLevels once the cell is
+        // finished; cellCounts[cell][b] holds the counts for the range b of CpGs, by offset in the range
+        std::vector<std::vector<CellCounts> > cellCounts;
+        // position of the cell index in a methylation event
+        static constexpr unsigned int METHCELLSHIFT = 34;
 		// Mapping of internal ids to external identifier tags
 		std::unordered_map<size_t, std::string> scIds;
 		// output file for sc data
-		std::ofstream scOutput;
+		MethWriter scOutput;
+
+        // bin of every CpG (see setBins), NOBIN for CpGs outside of all bins
+        static constexpr uint32_t NOBIN = std::numeric_limits<uint32_t>::max();
+        std::vector<uint32_t> cpgBins;
+        std::vector<BINFILE::bin> bins;
+        // chromosome names of the bins, sequences of a targeted index named after the same chromosome share one
+        std::vector<std::string> binChroms;
+        // methylated and unmethylated counts of each bin, only nonzero for the bins in binTouched (see collectBins)
+        std::vector<std::array<uint64_t, 2> > binSums;
+        std::vector<uint32_t> binTouched;
+        // single cell tile matrix, not open if not requested
+        MethWriter binMatrix;
 
         // holds matching info
-        std::array<uint64_t, CORENUM> matchStats;
-        std::array<uint64_t, CORENUM> nonUniqueStats;
-        std::array<uint64_t, CORENUM> noMatchStats;
-        std::array<uint64_t, CORENUM> matchPairedStats;
-        std::array<uint64_t, CORENUM> tooShortCounts;
+        // (all per thread structures are sized to CORENUM by initThreadState())
+        std::vector<uint64_t> matchStats;
+        std::vector<uint64_t> nonUniqueStats;
+        std::vector<uint64_t> noMatchStats;
+        std::vector<uint64_t> matchPairedStats;
+        std::vector<uint64_t> tooShortCounts;
+
+        // time each thread spent matching in the current batch
+        std::vector<double> threadBusy;
+        // true iff the current batch is scheduled dynamically
+        bool schedDynamic;
+        // batches scheduled dynamically since the last static one (adaptive mode)
+        unsigned int schedDynamicBatches;
+        // summed over all batches: busy time of all threads, time threads waited for the slowest one
+        // and the number of static and dynamic batches
+        double sumBusyTime;
+        double sumIdleTime;
+        uint64_t staticBatches;
+        uint64_t dynamicBatches;
+
+        // per stage timing and histograms, disabled unless enableProfiling() is called
+        Profiler prof;
 
 		bool bothStrandsFlag;
 		// counter for read 1 matches to fwd strand
@@ -388,6 +1418,41 @@ class ReadQueue
 		uint64_t r1RevMatches;
 		bool matchR1Fwd;
 
+        // index of the file (pair) of readFiles read at the moment
+        size_t readFileIdx;
+        bool readFilesGZ;
+        // current one of fastq and fastqSpare (fastq2 and fastq2Spare)
+        FastqReader* inFastq;
+        FastqReader* inFastq2;
+        // source of the reads instead of the files, nullptr if none (see setSource)
+        ReadSource* source;
+        // true iff the parsed reads keep their ids without a per-read output (see keepIds)
+        bool idsKept;
+        // reads that took the result of an identical read (see collapseReads)
+        uint64_t cachedReads;
+        // input position after the chunk in the read buffers
+        InputPos inputPos;
+
+        // alignment output (see openAlignments), not open if no alignments are requested
+        MethWriter alignOut;
+        // true iff alignOut holds BAM records instead of SAM lines
+        bool alignBam;
+        // reference sequence in the alignment output of every chromosome id, the sequences of a targeted index
+        // named after the same chromosome share one (see RefGenome::chrOffsets)
+        std::vector<uint32_t> alignRefIds;
+        std::vector<std::string> alignRefNames;
+
+        // output of unaligned reads (see openUnmapped), written by its own thread, not open if not requested
+        FastqWriter unmappedOut;
+        // read level methylation calls (see openReadCalls), not open if not requested
+        MethWriter callOut;
+        // calls (cpgId << 1 | methylated) of the read each thread works on
+        std::vector<std::vector<uint64_t> > threadCalls;
+        // READCALLS::FLAGs of the read each thread works on, besides the strand, the QC takes the mate from them
+        std::vector<uint8_t> threadReadFlags;
+        // records of the reads each thread matched in the current batch
+        std::vector<std::string> threadCallText;
+
         // TODO
         std::ofstream of;
         inline void printMatch(std::ostream& o, MATCH::match& mat)
@@ -0,0 +1,56 @@
+//	Metal - A fast methylation alignment and calling tool for WGBS data.
+//	Copyright (C) 2017  Jonas Fischer
+//
+//	This program is free software: you can redistribute it and/or modify
+//	it under the terms of the GNU General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+//
+//	This program is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//	GNU General Public License for more details.
+//
+//	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Jonas Fischer	jonaspost@web.de
+
+#include <algorithm>
+
+#include "ReadSource.h"
+
+
+size_t MemoryReadSource::read(ReadBatch& batch, ReadBatch* batch2, const size_t n)
+{
+
+    const size_t last = std::min(num, next + n);
+    for (size_t i = next; i < last; ++i)
+    {
+        batch.push(nullptr, 0, reads[i].data, reads[i].len);
+        if (batch2)
+            batch2->push(nullptr, 0, reads2[i].data, reads2[i].len);
+    }
+    const size_t added = last - next;
+    next = last;
+    return added;
+}
+
+size_t GeneratorReadSource::read(ReadBatch& batch, ReadBatch* batch2, const size_t n)
+{
+
+    size_t added = 0;
+    while (added < n && !done)
+    {
+        if (!gen(id, seq, id2, seq2))
+        {
+            done = true;
+            break;
+        }
+        batch.push(id, seq);
+        if (batch2)
+            batch2->push(id2, seq2);
+        ++added;
+    }
+    return added;
+}
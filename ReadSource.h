@@ -0,0 +1,106 @@
+//	Metal - A fast methylation alignment and calling tool for WGBS data.
+//	Copyright (C) 2017  Jonas Fischer
+//
+//	This program is free software: you can redistribute it and/or modify
+//	it under the terms of the GNU General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+//
+//	This program is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//	GNU General Public License for more details.
+//
+//	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Jonas Fischer	jonaspost@web.de
+
+#ifndef READSOURCE_H
+#define READSOURCE_H
+
+#include <string>
+#include <functional>
+#include <cstddef>
+
+#include "Read.h"
+
+
+// Source of the reads of a ReadQueue other than FASTQ files (see ReadQueue::setSource)
+// parseChunk(...) takes its chunks from the source instead of a FastqReader, such that reads held in memory or
+// produced by a generator (e.g. SynthDS in the benchmarks) are matched without being written to and parsed from a
+// file. The reads are copied into the arena of the read buffers, as the parser does for records of a file.
+class ReadSource
+{
+
+    public:
+
+        virtual ~ReadSource() {}
+
+        // appends up to n reads to batch, for pairs read 2 to batch2 (nullptr for single-end reads); does NOT
+        // call bind()
+        //
+        // RETURN:  number of reads (pairs) appended, less than n iff the source is exhausted
+        virtual size_t read(ReadBatch& batch, ReadBatch* batch2, const size_t n) = 0;
+};
+
+// reads held by the caller as pointer/length pairs, which must stay valid until they are read
+class MemoryReadSource : public ReadSource
+{
+
+    public:
+
+        struct Seq
+        {
+            const char* data;
+            size_t len;
+        };
+
+        MemoryReadSource() : reads(nullptr), reads2(nullptr), num(0), next(0) {}
+
+        // sets the reads to return, reads2 holds read 2 of each pair (nullptr for single-end reads)
+        inline void reset(const Seq* r, const Seq* r2, const size_t n)
+        {
+            reads = r;
+            reads2 = r2;
+            num = n;
+            next = 0;
+        }
+
+        size_t read(ReadBatch& batch, ReadBatch* batch2, const size_t n) override;
+
+    private:
+
+        const Seq* reads;
+        const Seq* reads2;
+        size_t num;
+        // index of the next read to return
+        size_t next;
+};
+
+// reads produced one by one by a callback, which sets id and sequence of the next read (and of read 2 of a pair)
+// and returns false iff there is no further read
+class GeneratorReadSource : public ReadSource
+{
+
+    public:
+
+        typedef std::function<bool(std::string& id, std::string& seq, std::string& id2, std::string& seq2)> Generator;
+
+        explicit GeneratorReadSource(const Generator& g) : gen(g), done(false) {}
+
+        size_t read(ReadBatch& batch, ReadBatch* batch2, const size_t n) override;
+
+    private:
+
+        Generator gen;
+        // true iff gen returned false
+        bool done;
+        // buffers passed to gen, reused for all reads
+        std::string id;
+        std::string seq;
+        std::string id2;
+        std::string seq2;
+};
+
+#endif /* READSOURCE_H */
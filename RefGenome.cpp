@@ -19,31 +19,101 @@
 #include <chrono>
 #include <algorithm> // max
 #include <list>
-
+#include <functional> // greater
+#include <cstring>
+#include <cstdlib>
+#include <limits>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "AsyncIO.h"
+#include "Checksum.h"
+#include "Numa.h"
 #include "RefGenome.h"
 
 
-RefGenome::RefGenome(std::vector<struct CpG>&& cpgTab, std::vector<struct CpG>&& cpgStartTab, std::vector<std::vector<char> >& genomeSeq, const bool noloss, std::unordered_map<uint8_t, std::string>& chromMap) :
-        cpgTable(cpgTab)
-    ,   cpgStartTable(cpgStartTab)
-    ,   fullSeq(std::move(genomeSeq))
-    ,   tabIndex(MyConst::HTABSIZE + 1, 0)
+// while the hash table is built, the strand of a kmer is kept in an unused offset bit of the kmer itself,
+// the loaded index holds it inline in KMER_S::kmer (see KMER_S::FWDBIT)
+constexpr uint64_t STRANDBIT = 1ULL << 31;
+// and the seed it was hashed with (index into MyConst::SEEDSET) in the bit below, the loaded index does not need it
+constexpr uint64_t SEEDIDBIT = 1ULL << 30;
+static_assert(MyConst::SEEDNUM <= 2, "the kmers of the hash table keep their seed in a single bit");
+
+static inline KMER::kmer packStrand(const KMER::kmer k, const bool isFwd)
+{
+    return isFwd ? (k | STRANDBIT) : k;
+}
+static inline bool packedStrand(const KMER::kmer k)
+{
+    return k & STRANDBIT;
+}
+static inline KMER::kmer packSeed(const KMER::kmer k, const unsigned int seed)
+{
+    return seed ? (k | SEEDIDBIT) : k;
+}
+static inline unsigned int packedSeed(const KMER::kmer k)
+{
+    return (k & SEEDIDBIT) ? 1 : 0;
+}
+static inline KMER::kmer unpackedKmer(const KMER::kmer k)
+{
+    return k & ~(STRANDBIT | SEEDIDBIT);
+}
+
+
+RefGenome::RefGenome(std::vector<struct CpG>&& cpgTab, std::vector<struct CpG>&& cpgStartTab, std::vector<std::vector<char> >& genomeSeq, const bool noloss, std::unordered_map<chromId, std::string>& chromMap, std::vector<uint32_t>&& chromOffsets, const bool syncmers, const bool allSeeds, const uint32_t minCutoff) :
+        cpgTable(std::move(cpgTab))
+    ,   cpgStartTable(std::move(cpgStartTab))
+    ,   fullSeq()
+    ,   winRecBase(nullptr)
+    ,   hotMinSize(std::numeric_limits<uint64_t>::max())
+    ,   tabIndex()
+    ,   htabSize(0)
+    ,   htabMask(0)
+    ,   cellBase(0)
     ,   kmerTable()
-    ,   strandTable()
     ,   metaCpGs()
     ,   metaStartCpGs()
+    ,   filteredBloomMask(0)
+    ,   deferCutoff(minCutoff)
+    ,   kmerCutoff(MyConst::KMERCUTOFF)
+    ,   unfiltered()
+    ,   syncLen(syncmers ? MyConst::SYNCLEN : 0)
+    ,   seedNum(allSeeds ? MyConst::SEEDNUM : 1)
 	,	chrMap(chromMap)
+	,	chrOffsets(std::move(chromOffsets))
+    ,   genomeTags()
+    ,   chrGenome()
+    ,   indexMap(nullptr)
+    ,   indexMapLen(0)
+    ,   hugeMap(nullptr)
+    ,   hugeMapLen(0)
+    ,   hugeMode(HUGE_NONE)
+    ,   hugeBytes(0)
+    ,   numaNodes(0)
 {
 
     if (!testPODs())
     {
         std::cout << "\nWARNING: Structures are not POD! Cannot write index to file savely!\n\n";
     }
-    // find out genome size
+    // find out genome size and take over sequences
+    // the plain sequences are only kept for hashing, everything else uses the packed fullSeq
     size_t gensize = 0;
-    for (std::vector<char> chr : genomeSeq)
+    std::vector<MappedArray<char> > plainSeq;
+    plainSeq.reserve(genomeSeq.size());
+    fullSeq.reserve(genomeSeq.size());
+    for (std::vector<char>& chr : genomeSeq)
     {
         gensize += chr.size();
+        fullSeq.emplace_back(chr.data(), chr.size());
+        plainSeq.emplace_back(std::move(chr));
     }
     // init meta table with upper bound on required windows
     // metaCpGs.reserve(gensize/MyConst::WINLEN);
@@ -52,414 +122,1893 @@ RefGenome::RefGenome(std::vector<struct CpG>&& cpgTab, std::vector<struct CpG>&&
     // fill meta table
     // generateMetaCpGs();
 	generateWindows();
+    if (metaWindows.size() > KMER_S::METAMAX)
+    {
+        std::cerr << "Genome consists of too many meta CpGs (" << metaWindows.size() << ") to be indexed! Terminating...\n\n";
+        exit(1);
+    }
     // generate encoding of genome
     // generateBitStrings(fullSeq);
     // cout << "Done generating Genome bit representation" << endl;
-    std::cout << "\nStart hashing CpGs\n";
+    // size the hash table, the windows are hashed from fullSeq
+    const uint64_t kmerNum = estimateTablesizes(plainSeq);
+    std::vector<MappedArray<char> >().swap(plainSeq);
+    // without a memory budget (or if the tables fit into it), all cells are hashed and filtered at once
+    const uint64_t passNum = passCount(kmerNum);
+    if (passNum > 1)
+    {
+        buildInPasses(passNum, noloss);
+
+    } else {
+
+        std::cout << "\nStart hashing CpGs\n";
+        std::chrono::high_resolution_clock::time_point startTime = std::chrono::high_resolution_clock::now();
+        // hash all kmers of reduced alphabet
+        countKmers();
+        generateHashes();
+        std::chrono::high_resolution_clock::time_point endTime = std::chrono::high_resolution_clock::now();
+        auto runtime = std::chrono::duration_cast<std::chrono::seconds>(endTime - startTime).count();
+        std::cout << "\nDone hashing CpGs (" << runtime << "s)\n";
+        filterKmers(noloss);
+    }
+    std::cout << "\nFinished index processing.\n";
+}
+
+
+RefGenome::RefGenome(std::string filepath) :
+        winRecBase(nullptr)
+    ,   hotMinSize(std::numeric_limits<uint64_t>::max())
+    ,   cellBase(0)
+    ,   filteredBloomMask(0)
+    ,   deferCutoff(0)
+    ,   kmerCutoff(MyConst::KMERCUTOFF)
+    ,   unfiltered()
+    ,   syncLen(0)
+    ,   seedNum(1)
+    ,   indexMap(nullptr)
+    ,   indexMapLen(0)
+    ,   hugeMap(nullptr)
+    ,   hugeMapLen(0)
+    ,   hugeMode(HUGE_NONE)
+    ,   hugeBytes(0)
+    ,   numaNodes(0)
+{
+    load(filepath);
+}
+
+void RefGenome::extend(std::vector<struct CpG>&& cpgTab, std::vector<struct CpG>&& cpgStartTab, std::vector<std::vector<char> >& genomeSeq, const bool noloss, std::unordered_map<chromId, std::string>& chromMap, std::vector<uint32_t>&& chromOffsets)
+{
+
+    if (kmerCutoff != MyConst::KMERCUTOFF)
+    {
+        std::cerr << "The index was filtered with k-mer cutoff " << kmerCutoff << " when it was loaded, only indexes filtered with KMERCUTOFF (" << MyConst::KMERCUTOFF << ") can be extended! Terminating...\n\n";
+        exit(1);
+    }
+    if (!genomeTags.empty())
+    {
+        std::cerr << "The index combines several genomes, the genome of further sequences is unknown. Please rebuild the combined index with them! Terminating...\n\n";
+        exit(1);
+    }
+    // the merged tables replace the filtered ones, the extended index cannot be filtered again
+    unfiltered = decltype(unfiltered)();
+    std::cout << "\nStart extending index by " << genomeSeq.size() << " sequence(s)\n";
     std::chrono::high_resolution_clock::time_point startTime = std::chrono::high_resolution_clock::now();
-    // hash all kmers of reduced alphabet
-    generateHashes(fullSeq);
+
+    // the new sequences get the ids following the ones of the index, names have to stay unique
+    const chromId firstChr = fullSeq.size();
+    std::unordered_set<std::string> names;
+    for (const auto& chrMapping : chrMap)
+    {
+        names.insert(chrMapping.second);
+    }
+    for (const auto& chrMapping : chromMap)
+    {
+        if (names.count(chrMapping.second))
+        {
+            std::cerr << "Sequence " << chrMapping.second << " is already part of the index! Terminating...\n\n";
+            exit(1);
+        }
+    }
+    for (size_t i = 0; i < genomeSeq.size(); ++i)
+    {
+        fullSeq.emplace_back(genomeSeq[i].data(), genomeSeq[i].size());
+        std::vector<char>().swap(genomeSeq[i]);
+        chrMap[firstChr + i] = chromMap[i];
+        chrOffsets.push_back(chromOffsets[i]);
+    }
+    cpgTable.reserve(cpgTable.size() + cpgTab.size());
+    for (struct CpG c : cpgTab)
+    {
+        c.chrom += firstChr;
+        cpgTable.push_back(c);
+    }
+    cpgStartTable.reserve(cpgStartTable.size() + cpgStartTab.size());
+    for (struct CpG c : cpgStartTab)
+    {
+        c.chrom += firstChr;
+        cpgStartTable.push_back(c);
+    }
+    const uint32_t firstWin = metaWindows.size();
+    generateWindows(firstChr);
+    if (metaWindows.size() > KMER_S::METAMAX)
+    {
+        std::cerr << "Genome consists of too many meta CpGs (" << metaWindows.size() << ") to be indexed! Terminating...\n\n";
+        exit(1);
+    }
+
+    // hash the new windows only, (key, kmer) in the order a fill of the hash table leaves them in each cell:
+    // windows in descending order, the kmers of a window in reverse order of hashing (see sortKmerCells)
+    std::vector<std::vector<std::pair<uint64_t, KMER::kmer> > > winKmers(metaWindows.size() - firstWin);
+    std::vector<windowBuffers> bufs(CORENUM);
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(CORENUM) schedule(dynamic, 256)
+#endif
+    for (uint32_t w = 0; w < winKmers.size(); ++w)
+    {
+        hashWindow(firstWin + w, bufs[omp_get_thread_num()], [&](const uint64_t hVal, const KMER::kmer k, const bool isFwd) { winKmers[w].emplace_back(hVal & htabMask, packStrand(k, isFwd)); });
+    }
+    std::vector<std::pair<uint64_t, KMER::kmer> > added;
+    for (size_t w = winKmers.size(); w-- > 0; )
+    {
+        added.insert(added.end(), winKmers[w].rbegin(), winKmers[w].rend());
+        std::vector<std::pair<uint64_t, KMER::kmer> >().swap(winKmers[w]);
+    }
+    std::stable_sort(added.begin(), added.end(), [](const std::pair<uint64_t, KMER::kmer>& a, const std::pair<uint64_t, KMER::kmer>& b) { return a.first < b.first; });
+    std::cout << "New kmers: " << added.size() << "\n";
+
+    // cells of the hash table that get new kmers
+    std::vector<size_t> cellStarts;
+    for (size_t i = 0; i < added.size(); ++i)
+    {
+        if (i == 0 || added[i].first != added[i - 1].first)
+            cellStarts.push_back(i);
+    }
+    cellStarts.push_back(added.size());
+
+    // filter the new kmers as filterHashTable and filterRedundancyInHashTable filter a fresh index: kmers that are
+    // filtered already are dropped, the blacklist is re-evaluated for cells that now reach KMERCUTOFF kmers,
+    // which may also filter kmers of the index
+    std::vector<uint32_t> tMasks(added.size());
+    std::vector<char> keep(added.size(), 1);
+    std::vector<std::vector<uint64_t> > removedPos(CORENUM);
+    std::vector<std::vector<uint64_t> > newFiltered(CORENUM);
+    constexpr uint64_t NOSEQ = 0xffffffffffffffffULL;
+    const size_t cellNum = cellStarts.size() - 1;
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(CORENUM) schedule(dynamic, 64)
+#endif
+    for (size_t c = 0; c < cellNum; ++c)
+    {
+
+        const size_t first = cellStarts[c];
+        const size_t last = cellStarts[c + 1];
+        const uint64_t key = added[first].first;
+        std::vector<uint64_t> seqs(last - first);
+        for (size_t i = first; i < last; ++i)
+        {
+            const KMER::kmer k = unpackedKmer(added[i].second);
+            const bool isFwd = packedStrand(added[i].second);
+            seqs[i - first] = reproduceKmerSeq(k, isFwd, packedSeed(added[i].second));
+            tMasks[i] = reproduceTMask(k, isFwd);
+            if (!noloss && isFiltered(seqs[i - first]))
+                keep[i] = 0;
+        }
+
+        const uint64_t cellStart = bucketStart(key);
+        const uint64_t cellEnd = bucketStart(key + 1);
+        if (!noloss && cellEnd - cellStart + last - first >= MyConst::KMERCUTOFF)
+        {
+
+            std::unordered_map<uint64_t, unsigned int> kmerCount;
+            for (size_t i = first; i < last; ++i)
+            {
+                if (keep[i])
+                    ++kmerCount[seqs[i - first]];
+            }
+            // sequences of the kmers of the index in this cell, only the ones also added matter
+            // (the seed of a kmer of the index is not stored, the first one giving an added sequence is taken)
+            std::vector<uint64_t> cellSeqs(cellEnd - cellStart, NOSEQ);
+            for (uint64_t j = cellStart; j < cellEnd; ++j)
+            {
+                const KMER_S::kmer& e = kmerTableSmall[j];
+                const bool isFwd = KMER_S::isFwd(e);
+                if (hasKmerOffsets())
+                {
+                    for (unsigned int s = 0; s < seedNum; ++s)
+                    {
+                        const uint64_t kSeq = reproduceKmerSeq(KMER::constructKmer(0, KMER_S::getMetaCpG(e), kmerOffsets[j]), isFwd, s);
+                        if (kmerCount.count(kSeq))
+                        {
+                            cellSeqs[j - cellStart] = kSeq;
+                            break;
+                        }
+                    }
+
+                } else {
+
+                    // offset unknown, take the first position of the window with the same T mask and an added sequence
+                    const metaWindow& m = metaWindows[KMER_S::getMetaCpG(e)];
+                    const uint64_t winLen = std::min(static_cast<uint64_t>(MyConst::WINLEN), static_cast<uint64_t>(fullSeq[m.chrom].size() - m.startPos));
+                    for (uint64_t off = 0; off + MyConst::KMERLEN <= winLen && cellSeqs[j - cellStart] == NOSEQ; ++off)
+                    {
+                        const KMER::kmer k = KMER::constructKmer(0, KMER_S::getMetaCpG(e), off);
+                        if (reproduceTMask(k, isFwd) != e.tmask)
+                            continue;
+                        for (unsigned int s = 0; s < seedNum; ++s)
+                        {
+                            const uint64_t kSeq = reproduceKmerSeq(k, isFwd, s);
+                            if (kmerCount.count(kSeq))
+                            {
+                                cellSeqs[j - cellStart] = kSeq;
+                                break;
+                            }
+                        }
+                    }
+                }
+                auto count = kmerCount.find(cellSeqs[j - cellStart]);
+                if (count != kmerCount.end())
+                    ++count->second;
+            }
+            for (const auto& count : kmerCount)
+            {
+                if (count.second < MyConst::KMERCUTOFF)
+                    continue;
+                newFiltered[omp_get_thread_num()].push_back(count.first);
+                for (size_t i = first; i < last; ++i)
+                {
+                    if (seqs[i - first] == count.first)
+                        keep[i] = 0;
+                }
+                for (uint64_t j = cellStart; j < cellEnd; ++j)
+                {
+                    if (cellSeqs[j - cellStart] == count.first)
+                        removedPos[omp_get_thread_num()].push_back(j);
+                }
+            }
+        }
+
+        // only one kmer per window, strand and T mask
+        std::unordered_set<uint32_t> masks;
+        uint64_t metaID = 0xffffffffffffffffULL;
+        bool isFwd = false;
+        for (size_t i = first; i < last; ++i)
+        {
+            if (!keep[i])
+                continue;
+            const KMER::kmer k = unpackedKmer(added[i].second);
+            if (KMER::getMetaCpG(k) != metaID || packedStrand(added[i].second) != isFwd)
+            {
+                masks.clear();
+                metaID = KMER::getMetaCpG(k);
+                isFwd = packedStrand(added[i].second);
+            }
+            if (!masks.insert(tMasks[i]).second)
+                keep[i] = 0;
+        }
+    }
+
+    std::vector<uint64_t> removed;
+    for (const std::vector<uint64_t>& threadRemoved : removedPos)
+    {
+        removed.insert(removed.end(), threadRemoved.begin(), threadRemoved.end());
+    }
+    std::sort(removed.begin(), removed.end());
+    std::vector<uint64_t> filtered(filteredKmers.begin(), filteredKmers.end());
+    for (const std::vector<uint64_t>& threadFiltered : newFiltered)
+    {
+        filtered.insert(filtered.end(), threadFiltered.begin(), threadFiltered.end());
+    }
+    std::sort(filtered.begin(), filtered.end());
+    filtered.erase(std::unique(filtered.begin(), filtered.end()), filtered.end());
+    // the kept new kmers in the representation used for querying
+    std::vector<uint64_t> newKeys;
+    std::vector<KMER_S::kmer> newKmers;
+    std::vector<uint16_t> newOffsets;
+    std::vector<uint8_t> newPrints;
+    for (size_t i = 0; i < added.size(); ++i)
+    {
+        if (!keep[i])
+            continue;
+        const KMER::kmer k = unpackedKmer(added[i].second);
+        newKeys.push_back(added[i].first);
+        newKmers.push_back(KMER_S::constructKmerS(KMER::getCore(k), tMasks[i], packedStrand(added[i].second)));
+        newOffsets.push_back(KMER::getOffset(k));
+        if (hasKmerPrints())
+            newPrints.push_back(kmerPrint(reproduceKmerSeq(k, packedStrand(added[i].second), packedSeed(added[i].second))));
+    }
+    std::vector<std::pair<uint64_t, KMER::kmer> >().swap(added);
+
+    // merge the new kmers into the bucket directory and the kmer table, the new kmers come first in their cells
+    // (windows in descending order), every block of the directory is merged independently
+    constexpr uint64_t blockLen = 1ULL << INDEX::TABBLOCKBITS;
+    const uint64_t keyNum = tabOffsets.size();
+    const uint64_t blockNum = tabBlocks.size();
+    const uint64_t kmerNum = kmerTableSmall.size() - removed.size() + newKeys.size();
+    std::vector<uint32_t> offs(keyNum);
+    std::vector<uint64_t> blocks(blockNum);
+    std::vector<KMER_S::kmer> kmers(kmerNum);
+    std::vector<uint16_t> kmerOffs(hasKmerOffsets() ? kmerNum : 0);
+    std::vector<uint8_t> prints(hasKmerPrints() ? kmerNum : 0);
+    bool overflow = false;
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(CORENUM) schedule(dynamic, 1)
+#endif
+    for (uint64_t b = 0; b < blockNum; ++b)
+    {
+        const uint64_t firstKey = b * blockLen;
+        const uint64_t lastKey = std::min(firstKey + blockLen, keyNum);
+        size_t newInd = std::lower_bound(newKeys.begin(), newKeys.end(), firstKey) - newKeys.begin();
+        size_t remInd = std::lower_bound(removed.begin(), removed.end(), bucketStart(firstKey)) - removed.begin();
+        uint64_t out = bucketStart(firstKey) - remInd + newInd;
+        blocks[b] = out;
+        for (uint64_t key = firstKey; key < lastKey; ++key)
+        {
+            if (out - blocks[b] > std::numeric_limits<uint32_t>::max())
+            {
+#pragma omp atomic write
+                overflow = true;
+            }
+            offs[key] = out - blocks[b];
+            // the last key only marks the end of the table
+            if (key + 1 == keyNum)
+                break;
+            for (; newInd < newKeys.size() && newKeys[newInd] == key; ++newInd, ++out)
+            {
+                kmers[out] = newKmers[newInd];
+                if (hasKmerOffsets())
+                    kmerOffs[out] = newOffsets[newInd];
+                if (hasKmerPrints())
+                    prints[out] = newPrints[newInd];
+            }
+            const uint64_t cellEnd = bucketStart(key + 1);
+            for (uint64_t j = bucketStart(key); j < cellEnd; ++j)
+            {
+                if (remInd < removed.size() && removed[remInd] == j)
+                {
+                    ++remInd;
+                    continue;
+                }
+                kmers[out] = kmerTableSmall[j];
+                if (hasKmerOffsets())
+                    kmerOffs[out] = kmerOffsets[j];
+                if (hasKmerPrints())
+                    prints[out] = kmerPrints[j];
+                ++out;
+            }
+        }
+    }
+    if (overflow)
+    {
+        std::cerr << "Buckets of the extended index hold too many k-mers for the bucket directory (decrease INDEX::TABBLOCKBITS)! Terminating...\n\n";
+        exit(1);
+    }
+    tabOffsets = MappedArray<uint32_t>(std::move(offs));
+    tabBlocks = MappedArray<uint64_t>(std::move(blocks));
+    kmerTableSmall = MappedArray<KMER_S::kmer>(std::move(kmers));
+    kmerOffsets = MappedArray<uint16_t>(std::move(kmerOffs));
+    kmerPrints = MappedArray<uint8_t>(std::move(prints));
+    filteredKmers = MappedArray<uint64_t>(std::move(filtered));
+    buildFilteredBloom();
+
     std::chrono::high_resolution_clock::time_point endTime = std::chrono::high_resolution_clock::now();
     auto runtime = std::chrono::duration_cast<std::chrono::seconds>(endTime - startTime).count();
-    std::cout << "\nDone hashing CpGs (" << runtime << "s)\n";
-    if (!noloss)
+    std::cout << "Added " << newKeys.size() << " kmers of " << metaWindows.size() - firstWin << " new windows, filtered " << removed.size() << " kmers of the index (running " << runtime << "s)\n\n";
+}
+
+RefGenome::~RefGenome()
+{
+    if (warmer.joinable())
     {
-        std::cout << "\nStarting filtering process for Index\nThrowing out highly repetetive kmers...\n";
-        // filter out highly repetitive sequences
-        filterHashTable();
+        warmStop = true;
+        warmer.join();
+        if (warmMillis >= 0)
+            std::cout << "Index warm-up read " << (warmBytes >> 20) << " MB in " << warmMillis / 1000.0 << "s\n";
+        else
+            std::cout << "Index warm-up stopped after " << (warmBytes >> 20) << " MB\n";
     }
-    std::cout << "\nThrowing out kmers of single metaCpG with same hash...\n";
-    filterRedundancyInHashTable();
-    std::cout << "\nFinished index processing.\n";
+    if (indexMap != nullptr)
+    {
+        munmap(indexMap, indexMapLen);
+    }
+    if (hugeMap != nullptr)
+    {
+        munmap(hugeMap, hugeMapLen);
+    }
+}
+
+
+// drops the whole pages inside [from, from + bytes) of a private file mapping that is only read, they are read
+// from the file again if accessed later
+static void dropPages(const void* from, const uint64_t bytes)
+{
+    const uintptr_t pageLen = sysconf(_SC_PAGESIZE);
+    const uintptr_t start = (reinterpret_cast<uintptr_t>(from) + pageLen - 1) / pageLen * pageLen;
+    const uintptr_t end = (reinterpret_cast<uintptr_t>(from) + bytes) / pageLen * pageLen;
+    if (end > start)
+    {
+        madvise(reinterpret_cast<void*>(start), end - start, MADV_DONTNEED);
+    }
+}
+
+// writes len bytes of data at offset off of fd, returns false on error
+static bool writeAt(const int fd, const char* data, size_t len, uint64_t off)
+{
+    while (len > 0)
+    {
+        const ssize_t n = pwrite(fd, data, len, off);
+        if (n <= 0)
+            return false;
+        data += n;
+        len -= n;
+        off += n;
+    }
+    return true;
+}
+
+// checksums of all sections of the index file mapped at base (see INDEX::section), the blocks of all sections are hashed in parallel
+static void sectionChecksums(const char* base, const INDEX::header& hdr, std::array<uint64_t, INDEX::SECNUM>& sums)
+{
+
+    // (section, block number) of every block
+    std::vector<std::pair<uint32_t, uint64_t> > blocks;
+    std::array<size_t, INDEX::SECNUM + 1> firstBlock;
+    for (uint32_t id = 0; id < INDEX::SECNUM; ++id)
+    {
+        firstBlock[id] = blocks.size();
+        for (uint64_t b = 0; b * INDEX::CHECKBLOCK < hdr.sections[id].bytes; ++b)
+            blocks.emplace_back(id, b);
+    }
+    firstBlock[INDEX::SECNUM] = blocks.size();
+
+    std::vector<uint64_t> blockSums(blocks.size());
+#pragma omp parallel for num_threads(CORENUM) schedule(dynamic, 1)
+    for (size_t i = 0; i < blocks.size(); ++i)
+    {
+        const INDEX::section& sec = hdr.sections[blocks[i].first];
+        const uint64_t from = blocks[i].second * INDEX::CHECKBLOCK;
+        blockSums[i] = CHECKSUM::xxh64(base + sec.offset + from, std::min(INDEX::CHECKBLOCK, sec.bytes - from), blocks[i].second);
+    }
+    for (uint32_t id = 0; id < INDEX::SECNUM; ++id)
+    {
+        sums[id] = CHECKSUM::xxh64(blockSums.data() + firstBlock[id], sizeof(uint64_t) * (firstBlock[id + 1] - firstBlock[id]), hdr.sections[id].bytes);
+    }
+}
+
+static uint64_t headerChecksum(INDEX::header hdr)
+{
+    hdr.checksum = 0;
+    return CHECKSUM::xxh64(&hdr, sizeof(hdr), 0);
+}
+
+// compresses the index file of len bytes mapped at plain block by block into a new file filepath (see INDEX::zheader),
+// returns false on error
+static bool compressIndex(const char* plain, const uint64_t len, const std::string& filepath)
+{
+
+    INDEX::zheader zhdr;
+    std::memset(&zhdr, 0, sizeof(zhdr));
+    zhdr.magic = INDEX::ZMAGIC;
+    zhdr.version = INDEX::VERSION;
+    zhdr.bytes = len;
+    zhdr.blocks = (len + INDEX::ZBLOCK - 1) / INDEX::ZBLOCK;
+    std::vector<INDEX::zblock> table(zhdr.blocks);
+
+    const int fd = open(filepath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return false;
+    bool failed = false;
+    uint64_t fileEnd = sizeof(zhdr) + sizeof(INDEX::zblock) * table.size();
+    // blocks are compressed in parallel rounds, such that only a few of them are held in memory
+    const uint64_t roundLen = 4 * CORENUM;
+    std::vector<std::vector<Bytef> > zbufs(roundLen);
+    for (uint64_t first = 0; first < zhdr.blocks && !failed; first += roundLen)
+    {
+        const uint64_t last = std::min(first + roundLen, zhdr.blocks);
+#pragma omp parallel for num_threads(CORENUM) schedule(dynamic, 1)
+        for (uint64_t b = first; b < last; ++b)
+        {
+            const uLong blockLen = std::min(INDEX::ZBLOCK, len - b * INDEX::ZBLOCK);
+            std::vector<Bytef>& zbuf = zbufs[b - first];
+            uLongf zLen = compressBound(blockLen);
+            zbuf.resize(zLen);
+            if (compress2(zbuf.data(), &zLen, reinterpret_cast<const Bytef*>(plain + b * INDEX::ZBLOCK), blockLen, Z_DEFAULT_COMPRESSION) != Z_OK)
+            {
+#pragma omp atomic write
+                failed = true;
+            }
+            zbuf.resize(zLen);
+        }
+        for (uint64_t b = first; b < last && !failed; ++b)
+        {
+            table[b].offset = fileEnd;
+            table[b].bytes = zbufs[b - first].size();
+            failed = !writeAt(fd, reinterpret_cast<const char*>(zbufs[b - first].data()), table[b].bytes, fileEnd);
+            fileEnd += table[b].bytes;
+        }
+    }
+    zhdr.checksum = CHECKSUM::xxh64(table.data(), sizeof(INDEX::zblock) * table.size(), zhdr.bytes);
+    failed = failed || !writeAt(fd, reinterpret_cast<const char*>(table.data()), sizeof(INDEX::zblock) * table.size(), sizeof(zhdr));
+    // the header is written last, as for the uncompressed file
+    failed = failed || fdatasync(fd) != 0 || !writeAt(fd, reinterpret_cast<const char*>(&zhdr), sizeof(zhdr), 0);
+    return close(fd) == 0 && !failed;
+}
+
+// decompresses the compressed index file fd (see INDEX::zheader) into anonymous memory, all blocks in parallel,
+// and sets len to the size of the uncompressed file; returns MAP_FAILED if the memory cannot be allocated
+static void* decompressIndex(const int fd, const std::string& filepath, const uint64_t fileLen, size_t& len)
+{
+
+    INDEX::zheader zhdr;
+    if (pread(fd, &zhdr, sizeof(zhdr), 0) != sizeof(zhdr) || zhdr.magic != INDEX::ZMAGIC || zhdr.version != INDEX::VERSION)
+    {
+        std::cerr << "Index file " << filepath << " has an unknown format or was written by another version of this program. Please rebuild the index (\"--store_index\")! Terminating...\n\n";
+        exit(1);
+    }
+    std::vector<INDEX::zblock> table;
+    if (zhdr.blocks == (zhdr.bytes + INDEX::ZBLOCK - 1) / INDEX::ZBLOCK && sizeof(INDEX::zblock) * zhdr.blocks <= fileLen - sizeof(zhdr))
+    {
+        table.resize(zhdr.blocks);
+        const ssize_t tableLen = sizeof(INDEX::zblock) * table.size();
+        if (pread(fd, table.data(), tableLen, sizeof(zhdr)) != tableLen)
+            table.clear();
+    }
+    if (table.size() != zhdr.blocks || zhdr.bytes == 0 || CHECKSUM::xxh64(table.data(), sizeof(INDEX::zblock) * table.size(), zhdr.bytes) != zhdr.checksum)
+    {
+        std::cerr << "Index file " << filepath << " is truncated or corrupt (block table)! Terminating...\n\n";
+        exit(1);
+    }
+
+    void* mem = mmap(nullptr, zhdr.bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED)
+        return mem;
+    char* out = static_cast<char*>(mem);
+    // first corrupt block, if any
+    uint64_t badBlock = zhdr.blocks;
+#pragma omp parallel for num_threads(CORENUM) schedule(dynamic, 1)
+    for (uint64_t b = 0; b < zhdr.blocks; ++b)
+    {
+        const uLong blockLen = std::min(INDEX::ZBLOCK, zhdr.bytes - b * INDEX::ZBLOCK);
+        uLongf outLen = blockLen;
+        std::vector<Bytef> zbuf(table[b].bytes);
+        const bool ok = table[b].offset <= fileLen && table[b].bytes <= fileLen - table[b].offset
+                && pread(fd, zbuf.data(), zbuf.size(), table[b].offset) == static_cast<ssize_t>(zbuf.size())
+                && uncompress(reinterpret_cast<Bytef*>(out + b * INDEX::ZBLOCK), &outLen, zbuf.data(), zbuf.size()) == Z_OK
+                && outLen == blockLen;
+        if (!ok)
+        {
+#pragma omp critical(badblock)
+            badBlock = std::min(badBlock, b);
+        }
+    }
+    if (badBlock < zhdr.blocks)
+    {
+        std::cerr << "Index file " << filepath << " is truncated or corrupt (compressed block " << badBlock << ")! Terminating...\n\n";
+        exit(1);
+    }
+    len = zhdr.bytes;
+    return mem;
+}
+
+
+void RefGenome::save(const std::string& filepath, const bool withOffsets, const bool withPrints, const bool compress)
+{
+
+    std::cout << "Start writing index to file " << filepath << "\n";
+    std::chrono::high_resolution_clock::time_point startTime = std::chrono::high_resolution_clock::now();
+
+    // save CONSTANTS
+    INDEX::header hdr;
+    std::memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = INDEX::MAGIC;
+    hdr.version = INDEX::VERSION;
+    hdr.secNum = INDEX::SECNUM;
+    hdr.htabs = htabSize;
+    hdr.readl = MyConst::READLEN;
+    hdr.winl = MyConst::WINLEN;
+    hdr.kmerl = MyConst::KMERLEN;
+    hdr.seedbits = MyConst::SEEDBITS;
+    hdr.syncl = syncLen;
+    hdr.seednum = seedNum;
+    for (unsigned int s = 0; s < seedNum; ++s)
+    {
+        hdr.seedset[s] = MyConst::SEEDSET[s];
+    }
+
+    // chromosome offsets in the concatenated sequence
+    std::vector<uint64_t> seqOff(1, 0);
+    uint64_t seqWordNum = 0;
+    uint64_t nMaskWordNum = 0;
+    for (const PackedSeq& chromSeq : fullSeq)
+    {
+        seqOff.push_back(seqOff.back() + chromSeq.size());
+        seqWordNum += chromSeq.seqData().size();
+        nMaskWordNum += chromSeq.nMaskData().size();
+    }
+    // a loaded (and extended) index holds the hash table in the representation of the file already
+    const bool loaded = tabIndex.empty();
+    const bool offsets = loaded ? hasKmerOffsets() : withOffsets;
+    const bool prints = loaded ? hasKmerPrints() : withPrints;
+    const uint64_t keyNum = loaded ? tabOffsets.size() : tabIndex.size();
+    const uint64_t kmerNum = loaded ? kmerTableSmall.size() : kmerTable.size();
+    // first bucket of every block of the bucket directory
+    constexpr uint64_t blockLen = 1ULL << INDEX::TABBLOCKBITS;
+    std::vector<uint64_t> blockBases(tabBlocks.begin(), tabBlocks.end());
+    for (size_t block = 0; !loaded && block < tabIndex.size(); block += blockLen)
+    {
+        blockBases.push_back(tabIndex[block]);
+    }
+    std::string chrMapBuf;
+    write_chrMap(chrMapBuf);
+    std::string genomeTagBuf;
+    for (const std::string& tag : genomeTags)
+    {
+        const uint64_t len = tag.size();
+        genomeTagBuf.append(reinterpret_cast<const char*>(&len), sizeof(len));
+        genomeTagBuf.append(tag);
+    }
+    static_assert(MyConst::WINLEN <= (1 << 16), "k-mer offsets inside windows are stored in 16 bit");
+
+    // a deferred index holds the unfiltered hash table, the occurrences of its k-mers in their buckets and, instead
+    // of the blacklist, all k-mers a cutoff of at least deferCutoff may blacklist with their occurrences
+    // (see applyKmerCutoff)
+    const bool deferred = !loaded && deferCutoff > 0;
+    hdr.kmerc = deferred ? deferCutoff : kmerCutoff;
+    std::vector<uint16_t> kmerCounts;
+    std::vector<uint64_t> candSeqs;
+    std::vector<uint16_t> candCounts;
+    if (deferred)
+    {
+        kmerCounts.assign(kmerNum, 0);
+        // as filterHashTable, buckets with fewer than deferCutoff k-mers cannot hold a k-mer to filter
+        std::vector<std::unordered_map<uint64_t, unsigned int> > bucketCounts(CORENUM);
+        std::vector<std::vector<uint64_t> > bucketSeqs(CORENUM);
+        std::vector<std::vector<std::pair<uint64_t, uint16_t> > > cands(CORENUM);
+#pragma omp parallel for num_threads(CORENUM) schedule(dynamic, 1 << 12)
+        for (uint64_t cell = 0; cell < htabSize; ++cell)
+        {
+            const uint64_t cellStart = tabIndex[cell];
+            const uint64_t cellEnd = tabIndex[cell + 1];
+            if (cellEnd - cellStart < deferCutoff)
+                continue;
+            std::unordered_map<uint64_t, unsigned int>& bl = bucketCounts[omp_get_thread_num()];
+            std::vector<uint64_t>& kSeqs = bucketSeqs[omp_get_thread_num()];
+            bl.clear();
+            blacklist(cellStart, cellEnd, bl, kSeqs);
+            for (uint64_t j = cellStart; j < cellEnd; ++j)
+            {
+                kmerCounts[j] = std::min<unsigned int>(bl[kSeqs[j - cellStart]], std::numeric_limits<uint16_t>::max());
+            }
+            for (const auto& kCount : bl)
+            {
+                if (kCount.second >= deferCutoff)
+                    cands[omp_get_thread_num()].emplace_back(kCount.first, std::min<unsigned int>(kCount.second, std::numeric_limits<uint16_t>::max()));
+            }
+        }
+        std::vector<std::pair<uint64_t, uint16_t> > allCands;
+        for (std::vector<std::pair<uint64_t, uint16_t> >& threadCands : cands)
+        {
+            allCands.insert(allCands.end(), threadCands.begin(), threadCands.end());
+            std::vector<std::pair<uint64_t, uint16_t> >().swap(threadCands);
+        }
+        std::sort(allCands.begin(), allCands.end());
+        for (const auto& cand : allCands)
+        {
+            candSeqs.push_back(cand.first);
+            candCounts.push_back(cand.second);
+        }
+        std::cout << "Stored the k-mer counts of the unfiltered hash table, " << candSeqs.size() << " k-mer(s) with at least " << deferCutoff << " occurrences\n";
+    }
+
+    // place all sections before anything is written, every section starts at a multiple of INDEX::ALIGN
+    uint64_t fileEnd = sizeof(hdr);
+    auto placeSection = [&](const INDEX::SECTION id, const uint64_t bytes, const uint64_t count)
+    {
+        fileEnd = (fileEnd + INDEX::ALIGN - 1) / INDEX::ALIGN * INDEX::ALIGN;
+        hdr.sections[id].offset = fileEnd;
+        hdr.sections[id].bytes = bytes;
+        hdr.sections[id].count = count;
+        fileEnd += bytes;
+    };
+    placeSection(INDEX::CPG, sizeof(struct CpG) * cpgTable.size(), cpgTable.size());
+    placeSection(INDEX::CPGSTART, sizeof(struct CpG) * cpgStartTable.size(), cpgStartTable.size());
+    placeSection(INDEX::SEQ, sizeof(uint64_t) * seqWordNum, seqWordNum);
+    placeSection(INDEX::SEQNMASK, sizeof(uint64_t) * nMaskWordNum, nMaskWordNum);
+    placeSection(INDEX::SEQOFF, sizeof(uint64_t) * seqOff.size(), seqOff.size());
+    placeSection(INDEX::TABINDEX, sizeof(uint32_t) * keyNum, keyNum);
+    placeSection(INDEX::TABBLOCK, sizeof(uint64_t) * blockBases.size(), blockBases.size());
+    placeSection(INDEX::KMERS, sizeof(KMER_S::kmer) * kmerNum, kmerNum);
+    placeSection(INDEX::METACPG, sizeof(struct metaCpG) * metaCpGs.size(), metaCpGs.size());
+    placeSection(INDEX::METASTARTCPG, sizeof(struct metaCpG) * metaStartCpGs.size(), metaStartCpGs.size());
+    placeSection(INDEX::METAWIN, sizeof(struct metaWindow) * metaWindows.size(), metaWindows.size());
+    // stored sorted, such that the index file does not depend on the order of insertion and can be searched in place
+    const MappedArray<uint64_t> candidates(std::move(candSeqs));
+    const MappedArray<uint64_t>& filtered = deferred ? candidates : filteredKmers;
+    placeSection(INDEX::FILTERED, sizeof(uint64_t) * filtered.size(), filtered.size());
+    placeSection(INDEX::CHRMAP, chrMapBuf.size(), chrMap.size());
+    placeSection(INDEX::KMEROFF, offsets ? sizeof(uint16_t) * kmerNum : 0, offsets ? kmerNum : 0);
+    placeSection(INDEX::CHROFF, sizeof(uint32_t) * chrOffsets.size(), chrOffsets.size());
+    placeSection(INDEX::KMERPRINT, prints ? sizeof(uint8_t) * kmerNum : 0, prints ? kmerNum : 0);
+    placeSection(INDEX::KMERCOUNT, sizeof(uint16_t) * kmerCounts.size(), kmerCounts.size());
+    placeSection(INDEX::FILTERCOUNT, sizeof(uint16_t) * candCounts.size(), candCounts.size());
+    placeSection(INDEX::GENOMETAG, genomeTagBuf.size(), genomeTags.size());
+    placeSection(INDEX::CHRGENOME, sizeof(uint8_t) * chrGenome.size(), chrGenome.size());
+
+    // pieces of at most WRITECHUNK bytes that are written independently
+    // data is nullptr for the sections converted while writing (bucket directory, k-mers, k-mer offsets and
+    // fingerprints of a built index)
+    // WRITECHUNK is a multiple of the bytes of a block of the bucket directory
+    constexpr uint64_t WRITECHUNK = 1ULL << 26;
+    // the conversion buffers of all threads stay inside the memory budget of index construction, if any
+    uint64_t writeChunk = WRITECHUNK;
+    while (MyConst::indexMem > 0 && writeChunk > sizeof(uint32_t) * blockLen && writeChunk * CORENUM > (static_cast<uint64_t>(MyConst::indexMem) << 20))
+    {
+        writeChunk >>= 1;
+    }
+    struct WritePiece {
+        INDEX::SECTION id;
+        const char* data;
+        uint64_t from;
+        uint64_t bytes;
+    };
+    std::vector<WritePiece> pieces;
+    auto addPieces = [&](const INDEX::SECTION id, const char* data, const uint64_t from, const uint64_t bytes)
+    {
+        for (uint64_t off = 0; off < bytes; off += writeChunk)
+        {
+            pieces.push_back({id, data ? data + off : nullptr, from + off, std::min(writeChunk, bytes - off)});
+        }
+    };
+    addPieces(INDEX::CPG, reinterpret_cast<const char*>(cpgTable.data()), 0, hdr.sections[INDEX::CPG].bytes);
+    addPieces(INDEX::CPGSTART, reinterpret_cast<const char*>(cpgStartTable.data()), 0, hdr.sections[INDEX::CPGSTART].bytes);
+    uint64_t seqFrom = 0;
+    uint64_t nMaskFrom = 0;
+    for (const PackedSeq& chromSeq : fullSeq)
+    {
+        addPieces(INDEX::SEQ, reinterpret_cast<const char*>(chromSeq.seqData().data()), seqFrom, sizeof(uint64_t) * chromSeq.seqData().size());
+        addPieces(INDEX::SEQNMASK, reinterpret_cast<const char*>(chromSeq.nMaskData().data()), nMaskFrom, sizeof(uint64_t) * chromSeq.nMaskData().size());
+        seqFrom += sizeof(uint64_t) * chromSeq.seqData().size();
+        nMaskFrom += sizeof(uint64_t) * chromSeq.nMaskData().size();
+    }
+    addPieces(INDEX::SEQOFF, reinterpret_cast<const char*>(seqOff.data()), 0, hdr.sections[INDEX::SEQOFF].bytes);
+    addPieces(INDEX::TABINDEX, loaded ? reinterpret_cast<const char*>(tabOffsets.data()) : nullptr, 0, hdr.sections[INDEX::TABINDEX].bytes);
+    addPieces(INDEX::TABBLOCK, reinterpret_cast<const char*>(blockBases.data()), 0, hdr.sections[INDEX::TABBLOCK].bytes);
+    addPieces(INDEX::KMERS, loaded ? reinterpret_cast<const char*>(kmerTableSmall.data()) : nullptr, 0, hdr.sections[INDEX::KMERS].bytes);
+    addPieces(INDEX::METACPG, reinterpret_cast<const char*>(metaCpGs.data()), 0, hdr.sections[INDEX::METACPG].bytes);
+    addPieces(INDEX::METASTARTCPG, reinterpret_cast<const char*>(metaStartCpGs.data()), 0, hdr.sections[INDEX::METASTARTCPG].bytes);
+    addPieces(INDEX::METAWIN, reinterpret_cast<const char*>(metaWindows.data()), 0, hdr.sections[INDEX::METAWIN].bytes);
+    addPieces(INDEX::FILTERED, reinterpret_cast<const char*>(filtered.data()), 0, hdr.sections[INDEX::FILTERED].bytes);
+    addPieces(INDEX::CHRMAP, chrMapBuf.data(), 0, hdr.sections[INDEX::CHRMAP].bytes);
+    addPieces(INDEX::KMEROFF, loaded ? reinterpret_cast<const char*>(kmerOffsets.data()) : nullptr, 0, hdr.sections[INDEX::KMEROFF].bytes);
+    addPieces(INDEX::CHROFF, reinterpret_cast<const char*>(chrOffsets.data()), 0, hdr.sections[INDEX::CHROFF].bytes);
+    addPieces(INDEX::KMERPRINT, loaded ? reinterpret_cast<const char*>(kmerPrints.data()) : nullptr, 0, hdr.sections[INDEX::KMERPRINT].bytes);
+    addPieces(INDEX::KMERCOUNT, reinterpret_cast<const char*>(kmerCounts.data()), 0, hdr.sections[INDEX::KMERCOUNT].bytes);
+    addPieces(INDEX::FILTERCOUNT, reinterpret_cast<const char*>(candCounts.data()), 0, hdr.sections[INDEX::FILTERCOUNT].bytes);
+    addPieces(INDEX::GENOMETAG, genomeTagBuf.data(), 0, hdr.sections[INDEX::GENOMETAG].bytes);
+    addPieces(INDEX::CHRGENOME, reinterpret_cast<const char*>(chrGenome.data()), 0, hdr.sections[INDEX::CHRGENOME].bytes);
+
+    // a compressed index is compressed from the uncompressed file written next to it
+    const std::string plainPath = compress ? filepath + ".tmp" : filepath;
+    const int fd = open(plainPath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || ftruncate(fd, fileEnd) != 0)
+    {
+        std::cerr << "Could not create index file " << plainPath << "! Terminating...\n\n";
+        exit(1);
+    }
+
+    bool writeFailed = false;
+    // first block of the bucket directory whose offsets do not fit into 32 bit, if any
+    uint64_t overflowBlock = keyNum;
+#pragma omp parallel for num_threads(CORENUM) schedule(dynamic, 1)
+    for (size_t p = 0; p < pieces.size(); ++p)
+    {
+        const WritePiece& piece = pieces[p];
+        const char* data = piece.data;
+        std::vector<char> buf;
+        if (!data)
+        {
+            buf.resize(piece.bytes);
+            data = buf.data();
+            if (piece.id == INDEX::TABINDEX)
+            {
+                // tabIndex as bucket directory, offsets relative to the first bucket of their block
+                uint32_t* dir = reinterpret_cast<uint32_t*>(buf.data());
+                const uint64_t first = piece.from / sizeof(uint32_t);
+                for (uint64_t key = first; key < first + piece.bytes / sizeof(uint32_t); ++key)
+                {
+                    const uint64_t off = tabIndex[key] - blockBases[key >> INDEX::TABBLOCKBITS];
+                    if (off > std::numeric_limits<uint32_t>::max())
+                    {
+#pragma omp critical(overflow)
+                        overflowBlock = std::min(overflowBlock, key & ~(blockLen - 1));
+                    }
+                    dir[key - first] = off;
+                }
+                // a table built in passes is read from its temporary file once (see buildInPasses)
+                if (tabIndex.isMapped())
+                {
+                    dropPages(tabIndex.data() + first, sizeof(uint64_t) * (piece.bytes / sizeof(uint32_t)));
+                }
+
+            } else if (piece.id == INDEX::KMERS) {
+
+                // kmers in the representation used for querying
+                KMER_S::kmer* out = reinterpret_cast<KMER_S::kmer*>(buf.data());
+                const uint64_t first = piece.from / sizeof(KMER_S::kmer);
+                for (uint64_t i = first; i < first + piece.bytes / sizeof(KMER_S::kmer); ++i)
+                {
+                    const KMER::kmer k = unpackedKmer(kmerTable[i]);
+                    const bool isFwd = packedStrand(kmerTable[i]);
+                    out[i - first] = KMER_S::constructKmerS(KMER::getCore(k), reproduceTMask(k, isFwd), isFwd);
+                }
+                if (kmerTable.isMapped())
+                {
+                    dropPages(kmerTable.data() + first, sizeof(KMER::kmer) * (piece.bytes / sizeof(KMER_S::kmer)));
+                }
+
+            } else if (piece.id == INDEX::KMERPRINT) {
+
+                // fingerprints of the kmers, in the order of kmerTableSmall
+                uint8_t* out = reinterpret_cast<uint8_t*>(buf.data());
+                const uint64_t first = piece.from / sizeof(uint8_t);
+                for (uint64_t i = first; i < first + piece.bytes / sizeof(uint8_t); ++i)
+                {
+                    out[i - first] = kmerPrint(reproduceKmerSeq(unpackedKmer(kmerTable[i]), packedStrand(kmerTable[i]), packedSeed(kmerTable[i])));
+                }
+                if (kmerTable.isMapped())
+                {
+                    dropPages(kmerTable.data() + first, sizeof(KMER::kmer) * (piece.bytes / sizeof(uint8_t)));
+                }
+
+            } else {
+
+                // offsets of the kmers inside their windows, in the order of kmerTableSmall
+                uint16_t* out = reinterpret_cast<uint16_t*>(buf.data());
+                const uint64_t first = piece.from / sizeof(uint16_t);
+                for (uint64_t i = first; i < first + piece.bytes / sizeof(uint16_t); ++i)
+                {
+                    out[i - first] = KMER::getOffset(unpackedKmer(kmerTable[i]));
+                }
+                if (kmerTable.isMapped())
+                {
+                    dropPages(kmerTable.data() + first, sizeof(KMER::kmer) * (piece.bytes / sizeof(uint16_t)));
+                }
+            }
+        }
+        if (!writeAt(fd, data, piece.bytes, hdr.sections[piece.id].offset + piece.from))
+        {
+#pragma omp atomic write
+            writeFailed = true;
+        }
+    }
+    if (overflowBlock < keyNum)
+    {
+        std::cerr << "Buckets of hash keys " << overflowBlock << " to " << std::min(overflowBlock + blockLen, keyNum) - 1 << " hold too many k-mers for the bucket directory (decrease INDEX::TABBLOCKBITS)! Terminating...\n\n";
+        close(fd);
+        unlink(plainPath.c_str());
+        exit(1);
+    }
+
+    // checksums over the written file, such that the stored values describe what is on disk
+    void* fileMap = writeFailed || fileEnd == 0 ? MAP_FAILED : mmap(nullptr, fileEnd, PROT_READ, MAP_SHARED, fd, 0);
+    if (fileMap != MAP_FAILED)
+    {
+        std::array<uint64_t, INDEX::SECNUM> sums;
+        sectionChecksums(static_cast<const char*>(fileMap), hdr, sums);
+        munmap(fileMap, fileEnd);
+        for (uint32_t id = 0; id < INDEX::SECNUM; ++id)
+        {
+            hdr.sections[id].checksum = sums[id];
+        }
+    }
+
+    // the header is written last, once all sections are on disk
+    hdr.checksum = headerChecksum(hdr);
+    if (writeFailed || fileMap == MAP_FAILED || fdatasync(fd) != 0 || !writeAt(fd, reinterpret_cast<const char*>(&hdr), sizeof(hdr), 0) || close(fd) != 0)
+    {
+        std::cerr << "Error while writing index file... Terminating\n\n";
+        exit(1);
+    }
+    if (compress)
+    {
+        const int plainFd = open(plainPath.c_str(), O_RDONLY);
+        void* plain = plainFd < 0 ? MAP_FAILED : mmap(nullptr, fileEnd, PROT_READ, MAP_SHARED, plainFd, 0);
+        if (plainFd >= 0)
+            close(plainFd);
+        if (plain == MAP_FAILED || !compressIndex(static_cast<const char*>(plain), fileEnd, filepath))
+        {
+            std::cerr << "Error while compressing index file... Terminating\n\n";
+            exit(1);
+        }
+        munmap(plain, fileEnd);
+        unlink(plainPath.c_str());
+        struct stat st;
+        if (stat(filepath.c_str(), &st) == 0)
+            std::cout << "Compressed index from " << (fileEnd >> 20) << " MB to " << (st.st_size >> 20) << " MB\n";
+    }
+
+    std::chrono::high_resolution_clock::time_point endTime = std::chrono::high_resolution_clock::now();
+    auto runtime = std::chrono::duration_cast<std::chrono::seconds>(endTime - startTime).count();
+    std::cout << "Finished writing index to file " << filepath << " in " << runtime << "s\n\n";
+}
+
+void RefGenome::load(const std::string& filepath)
+{
+
+    std::cout << "Start reading index file " << filepath << "\n";
+    std::chrono::high_resolution_clock::time_point startTime = std::chrono::high_resolution_clock::now();
+
+    // map whole file read only, pages are shared with all other processes using the same index
+    int fd = open(filepath.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        std::cerr << "Could not open index file " << filepath << "! Terminating...\n\n";
+        exit(1);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(INDEX::header))
+    {
+        std::cerr << "Index file " << filepath << " is too small to be an index! Terminating...\n\n";
+        exit(1);
+    }
+    uint64_t magic = 0;
+    if (pread(fd, &magic, sizeof(magic), 0) == sizeof(magic) && magic == INDEX::ZMAGIC)
+    {
+        // compressed index, the tables are used in place in the decompressed copy
+        indexMap = decompressIndex(fd, filepath, st.st_size, indexMapLen);
+
+    } else {
+
+        indexMapLen = st.st_size;
+        indexMap = mmap(nullptr, indexMapLen, PROT_READ, MAP_PRIVATE, fd, 0);
+        // faults on the mapping read a few pages at a time, an index not in the page cache yet is pulled in by a
+        // sequential pass with MyConst::ioDepth large reads in flight first, unless it is read in the background
+        if (indexMap != MAP_FAILED && MyConst::ioDepth > 1 && !MyConst::warmIndex)
+        {
+            const size_t pageSize = sysconf(_SC_PAGESIZE);
+            std::vector<unsigned char> resident((indexMapLen + pageSize - 1) / pageSize);
+            if (mincore(indexMap, indexMapLen, resident.data()) == 0 && std::count_if(resident.begin(), resident.end(), [](const unsigned char r) { return r & 1; }) * 2 < static_cast<ptrdiff_t>(resident.size()))
+            {
+                AsyncReader warm;
+                if (warm.open(filepath))
+                    warm.discard();
+            }
+        }
+    }
+    close(fd);
+    if (indexMap == MAP_FAILED)
+    {
+        indexMap = nullptr;
+        std::cerr << "Could not map index file " << filepath << " into memory! Terminating...\n\n";
+        exit(1);
+    }
+    char* base = static_cast<char*>(indexMap);
+    const INDEX::header& hdr = *reinterpret_cast<const INDEX::header*>(base);
+
+    if (hdr.magic != INDEX::MAGIC || hdr.version != INDEX::VERSION || hdr.secNum != INDEX::SECNUM)
+    {
+        std::cerr << "Index file " << filepath << " has an unknown format or was written by another version of this program. Please rebuild the index (\"--store_index\")! Terminating...\n\n";
+        exit(1);
+    }
+    if (headerChecksum(hdr) != hdr.checksum)
+    {
+        std::cerr << "Index file " << filepath << " is corrupt (header checksum)! Terminating...\n\n";
+        exit(1);
+    }
+    // check CONSTANTS
+    // the table size is chosen per genome when building, it only has to be a power of two
+    if (hdr.htabs == 0 || (hdr.htabs & (hdr.htabs - 1)) || hdr.htabs > MyConst::HTABSIZE)
+    {
+        std::cerr << "Hash table size in index file (" << hdr.htabs << ") is not a power of two up to HTABSIZE! Terminating...\n\n";
+        exit(1);
+    }
+    htabSize = hdr.htabs;
+    htabMask = htabSize - 1;
+    if (hdr.readl != MyConst::READLEN)
+    {
+        std::cerr << "Read length used in source code and index file are different!\n\n";
+        exit(1);
+    }
+    if (hdr.winl != MyConst::WINLEN)
+    {
+        std::cerr << "Meta CpG length used in source code and index file are different!\n\n";
+        exit(1);
+    }
+    if (hdr.kmerl != MyConst::KMERLEN)
+    {
+        std::cerr << "k-mer length used in source code and index file are different!\n\n";
+        exit(1);
+    }
+    // a deferred index is filtered below with any cutoff of at least the one it was built for
+    const bool deferred = hdr.sections[INDEX::KMERCOUNT].count > 0;
+    const uint64_t cutoff = MyConst::kmerCutoff > 0 ? MyConst::kmerCutoff : MyConst::KMERCUTOFF;
+    if (deferred && (cutoff < hdr.kmerc || cutoff > std::numeric_limits<uint16_t>::max()))
+    {
+        std::cerr << "k-mer cutoff " << cutoff << " is not between the smallest cutoff of the deferred index file (" << hdr.kmerc << ") and " << std::numeric_limits<uint16_t>::max() << "!\n\n";
+        exit(1);
+    }
+    if (!deferred && hdr.kmerc != MyConst::KMERCUTOFF)
+    {
+        std::cerr << "k-mer cutoff used in source code and index file are different!\n\n";
+        exit(1);
+    }
+    if (!deferred && MyConst::kmerCutoff > 0 && MyConst::kmerCutoff != hdr.kmerc)
+    {
+        std::cerr << "Index file " << filepath << " was filtered when it was built (see \"--defer_cutoff\"), --kmer_cutoff has no effect\n";
+    }
+	if (hdr.seedbits != MyConst::SEEDBITS)
+	{
+		std::cerr << "Different seed used in index and methylation prediction!\n\n";
+		exit(1);
+	}
+	if (hdr.syncl != 0 && hdr.syncl != MyConst::SYNCLEN)
+	{
+		std::cerr << "Syncmer length used in source code and index file are different!\n\n";
+		exit(1);
+	}
+	syncLen = hdr.syncl;
+	if (hdr.seednum == 0 || hdr.seednum > MyConst::SEEDNUM || !std::equal(hdr.seedset, hdr.seedset + hdr.seednum, MyConst::SEEDSET))
+	{
+		std::cerr << "Different seeds used in index and methylation prediction!\n\n";
+		exit(1);
+	}
+	seedNum = hdr.seednum;
+    for (uint32_t id = 0; id < INDEX::SECNUM; ++id)
+    {
+        const INDEX::section& sec = hdr.sections[id];
+        if (sec.offset % INDEX::ALIGN != 0 || sec.offset > indexMapLen || sec.bytes > indexMapLen - sec.offset)
+        {
+            std::cerr << "Index file " << filepath << " is truncated or corrupt (section " << id << ")! Terminating...\n\n";
+            exit(1);
+        }
+    }
+    if (MyConst::verifyIndex)
+    {
+        std::array<uint64_t, INDEX::SECNUM> sums;
+        sectionChecksums(base, hdr, sums);
+        bool corrupt = false;
+        for (uint32_t id = 0; id < INDEX::SECNUM; ++id)
+        {
+            if (sums[id] != hdr.sections[id].checksum)
+            {
+                std::cerr << "Checksum of section " << id << " of index file " << filepath << " does not match\n";
+                corrupt = true;
+            }
+        }
+        if (corrupt)
+        {
+            std::cerr << "Index file " << filepath << " is corrupt, please rebuild the index (\"--store_index\")! Terminating...\n\n";
+            exit(1);
+        }
+        std::cout << "Verified the checksums of all sections of the index file\n";
+    }
+
+    // the large tables are copied to memory backed by huge pages or interleaved over the NUMA nodes if requested
+    std::array<char*, INDEX::SECNUM> secData;
+    for (uint32_t id = 0; id < INDEX::SECNUM; ++id)
+    {
+        secData[id] = base + hdr.sections[id].offset;
+    }
+    if (MyConst::hugePages || MyConst::numa)
+    {
+        copyTables(hdr, secData);
+    }
+
+    // let arr view the given section in place
+    auto viewSection = [&](auto& arr, const INDEX::SECTION id)
+    {
+        using T = typename std::remove_reference<decltype(arr[0])>::type;
+        const INDEX::section& sec = hdr.sections[id];
+        if (sec.bytes != sec.count * sizeof(T))
+        {
+            std::cerr << "Index file " << filepath << " is corrupt (size of section " << id << ")! Terminating...\n\n";
+            exit(1);
+        }
+        arr.view(reinterpret_cast<T*>(secData[id]), sec.count);
+    };
+
+    // CpGs
+    viewSection(cpgTable, INDEX::CPG);
+    viewSection(cpgStartTable, INDEX::CPGSTART);
+    // reference sequence
+    MappedArray<uint64_t> seqOff;
+    viewSection(seqOff, INDEX::SEQOFF);
+    MappedArray<uint64_t> seqWords;
+    MappedArray<uint64_t> nMaskWords;
+    viewSection(seqWords, INDEX::SEQ);
+    viewSection(nMaskWords, INDEX::SEQNMASK);
+    fullSeq.resize(seqOff.empty() ? 0 : seqOff.size() - 1);
+    // every chromosome starts at a new word
+    size_t seqWord = 0;
+    size_t nMaskWord = 0;
+    for (size_t i = 0; i < fullSeq.size(); ++i)
+    {
+        const size_t len = seqOff[i + 1] - seqOff[i];
+        if (seqOff[i + 1] < seqOff[i] || seqWord + PackedSeq::seqWords(len) > seqWords.size() || nMaskWord + PackedSeq::maskWords(len) > nMaskWords.size())
+        {
+            std::cerr << "Index file " << filepath << " is corrupt (sequence offsets)! Terminating...\n\n";
+            exit(1);
+        }
+        fullSeq[i].view(seqWords.data() + seqWord, nMaskWords.data() + nMaskWord, len);
+        seqWord += PackedSeq::seqWords(len);
+        nMaskWord += PackedSeq::maskWords(len);
+    }
+    if (seqOff.empty() || seqWord != seqWords.size() || nMaskWord != nMaskWords.size())
+    {
+        std::cerr << "Index file " << filepath << " is corrupt (sequence offsets)! Terminating...\n\n";
+        exit(1);
+    }
+    // hash table
+    viewSection(tabOffsets, INDEX::TABINDEX);
+    viewSection(tabBlocks, INDEX::TABBLOCK);
+    if (tabOffsets.size() != htabSize + 1 || tabBlocks.size() != (tabOffsets.size() >> INDEX::TABBLOCKBITS) + ((tabOffsets.size() & ((1ULL << INDEX::TABBLOCKBITS) - 1)) ? 1 : 0))
+    {
+        std::cerr << "Index file " << filepath << " is corrupt (bucket directory)! Terminating...\n\n";
+        exit(1);
+    }
+    viewSection(kmerTableSmall, INDEX::KMERS);
+    viewSection(kmerOffsets, INDEX::KMEROFF);
+    if (hasKmerOffsets() && kmerOffsets.size() != kmerTableSmall.size())
+    {
+        std::cerr << "Index file " << filepath << " is corrupt (k-mer offsets)! Terminating...\n\n";
+        exit(1);
+    }
+    viewSection(kmerPrints, INDEX::KMERPRINT);
+    if (hasKmerPrints() && kmerPrints.size() != kmerTableSmall.size())
+    {
+        std::cerr << "Index file " << filepath << " is corrupt (k-mer fingerprints)! Terminating...\n\n";
+        exit(1);
+    }
+    // meta CpGs (small, copied)
+    const struct metaCpG* metas = reinterpret_cast<const struct metaCpG*>(base + hdr.sections[INDEX::METACPG].offset);
+    metaCpGs.assign(metas, metas + hdr.sections[INDEX::METACPG].count);
+    metas = reinterpret_cast<const struct metaCpG*>(base + hdr.sections[INDEX::METASTARTCPG].offset);
+    metaStartCpGs.assign(metas, metas + hdr.sections[INDEX::METASTARTCPG].count);
+    viewSection(metaWindows, INDEX::METAWIN);
+
+    // filtered kmers, stored sorted
+    viewSection(filteredKmers, INDEX::FILTERED);
+    if (deferred)
+    {
+        // the views of the stored tables are kept, such that the index can be filtered again (see setKmerCutoff)
+        unfiltered.tabOffsets = tabOffsets;
+        unfiltered.tabBlocks = tabBlocks;
+        unfiltered.kmers = kmerTableSmall;
+        unfiltered.kmerOffsets = kmerOffsets;
+        unfiltered.kmerPrints = kmerPrints;
+        unfiltered.candidates = filteredKmers;
+        unfiltered.minCutoff = hdr.kmerc;
+        viewSection(unfiltered.counts, INDEX::KMERCOUNT);
+        viewSection(unfiltered.candCounts, INDEX::FILTERCOUNT);
+        if (unfiltered.counts.size() != kmerTableSmall.size() || unfiltered.candCounts.size() != filteredKmers.size())
+        {
+            std::cerr << "Index file " << filepath << " is corrupt (k-mer counts)! Terminating...\n\n";
+            exit(1);
+        }
+        applyKmerCutoff(cutoff);
+    }
+    buildFilteredBloom();
+	// load chromosome ID mapping
+    read_chrMap(base + hdr.sections[INDEX::CHRMAP].offset, hdr.sections[INDEX::CHRMAP].count);
+    viewSection(chrOffsets, INDEX::CHROFF);
+    if (chrOffsets.size() != fullSeq.size())
+    {
+        std::cerr << "Index file " << filepath << " is corrupt (chromosome offsets)! Terminating...\n\n";
+        exit(1);
+    }
+    // genomes of a combined index
+    const char* tagBuf = secData[INDEX::GENOMETAG];
+    const char* const tagEnd = tagBuf + hdr.sections[INDEX::GENOMETAG].bytes;
+    for (uint64_t g = 0; g < hdr.sections[INDEX::GENOMETAG].count; ++g)
+    {
+        uint64_t len = 0;
+        if (static_cast<uint64_t>(tagEnd - tagBuf) >= sizeof(len))
+        {
+            std::memcpy(&len, tagBuf, sizeof(len));
+            tagBuf += sizeof(len);
+        }
+        if (len == 0 || len > static_cast<uint64_t>(tagEnd - tagBuf))
+        {
+            std::cerr << "Index file " << filepath << " is corrupt (genome tags)! Terminating...\n\n";
+            exit(1);
+        }
+        genomeTags.emplace_back(tagBuf, len);
+        tagBuf += len;
+    }
+    viewSection(chrGenome, INDEX::CHRGENOME);
+    if ((!genomeTags.empty() || !chrGenome.empty()) && (chrGenome.size() != fullSeq.size() || std::any_of(chrGenome.begin(), chrGenome.end(), [&](const uint8_t g) { return g >= genomeTags.size(); })))
+    {
+        std::cerr << "Index file " << filepath << " is corrupt (genomes of the chromosomes)! Terminating...\n\n";
+        exit(1);
+    }
+    if (MyConst::windowRecords)
+        buildWindowRecords();
+    if (MyConst::hotBuckets)
+        buildHotBuckets();
+
+    // the sections still used in the file mapping, in the order of how often matching reads them
+    if (MyConst::warmIndex && magic != INDEX::ZMAGIC)
+    {
+        std::vector<std::pair<const char*, uint64_t> > ranges;
+        for (const INDEX::SECTION id : {INDEX::TABBLOCK, INDEX::TABINDEX, INDEX::KMERS, INDEX::KMERPRINT, INDEX::KMEROFF, INDEX::METAWIN, INDEX::SEQ, INDEX::SEQNMASK, INDEX::CPG, INDEX::CPGSTART})
+        {
+            if (secData[id] == base + hdr.sections[id].offset && hdr.sections[id].bytes > 0)
+                ranges.emplace_back(secData[id], hdr.sections[id].bytes);
+        }
+        warmer = std::thread(&RefGenome::warmUp, this, std::move(ranges));
+    }
+
+    std::chrono::high_resolution_clock::time_point endTime = std::chrono::high_resolution_clock::now();
+    auto runtime = std::chrono::duration_cast<std::chrono::seconds>(endTime - startTime).count();
+    std::cout << "Finished reading index file " << filepath << " in " << runtime << "s" << (warmer.joinable() ? ", the tables are read in the background" : "") << "\n\n";
+}
+
+void RefGenome::warmUp(const std::vector<std::pair<const char*, uint64_t> > ranges)
+{
+
+    const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+    const uintptr_t pageLen = sysconf(_SC_PAGESIZE);
+    // pieces small enough that the matching threads faulting the same pages do not wait long for a piece
+    constexpr uint64_t pieceLen = 1ULL << 24;
+    for (const auto& range : ranges)
+    {
+        for (uint64_t off = 0; off < range.second; off += pieceLen)
+        {
+            if (warmStop)
+                return;
+            const uintptr_t from = reinterpret_cast<uintptr_t>(range.first + off) / pageLen * pageLen;
+            const uintptr_t to = reinterpret_cast<uintptr_t>(range.first + std::min(range.second, off + pieceLen));
+            // read-ahead of the whole piece, then one read per page maps the pages into this process
+            madvise(reinterpret_cast<void*>(from), to - from, MADV_WILLNEED);
+            for (uintptr_t p = from; p < to; p += pageLen)
+                static_cast<void>(*reinterpret_cast<const volatile unsigned char*>(p));
+            warmBytes += to - from;
+        }
+    }
+    warmMillis = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+void RefGenome::copyTables(const INDEX::header& hdr, std::array<char*, INDEX::SECNUM>& secData)
+{
+
+    // tables hit at random by seeding and verification, the hash table of a deferred index is replaced by its
+    // filtered copy (see applyKmerCutoff)
+    std::vector<INDEX::SECTION> large = {INDEX::SEQ, INDEX::SEQNMASK};
+    if (hdr.sections[INDEX::KMERCOUNT].count == 0)
+        large.insert(large.begin(), {INDEX::TABINDEX, INDEX::KMERS, INDEX::KMEROFF, INDEX::KMERPRINT});
+    constexpr size_t hugeLen = 1ULL << 21;
+    size_t len = 0;
+    for (const INDEX::SECTION id : large)
+    {
+        len += (hdr.sections[id].bytes + INDEX::ALIGN - 1) / INDEX::ALIGN * INDEX::ALIGN;
+    }
+    len = (len + hugeLen - 1) / hugeLen * hugeLen;
+    if (len == 0)
+        return;
+
+    // explicit huge pages need pages reserved by the administrator (vm.nr_hugepages), otherwise ask for
+    // transparent huge pages on a 2 MB aligned anonymous mapping
+    void* mem = MyConst::hugePages ? mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0) : MAP_FAILED;
+    if (mem != MAP_FAILED)
+    {
+        hugeMode = HUGE_TLBFS;
+
+    } else {
+
+        mem = mmap(nullptr, len + hugeLen, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mem == MAP_FAILED)
+        {
+            std::cerr << "Could not allocate memory for the index tables, they stay in the file mapping\n";
+            return;
+        }
+        // cut the mapping to its aligned part
+        char* raw = static_cast<char*>(mem);
+        char* aligned = reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(raw) + hugeLen - 1) & ~(hugeLen - 1));
+        if (aligned > raw)
+            munmap(raw, aligned - raw);
+        munmap(aligned + len, raw + hugeLen - aligned);
+        mem = aligned;
+        if (MyConst::hugePages)
+            hugeMode = madvise(mem, len, MADV_HUGEPAGE) == 0 ? HUGE_THP : HUGE_NONE;
+    }
+    hugeMap = mem;
+    hugeMapLen = len;
+
+    // the policy must be set before the copy below faults the pages in
+    if (MyConst::numa)
+    {
+        const std::vector<int> nodes = NUMA::memNodes();
+        if (NUMA::interleave(mem, len, nodes))
+        {
+            numaNodes = nodes.size();
+            std::cout << "Index tables (" << (len >> 20) << " MB) interleaved over " << numaNodes << " NUMA node(s)\n";
+        } else {
+            std::cerr << "Could not interleave the index tables over the NUMA nodes, using the default placement\n";
+        }
+    }
+
+    const uintptr_t pageMask = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE)) - 1;
+    char* out = static_cast<char*>(mem);
+    for (const INDEX::SECTION id : large)
+    {
+        const INDEX::section& sec = hdr.sections[id];
+        memcpy(out, secData[id], sec.bytes);
+        // the copy is used from now on, drop the pages of the file mapping (the page cache keeps them)
+        const uintptr_t from = (reinterpret_cast<uintptr_t>(secData[id]) + pageMask) & ~pageMask;
+        const uintptr_t to = (reinterpret_cast<uintptr_t>(secData[id]) + sec.bytes) & ~pageMask;
+        if (to > from)
+            madvise(reinterpret_cast<void*>(from), to - from, MADV_DONTNEED);
+        secData[id] = out;
+        out += (sec.bytes + INDEX::ALIGN - 1) / INDEX::ALIGN * INDEX::ALIGN;
+    }
+
+    if (!MyConst::hugePages)
+        return;
+
+    // transparent huge pages may be refused (fragmented memory, "never" in
+    // /sys/kernel/mm/transparent_hugepage/enabled), report what the kernel actually did
+    hugeBytes = len;
+    if (hugeMode != HUGE_TLBFS)
+    {
+        hugeBytes = 0;
+        char start[32];
+        snprintf(start, sizeof(start), "%lx-", static_cast<unsigned long>(reinterpret_cast<uintptr_t>(mem)));
+        std::ifstream smaps("/proc/self/smaps");
+        std::string line;
+        bool inMap = false;
+        while (std::getline(smaps, line))
+        {
+            if (!inMap)
+            {
+                inMap = line.compare(0, strlen(start), start) == 0;
+
+            } else if (line.compare(0, 14, "AnonHugePages:") == 0) {
+
+                hugeBytes = std::stoull(line.substr(14)) * 1024;
+                break;
+            }
+        }
+    }
+    std::cout << "Huge pages for the index tables (" << (len >> 20) << " MB, " << (hugeMode == HUGE_TLBFS ? "explicit" : "transparent") << "): " << (hugeBytes >> 20) << " MB backed by huge pages\n";
+}
+
+bool RefGenome::setKmerCutoff(const uint64_t cutoff)
+{
+
+    if (unfiltered.counts.empty() || cutoff < unfiltered.minCutoff || cutoff > std::numeric_limits<uint16_t>::max())
+        return false;
+    if (cutoff == kmerCutoff)
+        return true;
+    applyKmerCutoff(cutoff);
+    buildFilteredBloom();
+    if (!hotStarts.empty())
+    {
+        hotStarts.clear();
+        hotOffsets.clear();
+        hotData.clear();
+        hotMinSize = std::numeric_limits<uint64_t>::max();
+        buildHotBuckets();
+    }
+    return true;
+}
+
+void RefGenome::applyKmerCutoff(const uint64_t cutoff)
+{
+
+    std::chrono::high_resolution_clock::time_point startTime = std::chrono::high_resolution_clock::now();
+    const MappedArray<uint32_t>& tabOffsetsIn = unfiltered.tabOffsets;
+    const MappedArray<uint64_t>& tabBlocksIn = unfiltered.tabBlocks;
+    const MappedArray<KMER_S::kmer>& kmersIn = unfiltered.kmers;
+    const MappedArray<uint16_t>& counts = unfiltered.counts;
+    const bool offsets = !unfiltered.kmerOffsets.empty();
+    const bool prints = !unfiltered.kmerPrints.empty();
+    // the last key of the bucket directory only marks the end of the table
+    const uint64_t keyNum = tabOffsetsIn.size();
+    const uint64_t blockNum = tabBlocksIn.size();
+    constexpr uint64_t blockLen = 1ULL << INDEX::TABBLOCKBITS;
+
+    // calls keep(i) for the kept entries i of the buckets of block b, in order, and sets the offsets of the keys of
+    // the block relative to the first kept entry of the block (if newOffsets is given)
+    auto filterBlock = [&](const uint64_t b, std::unordered_set<uint32_t>& masks, uint32_t* newOffsets, auto&& keep)
+    {
+        uint32_t kept = 0;
+        for (uint64_t key = b * blockLen; key < std::min(keyNum, (b + 1) * blockLen); ++key)
+        {
+            if (newOffsets)
+                newOffsets[key] = kept;
+            if (key + 1 == keyNum)
+                break;
+            const uint64_t bucketEnd = tabBlocksIn[(key + 1) >> INDEX::TABBLOCKBITS] + tabOffsetsIn[key + 1];
+            // previous window with start flag and strand, as in filterRedundancyInHashTable
+            uint32_t meta = 0;
+            bool first = true;
+            for (uint64_t i = tabBlocksIn[b] + tabOffsetsIn[key]; i < bucketEnd; ++i)
+            {
+                if (counts[i] >= cutoff)
+                    continue;
+                const KMER_S::kmer& k = kmersIn[i];
+                if (first || k.meta != meta)
+                {
+                    masks.clear();
+                    meta = k.meta;
+                    first = false;
+
+                } else if (masks.count(k.tmask)) {
+
+                    continue;
+                }
+                masks.insert(k.tmask);
+                keep(i);
+                ++kept;
+            }
+        }
+        return kept;
+    };
+
+    // kept entries per block, then the entries are copied to their new positions
+    std::vector<uint64_t> newBlocks(blockNum + 1, 0);
+#pragma omp parallel for num_threads(CORENUM) schedule(dynamic, 1)
+    for (uint64_t b = 0; b < blockNum; ++b)
+    {
+        std::unordered_set<uint32_t> masks;
+        newBlocks[b + 1] = filterBlock(b, masks, nullptr, [](const uint64_t) {});
+    }
+    for (uint64_t b = 0; b < blockNum; ++b)
+    {
+        newBlocks[b + 1] += newBlocks[b];
+    }
+    const uint64_t kmerNum = newBlocks[blockNum];
+    newBlocks.pop_back();
+    std::vector<uint32_t> newOffsets(keyNum);
+    std::vector<KMER_S::kmer> newKmers(kmerNum);
+    std::vector<uint16_t> newKmerOffsets(offsets ? kmerNum : 0);
+    std::vector<uint8_t> newPrints(prints ? kmerNum : 0);
+#pragma omp parallel for num_threads(CORENUM) schedule(dynamic, 1)
+    for (uint64_t b = 0; b < blockNum; ++b)
+    {
+        std::unordered_set<uint32_t> masks;
+        uint64_t out = newBlocks[b];
+        filterBlock(b, masks, newOffsets.data(), [&](const uint64_t i)
+        {
+            newKmers[out] = kmersIn[i];
+            if (offsets)
+                newKmerOffsets[out] = unfiltered.kmerOffsets[i];
+            if (prints)
+                newPrints[out] = unfiltered.kmerPrints[i];
+            ++out;
+        });
+    }
+    tabOffsets = MappedArray<uint32_t>(std::move(newOffsets));
+    tabBlocks = MappedArray<uint64_t>(std::move(newBlocks));
+    kmerTableSmall = MappedArray<KMER_S::kmer>(std::move(newKmers));
+    kmerOffsets = MappedArray<uint16_t>(std::move(newKmerOffsets));
+    kmerPrints = MappedArray<uint8_t>(std::move(newPrints));
+
+    // the candidates are sorted, and so are the ones blacklisted
+    std::vector<uint64_t> blacklisted;
+    for (size_t c = 0; c < unfiltered.candidates.size(); ++c)
+    {
+        if (unfiltered.candCounts[c] >= cutoff)
+            blacklisted.push_back(unfiltered.candidates[c]);
+    }
+    filteredKmers = MappedArray<uint64_t>(std::move(blacklisted));
+    kmerCutoff = cutoff;
+
+    std::chrono::high_resolution_clock::time_point endTime = std::chrono::high_resolution_clock::now();
+    auto runtime = std::chrono::duration_cast<std::chrono::seconds>(endTime - startTime).count();
+    std::cout << "Filtered the deferred index with k-mer cutoff " << cutoff << " (" << runtime << "s): " << kmerNum << " of " << kmersIn.size() << " kmers kept, " << filteredKmers.size() << " blacklisted\n";
 }
 
+void RefGenome::buildFilteredBloom()
+{
+
+    size_t words = 1;
+    while (words * 64 < filteredKmers.size() * 16)
+        words <<= 1;
+    filteredBloom.assign(words, 0);
+    filteredBloomMask = words - 1;
+    for (const uint64_t kSeq : filteredKmers)
+    {
 
-RefGenome::RefGenome(std::string filepath)
+        const uint64_t h = kSeq * BLOOMMULT;
+        filteredBloom[(h >> 20) & filteredBloomMask] |= (1ULL << (h >> 58)) | (1ULL << ((h >> 52) & 63));
+    }
+}
+inline void RefGenome::write_chrMap(std::string& buf)
 {
-    load(filepath);
+
+	for (auto chrMapping : chrMap)
+	{
+		chromId internID = chrMapping.first;
+		buf.append(reinterpret_cast<char*>(&internID), sizeof(internID));
+		uint64_t strlen = chrMapping.second.size();
+		buf.append(reinterpret_cast<char*>(&strlen), sizeof(strlen));
+		buf.append(chrMapping.second.data(), strlen);
+	}
+}
+inline void RefGenome::read_chrMap(const char* buf, const size_t n)
+{
+
+	for (size_t i = 0; i < n; ++i)
+	{
+		chromId internID;
+		std::memcpy(&internID, buf, sizeof(internID));
+		buf += sizeof(internID);
+		uint64_t strlen;
+		std::memcpy(&strlen, buf, sizeof(strlen));
+		buf += sizeof(strlen);
+		chrMap.insert(std::pair<chromId, std::string>(internID, std::string(buf, strlen)));
+		buf += strlen;
+	}
 }
 
 
-void RefGenome::save(const std::string& filepath)
+void RefGenome::buildContextSites()
 {
 
-    std::cout << "Start writing index to file " << filepath << "\n";
-    std::chrono::high_resolution_clock::time_point startTime = std::chrono::high_resolution_clock::now();
-    // open file in binary mode
-    std::ofstream of(filepath, std::ofstream::binary | std::ofstream::trunc);
+    const size_t chrNum = fullSeq.size();
+    std::vector<std::vector<uint32_t> > sites(chrNum);
+    std::vector<std::vector<uint8_t> > types(chrNum);
+    // letters outside of the sequence are unknown, sites without a known context are left out
+    const auto isH = [](const char c) { return c == 'A' || c == 'C' || c == 'T'; };
+    const auto isD = [](const char c) { return c == 'A' || c == 'G' || c == 'T'; };
+#pragma omp parallel for num_threads(CORENUM) schedule(dynamic, 1)
+    for (size_t c = 0; c < chrNum; ++c)
+    {
 
-    // save CONSTANTS
-    auto htabs = MyConst::HTABSIZE;
-    of.write(reinterpret_cast<char*>(&htabs), sizeof(htabs));
-    auto readl = MyConst::READLEN;
-    of.write(reinterpret_cast<char*>(&readl), sizeof(readl));
-    auto winl = MyConst::WINLEN;
-    of.write(reinterpret_cast<char*>(&winl), sizeof(winl));
-    auto kmerl = MyConst::KMERLEN;
-    of.write(reinterpret_cast<char*>(&kmerl), sizeof(kmerl));
-    auto kmerc = MyConst::KMERCUTOFF;
-    of.write(reinterpret_cast<char*>(&kmerc), sizeof(kmerc));
-	auto seedbits = MyConst::SEEDBITS;
-	of.write(reinterpret_cast<char*>(&seedbits), sizeof(seedbits));
-
-    // store NON-start CpGs
-    size_t cpgNum = cpgTable.size();
-    of.write(reinterpret_cast<char*>(&cpgNum), sizeof(cpgNum));
-    of.write(reinterpret_cast<char*>(cpgTable.data()), sizeof(cpgTable[0]) * cpgNum);
-    if (of.fail())
-    {
-        std::cout << "Error writing CpG stuff " << cpgNum << "\n";
-    }
-    // store start CpGs
-    cpgNum = cpgStartTable.size();
-    of.write(reinterpret_cast<char*>(&cpgNum), sizeof(cpgNum));
-    of.write(reinterpret_cast<char*>(cpgStartTable.data()), sizeof(cpgStartTable[0]) * cpgNum);
-    if (of.fail())
-    {
-        std::cout << "Error writing CpG Start stuff " << cpgNum << "\n";
-    }
-    // write reference sequence
-    size_t chromNum = fullSeq.size();
-    of.write(reinterpret_cast<char*>(&chromNum), sizeof(chromNum));
-    for (std::vector<char> chromSeq : fullSeq)
-    {
-        size_t chromLen = chromSeq.size();
-        of.write(reinterpret_cast<char*>(&chromLen), sizeof(chromLen));
-        of.write(chromSeq.data(), chromLen);
-        if (of.fail())
+        const PackedSeq& seq = fullSeq[c];
+        const std::ptrdiff_t len = seq.size();
+        const auto at = [&](const std::ptrdiff_t i) { return i >= 0 && i < len ? seq.begin()[i] : 'N'; };
+        for (std::ptrdiff_t i = 0; i < len; ++i)
         {
-            std::cout << "Error writing sequence " << chromLen << "\n";
+            const char l = seq.begin()[i];
+            if (l == 'C' && isH(at(i + 1)))
+            {
+                // CHG or CHH on the forward strand
+                const char third = at(i + 2);
+                if (third == 'G' || isH(third))
+                {
+                    sites[c].push_back(i);
+                    types[c].push_back(third == 'G' ? 0 : CTX_CHH);
+                }
+
+            } else if (l == 'G' && isD(at(i - 1))) {
+
+                // the reverse strand reads CHG or CHH from right to left
+                const char third = at(i - 2);
+                if (third == 'C' || isD(third))
+                {
+                    sites[c].push_back(i);
+                    types[c].push_back(CTX_REV | (third == 'C' ? 0 : CTX_CHH));
+                }
+            }
         }
     }
-    // tabIndex
-    size_t tabLen = tabIndex.size();
-    of.write(reinterpret_cast<char*>(&tabLen), sizeof(tabLen));
-    of.write(reinterpret_cast<char*>(tabIndex.data()), sizeof(tabIndex[0])*tabLen);
 
-    if (of.fail())
+    ctxStart.assign(chrNum + 1, 0);
+    for (size_t c = 0; c < chrNum; ++c)
     {
-        std::cout << "Error writing tabIndex " << tabLen << "\n";
+        ctxStart[c + 1] = ctxStart[c] + sites[c].size();
     }
-    // store kmers
-    size_t kmerNum = kmerTable.size();
-    of.write(reinterpret_cast<char*>(&kmerNum), sizeof(kmerNum));
-    for (size_t i = 0; i < kmerNum; ++i)
+    ctxSites.resize(ctxStart[chrNum]);
+    ctxTypes.resize(ctxStart[chrNum]);
+    for (size_t c = 0; c < chrNum; ++c)
     {
-        const uint32_t k = KMER::getCore(kmerTable[i]);
-		const uint32_t kTMask = getTMask(kmerTable[i]);
-        of.write(reinterpret_cast<const char*>(&k),sizeof(uint32_t));
-        of.write(reinterpret_cast<const char*>(&kTMask),sizeof(uint32_t));
+        std::copy(sites[c].begin(), sites[c].end(), ctxSites.begin() + ctxStart[c]);
+        std::copy(types[c].begin(), types[c].end(), ctxTypes.begin() + ctxStart[c]);
     }
+    std::cout << "Found " << ctxSites.size() << " cytosines in CHG or CHH context\n";
+}
 
-    if (of.fail())
-    {
-        std::cout << "Error writing kmerTable " << kmerNum << "\n";
-    }
-    // store strands
-    std::ofstream strandFile(filepath + "_strands", std::ofstream::binary | std::ofstream::trunc);
-    write_strands(strandFile);
-    if (strandFile.fail())
+void RefGenome::buildWindowRecords()
+{
+
+    // words of every record, the CpG offsets are padded to a cache line
+    std::vector<uint64_t> offsets(metaWindows.size() + 1, 0);
+    for (size_t w = 0; w < metaWindows.size(); ++w)
     {
-        std::cerr << "Error while writing index strand file! Terminating...\n\n";
-        exit(1);
+        const metaWindow& m = metaWindows[w];
+        const size_t cpgNum = m.startInd == MyConst::CPGDUMMY ? 0 : m.endInd - m.startInd + 1;
+        const size_t words = WINRECSEQWORDS + 2 * WINRECMASKWORDS + WINRECRANKWORDS + (cpgNum * sizeof(int16_t) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+        offsets[w + 1] = offsets[w] + (words + 7) / 8 * 8;
     }
-    strandFile.close();
+    winRecData.assign(offsets.back() + 8, 0);
+    uint64_t* base = winRecData.data();
+    base += (64 - (reinterpret_cast<uintptr_t>(base) & 63)) / sizeof(uint64_t) % 8;
+    winRecBase = base;
 
-    // store meta CpGs
-    size_t metaCpGNum = metaCpGs.size();
-    of.write(reinterpret_cast<char*>(&metaCpGNum), sizeof(metaCpGNum));
-	if (metaCpGNum > 0)
-		of.write(reinterpret_cast<char*>(metaCpGs.data()), sizeof(metaCpGs[0]) * metaCpGNum);
-    if (of.fail())
+#pragma omp parallel for num_threads(CORENUM) schedule(dynamic, 1024)
+    for (size_t w = 0; w < metaWindows.size(); ++w)
     {
-        std::cout << "Error while writing metaCpGs " << metaCpGNum << "\n";
+
+        const metaWindow& m = metaWindows[w];
+        uint64_t* rec = base + offsets[w];
+        // whole words of the sequence (see WINRECBEFORE), words outside of it stay 0
+        const MappedArray<uint64_t>& seq = fullSeq[m.chrom].seqData();
+        const MappedArray<uint64_t>& nMask = fullSeq[m.chrom].nMaskData();
+        const int64_t first = static_cast<int64_t>(m.startPos & ~static_cast<uint32_t>(63)) - WINRECBEFORE;
+        for (size_t i = 0; i < WINRECSEQWORDS; ++i)
+        {
+            const int64_t word = first / 32 + static_cast<int64_t>(i);
+            if (word >= 0 && static_cast<size_t>(word) < seq.size())
+                rec[i] = seq[word];
+        }
+        for (size_t i = 0; i < WINRECMASKWORDS; ++i)
+        {
+            const int64_t word = first / 64 + static_cast<int64_t>(i);
+            if (word >= 0 && static_cast<size_t>(word) < nMask.size())
+                rec[WINRECSEQWORDS + i] = nMask[word];
+        }
+        if (m.startInd == MyConst::CPGDUMMY)
+            continue;
+        uint64_t* bits = rec + WINRECSEQWORDS + WINRECMASKWORDS;
+        uint16_t* ranks = reinterpret_cast<uint16_t*>(bits + WINRECMASKWORDS);
+        int16_t* cpgs = reinterpret_cast<int16_t*>(bits + WINRECMASKWORDS + WINRECRANKWORDS);
+        for (uint32_t c = m.startInd; c <= m.endInd; ++c)
+        {
+            const int64_t callPos = static_cast<int64_t>(cpgTable[c].pos) + MyConst::READLEN - 2;
+            cpgs[c - m.startInd] = static_cast<int16_t>(callPos - m.startPos);
+            // ranks of the bitmap are only exact if all CpGs of the window are in it
+            if (callPos < first || callPos >= first + static_cast<int64_t>(WINRECLETTERS))
+            {
+#pragma omp critical
+                {
+                    std::cerr << "CpG at " << cpgTable[c].pos << " lies outside of the record of its window! Terminating...\n\n";
+                    exit(1);
+                }
+            }
+            bits[(callPos - first) >> 6] |= 1ULL << ((callPos - first) & 63);
+        }
+        for (size_t i = 0; i < WINRECMASKWORDS; ++i)
+        {
+            ranks[i + 1] = ranks[i] + __builtin_popcountll(bits[i]);
+        }
     }
+    offsets.pop_back();
+    winRecOffsets.swap(offsets);
+    std::cout << "Window records of the reference: " << (winRecData.size() * sizeof(uint64_t) >> 20) << " MB\n";
+}
+
+void RefGenome::buildHotBuckets()
+{
 
-    // store start meta CpGs
-    metaCpGNum = metaStartCpGs.size();
-    of.write(reinterpret_cast<char*>(&metaCpGNum), sizeof(metaCpGNum));
-	if (metaCpGNum > 0)
-		of.write(reinterpret_cast<char*>(metaStartCpGs.data()), sizeof(metaStartCpGs[0]) * metaCpGNum);
-    if (of.fail())
+    if (hasKmerOffsets() || hasKmerPrints() || seedNum > 1)
     {
-        std::cout << "Error while writing start metaCpGs " << metaCpGNum << "\n";
+        std::cout << "Hot bucket lists are not used with k-mer offsets, k-mer fingerprints or several seeds\n";
+        return;
     }
-    // store meta Windows
-    size_t metaWinNum = metaWindows.size();
-    of.write(reinterpret_cast<char*>(&metaWinNum), sizeof(metaWinNum));
-	if (metaWinNum > 0)
-		of.write(reinterpret_cast<char*>(metaWindows.data()), sizeof(metaWindows[0]) * metaWinNum);
-    if (of.fail())
+    // smaller buckets are not worth a lookup
+    constexpr uint64_t minSize = 64;
+
+    // all buckets of at least minSize entries as (size, first entry)
+    const uint64_t keyNum = tabOffsets.size() - 1;
+    std::vector<std::vector<std::pair<uint64_t, uint64_t> > > threadLarge(CORENUM);
+#pragma omp parallel for num_threads(CORENUM) schedule(static)
+    for (uint64_t key = 0; key < keyNum; ++key)
     {
-        std::cout << "Error while writing start metaCpGs " << metaCpGNum << "\n";
+        const uint64_t first = bucketStart(key);
+        const uint64_t size = bucketStart(key + 1) - first;
+        if (size >= minSize)
+            threadLarge[omp_get_thread_num()].emplace_back(size, first);
     }
-    // store filtered kmers
-    write_filteredKmers(of);
-    if (of.fail())
+    std::vector<std::pair<uint64_t, uint64_t> > large;
+    for (const auto& t : threadLarge)
+        large.insert(large.end(), t.begin(), t.end());
+    std::sort(large.begin(), large.end(), std::greater<std::pair<uint64_t, uint64_t> >());
+
+    // lists of the largest buckets while they fit into the budget, buckets whose windows are not in descending
+    // order cannot be delta encoded and keep being read as they are
+    const uint64_t budget = static_cast<uint64_t>(MyConst::hotBuckets) << 10;
+    std::vector<std::pair<uint64_t, std::vector<uint8_t> > > lists;
+    uint64_t bytes = 0;
+    for (const std::pair<uint64_t, uint64_t>& b : large)
     {
-        std::cout << "Error while writing filtered kmer map\n";
+        std::vector<uint8_t> list;
+        uint32_t lastId = KMER_S::METAMAX;
+        bool lastFwd = false;
+        bool ordered = true;
+        for (uint64_t j = b.second; j < b.second + b.first && ordered; ++j)
+        {
+            const uint32_t metaId = KMER_S::getMetaCpG(kmerTableSmall[j]);
+            const bool isFwd = KMER_S::isFwd(kmerTableSmall[j]);
+            if (j > b.second && metaId == lastId && isFwd == lastFwd)
+                continue;
+            ordered = metaId <= lastId;
+            uint32_t v = ((lastId - metaId) << 1) | isFwd;
+            for (; v >= 0x80; v >>= 7)
+                list.push_back(static_cast<uint8_t>(v | 0x80));
+            list.push_back(static_cast<uint8_t>(v));
+            lastId = metaId;
+            lastFwd = isFwd;
+        }
+        if (!ordered)
+            continue;
+        if (bytes + list.size() > budget)
+            break;
+        bytes += list.size();
+        hotMinSize = b.first;
+        lists.emplace_back(b.second, std::move(list));
     }
-    if (of.fail())
+    std::sort(lists.begin(), lists.end(), [](const std::pair<uint64_t, std::vector<uint8_t> >& a, const std::pair<uint64_t, std::vector<uint8_t> >& b) { return a.first < b.first; });
+
+    hotData.reserve(bytes);
+    hotOffsets.push_back(0);
+    for (const auto& l : lists)
     {
-        std::cerr << "Error while writing index file... Terminating\n\n";
-        exit(1);
+        hotStarts.push_back(l.first);
+        hotData.insert(hotData.end(), l.second.begin(), l.second.end());
+        hotOffsets.push_back(hotData.size());
     }
-
-	// write chromosome ID mapping
-	chromNum = chrMap.size();
-	of.write(reinterpret_cast<char*>(&chromNum), sizeof(chromNum));
-	for (auto chrMapping : chrMap)
-	{
-		uint8_t internID = chrMapping.first;
-		of.write(reinterpret_cast<char*>(&internID), sizeof(internID));
-		size_t strlen = chrMapping.second.size();
-		of.write(reinterpret_cast<char*>(&strlen), sizeof(strlen));
-		for (char c : chrMapping.second)
-		{
-			of.write(&c, sizeof(c));
-		}
-	}
-
-
-    std::chrono::high_resolution_clock::time_point endTime = std::chrono::high_resolution_clock::now();
-    auto runtime = std::chrono::duration_cast<std::chrono::seconds>(endTime - startTime).count();
-    std::cout << "Finished writing index to file " << filepath << " in " << runtime << "s\n\n";
-    of.close();
+    std::cout << "Hot bucket lists: " << hotStarts.size() << " buckets, " << (bytes >> 10) << " KB\n";
 }
 
-void RefGenome::load(const std::string& filepath)
+void RefGenome::setGenomes(std::vector<std::string>&& tags, std::vector<uint8_t>&& chromGenome)
 {
 
-    std::cout << "Start reading index file " << filepath << "\n";
-    std::chrono::high_resolution_clock::time_point startTime = std::chrono::high_resolution_clock::now();
-    // open file in binary mode
-    std::ifstream ifs(filepath, std::ifstream::binary);
-
-    // load CONSTANTS
-    auto htabs = MyConst::HTABSIZE;
-    ifs.read(reinterpret_cast<char*>(&htabs), sizeof(htabs));
-    if (htabs != MyConst::HTABSIZE)
-    {
-        std::cerr << "Hash table size in source code and index file are different!\n\n";
-        exit(1);
-    }
-    auto readl = MyConst::READLEN;
-    ifs.read(reinterpret_cast<char*>(&readl), sizeof(readl));
-    if (readl != MyConst::READLEN)
+    if (chromGenome.size() != fullSeq.size() || tags.size() > std::numeric_limits<uint8_t>::max() + 1u || std::any_of(chromGenome.begin(), chromGenome.end(), [&](const uint8_t g) { return g >= tags.size(); }))
     {
-        std::cerr << "Read length used in source code and index file are different!\n\n";
+        std::cerr << "Genomes of the sequences do not match the index! Terminating...\n\n";
         exit(1);
     }
-    auto winl = MyConst::WINLEN;
-    ifs.read(reinterpret_cast<char*>(&winl), sizeof(winl));
-    if (winl != MyConst::WINLEN)
+    genomeTags = std::move(tags);
+    chrGenome = MappedArray<uint8_t>(std::move(chromGenome));
+}
+
+uint64_t RefGenome::fingerprint() const
+{
+
+    // FNV-1a over the chromosome names by id and the CpGs in table order
+    constexpr uint64_t prime = 0x100000001b3ULL;
+    uint64_t h = 0xcbf29ce484222325ULL;
+    auto mix = [&](const uint64_t v)
     {
-        std::cerr << "Meta CpG length used in source code and index file are different!\n\n";
-        exit(1);
-    }
-    auto kmerl = MyConst::KMERLEN;
-    ifs.read(reinterpret_cast<char*>(&kmerl), sizeof(kmerl));
-    if (kmerl != MyConst::KMERLEN)
+        for (unsigned int i = 0; i < 8; ++i)
+        {
+            h ^= (v >> (8 * i)) & 0xff;
+            h *= prime;
+        }
+    };
+    // ids are 0, ..., chrMap.size() - 1
+    for (chromId id = 0; id < chrMap.size(); ++id)
     {
-        std::cerr << "k-mer length used in source code and index file are different!\n\n";
-        exit(1);
+        const auto chr = chrMap.find(id);
+        if (chr == chrMap.end())
+            continue;
+        mix(id);
+        for (const char c : chr->second)
+            mix(static_cast<unsigned char>(c));
     }
-    auto kmerc = MyConst::KMERCUTOFF;
-    ifs.read(reinterpret_cast<char*>(&kmerc), sizeof(kmerc));
-    if (kmerc != MyConst::KMERCUTOFF)
+    for (size_t i = 0; i < cpgTable.size(); ++i)
     {
-        std::cerr << "k-mer cutoff used in source code and index file are different!\n\n";
-        exit(1);
-    }
-	auto seedbits = MyConst::SEEDBITS;
-	ifs.read(reinterpret_cast<char*>(&seedbits), sizeof(seedbits));
-	if (seedbits != MyConst::SEEDBITS)
-	{
-		std::cerr << "Different seed used in index and methylation prediction!\n\n";
-		exit(1);
-	}
-
-    // load NON-start CpGs
-    size_t cpgNum;
-    ifs.read(reinterpret_cast<char*>(&cpgNum), sizeof(cpgNum));
-    cpgTable.resize(cpgNum);
-    ifs.read(reinterpret_cast<char*>(cpgTable.data()), sizeof(cpgTable[0]) * cpgNum);
-    // load start CpGs
-    size_t cpgStartNum;
-    ifs.read(reinterpret_cast<char*>(&cpgStartNum), sizeof(cpgStartNum));
-    cpgStartTable.resize(cpgStartNum);
-    ifs.read(reinterpret_cast<char*>(cpgStartTable.data()), sizeof(cpgStartTable[0]) * cpgStartNum);
-    // load reference sequence
-    size_t chromNum;
-    ifs.read(reinterpret_cast<char*>(&chromNum), sizeof(chromNum));
-    fullSeq.resize(chromNum);
-    for (size_t i = 0; i < chromNum; ++i)
-    {
-        size_t chromLen;
-        ifs.read(reinterpret_cast<char*>(&chromLen), sizeof(chromLen));
-        fullSeq[i].resize(chromLen);
-        ifs.read(fullSeq[i].data(), chromLen);
-    }
-    // tabIndex
-    size_t tabLen;
-    ifs.read(reinterpret_cast<char*>(&tabLen), sizeof(tabLen));
-    tabIndex.resize(tabLen);
-    ifs.read(reinterpret_cast<char*>(tabIndex.data()), sizeof(tabIndex[0])*tabLen);
-
-    // load kmers
-    size_t kmerNum;
-    ifs.read(reinterpret_cast<char*>(&kmerNum), sizeof(kmerNum));
-    kmerTableSmall.resize(kmerNum);
-    for (size_t i = 0; i < kmerNum; ++i)
-    {
-		uint32_t metaCpG;
-		uint32_t tMask;
-        ifs.read(reinterpret_cast<char*>(&(metaCpG)),sizeof(uint32_t));
-        ifs.read(reinterpret_cast<char*>(&(tMask)),sizeof(uint32_t));
-		kmerTableSmall[i] = KMER_S::constructKmerS(metaCpG, tMask);
-    }
-
-    // load strands
-    std::ifstream ifs_bool(filepath + "_strands", std::ifstream::binary);
-    read_strands(ifs_bool);
-    if (ifs_bool.fail())
-    {
-        std::cerr << "Error while reading index strand file! Terminating...\n\n";
-        exit(1);
+        mix((static_cast<uint64_t>(cpgTable[i].chrom) << 32) | (cpgTable[i].pos + chrOffsets[cpgTable[i].chrom]));
     }
+    return h;
+}
 
-    ifs_bool.close();
-
-    // load meta CpGs
-    size_t metaCpGNum;
-    ifs.read(reinterpret_cast<char*>(&metaCpGNum), sizeof(metaCpGNum));
-	if (metaCpGNum > 0)
-	{
-		metaCpGs.resize(metaCpGNum);
-		ifs.read(reinterpret_cast<char*>(metaCpGs.data()), sizeof(metaCpGs[0]) * metaCpGNum);
-	}
-
-    // load start meta CpGs
-    size_t metaStartCpGNum;
-    ifs.read(reinterpret_cast<char*>(&metaStartCpGNum), sizeof(metaStartCpGNum));
-	if (metaStartCpGNum > 0)
-	{
-		metaStartCpGs.resize(metaStartCpGNum);
-		ifs.read(reinterpret_cast<char*>(metaStartCpGs.data()), sizeof(metaStartCpGs[0]) * metaStartCpGNum);
-	}
+// names of the index file sections as printed by printStats, in the order of INDEX::SECTION
+static const char* const SECTIONNAMES[INDEX::SECNUM] = {"cpg", "cpgstart", "seq", "seqoff", "seqnmask", "tabindex", "tabblock", "kmers", "metacpg", "metastartcpg", "metawin", "filtered", "chrmap", "kmeroff", "chroff", "kmerprint", "kmercount", "filtercount", "genometag", "chrgenome"};
 
-    size_t metaWinNum;
-    ifs.read(reinterpret_cast<char*>(&metaWinNum), sizeof(metaWinNum));
-	if (metaWinNum > 0)
-	{
-		metaWindows.resize(metaWinNum);
-		ifs.read(reinterpret_cast<char*>(metaWindows.data()), sizeof(metaWindows[0]) * metaWinNum);
-	}
+// bin of a count in the histograms of printStats: 0 for 0, i + 1 for counts in [2^i, 2^(i+1))
+static inline unsigned int log2Bin(const uint64_t n)
+{
+    return n == 0 ? 0 : 64 - __builtin_clzll(n);
+}
 
-    // load filtered kmers
-    read_filteredKmers(ifs);
-    if (ifs.fail())
+// writes the nonempty bins of hist as lines "range count share"
+static void printHistogram(std::ostream& out, const std::vector<uint64_t>& hist, const uint64_t total)
+{
+    for (unsigned int bin = 0; bin < hist.size(); ++bin)
     {
-        std::cerr << "Error while reading index file! Terminating...\n\n";
-        exit(1);
+        if (hist[bin] == 0)
+            continue;
+        out << "\t";
+        if (bin <= 1)
+            out << bin;
+        else
+            out << (1ULL << (bin - 1)) << "-" << (1ULL << bin) - 1;
+        out << "\t" << hist[bin] << "\t" << 100.0 * hist[bin] / total << "%\n";
     }
-	// load chromosome ID mapping
-	ifs.read(reinterpret_cast<char*>(&chromNum), sizeof(chromNum));
-	for (size_t i = 0; i < chromNum; ++i)
-	{
-		uint8_t internID;
-		ifs.read(reinterpret_cast<char*>(&internID), sizeof(internID));
-		std::string externID;
-		size_t strlen;
-		ifs.read(reinterpret_cast<char*>(&strlen), sizeof(strlen));
-		for (size_t strL = 0; strL < strlen; ++strL)
-		{
-			char c;
-			ifs.read(&c, sizeof(c));
-			externID += c;
-		}
-		chrMap.insert(std::pair<uint8_t, std::string>(internID, externID));
-	}
-    std::chrono::high_resolution_clock::time_point endTime = std::chrono::high_resolution_clock::now();
-    auto runtime = std::chrono::duration_cast<std::chrono::seconds>(endTime - startTime).count();
-    std::cout << "Finished reading index file " << filepath << " in " << runtime << "s\n\n";
-    ifs.close();
 }
 
-// General idea taken from
-// https://stackoverflow.com/questions/29623605/how-to-dump-stdvectorbool-in-a-binary-file
-// accessed on 21th July 2017
-inline void RefGenome::write_strands(std::ofstream& of)
+void RefGenome::printStats(std::ostream& out) const
 {
 
-    size_t n = strandTable.size();
-    of.write(reinterpret_cast<char*>(&n), sizeof(n));
-
-    // go over all bits
-    for (size_t i = 0; i < n;)
+    // per structure bytes as stored in the index file
+    if (indexMap != nullptr)
     {
-        // saves 8 flags in one char
-        unsigned char mergedBits = 0;
-        for (unsigned char mask = 1; mask > 0 && i < n; ++i, mask <<= 1)
-        {
-            if (strandTable[i])
-            {
-                mergedBits |= mask;
-            }
-
-        }
-        of.write(reinterpret_cast<const char*>(&mergedBits), sizeof(mergedBits));
-    }
-}
-inline void RefGenome::read_strands(std::ifstream& ifs)
-{
-    size_t n;
-    ifs.read(reinterpret_cast<char*>(&n), sizeof(n));
-    strandTable.resize(n);
-
-    // go over all bits
-    for (size_t i = 0; i < n;)
-    {
-        // will hold 8 bits
-        unsigned char mergedBits;
-        // read one chunk
-        ifs.read(reinterpret_cast<char*>(&mergedBits), sizeof(mergedBits));
-        // store bits of chunk
-        for(unsigned char mask = 1; mask > 0 && i < n; ++i, mask <<= 1)
+        const INDEX::header& hdr = *static_cast<const INDEX::header*>(indexMap);
+        out << "Index file (version " << hdr.version << ", " << indexMapLen << " bytes)\n";
+        out << "\tsection\tbytes\tcount\tshare\n";
+        for (uint32_t id = 0; id < INDEX::SECNUM; ++id)
         {
-            strandTable[i] = mergedBits & mask;
+            const INDEX::section& sec = hdr.sections[id];
+            out << "\t" << SECTIONNAMES[id] << "\t" << sec.bytes << "\t" << sec.count << "\t" << 100.0 * sec.bytes / indexMapLen << "%\n";
         }
+        out << "\tbloom filter (memory only)\t" << filteredBloom.size() * sizeof(uint64_t) << "\n\n";
+        out << "Built with HTABSIZE " << hdr.htabs << ", KMERCUTOFF " << hdr.kmerc << ", READLEN " << hdr.readl << ", WINLEN " << hdr.winl << ", KMERLEN " << hdr.kmerl << ", " << (hdr.syncl ? "syncmers of length " + std::to_string(hdr.syncl) : "1 in " + std::to_string(MyConst::SKIPMOD) + " k-mers") << ", " << hdr.seednum << " seed(s)\n\n";
     }
-}
-inline void RefGenome::write_filteredKmers(std::ofstream& of)
-{
 
-    size_t n = filteredKmers.size();
-    of.write(reinterpret_cast<char*>(&n), sizeof(n));
-    for (const uint64_t k : filteredKmers)
+    // reference sequence
+    uint64_t letters = 0;
+    uint64_t nLetters = 0;
+    for (const PackedSeq& chromSeq : fullSeq)
     {
-
-        of.write(reinterpret_cast<const char*>(&k), sizeof(k));
+        letters += chromSeq.size();
+        for (const uint64_t w : chromSeq.nMaskData())
+            nLetters += __builtin_popcountll(w);
     }
-}
-inline void RefGenome::read_filteredKmers(std::ifstream& ifs)
-{
-
-    size_t n;
-    ifs.read(reinterpret_cast<char*>(&n), sizeof(n));
-    for (size_t i = 0; i < n; ++i)
+    out << "Reference\n";
+    out << "\tsequences\t" << fullSeq.size() << "\n";
+    out << "\tletters\t" << letters << "\n";
+    out << "\tN letters\t" << nLetters << "\n\n";
+
+    // hash table
+    const uint64_t kmerNum = kmerTableSmall.size();
+    std::vector<uint64_t> bucketHist(65, 0);
+    uint64_t maxBucket = 0;
+    uint64_t fullBuckets = 0;
+    uint64_t bucketEnd = bucketStart(0);
+    for (uint64_t key = 0; key < htabSize; ++key)
     {
-
-        uint64_t k;
-        ifs.read(reinterpret_cast<char*>(&k), sizeof(k));
-        filteredKmers.emplace(k);
+        const uint64_t bucketBeg = bucketEnd;
+        bucketEnd = bucketStart(key + 1);
+        const uint64_t n = bucketEnd - bucketBeg;
+        ++bucketHist[log2Bin(n)];
+        maxBucket = std::max(maxBucket, n);
+        if (n >= MyConst::KMERCUTOFF)
+            ++fullBuckets;
     }
-
+    uint64_t fwdKmers = 0;
+    uint64_t startKmers = 0;
+    std::vector<uint32_t> winKmers(metaWindows.size(), 0);
+    for (uint64_t i = 0; i < kmerNum; ++i)
+    {
+        const KMER_S::kmer& k = kmerTableSmall[i];
+        if (KMER_S::isFwd(k))
+            ++fwdKmers;
+        if (KMER_S::isStartCpG(k))
+            ++startKmers;
+        else if (KMER_S::getMetaCpG(k) < winKmers.size())
+            ++winKmers[KMER_S::getMetaCpG(k)];
+    }
+    out << "Hash table\n";
+    out << "\tbuckets\t" << htabSize << "\n";
+    out << "\tk-mers\t" << kmerNum << " (" << fwdKmers << " forward, " << kmerNum - fwdKmers << " reverse)\n";
+    out << "\tk-mers per bucket\t" << static_cast<double>(kmerNum) / htabSize << " (max " << maxBucket << ")\n";
+    out << "\tbuckets with at least KMERCUTOFF (" << MyConst::KMERCUTOFF << ") k-mers\t" << fullBuckets << "\n";
+    out << "\tk-mer offsets\t" << (hasKmerOffsets() ? "yes" : "no") << "\n";
+    out << "\tblacklisted k-mers\t" << filteredKmers.size() << "\n";
+    out << "Bucket sizes\n";
+    out << "\tk-mers\tbuckets\tshare\n";
+    printHistogram(out, bucketHist, htabSize);
+    out << "\n";
+
+    // windows and CpGs
+    uint64_t cpgWins = 0;
+    uint64_t winCpGs = 0;
+    std::vector<uint64_t> winHist(33, 0);
+    for (uint64_t w = 0; w < metaWindows.size(); ++w)
+    {
+        if (metaWindows[w].startInd != MyConst::CPGDUMMY)
+        {
+            ++cpgWins;
+            winCpGs += metaWindows[w].endInd - metaWindows[w].startInd + 1;
+        }
+        ++winHist[log2Bin(winKmers[w])];
+    }
+    out << "Windows\n";
+    out << "\twindows\t" << metaWindows.size() << " (" << cpgWins << " with CpGs)\n";
+    out << "\tCpGs per window with CpGs\t" << (cpgWins ? static_cast<double>(winCpGs) / cpgWins : 0.0) << "\n";
+    out << "\tk-mers per window\t" << (metaWindows.empty() ? 0.0 : static_cast<double>(kmerNum - startKmers) / metaWindows.size()) << "\n";
+    out << "\tk-mers\twindows\tshare\n";
+    printHistogram(out, winHist, std::max<uint64_t>(metaWindows.size(), 1));
+    out << "\n";
+    out << "CpGs\n";
+    out << "\tCpGs\t" << cpgTable.size() << "\n";
+    out << "\tCpGs at sequence starts\t" << cpgStartTable.size() << "\n";
+    out << "\tmeta CpGs\t" << metaCpGs.size() << "\n";
+    out << "\tstart meta CpGs\t" << metaStartCpGs.size() << " (" << startKmers << " k-mers)\n\n";
 }
 
-
-
-
 void RefGenome::generateMetaCpGs()
 {
 
@@ -529,12 +2078,13 @@ void RefGenome::generateMetaCpGs()
 
 
 
-void RefGenome::generateWindows()
+void RefGenome::generateWindows(const chromId firstChr)
 {
 
-    uint32_t cpgTabInd = 0;
+    // CpGs are sorted by chromosome
+    uint32_t cpgTabInd = std::lower_bound(cpgTable.begin(), cpgTable.end(), firstChr, [](const struct CpG& c, const chromId chr) { return c.chrom < chr; }) - cpgTable.begin();
 
-	for (uint8_t currChr = 0; currChr < fullSeq.size(); ++currChr)
+	for (chromId currChr = firstChr; currChr < fullSeq.size(); ++currChr)
 	{
 		for (uint32_t wStart = 0; wStart < fullSeq[currChr].size(); wStart = wStart + MyConst::WINLEN - MyConst::READLEN)
 		{
@@ -553,7 +2103,7 @@ void RefGenome::generateWindows()
 				++cpgTabInd;
 			}
 			// reduce CpG index again for overlapping region
-			while (cpgTabInd > 0 && cpgTable[cpgTabInd].chrom == currChr && cpgTable[cpgTabInd].pos >= wEnd - MyConst::READLEN)
+			while (cpgTabInd > 0 && cpgTabInd < cpgTable.size() && cpgTable[cpgTabInd].chrom == currChr && cpgTable[cpgTabInd].pos >= wEnd - MyConst::READLEN)
 			{
 				--cpgTabInd;
 			}
@@ -563,15 +2113,282 @@ void RefGenome::generateWindows()
 		}
 	}
 
-    metaWindows.shrink_to_fit();
+    metaWindows.shrink_to_fit();
+}
+
+
+// hashed are the first k-mer and every SKIPMOD-th after it (resp. the syncmers, see isSyncmer) of each interval
+// without N of at least READLEN bp, on both strands, with every seed of the index
+template<typename F>
+inline void RefGenome::hashWindow(const uint32_t mId, windowBuffers& buf, F&& emit)
+{
+
+	const metaWindow& m = metaWindows[mId];
+
+	// construct corresponding sequence with reduced alphabet
+	// only the positions inside the intervals are read, the rest may be left from the previous window
+	std::vector<char>& redSeq = buf.redSeq;
+	std::vector<char>& redSeqRev = buf.redSeqRev;
+	redSeq.resize(MyConst::WINLEN);
+	redSeqRev.resize(MyConst::WINLEN);
+	std::vector<std::pair<uint32_t, uint32_t> >& intervals = buf.intervals;
+	intervals.clear();
+
+	const auto& seq = fullSeq[m.chrom];
+	bool lastN = true;
+	uint32_t nStart = 0;
+
+	uint32_t j = 0;
+	for (uint32_t i = m.startPos; i < std::min((size_t)(m.startPos + MyConst::WINLEN), fullSeq[m.chrom].size()); ++i, ++j)
+	{
+		const uint32_t revPos = MyConst::WINLEN - 1 - j;
+		const char c = seq[i];
+		if (c == 'N')
+		{
+			if (!lastN)
+			{
+				intervals.push_back({nStart, j - 1});
+			}
+			lastN = true;
+			redSeq[j] = 'N';
+			redSeqRev[revPos] = 'N';
+			continue;
+		}
+		if (lastN)
+		{
+			nStart = j;
+			lastN = false;
+		}
+		switch (c)
+		{
+			case 'C':
+				redSeq[j] = 'T';
+				redSeqRev[revPos] = 'G';
+				break;
+
+			case 'G':
+				redSeq[j] = 'G';
+				redSeqRev[revPos] = 'T';
+				break;
+
+			case 'T':
+				redSeq[j] = 'T';
+				redSeqRev[revPos] = 'A';
+				break;
+
+			default:
+				redSeq[j] = 'A';
+				redSeqRev[revPos] = 'T';
+				break;
+		}
+	}
+	if (!lastN)
+	{
+		intervals.push_back({nStart, j - 1});
+	}
+
+
+	for (const auto& p : intervals)
+	{
+
+		uint32_t intervalDist = p.second - p.first + 1;
+		if (intervalDist < MyConst::READLEN)
+		{
+			continue;
+		}
+		const char* seqStart = redSeq.data() + p.first;
+		const char* seqStartRev = redSeqRev.data() + (MyConst::WINLEN - p.second - 1);
+
+		// 2 bit letters of the current k-mers, only needed to select syncmers
+		uint64_t kSeqRev = 0;
+		uint64_t kSeq = 0;
+		if (syncLen)
+		{
+			for (unsigned int i = 0; i < MyConst::KMERLEN; ++i)
+			{
+				kSeqRev = (kSeqRev << 2) | reducedCode(seqStartRev[i]);
+				kSeq = (kSeq << 2) | reducedCode(seqStart[i]);
+			}
+		}
+
+		// hashes of the current k-mer under all seeds, computed in one pass (see ntHash::NTMS64)
+		uint64_t sVals[MyConst::SEEDNUM];
+		// update kmer table with the k-mer under every seed (resp. every seed it is a syncmer of)
+		auto emitSeeds = [&](const uint64_t kLetters, const uint64_t pos, const bool isFwd)
+		{
+			for (unsigned int s = 0; s < seedNum; ++s)
+			{
+				if (!syncLen || isSyncmer(kLetters & MyConst::SEEDLETTERMASKS[s]))
+				{
+					emit(sVals[s], packSeed(KMER::constructKmer(0, mId, pos), s), isFwd);
+				}
+			}
+		};
+
+		// initial hash backward
+		uint64_t rhVal;
+		ntHash::NTMS64(seqStartRev, MyConst::SEEDSET, seedNum, MyConst::KMERLEN, rhVal, sVals);
+		// first kmer on reverse complement corresponds to last kmer in forward sequence
+		// (the interval may end before the window does, e.g. at an N or in the last window of a chromosome)
+		uint64_t kPosRev = p.second + 1 - MyConst::KMERLEN;
+		emitSeeds(kSeqRev, kPosRev, false);
+
+		// hash kmers of backward strand
+		for (unsigned int i = 0; i < intervalDist - MyConst::KMERLEN; ++i)
+		{
+			--kPosRev;
+			ntHash::NTMS64(seqStartRev+i+1, MyConst::SEEDSET, seedNum, seqStartRev[i], seqStartRev[i + MyConst::KMERLEN], MyConst::KMERLEN, rhVal, sVals);
+			if (syncLen)
+			{
+				kSeqRev = (kSeqRev << 2) | reducedCode(seqStartRev[i + MyConst::KMERLEN]);
+			}
+			if (syncLen || !(i%MyConst::SKIPMOD))
+			{
+				emitSeeds(kSeqRev, kPosRev, false);
+			}
+		}
+
+		// initial hash forward
+		uint64_t fhVal;
+		ntHash::NTMS64(seqStart, MyConst::SEEDSET, seedNum, MyConst::KMERLEN, fhVal, sVals);
+		uint64_t kPos = p.first;
+		emitSeeds(kSeq, kPos, true);
+
+		// hash kmers of forward strand
+		for (unsigned int i = 0; i < intervalDist - MyConst::KMERLEN; ++i)
+		{
+			++kPos;
+			ntHash::NTMS64(seqStart+i+1, MyConst::SEEDSET, seedNum, seqStart[i], seqStart[i + MyConst::KMERLEN], MyConst::KMERLEN, fhVal, sVals);
+			if (syncLen)
+			{
+				kSeq = (kSeq << 2) | reducedCode(seqStart[i + MyConst::KMERLEN]);
+			}
+			if (syncLen || !(i%MyConst::SKIPMOD))
+			{
+				emitSeeds(kSeq, kPos, true);
+			}
+		}
+	}
+}
+
+
+void RefGenome::filterKmers(const bool noloss)
+{
+
+    if (deferCutoff)
+    {
+        std::cout << "\nFiltering of the index deferred to loading it (k-mer cutoff at least " << deferCutoff << ")\n";
+        return;
+    }
+    if (!noloss)
+    {
+        std::cout << "\nStarting filtering process for Index\nThrowing out highly repetetive kmers...\n";
+        // filter out highly repetitive sequences
+        filterHashTable();
+    }
+    std::cout << "\nThrowing out kmers of single metaCpG with same hash...\n";
+    filterRedundancyInHashTable();
+}
+
+
+uint64_t RefGenome::passCount(const uint64_t kmerNum) const
+{
+
+    if (MyConst::indexMem == 0)
+    {
+        return 1;
+    }
+    // a pass holds the k-mer table and the bucket directory of its cells, the cells are split at directory blocks
+    constexpr uint64_t blockLen = 1ULL << INDEX::TABBLOCKBITS;
+    const uint64_t bytes = sizeof(KMER::kmer) * kmerNum + sizeof(uint64_t) * (htabSize + 1);
+    const uint64_t budget = static_cast<uint64_t>(MyConst::indexMem) << 20;
+    return std::max<uint64_t>(1, std::min((bytes + budget - 1) / budget, (htabSize + blockLen - 1) / blockLen));
+}
+
+
+void RefGenome::buildInPasses(const uint64_t passNum, const bool noloss)
+{
+
+    const uint64_t fullSize = htabSize;
+    // passes cover whole blocks of the bucket directory
+    constexpr uint64_t blockLen = 1ULL << INDEX::TABBLOCKBITS;
+    const uint64_t passLen = ((fullSize + passNum - 1) / passNum + blockLen - 1) / blockLen * blockLen;
+    const uint64_t passes = (fullSize + passLen - 1) / passLen;
+    std::cout << "\nBuilding the hash table in " << passes << " passes for a memory budget of " << MyConst::indexMem << " MB\n";
+    std::chrono::high_resolution_clock::time_point startTime = std::chrono::high_resolution_clock::now();
+
+    // the bucket directory (cell starts of the whole table) and behind it the filtered k-mers of every pass are
+    // written to a temporary file, which is mapped as tabIndex and kmerTable in the end
+    const char* tmpDir = std::getenv("TMPDIR");
+    std::string spillPath = std::string(tmpDir ? tmpDir : "/tmp") + "/fame_kmers_XXXXXX";
+    const int fd = mkstemp(&spillPath[0]);
+    if (fd < 0)
+    {
+        std::cerr << "Could not create temporary file " << spillPath << " for the hash table! Terminating...\n\n";
+        exit(1);
+    }
+    // removed once the file is closed and unmapped
+    unlink(spillPath.c_str());
+    auto spill = [&](const void* data, const uint64_t bytes, const uint64_t off)
+    {
+        if (!writeAt(fd, static_cast<const char*>(data), bytes, off))
+        {
+            std::cerr << "Could not write the hash table to temporary file " << spillPath << "! Terminating...\n\n";
+            exit(1);
+        }
+    };
+
+    const uint64_t pageLen = sysconf(_SC_PAGESIZE);
+    const uint64_t dirBytes = (sizeof(uint64_t) * (fullSize + 1) + pageLen - 1) / pageLen * pageLen;
+    uint64_t kept = 0;
+    for (uint64_t first = 0, p = 1; first < fullSize; first += passLen, ++p)
+    {
+
+        std::cout << "\nPass " << p << " of " << passes << "\n";
+        // the pass sees a table of its cells only, k-mers of other cells are neither counted nor inserted
+        cellBase = first;
+        htabSize = std::min(passLen, fullSize - first);
+        countKmers();
+        generateHashes();
+        filterKmers(noloss);
+
+        spill(kmerTable.data(), sizeof(KMER::kmer) * kmerTable.size(), dirBytes + sizeof(KMER::kmer) * kept);
+        for (uint64_t i = 0; i < htabSize; ++i)
+        {
+            tabIndex[i] += kept;
+        }
+        spill(tabIndex.data(), sizeof(uint64_t) * htabSize, sizeof(uint64_t) * first);
+        kept += kmerTable.size();
+    }
+    spill(&kept, sizeof(kept), sizeof(uint64_t) * fullSize);
+    htabSize = fullSize;
+    cellBase = 0;
+
+    // the mapping is backed by the file, its pages are dropped again while the index is written (see save)
+    kmerTable.clear();
+    tabIndex.clear();
+    indexMapLen = dirBytes + sizeof(KMER::kmer) * kept;
+    indexMap = mmap(nullptr, indexMapLen, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (indexMap == MAP_FAILED)
+    {
+        indexMap = nullptr;
+        std::cerr << "Could not map temporary file " << spillPath << "! Terminating...\n\n";
+        exit(1);
+    }
+    close(fd);
+    tabIndex.view(static_cast<uint64_t*>(indexMap), fullSize + 1);
+    kmerTable.view(reinterpret_cast<KMER::kmer*>(static_cast<char*>(indexMap) + dirBytes), kept);
+
+    std::chrono::high_resolution_clock::time_point endTime = std::chrono::high_resolution_clock::now();
+    auto runtime = std::chrono::duration_cast<std::chrono::seconds>(endTime - startTime).count();
+    std::cout << "\nDone building the hash table in passes (" << runtime << "s): " << kept << " kmers\n";
 }
 
 
-void RefGenome::generateHashes(std::vector<std::vector<char> >& genomeSeq)
+void RefGenome::generateHashes()
 {
 
-
-    estimateTablesizes(genomeSeq);
+    kmerTable.resize(tabIndex[htabSize]);
 
     std::cout << "\nKmer table size: " << kmerTable.size() << std::endl;
     std::cout << "\nMeta CpGs: " << metaCpGs.size() << std::endl;
@@ -617,145 +2434,19 @@ void RefGenome::generateHashes(std::vector<std::vector<char> >& genomeSeq)
     //         }
     //     }
     // }
-	uint32_t mId = 0;
-	for (metaWindow& m : metaWindows)
+	// windows are hashed in parallel, each cell of the hash table is filled from its end
+	// by atomically decrementing tabIndex
+	std::vector<windowBuffers> bufs(CORENUM);
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(CORENUM) schedule(dynamic, 256)
+#endif
+	for (uint32_t mId = 0; mId < metaWindows.size(); ++mId)
 	{
-
-		// construct corresponding sequence with reduced alphabet
-		std::vector<char> redSeq(MyConst::WINLEN);
-		std::vector<char> redSeqRev(MyConst::WINLEN);
-
-		const auto& seq = fullSeq[m.chrom];
-		bool lastN = true;
-		uint32_t nStart = 0;
-		std::list<std::pair<uint32_t, uint32_t> > intervals;
-
-		uint32_t j = 0;
-		for (uint32_t i = m.startPos; i < std::min((size_t)(m.startPos + MyConst::WINLEN), fullSeq[m.chrom].size()); ++i, ++j)
-		{
-			const uint32_t revPos = MyConst::WINLEN - 1 - j;
-			switch (seq[i])
-			{
-				case 'N':
-					if (!lastN)
-					{
-						intervals.push_back({nStart, j - 1});
-					}
-					lastN = true;
-					redSeq[j] = 'N';
-					redSeq[revPos] = 'N';
-					break;
-
-				case 'C':
-					if (lastN)
-					{
-						nStart = j;
-						lastN = false;
-					}
-					redSeq[j] = 'T';
-					redSeqRev[revPos] = 'G';
-					break;
-
-				case 'G':
-					if (lastN)
-					{
-						nStart = j;
-						lastN = false;
-					}
-					redSeq[j] = 'G';
-					redSeqRev[revPos] = 'T';
-					break;
-
-				case 'T':
-					if (lastN)
-					{
-						nStart = j;
-						lastN = false;
-					}
-					redSeq[j] = 'T';
-					redSeqRev[revPos] = 'A';
-					break;
-
-				case 'A':
-					if (lastN)
-					{
-						nStart = j;
-						lastN = false;
-					}
-					redSeq[j] = 'A';
-					redSeqRev[revPos] = 'T';
-					break;
-
-				default:
-					std::cerr << "Reference has unknown character \'" << seq[i] << "\' result will not be reliable.\n\n";
-
-			}
-		}
-		if (!lastN)
-		{
-			intervals.push_back({nStart, j - 1});
-		}
-
-
-		for (auto& p : intervals)
-		{
-
-			uint32_t intervalDist = p.second - p.first + 1;
-			if (intervalDist < MyConst::READLEN)
-			{
-				continue;
-			}
-			const char* seqStart = redSeq.data() + p.first;
-			const char* seqStartRev = redSeqRev.data() + (MyConst::WINLEN - p.second - 1);
-
-			// initial hash backward
-			uint64_t rhVal;
-			uint64_t srVal = ntHash::NTPS64(seqStartRev, MyConst::SEED, MyConst::KMERLEN, rhVal);
-			// first kmer on reverse complement corresponds to last kmer in forward sequence
-			uint64_t kPosRev = MyConst::WINLEN - p.first - MyConst::KMERLEN;
-
-			// update kmer table
-			kmerTable[--tabIndex[srVal % MyConst::HTABSIZE]] = std::move(KMER::constructKmer(0, mId, kPosRev));
-			strandTable[tabIndex[srVal % MyConst::HTABSIZE]] = false;
-
-
-			// hash kmers of backward strand
-			for (unsigned int i = 0; i < intervalDist - MyConst::KMERLEN; ++i)
-			{
-				--kPosRev;
-				srVal = ntHash::NTPS64(seqStartRev+i+1, MyConst::SEED, seqStartRev[i], seqStartRev[i + MyConst::KMERLEN], MyConst::KMERLEN, rhVal);
-				// update kmer table
-				if (!(i%MyConst::SKIPMOD))
-				{
-					kmerTable[--tabIndex[srVal % MyConst::HTABSIZE]] = std::move(KMER::constructKmer(0, mId, kPosRev));
-					strandTable[tabIndex[srVal % MyConst::HTABSIZE]] = false;
-				}
-			}
-
-			// initial hash forward
-			uint64_t fhVal;
-			uint64_t sfVal = ntHash::NTPS64(seqStart, MyConst::SEED, MyConst::KMERLEN, fhVal);
-			uint64_t kPos = p.first;
-
-			// update kmer table
-			kmerTable[--tabIndex[sfVal % MyConst::HTABSIZE]] = std::move(KMER::constructKmer(0, mId, kPos));
-			strandTable[tabIndex[sfVal % MyConst::HTABSIZE]] = true;
-
-			// hash kmers of forward strand
-			for (unsigned int i = 0; i < intervalDist - MyConst::KMERLEN; ++i)
-			{
-				++kPos;
-				sfVal = ntHash::NTPS64(seqStart+i+1, MyConst::SEED, seqStart[i], seqStart[i + MyConst::KMERLEN], MyConst::KMERLEN, fhVal);
-				// update kmer table
-				if (!(i%MyConst::SKIPMOD))
-				{
-					kmerTable[--tabIndex[sfVal % MyConst::HTABSIZE]] = std::move(KMER::constructKmer(0, mId, kPos));
-					strandTable[tabIndex[sfVal % MyConst::HTABSIZE]] = true;
-				}
-			}
-		}
-		++mId;
+		hashWindow(mId, bufs[omp_get_thread_num()], [this](const uint64_t hVal, const KMER::kmer k, const bool isFwd) { insertKmer(hVal, k, isFwd); });
 	}
+
+	// threads interleave their entries inside a cell, restore the order of a sequential fill
+	sortKmerCells();
 }
 
 
@@ -895,8 +2586,7 @@ inline void RefGenome::ntHashChunk(const std::vector<char>& seq, uint32_t& lastP
 	uint64_t kPosRev = off - MyConst::KMERLEN + metaOff;
 
 	// update kmer table
-	kmerTable[--tabIndex[srVal % MyConst::HTABSIZE]] = std::move(KMER::constructKmer(0, metacpg, kPosRev));
-	strandTable[tabIndex[srVal % MyConst::HTABSIZE]] = false;
+	kmerTable[--tabIndex[srVal & htabMask]] = packStrand(KMER::constructKmer(0, metacpg, kPosRev), false);
 
 
 	// hash kmers of backward strand
@@ -907,8 +2597,7 @@ inline void RefGenome::ntHashChunk(const std::vector<char>& seq, uint32_t& lastP
 		// update kmer table
 		if (!(i%MyConst::SKIPMOD))
 		{
-			kmerTable[--tabIndex[srVal % MyConst::HTABSIZE]] = std::move(KMER::constructKmer(0, metacpg, kPosRev));
-			strandTable[tabIndex[srVal % MyConst::HTABSIZE]] = false;
+			kmerTable[--tabIndex[srVal & htabMask]] = packStrand(KMER::constructKmer(0, metacpg, kPosRev), false);
 		}
 	}
 
@@ -918,8 +2607,7 @@ inline void RefGenome::ntHashChunk(const std::vector<char>& seq, uint32_t& lastP
 	uint64_t kPos = lasN + metaOff;
 
 	// update kmer table
-	kmerTable[--tabIndex[sfVal % MyConst::HTABSIZE]] = std::move(KMER::constructKmer(0, metacpg, kPos));
-	strandTable[tabIndex[sfVal % MyConst::HTABSIZE]] = true;
+	kmerTable[--tabIndex[sfVal & htabMask]] = packStrand(KMER::constructKmer(0, metacpg, kPos), true);
 
 	// hash kmers of forward strand
 	for (unsigned int i = 0; i < (contextLen - MyConst::KMERLEN); ++i)
@@ -929,8 +2617,7 @@ inline void RefGenome::ntHashChunk(const std::vector<char>& seq, uint32_t& lastP
 		// update kmer table
 		if (!(i%MyConst::SKIPMOD))
 		{
-			kmerTable[--tabIndex[sfVal % MyConst::HTABSIZE]] = std::move(KMER::constructKmer(0, metacpg, kPos));
-			strandTable[tabIndex[sfVal % MyConst::HTABSIZE]] = true;
+			kmerTable[--tabIndex[sfVal & htabMask]] = packStrand(KMER::constructKmer(0, metacpg, kPos), true);
 		}
 	}
 	lastPos = pos + off - MyConst::KMERLEN + 1;
@@ -1075,8 +2762,7 @@ void RefGenome::ntHashLast(const std::vector<char>& seq, uint32_t& lastPos, cons
     uint64_t kPosRev = off - MyConst::KMERLEN;
 
     // update kmer table
-    kmerTable[--tabIndex[srVal % MyConst::HTABSIZE]] = std::move(KMER::constructKmer(0, metacpg, kPosRev + metaOff));
-    strandTable[tabIndex[srVal % MyConst::HTABSIZE]] = false;
+    kmerTable[--tabIndex[srVal & htabMask]] = packStrand(KMER::constructKmer(0, metacpg, kPosRev + metaOff), false);
 
 
     // hash kmers of backward strand
@@ -1087,8 +2773,7 @@ void RefGenome::ntHashLast(const std::vector<char>& seq, uint32_t& lastPos, cons
         // update kmer table
 		if (!(i%MyConst::SKIPMOD))
 		{
-			kmerTable[--tabIndex[srVal % MyConst::HTABSIZE]] = std::move(KMER::constructKmer(0, metacpg, kPosRev + metaOff));
-			strandTable[tabIndex[srVal % MyConst::HTABSIZE]] = false;
+			kmerTable[--tabIndex[srVal & htabMask]] = packStrand(KMER::constructKmer(0, metacpg, kPosRev + metaOff), false);
 		}
     }
 
@@ -1098,8 +2783,7 @@ void RefGenome::ntHashLast(const std::vector<char>& seq, uint32_t& lastPos, cons
     uint64_t kPos = lasN;
 
     // update kmer table
-    kmerTable[--tabIndex[sfVal % MyConst::HTABSIZE]] = std::move(KMER::constructKmer(0, metacpg, kPos + metaOff));
-    strandTable[tabIndex[sfVal % MyConst::HTABSIZE]] = true;
+    kmerTable[--tabIndex[sfVal & htabMask]] = packStrand(KMER::constructKmer(0, metacpg, kPos + metaOff), true);
 
     // hash kmers of forward strand
     for (unsigned int i = 0; i < (contextLen - MyConst::KMERLEN); ++i)
@@ -1109,8 +2793,7 @@ void RefGenome::ntHashLast(const std::vector<char>& seq, uint32_t& lastPos, cons
         // update kmer table
 		if (!(i%MyConst::SKIPMOD))
 		{
-			kmerTable[--tabIndex[sfVal % MyConst::HTABSIZE]] = std::move(KMER::constructKmer(0, metacpg, kPos + metaOff));
-			strandTable[tabIndex[sfVal % MyConst::HTABSIZE]] = true;
+			kmerTable[--tabIndex[sfVal & htabMask]] = packStrand(KMER::constructKmer(0, metacpg, kPos + metaOff), true);
 		}
     }
 }
@@ -1249,8 +2932,7 @@ void RefGenome::ntHashFirst(const std::vector<char>& seq, uint32_t& lastPos, con
     uint64_t kPosRev = off - MyConst::KMERLEN;
 
     // update kmer table
-    kmerTable[--tabIndex[srVal % MyConst::HTABSIZE]] = std::move(KMER::constructKmer(1, metacpg, kPosRev));
-    strandTable[tabIndex[srVal % MyConst::HTABSIZE]] = false;
+    kmerTable[--tabIndex[srVal & htabMask]] = packStrand(KMER::constructKmer(1, metacpg, kPosRev), false);
 
 
     // hash kmers of backward strand
@@ -1259,8 +2941,7 @@ void RefGenome::ntHashFirst(const std::vector<char>& seq, uint32_t& lastPos, con
         --kPosRev;
 		srVal = ntHash::NTPS64(seqStartRev+i+1, MyConst::SEED, seqStartRev[i], seqStartRev[i + MyConst::KMERLEN], MyConst::KMERLEN, rhVal);
         // update kmer table
-        kmerTable[--tabIndex[srVal % MyConst::HTABSIZE]] = std::move(KMER::constructKmer(1, metacpg, kPosRev));
-        strandTable[tabIndex[srVal % MyConst::HTABSIZE]] = false;
+        kmerTable[--tabIndex[srVal & htabMask]] = packStrand(KMER::constructKmer(1, metacpg, kPosRev), false);
     }
 
     // initial hash forward
@@ -1269,8 +2950,7 @@ void RefGenome::ntHashFirst(const std::vector<char>& seq, uint32_t& lastPos, con
     uint64_t kPos = lasN;
 
     // update kmer table
-    kmerTable[--tabIndex[sfVal % MyConst::HTABSIZE]] = std::move(KMER::constructKmer(1, metacpg, kPos));
-    strandTable[tabIndex[sfVal % MyConst::HTABSIZE]] = true;
+    kmerTable[--tabIndex[sfVal & htabMask]] = packStrand(KMER::constructKmer(1, metacpg, kPos), true);
 
     // hash kmers of forward strand
     for (unsigned int i = 0; i < (contextLen - MyConst::KMERLEN); ++i)
@@ -1278,8 +2958,7 @@ void RefGenome::ntHashFirst(const std::vector<char>& seq, uint32_t& lastPos, con
         ++kPos;
 		sfVal = ntHash::NTPS64(seqStart+i+1, MyConst::SEED, seqStart[i], seqStart[i + MyConst::KMERLEN], MyConst::KMERLEN, fhVal);
         // update kmer table
-        kmerTable[--tabIndex[sfVal % MyConst::HTABSIZE]] = std::move(KMER::constructKmer(1, metacpg, kPos));
-        strandTable[tabIndex[sfVal % MyConst::HTABSIZE]] = true;
+        kmerTable[--tabIndex[sfVal & htabMask]] = packStrand(KMER::constructKmer(1, metacpg, kPos), true);
     }
     lastPos = off - MyConst::KMERLEN + 1;
 
@@ -1421,7 +3100,7 @@ inline void RefGenome::ntCountChunk(const std::vector<char>& seq, uint32_t& last
 	uint64_t srVal = ntHash::NTPS64(seqStartRev, MyConst::SEED, MyConst::KMERLEN, rhVal);
 
 	// update indices
-	++tabIndex[srVal % MyConst::HTABSIZE];
+	++tabIndex[srVal & htabMask];
 
 	// hash kmers of backward strand
 	for (unsigned int i = 0; i < (contextLen - MyConst::KMERLEN); ++i)
@@ -1429,7 +3108,7 @@ inline void RefGenome::ntCountChunk(const std::vector<char>& seq, uint32_t& last
 		srVal = ntHash::NTPS64(seqStartRev+i+1, MyConst::SEED, seqStartRev[i], seqStartRev[i + MyConst::KMERLEN], MyConst::KMERLEN, rhVal);
 		// update indices
 		if (!(i%MyConst::SKIPMOD))
-			++tabIndex[srVal % MyConst::HTABSIZE];
+			++tabIndex[srVal & htabMask];
 
 	}
 
@@ -1438,7 +3117,7 @@ inline void RefGenome::ntCountChunk(const std::vector<char>& seq, uint32_t& last
 	uint64_t sfVal = ntHash::NTPS64(seqStart, MyConst::SEED, MyConst::KMERLEN, fhVal);
 
 	// update indices
-	++tabIndex[sfVal % MyConst::HTABSIZE];
+	++tabIndex[sfVal & htabMask];
 
 	// hash kmers of forward strand
 	for (unsigned int i = 0; i < (contextLen - MyConst::KMERLEN); ++i)
@@ -1447,7 +3126,7 @@ inline void RefGenome::ntCountChunk(const std::vector<char>& seq, uint32_t& last
 		sfVal = ntHash::NTPS64(seqStart+i+1, MyConst::SEED, seqStart[i], seqStart[i + MyConst::KMERLEN], MyConst::KMERLEN, fhVal);
 		// update indices
 		if (!(i%MyConst::SKIPMOD))
-			++tabIndex[sfVal % MyConst::HTABSIZE];
+			++tabIndex[sfVal & htabMask];
 	}
 	// update position of last hashed kmer (+ 1)
 	lastPos = pos + off - MyConst::KMERLEN + 1;
@@ -1591,27 +3270,27 @@ void RefGenome::ntCountFirst(std::vector<char>& seq, uint32_t& lastPos, const un
 	uint64_t srVal = ntHash::NTPS64(seqStartRev, MyConst::SEED, MyConst::KMERLEN, rhVal);
 
     // update kmer table
-    ++tabIndex[srVal % MyConst::HTABSIZE];
+    ++tabIndex[srVal & htabMask];
 
 
     // hash kmers of backward strand
     for (unsigned int i = 0; i < (contextLen - MyConst::KMERLEN); ++i)
     {
 		srVal = ntHash::NTPS64(seqStartRev+i+1, MyConst::SEED, seqStartRev[i], seqStartRev[i + MyConst::KMERLEN], MyConst::KMERLEN, rhVal);
-        ++tabIndex[srVal % MyConst::HTABSIZE];
+        ++tabIndex[srVal & htabMask];
     }
 
     // initial hash forward
 	uint64_t fhVal;
 	uint64_t sfVal = ntHash::NTPS64(seqStart, MyConst::SEED, MyConst::KMERLEN, fhVal);
 
-    ++tabIndex[sfVal % MyConst::HTABSIZE];
+    ++tabIndex[sfVal & htabMask];
 
     // hash kmers of forward strand
     for (unsigned int i = 0; i < (contextLen - MyConst::KMERLEN); ++i)
     {
 		sfVal = ntHash::NTPS64(seqStart+i+1, MyConst::SEED, seqStart[i], seqStart[i + MyConst::KMERLEN], MyConst::KMERLEN, fhVal);
-        ++tabIndex[sfVal % MyConst::HTABSIZE];
+        ++tabIndex[sfVal & htabMask];
     }
     lastPos = off - MyConst::KMERLEN + 1;
 
@@ -1754,7 +3433,7 @@ void RefGenome::ntCountLast(std::vector<char>& seq, uint32_t& lastPos, const uns
 	uint64_t srVal = ntHash::NTPS64(seqStartRev, MyConst::SEED, MyConst::KMERLEN, rhVal);
 
     // update indices
-    ++tabIndex[srVal % MyConst::HTABSIZE];
+    ++tabIndex[srVal & htabMask];
 
 
     // hash kmers of backward strand
@@ -1763,7 +3442,7 @@ void RefGenome::ntCountLast(std::vector<char>& seq, uint32_t& lastPos, const uns
 		srVal = ntHash::NTPS64(seqStartRev+i+1, MyConst::SEED, seqStartRev[i], seqStartRev[i + MyConst::KMERLEN], MyConst::KMERLEN, rhVal);
         // update indices
 		if (!(i%MyConst::SKIPMOD))
-			++tabIndex[srVal % MyConst::HTABSIZE];
+			++tabIndex[srVal & htabMask];
     }
 
     // initial hash forward
@@ -1771,7 +3450,7 @@ void RefGenome::ntCountLast(std::vector<char>& seq, uint32_t& lastPos, const uns
 	uint64_t sfVal = ntHash::NTPS64(seqStart, MyConst::SEED, MyConst::KMERLEN, fhVal);
 
     // update indices
-    ++tabIndex[sfVal % MyConst::HTABSIZE];
+    ++tabIndex[sfVal & htabMask];
 
     // hash kmers of forward strand
     for (unsigned int i = 0; i < (contextLen - MyConst::KMERLEN); ++i)
@@ -1779,12 +3458,12 @@ void RefGenome::ntCountLast(std::vector<char>& seq, uint32_t& lastPos, const uns
 		sfVal = ntHash::NTPS64(seqStart+i+1, MyConst::SEED, seqStart[i], seqStart[i + MyConst::KMERLEN], MyConst::KMERLEN, fhVal);
         // update indices
 		if (!(i%MyConst::SKIPMOD))
-			++tabIndex[sfVal % MyConst::HTABSIZE];
+			++tabIndex[sfVal & htabMask];
     }
 }
 
 
-void RefGenome::estimateTablesizes(std::vector<std::vector<char> >& genomeSeq)
+uint64_t RefGenome::estimateTablesizes(std::vector<MappedArray<char> >& genomeSeq)
 {
 
     // // count start CpG kmers
@@ -1845,178 +3524,132 @@ void RefGenome::estimateTablesizes(std::vector<std::vector<char> >& genomeSeq)
     //
     //
     // }
-	for (metaWindow& m : metaWindows)
+	// size the hash table to the genome, the number of k-mers that will be hashed follows from the intervals
+	// without N of each window, so they are scanned once without hashing
+	uint64_t kmerNum = 0;
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(CORENUM) schedule(dynamic, 256) reduction(+:kmerNum)
+#endif
+	for (uint32_t mId = 0; mId < metaWindows.size(); ++mId)
 	{
 
-		// construct corresponding sequence with reduced alphabet
-		std::vector<char> redSeq(MyConst::WINLEN);
-		std::vector<char> redSeqRev(MyConst::WINLEN);
-
+		const metaWindow& m = metaWindows[mId];
 		const auto& seq = fullSeq[m.chrom];
+		const uint32_t winEnd = std::min((size_t)(m.startPos + MyConst::WINLEN), seq.size());
 
-		bool lastN = true;
-		uint32_t nStart = 0;
-		std::list<std::pair<uint32_t, uint32_t> > intervals;
-
-		uint32_t j = 0;
-		for (uint32_t i = m.startPos; i < std::min((size_t)(m.startPos + MyConst::WINLEN), fullSeq[m.chrom].size()); ++i, ++j)
-		{
-			const uint32_t revPos = MyConst::WINLEN - 1 - j;
-			switch (seq[i])
-			{
-				case 'N':
-					if (!lastN)
-					{
-						intervals.push_back({nStart, j - 1});
-					}
-					lastN = true;
-					redSeq[j] = 'N';
-					redSeq[revPos] = 'N';
-					break;
-
-				case 'C':
-					if (lastN)
-					{
-						nStart = j;
-						lastN = false;
-					}
-					redSeq[j] = 'T';
-					redSeqRev[revPos] = 'G';
-					break;
-
-				case 'G':
-					if (lastN)
-					{
-						nStart = j;
-						lastN = false;
-					}
-					redSeq[j] = 'G';
-					redSeqRev[revPos] = 'T';
-					break;
-
-				case 'T':
-					if (lastN)
-					{
-						nStart = j;
-						lastN = false;
-					}
-					redSeq[j] = 'T';
-					redSeqRev[revPos] = 'A';
-					break;
-
-				case 'A':
-					if (lastN)
-					{
-						nStart = j;
-						lastN = false;
-					}
-					redSeq[j] = 'A';
-					redSeqRev[revPos] = 'T';
-					break;
-
-				default:
-					std::cerr << "Read has unknown character \'" << seq[i] << "\' result will not be reliable.\n\n";
-
-			}
-		}
-		if (!lastN)
-		{
-			intervals.push_back({nStart, j - 1});
-		}
-
-		for (auto& p : intervals)
+		uint32_t intervalDist = 0;
+		for (uint32_t i = m.startPos; i <= winEnd; ++i)
 		{
-
-			uint32_t intervalDist = p.second - p.first + 1;
-			if (intervalDist < MyConst::READLEN)
+			if (i < winEnd && seq[i] != 'N')
 			{
+				++intervalDist;
 				continue;
 			}
-			const char* seqStart = redSeq.data() + p.first;
-			const char* seqStartRev = redSeqRev.data() + (MyConst::WINLEN - 1 - p.second);
-
-			// initial hash backward
-			uint64_t rhVal;
-			uint64_t srVal = ntHash::NTPS64(seqStartRev, MyConst::SEED, MyConst::KMERLEN, rhVal);
-
-			// update indices
-			++tabIndex[srVal % MyConst::HTABSIZE];
-
-			// hash kmers of backward strand
-			for (unsigned int i = 0; i < intervalDist - MyConst::KMERLEN; ++i)
+			// same sampling as below, first k-mer and every SKIPMOD-th after it, on both strands and with all seeds
+			// (syncmers are estimated by their expected density)
+			if (intervalDist >= MyConst::READLEN && syncLen)
 			{
-				srVal = ntHash::NTPS64(seqStartRev+i+1, MyConst::SEED, seqStartRev[i], seqStartRev[i + MyConst::KMERLEN], MyConst::KMERLEN, rhVal);
-				// update indices
-				if (!(i%MyConst::SKIPMOD))
-					++tabIndex[srVal % MyConst::HTABSIZE];
+				kmerNum += 2 * seedNum * (1 + (intervalDist - MyConst::KMERLEN) / (MyConst::KMERLEN - syncLen + 1));
 
+			} else if (intervalDist >= MyConst::READLEN) {
+
+				kmerNum += 2 * seedNum * (1 + (intervalDist - MyConst::KMERLEN + MyConst::SKIPMOD - 1) / MyConst::SKIPMOD);
 			}
+			intervalDist = 0;
+		}
+	}
+	// power of two with at least two cells per k-mer, so that keys are computed with a mask
+	htabSize = MyConst::HTABMINSIZE;
+	while (htabSize < 2 * kmerNum && htabSize < MyConst::HTABSIZE)
+	{
+		htabSize <<= 1;
+	}
+	htabMask = htabSize - 1;
+	std::cout << "Hash table with " << htabSize << " cells for " << kmerNum << " kmers\n\n";
+	return kmerNum;
+}
 
-			// initial hash forward
-			uint64_t fhVal;
-			uint64_t sfVal = ntHash::NTPS64(seqStart, MyConst::SEED, MyConst::KMERLEN, fhVal);
 
-			// update indices
-			++tabIndex[sfVal % MyConst::HTABSIZE];
+void RefGenome::countKmers()
+{
 
-			// hash kmers of forward strand
-			for (unsigned int i = 0; i < intervalDist - MyConst::KMERLEN; ++i)
-			{
+	tabIndex.clear();
+	tabIndex.resize(htabSize + 1, 0);
 
-				sfVal = ntHash::NTPS64(seqStart+i+1, MyConst::SEED, seqStart[i], seqStart[i + MyConst::KMERLEN], MyConst::KMERLEN, fhVal);
-				// update indices
-				if (!(i%MyConst::SKIPMOD))
-					++tabIndex[sfVal % MyConst::HTABSIZE];
+	// count in parallel over windows, k-mers of cells outside of the current pass are skipped (see buildInPasses)
+	std::vector<windowBuffers> bufs(CORENUM);
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(CORENUM) schedule(dynamic, 256)
+#endif
+	for (uint32_t mId = 0; mId < metaWindows.size(); ++mId)
+	{
+		hashWindow(mId, bufs[omp_get_thread_num()], [this](const uint64_t hVal, const KMER::kmer, const bool)
+		{
+			const uint64_t cell = (hVal & htabMask) - cellBase;
+			if (cell < htabSize)
+			{
+#pragma omp atomic
+				++tabIndex[cell];
 			}
-		}
+		});
 	}
 
-    uint64_t sum = 0;
     // update to sums of previous entrys
-    for (uint64_t i = 0; i < MyConst::HTABSIZE; ++i)
+    // computed in parallel over slices of the table
+    const uint64_t sliceLen = (htabSize + CORENUM - 1) / CORENUM;
+    std::vector<uint64_t> sliceSum(CORENUM + 1, 0);
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(CORENUM) schedule(static, 1)
+#endif
+    for (unsigned int sl = 0; sl < CORENUM; ++sl)
     {
-
-        sum += tabIndex[i];
-        tabIndex[i] = sum;
+        const uint64_t cellEnd = std::min(htabSize, (sl + 1) * sliceLen);
+        for (uint64_t i = sl * sliceLen; i < cellEnd; ++i)
+        {
+            sliceSum[sl + 1] += tabIndex[i];
+        }
     }
+    for (unsigned int sl = 0; sl < CORENUM; ++sl)
+    {
+        sliceSum[sl + 1] += sliceSum[sl];
+    }
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(CORENUM) schedule(static, 1)
+#endif
+    for (unsigned int sl = 0; sl < CORENUM; ++sl)
+    {
+        uint64_t partSum = sliceSum[sl];
+        const uint64_t cellEnd = std::min(htabSize, (sl + 1) * sliceLen);
+        for (uint64_t i = sl * sliceLen; i < cellEnd; ++i)
+        {
+            partSum += tabIndex[i];
+            tabIndex[i] = partSum;
+        }
+    }
+    const uint64_t sum = sliceSum[CORENUM];
 
-    // resize table to number of kmers that have to be hashed
-    kmerTable.resize(sum);
-    strandTable.resize(sum);
-
-    // fill dummy value
-    tabIndex[MyConst::HTABSIZE] = sum;
+    // fill dummy value, kmerTable is sized to it by generateHashes
+    tabIndex[htabSize] = sum;
 }
 
 
 
 
 
-inline void RefGenome::blacklist(const unsigned int& KSliceStart, const unsigned int& KSliceEnd, std::unordered_map<uint64_t, unsigned int>& bl)
+inline void RefGenome::blacklist(const uint64_t KSliceStart, const uint64_t KSliceEnd, std::unordered_map<uint64_t, unsigned int>& bl, std::vector<uint64_t>& kSeqs)
 {
 
+	kSeqs.resize(KSliceEnd - KSliceStart);
 	// iterate over kmerTable in the specified range
-	for (unsigned int i = KSliceStart; i < KSliceEnd; ++i)
+	for (uint64_t i = KSliceStart; i < KSliceEnd; ++i)
 	{
 
-		// get the kmer at that position
-		KMER::kmer& k = kmerTable[i];
-		bool sFlag = strandTable[i];
+		const uint64_t kHash = reproduceKmerSeq(unpackedKmer(kmerTable[i]), packedStrand(kmerTable[i]), packedSeed(kmerTable[i]));
+		kSeqs[i - KSliceStart] = kHash;
 
-		const uint64_t kHash = reproduceKmerSeq(k, sFlag);
-
-		// try to put sequence in map - if already in, count up
+		// count occurrences of the sequence
 		// NOTE:    hash function is perfect, hence no implicit collisions before putting it into hashmap
-		auto insertion = bl.find(kHash);
-		if (insertion == bl.end())
-		{
-
-			bl[kHash] = 1;
-
-		} else {
-
-			insertion->second += 1;
-		}
+		++bl[kHash];
 	}
 }
 
@@ -2025,166 +3658,64 @@ inline void RefGenome::blacklist(const unsigned int& KSliceStart, const unsigned
 
 
 
-inline uint64_t RefGenome::reproduceKmerSeq(const KMER::kmer& k, const bool sFlag)
+inline uint64_t RefGenome::kmerLetters(const KMER::kmer& k, const bool sFlag) const
 {
 
-	// uint32_t pos = 0;
-	// uint8_t chrom;
-	// // reproduce kmer sequence
-	// if (KMER::isStartCpG(k))
-	// {
-    //
-	// 	// get the start position and chromosome of surrounding meta cpg wrapped into a CpG
-	// 	const struct CpG& startCpG = cpgStartTable[metaStartCpGs[KMER::getMetaCpG(k)].start];
-	// 	chrom = startCpG.chrom;
-    //
-	// } else {
-    //
-	// 	// get the start position and chromosome of surrounding meta cpg wrapped into a CpG
-	// 	const struct CpG& startCpG = cpgTable[metaCpGs[KMER::getMetaCpG(k)].start];
-	// 	pos = startCpG.pos;
-	// 	chrom = startCpG.chrom;
-    //
-	// }
-	uint32_t pos = metaWindows[KMER::getMetaCpG(k)].startPos;
-	uint8_t chrom = metaWindows[KMER::getMetaCpG(k)].chrom;
-
-	// retrieve sequence
-	//
-	// get iterator to sequence start
-	auto seqStart = fullSeq[chrom].begin() + KMER::getOffset(k) + pos;
-	uint64_t kSeq = 0;
+	static_assert(MyConst::KMERLEN == 32, "a k-mer has to fill one word of the 2 bit reference");
+	const metaWindow& m = metaWindows[KMER::getMetaCpG(k)];
+	const PackedSeq& seq = fullSeq[m.chrom];
+	const size_t pos = m.startPos + KMER::getOffset(k);
+	// letter i of the k-mer in bits [2i, 2i + 2)
+	uint64_t word = seq.seqWordAt(pos);
+	const uint32_t nFlags = static_cast<uint32_t>(seq.nMaskAt(pos));
 
-	// if from forward strand, just translate
 	if (sFlag)
 	{
+		// reverse the order of the letters, N is stored as A already
+		word = __builtin_bswap64(word);
+		word = ((word >> 4) & 0x0f0f0f0f0f0f0f0fULL) | ((word & 0x0f0f0f0f0f0f0f0fULL) << 4);
+		return ((word >> 2) & 0x3333333333333333ULL) | ((word & 0x3333333333333333ULL) << 2);
+	}
 
+	// the last letter is in the highest bits already, complement A <-> T, C <-> G by flipping both bits
+	word = ~word;
+	// Ns stay A (k-mers of the table never contain one)
+	if (nFlags)
+	{
 		for (unsigned int i = 0; i < MyConst::KMERLEN; ++i)
 		{
-			kSeq = kSeq << 2;
-
-			if (MyConst::SEED[i])
-			{
-				switch (seqStart[i])
-				{
-
-					case 'C':
-					case 'T':
-
-						kSeq += 3;
-						break;
-
-					// case 'C':
-					//
-					//     kSeq += 1;
-					//     break;
-
-					case 'G':
-
-						kSeq += 2;
-						break;
-
-				// end switch
-				}
-			}
-
-		// end forloop over sequence
-		}
-
-	// otherwise, build reverse complement
-	} else {
-
-		for (unsigned int i = MyConst::KMERLEN; i > 0; --i)
-		{
-			kSeq = kSeq << 2;
-
-			if (MyConst::SEED[MyConst::KMERLEN - i])
-			{
-				switch (seqStart[i - 1])
-				{
-
-					case 'G':
-					case 'A':
-
-						kSeq += 3;
-						break;
-
-					// case 'G':
-					//
-					//     kSeq += 1;
-					//     break;
-
-					case 'C':
-
-						kSeq += 2;
-						break;
-
-				// end switch
-				}
-			}
-
-		// end forloop over sequence
+			if ((nFlags >> i) & 1)
+				word &= ~(3ULL << (2 * i));
 		}
 	}
-
-	return kSeq;
-
+	return word;
 }
 
 
-inline uint32_t RefGenome::reproduceTMask(const KMER::kmer& k, const bool sFlag)
+inline uint64_t RefGenome::reproduceKmerSeq(const KMER::kmer& k, const bool sFlag, const unsigned int seed)
 {
-	uint32_t tMask = 0;
-	// uint32_t pos = 0;
-	// uint8_t chrom;
-	// // reproduce kmer sequence
-	// if (KMER::isStartCpG(k))
-	// {
-    //
-	// 	// get the start position and chromosome of surrounding meta cpg wrapped into a CpG
-	// 	const struct CpG& startCpG = cpgStartTable[metaStartCpGs[KMER::getMetaCpG(k)].start];
-	// 	chrom = startCpG.chrom;
-    //
-	// } else {
-    //
-	// 	// get the start position and chromosome of surrounding meta cpg wrapped into a CpG
-	// 	const struct CpG& startCpG = cpgTable[metaCpGs[KMER::getMetaCpG(k)].start];
-	// 	pos = startCpG.pos;
-	// 	chrom = startCpG.chrom;
-    //
-	// }
-	uint32_t pos = metaWindows[KMER::getMetaCpG(k)].startPos;
-	uint8_t chrom = metaWindows[KMER::getMetaCpG(k)].chrom;
 
-	// retrieve sequence
-	//
-	// get iterator to sequence start
-	auto seqStart = fullSeq[chrom].begin() + KMER::getOffset(k) + pos;
+	// reduced alphabet: C and T (G and A on the reverse strand) become 3, positions skipped by the seed 0
+	const uint64_t letters = kmerLetters(k, sFlag);
+	const uint64_t lo = letters & 0x5555555555555555ULL;
+	const uint64_t hi = (letters >> 1) & 0x5555555555555555ULL;
+	const uint64_t kSeq = letters | ((lo & ~hi) << 1);
+	return (kSeq & MyConst::SEEDLETTERMASKS[seed]) | MyConst::SEEDTAGS[seed];
+}
 
-	// if from forward strand, just translate
-	if (sFlag)
-	{
 
-		for (unsigned int i = 0; i < MyConst::KMERLEN; ++i)
-		{
-			tMask = tMask << 1;
-			if (seqStart[i] == 'T')
-			{
-				tMask |= 1;
-			}
-		}
-	} else {
+inline uint32_t RefGenome::reproduceTMask(const KMER::kmer& k, const bool sFlag)
+{
 
-		for (unsigned int i = MyConst::KMERLEN; i > 0; --i)
-		{
-			tMask = tMask << 1;
-			if (seqStart[i-1] == 'A')
-			{
-				tMask |= 1;
-			}
-		}
-	}
-	return tMask;
+	// one bit per T (A on the reverse strand), first letter in the highest bit
+	const uint64_t letters = kmerLetters(k, sFlag);
+	uint64_t t = letters & (letters >> 1) & 0x5555555555555555ULL;
+	t = (t | (t >> 1)) & 0x3333333333333333ULL;
+	t = (t | (t >> 2)) & 0x0f0f0f0f0f0f0f0fULL;
+	t = (t | (t >> 4)) & 0x00ff00ff00ff00ffULL;
+	t = (t | (t >> 8)) & 0x0000ffff0000ffffULL;
+	t = (t | (t >> 16)) & 0x00000000ffffffffULL;
+	return static_cast<uint32_t>(t);
 }
 
 
@@ -2194,15 +3725,8 @@ void RefGenome::filterRedundancyInHashTable()
     std::cout << "\nHash table size before filter: " << kmerTable.size() << std::endl;
     std::chrono::high_resolution_clock::time_point filterStartTime = std::chrono::high_resolution_clock::now();
 
-    // iterator to the element that we process
-    auto srcItK = kmerTable.begin();
-    auto srcItS = strandTable.begin();
-    // iterator to the position one after the last inserted FILTERED element, always at most as far as srcIt
-    auto filterItK = kmerTable.begin();
-    auto filterItS = strandTable.begin();
-
-    // iterate over hashTable
-    for (uint64_t i = 0; i < MyConst::HTABSIZE; ++i)
+    // process one hash table cell, copies all kept kmers to out
+    auto filterCell = [&](const uint64_t cellStart, const uint64_t cellEnd, uint64_t out)
     {
 
 		std::unordered_set<uint32_t> masks;
@@ -2210,57 +3734,43 @@ void RefGenome::filterRedundancyInHashTable()
         bool isStart = false;
         bool isFwd = false;
         uint64_t metaID = 0xffffffffffffffffULL;
-        const uint64_t prevSizeK = filterItK - kmerTable.begin();
 
         // iterate through vector elements
-        for (uint64_t j = tabIndex[i]; j < tabIndex[i+1]; ++j, ++srcItK, ++srcItS)
+        for (uint64_t j = cellStart; j < cellEnd; ++j)
         {
 
-            if (KMER::getMetaCpG(*srcItK) != metaID || *srcItS != isFwd || KMER::isStartCpG(*srcItK) != isStart)
+            const KMER::kmer k = unpackedKmer(kmerTable[j]);
+            const bool sFlag = packedStrand(kmerTable[j]);
+            if (KMER::getMetaCpG(k) != metaID || sFlag != isFwd || KMER::isStartCpG(k) != isStart)
             {
 
 				masks.clear();
-				masks.insert(reproduceTMask(*srcItK, *srcItS));
-                isFwd = *srcItS;
-                isStart = KMER::isStartCpG(*srcItK);
-                metaID = KMER::getMetaCpG(*srcItK);
-                *filterItK = *srcItK;
-                *filterItS = *srcItS;
-                ++filterItK;
-                ++filterItS;
+				masks.insert(reproduceTMask(k, sFlag));
+                isFwd = sFlag;
+                isStart = KMER::isStartCpG(k);
+                metaID = KMER::getMetaCpG(k);
+                kmerTable[out++] = kmerTable[j];
             } else {
 
-				if (masks.count(reproduceTMask(*srcItK, *srcItS)) == 0)
+				const uint32_t tMask = reproduceTMask(k, sFlag);
+				if (masks.count(tMask) == 0)
 				{
-					masks.insert(reproduceTMask(*srcItK, *srcItS));
-					isFwd = *srcItS;
-					isStart = KMER::isStartCpG(*srcItK);
-					metaID = KMER::getMetaCpG(*srcItK);
-					*filterItK = *srcItK;
-					*filterItS = *srcItS;
-					++filterItK;
-					++filterItS;
+					masks.insert(tMask);
+					kmerTable[out++] = kmerTable[j];
 				}
 			}
 
         }
-        // update the indexing structure for collisions
-        tabIndex[i] = prevSizeK;
-    }
-
-    // update dummy value used for efficient indexing
-    tabIndex[MyConst::HTABSIZE] = filterItK - kmerTable.begin();
-
-    // shrink to new size
-    kmerTable.resize(filterItK - kmerTable.begin());
-    strandTable.resize(filterItS - strandTable.begin());
+        return out;
+    };
+    compactHashTable(filterCell);
 
     std::chrono::high_resolution_clock::time_point filterEndTime = std::chrono::high_resolution_clock::now();
 
     auto runtime = std::chrono::duration_cast<std::chrono::seconds>(filterEndTime - filterStartTime).count();
 
 
-    std::cout << "Hash table size after filter (running " << runtime << "s): " << tabIndex[MyConst::HTABSIZE] << "\n\n";
+    std::cout << "Hash table size after filter (running " << runtime << "s): " << tabIndex[htabSize] << "\n\n";
 }
 
 
@@ -2270,83 +3780,194 @@ void RefGenome::filterHashTable()
     std::cout << "\nHash table size before filter: " << kmerTable.size() << std::endl;
     std::chrono::high_resolution_clock::time_point filterStartTime = std::chrono::high_resolution_clock::now();
 
-    // will hold the counts of individual kmers for each hash table cell
-    std::unordered_map<uint64_t, unsigned int> kmerCount;
-
-    // iterator to the element that we process
-    auto srcItK = kmerTable.begin();
-    auto srcItS = strandTable.begin();
-    // iterator to the position of the last inserted FILTERED element, always at most as far as srcIt
-    auto filterItK = kmerTable.begin();
-    auto filterItS = strandTable.begin();
+    // will hold the counts of individual kmers for each hash table cell (per thread)
+    std::vector<std::unordered_map<uint64_t, unsigned int> > kmerCounts(CORENUM);
+    // sequences of the kmers of the current cell (per thread)
+    std::vector<std::vector<uint64_t> > cellSeqs(CORENUM);
+    // kmers thrown out by each thread
+    std::vector<std::unordered_set<uint64_t, KmerHash> > filtered(CORENUM);
 
-    // iterate over hashTable
-    for (uint64_t i = 0; i < MyConst::HTABSIZE; ++i)
+    // process one hash table cell, copies all kept kmers to out
+    auto filterCell = [&](const uint64_t cellStart, const uint64_t cellEnd, uint64_t out)
     {
 
-        const uint64_t prevSizeK = filterItK - kmerTable.begin();
-
         // check if this slice contains enough elements - if not, do not make blacklist and copy all
-        if ( (tabIndex[i+1] - tabIndex[i]) < MyConst::KMERCUTOFF)
+        if ( (cellEnd - cellStart) < MyConst::KMERCUTOFF)
         {
 
             // just copy over the old kmer slice
-            for (uint64_t j = tabIndex[i]; j < tabIndex[i+1]; ++j, ++srcItK, ++srcItS, ++filterItK, ++filterItS)
+            for (uint64_t j = cellStart; j < cellEnd; ++j)
             {
 
-                *filterItK = *srcItK;
-                *filterItS = *srcItS;
-
+                kmerTable[out++] = kmerTable[j];
             }
 
-
-
         // if there are enough elements for potential kick outs, start a blacklisting
         } else {
 
+            std::unordered_map<uint64_t, unsigned int>& kmerCount = kmerCounts[omp_get_thread_num()];
             // clear container from previous round
             kmerCount.clear();
 
             // generate blacklist
-            blacklist(tabIndex[i], tabIndex[i+1], kmerCount);
+            std::vector<uint64_t>& kSeqs = cellSeqs[omp_get_thread_num()];
+            blacklist(cellStart, cellEnd, kmerCount, kSeqs);
 
             // iterate through vector elements
-            for (uint64_t j = tabIndex[i]; j < tabIndex[i+1]; ++j, ++srcItK, ++srcItS)
+            for (uint64_t j = cellStart; j < cellEnd; ++j)
             {
 
-                const uint64_t kHash = reproduceKmerSeq(*srcItK, *srcItS);
+                const uint64_t kHash = kSeqs[j - cellStart];
 
                 // retrieve count how often it occurs
                 if (kmerCount[kHash] < MyConst::KMERCUTOFF)
                 {
                     // if it occurs not too often, copy
-                    *filterItK = *srcItK;
-                    *filterItS = *srcItS;
-                    ++filterItK;
-                    ++filterItS;
+                    kmerTable[out++] = kmerTable[j];
 
                 } else {
 
-                    filteredKmers.emplace(kHash);
+                    filtered[omp_get_thread_num()].emplace(kHash);
                 }
             }
+        }
+        return out;
+    };
+    compactHashTable(filterCell);
+
+    // the k-mers filtered in earlier passes are kept (see buildInPasses)
+    std::unordered_set<uint64_t, KmerHash> allFiltered(filteredKmers.begin(), filteredKmers.end());
+    for (const auto& threadFiltered : filtered)
+    {
+        allFiltered.insert(threadFiltered.begin(), threadFiltered.end());
+    }
+    std::vector<uint64_t> sortedFiltered(allFiltered.begin(), allFiltered.end());
+    std::sort(sortedFiltered.begin(), sortedFiltered.end());
+    filteredKmers = MappedArray<uint64_t>(std::move(sortedFiltered));
+    buildFilteredBloom();
+
+    std::chrono::high_resolution_clock::time_point filterEndTime = std::chrono::high_resolution_clock::now();
+
+    auto runtime = std::chrono::duration_cast<std::chrono::seconds>(filterEndTime - filterStartTime).count();
+
+
+    std::cout << "Hash table size after filter (running " << runtime << "s): " << tabIndex[htabSize] << "\n\n";
+}
+
+
+template<typename F>
+void RefGenome::compactHashTable(F& filterCell)
+{
+
+    // the table is cut into slices of cells which are filtered in parallel,
+    // kept kmers are moved to the front of their slice
+    const uint64_t sliceLen = (htabSize + CORENUM - 1) / CORENUM;
+    std::vector<uint64_t> sliceStart(CORENUM + 1);
+    for (unsigned int sl = 0; sl <= CORENUM; ++sl)
+    {
+        sliceStart[sl] = tabIndex[std::min(htabSize, sl * sliceLen)];
+    }
+    std::vector<uint64_t> sliceKept(CORENUM + 1, 0);
+
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(CORENUM) schedule(static, 1)
+#endif
+    for (unsigned int sl = 0; sl < CORENUM; ++sl)
+    {
+        const uint64_t cellEnd = std::min(htabSize, (sl + 1) * sliceLen);
+        uint64_t out = sliceStart[sl];
+        for (uint64_t i = sl * sliceLen; i < cellEnd; ++i)
+        {
+            // end of last cell belongs to next slice which may already be rewritten
+            const uint64_t end = (i + 1 == cellEnd) ? sliceStart[sl + 1] : tabIndex[i + 1];
+            const uint64_t start = tabIndex[i];
+            tabIndex[i] = out;
+            out = filterCell(start, end, out);
+        }
+        sliceKept[sl + 1] = out - sliceStart[sl];
+    }
 
+    // close the gaps between slices
+    for (unsigned int sl = 0; sl < CORENUM; ++sl)
+    {
+        sliceKept[sl + 1] += sliceKept[sl];
+        if (sliceKept[sl] != sliceStart[sl])
+        {
+            std::memmove(kmerTable.data() + sliceKept[sl], kmerTable.data() + sliceStart[sl], sizeof(KMER::kmer) * (sliceKept[sl + 1] - sliceKept[sl]));
+        }
+    }
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(CORENUM) schedule(static, 1)
+#endif
+    for (unsigned int sl = 0; sl < CORENUM; ++sl)
+    {
+        const uint64_t cellEnd = std::min(htabSize, (sl + 1) * sliceLen);
+        for (uint64_t i = sl * sliceLen; i < cellEnd; ++i)
+        {
+            tabIndex[i] = tabIndex[i] - sliceStart[sl] + sliceKept[sl];
         }
-        // update the indexing structure for collisions
-        tabIndex[i] = prevSizeK;
     }
 
     // update dummy value used for efficient indexing
-    tabIndex[MyConst::HTABSIZE] = filterItK - kmerTable.begin();
+    tabIndex[htabSize] = sliceKept[CORENUM];
 
     // shrink to new size
-    kmerTable.resize(filterItK - kmerTable.begin());
-    strandTable.resize(filterItS - strandTable.begin());
+    kmerTable.resize(sliceKept[CORENUM]);
+}
 
-    std::chrono::high_resolution_clock::time_point filterEndTime = std::chrono::high_resolution_clock::now();
 
-    auto runtime = std::chrono::duration_cast<std::chrono::seconds>(filterEndTime - filterStartTime).count();
+inline void RefGenome::insertKmer(const uint64_t hVal, const KMER::kmer k, const bool isFwd)
+{
+
+    // cells of other passes are skipped (see buildInPasses)
+    const uint64_t cell = (hVal & htabMask) - cellBase;
+    if (cell >= htabSize)
+    {
+        return;
+    }
+    uint64_t pos;
+#pragma omp atomic capture
+    pos = --tabIndex[cell];
+    kmerTable[pos] = packStrand(k, isFwd);
+}
+
 
+void RefGenome::sortKmerCells()
+{
+
+    // a sequential fill leaves the kmers of a cell in descending order of windows,
+    // kmers of the same window are inserted by the same thread and hence already in order
+    auto cmp = [](const KMER::kmer& a, const KMER::kmer& b) { return KMER::getMetaCpG(a) > KMER::getMetaCpG(b); };
+
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(CORENUM) schedule(dynamic, 1 << 16)
+#endif
+    for (uint64_t i = 0; i < htabSize; ++i)
+    {
+
+        auto first = kmerTable.begin() + tabIndex[i];
+        auto last = kmerTable.begin() + tabIndex[i + 1];
+        if (std::is_sorted(first, last, cmp))
+        {
+            continue;
+        }
+        // insertion sort for the common small cells, it is stable
+        if (last - first <= 32)
+        {
+            for (auto it = first + 1; it < last; ++it)
+            {
+                const KMER::kmer k = *it;
+                auto ins = it;
+                for (; ins > first && cmp(k, *(ins - 1)); --ins)
+                {
+                    *ins = *(ins - 1);
+                }
+                *ins = k;
+            }
 
-    std::cout << "Hash table size after filter (running " << runtime << "s): " << tabIndex[MyConst::HTABSIZE] << "\n\n";
+        } else {
+
+            std::stable_sort(first, last, cmp);
+        }
+    }
 }
@@ -20,16 +20,23 @@
 #define REFGENOME_H
 
 #include <fstream>
+#include <array>
 #include <istream>
 #include <string>
 #include <vector>
 #include <unordered_map>
 #include <unordered_set>
+#include <algorithm> // binary_search
+#include <atomic>
+#include <thread>
 
 // Project includes
 #include "CONST.h"
 #include "structs.h"
 #include "DnaBitStr.h"
+#include "MappedArray.h"
+#include "PackedSeq.h"
+#include "SeqView.h"
 // spaced seeds
 #include "spaced_nthash/nthash.hpp"
 
@@ -49,64 +56,411 @@ class RefGenome
         //      genSeq      genomic sequence seperated by chromosome
         //      noloss      flag that is true iff index must be lossless
 		//      chrMap		map of internal chromosome ID to external string identifier of fasta file
-        RefGenome(std::vector<struct CpG>&& cpgTab, std::vector<struct CpG>&& cpgStartTab, std::vector<std::vector<char> >& genSeq, const bool noloss, std::unordered_map<uint8_t, std::string>& chromMap);
+		//      chrOffsets	position of each sequence in the chromosome it is named after (see readReference)
+		//      syncmers	flag that is true iff only the syncmers are hashed instead of every SKIPMOD-th k-mer
+		//      allSeeds	flag that is true iff the k-mers are hashed with all seeds of MyConst::SEEDSET
+		//      minCutoff	0 to filter the hash table now, otherwise the smallest k-mer cutoff a load of the index may
+		//      			choose: both filters are left to the load and save stores the counts they need (see
+		//      			applyKmerCutoff)
+        RefGenome(std::vector<struct CpG>&& cpgTab, std::vector<struct CpG>&& cpgStartTab, std::vector<std::vector<char> >& genSeq, const bool noloss, std::unordered_map<chromId, std::string>& chromMap, std::vector<uint32_t>&& chromOffsets, const bool syncmers = false, const bool allSeeds = false, const uint32_t minCutoff = 0);
         // ARGUMENTS:
         //      filepath    file where index was saved before using RefGenome::save(...)
         RefGenome(std::string filePath);
 
-        ~RefGenome() = default;
+        // appends further sequences (e.g. spike-ins or decoys, arguments as for the first Ctor) to a loaded index
+        // only the new sequences are hashed and filtered, their kmers are merged into the hash table of the index
+        void extend(std::vector<struct CpG>&& cpgTab, std::vector<struct CpG>&& cpgStartTab, std::vector<std::vector<char> >& genSeq, const bool noloss, std::unordered_map<chromId, std::string>& chromMap, std::vector<uint32_t>&& chromOffsets);
 
+        // tables may point into the memory mapped index file, which is unmapped on destruction
+        RefGenome(const RefGenome&) = delete;
+        RefGenome& operator=(const RefGenome&) = delete;
 
-		// compute the T mask for a given k-mer k, that is, returns a bit string
-		// that is 1 at position i (from right) iff k[i] == T AND seed[i] == 1
-		inline uint32_t getTMask(KMER::kmer& k)
+        ~RefGenome();
+
+
+		// position of the first entry of bucket key in kmerTableSmall, bucket key ends at bucketStart(key + 1)
+		inline uint64_t bucketStart(const uint64_t key) const
 		{
-			if (!KMER::isStartCpG(k))
-			{
-				// const char* seq = fullSeq[cpgTable[metaCpGs[KMER::getMetaCpG(k)].start].chrom].data() +
-				// 			cpgTable[metaCpGs[KMER::getMetaCpG(k)].start].pos + KMER::getOffset(k);
-				const char* seq = fullSeq[metaWindows[KMER::getMetaCpG(k)].chrom].data() +
-							metaWindows[KMER::getMetaCpG(k)].startPos + KMER::getOffset(k);
-				uint32_t mask = 0;
-				if (strandTable[KMER::getMetaCpG(k)])
+			return tabBlocks[key >> INDEX::TABBLOCKBITS] + tabOffsets[key];
+		}
+
+		// true iff the loaded index holds the offsets of its k-mers (see kmerOffsets)
+		inline bool hasKmerOffsets() const { return !kmerOffsets.empty(); }
+		// true iff the loaded index holds the fingerprints of its k-mers (see kmerPrints)
+		inline bool hasKmerPrints() const { return !kmerPrints.empty(); }
+		// number of seeds the k-mers are hashed with, the first ones of MyConst::SEEDSET
+		inline unsigned int seeds() const { return seedNum; }
+		// minimum number of k-mer hits of a window to verify a read in it, MyConst::qThresh scaled down to the
+		// sparser syncmers if the index holds these
+		inline uint16_t qgramThreshold() const
+		{
+			if (!syncLen)
+				return MyConst::qThresh;
+			return (MyConst::qThresh * MyConst::SKIPMOD + MyConst::KMERLEN - syncLen) / (MyConst::KMERLEN - syncLen + 1);
+		}
+
+		// k-mer cutoff the hash table is filtered with
+		inline uint64_t kmerCutoffUsed() const { return kmerCutoff; }
+		// filters a loaded deferred index (see MyConst::kmerCutoff) once more, with cutoff instead of the cutoff it
+		// was filtered with so far, and rebuilds the hot bucket lists if there are any
+		// RETURN:  false iff the index is not deferred or cutoff is not between its smallest cutoff and 65535
+		bool setKmerCutoff(const uint64_t cutoff);
+
+		// tags the sequences of a combined index of several genomes (e.g. host and graft) with their genome of
+		// origin: sequence c stems from genome chromGenome[c], named tags[chromGenome[c]]; stored by save
+		void setGenomes(std::vector<std::string>&& tags, std::vector<uint8_t>&& chromGenome);
+		// tags of the genomes of a combined index, empty for an index of one genome
+		inline const std::vector<std::string>& genomes() const { return genomeTags; }
+		// genome of sequence c of a combined index
+		inline uint8_t genomeOf(const chromId c) const { return chrGenome[c]; }
+
+		// hash of the CpGs and chromosome names, identifies the index methylation counts refer to
+		// (see METHFILE::header)
+		uint64_t fingerprint() const;
+
+		// collects the cytosines of both strands in CHG and CHH context into ctxSites (see --non_cpg)
+		// the sites are not stored with the index but found in the sequences after loading it, a pass over the genome
+		void buildContextSites();
+
+		// window major copy of the reference for verification and calling (see MyConst::windowRecords): one record
+		// per window, aligned to a cache line, with the packed letters and N flags of its sequence from WINRECBEFORE
+		// letters before the window to WINRECAFTER letters after its start, a bitmap of the call positions of its CpGs
+		// over the same letters with the ranks of its words, and the positions of its CpGs relative to the window
+		// start, such that a candidate window is read from one memory region
+		void buildWindowRecords();
+		inline bool hasWindowRecords() const { return !winRecOffsets.empty(); }
+
+		// window lists of the largest buckets of kmerTableSmall, up to MyConst::hotBuckets KB (see hotBucket)
+		// not built for indexes with k-mer offsets, fingerprints or several seeds, whose seeding needs the entries
+		void buildHotBuckets();
+		// window list of bucket b (a range of kmerTableSmall as from getSeedBuckets) as [first, last), nullptr if the
+		// bucket has none: the (window, strand) pairs of its entries in their order without consecutive repeats, each
+		// a varint of the distance to the window before (KMER_S::METAMAX for the first one) shifted left by one and
+		// the strand in the lowest bit, such that the lists of the hot buckets stay cached across reads
+		inline const uint8_t* hotBucket(const std::pair<uint64_t, uint64_t>& b, const uint8_t*& last) const
+		{
+			if (b.second - b.first < hotMinSize)
+				return nullptr;
+			const auto it = std::lower_bound(hotStarts.begin(), hotStarts.end(), b.first);
+			if (it == hotStarts.end() || *it != b.first)
+				return nullptr;
+			const size_t h = it - hotStarts.begin();
+			last = hotData.data() + hotOffsets[h + 1];
+			return hotData.data() + hotOffsets[h];
+		}
+		// windows of a list of hotBucket in the order of the bucket
+		class HotWindows
+		{
+			public:
+
+				HotWindows(const uint8_t* first, const uint8_t* last) :
+						pos(first)
+					,	end(last)
+					,	metaId(KMER_S::METAMAX)
 				{
-					for (unsigned int i = 0; i < MyConst::KMERLEN; ++i)
+				}
+
+				// next window id and its strand, false if there is none left
+				inline bool next(uint32_t& id, bool& isFwd)
+				{
+					if (pos == end)
+						return false;
+					uint32_t v = 0;
+					for (unsigned int shift = 0; ; shift += 7)
 					{
-						mask = mask << 1;
-						if (seq[i] == 'T')
-						{
-							mask |= 1;
-						}
+						const uint8_t byte = *pos++;
+						v |= static_cast<uint32_t>(byte & 0x7f) << shift;
+						if (!(byte & 0x80))
+							break;
 					}
-				// is reverse complement sequence
-				} else {
+					metaId -= v >> 1;
+					id = metaId;
+					isFwd = v & 1;
+					return true;
+				}
+
+			private:
 
-					for (unsigned int i = MyConst::KMERLEN - 1; i > 0; --i)
+				const uint8_t* pos;
+				const uint8_t* end;
+				uint32_t metaId;
+		};
+		// letters of the sequence around window metaId, as a view into its record; letter i of the view is letter
+		// first + i of the sequence (positions outside of the sequence are A)
+		inline void windowLetters(const uint32_t metaId, PackedSeq& letters, int64_t& first) const
+		{
+			const uint64_t* rec = winRecBase + winRecOffsets[metaId];
+			first = static_cast<int64_t>(metaWindows[metaId].startPos & ~static_cast<uint32_t>(63)) - WINRECBEFORE;
+			letters.view(const_cast<uint64_t*>(rec), const_cast<uint64_t*>(rec) + WINRECSEQWORDS, WINRECLETTERS);
+		}
+		// offsets to the window start of the CpGs of window metaId (the ones of calls, cpgTable[i].pos + READLEN - 2),
+		// the one of CpG metaWindows[metaId].startInd first
+		inline const int16_t* windowCpGs(const uint32_t metaId) const
+		{
+			return reinterpret_cast<const int16_t*>(winRecBase + winRecOffsets[metaId] + WINRECSEQWORDS + 2 * WINRECMASKWORDS + WINRECRANKWORDS);
+		}
+		// number of CpGs of window metaId whose call position is before pos, counted in the CpG bitmap of its record;
+		// the CpGs of the window with call positions in [lo, hi] are the ones with IDs
+		// [startInd + windowCpGRank(lo), startInd + windowCpGRank(hi + 1))
+		inline uint32_t windowCpGRank(const uint32_t metaId, const int64_t pos) const
+		{
+			const uint64_t* bits = winRecBase + winRecOffsets[metaId] + WINRECSEQWORDS + WINRECMASKWORDS;
+			const uint16_t* ranks = reinterpret_cast<const uint16_t*>(bits + WINRECMASKWORDS);
+			const int64_t off = pos - (static_cast<int64_t>(metaWindows[metaId].startPos & ~static_cast<uint32_t>(63)) - WINRECBEFORE);
+			if (off <= 0)
+				return 0;
+			if (off >= static_cast<int64_t>(WINRECLETTERS))
+				return ranks[WINRECMASKWORDS];
+			const uint64_t below = bits[off >> 6] & ((1ULL << (off & 63)) - 1);
+			return ranks[off >> 6] + __builtin_popcountll(below);
+		}
+		// writes the n letters of sequence chrom starting at pos to out as PackedSeq::unpack, from the record of
+		// window metaId if it holds them
+		inline void unpackNear(const uint32_t metaId, const chromId chrom, const std::ptrdiff_t pos, const size_t n, char* out) const
+		{
+			if (hasWindowRecords())
+			{
+				PackedSeq letters;
+				int64_t first;
+				windowLetters(metaId, letters, first);
+				if (pos >= std::max<int64_t>(first, 0) && pos + n <= std::min<uint64_t>(first + WINRECLETTERS, fullSeq[chrom].size()))
+				{
+					letters.unpack(pos - first, n, out);
+					return;
+				}
+			}
+			fullSeq[chrom].unpack(pos, n, out);
+		}
+		// flags of a site in ctxTypes, CHG on the forward strand if none is set
+		enum CTXTYPE : uint8_t {
+			CTX_CHH = 1,
+			// C on the reverse strand, i.e. a G on the forward strand
+			CTX_REV = 2
+		};
+
+		// writes the sections of the loaded index file with their sizes, the bucket size histogram of the hash
+		// table, the number of blacklisted k-mers and window and CpG statistics to out (see --index_stats)
+		void printStats(std::ostream& out) const;
+
+		// huge page backing of the large tables of a loaded index (see MyConst::hugePages)
+		// HUGE_TLBFS: explicit huge pages (MAP_HUGETLB), HUGE_THP: transparent huge pages (MADV_HUGEPAGE)
+		enum HUGEPAGES : uint8_t {
+			HUGE_NONE = 0,
+			HUGE_TLBFS,
+			HUGE_THP
+		};
+		inline HUGEPAGES hugePageMode() const { return hugeMode; }
+		// bytes of the tables the kernel actually backed by huge pages
+		inline size_t hugePageBytes() const { return hugeBytes; }
+		// NUMA nodes the large tables of a loaded index are interleaved over, 0 if not interleaved (see MyConst::numa)
+		inline size_t interleavedNodes() const { return numaNodes; }
+
+		// true iff the k-mer with blacklist key kSeq (reduced alphabet, 2 bit per letter, see seedKey) was thrown out
+		// by filterHashTable
+		// filteredBloom rejects most k-mers, only the rest is searched in filteredKmers
+		inline bool isFiltered(const uint64_t kSeq) const
+		{
+			if (filteredKmers.empty())
+				return false;
+			const uint64_t h = kSeq * BLOOMMULT;
+			const uint64_t bits = (1ULL << (h >> 58)) | (1ULL << ((h >> 52) & 63));
+			if ((filteredBloom[(h >> 20) & filteredBloomMask] & bits) != bits)
+				return false;
+			return std::binary_search(filteredKmers.begin(), filteredKmers.end(), kSeq);
+		}
+
+
+		// hash all k-mers of seq and look up their buckets in the hash table
+		// the hashes of all k-mers are computed up front (see hashKmers), then the random accesses are batched:
+		// all bucket directory entries are prefetched before the first one is read and all buckets of
+		// kmerTableSmall are prefetched before the first one is scanned
+		//
+		// ARGUMENTS:
+		// 			seq			sequence of the read to query to hash table
+		// 			buckets		will hold range [first, second) of kmerTableSmall for each k-mer and seed, the buckets
+		// 						of the seeds() seeds of a k-mer one after another, in the order of the k-mers
+		// 			hashBuf		buffer for the hashes, reused over the reads of a thread
+		// 			prints		will hold the fingerprint (see kmerPrint) of each k-mer and seed in the order of buckets
+		// 						if the index holds fingerprints, empty otherwise (see SeedHits)
+		//
+		// RETURN:	overall number of entries in all buckets
+		inline uint64_t getSeedBuckets(const SeqView& seq, std::vector<std::pair<uint64_t, uint64_t> >& buckets, std::vector<uint64_t>& hashBuf, std::vector<uint8_t>& prints)
+		{
+			seedKeys(seq, buckets, hashBuf, prints);
+			return seedRanges(buckets);
+		}
+		// the two halves of getSeedBuckets, such that the reads of a group can issue the prefetches of one half for
+		// all of them before the first one waits for its memory (see MyConst::interleave)
+		// seedKeys leaves the bucket directory entry of each k-mer and seed in buckets[].first and prefetches it
+		inline void seedKeys(const SeqView& seq, std::vector<std::pair<uint64_t, uint64_t> >& buckets, std::vector<uint64_t>& hashBuf, std::vector<uint8_t>& prints)
+		{
+
+			const size_t kmerNum = seq.size() - MyConst::KMERLEN + 1;
+			buckets.resize(kmerNum * seedNum);
+			prints.resize(hasKmerPrints() ? kmerNum * seedNum : 0);
+			const uint64_t* hashes = hashKmers(seq, hashBuf);
+
+			// keys of all k-mers under all seeds
+			// blacklisted k-mers (see isFiltered) get the key FILTEREDKEY and an empty bucket, their bucket
+			// directory entries are not touched
+			uint64_t kSeq = 0;
+			for (size_t i = 0; i + 1 < MyConst::KMERLEN; ++i)
+				kSeq = (kSeq << 2) | reducedCode(seq[i]);
+			for (size_t cIdx = 0; cIdx < kmerNum; ++cIdx)
+			{
+				kSeq = (kSeq << 2) | reducedCode(seq[cIdx + MyConst::KMERLEN - 1]);
+				for (unsigned int s = 0; s < seedNum; ++s)
+				{
+					std::pair<uint64_t, uint64_t>& b = buckets[cIdx * seedNum + s];
+					const uint64_t key = seedKey(kSeq, s);
+					// k-mers that are no syncmers of a syncmer index are not in the table, neither are blacklisted ones
+					if ((syncLen && !isSyncmer(kSeq & MyConst::SEEDLETTERMASKS[s])) || isFiltered(key))
 					{
-						mask = mask << 1;
-						if (seq[i] == 'A')
-						{
-							mask |= 1;
-						}
+						b.first = FILTEREDKEY;
+						continue;
 					}
+					if (!prints.empty())
+						prints[cIdx * seedNum + s] = kmerPrint(key);
+					b.first = hashes[s * kmerNum + cIdx] & htabMask;
+					__builtin_prefetch(tabOffsets.data() + b.first);
 				}
-				return mask;
+			}
+		}
+		// seedRanges turns the directory entries left by seedKeys into the bucket ranges and prefetches the buckets
+		// RETURN:	overall number of entries in all buckets
+		inline uint64_t seedRanges(std::vector<std::pair<uint64_t, uint64_t> >& buckets)
+		{
 
-			// TODO: make this happen right
-			} else {
+			uint64_t bucketCount = 0;
+			for (std::pair<uint64_t, uint64_t>& b : buckets)
+			{
+				const uint64_t key = b.first;
+				if (key == FILTEREDKEY)
+				{
+					b.first = 0;
+					b.second = 0;
+					continue;
+				}
+				b.first = bucketStart(key);
+				b.second = bucketStart(key + 1);
+				__builtin_prefetch(kmerTableSmall.data() + b.first);
+				bucketCount += b.second - b.first;
+			}
+			return bucketCount;
+		}
 
-				return 0;
+		// spaced seed ntHash (as ntHash::NTPS64) of all k-mers of seq under all seeds, written to hashBuf
+		// instead of rolling the hash from k-mer to k-mer, the hash of every k-mer is the xor of its care positions,
+		// which are added for all k-mers at once: the loop over the k-mers has no dependencies between iterations
+		// and runs in the vector lanes (the rotation is the same for all lanes)
+		//
+		// RETURN:	the hash of k-mer c under seed s at position s * (seq.size() - KMERLEN + 1) + c
+		inline const uint64_t* hashKmers(const SeqView& seq, std::vector<uint64_t>& hashBuf) const
+		{
+			const size_t len = seq.size();
+			const size_t kmerNum = len - MyConst::KMERLEN + 1;
+			hashBuf.resize(len + seedNum * kmerNum);
+			// random value of each letter, the value of letter j in k-mer c is this value rotated by KMERLEN-1-(j-c)
+			uint64_t* letters = hashBuf.data();
+			for (size_t j = 0; j < len; ++j)
+				letters[j] = msTab[static_cast<unsigned char>(seq[j])][0];
+			uint64_t* hashes = letters + len;
+			for (unsigned int s = 0; s < seedNum; ++s)
+			{
+				uint64_t* __restrict__ h = hashes + s * kmerNum;
+				std::fill(h, h + kmerNum, 0);
+				for (unsigned int i = 0; i < MyConst::KMERLEN; ++i)
+				{
+					if (!((MyConst::SEEDSET[s] >> (MyConst::KMERLEN - 1 - i)) & 1))
+						continue;
+					const unsigned int rot = (MyConst::KMERLEN - 1 - i) & 63;
+					const uint64_t* __restrict__ l = letters + i;
+					for (size_t c = 0; c < kmerNum; ++c)
+						h[c] ^= (l[c] << rot) | (l[c] >> ((64 - rot) & 63));
+				}
 			}
+			return hashes;
 		}
 
+		// entries of the buckets of one k-mer under all seeds (see getSeedBuckets), merged in descending order of
+		// their windows like the entries of a single bucket
+		// with the fingerprints of getSeedBuckets, entries of other k-mers that share the bucket are skipped
+		class SeedHits
+		{
+			public:
+
+				SeedHits(const RefGenome& ref, const std::vector<std::pair<uint64_t, uint64_t> >& buckets, const std::vector<uint8_t>& prints, const size_t kIdx) :
+						table(ref.kmerTableSmall.data())
+					,	tablePrints(prints.empty() ? nullptr : ref.kmerPrints.data())
+				{
+					static_assert(MyConst::SEEDNUM <= 2, "SeedHits merges the buckets of at most two seeds");
+					const unsigned int seedNum = ref.seeds();
+					pos[0] = buckets[kIdx * seedNum].first;
+					end[0] = buckets[kIdx * seedNum].second;
+					pos[1] = seedNum > 1 ? buckets[kIdx * seedNum + 1].first : 0;
+					end[1] = seedNum > 1 ? buckets[kIdx * seedNum + 1].second : 0;
+					want[0] = tablePrints ? prints[kIdx * seedNum] : 0;
+					want[1] = tablePrints && seedNum > 1 ? prints[kIdx * seedNum + 1] : 0;
+				}
+
+				// next entry i of kmerTableSmall and the seed s of its bucket, false if there is none left
+				inline bool next(uint64_t& i, unsigned int& s)
+				{
+					if (tablePrints)
+					{
+						while (pos[0] < end[0] && tablePrints[pos[0]] != want[0])
+							++pos[0];
+						while (pos[1] < end[1] && tablePrints[pos[1]] != want[1])
+							++pos[1];
+					}
+					if (pos[0] < end[0] && (pos[1] == end[1] || KMER_S::getMetaCpG(table[pos[0]]) >= KMER_S::getMetaCpG(table[pos[1]])))
+					{
+						i = pos[0]++;
+						s = 0;
+						return true;
+					}
+					if (pos[1] < end[1])
+					{
+						i = pos[1]++;
+						s = 1;
+						return true;
+					}
+					return false;
+				}
+
+			private:
+
+				const KMER_S::kmer* table;
+				// fingerprints of the table, nullptr if entries are not filtered
+				const uint8_t* tablePrints;
+				uint64_t pos[2];
+				uint64_t end[2];
+				// fingerprint of the k-mer under each seed
+				uint8_t want[2];
+		};
+
 
         // functions to save and load the index structure represented by this class to a binary file
-        void save(const std::string& filepath);
+        // for the file layout see namespace INDEX in structs.h
+        // load memory maps the file, the large tables are used in place without copying
+        // withOffsets: additionally store the offset of every k-mer inside its window (see kmerOffsets), a loaded
+        //             index is stored with its offsets if it has them
+        // withPrints: additionally store the fingerprint of every k-mer (see kmerPrints), likewise kept by a loaded index
+        // compress: store the file compressed in blocks (see INDEX::zheader), load decompresses it into memory
+        void save(const std::string& filepath, const bool withOffsets = false, const bool withPrints = false, const bool compress = false);
         void load(const std::string& filepath);
-        inline void write_strands(std::ofstream& of);
-        inline void read_strands(std::ifstream& ifs);
-        inline void write_filteredKmers(std::ofstream& of);
-        inline void read_filteredKmers(std::ifstream& ifs);
+        // sizes and fills filteredBloom from filteredKmers
+        void buildFilteredBloom();
+        // copies the bucket directory, the k-mer table, the k-mer offsets and the reference sequence of the index
+        // file to anonymous memory and points secData to the copies; the copy is backed by huge pages
+        // (MyConst::hugePages) and/or interleaved over the NUMA nodes (MyConst::numa)
+        void copyTables(const INDEX::header& hdr, std::array<char*, INDEX::SECNUM>& secData);
+        // faults the given ranges of the index file mapping in, one after another, unless warmStop is set
+        // run by warmer (see MyConst::warmIndex), sets warmMillis when done
+        void warmUp(const std::vector<std::pair<const char*, uint64_t> > ranges);
+        // appends chrMap in the layout of section INDEX::CHRMAP to buf
+        inline void write_chrMap(std::string& buf);
+        inline void read_chrMap(const char* buf, const size_t n);
 
 
     // private:
@@ -114,13 +468,43 @@ class RefGenome
         // produces all struct Meta CpGs
         void generateMetaCpGs();
 
-		void generateWindows();
+		// appends the windows of the sequences firstChr, firstChr + 1, ... to metaWindows
+		void generateWindows(const chromId firstChr = 0);
 
 
         // hash all kmers in all CpGs to _kmerTable using ntHash
         // the kmers are represented in REDUCED alphabet {A,T,G}
         // mapping all Cs to Ts
-        void generateHashes(std::vector<std::vector<char> >& genomeSeq);
+        // tabIndex has to hold the end of every cell in kmerTable (see countKmers)
+        void generateHashes();
+        // applies filterHashTable (unless noloss is set) and filterRedundancyInHashTable, neither for a deferred index
+        void filterKmers(const bool noloss);
+        // filters the unfiltered hash table of a deferred index into the tables used for querying, as filterHashTable
+        // with cutoff instead of KMERCUTOFF followed by filterRedundancyInHashTable would have when it was built:
+        // entries of k-mers with at least cutoff occurrences in their bucket are dropped, of the rest only the first
+        // entry per T mask of a run of entries of the same window, strand and start flag is kept, and the blacklist
+        // becomes the candidates with at least cutoff occurrences (see unfiltered)
+        void applyKmerCutoff(const uint64_t cutoff);
+        // number of passes of buildInPasses such that the k-mers (kmerNum as estimated) and the bucket directory of
+        // the cells of a pass fit into MyConst::indexMem, 1 without a budget
+        uint64_t passCount(const uint64_t kmerNum) const;
+        // builds the hash table pass by pass over ranges of cells: each pass hashes all windows but only keeps the
+        // k-mers of its cells, filters them and appends them to a temporary file, which is mapped as kmerTable
+        // and tabIndex in the end
+        // the result is the same as hashing and filtering all cells at once
+        void buildInPasses(const uint64_t passNum, const bool noloss);
+        // scratch memory of hashWindow, one per thread, reused for all windows the thread hashes
+        struct windowBuffers
+        {
+            // window in reduced alphabet and its reverse complement
+            std::vector<char> redSeq;
+            std::vector<char> redSeqRev;
+            // first and last position of the intervals without N
+            std::vector<std::pair<uint32_t, uint32_t> > intervals;
+        };
+        // calls emit(hash value, kmer, strand flag) for every k-mer of window mId that is put into the hash table
+        template<typename F>
+        inline void hashWindow(const uint32_t mId, windowBuffers& buf, F&& emit);
 
 
         // generates all kmers in seq and hashes them and their reverse complement using nthash into kmerTable
@@ -151,9 +535,12 @@ class RefGenome
         void ntCountLast(std::vector<char>& seq, uint32_t& lastPos, const unsigned int& pos, const unsigned int& bpsAfterCpG);
         void ntCountFirst(std::vector<char>& seq, uint32_t& lastPos, const unsigned int& cpgOffset);
 
-        // estimates the number of collision per entry and number of overall kmers to be hashed
-        // to initialize tabIndex and kmerTable
-        void estimateTablesizes(std::vector<std::vector<char> >& genomeSeq);
+        // estimates the number of overall kmers to be hashed to size the hash table (htabSize)
+        //
+        // RETURN:  estimated number of kmers
+        uint64_t estimateTablesizes(std::vector<MappedArray<char> >& genomeSeq);
+        // counts the kmers of every cell to initialize tabIndex (the end of every cell in the k-mer table)
+        void countKmers();
 
 
         // blacklist all k-mers that appear more then KMERCUTOFF times in the specified kmerTable slice
@@ -165,15 +552,26 @@ class RefGenome
         //
         //              blt         map of k-mer strings that are blacklisted
         //                          THIS WILL BE FILLED DURING CALL
-        inline void blacklist(const unsigned int& KSliceStart, const unsigned int& KSliceEnd, std::unordered_map<uint64_t, unsigned int>& bl);
+        //              kSeqs       k-mer sequences of the slice in order (see reproduceKmerSeq)
+        //                          THIS WILL BE FILLED DURING CALL
+        inline void blacklist(const uint64_t KSliceStart, const uint64_t KSliceEnd, std::unordered_map<uint64_t, unsigned int>& bl, std::vector<uint64_t>& kSeqs);
+
+        // letters of kmer k on its strand read from one word of the 2 bit reference, 2 bits each as in PackedSeq
+        // with the first letter in the highest bits (Ns as A), reproduceKmerSeq and reproduceTMask derive from it
+        //
+        // ARGUMENTS:
+        //              k       k-mer
+        //              sFlag   flag stating if kmer is of forward (true) or reverse (false) strand
+        inline uint64_t kmerLetters(const KMER::kmer& k, const bool sFlag) const;
 
         // reproduce the k-mer sequence of a given kmer by looking up the position in the reference genome
-        // the sequence will be returned as a bitstring
+        // the sequence will be returned as a bitstring, masked by the seed as key of the blacklist (see seedKey)
         //
         // ARGUMENTS:
         //              k       k-mer
         //              sFlag   flag stating if kmer is of forward (true) or reverse (false) strand
-        inline uint64_t reproduceKmerSeq(const KMER::kmer& k, const bool sFlag);
+        //              seed    index of the seed in MyConst::SEEDSET the kmer was hashed with
+        inline uint64_t reproduceKmerSeq(const KMER::kmer& k, const bool sFlag, const unsigned int seed);
 		// reproduce T masks of sequence given by kmer
 		//
 		// ARGUMENTS:
@@ -182,35 +580,91 @@ class RefGenome
 		inline uint32_t reproduceTMask(const KMER::kmer& k, const bool sFlag);
 
         // filter the current hash table according to the given blacklist
-        // overwrites the internal kmerTable and strandTable structure, as well as tabIndex
+        // overwrites the internal kmerTable structure, as well as tabIndex
         //
         void filterHashTable();
         // filter hash table such that k-mers that occur more then once per meta CpG are deleted
         void filterRedundancyInHashTable();
+        // removes kmers from kmerTable in parallel and updates tabIndex accordingly
+        // filterCell(cellStart, cellEnd, out) is called for every cell of the hash table and
+        // copies the kept kmers of kmerTable[cellStart, cellEnd) to kmerTable[out, ...), returning the new out
+        template<typename F>
+        void compactHashTable(F& filterCell);
 
+        // put kmer k with hash value hVal into kmerTable (thread safe)
+        // the strand flag is kept inside the kmer (see STRANDBIT in RefGenome.cpp)
+        inline void insertKmer(const uint64_t hVal, const KMER::kmer k, const bool isFwd);
+        // restores the order of kmers in each cell that a sequential fill of the table would produce
+        void sortKmerCells();
 
 
-        // table of all CpGs in reference genome
-        std::vector<struct CpG> cpgTable;
-        std::vector<struct CpG> cpgStartTable;
 
-        // full sequence
-        std::vector<std::vector<char> > fullSeq;
+        // table of all CpGs in reference genome
+        MappedArray<struct CpG> cpgTable;
+        MappedArray<struct CpG> cpgStartTable;
+
+        // full sequence, 2 bit encoded
+        std::vector<PackedSeq> fullSeq;
+        // records of buildWindowRecords, winRecOffsets[w] is the first word of the record of window w after
+        // winRecBase, the cache line aligned start of winRecData
+        std::vector<uint64_t> winRecData;
+        const uint64_t* winRecBase;
+        std::vector<uint64_t> winRecOffsets;
+        // window lists of buildHotBuckets: first entry of each hot bucket in kmerTableSmall in ascending order, the
+        // start of its list in hotData (one more for the end of the last) and the size of the smallest hot bucket
+        // (the largest number if there is none)
+        std::vector<uint64_t> hotStarts;
+        std::vector<uint64_t> hotOffsets;
+        std::vector<uint8_t> hotData;
+        uint64_t hotMinSize;
+        // letters of a record, counted from the window start rounded down to a multiple of 64, such that the words
+        // of a record are whole words of fullSeq; they cover reads of READLEN with the largest error budget ending in
+        // the window and the letters shift and verifies for it (see ReadQueue::scanRange), as well as the call
+        // positions of the CpGs of the window
+        static constexpr int64_t WINRECBEFORE = (MyConst::READLEN + MyConst::ERRBUDGETS.back() + 63) / 64 * 64;
+        static constexpr int64_t WINRECAFTER = (MyConst::WINLEN + MyConst::READLEN + 63 + MyConst::ERRBUDGETS.back() + 63) / 64 * 64;
+        static constexpr size_t WINRECLETTERS = WINRECBEFORE + WINRECAFTER;
+        static constexpr size_t WINRECSEQWORDS = WINRECLETTERS / 32;
+        // words of the N flags and of the CpG bitmap each
+        static constexpr size_t WINRECMASKWORDS = WINRECLETTERS / 64;
+        // words of the 16 bit ranks of the CpG bitmap, CpGs before each of its words and in total
+        static constexpr size_t WINRECRANKWORDS = (WINRECMASKWORDS + 1 + 3) / 4;
+        // non CpG sites (see buildContextSites), empty unless requested
+        // ctxSites[ctxStart[c], ctxStart[c + 1]) are the positions of the sites of sequence c in fullSeq[c] in
+        // ascending order, ctxTypes their CTXTYPE flags
+        std::vector<uint32_t> ctxSites;
+        std::vector<uint8_t> ctxTypes;
+        std::vector<uint64_t> ctxStart;
 
         // hash table
         // tabIndex [i] points into kmerTable where the first entry with hash value i is saved
-        // kmerTable holds the kmer (i.e. MetaCpg index and offset)
-        // strandTable hold the strand orientation of the corresponding kmer (true iff forward)
-        std::vector<uint64_t> tabIndex;
-        std::vector<KMER::kmer> kmerTable;
-        std::vector<KMER_S::kmer> kmerTableSmall;
-        std::vector<bool> strandTable;
+        // kmerTable holds the kmer (i.e. MetaCpg index and offset) with its strand flag while building the index,
+        // kmerTableSmall holds the kmers of a loaded index with the strand inline
+        MappedArray<uint64_t> tabIndex;
+        // number of cells of the hash table, a power of two chosen from the number of k-mers of the genome
+        // (at most MyConst::HTABSIZE), keys are the hash values masked with htabMask
+        uint64_t htabSize;
+        uint64_t htabMask;
+        // first cell of the current pass of buildInPasses, tabIndex and htabSize only cover the cells of the pass
+        uint64_t cellBase;
+        // bucket directory of a loaded index, the compressed form of tabIndex (see INDEX::TABBLOCKBITS)
+        MappedArray<uint32_t> tabOffsets;
+        MappedArray<uint64_t> tabBlocks;
+        MappedArray<KMER::kmer> kmerTable;
+        MappedArray<KMER_S::kmer> kmerTableSmall;
+        // optional, offset of the first letter of kmerTableSmall[i] in its window (forward strand coordinates also
+        // for reverse strand k-mers), lets the seeds of a read predict where it is placed inside a window
+        MappedArray<uint16_t> kmerOffsets;
+        // optional, fingerprint of kmerTableSmall[i] (see kmerPrint): the bucket of a k-mer only depends on the lower
+        // bits of its hash, such that a bucket also holds the entries of unrelated k-mers; seeding skips the entries
+        // whose fingerprint differs from the one of the read k-mer before they count as hits of their window
+        MappedArray<uint8_t> kmerPrints;
         //
         // meta CpG table
         std::vector<struct metaCpG> metaCpGs;
         std::vector<struct metaCpG> metaStartCpGs;
 
-		std::vector<metaWindow> metaWindows;
+		MappedArray<metaWindow> metaWindows;
 
         struct KmerHash
         {
@@ -220,11 +674,100 @@ class RefGenome
                 return static_cast<size_t>(k);
             }
         };
-        // contains all kmers discarded during filterHashTable
-        std::unordered_set<uint64_t, KmerHash> filteredKmers;
+        // contains all kmers discarded during filterHashTable, sorted
+        MappedArray<uint64_t> filteredKmers;
+        // Bloom filter over filteredKmers with two bits per k-mer in one word, about 16 bits per k-mer such that
+        // it stays in cache (see isFiltered)
+        std::vector<uint64_t> filteredBloom;
+        uint64_t filteredBloomMask;
+        static constexpr uint64_t BLOOMMULT = 0x9e3779b97f4a7c15ULL;
+        // reduced alphabet letter code of the k-mers in filteredKmers, C and T are the same letter
+        static inline uint64_t reducedCode(const char c)
+        {
+            return (c == 'C' || c == 'T') ? 3 : (c == 'G' ? 2 : 0);
+        }
+        // true iff the seed masked k-mer kSeq (reduced alphabet as above) is an open syncmer: the smallest of its
+        // s-mers of length SYNCLEN, compared by a multiplicative hash, starts at SYNCPOS (first one on ties)
+        // the mask makes the choice depend on the seed letters only, as a seed hit does
+        static inline bool isSyncmer(const uint64_t kSeq)
+        {
+            constexpr unsigned int smerNum = MyConst::KMERLEN - MyConst::SYNCLEN + 1;
+            constexpr uint64_t smerMask = MyConst::SYNCLEN == 32 ? 0xffffffffffffffffULL : (1ULL << (2 * MyConst::SYNCLEN)) - 1;
+            uint64_t minHash = 0xffffffffffffffffULL;
+            unsigned int minPos = 0;
+            for (unsigned int j = 0; j < smerNum; ++j)
+            {
+                const uint64_t h = (((kSeq >> (2 * (smerNum - 1 - j))) & smerMask) + 1) * BLOOMMULT;
+                if (h < minHash)
+                {
+                    minHash = h;
+                    minPos = j;
+                }
+            }
+            return minPos == MyConst::SYNCPOS;
+        }
+        // key of the k-mer kSeq (reduced alphabet as above) hashed with seed s in the blacklist: the seed masked
+        // k-mer with the tag of the seed (see MyConst::SEEDTAGS)
+        static inline uint64_t seedKey(const uint64_t kSeq, const unsigned int s)
+        {
+            return (kSeq & MyConst::SEEDLETTERMASKS[s]) | MyConst::SEEDTAGS[s];
+        }
+        // fingerprint of the k-mer with blacklist key key (see seedKey) in kmerPrints, the upper bits of a
+        // multiplicative hash, independent of the spaced seed ntHash that picks the bucket
+        static inline uint8_t kmerPrint(const uint64_t key)
+        {
+            return (key * 0x9e3779b97f4a7c15ULL) >> 56;
+        }
+        // bucket key of blacklisted k-mers in getSeedBuckets, larger than any key of the table
+        static constexpr uint64_t FILTEREDKEY = 0xffffffffffffffffULL;
+        // smallest cutoff a load may apply to the index being built, 0 if it is filtered while it is built
+        uint32_t deferCutoff;
+        // k-mer cutoff the hash table is filtered with, KMERCUTOFF unless a deferred index was loaded
+        uint64_t kmerCutoff;
+        // tables of a loaded deferred index as stored, viewing the index file, which applyKmerCutoff filters:
+        // the unfiltered hash table, the occurrences of its k-mers in their buckets (saturated, 0 in buckets with
+        // fewer than minCutoff k-mers) and the k-mers with at least minCutoff occurrences with their occurrences;
+        // empty for other indexes
+        struct {
+            MappedArray<uint32_t> tabOffsets;
+            MappedArray<uint64_t> tabBlocks;
+            MappedArray<KMER_S::kmer> kmers;
+            MappedArray<uint16_t> kmerOffsets;
+            MappedArray<uint8_t> kmerPrints;
+            MappedArray<uint16_t> counts;
+            MappedArray<uint64_t> candidates;
+            MappedArray<uint16_t> candCounts;
+            uint64_t minCutoff;
+        } unfiltered;
+        // SYNCLEN if only the syncmers of the genome are hashed, 0 if every SKIPMOD-th k-mer (see MyConst::SYNCLEN)
+        uint32_t syncLen;
+        // number of seeds of MyConst::SEEDSET the k-mers are hashed with, 1 or SEEDNUM
+        uint32_t seedNum;
 
 		// mapping of internal chromosome id to external string identifier from fasta
-		std::unordered_map<uint8_t, std::string> chrMap;
+		std::unordered_map<chromId, std::string> chrMap;
+		// position of the first letter of each sequence in its chromosome, nonzero only for the target regions
+		// of a targeted index (see readTargets), added to all reported positions
+		MappedArray<uint32_t> chrOffsets;
+		// genome tags and genome of every sequence of a combined index (see setGenomes), both empty otherwise
+		std::vector<std::string> genomeTags;
+		MappedArray<uint8_t> chrGenome;
+
+		// memory mapped index file, nullptr if index was built in this process
+		void* indexMap;
+		size_t indexMapLen;
+		// anonymous mapping holding the tables copied by copyTables, nullptr if not used
+		void* hugeMap;
+		size_t hugeMapLen;
+		HUGEPAGES hugeMode;
+		size_t hugeBytes;
+		size_t numaNodes;
+		// background thread of warmUp, joined when the index is released
+		std::thread warmer;
+		std::atomic<bool> warmStop{false};
+		// bytes faulted in by warmUp so far and its runtime in ms, -1 until it is done
+		std::atomic<uint64_t> warmBytes{0};
+		std::atomic<int64_t> warmMillis{-1};
 
 };
 
@@ -16,182 +16,389 @@
 //
 //	Jonas Fischer	jonaspost@web.de
 
-#include <fstream>
 #include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <unordered_set>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #include "RefReader_istr.h"
 
 
-void readReference(const std::string& filename, std::vector<struct CpG>& cpgTab, std::vector<struct CpG>& cpgStartTab, std::vector<std::vector<char> >& genSeq, std::unordered_map<uint8_t, std::string>& chrMap, const bool humanOptFlag)
+void readReference(const std::string& filename, std::vector<struct CpG>& cpgTab, std::vector<struct CpG>& cpgStartTab, std::vector<std::vector<char> >& genSeq, std::unordered_map<chromId, std::string>& chrMap, std::vector<uint32_t>& chrOffsets, const bool humanOptFlag, const regionMap& targets, const uint32_t rrbsMin, const uint32_t rrbsMax, const uint32_t fragPad, const std::string& chrPrefix)
 {
 
-    std::string line;
-
-    // stores the sequence of each chromosome
-    std::vector<char> seq;
-
     genSeq.reserve(MyConst::CHROMNUM);
-    seq.reserve(MyConst::CHROMMAX);
     cpgTab.reserve(MyConst::CPGMAX);
 
-    // stores the chromosome index we are currently reading
-    uint8_t chrIndex = 0;
-
-    // flag stating if we currently read a real chromosome assembly
-    bool contFlag = false;
-    // flag stating if the last character read in the previous line was a c
-    bool lastC = false;
-
-    std::ifstream ifs (filename);
+    // stores the chromosome index we are currently reading, following the sequences read before
+    uint64_t chrIndex = genSeq.size();
+    // registers the next sequence, offset is the position of its first letter in the named chromosome
+    auto addSequence = [&](const std::string& chrID, const uint32_t offset)
+    {
+        if (chrIndex > std::numeric_limits<chromId>::max())
+        {
+            std::cerr << "Reference file " << filename << " holds more than " << std::numeric_limits<chromId>::max() + 1 << " sequences! Terminating...\n\n";
+            exit(1);
+        }
+        chrMap.insert(std::pair<chromId, std::string>(chrIndex, chrPrefix + chrID));
+        chrOffsets.push_back(offset);
+        return static_cast<chromId>(chrIndex++);
+    };
 
     std::cout << "Start reading reference file " << filename << std::endl;
 
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        std::cerr << "Could not open reference file " << filename << "! Terminating...\n\n";
+        exit(1);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        std::cerr << "Could not read reference file " << filename << "! Terminating...\n\n";
+        exit(1);
+    }
+    const size_t fileLen = st.st_size;
+    void* fileMap = fileLen > 0 ? mmap(nullptr, fileLen, PROT_READ, MAP_PRIVATE, fd, 0) : nullptr;
+    close(fd);
+    if (fileMap == MAP_FAILED)
+    {
+        std::cerr << "Could not map reference file " << filename << " into memory! Terminating...\n\n";
+        exit(1);
+    }
+    if (fileMap != nullptr)
+        madvise(fileMap, fileLen, MADV_SEQUENTIAL);
+    const char* data = static_cast<const char*>(fileMap);
+    const char* const fileEnd = data + fileLen;
+
 	uint32_t unIDCount = 1;
+    // identifiers used so far
+    std::unordered_set<std::string> chrIDs;
+    // identifier of the header line [line, lineEnd), renamed if it is not unique
+    auto getChrID = [&](const char* line, const char* lineEnd, std::string& chrHeader)
+    {
+        chrHeader.assign(line + 1, lineEnd);
+        std::string chrID(chrHeader, 0, chrHeader.find_first_of(" \t"));
+        if (chrIDs.count(chrID))
+        {
+            std::cout << "WARNING: Chromosome identifier " << chrID << " found in header\n" <<
+                chrHeader << "\nis not unique.";
+            chrID.append("_");
+            chrID.append(std::to_string(unIDCount++));
+            std::cout << "Renaming to " << chrID << "\n";
+        }
+        return chrID;
+    };
 
-    while (getline(ifs, line)) {
+    // a header line starts with '>' followed by at least one character
+    auto isHeader = [&](const char* line)
+    {
+        return *line == '>' && (line == data || line[-1] == '\n') && line + 1 < fileEnd && line[1] != '\n';
+    };
+    const char* header = data;
+    while (header < fileEnd && !isHeader(header))
+    {
+        header = static_cast<const char*>(memchr(header + 1, '>', fileEnd - header - 1));
+        if (header == nullptr)
+            header = fileEnd;
+    }
 
-        // Test for id tag line
-        if (line.begin() != line.end() && *(line.begin()) == '>' && (line.begin() + 1) != line.end())
-        {
+    while (header < fileEnd)
+    {
 
-            // if we read primary assembly previously, write it to vectors
-            if (contFlag)
+        const char* lineEnd = static_cast<const char*>(memchr(header, '\n', fileEnd - header));
+        if (lineEnd == nullptr)
+            lineEnd = fileEnd;
+        // the sequence lines of the record up to the next header line
+        const char* body = std::min(lineEnd + 1, fileEnd);
+        const char* next = body;
+        do
+        {
+            next = static_cast<const char*>(memchr(next, '>', fileEnd - next));
+            if (next == nullptr)
+                next = fileEnd;
+            else if (!isHeader(next))
+                ++next;
+            else
+                break;
+        } while (next < fileEnd);
+
+        // decide if the record is read
+        std::string chrHeader;
+        std::string chrID;
+        bool contFlag = false;
+        if (humanOptFlag)
+        {
+            // check if primary assembly
+            // (GRCH versions)
+            if (header[1] == 'C' || (header[1] == 'N' && header + 2 < fileEnd && header[2] == 'C'))
             {
 
-                seq.shrink_to_fit();
-                genSeq.emplace_back(move(seq));
-                // reset buffer
-                seq = std::vector<char>();
-                seq.reserve(MyConst::CHROMMAX);
-                // reset flag for last c
-                lastC = false;
+                chrID = getChrID(header, lineEnd, chrHeader);
+                contFlag = true;
 
-            }
-			if (humanOptFlag)
-			{
-				// check if primary assembly
-				// (GRCH versions)
-				if (*(line.begin() + 1) == 'C' || (*(line.begin() + 1) == 'N' && *(line.begin() + 2) == 'C'))
-				{
-
-					++chrIndex;
-					std::string chrHeader (line.begin() + 1, line.end());
-					uint32_t pos = chrHeader.find_first_of(" \t");
-					std::string chrID(chrHeader, 0, pos);
-					for (const auto chrP : chrMap)
-					{
-						if (chrP.second == chrID)
-						{
-							std::cout << "WARNING: Chromosome identifier " << chrID << " found in header\n" <<
-								chrHeader << "\nis not unique.";
-							chrID.append("_");
-							chrID.append(std::to_string(unIDCount++));
-							std::cout << "Renaming to " << chrID << "\n";
-							break;
-						}
-					}
-					chrMap.insert(std::pair<uint8_t,std::string>(chrIndex - 1, chrID));
-					contFlag = true;
-					continue;
-
-				// throw out unlocalized contigs
-				// (hg versions)
-				} else if ( *(line.begin() + 1) == 'c')
-				{
-
-					++chrIndex;
-					std::string chrHeader (line.begin() + 1, line.end());
-					uint32_t pos = chrHeader.find_first_of(" \t");
-					std::string chrID(chrHeader, 0, pos);
-					for (const auto chrP : chrMap)
-					{
-						if (chrP.second == chrID)
-						{
-							std::cout << "WARNING: Chromosome identifier " << chrID << " found in header\n" <<
-								chrHeader << "\nis not unique.";
-							chrID.append("_");
-							chrID.append(std::to_string(unIDCount++));
-							std::cout << "Renaming to " << chrID << "\n";
-							break;
-						}
-					}
-					// test if real primary assembly sequence
-					if (!isPrimaryHG(chrID))
-					{
-						--chrIndex;
-						contFlag = false;
-						continue;
-					}
-					chrMap.insert(std::pair<uint8_t,std::string>(chrIndex - 1, chrID));
-					contFlag = true;
-					continue;
-
-				} else {
-					contFlag = false;
-				}
-            } else {
-
-				++chrIndex;
-				if (chrIndex > MyConst::CHROMNUM)
-				{
-					std::cout << "\nWARNING: Number of read chromosomes and number of specified chromosomes the organism should have do not match!\n"
-						<< "Maybe the reference genome contains unlocalized contigs. You should consider removing them from the reference fasta.\n"
-						<< "For the human reference genome GRCH and HG versions, use \"--human_opt\" to mitigate this problem.\n";
-				}
-				std::string chrHeader (line.begin() + 1, line.end());
-				uint32_t pos = chrHeader.find_first_of(" \t");
-				std::string chrID(chrHeader, 0, pos);
-				for (const auto chrP : chrMap)
-				{
-					if (chrP.second == chrID)
-					{
-						std::cout << "WARNING: Chromosome identifier " << chrID << " found in header\n" <<
-							chrHeader << "\nis not unique.";
-						chrID.append("_");
-						chrID.append(std::to_string(unIDCount++));
-						std::cout << "Renaming to " << chrID << "\n";
-						break;
-					}
-				}
-				std::cout << chrHeader << "\n" << chrID << "\n\n";
-				chrMap.insert(std::pair<uint8_t,std::string>(chrIndex - 1, chrID));
-				contFlag = true;
-				continue;
+            // throw out unlocalized contigs
+            // (hg versions)
+            } else if (header[1] == 'c')
+            {
 
+                chrID = getChrID(header, lineEnd, chrHeader);
+                // test if real primary assembly sequence
+                contFlag = isPrimaryHG(chrID);
             }
+        } else {
 
+            chrID = getChrID(header, lineEnd, chrHeader);
+            std::cout << chrHeader << "\n" << chrID << "\n\n";
+            contFlag = true;
         }
 
         // check if we are in real primary chromosome assembly
         if (contFlag)
         {
+            chrIDs.insert(chrID);
+            if (targets.empty() && rrbsMax == 0)
+            {
+                genSeq.emplace_back();
+                readRecord(body, next, chrID, genSeq.back());
+                appendCpGs(genSeq.back(), addSequence(chrID, 0), cpgTab, cpgStartTab);
 
-            // parse the line
-            readLine(line, lastC, chrIndex, cpgTab, cpgStartTab, seq);
+            // a targeted (or RRBS) index keeps only the (padded) target regions (or MspI fragments) of the record,
+            // each as a sequence of its own
+            } else if (rrbsMax > 0 || targets.count(chrID))
+            {
+                std::vector<char> seq;
+                readRecord(body, next, chrID, seq);
+                std::vector<std::pair<uint32_t, uint32_t> > fragments;
+                if (rrbsMax > 0)
+                    fragments = mspiFragments(seq, rrbsMin, rrbsMax, fragPad);
+                for (const std::pair<uint32_t, uint32_t>& region : rrbsMax > 0 ? fragments : targets.at(chrID))
+                {
+                    if (region.first >= seq.size())
+                        break;
+                    genSeq.emplace_back(seq.begin() + region.first, seq.begin() + std::min<size_t>(region.second, seq.size()));
+                    appendCpGs(genSeq.back(), addSequence(chrID, region.first), cpgTab, cpgStartTab);
+                }
+            }
+        }
+        header = next;
+    }
 
-        } else {
+    if (fileMap != nullptr)
+        munmap(fileMap, fileLen);
 
-            continue;
-        }
+    for (const auto& chrTargets : targets)
+    {
+        if (!chrIDs.count(chrTargets.first))
+            std::cout << "WARNING: Target regions on " << chrTargets.first << " are skipped, the reference has no such sequence.\n";
+    }
+    if ((!targets.empty() || rrbsMax > 0) && genSeq.empty())
+    {
+        std::cerr << "No target region (or MspI fragment) lies on a sequence of reference file " << filename << "! Terminating...\n\n";
+        exit(1);
+    }
+    if (rrbsMax > 0)
+        std::cout << "Kept " << genSeq.size() << " sequences of MspI fragments of " << rrbsMin << " to " << rrbsMax << " bp (padded by " << fragPad << " bp)\n";
+
+    cpgTab.shrink_to_fit();
+    genSeq.shrink_to_fit();
+
+    std::cout << "Done reading reference file" << std::endl;
+
+}
+
+void readRecord(const char* body, const char* bodyEnd, const std::string& chrID, std::vector<char>& seq)
+{
+
+    // letters in each block of the record, then their offsets in seq
+    const size_t blocks = (bodyEnd - body + REFBLOCK - 1) / REFBLOCK;
+    std::vector<size_t> blockOff(blocks + 1, 0);
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(CORENUM) schedule(static)
+#endif
+    for (size_t b = 0; b < blocks; ++b)
+    {
+        const char* start = body + b * REFBLOCK;
+        const size_t len = std::min(REFBLOCK, static_cast<size_t>(bodyEnd - start));
+        size_t newlines = 0;
+        for (size_t i = 0; i < len; ++i)
+            newlines += start[i] == '\n';
+        blockOff[b + 1] = len - newlines;
+    }
+    for (size_t b = 0; b < blocks; ++b)
+        blockOff[b + 1] += blockOff[b];
 
+    // positions inside a chromosome are 32 bit
+    if (blockOff[blocks] > std::numeric_limits<uint32_t>::max())
+    {
+        std::cerr << "Reference sequence " << chrID << " is longer than " << std::numeric_limits<uint32_t>::max() << " bp! Terminating...\n\n";
+        exit(1);
+    }
+    seq.resize(blockOff[blocks]);
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(CORENUM) schedule(static)
+#endif
+    for (size_t b = 0; b < blocks; ++b)
+    {
+        const char* line = body + b * REFBLOCK;
+        const char* end = line + std::min(REFBLOCK, static_cast<size_t>(bodyEnd - line));
+        char* out = seq.data() + blockOff[b];
+        while (line < end)
+        {
+            const char* lineEnd = static_cast<const char*>(memchr(line, '\n', end - line));
+            if (lineEnd == nullptr)
+                lineEnd = end;
+            const size_t len = lineEnd - line;
+            for (size_t i = 0; i < len; ++i)
+                out[i] = refLetter(line[i]);
+            out += len;
+            line = lineEnd + 1;
+        }
+    }
+}
 
+void appendCpGs(const std::vector<char>& seq, const chromId chrIndex, std::vector<struct CpG>& cpgTab, std::vector<struct CpG>& cpgStartTab)
+{
 
+    // CpGs, C at position c and G at c + 1, collected per block of positions in the order of the sequence
+    const size_t cpgPositions = seq.empty() ? 0 : seq.size() - 1;
+    const size_t cpgBlocks = (cpgPositions + REFBLOCK - 1) / REFBLOCK;
+    std::vector<std::vector<uint32_t> > blockCpGs(cpgBlocks);
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(CORENUM) schedule(static)
+#endif
+    for (size_t b = 0; b < cpgBlocks; ++b)
+    {
+        const size_t end = std::min((b + 1) * REFBLOCK, cpgPositions);
+        for (size_t i = b * REFBLOCK; i < end; i += 64)
+        {
+            // bit j is set iff there is a CpG at i + j
+            const size_t n = std::min(static_cast<size_t>(64), end - i);
+            const char* s = seq.data() + i;
+            uint64_t cpgs = 0;
+            for (size_t j = 0; j < n; ++j)
+                cpgs |= static_cast<uint64_t>(s[j] == 'C' && s[j + 1] == 'G') << j;
+            while (cpgs)
+            {
+                blockCpGs[b].push_back(i + __builtin_ctzll(cpgs));
+                cpgs &= cpgs - 1;
+            }
+        }
+    }
+    // convention of struct CpG: pos is c - READLEN + 2, or c for the CpGs at the start of the chromosome
+    // the padding of the CpGs is cleared, it is written to the index file
+    for (const std::vector<uint32_t>& cpgs : blockCpGs)
+    {
+        const auto startEnd = std::lower_bound(cpgs.begin(), cpgs.end(), MyConst::READLEN - 3);
+        size_t k = cpgStartTab.size();
+        cpgStartTab.resize(k + (startEnd - cpgs.begin()));
+        memset(cpgStartTab.data() + k, 0, (startEnd - cpgs.begin()) * sizeof(struct CpG));
+        for (auto it = cpgs.begin(); it != startEnd; ++it, ++k)
+        {
+            cpgStartTab[k].chrom = chrIndex;
+            cpgStartTab[k].pos = *it;
+        }
+        k = cpgTab.size();
+        cpgTab.resize(k + (cpgs.end() - startEnd));
+        memset(cpgTab.data() + k, 0, (cpgs.end() - startEnd) * sizeof(struct CpG));
+        for (auto it = startEnd; it != cpgs.end(); ++it, ++k)
+        {
+            cpgTab[k].chrom = chrIndex;
+            cpgTab[k].pos = *it + 2 - MyConst::READLEN;
+        }
     }
+}
 
-    // if we read primary assembly previously, write it to vectors
-    if (contFlag)
+// merges overlapping and adjacent regions of the sorted regions
+static void mergeRegions(std::vector<std::pair<uint32_t, uint32_t> >& regions)
+{
+    if (regions.empty())
+        return;
+    size_t last = 0;
+    for (size_t i = 1; i < regions.size(); ++i)
     {
+        if (regions[i].first <= regions[last].second)
+            regions[last].second = std::max(regions[last].second, regions[i].second);
+        else
+            regions[++last] = regions[i];
+    }
+    regions.resize(last + 1);
+}
+
+regionMap readTargets(const std::string& filename, const uint32_t pad)
+{
 
-        seq.shrink_to_fit();
-        genSeq.emplace_back(move(seq));
+    std::ifstream bed(filename);
+    if (!bed)
+    {
+        std::cerr << "Could not open target region file " << filename << "! Terminating...\n\n";
+        exit(1);
+    }
+    regionMap targets;
+    std::string line;
+    size_t lineNum = 0;
+    size_t regionNum = 0;
+    while (std::getline(bed, line))
+    {
+        ++lineNum;
+        if (line.empty() || line[0] == '#' || line.compare(0, 5, "track") == 0 || line.compare(0, 7, "browser") == 0)
+            continue;
+        std::istringstream fields(line);
+        std::string chrom;
+        uint64_t start;
+        uint64_t end;
+        if (!(fields >> chrom >> start >> end) || end <= start || end > std::numeric_limits<uint32_t>::max())
+        {
+            std::cerr << "Line " << lineNum << " of target region file " << filename << " is no valid BED region! Terminating...\n\n";
+            exit(1);
+        }
+        start = start > pad ? start - pad : 0;
+        end = std::min<uint64_t>(end + pad, std::numeric_limits<uint32_t>::max());
+        targets[chrom].emplace_back(start, end);
+        ++regionNum;
     }
 
-    cpgTab.shrink_to_fit();
-    genSeq.shrink_to_fit();
-    ifs.close();
+    size_t mergedNum = 0;
+    for (auto& chrTargets : targets)
+    {
+        std::sort(chrTargets.second.begin(), chrTargets.second.end());
+        mergeRegions(chrTargets.second);
+        mergedNum += chrTargets.second.size();
+    }
+    std::cout << "Read " << regionNum << " target regions from " << filename << ", " << mergedNum << " regions after padding by " << pad << " bp and merging\n";
+    return targets;
+}
 
-    std::cout << "Done reading reference file" << std::endl;
+std::vector<std::pair<uint32_t, uint32_t> > mspiFragments(const std::vector<char>& seq, const uint32_t minLen, const uint32_t maxLen, const uint32_t pad)
+{
 
+    std::vector<std::pair<uint32_t, uint32_t> > fragments;
+    // MspI cuts C^CGG, the fragment of two consecutive cuts starts with CGG
+    uint64_t prevCut = 0;
+    bool hasCut = false;
+    for (size_t i = 0; i + 3 < seq.size(); ++i)
+    {
+        if (seq[i] != 'C' || seq[i + 1] != 'C' || seq[i + 2] != 'G' || seq[i + 3] != 'G')
+            continue;
+        const uint64_t cut = i + 1;
+        if (hasCut && cut - prevCut >= minLen && cut - prevCut <= maxLen)
+            fragments.emplace_back(prevCut > pad ? prevCut - pad : 0, std::min<uint64_t>(cut + pad, seq.size()));
+        prevCut = cut;
+        hasCut = true;
+    }
+    mergeRegions(fragments);
+    return fragments;
 }
 
 bool isPrimaryHG(std::string chrID)
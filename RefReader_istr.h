@@ -22,95 +22,55 @@
 #include <vector>
 #include <string>
 #include <unordered_map>
+#include <utility>
+#include <cstdint>
 
 #include <iostream> // for debugging
 
 #include "structs.h"
 #include "CONST.h"
 
+// target regions [start, end) per chromosome name, sorted and disjoint
+typedef std::unordered_map<std::string, std::vector<std::pair<uint32_t, uint32_t> > > regionMap;
+
 // read reference FASTA file from filename
 // produces a vector of all CpGs present in the genome written to cpgTab and cpgStartTab (the latter one is filled with those CpGs that are not READLEN away from the start)
 // IMPORTANT:
 //              cpg.pos for all CpGs in cpgStartTab will be the offset to the C in CpG!
 // produces sequence strings seperated by chromosome saved to genSeq, their length to genSeqLen
-//      underlying vectors should be empty on calling
-void readReference(const std::string& filename, std::vector<struct CpG>& cpgTab, std::vector<struct CpG>& cpgStartTab, std::vector<std::vector<char> >& genSeq, std::unordered_map<uint8_t,std::string>& chrMap, const bool humanOptFlag);
-
-// read a line of the reference, constructing possible CpGs, appending and counting the read characters
-//
-// Arguments:
-//              line        line to parse
-//              lastC       true if previous line encoding this sequence ended with a C
-//                          will be updated after the function call is finished
-//              chrIndex    index of the current chromosome (start counting from 1!)
-//              cpgTab      reference to where the CpGs should be saved (will be padded at the end)
-//              seq         sequence to which chars should be appended
-inline void readLine(std::string& line, bool& lastC, uint8_t chrIndex, std::vector<struct CpG>& cpgTab, std::vector<struct CpG>& cpgStartTab, std::vector<char>& seq)
+//      underlying vectors should be empty on calling, or hold the references read before by this function, whose
+//      sequences the ones of filename follow (e.g. the genomes of a combined index, see --genomes)
+// chrPrefix is put in front of the names of the sequences in chrMap, e.g. the tag of the genome
+// if targets is not empty, only the target regions are read, each as a sequence of its own named like its
+// chromosome, chrOffsets holds the position of the first letter of every sequence in its chromosome (0 otherwise)
+// if rrbsMax is not 0, the regions are the MspI fragments of rrbsMin to rrbsMax bp padded by fragPad (see mspiFragments)
+void readReference(const std::string& filename, std::vector<struct CpG>& cpgTab, std::vector<struct CpG>& cpgStartTab, std::vector<std::vector<char> >& genSeq, std::unordered_map<chromId, std::string>& chrMap, std::vector<uint32_t>& chrOffsets, const bool humanOptFlag, const regionMap& targets, const uint32_t rrbsMin, const uint32_t rrbsMax, const uint32_t fragPad, const std::string& chrPrefix);
+
+// reads the regions of the BED file filename, extended by pad bp on both sides, overlapping regions are merged
+regionMap readTargets(const std::string& filename, const uint32_t pad);
+
+// in silico MspI digest of seq for reduced representation libraries: the fragments between two consecutive
+// C^CGG sites with a length in [minLen, maxLen], extended by pad bp on both sides, overlapping fragments are merged
+// (the padding keeps the CpGs at the fragment starts out of the start CpGs, see readReference)
+std::vector<std::pair<uint32_t, uint32_t> > mspiFragments(const std::vector<char>& seq, const uint32_t minLen, const uint32_t maxLen, const uint32_t pad);
+
+// the FASTA file is mapped into memory, records are located with memchr and the sequence lines of each record are
+// converted by all threads in blocks of REFBLOCK bytes (see readRecord)
+constexpr size_t REFBLOCK = 1 << 22;
+
+// letter of the reference for the FASTA character c: upper case ACGT, N for everything else
+// (branch free, such that the loops converting whole lines are vectorized)
+inline char refLetter(const char c)
 {
+    const char u = c & 0xDF;
+    return (u == 'A' || u == 'C' || u == 'G' || u == 'T') ? u : 'N';
+}
 
-    chrIndex = chrIndex - 1;
-
-    // parse the line
-    // transform lower case to upper case, construct cpg objects and write unknowns as N
-    for (char& c : line)
-    {
-
-        switch (c)
-        {
-
-            case 'g':
-            case 'G':
-
-                // if previous letter was C, construct a CpG object
-                if (lastC)
-                {
-                    if (seq.size() >= (MyConst::READLEN - 2))
-                    {
-
-                        cpgTab.push_back({chrIndex, static_cast<uint32_t>(seq.size()) - MyConst::READLEN + 1});
-
-                    } else {
-
-                        cpgStartTab.push_back({chrIndex, static_cast<uint32_t>(seq.size()) - 1});
-						// TODO: fix this!!!!
-                    }
-                    lastC = false;
-                }
-                seq.emplace_back('G');
-                break;
-
-            case 'c':
-            case 'C':
-
-                seq.emplace_back('C');
-                lastC = true;
-                break;
-
-            case 'a':
-            case 'A':
-
-                seq.emplace_back('A');
-                lastC = false;
-                break;
-
-            case 't':
-            case 'T':
-
-                seq.emplace_back('T');
-                lastC = false;
-                break;
-
-            default:
-
-                seq.emplace_back('N');
-                lastC = false;
-                break;
-
-
-        }
-    }
+// converts the sequence lines in [body, bodyEnd) of the record chrID (newlines are dropped, see refLetter) into seq
+void readRecord(const char* body, const char* bodyEnd, const std::string& chrID, std::vector<char>& seq);
 
-}
+// appends the CpGs of seq, the sequence with index chrIndex (start counting from 0), to cpgTab resp. cpgStartTab
+void appendCpGs(const std::vector<char>& seq, const chromId chrIndex, std::vector<struct CpG>& cpgTab, std::vector<struct CpG>& cpgStartTab);
 
 // Arguments:
 // 				chrID	string containing chromosome ID (i.e. content after '>' id line in fasta)
@@ -0,0 +1,60 @@
+//	Metal - A fast methylation alignment and calling tool for WGBS data.
+//	Copyright (C) 2017  Jonas Fischer
+//
+//	This program is free software: you can redistribute it and/or modify
+//	it under the terms of the GNU General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+//
+//	This program is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//	GNU General Public License for more details.
+//
+//	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Jonas Fischer	jonaspost@web.de
+
+#ifndef SEQVIEW_H
+#define SEQVIEW_H
+
+#include <string>
+#include <cstddef>
+
+// View onto a sequence of characters stored elsewhere, e.g. in the arena of a ReadBatch
+// Provides the subset of the std::string interface used by the matching routines,
+// a std::string converts implicitly to a view onto its characters.
+// The viewed characters may be modified through the view.
+class SeqView
+{
+
+    public:
+
+        SeqView() : ptr(nullptr), len(0) {}
+        SeqView(char* p, const size_t n) : ptr(p), len(n) {}
+        SeqView(std::string& s) : ptr(&s[0]), len(s.size()) {}
+
+        inline size_t size() const { return len; }
+        inline bool empty() const { return len == 0; }
+
+        inline char& operator[](const size_t i) { return ptr[i]; }
+        inline const char& operator[](const size_t i) const { return ptr[i]; }
+
+        inline char* data() { return ptr; }
+        inline const char* data() const { return ptr; }
+
+        inline char* begin() { return ptr; }
+        inline char* end() { return ptr + len; }
+        inline const char* begin() const { return ptr; }
+        inline const char* end() const { return ptr + len; }
+
+        inline std::string str() const { return std::string(ptr, len); }
+
+    private:
+
+        char* ptr;
+        size_t len;
+};
+
+#endif /* SEQVIEW_H */
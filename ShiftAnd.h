@@ -23,21 +23,32 @@
 #include <array>
 #include <cstdint>
 #include <iostream>
+#include <algorithm>
 
 #include "CONST.h"
+#include "SeqView.h"
+
+// number of sequence slices queried at once by ShiftAnd::querySeqMulti/queryRevSeqMulti
+// 4 lanes of 64 bit fill an AVX2 register, the compiler maps the vector operations
+// to the widest vector unit that is available (-march=native)
+constexpr size_t SALANES = 4;
+typedef uint64_t saLaneVec __attribute__ ((vector_size (8 * SALANES)));
 
 // Implementation of the approximate shift and algorithm with maximum E errors allowed
-template<size_t E>
+// W is the number of 64 bit words per layer of states (see MyConst::SAWORDS), the hand unrolled updates
+// of the single automaton are specialized for the two word layers of reads up to 127 bp
+template<size_t E, size_t W = MyConst::SAWORDS>
 class ShiftAnd
 {
 
+    static_assert(W >= 1, "ShiftAnd needs at least one word per layer");
+
     // Internal representation of states
-    // one layer of states encoded by 128 bits (Note that our shift-and automata
-    // therefore represents at most 128-1 letters, first state is always active dummy state)
+    // one layer of states encoded by 64*W bits, word B[0] holds the lowest states (Note that our shift-and
+    // automata therefore represents at most 64*W-1 letters, first state is always active dummy state)
     struct states {
 
-        uint64_t B_0;
-        uint64_t B_1;
+        uint64_t B[W];
 
     };
     using bitMasks = struct states;
@@ -53,7 +64,13 @@ class ShiftAnd
         //              seq     sequence of characters for which the bitmasks should be
         //                      initialized
         //              lMap    array that maps letters to mask indices
-        ShiftAnd(std::string& seq, std::array<uint8_t, 16>& lMap);
+        ShiftAnd(const SeqView& seq, std::array<uint8_t, 16>& lMap);
+
+        // automaton without pattern, reload(...) has to be called before the first query
+        //
+        // ARGUMENTS:
+        //              lMap    array that maps letters to mask indices
+        explicit ShiftAnd(std::array<uint8_t, 16>& lMap);
 
         // -------------------
 
@@ -66,12 +83,63 @@ class ShiftAnd
         //              matches     will contain the matchings as offset relative to the start iterator (the end of the match)
         //              errors      same size as matches; will contain number of errors for each match
         //
-        inline void querySeq(std::vector<char>::iterator start, std::vector<char>::iterator end, std::vector<uint64_t>& matches, std::vector<uint8_t>& errors);
-        inline void queryRevSeq(std::vector<char>::iterator start, std::vector<char>::iterator end, std::vector<uint64_t>& matches, std::vector<uint8_t>& errors);
+        // It can be any random access iterator over chars (e.g. std::vector<char>::iterator or
+        // a pointer into the memory mapped reference sequence)
+        template<typename It>
+        inline void querySeq(It start, It end, std::vector<uint64_t>& matches, std::vector<uint8_t>& errors);
+        template<typename It>
+        inline void queryRevSeq(It start, It end, std::vector<uint64_t>& matches, std::vector<uint8_t>& errors);
+
+        // Query up to SALANES sequence slices to the automaton at once, one slice per vector lane
+        // Results are identical to calling querySeq/queryRevSeq on every slice on its own
+        //
+        // ARGUMENTS:
+        //              starts      start iterator for each slice (see querySeq/queryRevSeq)
+        //              ends        end iterator for each slice (see querySeq/queryRevSeq)
+        //              n           number of lanes used, the first n entries of the arrays are queried
+        //              matches     matches[l] will contain the matchings found in slice l
+        //              errors      errors[l] will contain the number of errors of matches[l]
+        //
+        template<typename It>
+        inline void querySeqMulti(const std::array<It, SALANES>& starts, const std::array<It, SALANES>& ends, const size_t n, std::array<std::vector<uint64_t>, SALANES>& matches, std::array<std::vector<uint8_t>, SALANES>& errors);
+        template<typename It>
+        inline void queryRevSeqMulti(const std::array<It, SALANES>& starts, const std::array<It, SALANES>& ends, const size_t n, std::array<std::vector<uint64_t>, SALANES>& matches, std::array<std::vector<uint8_t>, SALANES>& errors);
+
+        // Same as querySeqMulti/queryRevSeqMulti, but lane l runs its own automaton sas[l] (i.e. a different pattern),
+        // such that several reads can be verified against the same reference slice together
+        // Results are identical to calling sas[l]->querySeq/queryRevSeq on every slice on its own
+        //
+        // ARGUMENTS:
+        //              sas         automaton for each lane, the first n entries must be set
+        //              (others see querySeqMulti)
+        //
+        template<typename It>
+        static inline void querySeqMultiPattern(const std::array<ShiftAnd<E, W>*, SALANES>& sas, const std::array<It, SALANES>& starts, const std::array<It, SALANES>& ends, const size_t n, std::array<std::vector<uint64_t>, SALANES>& matches, std::array<std::vector<uint8_t>, SALANES>& errors);
+        template<typename It>
+        static inline void queryRevSeqMultiPattern(const std::array<ShiftAnd<E, W>*, SALANES>& sas, const std::array<It, SALANES>& starts, const std::array<It, SALANES>& ends, const size_t n, std::array<std::vector<uint64_t>, SALANES>& matches, std::array<std::vector<uint8_t>, SALANES>& errors);
+
+        // Same as querySeqMultiPattern, but every lane has its own direction: lane l is queried as by
+        // sas[l]->querySeq if isFwd[l] is set and as by sas[l]->queryRevSeq otherwise
+        // such that the windows of both strands (and of a read and its reverse complement) share one pass
+        template<typename It>
+        static inline void queryMixedMultiPattern(const std::array<ShiftAnd<E, W>*, SALANES>& sas, const std::array<It, SALANES>& starts, const std::array<It, SALANES>& ends, const std::array<bool, SALANES>& isFwd, const size_t n, std::array<std::vector<uint64_t>, SALANES>& matches, std::array<std::vector<uint8_t>, SALANES>& errors);
 
         // returns the size of the represented pattern sequence
         inline uint64_t size() { return pLen; }
 
+        // replace the pattern of the automaton by seq, only the bitmasks are rewritten
+        // such that one automaton can be reused for many reads
+        //
+        // ARGUMENTS:
+        //              seq     sequence of characters for which the bitmasks should be
+        //                      initialized
+        inline void reload(const SeqView& seq);
+
+        // restrict querySeqMulti/queryRevSeqMulti to matches with at most bound (<= E) errors,
+        // the error layers above bound are not updated, reload(...) restores bound E
+        inline void setErrorBound(const size_t bound) { errBound = std::min(bound, E); }
+        inline size_t errorBound() const { return errBound; }
+
 
         // TODO make this private once its tested
     // private:
@@ -100,10 +168,24 @@ class ShiftAnd
         inline bool isMatch(uint8_t& errNum);
 
         // load the bitmasks for the given sequences
-        inline void loadBitmasks(std::string& seq);
+        inline void loadBitmasks(const SeqView& seq);
+
+        // states of SALANES automata (same pattern) that are updated together
+        struct laneStates {
+
+            saLaneVec B[W];
+
+        };
+        // reset the automata of all lanes in rst (lanes with all bits set)
+        static inline void resetMulti(std::array<laneStates, E + 1>& act, const saLaneVec& rst);
+        // query one letter per lane, m[w] holds word w of the bitmask of the letter for each lane, layers above bound are skipped
+        static inline void queryLetterMulti(std::array<laneStates, E + 1>& act, const std::array<saLaneVec, W>& m, const size_t bound);
+        // update the list of matches of one lane after matchable letter, offset is the position reported for a match,
+        // bookkeeping as in querySeq
+        inline void recordMulti(const std::array<laneStates, E + 1>& act, const size_t l, const uint64_t offset, bool& wasMatch, uint8_t& prevErrs, std::vector<uint64_t>& matches, std::vector<uint8_t>& errors);
 
         // Bitvector data structure holding the set of active states indicated by a 1
-        // initial state is least significant bit of active[0].B_0 (dummy state),
+        // initial state is least significant bit of active[0].B[0] (dummy state),
         // different layers indicating the number of errors are indexed by the vector
         std::array<bitStates, E + 1> active;
 
@@ -114,7 +196,10 @@ class ShiftAnd
         bitMasks accepted;
 
         // length of the sequence that is represented by the automata
-        const uint64_t pLen;
+        uint64_t pLen;
+
+        // highest error layer updated by the multi lane queries (see setErrorBound)
+        size_t errBound;
 
 
         // maps characters 'A', 'C', 'G', 'T' to their index
@@ -124,17 +209,38 @@ class ShiftAnd
 };
 
 
-template<size_t E>
-ShiftAnd<E>::ShiftAnd(std::string& seq, std::array<uint8_t, 16>& lMap) :
+template<size_t E, size_t W>
+ShiftAnd<E, W>::ShiftAnd(const SeqView& seq, std::array<uint8_t, 16>& lMap) :
         pLen(seq.size())
+    ,   errBound(E)
+    ,   lmap(lMap)
+{
+    loadBitmasks(seq);
+}
+
+template<size_t E, size_t W>
+ShiftAnd<E, W>::ShiftAnd(std::array<uint8_t, 16>& lMap) :
+        active()
+    ,   masks()
+    ,   accepted()
+    ,   pLen(0)
+    ,   errBound(E)
     ,   lmap(lMap)
 {
+}
+
+template<size_t E, size_t W>
+inline void ShiftAnd<E, W>::reload(const SeqView& seq)
+{
+    pLen = seq.size();
+    errBound = E;
     loadBitmasks(seq);
 }
 
 
-template<size_t E>
-inline void ShiftAnd<E>::querySeq(std::vector<char>::iterator start, std::vector<char>::iterator end, std::vector<uint64_t>& matches, std::vector<uint8_t>& errors)
+template<size_t E, size_t W>
+template<typename It>
+inline void ShiftAnd<E, W>::querySeq(It start, It end, std::vector<uint64_t>& matches, std::vector<uint8_t>& errors)
 {
 
     reset();
@@ -189,8 +295,9 @@ inline void ShiftAnd<E>::querySeq(std::vector<char>::iterator start, std::vector
 }
 
 
-template<size_t E>
-inline void ShiftAnd<E>::queryRevSeq(std::vector<char>::iterator start, std::vector<char>::iterator end, std::vector<uint64_t>& matches, std::vector<uint8_t>& errors)
+template<size_t E, size_t W>
+template<typename It>
+inline void ShiftAnd<E, W>::queryRevSeq(It start, It end, std::vector<uint64_t>& matches, std::vector<uint8_t>& errors)
 {
 
     reset();
@@ -239,7 +346,6 @@ inline void ShiftAnd<E>::queryRevSeq(std::vector<char>::iterator start, std::vec
             {
                 if (errNum <= prevErrs)
                 {
-					// TODO make this safe for insertions!!
                     matches.back() = it - end + pLen - 2;
                     errors.back() = errNum;
                     prevErrs = errNum;
@@ -247,7 +353,8 @@ inline void ShiftAnd<E>::queryRevSeq(std::vector<char>::iterator start, std::vec
 
             } else {
 
-				// TODO make this safe for insertions!!
+                // the letter queried last is the leftmost one of the match and exact, reported shifted by pLen - 1
+                // (see reversePositionIndels of the unit tests for reads with indels)
                 matches.push_back(it - end + pLen - 2);
                 errors.push_back(errNum);
                 wasMatch = true;
@@ -262,155 +369,531 @@ inline void ShiftAnd<E>::queryRevSeq(std::vector<char>::iterator start, std::vec
 }
 
 
-template<size_t E>
-inline void ShiftAnd<E>::reset()
+template<size_t E, size_t W>
+template<typename It>
+inline void ShiftAnd<E, W>::querySeqMulti(const std::array<It, SALANES>& starts, const std::array<It, SALANES>& ends, const size_t n, std::array<std::vector<uint64_t>, SALANES>& matches, std::array<std::vector<uint8_t>, SALANES>& errors)
+{
+    std::array<ShiftAnd<E, W>*, SALANES> sas;
+    sas.fill(this);
+    querySeqMultiPattern(sas, starts, ends, n, matches, errors);
+}
+
+
+template<size_t E, size_t W>
+template<typename It>
+inline void ShiftAnd<E, W>::queryRevSeqMulti(const std::array<It, SALANES>& starts, const std::array<It, SALANES>& ends, const size_t n, std::array<std::vector<uint64_t>, SALANES>& matches, std::array<std::vector<uint8_t>, SALANES>& errors)
+{
+    std::array<ShiftAnd<E, W>*, SALANES> sas;
+    sas.fill(this);
+    queryRevSeqMultiPattern(sas, starts, ends, n, matches, errors);
+}
+
+
+template<size_t E, size_t W>
+template<typename It>
+inline void ShiftAnd<E, W>::querySeqMultiPattern(const std::array<ShiftAnd<E, W>*, SALANES>& sas, const std::array<It, SALANES>& starts, const std::array<It, SALANES>& ends, const size_t n, std::array<std::vector<uint64_t>, SALANES>& matches, std::array<std::vector<uint8_t>, SALANES>& errors)
+{
+
+    std::array<laneStates, E + 1> act;
+    const saLaneVec all = ~saLaneVec{};
+    resetMulti(act, all);
+
+    // layers up to the highest error bound of the lanes are updated, every lane records its matches up to its own bound
+    size_t bound = 0;
+    for (size_t l = 0; l < n; ++l)
+        bound = std::max(bound, sas[l]->errBound);
+
+    std::array<bool, SALANES> wasMatch;
+    std::array<uint8_t, SALANES> prevErrs;
+    std::array<size_t, SALANES> numCompLets;
+    std::array<size_t, SALANES> lens;
+    size_t maxLen = 0;
+    for (size_t l = 0; l < SALANES; ++l)
+    {
+        wasMatch[l] = false;
+        prevErrs[l] = MyConst::MISCOUNT + 1;
+        numCompLets[l] = 0;
+        lens[l] = (l < n && starts[l] < ends[l]) ? ends[l] - starts[l] : 0;
+        maxLen = std::max(maxLen, lens[l]);
+    }
+
+    for (size_t k = 0; k < maxLen; ++k)
+    {
+
+        std::array<saLaneVec, W> m = {};
+        saLaneVec rst = {};
+        for (size_t l = 0; l < SALANES; ++l)
+        {
+            if (k >= lens[l])
+                continue;
+            const char c = starts[l][k];
+            // we do not consider Ns for matches - restart whole automaton of this lane for next letter
+            if (c == 'N')
+            {
+                rst[l] = all[l];
+                continue;
+            }
+            const bitMasks& mask = sas[l]->masks[sas[l]->lmap[c%16]];
+            for (size_t w = 0; w < W; ++w)
+                m[w][l] = mask.B[w];
+        }
+        queryLetterMulti(act, m, bound);
+        resetMulti(act, rst);
+
+        for (size_t l = 0; l < SALANES; ++l)
+        {
+            if (k >= lens[l] || rst[l])
+                continue;
+
+            ++numCompLets[l];
+            // There can only be a match after at least this->size() - E many chars are queried so only then compare
+            if (numCompLets[l] < (sas[l]->pLen - E))
+                continue;
+
+            sas[l]->recordMulti(act, l, k, wasMatch[l], prevErrs[l], matches[l], errors[l]);
+        }
+    }
+}
+
+
+template<size_t E, size_t W>
+template<typename It>
+inline void ShiftAnd<E, W>::queryRevSeqMultiPattern(const std::array<ShiftAnd<E, W>*, SALANES>& sas, const std::array<It, SALANES>& starts, const std::array<It, SALANES>& ends, const size_t n, std::array<std::vector<uint64_t>, SALANES>& matches, std::array<std::vector<uint8_t>, SALANES>& errors)
+{
+
+    std::array<laneStates, E + 1> act;
+    const saLaneVec all = ~saLaneVec{};
+    resetMulti(act, all);
+
+    // layers up to the highest error bound of the lanes are updated, every lane records its matches up to its own bound
+    size_t bound = 0;
+    for (size_t l = 0; l < n; ++l)
+        bound = std::max(bound, sas[l]->errBound);
+
+    std::array<bool, SALANES> wasMatch;
+    std::array<uint8_t, SALANES> prevErrs;
+    std::array<size_t, SALANES> numCompLets;
+    std::array<size_t, SALANES> lens;
+    size_t maxLen = 0;
+    for (size_t l = 0; l < SALANES; ++l)
+    {
+        wasMatch[l] = false;
+        prevErrs[l] = MyConst::MISCOUNT + 1;
+        numCompLets[l] = 0;
+        lens[l] = (l < n && ends[l] < starts[l]) ? starts[l] - ends[l] : 0;
+        maxLen = std::max(maxLen, lens[l]);
+    }
+
+    for (size_t k = 0; k < maxLen; ++k)
+    {
+
+        std::array<saLaneVec, W> m = {};
+        saLaneVec rst = {};
+        for (size_t l = 0; l < SALANES; ++l)
+        {
+            if (k >= lens[l])
+                continue;
+            const auto it = starts[l] - k;
+            char c;
+            switch (*it)
+            {
+                case 'A':
+                    c = 'T';
+                    break;
+                case 'C':
+                    c = 'G';
+                    break;
+                case 'G':
+                    c = 'C';
+                    break;
+                case 'T':
+                    c = 'A';
+                    break;
+                // we do not consider Ns for matches - restart whole automaton of this lane for next letter
+                case 'N':
+                    rst[l] = all[l];
+                    continue;
+                default:
+                    std::cerr << "[ShiftAnd] Could not parse letter " << *it << " at offset " << it - ends[l] + 1 << "\nStopping program...\n\n";
+                    exit(1);
+            }
+            const bitMasks& mask = sas[l]->masks[sas[l]->lmap[c%16]];
+            for (size_t w = 0; w < W; ++w)
+                m[w][l] = mask.B[w];
+        }
+        queryLetterMulti(act, m, bound);
+        resetMulti(act, rst);
+
+        for (size_t l = 0; l < SALANES; ++l)
+        {
+            if (k >= lens[l] || rst[l])
+                continue;
+
+            ++numCompLets[l];
+            // There can only be a match after at least this->size() - E many chars are queried so only then compare
+            if (numCompLets[l] < (sas[l]->pLen - E))
+                continue;
+
+            // position as in queryRevSeq (it - end = lens[l] - k): the letter queried last is the leftmost one of the
+            // match and exact, shifted by pLen - 1; with indels in the read the right end of the match lies up to the
+            // number of errors off, which is left to the banded alignment of the methylation calling
+            sas[l]->recordMulti(act, l, lens[l] - k + sas[l]->pLen - 2, wasMatch[l], prevErrs[l], matches[l], errors[l]);
+        }
+    }
+}
+
+
+template<size_t E, size_t W>
+template<typename It>
+inline void ShiftAnd<E, W>::queryMixedMultiPattern(const std::array<ShiftAnd<E, W>*, SALANES>& sas, const std::array<It, SALANES>& starts, const std::array<It, SALANES>& ends, const std::array<bool, SALANES>& isFwd, const size_t n, std::array<std::vector<uint64_t>, SALANES>& matches, std::array<std::vector<uint8_t>, SALANES>& errors)
+{
+
+    std::array<laneStates, E + 1> act;
+    const saLaneVec all = ~saLaneVec{};
+    resetMulti(act, all);
+
+    // layers up to the highest error bound of the lanes are updated, every lane records its matches up to its own bound
+    size_t bound = 0;
+    for (size_t l = 0; l < n; ++l)
+        bound = std::max(bound, sas[l]->errBound);
+
+    std::array<bool, SALANES> wasMatch;
+    std::array<uint8_t, SALANES> prevErrs;
+    std::array<size_t, SALANES> numCompLets;
+    std::array<size_t, SALANES> lens;
+    size_t maxLen = 0;
+    for (size_t l = 0; l < SALANES; ++l)
+    {
+        wasMatch[l] = false;
+        prevErrs[l] = MyConst::MISCOUNT + 1;
+        numCompLets[l] = 0;
+        if (l >= n)
+            lens[l] = 0;
+        else if (isFwd[l])
+            lens[l] = starts[l] < ends[l] ? ends[l] - starts[l] : 0;
+        else
+            lens[l] = ends[l] < starts[l] ? starts[l] - ends[l] : 0;
+        maxLen = std::max(maxLen, lens[l]);
+    }
+
+    for (size_t k = 0; k < maxLen; ++k)
+    {
+
+        std::array<saLaneVec, W> m = {};
+        saLaneVec rst = {};
+        for (size_t l = 0; l < SALANES; ++l)
+        {
+            if (k >= lens[l])
+                continue;
+            char c;
+            if (isFwd[l])
+            {
+                c = starts[l][k];
+
+            } else {
+
+                // reverse lanes read the complement backwards
+                switch (*(starts[l] - k))
+                {
+                    case 'A':
+                        c = 'T';
+                        break;
+                    case 'C':
+                        c = 'G';
+                        break;
+                    case 'G':
+                        c = 'C';
+                        break;
+                    case 'T':
+                        c = 'A';
+                        break;
+                    default:
+                        c = 'N';
+                }
+            }
+            // we do not consider Ns for matches - restart whole automaton of this lane for next letter
+            if (c == 'N')
+            {
+                rst[l] = all[l];
+                continue;
+            }
+            const bitMasks& mask = sas[l]->masks[sas[l]->lmap[c%16]];
+            for (size_t w = 0; w < W; ++w)
+                m[w][l] = mask.B[w];
+        }
+        queryLetterMulti(act, m, bound);
+        resetMulti(act, rst);
+
+        for (size_t l = 0; l < SALANES; ++l)
+        {
+            if (k >= lens[l] || rst[l])
+                continue;
+
+            ++numCompLets[l];
+            // There can only be a match after at least this->size() - E many chars are queried so only then compare
+            if (numCompLets[l] < (sas[l]->pLen - E))
+                continue;
+
+            // reverse lanes report the position of queryRevSeqMultiPattern, which is exact at the left end of the match
+            sas[l]->recordMulti(act, l, isFwd[l] ? k : lens[l] - k + sas[l]->pLen - 2, wasMatch[l], prevErrs[l], matches[l], errors[l]);
+        }
+    }
+}
+
+
+template<size_t E, size_t W>
+inline void ShiftAnd<E, W>::resetMulti(std::array<laneStates, E + 1>& act, const saLaneVec& rst)
+{
+    for (size_t i = 0; i <= E; ++i)
+    {
+
+        // set all initial states (with respect to epsilon transitions) active
+        const saLaneVec init = saLaneVec{} + ((static_cast<uint64_t>(1) << (i+1)) - 1);
+        act[i].B[0] = (act[i].B[0] & ~rst) | (init & rst);
+        for (size_t w = 1; w < W; ++w)
+            act[i].B[w] = act[i].B[w] & ~rst;
+    }
+}
+
+
+template<size_t E, size_t W>
+inline void ShiftAnd<E, W>::queryLetterMulti(std::array<laneStates, E + 1>& act, const std::array<saLaneVec, W>& m, const size_t bound)
+{
+
+    // same updates as in queryLetter, for all lanes at once, layers above bound are skipped
+    // the words of a layer are updated from the highest one down, such that the carry comes from the old lower word
+    // (top is bound by E as well, such that the error layers vanish at compile time for E = 0)
+    const size_t top = std::min(bound, E);
+    //
+    // Bottom up update part for old values of previous iteration
+    for (size_t i = top; i > 0; --i)
+    {
+
+        for (size_t w = W - 1; w > 0; --w)
+            act[i].B[w] = ((act[i].B[w] << 1 | act[i].B[w-1] >> 63) & m[w]) | (act[i-1].B[w]) | (act[i-1].B[w] << 1 | act[i-1].B[w-1] >> 63);
+        act[i].B[0] = ((act[i].B[0] << 1 | 1) & m[0]) | (act[i-1].B[0]) | (act[i-1].B[0] << 1);
+
+    }
+    // update zero error layer (at the top)
+    for (size_t w = W - 1; w > 0; --w)
+        act[0].B[w] = ((act[0].B[w] << 1 | act[0].B[w-1] >> 63) & m[w]);
+    act[0].B[0] = ((act[0].B[0] << 1 | 1) & m[0]);
+
+    // Top down update for values of this iteration
+    for (size_t i = 1; i <= top; ++i)
+    {
+
+        for (size_t w = W - 1; w > 0; --w)
+            act[i].B[w] |= act[i-1].B[w] << 1 | act[i-1].B[w-1] >> 63;
+        act[i].B[0] |= act[i-1].B[0] << 1;
+
+    }
+}
+
+
+template<size_t E, size_t W>
+inline void ShiftAnd<E, W>::recordMulti(const std::array<laneStates, E + 1>& act, const size_t l, const uint64_t offset, bool& wasMatch, uint8_t& prevErrs, std::vector<uint64_t>& matches, std::vector<uint8_t>& errors)
+{
+
+    // true iff layer i of lane l is in an accepting state
+    auto accepts = [&](const size_t i)
+    {
+        uint64_t acc = 0;
+        for (size_t w = 0; w < W; ++w)
+            acc |= act[i].B[w][l] & accepted.B[w];
+        return acc != 0;
+    };
+    // the highest updated layer contains the states of all layers below, so test it first
+    if (!accepts(errBound))
+    {
+        wasMatch = false;
+        return;
+    }
+    uint8_t errNum = errBound;
+    for (size_t i = 0; i < errBound; ++i)
+    {
+        if (accepts(i))
+        {
+            errNum = i;
+            break;
+        }
+    }
+
+    // if we matched in previous round, overwrite that match
+    if (wasMatch)
+    {
+        if (errNum <= prevErrs)
+        {
+            matches.back() = offset;
+            errors.back() = errNum;
+            prevErrs = errNum;
+        }
+
+    } else {
+
+        matches.push_back(offset);
+        errors.push_back(errNum);
+        wasMatch = true;
+        prevErrs = errNum;
+    }
+}
+
+
+template<size_t E, size_t W>
+inline void ShiftAnd<E, W>::reset()
 {
     for (size_t i = 0; i <= E; ++i)
     {
 
         // set all initial states (with respect to epsilon transitions) active
-        active[i].B_0 = (static_cast<uint64_t>(1) << (i+1)) - 1;
-        active[i].B_1 = 0;
+        active[i].B[0] = (static_cast<uint64_t>(1) << (i+1)) - 1;
+        for (size_t w = 1; w < W; ++w)
+            active[i].B[w] = 0;
 
     }
 }
 template <>
-inline void ShiftAnd<0>::reset()
+inline void ShiftAnd<0, 2>::reset()
 {
-    active[0].B_0 = 1;
-    active[0].B_1 = 0;
+    active[0].B[0] = 1;
+    active[0].B[1] = 0;
 
 }
 template <>
-inline void ShiftAnd<1>::reset()
+inline void ShiftAnd<1, 2>::reset()
 {
-    active[0].B_0 = 1;
-    active[0].B_1 = 0;
-    active[1].B_0 = 3;
-    active[1].B_1 = 0;
+    active[0].B[0] = 1;
+    active[0].B[1] = 0;
+    active[1].B[0] = 3;
+    active[1].B[1] = 0;
 
 }
 template <>
-inline void ShiftAnd<2>::reset()
+inline void ShiftAnd<2, 2>::reset()
 {
-    active[0].B_0 = 1;
-    active[0].B_1 = 0;
-    active[1].B_0 = 3;
-    active[1].B_1 = 0;
-    active[2].B_0 = 7;
-    active[2].B_1 = 0;
+    active[0].B[0] = 1;
+    active[0].B[1] = 0;
+    active[1].B[0] = 3;
+    active[1].B[1] = 0;
+    active[2].B[0] = 7;
+    active[2].B[1] = 0;
 
 }
 template <>
-inline void ShiftAnd<3>::reset()
+inline void ShiftAnd<3, 2>::reset()
 {
-    active[0].B_0 = 1;
-    active[0].B_1 = 0;
-    active[1].B_0 = 3;
-    active[1].B_1 = 0;
-    active[2].B_0 = 7;
-    active[2].B_1 = 0;
-    active[3].B_0 = 15;
-    active[3].B_1 = 0;
+    active[0].B[0] = 1;
+    active[0].B[1] = 0;
+    active[1].B[0] = 3;
+    active[1].B[1] = 0;
+    active[2].B[0] = 7;
+    active[2].B[1] = 0;
+    active[3].B[0] = 15;
+    active[3].B[1] = 0;
 }
 template <>
-inline void ShiftAnd<4>::reset()
+inline void ShiftAnd<4, 2>::reset()
 {
-    active[0].B_0 = 1;
-    active[0].B_1 = 0;
-    active[1].B_0 = 3;
-    active[1].B_1 = 0;
-    active[2].B_0 = 7;
-    active[2].B_1 = 0;
-    active[3].B_0 = 15;
-    active[3].B_1 = 0;
-    active[4].B_0 = 31;
-    active[4].B_1 = 0;
+    active[0].B[0] = 1;
+    active[0].B[1] = 0;
+    active[1].B[0] = 3;
+    active[1].B[1] = 0;
+    active[2].B[0] = 7;
+    active[2].B[1] = 0;
+    active[3].B[0] = 15;
+    active[3].B[1] = 0;
+    active[4].B[0] = 31;
+    active[4].B[1] = 0;
 }
 template <>
-inline void ShiftAnd<5>::reset()
+inline void ShiftAnd<5, 2>::reset()
 {
-    active[0].B_0 = 1;
-    active[0].B_1 = 0;
-    active[1].B_0 = 3;
-    active[1].B_1 = 0;
-    active[2].B_0 = 7;
-    active[2].B_1 = 0;
-    active[3].B_0 = 15;
-    active[3].B_1 = 0;
-    active[4].B_0 = 31;
-    active[4].B_1 = 0;
-    active[5].B_0 = 63;
-    active[5].B_1 = 0;
+    active[0].B[0] = 1;
+    active[0].B[1] = 0;
+    active[1].B[0] = 3;
+    active[1].B[1] = 0;
+    active[2].B[0] = 7;
+    active[2].B[1] = 0;
+    active[3].B[0] = 15;
+    active[3].B[1] = 0;
+    active[4].B[0] = 31;
+    active[4].B[1] = 0;
+    active[5].B[0] = 63;
+    active[5].B[1] = 0;
 }
 template <>
-inline void ShiftAnd<6>::reset()
+inline void ShiftAnd<6, 2>::reset()
 {
-    active[0].B_0 = 1;
-    active[0].B_1 = 0;
-    active[1].B_0 = 3;
-    active[1].B_1 = 0;
-    active[2].B_0 = 7;
-    active[2].B_1 = 0;
-    active[3].B_0 = 15;
-    active[3].B_1 = 0;
-    active[4].B_0 = 31;
-    active[4].B_1 = 0;
-    active[5].B_0 = 63;
-    active[5].B_1 = 0;
-    active[6].B_0 = 127;
-    active[6].B_1 = 0;
+    active[0].B[0] = 1;
+    active[0].B[1] = 0;
+    active[1].B[0] = 3;
+    active[1].B[1] = 0;
+    active[2].B[0] = 7;
+    active[2].B[1] = 0;
+    active[3].B[0] = 15;
+    active[3].B[1] = 0;
+    active[4].B[0] = 31;
+    active[4].B[1] = 0;
+    active[5].B[0] = 63;
+    active[5].B[1] = 0;
+    active[6].B[0] = 127;
+    active[6].B[1] = 0;
 }
 
 
-template<size_t E>
-inline void ShiftAnd<E>::queryLetter(const char& c)
+template<size_t E, size_t W>
+inline void ShiftAnd<E, W>::queryLetter(const char& c)
 {
 
     const bitMasks& mask = masks[lmap[c%16]];
 
+    // the words of a layer are updated from the highest one down, such that the carry comes from the old lower word
+    //
     // Bottom up update part for old values of previous iteration
     for (size_t i = E; i > 0; --i)
     {
 
-        // Update second part of pattern states
+        // Update upper parts of pattern states
         //
-        //                                  Match                                       Insertion                       Substitution
-        active[i].B_1 = ((active[i].B_1 << 1 | active[i].B_0 >> 63) & mask.B_1) | (active[i-1].B_1) | (active[i-1].B_1 << 1 | active[i-1].B_0 >> 63);
+        //                                  Match                                                   Insertion                       Substitution
+        for (size_t w = W - 1; w > 0; --w)
+            active[i].B[w] = ((active[i].B[w] << 1 | active[i].B[w-1] >> 63) & mask.B[w]) | (active[i-1].B[w]) | (active[i-1].B[w] << 1 | active[i-1].B[w-1] >> 63);
 
         // Update first part of pattern states
         //
-        //                          Match                           Insertion               Substitution
-        active[i].B_0 = ((active[i].B_0 << 1 | 1) & mask.B_0) | (active[i-1].B_0) | (active[i-1].B_0 << 1);
+        //                          Match                               Insertion               Substitution
+        active[i].B[0] = ((active[i].B[0] << 1 | 1) & mask.B[0]) | (active[i-1].B[0]) | (active[i-1].B[0] << 1);
 
     }
     // update zero error layer (at the top)
-    active[0].B_1 = ((active[0].B_1 << 1 | active[0].B_0 >> 63) & mask.B_1);
-    active[0].B_0 = ((active[0].B_0 << 1 | 1) & mask.B_0);
+    for (size_t w = W - 1; w > 0; --w)
+        active[0].B[w] = ((active[0].B[w] << 1 | active[0].B[w-1] >> 63) & mask.B[w]);
+    active[0].B[0] = ((active[0].B[0] << 1 | 1) & mask.B[0]);
     //
     // Top down update for values of this iteration
     for (size_t i = 1; i <= E; ++i)
     {
 
-        active[i].B_1 |= active[i-1].B_1 << 1 | active[i-1].B_0 >> 63;
-        active[i].B_0 |= active[i-1].B_0 << 1;
+        for (size_t w = W - 1; w > 0; --w)
+            active[i].B[w] |= active[i-1].B[w] << 1 | active[i-1].B[w-1] >> 63;
+        active[i].B[0] |= active[i-1].B[0] << 1;
 
     }
 }
 // template spec for 0 errors
 template<>
-inline void ShiftAnd<0>::queryLetter(const char& c)
+inline void ShiftAnd<0, 2>::queryLetter(const char& c)
 {
 
     const bitMasks& mask = masks[lmap[c%16]];
 
     // update zero error layer (at the top)
-    active[0].B_1 = ((active[0].B_1 << 1 | active[0].B_0 >> 63) & mask.B_1);
-    active[0].B_0 = ((active[0].B_0 << 1 | 1) & mask.B_0);
+    active[0].B[1] = ((active[0].B[1] << 1 | active[0].B[0] >> 63) & mask.B[1]);
+    active[0].B[0] = ((active[0].B[0] << 1 | 1) & mask.B[0]);
 }
 // template spec for 1 error
 template<>
-inline void ShiftAnd<1>::queryLetter(const char& c)
+inline void ShiftAnd<1, 2>::queryLetter(const char& c)
 {
 
     const bitMasks& mask = masks[lmap[c%16]];
@@ -419,24 +902,24 @@ inline void ShiftAnd<1>::queryLetter(const char& c)
     // Update second part of pattern states
     //
     //                                  Match                                       Insertion                       Substitution
-    active[1].B_1 = ((active[1].B_1 << 1 | active[1].B_0 >> 63) & mask.B_1) | (active[0].B_1) | (active[0].B_1 << 1 | active[0].B_0 >> 63);
+    active[1].B[1] = ((active[1].B[1] << 1 | active[1].B[0] >> 63) & mask.B[1]) | (active[0].B[1]) | (active[0].B[1] << 1 | active[0].B[0] >> 63);
 
     // Update first part of pattern states
     //
     //                          Match                           Insertion               Substitution
-    active[1].B_0 = ((active[1].B_0 << 1 | 1) & mask.B_0) | (active[0].B_0) | (active[0].B_0 << 1);
+    active[1].B[0] = ((active[1].B[0] << 1 | 1) & mask.B[0]) | (active[0].B[0]) | (active[0].B[0] << 1);
 
     // update zero error layer (at the top)
-    active[0].B_1 = ((active[0].B_1 << 1 | active[0].B_0 >> 63) & mask.B_1);
-    active[0].B_0 = ((active[0].B_0 << 1 | 1) & mask.B_0);
+    active[0].B[1] = ((active[0].B[1] << 1 | active[0].B[0] >> 63) & mask.B[1]);
+    active[0].B[0] = ((active[0].B[0] << 1 | 1) & mask.B[0]);
     //
     // Top down update for values of this iteration
-    active[1].B_1 |= active[0].B_1 << 1 | active[0].B_0 >> 63;
-    active[1].B_0 |= active[0].B_0 << 1;
+    active[1].B[1] |= active[0].B[1] << 1 | active[0].B[0] >> 63;
+    active[1].B[0] |= active[0].B[0] << 1;
 }
 // template spec for 2 errors
 template<>
-inline void ShiftAnd<2>::queryLetter(const char& c)
+inline void ShiftAnd<2, 2>::queryLetter(const char& c)
 {
 
     const bitMasks& mask = masks[lmap[c%16]];
@@ -445,34 +928,34 @@ inline void ShiftAnd<2>::queryLetter(const char& c)
     // Update second part of pattern states
     //
     //                                  Match                                       Insertion                       Substitution
-    active[2].B_1 = ((active[2].B_1 << 1 | active[2].B_0 >> 63) & mask.B_1) | (active[1].B_1) | (active[1].B_1 << 1 | active[1].B_0 >> 63);
+    active[2].B[1] = ((active[2].B[1] << 1 | active[2].B[0] >> 63) & mask.B[1]) | (active[1].B[1]) | (active[1].B[1] << 1 | active[1].B[0] >> 63);
 
     // Update first part of pattern states
     //
     //                          Match                           Insertion               Substitution
-    active[2].B_0 = ((active[2].B_0 << 1 | 1) & mask.B_0) | (active[1].B_0) | (active[1].B_0 << 1);
+    active[2].B[0] = ((active[2].B[0] << 1 | 1) & mask.B[0]) | (active[1].B[0]) | (active[1].B[0] << 1);
     // Update second part of pattern states
     //
     //                                  Match                                       Insertion                       Substitution
-    active[1].B_1 = ((active[1].B_1 << 1 | active[1].B_0 >> 63) & mask.B_1) | (active[0].B_1) | (active[0].B_1 << 1 | active[0].B_0 >> 63);
+    active[1].B[1] = ((active[1].B[1] << 1 | active[1].B[0] >> 63) & mask.B[1]) | (active[0].B[1]) | (active[0].B[1] << 1 | active[0].B[0] >> 63);
 
     // Update first part of pattern states
     //
     //                          Match                           Insertion               Substitution
-    active[1].B_0 = ((active[1].B_0 << 1 | 1) & mask.B_0) | (active[0].B_0) | (active[0].B_0 << 1);
+    active[1].B[0] = ((active[1].B[0] << 1 | 1) & mask.B[0]) | (active[0].B[0]) | (active[0].B[0] << 1);
 
     // update zero error layer (at the top)
-    active[0].B_1 = ((active[0].B_1 << 1 | active[0].B_0 >> 63) & mask.B_1);
-    active[0].B_0 = ((active[0].B_0 << 1 | 1) & mask.B_0);
+    active[0].B[1] = ((active[0].B[1] << 1 | active[0].B[0] >> 63) & mask.B[1]);
+    active[0].B[0] = ((active[0].B[0] << 1 | 1) & mask.B[0]);
     //
     // Top down update for values of this iteration
-    active[1].B_1 |= active[0].B_1 << 1 | active[0].B_0 >> 63;
-    active[1].B_0 |= active[0].B_0 << 1;
-    active[2].B_1 |= active[1].B_1 << 1 | active[1].B_0 >> 63;
-    active[2].B_0 |= active[1].B_0 << 1;
+    active[1].B[1] |= active[0].B[1] << 1 | active[0].B[0] >> 63;
+    active[1].B[0] |= active[0].B[0] << 1;
+    active[2].B[1] |= active[1].B[1] << 1 | active[1].B[0] >> 63;
+    active[2].B[0] |= active[1].B[0] << 1;
 }
 template<>
-inline void ShiftAnd<3>::queryLetter(const char& c)
+inline void ShiftAnd<3, 2>::queryLetter(const char& c)
 {
 
     const bitMasks& mask = masks[lmap[c%16]];
@@ -481,45 +964,45 @@ inline void ShiftAnd<3>::queryLetter(const char& c)
     // Update second part of pattern states
     //
     //                                  Match                                       Insertion                       Substitution
-    active[3].B_1 = ((active[3].B_1 << 1 | active[3].B_0 >> 63) & mask.B_1) | (active[2].B_1) | (active[2].B_1 << 1 | active[2].B_0 >> 63);
+    active[3].B[1] = ((active[3].B[1] << 1 | active[3].B[0] >> 63) & mask.B[1]) | (active[2].B[1]) | (active[2].B[1] << 1 | active[2].B[0] >> 63);
 
     // Update first part of pattern states
     //
     //                          Match                           Insertion               Substitution
-    active[3].B_0 = ((active[3].B_0 << 1 | 1) & mask.B_0) | (active[2].B_0) | (active[2].B_0 << 1);
+    active[3].B[0] = ((active[3].B[0] << 1 | 1) & mask.B[0]) | (active[2].B[0]) | (active[2].B[0] << 1);
     // Update second part of pattern states
     //
     //                                  Match                                       Insertion                       Substitution
-    active[2].B_1 = ((active[2].B_1 << 1 | active[2].B_0 >> 63) & mask.B_1) | (active[1].B_1) | (active[1].B_1 << 1 | active[1].B_0 >> 63);
+    active[2].B[1] = ((active[2].B[1] << 1 | active[2].B[0] >> 63) & mask.B[1]) | (active[1].B[1]) | (active[1].B[1] << 1 | active[1].B[0] >> 63);
 
     // Update first part of pattern states
     //
     //                          Match                           Insertion               Substitution
-    active[2].B_0 = ((active[2].B_0 << 1 | 1) & mask.B_0) | (active[1].B_0) | (active[1].B_0 << 1);
+    active[2].B[0] = ((active[2].B[0] << 1 | 1) & mask.B[0]) | (active[1].B[0]) | (active[1].B[0] << 1);
     // Update second part of pattern states
     //
     //                                  Match                                       Insertion                       Substitution
-    active[1].B_1 = ((active[1].B_1 << 1 | active[1].B_0 >> 63) & mask.B_1) | (active[0].B_1) | (active[0].B_1 << 1 | active[0].B_0 >> 63);
+    active[1].B[1] = ((active[1].B[1] << 1 | active[1].B[0] >> 63) & mask.B[1]) | (active[0].B[1]) | (active[0].B[1] << 1 | active[0].B[0] >> 63);
 
     // Update first part of pattern states
     //
     //                          Match                           Insertion               Substitution
-    active[1].B_0 = ((active[1].B_0 << 1 | 1) & mask.B_0) | (active[0].B_0) | (active[0].B_0 << 1);
+    active[1].B[0] = ((active[1].B[0] << 1 | 1) & mask.B[0]) | (active[0].B[0]) | (active[0].B[0] << 1);
 
     // update zero error layer (at the top)
-    active[0].B_1 = ((active[0].B_1 << 1 | active[0].B_0 >> 63) & mask.B_1);
-    active[0].B_0 = ((active[0].B_0 << 1 | 1) & mask.B_0);
+    active[0].B[1] = ((active[0].B[1] << 1 | active[0].B[0] >> 63) & mask.B[1]);
+    active[0].B[0] = ((active[0].B[0] << 1 | 1) & mask.B[0]);
     //
     // Top down update for values of this iteration
-    active[1].B_1 |= active[0].B_1 << 1 | active[0].B_0 >> 63;
-    active[1].B_0 |= active[0].B_0 << 1;
-    active[2].B_1 |= active[1].B_1 << 1 | active[1].B_0 >> 63;
-    active[2].B_0 |= active[1].B_0 << 1;
-    active[3].B_1 |= active[2].B_1 << 1 | active[2].B_0 >> 63;
-    active[3].B_0 |= active[2].B_0 << 1;
+    active[1].B[1] |= active[0].B[1] << 1 | active[0].B[0] >> 63;
+    active[1].B[0] |= active[0].B[0] << 1;
+    active[2].B[1] |= active[1].B[1] << 1 | active[1].B[0] >> 63;
+    active[2].B[0] |= active[1].B[0] << 1;
+    active[3].B[1] |= active[2].B[1] << 1 | active[2].B[0] >> 63;
+    active[3].B[0] |= active[2].B[0] << 1;
 }
 template<>
-inline void ShiftAnd<4>::queryLetter(const char& c)
+inline void ShiftAnd<4, 2>::queryLetter(const char& c)
 {
 
     const bitMasks& mask = masks[lmap[c%16]];
@@ -528,56 +1011,56 @@ inline void ShiftAnd<4>::queryLetter(const char& c)
     // Update second part of pattern states
     //
     //                                  Match                                       Insertion                       Substitution
-    active[4].B_1 = ((active[4].B_1 << 1 | active[4].B_0 >> 63) & mask.B_1) | (active[3].B_1) | (active[3].B_1 << 1 | active[3].B_0 >> 63);
+    active[4].B[1] = ((active[4].B[1] << 1 | active[4].B[0] >> 63) & mask.B[1]) | (active[3].B[1]) | (active[3].B[1] << 1 | active[3].B[0] >> 63);
 
     // Update first part of pattern states
     //
     //                          Match                           Insertion               Substitution
-    active[4].B_0 = ((active[4].B_0 << 1 | 1) & mask.B_0) | (active[3].B_0) | (active[3].B_0 << 1);
+    active[4].B[0] = ((active[4].B[0] << 1 | 1) & mask.B[0]) | (active[3].B[0]) | (active[3].B[0] << 1);
     // Update second part of pattern states
     //
     //                                  Match                                       Insertion                       Substitution
-    active[3].B_1 = ((active[3].B_1 << 1 | active[3].B_0 >> 63) & mask.B_1) | (active[2].B_1) | (active[2].B_1 << 1 | active[2].B_0 >> 63);
+    active[3].B[1] = ((active[3].B[1] << 1 | active[3].B[0] >> 63) & mask.B[1]) | (active[2].B[1]) | (active[2].B[1] << 1 | active[2].B[0] >> 63);
 
     // Update first part of pattern states
     //
     //                          Match                           Insertion               Substitution
-    active[3].B_0 = ((active[3].B_0 << 1 | 1) & mask.B_0) | (active[2].B_0) | (active[2].B_0 << 1);
+    active[3].B[0] = ((active[3].B[0] << 1 | 1) & mask.B[0]) | (active[2].B[0]) | (active[2].B[0] << 1);
     // Update second part of pattern states
     //
     //                                  Match                                       Insertion                       Substitution
-    active[2].B_1 = ((active[2].B_1 << 1 | active[2].B_0 >> 63) & mask.B_1) | (active[1].B_1) | (active[1].B_1 << 1 | active[1].B_0 >> 63);
+    active[2].B[1] = ((active[2].B[1] << 1 | active[2].B[0] >> 63) & mask.B[1]) | (active[1].B[1]) | (active[1].B[1] << 1 | active[1].B[0] >> 63);
 
     // Update first part of pattern states
     //
     //                          Match                           Insertion               Substitution
-    active[2].B_0 = ((active[2].B_0 << 1 | 1) & mask.B_0) | (active[1].B_0) | (active[1].B_0 << 1);
+    active[2].B[0] = ((active[2].B[0] << 1 | 1) & mask.B[0]) | (active[1].B[0]) | (active[1].B[0] << 1);
     // Update second part of pattern states
     //
     //                                  Match                                       Insertion                       Substitution
-    active[1].B_1 = ((active[1].B_1 << 1 | active[1].B_0 >> 63) & mask.B_1) | (active[0].B_1) | (active[0].B_1 << 1 | active[0].B_0 >> 63);
+    active[1].B[1] = ((active[1].B[1] << 1 | active[1].B[0] >> 63) & mask.B[1]) | (active[0].B[1]) | (active[0].B[1] << 1 | active[0].B[0] >> 63);
 
     // Update first part of pattern states
     //
     //                          Match                           Insertion               Substitution
-    active[1].B_0 = ((active[1].B_0 << 1 | 1) & mask.B_0) | (active[0].B_0) | (active[0].B_0 << 1);
+    active[1].B[0] = ((active[1].B[0] << 1 | 1) & mask.B[0]) | (active[0].B[0]) | (active[0].B[0] << 1);
 
     // update zero error layer (at the top)
-    active[0].B_1 = ((active[0].B_1 << 1 | active[0].B_0 >> 63) & mask.B_1);
-    active[0].B_0 = ((active[0].B_0 << 1 | 1) & mask.B_0);
+    active[0].B[1] = ((active[0].B[1] << 1 | active[0].B[0] >> 63) & mask.B[1]);
+    active[0].B[0] = ((active[0].B[0] << 1 | 1) & mask.B[0]);
     //
     // Top down update for values of this iteration
-    active[1].B_1 |= active[0].B_1 << 1 | active[0].B_0 >> 63;
-    active[1].B_0 |= active[0].B_0 << 1;
-    active[2].B_1 |= active[1].B_1 << 1 | active[1].B_0 >> 63;
-    active[2].B_0 |= active[1].B_0 << 1;
-    active[3].B_1 |= active[2].B_1 << 1 | active[2].B_0 >> 63;
-    active[3].B_0 |= active[2].B_0 << 1;
-    active[4].B_1 |= active[3].B_1 << 1 | active[3].B_0 >> 63;
-    active[4].B_0 |= active[3].B_0 << 1;
+    active[1].B[1] |= active[0].B[1] << 1 | active[0].B[0] >> 63;
+    active[1].B[0] |= active[0].B[0] << 1;
+    active[2].B[1] |= active[1].B[1] << 1 | active[1].B[0] >> 63;
+    active[2].B[0] |= active[1].B[0] << 1;
+    active[3].B[1] |= active[2].B[1] << 1 | active[2].B[0] >> 63;
+    active[3].B[0] |= active[2].B[0] << 1;
+    active[4].B[1] |= active[3].B[1] << 1 | active[3].B[0] >> 63;
+    active[4].B[0] |= active[3].B[0] << 1;
 }
 template<>
-inline void ShiftAnd<5>::queryLetter(const char& c)
+inline void ShiftAnd<5, 2>::queryLetter(const char& c)
 {
 
     const bitMasks& mask = masks[lmap[c%16]];
@@ -586,67 +1069,67 @@ inline void ShiftAnd<5>::queryLetter(const char& c)
     // Update second part of pattern states
     //
     //                                  Match                                       Insertion                       Substitution
-    active[5].B_1 = ((active[5].B_1 << 1 | active[5].B_0 >> 63) & mask.B_1) | (active[4].B_1) | (active[4].B_1 << 1 | active[4].B_0 >> 63);
+    active[5].B[1] = ((active[5].B[1] << 1 | active[5].B[0] >> 63) & mask.B[1]) | (active[4].B[1]) | (active[4].B[1] << 1 | active[4].B[0] >> 63);
 
     // Update first part of pattern states
     //
     //                          Match                           Insertion               Substitution
-    active[5].B_0 = ((active[5].B_0 << 1 | 1) & mask.B_0) | (active[4].B_0) | (active[4].B_0 << 1);
+    active[5].B[0] = ((active[5].B[0] << 1 | 1) & mask.B[0]) | (active[4].B[0]) | (active[4].B[0] << 1);
     // Update second part of pattern states
     //
     //                                  Match                                       Insertion                       Substitution
-    active[4].B_1 = ((active[4].B_1 << 1 | active[4].B_0 >> 63) & mask.B_1) | (active[3].B_1) | (active[3].B_1 << 1 | active[3].B_0 >> 63);
+    active[4].B[1] = ((active[4].B[1] << 1 | active[4].B[0] >> 63) & mask.B[1]) | (active[3].B[1]) | (active[3].B[1] << 1 | active[3].B[0] >> 63);
 
     // Update first part of pattern states
     //
     //                          Match                           Insertion               Substitution
-    active[4].B_0 = ((active[4].B_0 << 1 | 1) & mask.B_0) | (active[3].B_0) | (active[3].B_0 << 1);
+    active[4].B[0] = ((active[4].B[0] << 1 | 1) & mask.B[0]) | (active[3].B[0]) | (active[3].B[0] << 1);
     // Update second part of pattern states
     //
     //                                  Match                                       Insertion                       Substitution
-    active[3].B_1 = ((active[3].B_1 << 1 | active[3].B_0 >> 63) & mask.B_1) | (active[2].B_1) | (active[2].B_1 << 1 | active[2].B_0 >> 63);
+    active[3].B[1] = ((active[3].B[1] << 1 | active[3].B[0] >> 63) & mask.B[1]) | (active[2].B[1]) | (active[2].B[1] << 1 | active[2].B[0] >> 63);
 
     // Update first part of pattern states
     //
     //                          Match                           Insertion               Substitution
-    active[3].B_0 = ((active[3].B_0 << 1 | 1) & mask.B_0) | (active[2].B_0) | (active[2].B_0 << 1);
+    active[3].B[0] = ((active[3].B[0] << 1 | 1) & mask.B[0]) | (active[2].B[0]) | (active[2].B[0] << 1);
     // Update second part of pattern states
     //
     //                                  Match                                       Insertion                       Substitution
-    active[2].B_1 = ((active[2].B_1 << 1 | active[2].B_0 >> 63) & mask.B_1) | (active[1].B_1) | (active[1].B_1 << 1 | active[1].B_0 >> 63);
+    active[2].B[1] = ((active[2].B[1] << 1 | active[2].B[0] >> 63) & mask.B[1]) | (active[1].B[1]) | (active[1].B[1] << 1 | active[1].B[0] >> 63);
 
     // Update first part of pattern states
     //
     //                          Match                           Insertion               Substitution
-    active[2].B_0 = ((active[2].B_0 << 1 | 1) & mask.B_0) | (active[1].B_0) | (active[1].B_0 << 1);
+    active[2].B[0] = ((active[2].B[0] << 1 | 1) & mask.B[0]) | (active[1].B[0]) | (active[1].B[0] << 1);
     // Update second part of pattern states
     //
     //                                  Match                                       Insertion                       Substitution
-    active[1].B_1 = ((active[1].B_1 << 1 | active[1].B_0 >> 63) & mask.B_1) | (active[0].B_1) | (active[0].B_1 << 1 | active[0].B_0 >> 63);
+    active[1].B[1] = ((active[1].B[1] << 1 | active[1].B[0] >> 63) & mask.B[1]) | (active[0].B[1]) | (active[0].B[1] << 1 | active[0].B[0] >> 63);
 
     // Update first part of pattern states
     //
     //                          Match                           Insertion               Substitution
-    active[1].B_0 = ((active[1].B_0 << 1 | 1) & mask.B_0) | (active[0].B_0) | (active[0].B_0 << 1);
+    active[1].B[0] = ((active[1].B[0] << 1 | 1) & mask.B[0]) | (active[0].B[0]) | (active[0].B[0] << 1);
 
     // update zero error layer (at the top)
-    active[0].B_1 = ((active[0].B_1 << 1 | active[0].B_0 >> 63) & mask.B_1);
-    active[0].B_0 = ((active[0].B_0 << 1 | 1) & mask.B_0);
+    active[0].B[1] = ((active[0].B[1] << 1 | active[0].B[0] >> 63) & mask.B[1]);
+    active[0].B[0] = ((active[0].B[0] << 1 | 1) & mask.B[0]);
     //
     // Top down update for values of this iteration
-    active[1].B_1 |= active[0].B_1 << 1 | active[0].B_0 >> 63;
-    active[1].B_0 |= active[0].B_0 << 1;
-    active[2].B_1 |= active[1].B_1 << 1 | active[1].B_0 >> 63;
-    active[2].B_0 |= active[1].B_0 << 1;
-    active[3].B_1 |= active[2].B_1 << 1 | active[2].B_0 >> 63;
-    active[3].B_0 |= active[2].B_0 << 1;
-    active[4].B_1 |= active[3].B_1 << 1 | active[3].B_0 >> 63;
-    active[4].B_0 |= active[3].B_0 << 1;
-    active[5].B_1 |= active[4].B_1 << 1 | active[4].B_0 >> 63;
-    active[5].B_0 |= active[4].B_0 << 1;
+    active[1].B[1] |= active[0].B[1] << 1 | active[0].B[0] >> 63;
+    active[1].B[0] |= active[0].B[0] << 1;
+    active[2].B[1] |= active[1].B[1] << 1 | active[1].B[0] >> 63;
+    active[2].B[0] |= active[1].B[0] << 1;
+    active[3].B[1] |= active[2].B[1] << 1 | active[2].B[0] >> 63;
+    active[3].B[0] |= active[2].B[0] << 1;
+    active[4].B[1] |= active[3].B[1] << 1 | active[3].B[0] >> 63;
+    active[4].B[0] |= active[3].B[0] << 1;
+    active[5].B[1] |= active[4].B[1] << 1 | active[4].B[0] >> 63;
+    active[5].B[0] |= active[4].B[0] << 1;
 }
 template<>
-inline void ShiftAnd<6>::queryLetter(const char& c)
+inline void ShiftAnd<6, 2>::queryLetter(const char& c)
 {
 
     const bitMasks& mask = masks[lmap[c%16]];
@@ -655,88 +1138,91 @@ inline void ShiftAnd<6>::queryLetter(const char& c)
     // Update second part of pattern states
     //
     //                                  Match                                       Insertion                       Substitution
-    active[6].B_1 = ((active[6].B_1 << 1 | active[6].B_0 >> 63) & mask.B_1) | (active[5].B_1) | (active[5].B_1 << 1 | active[5].B_0 >> 63);
+    active[6].B[1] = ((active[6].B[1] << 1 | active[6].B[0] >> 63) & mask.B[1]) | (active[5].B[1]) | (active[5].B[1] << 1 | active[5].B[0] >> 63);
 
     // Update first part of pattern states
     //
     //                          Match                           Insertion               Substitution
-    active[6].B_0 = ((active[6].B_0 << 1 | 1) & mask.B_0) | (active[5].B_0) | (active[5].B_0 << 1);
+    active[6].B[0] = ((active[6].B[0] << 1 | 1) & mask.B[0]) | (active[5].B[0]) | (active[5].B[0] << 1);
     // Update second part of pattern states
     //
     //                                  Match                                       Insertion                       Substitution
-    active[5].B_1 = ((active[5].B_1 << 1 | active[5].B_0 >> 63) & mask.B_1) | (active[4].B_1) | (active[4].B_1 << 1 | active[4].B_0 >> 63);
+    active[5].B[1] = ((active[5].B[1] << 1 | active[5].B[0] >> 63) & mask.B[1]) | (active[4].B[1]) | (active[4].B[1] << 1 | active[4].B[0] >> 63);
 
     // Update first part of pattern states
     //
     //                          Match                           Insertion               Substitution
-    active[5].B_0 = ((active[5].B_0 << 1 | 1) & mask.B_0) | (active[4].B_0) | (active[4].B_0 << 1);
+    active[5].B[0] = ((active[5].B[0] << 1 | 1) & mask.B[0]) | (active[4].B[0]) | (active[4].B[0] << 1);
     // Update second part of pattern states
     //
     //                                  Match                                       Insertion                       Substitution
-    active[4].B_1 = ((active[4].B_1 << 1 | active[4].B_0 >> 63) & mask.B_1) | (active[3].B_1) | (active[3].B_1 << 1 | active[3].B_0 >> 63);
+    active[4].B[1] = ((active[4].B[1] << 1 | active[4].B[0] >> 63) & mask.B[1]) | (active[3].B[1]) | (active[3].B[1] << 1 | active[3].B[0] >> 63);
 
     // Update first part of pattern states
     //
     //                          Match                           Insertion               Substitution
-    active[4].B_0 = ((active[4].B_0 << 1 | 1) & mask.B_0) | (active[3].B_0) | (active[3].B_0 << 1);
+    active[4].B[0] = ((active[4].B[0] << 1 | 1) & mask.B[0]) | (active[3].B[0]) | (active[3].B[0] << 1);
     // Update second part of pattern states
     //
     //                                  Match                                       Insertion                       Substitution
-    active[3].B_1 = ((active[3].B_1 << 1 | active[3].B_0 >> 63) & mask.B_1) | (active[2].B_1) | (active[2].B_1 << 1 | active[2].B_0 >> 63);
+    active[3].B[1] = ((active[3].B[1] << 1 | active[3].B[0] >> 63) & mask.B[1]) | (active[2].B[1]) | (active[2].B[1] << 1 | active[2].B[0] >> 63);
 
     // Update first part of pattern states
     //
     //                          Match                           Insertion               Substitution
-    active[3].B_0 = ((active[3].B_0 << 1 | 1) & mask.B_0) | (active[2].B_0) | (active[2].B_0 << 1);
+    active[3].B[0] = ((active[3].B[0] << 1 | 1) & mask.B[0]) | (active[2].B[0]) | (active[2].B[0] << 1);
     // Update second part of pattern states
     //
     //                                  Match                                       Insertion                       Substitution
-    active[2].B_1 = ((active[2].B_1 << 1 | active[2].B_0 >> 63) & mask.B_1) | (active[1].B_1) | (active[1].B_1 << 1 | active[1].B_0 >> 63);
+    active[2].B[1] = ((active[2].B[1] << 1 | active[2].B[0] >> 63) & mask.B[1]) | (active[1].B[1]) | (active[1].B[1] << 1 | active[1].B[0] >> 63);
 
     // Update first part of pattern states
     //
     //                          Match                           Insertion               Substitution
-    active[2].B_0 = ((active[2].B_0 << 1 | 1) & mask.B_0) | (active[1].B_0) | (active[1].B_0 << 1);
+    active[2].B[0] = ((active[2].B[0] << 1 | 1) & mask.B[0]) | (active[1].B[0]) | (active[1].B[0] << 1);
     // Update second part of pattern states
     //
     //                                  Match                                       Insertion                       Substitution
-    active[1].B_1 = ((active[1].B_1 << 1 | active[1].B_0 >> 63) & mask.B_1) | (active[0].B_1) | (active[0].B_1 << 1 | active[0].B_0 >> 63);
+    active[1].B[1] = ((active[1].B[1] << 1 | active[1].B[0] >> 63) & mask.B[1]) | (active[0].B[1]) | (active[0].B[1] << 1 | active[0].B[0] >> 63);
 
     // Update first part of pattern states
     //
     //                          Match                           Insertion               Substitution
-    active[1].B_0 = ((active[1].B_0 << 1 | 1) & mask.B_0) | (active[0].B_0) | (active[0].B_0 << 1);
+    active[1].B[0] = ((active[1].B[0] << 1 | 1) & mask.B[0]) | (active[0].B[0]) | (active[0].B[0] << 1);
 
     // update zero error layer (at the top)
-    active[0].B_1 = ((active[0].B_1 << 1 | active[0].B_0 >> 63) & mask.B_1);
-    active[0].B_0 = ((active[0].B_0 << 1 | 1) & mask.B_0);
+    active[0].B[1] = ((active[0].B[1] << 1 | active[0].B[0] >> 63) & mask.B[1]);
+    active[0].B[0] = ((active[0].B[0] << 1 | 1) & mask.B[0]);
     //
     // Top down update for values of this iteration
-    active[1].B_1 |= active[0].B_1 << 1 | active[0].B_0 >> 63;
-    active[1].B_0 |= active[0].B_0 << 1;
-    active[2].B_1 |= active[1].B_1 << 1 | active[1].B_0 >> 63;
-    active[2].B_0 |= active[1].B_0 << 1;
-    active[3].B_1 |= active[2].B_1 << 1 | active[2].B_0 >> 63;
-    active[3].B_0 |= active[2].B_0 << 1;
-    active[4].B_1 |= active[3].B_1 << 1 | active[3].B_0 >> 63;
-    active[4].B_0 |= active[3].B_0 << 1;
-    active[5].B_1 |= active[4].B_1 << 1 | active[4].B_0 >> 63;
-    active[5].B_0 |= active[4].B_0 << 1;
-    active[6].B_1 |= active[5].B_1 << 1 | active[5].B_0 >> 63;
-    active[6].B_0 |= active[5].B_0 << 1;
+    active[1].B[1] |= active[0].B[1] << 1 | active[0].B[0] >> 63;
+    active[1].B[0] |= active[0].B[0] << 1;
+    active[2].B[1] |= active[1].B[1] << 1 | active[1].B[0] >> 63;
+    active[2].B[0] |= active[1].B[0] << 1;
+    active[3].B[1] |= active[2].B[1] << 1 | active[2].B[0] >> 63;
+    active[3].B[0] |= active[2].B[0] << 1;
+    active[4].B[1] |= active[3].B[1] << 1 | active[3].B[0] >> 63;
+    active[4].B[0] |= active[3].B[0] << 1;
+    active[5].B[1] |= active[4].B[1] << 1 | active[4].B[0] >> 63;
+    active[5].B[0] |= active[4].B[0] << 1;
+    active[6].B[1] |= active[5].B[1] << 1 | active[5].B[0] >> 63;
+    active[6].B[0] |= active[5].B[0] << 1;
 }
 
 
 
-template<size_t E>
-inline bool ShiftAnd<E>::isMatch(uint8_t& errNum)
+template<size_t E, size_t W>
+inline bool ShiftAnd<E, W>::isMatch(uint8_t& errNum)
 {
     // go through layers
     for (size_t i = 0; i <= E; ++i)
     {
 
         // test if this layer is match
-        if ((active[i].B_1 & accepted.B_1) || (active[i].B_0 & accepted.B_0))
+        uint64_t acc = 0;
+        for (size_t w = 0; w < W; ++w)
+            acc |= active[i].B[w] & accepted.B[w];
+        if (acc)
         {
             errNum = i;
             return true;
@@ -747,10 +1233,10 @@ inline bool ShiftAnd<E>::isMatch(uint8_t& errNum)
 }
 // template spec for 0 errors
 template<>
-inline bool ShiftAnd<0>::isMatch(uint8_t& errNum)
+inline bool ShiftAnd<0, 2>::isMatch(uint8_t& errNum)
 {
 
-    if ((active[0].B_1 & accepted.B_1) || (active[0].B_0 & accepted.B_0))
+    if ((active[0].B[1] & accepted.B[1]) || (active[0].B[0] & accepted.B[0]))
     {
         errNum = 0;
         return true;
@@ -759,15 +1245,15 @@ inline bool ShiftAnd<0>::isMatch(uint8_t& errNum)
 }
 // template spec for 1 error
 template<>
-inline bool ShiftAnd<1>::isMatch(uint8_t& errNum)
+inline bool ShiftAnd<1, 2>::isMatch(uint8_t& errNum)
 {
 
-    if ((active[0].B_1 & accepted.B_1) || (active[0].B_0 & accepted.B_0) )
+    if ((active[0].B[1] & accepted.B[1]) || (active[0].B[0] & accepted.B[0]) )
     {
         errNum = 0;
         return true;
     }
-    if ((active[1].B_1 & accepted.B_1) || (active[1].B_0 & accepted.B_0) )
+    if ((active[1].B[1] & accepted.B[1]) || (active[1].B[0] & accepted.B[0]) )
     {
         errNum = 1;
         return true;
@@ -776,20 +1262,20 @@ inline bool ShiftAnd<1>::isMatch(uint8_t& errNum)
 }
 // template spec for 2 errors
 template<>
-inline bool ShiftAnd<2>::isMatch(uint8_t& errNum)
+inline bool ShiftAnd<2, 2>::isMatch(uint8_t& errNum)
 {
 
-    if ((active[0].B_1 & accepted.B_1) || (active[0].B_0 & accepted.B_0) )
+    if ((active[0].B[1] & accepted.B[1]) || (active[0].B[0] & accepted.B[0]) )
     {
         errNum = 0;
         return true;
     }
-	else if ((active[1].B_1 & accepted.B_1) || (active[1].B_0 & accepted.B_0) )
+	else if ((active[1].B[1] & accepted.B[1]) || (active[1].B[0] & accepted.B[0]) )
     {
         errNum = 1;
         return true;
     }
-	else if ((active[2].B_1 & accepted.B_1) || (active[2].B_0 & accepted.B_0) )
+	else if ((active[2].B[1] & accepted.B[1]) || (active[2].B[0] & accepted.B[0]) )
     {
         errNum = 2;
         return true;
@@ -797,25 +1283,25 @@ inline bool ShiftAnd<2>::isMatch(uint8_t& errNum)
     return false;
 }
 template<>
-inline bool ShiftAnd<3>::isMatch(uint8_t& errNum)
+inline bool ShiftAnd<3, 2>::isMatch(uint8_t& errNum)
 {
 
-    if ((active[0].B_1 & accepted.B_1) || (active[0].B_0 & accepted.B_0) )
+    if ((active[0].B[1] & accepted.B[1]) || (active[0].B[0] & accepted.B[0]) )
     {
         errNum = 0;
         return true;
     }
-	else if ((active[1].B_1 & accepted.B_1) || (active[1].B_0 & accepted.B_0) )
+	else if ((active[1].B[1] & accepted.B[1]) || (active[1].B[0] & accepted.B[0]) )
     {
         errNum = 1;
         return true;
     }
-	else if ((active[2].B_1 & accepted.B_1) || (active[2].B_0 & accepted.B_0) )
+	else if ((active[2].B[1] & accepted.B[1]) || (active[2].B[0] & accepted.B[0]) )
     {
         errNum = 2;
         return true;
     }
-	else if ((active[3].B_1 & accepted.B_1) || (active[3].B_0 & accepted.B_0) )
+	else if ((active[3].B[1] & accepted.B[1]) || (active[3].B[0] & accepted.B[0]) )
     {
         errNum = 3;
         return true;
@@ -823,30 +1309,30 @@ inline bool ShiftAnd<3>::isMatch(uint8_t& errNum)
     return false;
 }
 template<>
-inline bool ShiftAnd<4>::isMatch(uint8_t& errNum)
+inline bool ShiftAnd<4, 2>::isMatch(uint8_t& errNum)
 {
 
-    if ((active[0].B_1 & accepted.B_1) || (active[0].B_0 & accepted.B_0) )
+    if ((active[0].B[1] & accepted.B[1]) || (active[0].B[0] & accepted.B[0]) )
     {
         errNum = 0;
         return true;
     }
-	else if ((active[1].B_1 & accepted.B_1) || (active[1].B_0 & accepted.B_0) )
+	else if ((active[1].B[1] & accepted.B[1]) || (active[1].B[0] & accepted.B[0]) )
     {
         errNum = 1;
         return true;
     }
-	else if ((active[2].B_1 & accepted.B_1) || (active[2].B_0 & accepted.B_0) )
+	else if ((active[2].B[1] & accepted.B[1]) || (active[2].B[0] & accepted.B[0]) )
     {
         errNum = 2;
         return true;
     }
-	else if ((active[3].B_1 & accepted.B_1) || (active[3].B_0 & accepted.B_0) )
+	else if ((active[3].B[1] & accepted.B[1]) || (active[3].B[0] & accepted.B[0]) )
     {
         errNum = 3;
         return true;
     }
-	else if ((active[4].B_1 & accepted.B_1) || (active[4].B_0 & accepted.B_0) )
+	else if ((active[4].B[1] & accepted.B[1]) || (active[4].B[0] & accepted.B[0]) )
     {
         errNum = 4;
         return true;
@@ -854,35 +1340,35 @@ inline bool ShiftAnd<4>::isMatch(uint8_t& errNum)
     return false;
 }
 template<>
-inline bool ShiftAnd<5>::isMatch(uint8_t& errNum)
+inline bool ShiftAnd<5, 2>::isMatch(uint8_t& errNum)
 {
 
-    if ((active[0].B_1 & accepted.B_1) || (active[0].B_0 & accepted.B_0) )
+    if ((active[0].B[1] & accepted.B[1]) || (active[0].B[0] & accepted.B[0]) )
     {
         errNum = 0;
         return true;
     }
-	else if ((active[1].B_1 & accepted.B_1) || (active[1].B_0 & accepted.B_0) )
+	else if ((active[1].B[1] & accepted.B[1]) || (active[1].B[0] & accepted.B[0]) )
     {
         errNum = 1;
         return true;
     }
-	else if ((active[2].B_1 & accepted.B_1) || (active[2].B_0 & accepted.B_0) )
+	else if ((active[2].B[1] & accepted.B[1]) || (active[2].B[0] & accepted.B[0]) )
     {
         errNum = 2;
         return true;
     }
-	else if ((active[3].B_1 & accepted.B_1) || (active[3].B_0 & accepted.B_0) )
+	else if ((active[3].B[1] & accepted.B[1]) || (active[3].B[0] & accepted.B[0]) )
     {
         errNum = 3;
         return true;
     }
-	else if ((active[4].B_1 & accepted.B_1) || (active[4].B_0 & accepted.B_0) )
+	else if ((active[4].B[1] & accepted.B[1]) || (active[4].B[0] & accepted.B[0]) )
     {
         errNum = 4;
         return true;
     }
-	else if ((active[5].B_1 & accepted.B_1) || (active[5].B_0 & accepted.B_0) )
+	else if ((active[5].B[1] & accepted.B[1]) || (active[5].B[0] & accepted.B[0]) )
     {
         errNum = 5;
         return true;
@@ -890,40 +1376,40 @@ inline bool ShiftAnd<5>::isMatch(uint8_t& errNum)
     return false;
 }
 template<>
-inline bool ShiftAnd<6>::isMatch(uint8_t& errNum)
+inline bool ShiftAnd<6, 2>::isMatch(uint8_t& errNum)
 {
 
-    if ((active[0].B_1 & accepted.B_1) || (active[0].B_0 & accepted.B_0) )
+    if ((active[0].B[1] & accepted.B[1]) || (active[0].B[0] & accepted.B[0]) )
     {
         errNum = 0;
         return true;
     }
-	else if ((active[1].B_1 & accepted.B_1) || (active[1].B_0 & accepted.B_0) )
+	else if ((active[1].B[1] & accepted.B[1]) || (active[1].B[0] & accepted.B[0]) )
     {
         errNum = 1;
         return true;
     }
-	else if ((active[2].B_1 & accepted.B_1) || (active[2].B_0 & accepted.B_0) )
+	else if ((active[2].B[1] & accepted.B[1]) || (active[2].B[0] & accepted.B[0]) )
     {
         errNum = 2;
         return true;
     }
-	else if ((active[3].B_1 & accepted.B_1) || (active[3].B_0 & accepted.B_0) )
+	else if ((active[3].B[1] & accepted.B[1]) || (active[3].B[0] & accepted.B[0]) )
     {
         errNum = 3;
         return true;
     }
-    else if ((active[4].B_1 & accepted.B_1) || (active[4].B_0 & accepted.B_0) )
+    else if ((active[4].B[1] & accepted.B[1]) || (active[4].B[0] & accepted.B[0]) )
     {
         errNum = 4;
         return true;
     }
-	else if ((active[5].B_1 & accepted.B_1) || (active[5].B_0 & accepted.B_0) )
+	else if ((active[5].B[1] & accepted.B[1]) || (active[5].B[0] & accepted.B[0]) )
     {
         errNum = 5;
         return true;
     }
-	else if ((active[6].B_1 & accepted.B_1) || (active[6].B_0 & accepted.B_0) )
+	else if ((active[6].B[1] & accepted.B[1]) || (active[6].B[0] & accepted.B[0]) )
     {
         errNum = 6;
         return true;
@@ -932,271 +1418,70 @@ inline bool ShiftAnd<6>::isMatch(uint8_t& errNum)
 }
 
 
-template<size_t E>
-inline void ShiftAnd<E>::loadBitmasks(std::string& seq)
+template<size_t E, size_t W>
+inline void ShiftAnd<E, W>::loadBitmasks(const SeqView& seq)
 {
 
-    // retrieve length of the sequence
-    const size_t seqLen = seq.size();
-
-    // load full mask for trailing 1s for sequences that are shorter than pLen
-    uint64_t maskA = 0xffffffffffffffffULL;
-    uint64_t maskC = 0xffffffffffffffffULL;
-    uint64_t maskG = 0xffffffffffffffffULL;
-    uint64_t maskT = 0xffffffffffffffffULL;
-
-    if (seqLen < 64)
+    // retrieve length of the sequence, letters beyond the capacity of the automaton are ignored
+    const size_t seqLen = std::min<size_t>(seq.size(), 64 * W - 1);
+
+    // state s + 1 stands for letter s of the sequence, state 0 is the initial state
+    // states of the mask of a letter are set where the sequence has the letter (a read T also matches a C of
+    // the reference), the initial state and the states behind the sequence are always set (trailing 1s for
+    // sequences that are shorter than 64*W - 1)
+    states maskA;
+    states maskC;
+    states maskG;
+    states maskT;
+    for (size_t w = 0; w < W; ++w)
     {
+        const uint64_t behind = w * 64 > seqLen ? 0xffffffffffffffffULL : (seqLen - w * 64 >= 63 ? 0 : 0xffffffffffffffffULL << (seqLen - w * 64 + 1));
+        maskA.B[w] = behind;
+        maskC.B[w] = behind;
+        maskG.B[w] = behind;
+        maskT.B[w] = behind;
+        accepted.B[w] = 0;
+    }
+    maskA.B[0] |= 1;
+    maskC.B[0] |= 1;
+    maskG.B[0] |= 1;
+    maskT.B[0] |= 1;
+    accepted.B[seqLen >> 6] = static_cast<uint64_t>(1) << (seqLen & 63);
 
-        accepted.B_1 = 0;
-        accepted.B_0 = static_cast<uint64_t>(1) << seqLen;
-        // save masks for second part of sequence
-        // dummy bitmask to propagate states to the end
-        masks[0].B_1 = maskA;
-        masks[1].B_1 = maskA;
-        masks[2].B_1 = maskA;
-        masks[3].B_1 = maskA;
-
-        for (size_t i = seqLen; i > 0; )
-        {
-
-            // shift to make space for next letter
-            maskA = maskA << 1;
-            maskC = maskC << 1;
-            maskG = maskG << 1;
-            maskT = maskT << 1;
-
-            switch (seq[--i])
-            {
-                case ('A'):
-
-                    maskA |= 1;
-                    break;
-
-                case ('C'):
-
-                    maskC |= 1;
-                    break;
-
-                case ('G'):
-
-                    maskG |= 1;
-                    break;
-
-                case ('T'):
-
-                    maskT |= 1;
-                    maskC |= 1;
-
-            }
-
-        }
-        // load initial state
-        maskA = (maskA << 1) | 1;
-        maskC = (maskC << 1) | 1;
-        maskG = (maskG << 1) | 1;
-        maskT = (maskT << 1) | 1;
-        // save masks
-        masks[lmap['A'%16]].B_0 = maskA;
-        masks[lmap['C'%16]].B_0 = maskC;
-        masks[lmap['G'%16]].B_0 = maskG;
-        masks[lmap['T'%16]].B_0 = maskT;
-
-
-
-    } else if (seqLen <= 127) {
-
-        accepted.B_0 = 0;
-        accepted.B_1 = static_cast<uint64_t>(1) << (seqLen - 64);
-
-        // load second part of sequence
-        for (size_t i = seqLen - 1; i > 62; --i)
-        {
-
-            // shift to make space for next letter
-            maskA = maskA << 1;
-            maskC = maskC << 1;
-            maskG = maskG << 1;
-            maskT = maskT << 1;
-
-            switch (seq[i])
-            {
-                case ('A'):
-
-                    maskA |= 1;
-                    break;
-
-                case ('C'):
-
-                    maskC |= 1;
-                    break;
-
-                case ('G'):
-
-                    maskG |= 1;
-                    break;
-
-                case ('T'):
-
-                    maskT |= 1;
-                    maskC |= 1;
-
-            }
-
-        }
-        // save masks
-        masks[lmap['A'%16]].B_1 = maskA;
-        masks[lmap['C'%16]].B_1 = maskC;
-        masks[lmap['G'%16]].B_1 = maskG;
-        masks[lmap['T'%16]].B_1 = maskT;
-
-        // reset mask buffer
-        maskA = 0xffffffffffffffffULL;
-        maskC = 0xffffffffffffffffULL;
-        maskG = 0xffffffffffffffffULL;
-        maskT = 0xffffffffffffffffULL;
-
-        // load first part of sequence
-        for (size_t i = 63; i > 0; )
-        {
-            // shift to make space for next letter
-            maskA = maskA << 1;
-            maskC = maskC << 1;
-            maskG = maskG << 1;
-            maskT = maskT << 1;
-
-            switch (seq[--i])
-            {
-                case ('A'):
-
-                    maskA |= 1;
-                    break;
-
-                case ('C'):
-
-                    maskC |= 1;
-                    break;
-
-                case ('G'):
-
-                    maskG |= 1;
-                    break;
-
-                case ('T'):
-
-                    maskT |= 1;
-                    maskC |= 1;
-
-            }
-
-        }
-        // load initial state
-        maskA = (maskA << 1) | 1;
-        maskC = (maskC << 1) | 1;
-        maskG = (maskG << 1) | 1;
-        maskT = (maskT << 1) | 1;
-        // save masks
-        masks[lmap['A'%16]].B_0 = maskA;
-        masks[lmap['C'%16]].B_0 = maskC;
-        masks[lmap['G'%16]].B_0 = maskG;
-        masks[lmap['T'%16]].B_0 = maskT;
-
-    } else {
-
-        accepted.B_0 = 0;
-        accepted.B_1 = 0x8000000000000000ULL;
-        // load second part of sequence
-        for (size_t i = 127; i > 62; --i)
-        {
-
-            // shift to make space for next letter
-            maskA = maskA << 1;
-            maskC = maskC << 1;
-            maskG = maskG << 1;
-            maskT = maskT << 1;
-
-            switch (seq[i])
-            {
-                case ('A'):
-
-                    maskA |= 1;
-                    break;
-
-                case ('C'):
-
-                    maskC |= 1;
-                    break;
-
-                case ('G'):
-
-                    maskG |= 1;
-                    break;
-
-                case ('T'):
-
-                    maskT |= 1;
-                    maskC |= 1;
-
-            }
+    for (size_t i = 0; i < seqLen; ++i)
+    {
 
-        }
-        // save masks
-        masks[lmap['A'%16]].B_1 = maskA;
-        masks[lmap['C'%16]].B_1 = maskC;
-        masks[lmap['G'%16]].B_1 = maskG;
-        masks[lmap['T'%16]].B_1 = maskT;
-
-        // reset mask buffer
-        maskA = 0xffffffffffffffffULL;
-        maskC = 0xffffffffffffffffULL;
-        maskG = 0xffffffffffffffffULL;
-        maskT = 0xffffffffffffffffULL;
-
-        // load first part of sequence
-        for (size_t i = 63; i > 0; )
+        const uint64_t bit = static_cast<uint64_t>(1) << ((i + 1) & 63);
+        const size_t w = (i + 1) >> 6;
+        switch (seq[i])
         {
+            case ('A'):
 
-            // shift to make space for next letter
-            maskA = maskA << 1;
-            maskC = maskC << 1;
-            maskG = maskG << 1;
-            maskT = maskT << 1;
-            switch (seq[--i])
-            {
-                case ('A'):
-
-                    maskA |= 1;
-                    break;
-
-                case ('C'):
+                maskA.B[w] |= bit;
+                break;
 
-                    maskC |= 1;
-                    break;
+            case ('C'):
 
-                case ('G'):
+                maskC.B[w] |= bit;
+                break;
 
-                    maskG |= 1;
-                    break;
+            case ('G'):
 
-                case ('T'):
+                maskG.B[w] |= bit;
+                break;
 
-                    maskT |= 1;
-                    maskC |= 1;
+            case ('T'):
 
-            }
+                maskT.B[w] |= bit;
+                maskC.B[w] |= bit;
 
         }
-        // load initial state
-        maskA = (maskA << 1) | 1;
-        maskC = (maskC << 1) | 1;
-        maskG = (maskG << 1) | 1;
-        maskT = (maskT << 1) | 1;
-        // save masks
-        masks[lmap['A'%16]].B_0 = maskA;
-        masks[lmap['C'%16]].B_0 = maskC;
-        masks[lmap['G'%16]].B_0 = maskG;
-        masks[lmap['T'%16]].B_0 = maskT;
     }
+    // save masks
+    masks[lmap['A'%16]] = maskA;
+    masks[lmap['C'%16]] = maskC;
+    masks[lmap['G'%16]] = maskG;
+    masks[lmap['T'%16]] = maskT;
 
 }
 
@@ -16,10 +16,14 @@
 //
 //	Jonas Fischer	jonaspost@web.de
 
+#include <random>
+#include <memory>
+
 #include "gtest/gtest.h"
 
 
 #include "ShiftAnd.h"
+#include "ReadQueue.h"
 
 
 // test fixture
@@ -31,15 +35,263 @@ class ShiftAnd_test : public testing::Test {
         virtual void SetUp()
         {
 
-            lmap['A'] = 0;
-            lmap['C'] = 1;
-            lmap['G'] = 2;
-            lmap['T'] = 3;
+            lmap['A'%16] = 0;
+            lmap['C'%16] = 1;
+            lmap['G'%16] = 2;
+            lmap['T'%16] = 3;
+        }
+
+        // index of the bitmask of letter c
+        inline uint8_t id(const char c) { return lmap[c%16]; }
+
+        // random sequence of n letters
+        std::string randomSeq(const size_t n)
+        {
+            std::uniform_int_distribution<int> letter(0, 3);
+            std::string seq(n, 'A');
+            for (char& c : seq)
+                c = "ACGT"[letter(gen)];
+            return seq;
+        }
+
+        // the matches querySeq reports for pattern p in text t with at most e errors, computed by the dynamic
+        // program of the edit distance of p to the best substring of t ending at each position (a T of p also
+        // matches a C of t), with the bookkeeping of querySeq for consecutive matching positions
+        void naiveQuery(const std::string& p, const std::string& t, const size_t e, std::vector<uint64_t>& matches, std::vector<uint8_t>& errors)
+        {
+            // column of the DP for the current letter of t, row i is the prefix of p of length i
+            std::vector<size_t> col(p.size() + 1);
+            for (size_t i = 0; i <= p.size(); ++i)
+                col[i] = i;
+            bool wasMatch = false;
+            uint8_t prevErrs = 0;
+            for (size_t j = 0; j < t.size(); ++j)
+            {
+                size_t diag = col[0];
+                col[0] = 0;
+                for (size_t i = 1; i <= p.size(); ++i)
+                {
+                    const size_t up = col[i];
+                    const bool same = p[i-1] == t[j] || (p[i-1] == 'T' && t[j] == 'C');
+                    col[i] = std::min({diag + !same, up + 1, col[i-1] + 1});
+                    diag = up;
+                }
+                if (j + 1 + e < p.size() || col[p.size()] > e)
+                {
+                    wasMatch = false;
+                    continue;
+                }
+                const uint8_t errNum = col[p.size()];
+                if (wasMatch)
+                {
+                    if (errNum <= prevErrs)
+                    {
+                        matches.back() = j;
+                        errors.back() = errNum;
+                        prevErrs = errNum;
+                    }
+                } else {
+                    matches.push_back(j);
+                    errors.push_back(errNum);
+                    wasMatch = true;
+                    prevErrs = errNum;
+                }
+            }
+        }
+
+        // copy of seq with k random substitutions, insertions or deletions
+        std::string mutate(const std::string& seq, const size_t k)
+        {
+            std::string mut = seq;
+            std::uniform_int_distribution<int> kind(0, 2);
+            for (size_t i = 0; i < k; ++i)
+            {
+                std::uniform_int_distribution<size_t> pos(0, mut.size() - 1);
+                const size_t at = pos(gen);
+                switch (kind(gen))
+                {
+                    case 0:
+                        mut[at] = mut[at] == 'A' ? 'G' : 'A';
+                        break;
+                    case 1:
+                        mut.insert(mut.begin() + at, 'G');
+                        break;
+                    default:
+                        mut.erase(mut.begin() + at);
+                }
+            }
+            return mut;
+        }
+
+        // compares the matches of ShiftAnd<E, W> with the ones of naiveQuery for random patterns of up to
+        // 64*W - 1 letters, planted with up to E + 1 edits in random texts
+        template<size_t E, size_t W>
+        void compareNaive(const size_t rounds)
+        {
+            std::uniform_int_distribution<size_t> len(2 * E + 2, 64 * W - 1);
+            std::uniform_int_distribution<size_t> flank(0, 40);
+            std::uniform_int_distribution<size_t> edits(0, E + 1);
+            for (size_t r = 0; r < rounds; ++r)
+            {
+                std::string p = randomSeq(len(gen));
+                const std::string t = randomSeq(flank(gen)) + mutate(p, edits(gen)) + randomSeq(flank(gen));
+                ShiftAnd<E, W> sa(p, lmap);
+                std::vector<uint64_t> matches;
+                std::vector<uint8_t> errors;
+                sa.querySeq(t.begin(), t.end(), matches, errors);
+                std::vector<uint64_t> expMatches;
+                std::vector<uint8_t> expErrors;
+                naiveQuery(p, t, E, expMatches, expErrors);
+                ASSERT_EQ(expMatches, matches) << "E = " << E << ", W = " << W << ", pattern " << p << ", text " << t;
+                ASSERT_EQ(expErrors, errors) << "E = " << E << ", W = " << W << ", pattern " << p << ", text " << t;
+            }
+        }
+
+        // reverse complement of seq
+        std::string revComp(const std::string& seq)
+        {
+            std::string rev(seq.rbegin(), seq.rend());
+            for (char& c : rev)
+            {
+                switch (c)
+                {
+                    case 'A': c = 'T'; break;
+                    case 'C': c = 'G'; break;
+                    case 'G': c = 'C'; break;
+                    case 'T': c = 'A'; break;
+                }
+            }
+            return rev;
+        }
+
+        // compares the multi lane queries of ShiftAnd<E> with the single lane ones on the same windows: the
+        // windows of a random text have unequal lengths, contain copies of the patterns (or of their reverse
+        // complements) with up to E + 1 substitutions, insertions and deletions and an N now and then,
+        // the last rounds use less than SALANES lanes
+        template<size_t E>
+        void compareLanes(const size_t rounds)
+        {
+            std::uniform_int_distribution<size_t> len(60, 110);
+            std::uniform_int_distribution<size_t> flank(0, 60);
+            std::uniform_int_distribution<size_t> edits(0, E + 1);
+            std::uniform_int_distribution<int> coin(0, 1);
+            std::uniform_int_distribution<int> die(0, 9);
+            size_t found = 0;
+            for (size_t r = 0; r < rounds; ++r)
+            {
+                const size_t n = r < rounds - 3 ? SALANES : SALANES - 1 - (rounds - 1 - r);
+                std::array<std::string, SALANES> pats;
+                std::vector<std::unique_ptr<ShiftAnd<E>>> owned;
+                std::array<ShiftAnd<E>*, SALANES> sas;
+                std::array<bool, SALANES> isFwd;
+                // windows with one letter of padding in front, such that the end iterator of a reverse query
+                // (one before the first letter) is valid
+                std::array<std::string, SALANES> wins;
+                std::array<const char*, SALANES> fwdStarts;
+                std::array<const char*, SALANES> fwdEnds;
+                std::array<const char*, SALANES> revStarts;
+                std::array<const char*, SALANES> revEnds;
+                for (size_t l = 0; l < SALANES; ++l)
+                {
+                    pats[l] = randomSeq(len(gen));
+                    owned.emplace_back(new ShiftAnd<E>(pats[l], lmap));
+                    sas[l] = owned.back().get();
+                    isFwd[l] = coin(gen);
+                    const std::string copy = mutate(pats[l], edits(gen));
+                    wins[l] = "G" + randomSeq(flank(gen)) + (isFwd[l] ? copy : revComp(copy)) + randomSeq(flank(gen));
+                    if (die(gen) == 0)
+                        wins[l][1 + flank(gen)] = 'N';
+                    fwdStarts[l] = wins[l].data() + 1;
+                    fwdEnds[l] = wins[l].data() + wins[l].size();
+                    revStarts[l] = wins[l].data() + wins[l].size() - 1;
+                    revEnds[l] = wins[l].data();
+                }
+
+                std::array<std::vector<uint64_t>, SALANES> matches;
+                std::array<std::vector<uint8_t>, SALANES> errors;
+                std::vector<uint64_t> expMatches;
+                std::vector<uint8_t> expErrors;
+                // one pattern, all windows forward resp. reverse
+                sas[0]->querySeqMulti(fwdStarts, fwdEnds, n, matches, errors);
+                for (size_t l = 0; l < n; ++l)
+                {
+                    expMatches.clear();
+                    expErrors.clear();
+                    sas[0]->querySeq(fwdStarts[l], fwdEnds[l], expMatches, expErrors);
+                    ASSERT_EQ(expMatches, matches[l]) << "querySeqMulti, E = " << E << ", lane " << l << ", window " << wins[l];
+                    ASSERT_EQ(expErrors, errors[l]) << "querySeqMulti, E = " << E << ", lane " << l << ", window " << wins[l];
+                    matches[l].clear();
+                    errors[l].clear();
+                }
+                sas[0]->queryRevSeqMulti(revStarts, revEnds, n, matches, errors);
+                for (size_t l = 0; l < n; ++l)
+                {
+                    expMatches.clear();
+                    expErrors.clear();
+                    sas[0]->queryRevSeq(revStarts[l], revEnds[l], expMatches, expErrors);
+                    ASSERT_EQ(expMatches, matches[l]) << "queryRevSeqMulti, E = " << E << ", lane " << l << ", window " << wins[l];
+                    ASSERT_EQ(expErrors, errors[l]) << "queryRevSeqMulti, E = " << E << ", lane " << l << ", window " << wins[l];
+                    matches[l].clear();
+                    errors[l].clear();
+                }
+                // a pattern per lane
+                ShiftAnd<E>::querySeqMultiPattern(sas, fwdStarts, fwdEnds, n, matches, errors);
+                for (size_t l = 0; l < n; ++l)
+                {
+                    expMatches.clear();
+                    expErrors.clear();
+                    sas[l]->querySeq(fwdStarts[l], fwdEnds[l], expMatches, expErrors);
+                    ASSERT_EQ(expMatches, matches[l]) << "querySeqMultiPattern, E = " << E << ", lane " << l << ", window " << wins[l];
+                    ASSERT_EQ(expErrors, errors[l]) << "querySeqMultiPattern, E = " << E << ", lane " << l << ", window " << wins[l];
+                    matches[l].clear();
+                    errors[l].clear();
+                }
+                ShiftAnd<E>::queryRevSeqMultiPattern(sas, revStarts, revEnds, n, matches, errors);
+                for (size_t l = 0; l < n; ++l)
+                {
+                    expMatches.clear();
+                    expErrors.clear();
+                    sas[l]->queryRevSeq(revStarts[l], revEnds[l], expMatches, expErrors);
+                    ASSERT_EQ(expMatches, matches[l]) << "queryRevSeqMultiPattern, E = " << E << ", lane " << l << ", window " << wins[l];
+                    ASSERT_EQ(expErrors, errors[l]) << "queryRevSeqMultiPattern, E = " << E << ", lane " << l << ", window " << wins[l];
+                    matches[l].clear();
+                    errors[l].clear();
+                }
+                // a pattern and a direction per lane
+                std::array<const char*, SALANES> starts;
+                std::array<const char*, SALANES> ends;
+                for (size_t l = 0; l < SALANES; ++l)
+                {
+                    starts[l] = isFwd[l] ? fwdStarts[l] : revStarts[l];
+                    ends[l] = isFwd[l] ? fwdEnds[l] : revEnds[l];
+                }
+                ShiftAnd<E>::queryMixedMultiPattern(sas, starts, ends, isFwd, n, matches, errors);
+                for (size_t l = 0; l < n; ++l)
+                {
+                    expMatches.clear();
+                    expErrors.clear();
+                    if (isFwd[l])
+                        sas[l]->querySeq(starts[l], ends[l], expMatches, expErrors);
+                    else
+                        sas[l]->queryRevSeq(starts[l], ends[l], expMatches, expErrors);
+                    ASSERT_EQ(expMatches, matches[l]) << "queryMixedMultiPattern, E = " << E << ", lane " << l << ", window " << wins[l];
+                    ASSERT_EQ(expErrors, errors[l]) << "queryMixedMultiPattern, E = " << E << ", lane " << l << ", window " << wins[l];
+                    found += !matches[l].empty();
+                    matches[l].clear();
+                    errors[l].clear();
+                }
+                // unused lanes report nothing
+                for (size_t l = n; l < SALANES; ++l)
+                    ASSERT_TRUE(matches[l].empty());
+            }
+            // most planted copies are found
+            ASSERT_GT(found, rounds * SALANES / 2);
         }
 
 
+        std::array<uint8_t, 16> lmap;
 
-        std::array<uint8_t, 256> lmap;
+        std::mt19937 gen{42};
 
 };
 
@@ -53,31 +305,31 @@ TEST_F(ShiftAnd_test, reset)
 
     ShiftAnd<0> sa0(seq, lmap);
 
-    sa0.active[0].B_0 = 15;
-    sa0.active[0].B_1 = 1;
+    sa0.active[0].B[0] = 15;
+    sa0.active[0].B[1] = 1;
 
     sa0.reset();
 
-    ASSERT_EQ(1, sa0.active[0].B_0);
-    ASSERT_EQ(0, sa0.active[0].B_1);
+    ASSERT_EQ(1, sa0.active[0].B[0]);
+    ASSERT_EQ(0, sa0.active[0].B[1]);
 
     ShiftAnd<2> sa2(seq, lmap);
 
-    sa2.active[0].B_0 = 15;
-    sa2.active[0].B_1 = 1;
-    sa2.active[1].B_0 = 1;
-    sa2.active[1].B_1 = 1;
-    sa2.active[2].B_0 = 0;
-    sa2.active[2].B_1 = 1;
+    sa2.active[0].B[0] = 15;
+    sa2.active[0].B[1] = 1;
+    sa2.active[1].B[0] = 1;
+    sa2.active[1].B[1] = 1;
+    sa2.active[2].B[0] = 0;
+    sa2.active[2].B[1] = 1;
 
     sa2.reset();
 
-    ASSERT_EQ(1, sa2.active[0].B_0);
-    ASSERT_EQ(0, sa2.active[0].B_1);
-    ASSERT_EQ(3, sa2.active[1].B_0);
-    ASSERT_EQ(0, sa2.active[1].B_1);
-    ASSERT_EQ(7, sa2.active[2].B_0);
-    ASSERT_EQ(0, sa2.active[2].B_1);
+    ASSERT_EQ(1, sa2.active[0].B[0]);
+    ASSERT_EQ(0, sa2.active[0].B[1]);
+    ASSERT_EQ(3, sa2.active[1].B[0]);
+    ASSERT_EQ(0, sa2.active[1].B[1]);
+    ASSERT_EQ(7, sa2.active[2].B[0]);
+    ASSERT_EQ(0, sa2.active[2].B[1]);
 
 
 }
@@ -91,14 +343,14 @@ TEST_F(ShiftAnd_test, simpleBitmasks)
 
     ShiftAnd<1> sa1(seq, lmap);
 
-    const uint64_t maskA_0 = sa1.masks[lmap['A']].B_0;
-    const uint64_t maskA_1 = sa1.masks[lmap['A']].B_1;
-    const uint64_t maskC_0 = sa1.masks[lmap['C']].B_0;
-    const uint64_t maskC_1 = sa1.masks[lmap['C']].B_1;
-    const uint64_t maskG_0 = sa1.masks[lmap['G']].B_0;
-    const uint64_t maskG_1 = sa1.masks[lmap['G']].B_1;
-    const uint64_t maskT_0 = sa1.masks[lmap['T']].B_0;
-    const uint64_t maskT_1 = sa1.masks[lmap['T']].B_1;
+    const uint64_t maskA_0 = sa1.masks[id('A')].B[0];
+    const uint64_t maskA_1 = sa1.masks[id('A')].B[1];
+    const uint64_t maskC_0 = sa1.masks[id('C')].B[0];
+    const uint64_t maskC_1 = sa1.masks[id('C')].B[1];
+    const uint64_t maskG_0 = sa1.masks[id('G')].B[0];
+    const uint64_t maskG_1 = sa1.masks[id('G')].B[1];
+    const uint64_t maskT_0 = sa1.masks[id('T')].B[0];
+    const uint64_t maskT_1 = sa1.masks[id('T')].B[1];
 
     const uint64_t full = 0xffffffffffffffffULL;
     ASSERT_EQ(0xfffffffffffffc2bULL, maskA_0);
@@ -110,8 +362,8 @@ TEST_F(ShiftAnd_test, simpleBitmasks)
     ASSERT_EQ(full, maskG_1);
     ASSERT_EQ(full, maskT_1);
 
-    ASSERT_EQ(0x0000000000000200ULL, sa1.accepted.B_0);
-    ASSERT_EQ(0, sa1.accepted.B_1);
+    ASSERT_EQ(0x0000000000000200ULL, sa1.accepted.B[0]);
+    ASSERT_EQ(0, sa1.accepted.B[1]);
 }
 
 // tests if the bitmasks are set correctly for the simple sequence
@@ -126,14 +378,14 @@ TEST_F(ShiftAnd_test, simpleBitmasksOverflow)
 
     ShiftAnd<1> sa1(seq, lmap);
 
-    const uint64_t maskA_0 = sa1.masks[lmap['A']].B_0;
-    const uint64_t maskA_1 = sa1.masks[lmap['A']].B_1;
-    const uint64_t maskC_0 = sa1.masks[lmap['C']].B_0;
-    const uint64_t maskC_1 = sa1.masks[lmap['C']].B_1;
-    const uint64_t maskG_0 = sa1.masks[lmap['G']].B_0;
-    const uint64_t maskG_1 = sa1.masks[lmap['G']].B_1;
-    const uint64_t maskT_0 = sa1.masks[lmap['T']].B_0;
-    const uint64_t maskT_1 = sa1.masks[lmap['T']].B_1;
+    const uint64_t maskA_0 = sa1.masks[id('A')].B[0];
+    const uint64_t maskA_1 = sa1.masks[id('A')].B[1];
+    const uint64_t maskC_0 = sa1.masks[id('C')].B[0];
+    const uint64_t maskC_1 = sa1.masks[id('C')].B[1];
+    const uint64_t maskG_0 = sa1.masks[id('G')].B[0];
+    const uint64_t maskG_1 = sa1.masks[id('G')].B[1];
+    const uint64_t maskT_0 = sa1.masks[id('T')].B[0];
+    const uint64_t maskT_1 = sa1.masks[id('T')].B[1];
 
     const uint64_t full = 0xffffffffffffffffULL;
     ASSERT_EQ(full, maskA_0);
@@ -145,8 +397,8 @@ TEST_F(ShiftAnd_test, simpleBitmasksOverflow)
     ASSERT_EQ(0xfffffffffffffffcULL, maskG_1);
     ASSERT_EQ(0xfffffffffffffff8ULL, maskT_1);
 
-    ASSERT_EQ(0, sa1.accepted.B_0);
-    ASSERT_EQ(0x0000000000000004ULL, sa1.accepted.B_1);
+    ASSERT_EQ(0, sa1.accepted.B[0]);
+    ASSERT_EQ(0x0000000000000004ULL, sa1.accepted.B[1]);
 }
 
 // tests if too long patterns are still correctly processed
@@ -166,14 +418,14 @@ TEST_F(ShiftAnd_test, bitmaskLongPattern)
 
     ShiftAnd<2> sa2(seq, lmap);
 
-    const uint64_t maskA_0 = sa2.masks[lmap['A']].B_0;
-    const uint64_t maskA_1 = sa2.masks[lmap['A']].B_1;
-    const uint64_t maskC_0 = sa2.masks[lmap['C']].B_0;
-    const uint64_t maskC_1 = sa2.masks[lmap['C']].B_1;
-    const uint64_t maskG_0 = sa2.masks[lmap['G']].B_0;
-    const uint64_t maskG_1 = sa2.masks[lmap['G']].B_1;
-    const uint64_t maskT_0 = sa2.masks[lmap['T']].B_0;
-    const uint64_t maskT_1 = sa2.masks[lmap['T']].B_1;
+    const uint64_t maskA_0 = sa2.masks[id('A')].B[0];
+    const uint64_t maskA_1 = sa2.masks[id('A')].B[1];
+    const uint64_t maskC_0 = sa2.masks[id('C')].B[0];
+    const uint64_t maskC_1 = sa2.masks[id('C')].B[1];
+    const uint64_t maskG_0 = sa2.masks[id('G')].B[0];
+    const uint64_t maskG_1 = sa2.masks[id('G')].B[1];
+    const uint64_t maskT_0 = sa2.masks[id('T')].B[0];
+    const uint64_t maskT_1 = sa2.masks[id('T')].B[1];
 
     const uint64_t full = 0xffffffffffffffffULL;
     ASSERT_EQ(1, maskA_0);
@@ -185,8 +437,8 @@ TEST_F(ShiftAnd_test, bitmaskLongPattern)
     ASSERT_EQ(1, maskG_1);
     ASSERT_EQ(0, maskT_1);
 
-    ASSERT_EQ(0, sa2.accepted.B_0);
-    ASSERT_EQ(0x8000000000000000ULL, sa2.accepted.B_1);
+    ASSERT_EQ(0, sa2.accepted.B[0]);
+    ASSERT_EQ(0x8000000000000000ULL, sa2.accepted.B[1]);
 }
 
 // tests if the bitmasks are set correctly for the sequence
@@ -199,10 +451,10 @@ TEST_F(ShiftAnd_test, bitmaskBisulfite)
 
     ShiftAnd<1> sa1(seq, lmap);
 
-    const uint64_t maskA_0 = sa1.masks[lmap['A']].B_0;
-    const uint64_t maskC_0 = sa1.masks[lmap['C']].B_0;
-    const uint64_t maskG_0 = sa1.masks[lmap['G']].B_0;
-    const uint64_t maskT_0 = sa1.masks[lmap['T']].B_0;
+    const uint64_t maskA_0 = sa1.masks[id('A')].B[0];
+    const uint64_t maskC_0 = sa1.masks[id('C')].B[0];
+    const uint64_t maskG_0 = sa1.masks[id('G')].B[0];
+    const uint64_t maskT_0 = sa1.masks[id('T')].B[0];
 
     ASSERT_EQ(0xfffffffffffff813ULL, maskA_0);
     ASSERT_EQ(0xffffffffffffffedULL, maskC_0);
@@ -237,10 +489,10 @@ TEST_F(ShiftAnd_test, matching_same)
     sa1.querySeq(t.begin(), t.end(), matchings1, errors1);
 
     // check the accepting masks
-    ASSERT_EQ(0, sa0.accepted.B_0);
-    ASSERT_EQ(0, sa1.accepted.B_0);
-    ASSERT_EQ(0x8000000000000000ULL, sa0.accepted.B_1);
-    ASSERT_EQ(0x8000000000000000ULL, sa1.accepted.B_1);
+    ASSERT_EQ(0, sa0.accepted.B[0]);
+    ASSERT_EQ(0, sa1.accepted.B[0]);
+    ASSERT_EQ(0x8000000000000000ULL, sa0.accepted.B[1]);
+    ASSERT_EQ(0x8000000000000000ULL, sa1.accepted.B[1]);
 
     // check size of matchings
     ASSERT_EQ(1, matchings0.size());
@@ -354,4 +606,298 @@ TEST_F(ShiftAnd_test, matching_bisulfite)
 
 }
 
-// TODO long test?
+
+// tests the single word layers of ShiftAnd<E, 1> (patterns up to 63 letters)
+TEST_F(ShiftAnd_test, singleWord)
+{
+    std::string seq = "ACACACCCC";
+
+    ShiftAnd<1, 1> sa1(seq, lmap);
+
+    // same masks as the lowest word of the two word layers
+    ASSERT_EQ(0xfffffffffffffc2bULL, sa1.masks[id('A')].B[0]);
+    ASSERT_EQ(0xffffffffffffffd5ULL, sa1.masks[id('C')].B[0]);
+    ASSERT_EQ(0xfffffffffffffc01ULL, sa1.masks[id('G')].B[0]);
+    ASSERT_EQ(0xfffffffffffffc01ULL, sa1.masks[id('T')].B[0]);
+    ASSERT_EQ(0x0000000000000200ULL, sa1.accepted.B[0]);
+
+    // a pattern of 63 letters fills the word, the accepting state is its highest bit
+    std::string full = randomSeq(63);
+    ShiftAnd<0, 1> sa0(full, lmap);
+    ASSERT_EQ(0x8000000000000000ULL, sa0.accepted.B[0]);
+
+    std::vector<uint64_t> matchings;
+    std::vector<uint8_t> errors;
+    sa0.querySeq(full.begin(), full.end(), matchings, errors);
+    ASSERT_EQ(1, matchings.size());
+    ASSERT_EQ(62, matchings[0]);
+    ASSERT_EQ(0, errors[0]);
+
+    // same results as the two word layers
+    std::string p = "AGGCGAGGC";
+    std::string t = "AGGCGAGGCGAAGCGAGGC";
+    ShiftAnd<1, 1> saP1(p, lmap);
+    ShiftAnd<1, 2> saP2(p, lmap);
+    std::vector<uint64_t> matchings1;
+    std::vector<uint8_t> errors1;
+    std::vector<uint64_t> matchings2;
+    std::vector<uint8_t> errors2;
+    saP1.querySeq(t.begin(), t.end(), matchings1, errors1);
+    saP2.querySeq(t.begin(), t.end(), matchings2, errors2);
+    ASSERT_EQ(matchings2, matchings1);
+    ASSERT_EQ(errors2, errors1);
+}
+
+// tests the layers of ShiftAnd<E, 3>, which use the generic word loops, for a pattern of 150 letters
+// such that the states are carried between all three words
+TEST_F(ShiftAnd_test, genericWordsCarry)
+{
+    std::string seq = randomSeq(150);
+
+    ShiftAnd<0, 3> sa0(seq, lmap);
+
+    // letter s is state s + 1, so the accepting state 150 is bit 22 of the highest word
+    ASSERT_EQ(0, sa0.accepted.B[0]);
+    ASSERT_EQ(0, sa0.accepted.B[1]);
+    ASSERT_EQ(0x0000000000400000ULL, sa0.accepted.B[2]);
+    // mask of the letter at position 63 (state 64) has bit 0 of the middle word set
+    ASSERT_EQ(1, sa0.masks[id(seq[63])].B[1] & 1);
+    // states behind the pattern are set in all masks
+    ASSERT_EQ(0xffffffffff800000ULL, sa0.masks[id('G')].B[2] & 0xffffffffff800000ULL);
+
+    // query the pattern letter by letter, the state of the prefix read so far is active and moves from word
+    // to word at the borders (states 64 and 128)
+    sa0.reset();
+    for (size_t i = 0; i < seq.size(); ++i)
+    {
+        sa0.queryLetter(seq[i]);
+        const size_t s = i + 1;
+        ASSERT_EQ(1, (sa0.active[0].B[s / 64] >> (s % 64)) & 1) << "after letter " << i;
+    }
+    uint8_t errNum;
+    ASSERT_TRUE(sa0.isMatch(errNum));
+    ASSERT_EQ(0, errNum);
+
+    // errors at the word borders: a substitution of the letter of state 64 and a deletion of the one of state 128
+    std::string t = "GGGG" + seq;
+    t[4 + 63] = t[4 + 63] == 'A' ? 'G' : 'A';
+    t.erase(t.begin() + 4 + 127);
+    ShiftAnd<2, 3> sa2(seq, lmap);
+    std::vector<uint64_t> matchings;
+    std::vector<uint8_t> errors;
+    sa2.querySeq(t.begin(), t.end(), matchings, errors);
+    ASSERT_EQ(1, matchings.size());
+    ASSERT_EQ(t.size() - 1, matchings[0]);
+    ASSERT_EQ(2, errors[0]);
+
+    // no match if only one error is allowed
+    ShiftAnd<1, 3> sa1(seq, lmap);
+    matchings.clear();
+    errors.clear();
+    sa1.querySeq(t.begin(), t.end(), matchings, errors);
+    ASSERT_EQ(0, matchings.size());
+}
+
+// compares the matches of one, two (specialized) and three (generic) word layers with the ones of the
+// edit distance for random patterns and texts
+TEST_F(ShiftAnd_test, matchingNaive)
+{
+    compareNaive<0, 1>(100);
+    compareNaive<1, 1>(100);
+    compareNaive<2, 1>(100);
+    compareNaive<0, 2>(100);
+    compareNaive<1, 2>(100);
+    compareNaive<2, 2>(100);
+    compareNaive<3, 2>(100);
+    compareNaive<6, 2>(100);
+    compareNaive<0, 3>(100);
+    compareNaive<1, 3>(100);
+    compareNaive<2, 3>(100);
+    compareNaive<3, 4>(50);
+}
+
+// reads longer than MyConst::SAMAXLEN do not fit into the automata, the letters beyond it would be ignored
+// by the bitmasks, hence such reads are discarded
+TEST_F(ShiftAnd_test, longReadsDiscarded)
+{
+    std::string seq = randomSeq(MyConst::SAMAXLEN);
+
+    // a read of SAMAXLEN letters fills the automaton
+    ShiftAnd<1> sa(seq, lmap);
+    ASSERT_EQ(0x8000000000000000ULL, sa.accepted.B[MyConst::SAWORDS - 1]);
+    std::vector<uint64_t> matchings;
+    std::vector<uint8_t> errors;
+    sa.querySeq(seq.begin(), seq.end(), matchings, errors);
+    ASSERT_EQ(1, matchings.size());
+    ASSERT_EQ(MyConst::SAMAXLEN - 1, matchings[0]);
+    ASSERT_EQ(0, errors[0]);
+
+    // the automaton of a longer read is the one of its first SAMAXLEN letters
+    std::string longSeq = seq + 'A';
+    ShiftAnd<1> saLong(longSeq, lmap);
+    for (const char c : std::string("ACGT"))
+    {
+        for (size_t w = 0; w < MyConst::SAWORDS; ++w)
+            ASSERT_EQ(sa.masks[id(c)].B[w], saLong.masks[id(c)].B[w]);
+    }
+    for (size_t w = 0; w < MyConst::SAWORDS; ++w)
+        ASSERT_EQ(sa.accepted.B[w], saLong.accepted.B[w]);
+
+    // which is why the ReadQueue does not match it at all
+    ASSERT_TRUE(ReadQueue::acceptLength(MyConst::SAMAXLEN, false));
+    ASSERT_TRUE(ReadQueue::acceptLength(MyConst::SAMAXLEN, true));
+    ASSERT_FALSE(ReadQueue::acceptLength(MyConst::SAMAXLEN + 1, false));
+    ASSERT_FALSE(ReadQueue::acceptLength(MyConst::SAMAXLEN + 1, true));
+    ASSERT_TRUE(ReadQueue::acceptLength(MyConst::READLEN, false));
+    ASSERT_FALSE(ReadQueue::acceptLength(MyConst::READLEN - 21, false));
+    ASSERT_TRUE(ReadQueue::acceptLength(MyConst::READLEN - 21, true));
+}
+
+// compares the multi lane queries (one pattern, a pattern per lane, a direction per lane) with the single
+// lane queries on the same forward and reverse windows, including lanes of unequal length and unused lanes
+TEST_F(ShiftAnd_test, multiLane)
+{
+    compareLanes<0>(50);
+    compareLanes<1>(50);
+    compareLanes<2>(50);
+    compareLanes<4>(50);
+}
+
+// lanes with a lower error bound (setErrorBound) record the matches of an automaton with that many errors,
+// while the other lanes keep theirs
+TEST_F(ShiftAnd_test, multiLaneErrorBound)
+{
+    std::string p = randomSeq(100);
+    // two substitutions
+    std::string t = randomSeq(30) + p + randomSeq(30);
+    t[30 + 10] = t[30 + 10] == 'A' ? 'G' : 'A';
+    t[30 + 60] = t[30 + 60] == 'A' ? 'G' : 'A';
+
+    ShiftAnd<2> sa2(p, lmap);
+    ShiftAnd<2> sa2b(p, lmap);
+    sa2b.setErrorBound(1);
+    ShiftAnd<1> sa1(p, lmap);
+
+    std::array<ShiftAnd<2>*, SALANES> sas = {&sa2, &sa2b, &sa2, &sa2b};
+    std::array<const char*, SALANES> starts;
+    std::array<const char*, SALANES> ends;
+    starts.fill(t.data());
+    ends.fill(t.data() + t.size());
+    std::array<std::vector<uint64_t>, SALANES> matches;
+    std::array<std::vector<uint8_t>, SALANES> errors;
+    ShiftAnd<2>::querySeqMultiPattern(sas, starts, ends, 2, matches, errors);
+
+    std::vector<uint64_t> expMatches;
+    std::vector<uint8_t> expErrors;
+    sa2.querySeq(t.data(), t.data() + t.size(), expMatches, expErrors);
+    ASSERT_EQ(1, expMatches.size());
+    ASSERT_EQ(2, expErrors[0]);
+    ASSERT_EQ(expMatches, matches[0]);
+    ASSERT_EQ(expErrors, errors[0]);
+    expMatches.clear();
+    expErrors.clear();
+    sa1.querySeq(t.data(), t.data() + t.size(), expMatches, expErrors);
+    ASSERT_EQ(0, expMatches.size());
+    ASSERT_EQ(expMatches, matches[1]);
+    ASSERT_EQ(expErrors, errors[1]);
+}
+
+// the reverse queries report the last letter queried (the leftmost reference letter of the match, which is exact)
+// shifted by pLen - 1, also if the read has an insertion or deletion, the multi lane queries report the same
+TEST_F(ShiftAnd_test, reversePositionIndels)
+{
+    std::string p = randomSeq(100);
+    std::string flank1 = randomSeq(20);
+    std::string flank2 = randomSeq(20);
+    // insertion in the read: the reference lacks letter 40 of the read, deletion: the reference has one more
+    std::string insRef = p;
+    insRef.erase(insRef.begin() + 40);
+    std::string delRef = p;
+    delRef.insert(delRef.begin() + 60, 'A');
+    std::array<std::string, SALANES> wins;
+    wins[0] = "G" + flank1 + revComp(p) + flank2;
+    wins[1] = "G" + flank1 + revComp(insRef) + flank2;
+    wins[2] = "G" + flank1 + revComp(delRef) + flank2;
+    wins[3] = "G" + flank1 + revComp(delRef) + flank2 + flank1;
+
+    ShiftAnd<1> sa(p, lmap);
+    std::array<const char*, SALANES> starts;
+    std::array<const char*, SALANES> ends;
+    for (size_t l = 0; l < SALANES; ++l)
+    {
+        starts[l] = wins[l].data() + wins[l].size() - 1;
+        ends[l] = wins[l].data();
+    }
+    std::array<std::vector<uint64_t>, SALANES> matches;
+    std::array<std::vector<uint8_t>, SALANES> errors;
+    sa.queryRevSeqMulti(starts, ends, SALANES, matches, errors);
+
+    const std::array<uint8_t, SALANES> expErrors = {0, 1, 1, 1};
+    for (size_t l = 0; l < SALANES; ++l)
+    {
+        std::vector<uint64_t> single;
+        std::vector<uint8_t> singleErrors;
+        sa.queryRevSeq(starts[l], ends[l], single, singleErrors);
+        ASSERT_EQ(1, single.size()) << "lane " << l;
+        ASSERT_EQ(expErrors[l], singleErrors[0]) << "lane " << l;
+        // the match starts behind the flank on the forward strand, whatever length it has there
+        ASSERT_EQ(flank1.size() + p.size() - 1, single[0]) << "lane " << l;
+        ASSERT_EQ(single, matches[l]) << "lane " << l;
+        ASSERT_EQ(singleErrors, errors[l]) << "lane " << l;
+    }
+}
+
+// a read and its reverse complement in one mixed pass (as --joint_strands) against windows with copies that have
+// an insertion or deletion: the reverse lanes report the same (left end exact) positions as queryRevSeq
+TEST_F(ShiftAnd_test, mixedPositionIndels)
+{
+    std::string p = randomSeq(100);
+    std::string flank = randomSeq(20);
+    std::string insRef = p;
+    insRef.erase(insRef.begin() + 40);
+    std::string delRef = p;
+    delRef.insert(delRef.begin() + 60, 'A');
+    std::array<std::string, SALANES> wins;
+    // forward lanes see the read, reverse lanes its reverse complement
+    wins[0] = "G" + flank + insRef + flank;
+    wins[1] = "G" + flank + revComp(insRef) + flank;
+    wins[2] = "G" + flank + delRef + flank;
+    wins[3] = "G" + flank + revComp(delRef) + flank;
+
+    ShiftAnd<1> saFwd(p, lmap);
+    ShiftAnd<1> saRev(p, lmap);
+    std::array<ShiftAnd<1>*, SALANES> sas = {&saFwd, &saRev, &saFwd, &saRev};
+    std::array<bool, SALANES> isFwd = {true, false, true, false};
+    std::array<const char*, SALANES> starts;
+    std::array<const char*, SALANES> ends;
+    for (size_t l = 0; l < SALANES; ++l)
+    {
+        starts[l] = isFwd[l] ? wins[l].data() + 1 : wins[l].data() + wins[l].size() - 1;
+        ends[l] = isFwd[l] ? wins[l].data() + wins[l].size() : wins[l].data();
+    }
+    std::array<std::vector<uint64_t>, SALANES> matches;
+    std::array<std::vector<uint8_t>, SALANES> errors;
+    ShiftAnd<1>::queryMixedMultiPattern(sas, starts, ends, isFwd, SALANES, matches, errors);
+
+    for (size_t l = 0; l < SALANES; ++l)
+    {
+        std::vector<uint64_t> single;
+        std::vector<uint8_t> singleErrors;
+        if (isFwd[l])
+        {
+            sas[l]->querySeq(starts[l], ends[l], single, singleErrors);
+            // forward lanes report the right end of the match, which is exact
+            ASSERT_EQ(1, single.size()) << "lane " << l;
+            ASSERT_EQ(flank.size() + (l == 0 ? insRef : delRef).size() - 1, single[0]) << "lane " << l;
+
+        } else {
+
+            sas[l]->queryRevSeq(starts[l], ends[l], single, singleErrors);
+            ASSERT_EQ(1, single.size()) << "lane " << l;
+            ASSERT_EQ(flank.size() + p.size() - 1, single[0]) << "lane " << l;
+        }
+        ASSERT_EQ(1, singleErrors[0]) << "lane " << l;
+        ASSERT_EQ(single, matches[l]) << "lane " << l;
+        ASSERT_EQ(singleErrors, errors[l]) << "lane " << l;
+    }
+}
@@ -0,0 +1,325 @@
+#include <omp.h>
+#include <iostream>
+#include <algorithm>
+#include <random>
+#include <chrono>
+
+#include "SynthDS.h"
+#include "../MethWriter.h"
+#include "ReadSim.h"
+
+
+constexpr uint64_t ReadSim::BLOCKREADS;
+
+// output of one block of reads
+struct ReadSim::Block
+{
+    std::string fq1;
+    std::string fq2;
+    std::string truth;
+};
+
+// reverse complement of seq
+static std::string revComp(const std::string& seq)
+{
+    std::string rc(seq.rbegin(), seq.rend());
+    for (char& c : rc)
+    {
+        switch (c)
+        {
+            case 'A': c = 'T'; break;
+            case 'C': c = 'G'; break;
+            case 'G': c = 'C'; break;
+            case 'T': c = 'A'; break;
+        }
+    }
+    return rc;
+}
+
+// appends a read in FASTQ format with name <read>_<chromosome>_<position>
+static void appendFastq(std::string& out, const uint64_t read, const std::string& chrom, const uint64_t pos, const std::string& seq)
+{
+    char num[20];
+    out += '@';
+    out.append(num, MethWriter::formatUInt(num, read));
+    out += '_';
+    out += chrom;
+    out += '_';
+    out.append(num, MethWriter::formatUInt(num, pos));
+    out += '\n';
+    out += seq;
+    out += "\n+\n";
+    out.append(seq.size(), 'I');
+    out += '\n';
+}
+
+ReadSim::ReadSim(const char* genFile, const double methRate, const double convRate, const unsigned int seed) :
+        ds(new SynthDS(genFile, methRate, convRate, seed))
+{
+
+    // the CpGs in flat per chromosome arrays, looked up by binary search while reads are generated
+    const size_t chrNum = ds->refSeqFwd.size();
+    std::vector<std::vector<std::pair<uint32_t, float> > > cpgs(chrNum);
+    for (const auto& cpg : ds->cpgMethRateFwd)
+    {
+        cpgs[cpg.first >> 32].emplace_back(static_cast<uint32_t>(cpg.first), static_cast<float>(cpg.second.sampleRate));
+    }
+    // the simulator keeps its own counts, the maps of SynthDS are no longer needed
+    ds->cpgMethRateFwd.clear();
+    ds->cpgMethRateRev.clear();
+    cpgPos.resize(chrNum);
+    cpgRate.resize(chrNum);
+    cpgBase.resize(chrNum + 1, 0);
+    for (size_t chr = 0; chr < chrNum; ++chr)
+    {
+        std::sort(cpgs[chr].begin(), cpgs[chr].end());
+        for (const auto& cpg : cpgs[chr])
+        {
+            cpgPos[chr].push_back(cpg.first);
+            cpgRate[chr].push_back(cpg.second);
+        }
+        cpgBase[chr + 1] = cpgBase[chr] + cpgPos[chr].size();
+        std::vector<std::pair<uint32_t, float> >().swap(cpgs[chr]);
+    }
+}
+
+ReadSim::~ReadSim()
+{
+}
+
+template <typename RNG>
+void ReadSim::drawFragment(RNG& rng, const size_t fragLen, uint32_t& chr, uint64_t& offset) const
+{
+
+    std::uniform_int_distribution<uint64_t> toOffset(0, fragOffsets.back() - 1);
+    while (true)
+    {
+        const uint64_t o = toOffset(rng);
+        const size_t c = std::upper_bound(fragOffsets.begin(), fragOffsets.end(), o) - fragOffsets.begin();
+        chr = fragChroms[c];
+        offset = o - (c > 0 ? fragOffsets[c - 1] : 0);
+        // fragments containing an N are drawn again
+        const std::string& seq = ds->refSeqFwd[chr];
+        if (std::find(seq.begin() + offset, seq.begin() + offset + fragLen, 'N') == seq.begin() + offset + fragLen)
+            return;
+    }
+}
+
+void ReadSim::genBlock(const Options& opts, const uint64_t b, Block& blk)
+{
+
+    // random stream of the block
+    std::seed_seq seeds{static_cast<uint32_t>(opts.seed), static_cast<uint32_t>(opts.seed >> 32), static_cast<uint32_t>(b), static_cast<uint32_t>(b >> 32)};
+    std::mt19937_64 rng(seeds);
+
+    // the distributions of SynthDS, as copies local to the block
+    std::bernoulli_distribution methToss(ds->methToss.p());
+    std::bernoulli_distribution convToss(ds->convToss.p());
+    std::bernoulli_distribution hasZeroErr(ds->hasZeroErr.p());
+    std::bernoulli_distribution hasOneErr(ds->hasOneErr.p());
+    std::bernoulli_distribution coin(0.5);
+    std::uniform_real_distribution<float> cpgToss(0, 1);
+    std::uniform_int_distribution<size_t> toFragLen(opts.paired ? opts.fragMin : opts.readLen, opts.paired ? opts.fragMax : opts.readLen);
+    std::uniform_int_distribution<size_t> toErrPos(0, opts.readLen - 1);
+    // substitutions are drawn from the three letters differing from the original one
+    std::uniform_int_distribution<int> toSubst(1, 3);
+
+    // number of errors as in SynthDS::getErrNum, introduced at distinct positions of read
+    auto addErrors = [&](std::string& read)
+    {
+        if (!opts.errors || hasZeroErr(rng))
+            return 0u;
+        const unsigned int errNum = hasOneErr(rng) ? 1 : 2;
+        size_t prev = read.size();
+        for (unsigned int e = 0; e < errNum; ++e)
+        {
+            size_t pos = toErrPos(rng);
+            while (pos == prev)
+                pos = toErrPos(rng);
+            prev = pos;
+            const int l = std::find(ds->alphabet.begin(), ds->alphabet.end(), read[pos]) - ds->alphabet.begin();
+            read[pos] = ds->alphabet[(l + toSubst(rng)) % 4];
+        }
+        return errNum;
+    };
+
+    blk.fq1.clear();
+    blk.fq2.clear();
+    blk.truth.clear();
+    const uint64_t first = b * BLOCKREADS;
+    const uint64_t last = std::min(opts.readNum, first + BLOCKREADS);
+    std::string frag;
+    char num[20];
+    for (uint64_t i = first; i < last; ++i)
+    {
+
+        const size_t fragLen = toFragLen(rng);
+        uint32_t chr;
+        uint64_t offset;
+        drawFragment(rng, fragLen, chr, offset);
+        const bool fwd = coin(rng);
+        // reverse strand fragments are read off refSeqRev, which starts at the end of the forward strand
+        const std::string& strand = fwd ? ds->refSeqFwd[chr] : ds->refSeqRev[chr];
+        const uint64_t chrLen = strand.size();
+        const uint64_t strandOff = fwd ? offset : chrLen - offset - fragLen;
+        frag.assign(strand, strandOff, fragLen);
+
+        // bisulfite conversion of the strand the fragment stems from
+        for (size_t k = 0; k < fragLen; ++k)
+        {
+
+            if (frag[k] != 'C')
+                continue;
+            const uint64_t s = strandOff + k;
+            if (s + 1 < chrLen && strand[s + 1] == 'G')
+            {
+                // forward strand position of the C of the CpG
+                const uint32_t pos = fwd ? s : chrLen - s - 2;
+                const auto it = std::lower_bound(cpgPos[chr].begin(), cpgPos[chr].end(), pos);
+                const size_t idx = it - cpgPos[chr].begin();
+                const bool meth = it != cpgPos[chr].end() && *it == pos && cpgToss(rng) < cpgRate[chr][idx];
+                if (!meth && convToss(rng))
+                    frag[k] = 'T';
+                // calls of the letters that end up in a read
+                if (it != cpgPos[chr].end() && *it == pos && (k < opts.readLen || k >= fragLen - opts.readLen))
+                {
+                    cpgCalls[4 * (cpgBase[chr] + idx) + (fwd ? 0 : 2) + (frag[k] == 'T')].fetch_add(1, std::memory_order_relaxed);
+                }
+
+            } else if (!methToss(rng) && convToss(rng)) {
+
+                frag[k] = 'T';
+            }
+        }
+
+        const std::string& chrom = ds->chrMap.at(chr);
+        std::string read1 = frag.substr(0, opts.readLen);
+        const unsigned int err1 = addErrors(read1);
+        appendFastq(blk.fq1, i, chrom, fwd ? offset : offset + fragLen - opts.readLen, read1);
+        unsigned int err2 = 0;
+        if (opts.paired)
+        {
+            std::string read2 = revComp(frag.substr(fragLen - opts.readLen));
+            err2 = addErrors(read2);
+            appendFastq(blk.fq2, i, chrom, fwd ? offset + fragLen - opts.readLen : offset, read2);
+        }
+
+        blk.truth.append(num, MethWriter::formatUInt(num, i));
+        blk.truth += '\t';
+        blk.truth += chrom;
+        blk.truth += '\t';
+        blk.truth.append(num, MethWriter::formatUInt(num, offset));
+        blk.truth += '\t';
+        blk.truth.append(num, MethWriter::formatUInt(num, offset + fragLen));
+        blk.truth += fwd ? "\t+\t" : "\t-\t";
+        blk.truth.append(num, MethWriter::formatUInt(num, err1));
+        if (opts.paired)
+        {
+            blk.truth += '\t';
+            blk.truth.append(num, MethWriter::formatUInt(num, err2));
+        }
+        blk.truth += '\n';
+    }
+}
+
+bool ReadSim::run(const Options& opts, const std::string& basename)
+{
+
+    if (opts.readLen == 0 || (opts.paired && (opts.fragMin < opts.readLen || opts.fragMax < opts.fragMin)))
+    {
+        std::cerr << "Fragments must be at least as long as the reads!\n";
+        return false;
+    }
+    // fragments are drawn from all chromosomes that can hold the longest one, proportional to their length
+    const size_t maxLen = opts.paired ? opts.fragMax : opts.readLen;
+    fragChroms.clear();
+    fragOffsets.clear();
+    for (uint32_t chr = 0; chr < ds->refSeqFwd.size(); ++chr)
+    {
+        if (ds->refSeqFwd[chr].size() < maxLen)
+            continue;
+        fragChroms.push_back(chr);
+        fragOffsets.push_back((fragOffsets.empty() ? 0 : fragOffsets.back()) + ds->refSeqFwd[chr].size() - maxLen + 1);
+    }
+    if (fragChroms.empty())
+    {
+        std::cerr << "No chromosome of the reference is long enough for a fragment of " << maxLen << " letters!\n";
+        return false;
+    }
+    std::vector<std::atomic<uint32_t> >(4 * cpgBase.back()).swap(cpgCalls);
+
+    const std::string ext = opts.gzip ? ".gz" : "";
+    MethWriter fq1;
+    MethWriter fq2;
+    MethWriter truth;
+    const std::string fq1Path = basename + (opts.paired ? "_1.fq" : ".fq") + ext;
+    const std::string fq2Path = basename + "_2.fq" + ext;
+    const std::string truthPath = basename + "_truth.tsv" + ext;
+    if (!fq1.open(fq1Path, opts.gzip) || (opts.paired && !fq2.open(fq2Path, opts.gzip)) || !truth.open(truthPath, opts.gzip))
+    {
+        std::cerr << "Could not open the output files of basename \"" << basename << "\"!\n";
+        return false;
+    }
+
+    const auto startTime = std::chrono::steady_clock::now();
+    const uint64_t blockNum = (opts.readNum + BLOCKREADS - 1) / BLOCKREADS;
+    // a few blocks per thread are generated in parallel, then written in order
+    const uint64_t roundBlocks = 4 * opts.threads;
+    std::vector<Block> blocks(roundBlocks);
+    for (uint64_t roundStart = 0; roundStart < blockNum; roundStart += roundBlocks)
+    {
+
+        const uint64_t roundEnd = std::min(blockNum, roundStart + roundBlocks);
+#pragma omp parallel for num_threads(opts.threads) schedule(dynamic,1)
+        for (uint64_t b = roundStart; b < roundEnd; ++b)
+        {
+            genBlock(opts, b, blocks[b - roundStart]);
+        }
+        for (uint64_t b = roundStart; b < roundEnd; ++b)
+        {
+            const Block& blk = blocks[b - roundStart];
+            fq1.write(blk.fq1);
+            if (opts.paired)
+                fq2.write(blk.fq2);
+            truth.write(blk.truth);
+        }
+    }
+    fq1.close();
+    if (opts.paired)
+        fq2.close();
+    truth.close();
+    const double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    std::cout << "Generated " << opts.readNum << (opts.paired ? " pairs" : " reads") << " in " << secs << "s\n";
+
+    // the calls of the reads per CpG, in the order of the chromosomes in the reference
+    const std::string cpgPath = basename + "_cpg_truth.tsv" + ext;
+    MethWriter cpgOut;
+    if (!cpgOut.open(cpgPath, opts.gzip))
+    {
+        std::cerr << "Could not open file \"" << cpgPath << "\" for writing!\n";
+        return false;
+    }
+    char num[20];
+    for (size_t chr = 0; chr < cpgPos.size(); ++chr)
+    {
+        const std::string& chrom = ds->chrMap.at(chr);
+        for (size_t idx = 0; idx < cpgPos[chr].size(); ++idx)
+        {
+            const std::atomic<uint32_t>* calls = &cpgCalls[4 * (cpgBase[chr] + idx)];
+            if (calls[0] + calls[1] + calls[2] + calls[3] == 0)
+                continue;
+            cpgOut.write(chrom);
+            cpgOut.put('\t');
+            cpgOut.write(num, MethWriter::formatUInt(num, cpgPos[chr][idx]));
+            for (unsigned int c = 0; c < 4; ++c)
+            {
+                cpgOut.put('\t');
+                cpgOut.write(num, MethWriter::formatUInt(num, calls[c]));
+            }
+            cpgOut.put('\n');
+        }
+    }
+    cpgOut.close();
+    std::cout << "Wrote reads to \"" << fq1Path << "\"" << (opts.paired ? " and \"" + fq2Path + "\"" : "") << ", truth to \"" << truthPath << "\" and \"" << cpgPath << "\"\n";
+    return true;
+}
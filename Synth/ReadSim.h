@@ -0,0 +1,94 @@
+#ifndef READSIM_H
+#define READSIM_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <cstdint>
+
+
+class SynthDS;
+
+// Streaming simulator of large bisulfite read sets from a reference loaded by SynthDS
+// Reads are generated in blocks of BLOCKREADS reads (pairs) by a team of threads and written in the order of the
+// blocks, such that only a few blocks are held in memory at a time. Every block draws from its own random stream,
+// derived from the seed and the block number, hence the output only depends on the seed and not on the number of
+// threads.
+// The reads model a directional library: each fragment stems from one strand, its Cs are kept at methylated
+// positions and converted to T with the conversion rate otherwise. CpGs are methylated with the sample rate drawn
+// for them by SynthDS, other Cs with the methylation rate given to SynthDS. The number of substitutions per read
+// follows SynthDS::getErrNum.
+//
+// Files written for basename B (with .gz appended if compressed, as BGZF readable by FAME and zcat):
+//          B.fq or B_1.fq, B_2.fq      the reads, named <read>_<chromosome>_<position> where position is the 0 based
+//                                      forward strand position of the first reference letter of the read (see
+//                                      --sweep_truth of FAME)
+//          B_truth.tsv                 per read (pair): read, chromosome, forward strand interval of the fragment,
+//                                      strand and substitutions per read
+//          B_cpg_truth.tsv             per CpG covered: the methylated and unmethylated calls of the reads on the
+//                                      forward and reverse strand, in the columns of the CpG report of FAME
+class ReadSim
+{
+
+    public:
+
+        struct Options
+        {
+            // letters per read
+            size_t readLen = 100;
+            // number of reads, resp. pairs
+            uint64_t readNum = 1000000;
+            // true iff pairs are generated, read 2 is the reverse complement of the end of the fragment
+            bool paired = false;
+            // range of the fragment lengths of pairs
+            size_t fragMin = 200;
+            size_t fragMax = 500;
+            // false iff reads are copied without substitutions
+            bool errors = true;
+            uint64_t seed = 0;
+            unsigned int threads = 1;
+            // true iff the output is BGZF compressed
+            bool gzip = false;
+        };
+
+        // loads the reference from the fasta file genFile (see SynthDS), the methylation rates of its CpGs are drawn
+        // from seed
+        ReadSim(const char* genFile, const double methRate, const double convRate, const unsigned int seed);
+        ~ReadSim();
+
+        ReadSim(const ReadSim&) = delete;
+        ReadSim& operator=(const ReadSim&) = delete;
+
+        // generates the read set and writes it to the files of basename
+        // RETURN:  false iff the reference holds no chromosome long enough for the reads or a file could not be written
+        bool run(const Options& opts, const std::string& basename);
+
+    private:
+
+        // reads (pairs) per block of the output
+        static constexpr uint64_t BLOCKREADS = 1 << 14;
+
+        struct Block;
+        // generates the reads of block b into blk
+        void genBlock(const Options& opts, const uint64_t b, Block& blk);
+        // draws the fragment, i.e. chromosome and forward strand offset, of the next read of a block
+        template <typename RNG>
+        void drawFragment(RNG& rng, const size_t fragLen, uint32_t& chr, uint64_t& offset) const;
+
+        std::unique_ptr<SynthDS> ds;
+
+        // per chromosome: positions of the CpGs (of the C, sorted) and their methylation rates
+        std::vector<std::vector<uint32_t> > cpgPos;
+        std::vector<std::vector<float> > cpgRate;
+        // first index of the CpGs of each chromosome in the counts below
+        std::vector<uint64_t> cpgBase;
+        // calls per CpG, methFwd, unmethFwd, methRev, unmethRev interleaved
+        std::vector<std::atomic<uint32_t> > cpgCalls;
+
+        // chromosomes a fragment can be drawn from and the cumulative number of their offsets
+        std::vector<uint32_t> fragChroms;
+        std::vector<uint64_t> fragOffsets;
+};
+
+#endif /* READSIM_H */
@@ -6,6 +6,10 @@
 
 #include "SynthDS.h"
 
+// true iff chrID is one of the primary assemblies of the human genome
+// (internal linkage, RefReader_istr.cpp has its own version when linked together)
+static bool isPrimaryHG(std::string chrID);
+
 SynthDS::SynthDS(const size_t refLen) :
         toIndex(0,3)
     ,   pairedOffDist(pairedMinDist, pairedMaxDist)
@@ -31,17 +35,41 @@ SynthDS::SynthDS(const size_t refLen, const unsigned int seed) :
     ,   hasOneErr(0.7)
     ,   alphabet {{ 'A', 'C', 'G', 'T' }}
 {
-    std::random_device seedGen;
-
     // init random number generator for each thread
+    // derived from seed as well, such that the generated reads are reproducible
     for (unsigned int cID = 0; cID < CORENUM; ++cID)
     {
-        randGen[cID] = std::mt19937(seedGen());
+        randGen[cID] = std::mt19937(seed + cID + 1);
     }
     initReference(refLen, seed);
     std::cout << "Generated reference sequence\n\n";
 }
 
+SynthDS::SynthDS(const std::string& seq, const unsigned int seed) :
+        toIndex(0,3)
+    ,   pairedOffDist(pairedMinDist, pairedMaxDist)
+    ,   hasZeroErr(0.75)
+    ,   hasOneErr(0.7)
+    ,   alphabet {{ 'A', 'C', 'G', 'T' }}
+{
+    for (unsigned int cID = 0; cID < CORENUM; ++cID)
+    {
+        randGen[cID] = std::mt19937(seed + cID + 1);
+    }
+    refFwd = seq;
+    refRev = std::string(seq.rbegin(), seq.rend());
+    for (char& c : refRev)
+    {
+        switch (c)
+        {
+            case 'A': c = 'T'; break;
+            case 'C': c = 'G'; break;
+            case 'G': c = 'C'; break;
+            case 'T': c = 'A'; break;
+        }
+    }
+}
+
 SynthDS::SynthDS(const char* genFile, const double methRate, const double convRate) :
         toIndex(0,3)
     ,   pairedOffDist(pairedMinDist, pairedMaxDist)
@@ -62,83 +90,149 @@ SynthDS::SynthDS(const char* genFile, const double methRate, const double convRa
     loadRefSeq(genFile);
 }
 
-// std::vector<std::string> SynthDS::genReadsFwdFixed(const size_t readLen, const size_t readNum, const unsigned int maxErrNum, std::vector<size_t>& offsets)
-// {
-//
-//     // will hold the generated reads
-//     std::vector<std::string> readSet(readNum);
-//     offsets.resize(readNum);
-//
-//     // range of indices allowed to be drawn for the reference
-//     std::uniform_int_distribution<int> toOffset (0, refFwd.size() - readLen);
-//
-//     // range of indices allowed to be drawn for errors in read
-//     std::uniform_int_distribution<int> toOffRead (0, readLen - 1);
-//
-//     // range of errors allowed to be drawn
-//     std::uniform_int_distribution<int> toErr(0, maxErrNum);
-//
-//     // coin flip for conversion type
-//     std::uniform_int_distribution<int> coin(0, 1);
-//
-// #pragma omp parallel for num_threads(CORENUM) schedule(dynamic,1000)
-//     for (size_t i = 0; i < readNum; ++i)
-//     {
-//         std::mt19937& MT = randGen[omp_get_thread_num()];
-//         // draw an offset where to draw the read
-//         const size_t offset = toOffset(MT);
-//         // generate sequence
-//         std::string read(refFwd, offset, readLen);
-//
-//         // draw number of errors
-//         const unsigned int err = toErr(MT);
-//         // introduce errors at random positions
-//         for (unsigned int e = 0; e < err; ++e)
-//         {
-//             read[toOffRead(MT)] = alphabet[toIndex(MT)];
-//
-//         }
-//         // introduce C->T  OR  G->A conversions
-//         if (coin(MT))
-//         {
-//
-//             for (size_t j = 0; j < readLen; ++j)
-//             {
-//                 if (read[j] == 'C')
-//                 {
-//                     // try conversion
-//                     if (coin(MT))
-//                     {
-//                         read[j] = 'T';
-//                     }
-//
-//                 }
-//             }
-//
-//         } else {
-//
-//             for (size_t j = 0; j < readLen; ++j)
-//             {
-//                 if (read[j] == 'G')
-//                 {
-//                     // try conversion
-//                     if (coin(MT))
-//                     {
-//                         read[j] = 'A';
-//                     }
-//
-//                 }
-//             }
-//         }
-//
-//         readSet[i] = std::move(read);
-//         offsets[i] = offset;
-//     }
-//
-//     std::cout << "Generated forward strand read set\n\n";
-//     return readSet;
-// }
-//
+SynthDS::SynthDS(const char* genFile, const double methRate, const double convRate, const unsigned int seed) :
+        toIndex(0,3)
+    ,   pairedOffDist(pairedMinDist, pairedMaxDist)
+    ,   hasZeroErr(0.75)
+    ,   hasOneErr(0.7)
+    ,   methToss(methRate)
+    ,   convToss(convRate)
+    ,   alphabet {{ 'A', 'C', 'G', 'T' }}
+{
+    for (unsigned int cID = 0; cID < CORENUM; ++cID)
+    {
+        randGen[cID] = std::mt19937(seed + cID + 1);
+    }
+    loadRefSeq(genFile);
+}
+
+std::vector<std::string> SynthDS::genReadsFwdFixed(const size_t readLen, const size_t readNum, const unsigned int maxErrNum, std::vector<size_t>& offsets)
+{
+
+    // will hold the generated reads
+    std::vector<std::string> readSet(readNum);
+    offsets.resize(readNum);
+
+    // range of indices allowed to be drawn for the reference
+    std::uniform_int_distribution<int> toOffset (0, refFwd.size() - readLen);
+
+    // range of indices allowed to be drawn for errors in read
+    std::uniform_int_distribution<int> toOffRead (0, readLen - 1);
+
+    // range of errors allowed to be drawn
+    std::uniform_int_distribution<int> toErr(0, maxErrNum);
+
+    // coin flip for conversion type
+    std::uniform_int_distribution<int> coin(0, 1);
+
+#pragma omp parallel for num_threads(CORENUM) schedule(dynamic,1000)
+    for (size_t i = 0; i < readNum; ++i)
+    {
+        std::mt19937& MT = randGen[omp_get_thread_num()];
+        // draw an offset where to draw the read
+        const size_t offset = toOffset(MT);
+        // generate sequence
+        std::string read(refFwd, offset, readLen);
+
+        // draw number of errors
+        const unsigned int err = toErr(MT);
+        // introduce errors at random positions
+        for (unsigned int e = 0; e < err; ++e)
+        {
+            read[toOffRead(MT)] = alphabet[toIndex(MT)];
+
+        }
+        // introduce C->T  OR  G->A conversions
+        if (coin(MT))
+        {
+
+            for (size_t j = 0; j < readLen; ++j)
+            {
+                if (read[j] == 'C')
+                {
+                    // try conversion
+                    if (coin(MT))
+                    {
+                        read[j] = 'T';
+                    }
+
+                }
+            }
+
+        } else {
+
+            for (size_t j = 0; j < readLen; ++j)
+            {
+                if (read[j] == 'G')
+                {
+                    // try conversion
+                    if (coin(MT))
+                    {
+                        read[j] = 'A';
+                    }
+
+                }
+            }
+        }
+
+        readSet[i] = std::move(read);
+        offsets[i] = offset;
+    }
+
+    std::cout << "Generated forward strand read set\n\n";
+    return readSet;
+}
+
+std::vector<std::string> SynthDS::genReadsBisulfite(const size_t readLen, const size_t readNum, const double errRate, const double convRate, std::vector<size_t>& offsets, std::vector<bool>& isFwd)
+{
+
+    std::vector<std::string> readSet(readNum);
+    offsets.resize(readNum);
+    isFwd.resize(readNum);
+
+    std::uniform_int_distribution<size_t> toOffset (0, refFwd.size() - readLen);
+    // substitutions are drawn from the three letters differing from the original one
+    std::uniform_int_distribution<int> toSubst (1, 3);
+    std::bernoulli_distribution errToss(errRate);
+    std::bernoulli_distribution bsToss(convRate);
+    std::bernoulli_distribution coin(0.5);
+
+    // drawn sequentially, such that the read set only depends on the seed
+    std::mt19937& MT = randGen[0];
+    for (size_t i = 0; i < readNum; ++i)
+    {
+        size_t offset = toOffset(MT);
+        while (refFwd.find('N', offset) < offset + readLen)
+        {
+            offset = toOffset(MT);
+        }
+        const bool fwd = coin(MT);
+        // reverse strand reads are read off refRev, which starts at the end of the forward strand
+        std::string read = fwd ? refFwd.substr(offset, readLen) : refRev.substr(refFwd.size() - offset - readLen, readLen);
+
+        for (char& c : read)
+        {
+            if (c == 'C' && bsToss(MT))
+            {
+                c = 'T';
+            }
+        }
+        for (char& c : read)
+        {
+            if (errToss(MT))
+            {
+                const int l = std::find(alphabet.begin(), alphabet.end(), c) - alphabet.begin();
+                c = alphabet[(l + toSubst(MT)) % 4];
+            }
+        }
+
+        readSet[i] = std::move(read);
+        offsets[i] = offset;
+        isFwd[i] = fwd;
+    }
+    return readSet;
+}
+
 // std::vector<std::string> SynthDS::genReadsRevFixed(const size_t readLen, const size_t readNum, const unsigned int maxErrNum)
 // {
 //
@@ -1520,7 +1614,7 @@ void SynthDS::loadRefSeq(const char* genFile)
         seqFwd.shrink_to_fit();
         seqRev.shrink_to_fit();
         refSeqFwd.emplace_back(move(seqFwd));
-        std::reverse(seqRev.begin(), seqFwd.end());
+        std::reverse(seqRev.begin(), seqRev.end());
         refSeqRev.emplace_back(move(seqRev));
     }
 
@@ -1548,7 +1642,7 @@ void SynthDS::initReference(const size_t refLen, const unsigned int seed)
     }
 }
 
-bool isPrimaryHG(std::string chrID)
+static bool isPrimaryHG(std::string chrID)
 {
 	for (unsigned int i = 1; i <= 22; ++i)
 	{
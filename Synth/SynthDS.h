@@ -23,7 +23,6 @@ constexpr unsigned int errNum = 2;
 // make each distribution thread safe?
 #define CORENUM  1
 
-bool isPrimaryHG(std::string);
 
 // class representing a synthetic dataset
 class SynthDS
@@ -48,6 +47,13 @@ class SynthDS
         //          seed        initial seed for the internal pseudo random number generator
         SynthDS(const size_t refLen, const unsigned int seed);
 
+        // uses the given sequence (e.g. a slice of a real genome) as reference
+        //
+        // ARGUMENTS:
+        //          seq         reference sequence over {A,C,G,T,N}
+        //          seed        initial seed for the internal pseudo random number generator
+        SynthDS(const std::string& seq, const unsigned int seed);
+
         // loads reference specified by file into DS
         //
         // ARGUMENTS:
@@ -56,6 +62,15 @@ class SynthDS
         //          convRate    specified bisulfite conversion rate [0, 1.0]
         SynthDS(const char* genFile, const double methRate, const double convRate = 0.99);
 
+        // loads reference specified by file into DS, with the methylation rates of the CpGs drawn from seed
+        //
+        // ARGUMENTS:
+        //          genFile     file containing reference in fasta format
+        //          methRate    specified methylation rate [0, 1.0] that should be reflected in generated reads
+        //          convRate    specified bisulfite conversion rate [0, 1.0]
+        //          seed        initial seed for the internal pseudo random number generator
+        SynthDS(const char* genFile, const double methRate, const double convRate, const unsigned int seed);
+
         // ----------
 
 
@@ -73,6 +88,22 @@ class SynthDS
         std::vector<std::string> genReadsFwdFixed(const size_t readLen, const size_t readNum, const unsigned int maxErrNum, std::vector<size_t>& offsets);
         std::vector<std::string> genReadsRevFixed(const size_t readLen, const size_t readNum, const unsigned int maxErrNum);
 
+        // generate set of bisulfite reads of given length drawn from both strands of the reference,
+        // as sequenced from a directional library, i.e. the read is C->T converted on the strand it stems from
+        // windows containing an N are not drawn
+        //
+        // ARGUMENTS:
+        //          readLen     length of the returned reads
+        //          readNum     number of reads to be generated
+        //          errRate     probability of a substitution per letter of the read
+        //          convRate    probability of a C of the read strand being converted to T
+        //          offsets     will hold the forward strand offset of the first reference letter covered by the read
+        //          isFwd       will hold true iff the read stems from the forward strand
+        //
+        // RETURN:
+        //          vector of length readNum holding the generated reads
+        std::vector<std::string> genReadsBisulfite(const size_t readLen, const size_t readNum, const double errRate, const double convRate, std::vector<size_t>& offsets, std::vector<bool>& isFwd);
+
         // generate set of reads of given length drawn from a LOADED reference
         std::vector<std::string> genReadsFwdRef(const size_t readLen, const size_t readNum, const unsigned int maxErrNum, std::vector<std::pair<size_t, size_t> >& offsets, std::vector<std::array<int, errNum> >& errOffs);
         std::vector<std::string> genReadsRevRef(const size_t readLen, const size_t readNum, const unsigned int maxErrNum, std::vector<std::pair<size_t, size_t> >& offsets, std::vector<std::array<int, errNum> >& errOffs);
@@ -0,0 +1,161 @@
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include <limits>
+
+#include "../CONST.h"
+#include "ReadSim.h"
+
+
+static void printHelp()
+{
+    std::cout << "\nSimReads - parallel simulator of large bisulfite read sets for benchmarking FAME\n\n";
+    std::cout << "Usage: SimReads --genome <fasta> --out_basename <B> [options]\n\n";
+    std::cout << "    --genome <fasta>        reference to draw the reads from (primary chromosomes, see SynthDS)\n";
+    std::cout << "    --out_basename <B>      writes B.fq (B_1.fq, B_2.fq for pairs), B_truth.tsv and B_cpg_truth.tsv\n";
+    std::cout << "    --reads <n>             number of reads, resp. pairs (default 1000000)\n";
+    std::cout << "    --read_len <n>          letters per read (default 100)\n";
+    std::cout << "    --paired                generate pairs of a directional library\n";
+    std::cout << "    --frag_min <n>          shortest fragment of a pair (default 200)\n";
+    std::cout << "    --frag_max <n>          longest fragment of a pair (default 500)\n";
+    std::cout << "    --meth_rate <p>         methylation rate of Cs outside of CpGs (default 0.01)\n";
+    std::cout << "    --conv_rate <p>         bisulfite conversion rate of unmethylated Cs (default 0.99)\n";
+    std::cout << "    --no_errors             copy the reads without substitutions\n";
+    std::cout << "    --seed <n>              seed of the random streams, the reads only depend on it (default 0)\n";
+    std::cout << "    --threads <n>           threads generating and compressing the reads (default 1)\n";
+    std::cout << "    --gzip                  write BGZF compressed files (.gz)\n\n";
+}
+
+// value of the option at argv[i], i.e. argv[i + 1], terminates if there is none
+static const char* optionValue(int argc, char** argv, int& i)
+{
+    if (i + 1 >= argc)
+    {
+        std::cerr << "No value for option \"" << argv[i] << "\" provided! Terminating...\n\n";
+        exit(1);
+    }
+    return argv[++i];
+}
+
+static uint64_t parseUInt(const char* opt, const char* val)
+{
+    char* end;
+    const unsigned long long n = strtoull(val, &end, 10);
+    if (*val == '\0' || *end != '\0' || *val == '-')
+    {
+        std::cerr << "Invalid argument \"" << val << "\" for option \"" << opt << "\"! Terminating...\n\n";
+        exit(1);
+    }
+    return n;
+}
+
+static double parseRate(const char* opt, const char* val)
+{
+    char* end;
+    const double p = strtod(val, &end);
+    if (*val == '\0' || *end != '\0' || !(p >= 0 && p <= 1))
+    {
+        std::cerr << "Invalid probability \"" << val << "\" for option \"" << opt << "\"! Terminating...\n\n";
+        exit(1);
+    }
+    return p;
+}
+
+int main(int argc, char** argv)
+{
+
+    std::string genomeFile;
+    std::string basename;
+    double methRate = 0.01;
+    double convRate = 0.99;
+    ReadSim::Options opts;
+
+    if (argc == 1)
+    {
+        printHelp();
+        return 0;
+    }
+    for (int i = 1; i < argc; ++i)
+    {
+
+        const std::string arg(argv[i]);
+        if (arg == "-h" || arg == "--help")
+        {
+            printHelp();
+            return 0;
+
+        } else if (arg == "--genome") {
+
+            genomeFile = optionValue(argc, argv, i);
+
+        } else if (arg == "--out_basename") {
+
+            basename = optionValue(argc, argv, i);
+
+        } else if (arg == "--reads") {
+
+            opts.readNum = parseUInt(arg.c_str(), optionValue(argc, argv, i));
+
+        } else if (arg == "--read_len") {
+
+            opts.readLen = parseUInt(arg.c_str(), optionValue(argc, argv, i));
+
+        } else if (arg == "--paired") {
+
+            opts.paired = true;
+
+        } else if (arg == "--frag_min") {
+
+            opts.fragMin = parseUInt(arg.c_str(), optionValue(argc, argv, i));
+
+        } else if (arg == "--frag_max") {
+
+            opts.fragMax = parseUInt(arg.c_str(), optionValue(argc, argv, i));
+
+        } else if (arg == "--meth_rate") {
+
+            methRate = parseRate(arg.c_str(), optionValue(argc, argv, i));
+
+        } else if (arg == "--conv_rate") {
+
+            convRate = parseRate(arg.c_str(), optionValue(argc, argv, i));
+
+        } else if (arg == "--no_errors") {
+
+            opts.errors = false;
+
+        } else if (arg == "--seed") {
+
+            opts.seed = parseUInt(arg.c_str(), optionValue(argc, argv, i));
+
+        } else if (arg == "--threads") {
+
+            const uint64_t threads = parseUInt(arg.c_str(), optionValue(argc, argv, i));
+            if (threads == 0 || threads > std::numeric_limits<uint16_t>::max())
+            {
+                std::cerr << "Invalid number of threads " << threads << "! Terminating...\n\n";
+                exit(1);
+            }
+            opts.threads = threads;
+
+        } else if (arg == "--gzip") {
+
+            opts.gzip = true;
+
+        } else {
+
+            std::cerr << "Don't know the option \"" << arg << "\", maybe you forgot a flag?\n\n";
+            exit(1);
+        }
+    }
+    if (genomeFile.empty() || basename.empty())
+    {
+        std::cerr << "Options --genome and --out_basename are required! Terminating...\n\n";
+        exit(1);
+    }
+    // the writers compress with CORENUM threads
+    MyConst::coreNum = opts.threads;
+
+    ReadSim sim(genomeFile.c_str(), methRate, convRate, static_cast<unsigned int>(opts.seed));
+    return sim.run(opts, basename) ? 0 : 1;
+}
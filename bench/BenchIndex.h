@@ -0,0 +1,57 @@
+//	Metal - A fast methylation alignment and calling tool for WGBS data.
+//	Copyright (C) 2017  Jonas Fischer
+//
+//	This program is free software: you can redistribute it and/or modify
+//	it under the terms of the GNU General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+//
+//	This program is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//	GNU General Public License for more details.
+//
+//	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Jonas Fischer	jonaspost@web.de
+
+
+#ifndef BENCHINDEX_H
+#define BENCHINDEX_H
+
+#include <string>
+#include <fstream>
+#include <cstdio>
+
+#include "../CONST.h"
+#include "../structs.h"
+#include "../RefGenome.h"
+#include "../RefReader_istr.h"
+
+// builds the FAME index over seq (as single chromosome chr1) through a fasta file and stores it in indexPath,
+// as done by FAME. The matching tables (kmerTableSmall) only exist in a loaded index, hence the index must be
+// loaded from indexPath before queries are run against it.
+// withOffsets: store the k-mer offsets (see RefGenome::save)
+inline void buildIndex(const std::string& seq, const std::string& indexPath, const bool withOffsets = false)
+{
+
+    const std::string fastaPath = indexPath + ".fa";
+    {
+        std::ofstream fasta(fastaPath);
+        fasta << ">chr1\n";
+        for (size_t pos = 0; pos < seq.size(); pos += 80)
+            fasta << seq.substr(pos, 80) << "\n";
+    }
+    std::vector<struct CpG> cpgTab;
+    std::vector<struct CpG> cpgStartTab;
+    std::vector<std::vector<char> > genSeq;
+    std::unordered_map<chromId, std::string> chrMap;
+    std::vector<uint32_t> chrOffsets;
+    readReference(fastaPath, cpgTab, cpgStartTab, genSeq, chrMap, chrOffsets, false, regionMap(), 0, 0, 0, "");
+    RefGenome build(std::move(cpgTab), std::move(cpgStartTab), genSeq, false, chrMap, std::move(chrOffsets));
+    build.save(indexPath, withOffsets);
+    std::remove(fastaPath.c_str());
+}
+
+#endif /* BENCHINDEX_H */
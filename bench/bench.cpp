@@ -0,0 +1,316 @@
+//	Metal - A fast methylation alignment and calling tool for WGBS data.
+//	Copyright (C) 2017  Jonas Fischer
+//
+//	This program is free software: you can redistribute it and/or modify
+//	it under the terms of the GNU General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+//
+//	This program is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//	GNU General Public License for more details.
+//
+//	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Jonas Fischer	jonaspost@web.de
+
+
+// Microbenchmarks of the matching kernels
+// All inputs are generated by SynthDS from a random reference, the index is built over the same reference.
+// Every kernel is run single threaded over all reads, results are reported as ns per call and reads per second.
+
+// SynthDS.h defines its own CORENUM, it must be included before the project headers
+#include "../Synth/SynthDS.h"
+#undef CORENUM
+
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <cstdio>
+#include <algorithm>
+
+#include "../CONST.h"
+#include "../structs.h"
+#include "../ShiftAnd.h"
+#include "../LevenshtDP.h"
+#include "../RefGenome.h"
+#include "../RefReader_istr.h"
+#include "BenchIndex.h"
+#include "../MetaCounter.h"
+#include "../ReadQueue.h"
+
+
+// runs f(i) for all i in [0, n) once and prints the time per call and the resulting read throughput
+// readsPerCall is the number of reads a single call of f processes
+template <typename F>
+void bench(const std::string& name, const size_t n, const double readsPerCall, F f)
+{
+
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    uint64_t check = 0;
+    for (size_t i = 0; i < n; ++i)
+    {
+        check += f(i);
+    }
+    const double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << name << "\t" << n << "\t" << sec << "\t" << 1e9 * sec / n << "\t" << n * readsPerCall / sec << "\t" << check << "\n";
+}
+
+// reverse complement of seq
+std::string revComp(const std::string& seq)
+{
+
+    std::string rev(seq.rbegin(), seq.rend());
+    for (char& c : rev)
+    {
+        switch (c)
+        {
+            case 'A': c = 'T'; break;
+            case 'C': c = 'G'; break;
+            case 'G': c = 'C'; break;
+            case 'T': c = 'A'; break;
+        }
+    }
+    return rev;
+}
+
+// ShiftAnd<E> queried with the reads against the reference slices the aligner verifies,
+// i.e. a window of WINLEN letters around the origin of the read
+template <size_t E>
+void benchShiftAnd(std::vector<std::string>& reads, std::vector<std::string>& revReads, const std::vector<size_t>& offsets, std::vector<PackedSeq>& seq, std::array<uint8_t, 16>& lmap)
+{
+
+    const std::string e = std::to_string(E);
+    std::vector<uint64_t> matches;
+    std::vector<uint8_t> errors;
+    // start of the window around read i
+    auto winStart = [&](const size_t i)
+    {
+        const size_t s = offsets[i] > MyConst::WINLEN / 2 ? offsets[i] - MyConst::WINLEN / 2 : 0;
+        return std::min(s, seq[0].size() - MyConst::WINLEN);
+    };
+    bench("ShiftAnd<" + e + ">::ctor", reads.size(), 1, [&](const size_t i)
+    {
+        ShiftAnd<E> sa(reads[i], lmap);
+        return sa.size();
+    });
+    bench("ShiftAnd<" + e + ">::querySeq", reads.size(), 1, [&](const size_t i)
+    {
+        ShiftAnd<E> sa(reads[i], lmap);
+        matches.clear();
+        errors.clear();
+        const PackedSeq::const_iterator start = seq[0].begin() + winStart(i);
+        sa.querySeq(start, start + MyConst::WINLEN, matches, errors);
+        return matches.size();
+    });
+    bench("ShiftAnd<" + e + ">::queryRevSeq", reads.size(), 1, [&](const size_t i)
+    {
+        ShiftAnd<E> sa(revReads[i], lmap);
+        matches.clear();
+        errors.clear();
+        const PackedSeq::const_iterator start = seq[0].begin() + winStart(i);
+        sa.queryRevSeq(start + MyConst::WINLEN - 1, start - 1, matches, errors);
+        return matches.size();
+    });
+    // SALANES windows of neighbouring reads at once, as done by saQuerySeedSetRef
+    std::array<PackedSeq::const_iterator, SALANES> starts;
+    std::array<PackedSeq::const_iterator, SALANES> ends;
+    std::array<std::vector<uint64_t>, SALANES> laneMatches;
+    std::array<std::vector<uint8_t>, SALANES> laneErrors;
+    bench("ShiftAnd<" + e + ">::querySeqMulti", reads.size() / SALANES, SALANES, [&](const size_t i)
+    {
+        ShiftAnd<E> sa(reads[i * SALANES], lmap);
+        uint64_t found = 0;
+        for (size_t l = 0; l < SALANES; ++l)
+        {
+            starts[l] = seq[0].begin() + winStart(i * SALANES + l);
+            ends[l] = starts[l] + MyConst::WINLEN;
+            laneMatches[l].clear();
+            laneErrors[l].clear();
+        }
+        sa.querySeqMulti(starts, ends, SALANES, laneMatches, laneErrors);
+        for (size_t l = 0; l < SALANES; ++l)
+            found += laneMatches[l].size();
+        return found;
+    });
+}
+
+// banded alignment of the reads to their origin with the comparators of ReadQueue
+template <size_t E>
+void benchLevenshtDP(std::vector<std::string>& reads, std::vector<std::string>& revReads, const std::vector<size_t>& offsets, std::vector<PackedSeq>& seq)
+{
+
+    const std::string e = std::to_string(E);
+    ReadQueue::CompiFwd cmpFwd;
+    ReadQueue::CompiRev cmpRev;
+    std::vector<char> refWin;
+    // unpacks the reference ending at the last letter of read i, returns pointer to its last letter
+    auto refEnd = [&](const size_t i)
+    {
+        refWin.resize(reads[i].size() + E);
+        seq[0].unpack(static_cast<std::ptrdiff_t>(offsets[i] + reads[i].size()) - refWin.size(), refWin.size(), refWin.data());
+        return refWin.data() + refWin.size() - 1;
+    };
+    bench("LevenshtDP<" + e + ">::runDPFill<CompiFwd>", reads.size(), 1, [&](const size_t i)
+    {
+        LevenshtDP<uint16_t, E> lev(reads[i], refEnd(i));
+        lev.template runDPFill<ReadQueue::CompiFwd>(cmpFwd);
+        return lev.getEditDist();
+    });
+    bench("LevenshtDP<" + e + ">::runDPFillRev<CompiRev>", reads.size(), 1, [&](const size_t i)
+    {
+        LevenshtDP<uint16_t, E> lev(revReads[i], refEnd(i));
+        lev.template runDPFillRev<ReadQueue::CompiRev>(cmpRev);
+        return lev.getEditDist();
+    });
+}
+
+void printHelp()
+{
+
+    std::cout << "\nMicrobenchmarks of the FAME matching kernels on synthetic data\n\n";
+    std::cout << "\t-l [.]\tlength of the random reference (default 2000000)\n";
+    std::cout << "\t-n [.]\tnumber of reads (default 100000)\n";
+    std::cout << "\t-s [.]\tseed of the random generators (default 42)\n";
+    std::cout << "\t-p [.]\tnumber of threads for the index construction (default " << MyConst::DEFAULTCORENUM << ")\n\n";
+    std::cout << "Output columns: kernel, calls, seconds, ns/call, reads/s, checksum\n";
+    std::cout << "(ShiftAnd queries count one read per verified window of WINLEN letters)\n\n";
+}
+
+int main(int argc, char** argv)
+{
+
+    size_t refLength = 2000000;
+    size_t reads = 100000;
+    unsigned int seed = 42;
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg(argv[i]);
+        if (arg == "-h" || arg == "--help")
+        {
+            printHelp();
+            return 0;
+        }
+        if (i + 1 >= argc)
+        {
+            std::cerr << "No value for option \"" << arg << "\" provided! Terminating...\n\n";
+            exit(1);
+        }
+        if (arg == "-l")
+        {
+            refLength = std::stoul(argv[++i]);
+        } else if (arg == "-n") {
+            reads = std::stoul(argv[++i]);
+        } else if (arg == "-s") {
+            seed = std::stoul(argv[++i]);
+        } else if (arg == "-p") {
+            MyConst::coreNum = std::stoul(argv[++i]);
+        } else {
+            std::cerr << "Don\'t know the option \"" << arg << "\". Terminating...\n\n";
+            exit(1);
+        }
+    }
+    MyConst::checkRuntimeParams();
+
+    // synthetic reference and bisulfite converted reads with errors
+    SynthDS synth(refLength, seed);
+    std::vector<size_t> offsets;
+    std::vector<std::string> readSet = synth.genReadsFwdFixed(MyConst::READLEN, reads, MyConst::MISCOUNT, offsets);
+    std::vector<std::string> revReadSet(readSet.size());
+    std::transform(readSet.begin(), readSet.end(), revReadSet.begin(), revComp);
+
+    // index over the reference, built and stored as done by FAME
+    const std::string indexPath = "bench_ref.idx";
+    buildIndex(synth.getRef(), indexPath);
+    RefGenome ref(indexPath);
+    // the index stays mapped after the file is removed
+    std::remove(indexPath.c_str());
+
+    std::array<uint8_t, 16> lmap;
+    lmap['A'%16] = 0;
+    lmap['C'%16] = 1;
+    lmap['G'%16] = 2;
+    lmap['T'%16] = 3;
+
+    std::cout << "\nkernel\tcalls\tseconds\tns/call\treads/s\tchecksum\n";
+
+    benchShiftAnd<0>(readSet, revReadSet, offsets, ref.fullSeq, lmap);
+    benchShiftAnd<1>(readSet, revReadSet, offsets, ref.fullSeq, lmap);
+    benchShiftAnd<2>(readSet, revReadSet, offsets, ref.fullSeq, lmap);
+    benchShiftAnd<3>(readSet, revReadSet, offsets, ref.fullSeq, lmap);
+    benchShiftAnd<4>(readSet, revReadSet, offsets, ref.fullSeq, lmap);
+    benchShiftAnd<5>(readSet, revReadSet, offsets, ref.fullSeq, lmap);
+    benchShiftAnd<6>(readSet, revReadSet, offsets, ref.fullSeq, lmap);
+
+    for (const unsigned int e : MyConst::ERRBUDGETS)
+    {
+        switch (e)
+        {
+            case 2: benchLevenshtDP<2>(readSet, revReadSet, offsets, ref.fullSeq); break;
+            case 4: benchLevenshtDP<4>(readSet, revReadSet, offsets, ref.fullSeq); break;
+            case 6: benchLevenshtDP<6>(readSet, revReadSet, offsets, ref.fullSeq); break;
+            case 8: benchLevenshtDP<8>(readSet, revReadSet, offsets, ref.fullSeq); break;
+        }
+    }
+
+    // rolling spaced seed hash over all k-mers of a read
+    bench("ntHash::NTPS64 (per read)", readSet.size(), 1, [&](const size_t i)
+    {
+        const std::string& r = readSet[i];
+        uint64_t fhVal;
+        uint64_t h = ntHash::NTPS64(r.data(), MyConst::SEED, MyConst::KMERLEN, fhVal);
+        uint64_t sum = h;
+        for (size_t k = 0; k + MyConst::KMERLEN < r.size(); ++k)
+        {
+            h = ntHash::NTPS64(r.data() + k + 1, MyConst::SEED, r[k], r[k + MyConst::KMERLEN], MyConst::KMERLEN, fhVal);
+            sum += h;
+        }
+        return sum;
+    });
+    // the same hashes computed for all k-mers at once, as getSeedBuckets does
+    std::vector<uint64_t> hashBuf;
+    bench("RefGenome::hashKmers (per read)", readSet.size(), 1, [&](const size_t i)
+    {
+        const uint64_t* h = ref.hashKmers(readSet[i], hashBuf);
+        uint64_t sum = 0;
+        for (size_t k = 0; k + MyConst::KMERLEN <= readSet[i].size(); ++k)
+        {
+            sum += h[k];
+        }
+        return sum;
+    });
+
+    // hash table buckets of all seeds of a read
+    std::vector<std::pair<uint64_t, uint64_t> > buckets;
+    std::vector<uint64_t> hashes;
+    std::vector<uint8_t> prints;
+    bench("RefGenome::getSeedBuckets", readSet.size(), 1, [&](const size_t i)
+    {
+        return ref.getSeedBuckets(readSet[i], buckets, hashes, prints);
+    });
+    // buckets and counting of the seed hits per window, the work of ReadQueue::getSeedRefs
+    MetaCounter fwdMetas;
+    MetaCounter revMetas;
+    bench("seed lookup and counting (getSeedRefs)", readSet.size(), 1, [&](const size_t i)
+    {
+        ref.getSeedBuckets(readSet[i], buckets, hashes, prints);
+        fwdMetas.clear();
+        revMetas.clear();
+        for (const std::pair<uint64_t, uint64_t>& b : buckets)
+        {
+            for (uint64_t k = b.first; k < b.second; ++k)
+            {
+                const KMER_S::kmer kmer = ref.kmerTableSmall[k];
+                if (KMER_S::isFwd(kmer))
+                    fwdMetas.add(KMER_S::getMetaCpG(kmer));
+                else
+                    revMetas.add(KMER_S::getMetaCpG(kmer));
+            }
+        }
+        return fwdMetas.size() + revMetas.size();
+    });
+
+    return 0;
+}
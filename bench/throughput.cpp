@@ -0,0 +1,317 @@
+//	Metal - A fast methylation alignment and calling tool for WGBS data.
+//	Copyright (C) 2017  Jonas Fischer
+//
+//	This program is free software: you can redistribute it and/or modify
+//	it under the terms of the GNU General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+//
+//	This program is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//	GNU General Public License for more details.
+//
+//	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Jonas Fischer	jonaspost@web.de
+
+
+
+// End-to-end throughput of single-end matching
+// Bisulfite reads with known origin are simulated by SynthDS from a random reference or a slice of a real genome,
+// written to a FASTQ file and streamed through ReadQueue once for every thread count. Reported are reads/s,
+// reads/s per thread and the accuracy of the unique matches with respect to the known read offsets.
+// With -m the reads are fed to ReadQueue from memory (see ReadSource.h) instead of the file, the parse seconds of
+// both modes tell the cost of reading and parsing the file apart from the matching.
+
+// SynthDS.h defines its own CORENUM, it must be included before the project headers
+#include "../Synth/SynthDS.h"
+#undef CORENUM
+
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <cstdio>
+#include <cctype>
+#include <sstream>
+#include <memory>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "../CONST.h"
+#include "../structs.h"
+#include "../RefGenome.h"
+#include "../ReadQueue.h"
+#include "BenchIndex.h"
+
+
+// matching outcome of the reads of one run
+struct Accuracy
+{
+    uint64_t correct = 0;
+    uint64_t wrong = 0;
+    uint64_t unmatched = 0;
+};
+
+// first sliceLen letters of the first sequence in the fasta file genFile, upper case
+std::string readSlice(const std::string& genFile, const size_t sliceLen)
+{
+
+    std::ifstream ifs(genFile);
+    if (!ifs)
+    {
+        std::cerr << "Opening file " << genFile << " failed! Terminating...\n\n";
+        exit(1);
+    }
+    std::string seq;
+    std::string line;
+    bool inSeq = false;
+    while (seq.size() < sliceLen && std::getline(ifs, line))
+    {
+        if (!line.empty() && line[0] == '>')
+        {
+            if (inSeq)
+                break;
+            inSeq = true;
+            continue;
+        }
+        for (const char c : line)
+        {
+            const char u = std::toupper(c);
+            seq.push_back((u == 'A' || u == 'C' || u == 'G' || u == 'T') ? u : 'N');
+        }
+    }
+    if (seq.size() > sliceLen)
+        seq.resize(sliceLen);
+    if (seq.size() < MyConst::WINLEN)
+    {
+        std::cerr << "Genome slice of " << genFile << " is too short! Terminating...\n\n";
+        exit(1);
+    }
+    return seq;
+}
+
+// comma separated list of thread counts
+std::vector<unsigned int> parseThreadList(const std::string& list)
+{
+
+    std::vector<unsigned int> threads;
+    std::stringstream ss(list);
+    std::string t;
+    while (std::getline(ss, t, ','))
+    {
+        const unsigned long n = std::stoul(t);
+        if (n == 0)
+        {
+            std::cerr << "Thread counts must be positive! Terminating...\n\n";
+            exit(1);
+        }
+        threads.push_back(n);
+    }
+    return threads;
+}
+
+void printHelp()
+{
+
+    std::cout << "\nEnd-to-end throughput of FAME single-end matching on simulated bisulfite reads\n\n";
+    std::cout << "\t-g [.]\tfasta file, its first sequence is used as reference (default: random reference)\n";
+    std::cout << "\t-l [.]\tlength of the reference or genome slice (default 2000000)\n";
+    std::cout << "\t-n [.]\tnumber of reads (default 1000000)\n";
+    std::cout << "\t-e [.]\tsubstitution rate per read letter (default 0.01)\n";
+    std::cout << "\t-c [.]\tbisulfite conversion rate of the C of the read strand (default 0.99)\n";
+    std::cout << "\t-t [.]\tcomma separated thread counts, e.g. 1,2,4,8,16,32,64 (default: powers of 2 up to the number of cores)\n";
+    std::cout << "\t-s [.]\tseed of the random generators (default 42)\n";
+    std::cout << "\t-k    \tindex with k-mer offsets, reads are verified around their predicted position (see --kmer_offsets)\n";
+    std::cout << "\t-a    \tadaptive error bound in the verification (see --adaptive_errors)\n";
+    std::cout << "\t-b    \tverify the candidate windows of a batch sorted by window (see --batch_verify)\n";
+    std::cout << "\t-T    \tmatch with a low error budget first and retry the unmatched reads (see --tiered_errors)\n";
+    std::cout << "\t-m    \tfeed the reads to ReadQueue from memory instead of a FASTQ file\n\n";
+    std::cout << "Output columns: threads, reads, match seconds, reads/s, reads/s per thread, speedup over the first row,\n";
+    std::cout << "correct, wrong and not (uniquely) matched reads in percent, seconds spent parsing the chunks\n";
+    std::cout << "(a match is correct if its end is within MISCOUNT letters of the end of the origin of the read)\n\n";
+}
+
+int main(int argc, char** argv)
+{
+
+    std::string genFile = "";
+    size_t refLength = 2000000;
+    size_t reads = 1000000;
+    double errRate = 0.01;
+    double convRate = 0.99;
+    unsigned int seed = 42;
+    bool kmerOffsets = false;
+    bool fromMemory = false;
+    std::vector<unsigned int> threads;
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg(argv[i]);
+        if (arg == "-h" || arg == "--help")
+        {
+            printHelp();
+            return 0;
+        }
+        if (arg == "-k")
+        {
+            kmerOffsets = true;
+            continue;
+        }
+        if (arg == "-a")
+        {
+            MyConst::adaptiveErrors = true;
+            continue;
+        }
+        if (arg == "-b")
+        {
+            MyConst::batchVerify = true;
+            continue;
+        }
+        if (arg == "-T")
+        {
+            MyConst::tieredErrors = true;
+            continue;
+        }
+        if (arg == "-m")
+        {
+            fromMemory = true;
+            continue;
+        }
+        if (i + 1 >= argc)
+        {
+            std::cerr << "No value for option \"" << arg << "\" provided! Terminating...\n\n";
+            exit(1);
+        }
+        if (arg == "-g")
+        {
+            genFile = argv[++i];
+        } else if (arg == "-l") {
+            refLength = std::stoul(argv[++i]);
+        } else if (arg == "-n") {
+            reads = std::stoul(argv[++i]);
+        } else if (arg == "-e") {
+            errRate = std::stod(argv[++i]);
+        } else if (arg == "-c") {
+            convRate = std::stod(argv[++i]);
+        } else if (arg == "-t") {
+            threads = parseThreadList(argv[++i]);
+        } else if (arg == "-s") {
+            seed = std::stoul(argv[++i]);
+        } else {
+            std::cerr << "Don\'t know the option \"" << arg << "\". Terminating...\n\n";
+            exit(1);
+        }
+    }
+    if (errRate < 0 || errRate > 1 || convRate < 0 || convRate > 1)
+    {
+        std::cerr << "Error and conversion rates must be in [0, 1]! Terminating...\n\n";
+        exit(1);
+    }
+    if (threads.empty())
+    {
+        unsigned int maxThreads = 1;
+#ifdef _OPENMP
+        maxThreads = omp_get_num_procs();
+#endif
+        for (unsigned int t = 1; t <= maxThreads; t *= 2)
+            threads.push_back(t);
+    }
+    MyConst::checkRuntimeParams();
+
+    SynthDS synth = genFile.empty() ? SynthDS(refLength, seed) : SynthDS(readSlice(genFile, refLength), seed);
+    std::vector<size_t> offsets;
+    std::vector<bool> isFwd;
+    const std::vector<std::string> readSet = synth.genReadsBisulfite(MyConst::READLEN, reads, errRate, convRate, offsets, isFwd);
+
+    // the read id is its index in readSet
+    const std::string readPath = "throughput_reads.fq";
+    std::vector<MemoryReadSource::Seq> memReads;
+    if (fromMemory)
+    {
+        for (const std::string& read : readSet)
+            memReads.push_back({read.data(), read.size()});
+
+    } else {
+
+        std::ofstream fastq(readPath);
+        const std::string qual(MyConst::READLEN, 'I');
+        for (size_t i = 0; i < readSet.size(); ++i)
+            fastq << "@" << i << "\n" << readSet[i] << "\n+\n" << qual << "\n";
+    }
+    const std::string indexPath = "throughput_ref.idx";
+    buildIndex(synth.getRef(), indexPath, kmerOffsets);
+    RefGenome ref(indexPath);
+    // the index stays mapped after the file is removed
+    std::remove(indexPath.c_str());
+
+    // compiler and flags, to tell the rows of different builds apart
+    std::cout << "\n# build: g++ " << __VERSION__ << (genFile.empty() ? ", random reference of " : (", slice of " + genFile + " of ")) << synth.getRef().size() << " letters";
+    std::cout << ", error rate " << errRate << ", conversion rate " << convRate << (kmerOffsets ? ", k-mer offsets" : "") << (MyConst::adaptiveErrors ? ", adaptive errors" : "") << (MyConst::batchVerify ? ", batched verification" : "") << (MyConst::tieredErrors ? ", tiered errors" : "") << (fromMemory ? ", reads from memory" : ", reads from file") << "\n";
+    std::cout << "threads\treads\tseconds\treads/s\treads/s/thread\tspeedup\tcorrect%\twrong%\tunmatched%\tparse_seconds\n";
+
+    double firstRate = 0;
+    for (const unsigned int t : threads)
+    {
+        MyConst::coreNum = t;
+        // thread state of ReadQueue is sized for the current coreNum, hence a fresh queue per run
+        MemoryReadSource memSource;
+        std::unique_ptr<ReadQueue> queue(fromMemory ? new ReadQueue(ref, false, true) : new ReadQueue(std::vector<std::string>{readPath}, ref, false, true));
+        ReadQueue& rQue = *queue;
+        if (fromMemory)
+        {
+            memSource.reset(memReads.data(), nullptr, memReads.size());
+            rQue.setSource(&memSource);
+        }
+
+        uint64_t succMatch = 0;
+        uint64_t nonUniqueMatch = 0;
+        uint64_t unSuccMatch = 0;
+        struct Accuracy acc;
+        double sec = 0;
+        double parseSec = 0;
+        size_t readId = 0;
+        bool moreReads = true;
+        while (moreReads)
+        {
+            unsigned int procReads = 0;
+            const std::chrono::steady_clock::time_point parseStart = std::chrono::steady_clock::now();
+            moreReads = rQue.parseChunk(procReads);
+            parseSec += std::chrono::duration<double>(std::chrono::steady_clock::now() - parseStart).count();
+
+            // only the matching is timed for the rates, parsing is overlapped with it in FAME
+            const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            rQue.matchReads(procReads, succMatch, nonUniqueMatch, unSuccMatch, false);
+            sec += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            ReadBatch& batch = rQue.getReads();
+            for (unsigned int i = 0; i < procReads; ++i, ++readId)
+            {
+                Read& r = batch[i];
+                if (r.isInvalid)
+                {
+                    ++acc.unmatched;
+                    continue;
+                }
+                // the match ends at the last letter of the forward strand interval of the read
+                const int64_t expected = offsets[readId] + MyConst::READLEN - 1;
+                const int64_t diff = static_cast<int64_t>(rQue.getMatchPos(r.mat)) - expected;
+                if (diff <= static_cast<int64_t>(MyConst::MISCOUNT) && diff >= -static_cast<int64_t>(MyConst::MISCOUNT))
+                    ++acc.correct;
+                else
+                    ++acc.wrong;
+            }
+        }
+        const double rate = readId / sec;
+        if (firstRate == 0)
+            firstRate = rate;
+        std::cout << t << "\t" << readId << "\t" << sec << "\t" << rate << "\t" << rate / t << "\t" << rate / firstRate << "\t";
+        std::cout << 100.0 * acc.correct / readId << "\t" << 100.0 * acc.wrong / readId << "\t" << 100.0 * acc.unmatched / readId << "\t" << parseSec << "\n";
+    }
+    if (!fromMemory)
+        std::remove(readPath.c_str());
+
+    return 0;
+}
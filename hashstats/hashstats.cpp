@@ -2,88 +2,565 @@
 #include <random>
 #include <fstream>
 #include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <algorithm>
+#include <unordered_map>
+#include <cstring>
+#include <limits>
+#include <cstdlib>
 
 #include "hashstats.h"
 
-#include "../ntHash-1.0.2/nthash.hpp"
+#include "../RefReader_istr.h"
+#include "../spaced_nthash/nthash.hpp"
 
-int main(int argc, char** argv)
+
+static void printHelp()
 {
+    std::cout << "\nHashStats - quality of hash functions for the k-mer table of the FAME index\n\n";
+    std::cout << "Usage: HashStats --genome <fasta> [options]\n\n";
+    std::cout << "    --genome <fasta>        reference whose k-mers are hashed (read as by FAME)\n";
+    std::cout << "    --human_opt             read only the primary assembly, as FAME with --human_opt\n";
+    std::cout << "    --all_kmers             hash all k-mers, not only those of the CpG contexts\n";
+    std::cout << "    --cells <n>             cells of the table (default as FAME: a power of two, at least 2 per k-mer)\n";
+    std::cout << "    --skip <n>              count every n-th k-mer of a context (default " << MyConst::SKIPMOD << " as FAME)\n";
+    std::cout << "    --spaced_seed <bits>    evaluate the spaced seed given as " << MyConst::KMERLEN << " letters 0/1, besides the seeds of FAME\n";
+    std::cout << "    --mul_seeds <n>         multiply-shift candidates with random multipliers (default 2)\n";
+    std::cout << "    --seed <n>              seed of the random multipliers (default 0)\n";
+    std::cout << "    --threads <n>           threads reading the reference (default 1)\n";
+    std::cout << "    --out <file>            write the summary to file instead of stdout\n";
+    std::cout << "    --hist <file>           write the histograms of the bucket sizes (see genPlots.R)\n\n";
+}
 
-    std::vector<unsigned int> hashTable (TABSIZE, 0);
-    drawRandHashes(hashTable);
-    writeStats(argv[1], hashTable);
-    hashTable = std::vector<unsigned int>(TABSIZE, 0);
-    drawDistHashes(hashTable);
-    writeStats(argv[2], hashTable);
+// value of the option at argv[i], i.e. argv[i + 1], terminates if there is none
+static const char* optionValue(int argc, char** argv, int& i)
+{
+    if (i + 1 >= argc)
+    {
+        std::cerr << "No value for option \"" << argv[i] << "\" provided! Terminating...\n\n";
+        exit(1);
+    }
+    return argv[++i];
+}
 
-    return 0;
+static uint64_t parseUInt(const std::string& opt, const char* val)
+{
+    char* end;
+    const unsigned long long n = strtoull(val, &end, 10);
+    if (*val == '\0' || *end != '\0' || *val == '-')
+    {
+        std::cerr << "Invalid argument \"" << val << "\" for option \"" << opt << "\"! Terminating...\n\n";
+        exit(1);
+    }
+    return n;
 }
 
-void drawRandHashes(std::vector<unsigned int>& hashTable)
+int main(int argc, char** argv)
 {
-    std::random_device seedGen;
-    std::mt19937 MT(seedGen());
-    std::uniform_int_distribution<int> toIndex(0, 2);
 
-    char kmer [MyConst::KMERLEN];
-    // sequences that should be constructed
-    for (unsigned long i = 1; i <= SAMPSIZE; ++i)
+    std::string genomeFile;
+    std::string outFile;
+    std::string histFile;
+    bool humanOptFlag = false;
+    bool allKmers = false;
+    uint64_t cells = 0;
+    uint64_t skip = MyConst::SKIPMOD;
+    uint64_t mulSeeds = 2;
+    uint64_t randSeed = 0;
+    std::vector<uint32_t> seeds(MyConst::SEEDSET, MyConst::SEEDSET + MyConst::SEEDNUM);
+
+    if (argc == 1)
+    {
+        printHelp();
+        return 0;
+    }
+    for (int i = 1; i < argc; ++i)
     {
 
-        // draw the individual positions of the kmer
-        for (unsigned int k = 0; k < MyConst::KMERLEN; ++k)
+        const std::string arg(argv[i]);
+        if (arg == "-h" || arg == "--help")
         {
+            printHelp();
+            return 0;
+
+        } else if (arg == "--genome") {
+
+            genomeFile = optionValue(argc, argv, i);
+
+        } else if (arg == "--human_opt") {
+
+            humanOptFlag = true;
+
+        } else if (arg == "--all_kmers") {
+
+            allKmers = true;
+
+        } else if (arg == "--cells") {
+
+            cells = parseUInt(arg, optionValue(argc, argv, i));
+            if (cells == 0 || cells > std::numeric_limits<uint32_t>::max())
+            {
+                std::cerr << "Invalid number of cells " << cells << "! Terminating...\n\n";
+                exit(1);
+            }
+
+        } else if (arg == "--skip") {
+
+            skip = parseUInt(arg, optionValue(argc, argv, i));
+            if (skip == 0)
+            {
+                std::cerr << "Option --skip has to be at least 1! Terminating...\n\n";
+                exit(1);
+            }
+
+        } else if (arg == "--spaced_seed") {
+
+            const std::string bits(optionValue(argc, argv, i));
+            if (bits.size() != MyConst::KMERLEN || bits.find_first_not_of("01") != std::string::npos || bits.find('1') == std::string::npos)
+            {
+                std::cerr << "Spaced seed \"" << bits << "\" is not " << MyConst::KMERLEN << " letters 0/1 with a care position! Terminating...\n\n";
+                exit(1);
+            }
+            uint32_t seedBits = 0;
+            for (const char c : bits)
+                seedBits = (seedBits << 1) | (c == '1');
+            seeds.push_back(seedBits);
+
+        } else if (arg == "--mul_seeds") {
+
+            mulSeeds = parseUInt(arg, optionValue(argc, argv, i));
+
+        } else if (arg == "--seed") {
+
+            randSeed = parseUInt(arg, optionValue(argc, argv, i));
+
+        } else if (arg == "--threads") {
+
+            const uint64_t threads = parseUInt(arg, optionValue(argc, argv, i));
+            if (threads == 0 || threads > std::numeric_limits<uint16_t>::max())
+            {
+                std::cerr << "Invalid number of threads " << threads << "! Terminating...\n\n";
+                exit(1);
+            }
+            MyConst::coreNum = threads;
+
+        } else if (arg == "--out") {
+
+            outFile = optionValue(argc, argv, i);
+
+        } else if (arg == "--hist") {
 
-            kmer[k] = LETCODE[toIndex(MT)];
+            histFile = optionValue(argc, argv, i);
 
+        } else {
+
+            std::cerr << "Don't know the option \"" << arg << "\", maybe you forgot a flag?\n\n";
+            exit(1);
         }
+    }
+    if (genomeFile.empty())
+    {
+        std::cerr << "Option --genome is required! Terminating...\n\n";
+        exit(1);
+    }
+
+    std::vector<struct CpG> cpgTab;
+    std::vector<struct CpG> cpgStartTab;
+    std::vector<std::vector<char> > genSeq;
+    std::unordered_map<chromId, std::string> chrMap;
+    std::vector<uint32_t> chrOffsets;
+    readReference(genomeFile, cpgTab, cpgStartTab, genSeq, chrMap, chrOffsets, humanOptFlag, regionMap(), 0, 0, 0, "");
+
+    std::vector<std::vector<char> > revSeq(genSeq.size());
+    for (size_t g = 0; g < genSeq.size(); ++g)
+        reduceSequence(genSeq[g], revSeq[g]);
+    const std::vector<KmerRun> runs = kmerRuns(genSeq, revSeq, cpgTab, cpgStartTab, allKmers);
+
+    if (cells == 0)
+    {
+        // k-mers in the table, sized as in RefGenome::estimateTablesizes
+        uint64_t kmerNum = 0;
+        for (const KmerRun& run : runs)
+            kmerNum += (run.last - run.first + skip) / skip;
+        cells = MyConst::HTABMINSIZE;
+        while (cells < 2 * kmerNum && cells < MyConst::HTABSIZE)
+            cells <<= 1;
+    }
 
-        ++hashTable[ntHash::NTP64(kmer) % TABSIZE];
+    // the hash of the index with the reductions to compare, for every seed, and the packed letters as reference
+    // of a strong hash of the k-mers
+    constexpr uint64_t GOLDEN = 0x9E3779B97F4A7C15ULL;
+    std::vector<Variant> vars;
+    for (const uint32_t seedBits : seeds)
+    {
+        vars.push_back({HashFun::NtHash, Reduce::Mask, seedBits, 0});
+        vars.push_back({HashFun::NtHash, Reduce::FastRange, seedBits, 0});
+        vars.push_back({HashFun::NtHash, Reduce::MulShift, seedBits, GOLDEN});
+        vars.push_back({HashFun::NtHash, Reduce::Mix, seedBits, 0});
+        vars.push_back({HashFun::Packed, Reduce::Mask, seedBits, 0});
+    }
+    std::mt19937_64 MT(randSeed);
+    for (uint64_t r = 0; r < mulSeeds; ++r)
+        vars.push_back({HashFun::NtHash, Reduce::MulShift, MyConst::SEEDBITS, MT() | 1});
+
+    std::vector<HashStats> stats;
+    for (const Variant& var : vars)
+        stats.push_back(evalVariant(runs, var, cells, static_cast<unsigned int>(skip)));
+
+    if (outFile.empty())
+    {
+        writeSummary(std::cout, stats);
 
+    } else {
+
+        std::ofstream ofs(outFile);
+        writeSummary(ofs, stats);
+        if (!ofs)
+        {
+            std::cerr << "Could not write summary to " << outFile << "! Terminating...\n\n";
+            exit(1);
+        }
     }
+    if (!histFile.empty())
+    {
+        std::ofstream ofs(histFile);
+        writeHistograms(ofs, stats);
+        if (!ofs)
+        {
+            std::cerr << "Could not write histograms to " << histFile << "! Terminating...\n\n";
+            exit(1);
+        }
+    }
+
+    return 0;
 }
 
-void drawDistHashes(std::vector<unsigned int>& hashTable)
+void reduceSequence(std::vector<char>& seq, std::vector<char>& rev)
 {
+    rev.resize(seq.size());
+    for (size_t i = 0, r = seq.size() - 1; i < seq.size(); ++i, --r)
+    {
+        // reverse complement with C converted to T, as the reverse strand contexts of the index
+        switch (seq[i])
+        {
+            case 'A':
+                rev[r] = 'T';
+                break;
+            case 'C':
+                rev[r] = 'G';
+                seq[i] = 'T';
+                break;
+            case 'G':
+                rev[r] = 'T';
+                break;
+            case 'T':
+                rev[r] = 'A';
+                break;
+            default:
+                rev[r] = 'N';
+        }
+    }
+}
+
+std::vector<KmerRun> kmerRuns(const std::vector<std::vector<char> >& genSeq, const std::vector<std::vector<char> >& revSeq, const std::vector<struct CpG>& cpgTab, const std::vector<struct CpG>& cpgStartTab, const bool allKmers)
+{
+
+    const uint64_t k = MyConst::KMERLEN;
+    const uint64_t r = MyConst::READLEN;
 
-    char kmer [MyConst::KMERLEN];
-    genDistSequence(kmer, 0, hashTable);
+    // k-mer starts of the contexts per sequence, see struct CpG for the positions
+    std::vector<std::vector<std::pair<uint64_t, uint64_t> > > contexts(genSeq.size());
+    for (size_t g = 0; g < genSeq.size(); ++g)
+    {
+        if (allKmers && genSeq[g].size() >= k)
+            contexts[g].emplace_back(0, genSeq[g].size() - k);
+    }
+    if (!allKmers)
+    {
+        for (const struct CpG& cpg : cpgStartTab)
+        {
+            if (cpg.pos + r >= k)
+                contexts[cpg.chrom].emplace_back(0, cpg.pos + r - k);
+        }
+        for (const struct CpG& cpg : cpgTab)
+            contexts[cpg.chrom].emplace_back(cpg.pos, cpg.pos + 2 * r - 2 - k);
+    }
+
+    std::vector<KmerRun> runs;
+    for (size_t g = 0; g < genSeq.size(); ++g)
+    {
+        const uint64_t len = genSeq[g].size();
+        if (len < k)
+            continue;
+        std::vector<std::pair<uint64_t, uint64_t> >& ctx = contexts[g];
+        std::sort(ctx.begin(), ctx.end());
+        const char* seq = genSeq[g].data();
+        for (size_t c = 0; c < ctx.size(); )
+        {
+            // merge overlapping contexts
+            uint64_t first = ctx[c].first;
+            uint64_t last = std::min(ctx[c].second, len - k);
+            for (++c; c < ctx.size() && ctx[c].first <= last + 1; ++c)
+                last = std::max(last, std::min(ctx[c].second, len - k));
+            // cut at the Ns
+            while (first <= last)
+            {
+                const char* n = static_cast<const char*>(memchr(seq + first, 'N', last + k - first));
+                const uint64_t runLast = n == nullptr ? last : n - seq;
+                if (n == nullptr || runLast >= first + k)
+                {
+                    const uint64_t end = n == nullptr ? last : runLast - k;
+                    runs.push_back({seq, first, end});
+                    runs.push_back({revSeq[g].data(), len - k - end, len - k - first});
+                }
+                if (n == nullptr)
+                    break;
+                first = runLast + 1;
+            }
+        }
+    }
+    return runs;
+}
+
+namespace {
+
+// finalizer of splitmix64
+inline uint64_t splitMix(uint64_t x)
+{
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+// finalizer of MurmurHash3
+inline uint64_t fmix(uint64_t x)
+{
+    x ^= x >> 33;
+    x *= 0xFF51AFD7ED558CCDULL;
+    x ^= x >> 33;
+    x *= 0xC4CEB9FE1A85EC53ULL;
+    return x ^ (x >> 33);
+}
+
+__extension__ typedef unsigned __int128 uint128;
+
+inline uint64_t fastRange(const uint64_t h, const uint64_t m)
+{
+    return static_cast<uint64_t>((static_cast<uint128>(h) * m) >> 64);
 }
 
-void genDistSequence(char* kmer, unsigned int pos, std::vector<unsigned int>& hashTable)
+// 2 bit code of the letters A, C, G, T (bits 1 and 2 of ASCII)
+inline uint64_t letterCode(const char c)
 {
-    // base case
-    if (pos == MyConst::KMERLEN - 1)
+    return (c >> 1) & 3;
+}
+
+// calls f(hash, counted) for each k-mer of runs, counted is true for every skip-th k-mer of a run
+template <typename F>
+void forKmers(const std::vector<KmerRun>& runs, const Variant& var, const unsigned int skip, F f)
+{
+
+    const unsigned int k = MyConst::KMERLEN;
+    std::vector<bool> seed(k);
+    for (unsigned int i = 0; i < k; ++i)
+        seed[i] = (var.seedBits >> (k - 1 - i)) & 1;
+    const uint64_t letterMask = MyConst::seedLetterMask(var.seedBits);
+
+    for (const KmerRun& run : runs)
     {
-        for (unsigned int i = 0; i < 3; ++i)
+        const char* s = run.seq + run.first;
+        const uint64_t num = run.last - run.first + 1;
+        unsigned int phase = 0;
+        if (var.hash == HashFun::NtHash)
         {
-            kmer[pos] = LETCODE[i];
-            ++hashTable[ntHash::NTP64(kmer) % TABSIZE];
+            uint64_t hVal;
+            f(ntHash::NTPS64(s, seed, k, hVal), true);
+            for (uint64_t i = 1; i < num; ++i)
+            {
+                phase = phase + 1 == skip ? 0 : phase + 1;
+                f(ntHash::NTPS64(s + i, seed, s[i - 1], s[i - 1 + k], k, hVal), phase == 0);
+            }
 
+        } else {
+
+            uint64_t key = 0;
+            for (unsigned int i = 0; i + 1 < k; ++i)
+                key = (key << 2) | letterCode(s[i]);
+            for (uint64_t i = 0; i < num; ++i)
+            {
+                key = (key << 2) | letterCode(s[i + k - 1]);
+                f(splitMix(key & letterMask), phase == 0);
+                phase = phase + 1 == skip ? 0 : phase + 1;
+            }
         }
-        return;
     }
+}
 
-    // recurse on pos
-    for (unsigned int i = 0; i < 3; ++i)
+// result of the timing passes, keeps them from being optimized away
+volatile uint64_t hashSink;
+
+template <typename R>
+HashStats runVariant(const std::vector<KmerRun>& runs, const Variant& var, const uint64_t cells, const unsigned int skip, R reduce)
+{
+
+    HashStats st;
+    st.var = var;
+    st.kmers = 0;
+    st.rolled = 0;
+    st.cells = cells;
+
+    // hashing and reduction are timed without the table, whose cache misses would dominate
+    uint64_t sink = 0;
+    const auto start = std::chrono::steady_clock::now();
+    forKmers(runs, var, skip, [&](const uint64_t h, const bool) { sink += reduce(h); });
+    st.nanos = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    hashSink = sink;
+
+    std::vector<uint32_t> counts(cells, 0);
+    forKmers(runs, var, skip, [&](const uint64_t h, const bool counted)
+    {
+        ++st.rolled;
+        if (counted)
+        {
+            ++counts[reduce(h)];
+            ++st.kmers;
+        }
+    });
+
+    st.used = 0;
+    st.maxBucket = 0;
+    st.sqSum = 0;
+    st.hist.assign(1, 0);
+    for (const uint32_t c : counts)
+    {
+        if (c >= st.hist.size())
+            st.hist.resize(c + 1, 0);
+        ++st.hist[c];
+    }
+    for (uint64_t c = 1; c < st.hist.size(); ++c)
     {
-        kmer[pos] = LETCODE[i];
-        genDistSequence(kmer, pos + 1, hashTable);
+        st.used += st.hist[c];
+        st.sqSum += static_cast<double>(c) * c * st.hist[c];
+    }
+    st.maxBucket = st.hist.size() - 1;
+    return st;
+}
 
+const char* hashName(const HashFun h)
+{
+    return h == HashFun::NtHash ? "nthash" : "packed";
+}
+
+const char* reduceName(const Reduce r, const uint64_t cells)
+{
+    switch (r)
+    {
+        case Reduce::Mask:
+            return (cells & (cells - 1)) == 0 ? "mask" : "mod";
+        case Reduce::FastRange:
+            return "fastrange";
+        case Reduce::MulShift:
+            return "mulshift";
+        default:
+            return "mix";
     }
 }
 
-void writeStats(char* filename, std::vector<unsigned int>& hashTable)
+// hash function, reduction, seed and multiplier of st
+void writeVariant(std::ostream& os, const HashStats& st)
+{
+    os << hashName(st.var.hash) << '\t' << reduceName(st.var.reduce, st.cells) << '\t' << std::hex << "0x" << st.var.seedBits << '\t';
+    if (st.var.reduce == Reduce::MulShift)
+        os << "0x" << st.var.mult;
+    else
+        os << '-';
+    os << std::dec;
+}
+
+// smallest bucket size such that at least the fraction q of the k-mers is in buckets of at most this size
+uint64_t kmerQuantile(const HashStats& st, const double q)
 {
+    double kmers = 0;
+    for (uint64_t c = 1; c < st.hist.size(); ++c)
+    {
+        kmers += static_cast<double>(c) * st.hist[c];
+        if (kmers >= q * st.kmers)
+            return c;
+    }
+    return st.maxBucket;
+}
 
-    std::ofstream ofs (filename);
+}
+
+HashStats evalVariant(const std::vector<KmerRun>& runs, const Variant& var, const uint64_t cells, const unsigned int skip)
+{
 
-    for (unsigned long i = 0; i < TABSIZE; ++i)
+    const uint64_t mask = cells - 1;
+    const uint64_t mult = var.mult;
+    if ((cells & mask) == 0)
     {
+        switch (var.reduce)
+        {
+            case Reduce::Mask:
+                return runVariant(runs, var, cells, skip, [mask](const uint64_t h) { return h & mask; });
+            case Reduce::Mix:
+                return runVariant(runs, var, cells, skip, [mask](const uint64_t h) { return fmix(h) & mask; });
+            default:
+                break;
+        }
+
+    } else {
 
-        ofs << i << '\t' << hashTable[i] << '\n';
+        switch (var.reduce)
+        {
+            case Reduce::Mask:
+                return runVariant(runs, var, cells, skip, [cells](const uint64_t h) { return h % cells; });
+            case Reduce::Mix:
+                return runVariant(runs, var, cells, skip, [cells](const uint64_t h) { return fmix(h) % cells; });
+            default:
+                break;
+        }
     }
+    if (var.reduce == Reduce::FastRange)
+        return runVariant(runs, var, cells, skip, [cells](const uint64_t h) { return fastRange(h, cells); });
+    return runVariant(runs, var, cells, skip, [cells, mult](const uint64_t h) { return fastRange(h * mult, cells); });
+}
 
-    ofs.close();
+void writeSummary(std::ostream& os, const std::vector<HashStats>& stats)
+{
+
+    os << "hash\treduce\tseed\tmult\tkmers\tcells\tload\tused\tmax_bucket\tskew\tprobe_cost\tprobe_ratio\tp99_bucket\tp999_bucket\tns_per_kmer\n";
+    for (const HashStats& st : stats)
+    {
+        const double load = static_cast<double>(st.kmers) / st.cells;
+        // a lookup of a k-mer of the reference scans its bucket, for a random function the expected size is
+        // 1 + (kmers - 1) / cells
+        const double probe = st.kmers ? st.sqSum / st.kmers : 0;
+        const double ideal = st.kmers ? 1 + static_cast<double>(st.kmers - 1) / st.cells : 1;
+        writeVariant(os, st);
+        os << '\t' << st.kmers << '\t' << st.cells << std::fixed << std::setprecision(4)
+            << '\t' << load << '\t' << static_cast<double>(st.used) / st.cells << '\t' << st.maxBucket
+            << '\t' << (st.kmers ? st.maxBucket / load : 0) << '\t' << probe << '\t' << probe / ideal
+            << '\t' << kmerQuantile(st, 0.99) << '\t' << kmerQuantile(st, 0.999)
+            << '\t' << (st.rolled ? st.nanos / st.rolled : 0) << '\n';
+        os.unsetf(std::ios::floatfield);
+    }
+}
+
+void writeHistograms(std::ostream& os, const std::vector<HashStats>& stats)
+{
+
+    os << "hash\treduce\tseed\tmult\tbucket_size\tcells\n";
+    for (const HashStats& st : stats)
+    {
+        for (uint64_t c = 0; c < st.hist.size(); ++c)
+        {
+            if (st.hist[c] == 0)
+                continue;
+            writeVariant(os, st);
+            os << '\t' << c << '\t' << st.hist[c] << '\n';
+        }
+    }
 }
@@ -2,38 +2,94 @@
 #define HASHSTATS_H
 
 #include <vector>
+#include <string>
+#include <ostream>
+#include <cstdint>
+
 #include "../CONST.h"
+#include "../structs.h"
+
+// Quality of candidate hash functions for the k-mer table of the index
+// The reference is read as by FAME (see readReference) and reduced to the bisulfite alphabet per strand, the
+// k-mers of the CpG contexts (every SKIPMOD-th, without Ns) are hashed with each candidate into a table of as
+// many cells as FAME would allocate. Reported are the distribution of the bucket sizes, the skew of the largest
+// bucket and the probe cost of a lookup, i.e. the number of entries in the bucket of a k-mer of the reference.
+
+// k-mers [first, last] (start positions) of a strand of a reference sequence with letters seq
+struct KmerRun
+{
+    const char* seq;
+    uint64_t first;
+    uint64_t last;
+};
+
+// 64 bit hash of the care positions of a k-mer
+enum class HashFun
+{
+    // spaced seed ntHash as in the index (ntHash::NTPS64)
+    NtHash,
+    // letters of the care positions packed with 2 bits each, finalized by splitmix64
+    Packed
+};
 
-// how many kmers should be drawn
-// pow(3,20) same size as the distinct sequences for KMERLEN == 20
-constexpr unsigned long SAMPSIZE = 3486784401;
+// reduction of a 64 bit hash value h to one of m cells
+enum class Reduce
+{
+    // h mod m, h & (m - 1) for a power of two as in the index
+    Mask,
+    // (h * m) >> 64, the upper bits of h
+    FastRange,
+    // ((h * mult) mod 2^64 * m) >> 64, multiply-shift with the odd multiplier mult
+    MulShift,
+    // h mixed by the finalizer of MurmurHash3, then as Mask
+    Mix
+};
 
-// size of the hash table
-constexpr unsigned int TABSIZE = 1000000000;
+// hash function candidate
+struct Variant
+{
+    HashFun hash;
+    Reduce reduce;
+    // spaced seed, bit KMERLEN - 1 - i is set iff position i of the k-mer is a care position (see MyConst::SEEDSET)
+    uint32_t seedBits;
+    uint64_t mult;
+};
 
-// encoding of numbers
-constexpr char LETCODE[3] = {'A','G','T'};
+// statistics of one candidate
+struct HashStats
+{
+    Variant var;
+    // k-mers in the table, k-mers hashed (including the skipped ones) and cells of the table
+    uint64_t kmers;
+    uint64_t rolled;
+    uint64_t cells;
+    uint64_t used;
+    uint64_t maxBucket;
+    // sum of the squared bucket sizes
+    double sqSum;
+    // nanoseconds to hash and reduce all rolled k-mers
+    double nanos;
+    // histogram of the bucket sizes, cells with 0, 1, ... k-mers
+    std::vector<uint64_t> hist;
+};
 
-// draw SAMPSIZE manz hashes, draw letters uniformly at random
-// encode the kmers using nthash
-//
-// hashTable should be initialized with TABSIZE capacity
-// will contain the number of kmers hashed to an element of a vector
-void drawRandHashes(std::vector<unsigned int>& hashTable);
+// k-mers of both strands of the sequences whose starts are at most MyConst::READLEN - 2 letters before a CpG or
+// whose ends are at most MyConst::READLEN - 1 letters behind it, cut at Ns
+// (runs of the reverse strand point to revSeq, the reverse complements of the sequences)
+// ARGUMENTS:
+//          allKmers    all k-mers without N are taken, not only those of CpG contexts
+std::vector<KmerRun> kmerRuns(const std::vector<std::vector<char> >& genSeq, const std::vector<std::vector<char> >& revSeq, const std::vector<struct CpG>& cpgTab, const std::vector<struct CpG>& cpgStartTab, const bool allKmers);
 
-// generate all possible (distinct) kmers and generate corresponding hashes
-//
-// hashTable should be initialized with TABSIZE capacity
-// will contain the number of kmers hashed to an element of a vector
-void drawDistHashes(std::vector<unsigned int>& hashTable);
+// converts seq in place to the reduced alphabet of the index (C to T)
+// and writes the reverse complement in the reduced alphabet to rev
+void reduceSequence(std::vector<char>& seq, std::vector<char>& rev);
 
-// recursive function generating all possible kmers, call with pos == 0
-// will recurse until inclusively KMERLEN - 1 (base case)
-// will cout up corresponding value in hashtable
-void genDistSequence(char* kmer, unsigned int pos, std::vector<unsigned int>& hashTable);
+// hashes the k-mers of runs with var into a table of cells cells, every skip-th k-mer of a run is counted
+HashStats evalVariant(const std::vector<KmerRun>& runs, const Variant& var, const uint64_t cells, const unsigned int skip);
 
-// write out statistic
-void writeStats(char* filename, std::vector<unsigned int>& hashTable);
+// writes one line of summary per candidate resp. the histograms of the bucket sizes as tab separated tables
+void writeSummary(std::ostream& os, const std::vector<HashStats>& stats);
+void writeHistograms(std::ostream& os, const std::vector<HashStats>& stats);
 
 
 #endif /* HASHSTATS_H */
@@ -17,30 +17,104 @@
 //	Jonas Fischer	jonaspost@web.de
 
 #include <chrono>
+#include <fstream>
+#include <sstream>
+#include <cctype>
+#include <algorithm>
+#include <functional>
+#include <thread>
+#include <memory>
+#include <array>
+#include <cstdlib>
+#include <csignal>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <malloc.h>
 
 
 #include "RefReader_istr.h"
 #include "RefGenome.h"
 #include "ReadQueue.h"
-
-void queryRoutine(ReadQueue& rQue, const bool isGZ, const bool bothStrandsFlag);
-void queryRoutinePaired(ReadQueue& rQue, const bool isGZ, const bool bothStrandsFlag);
+#include "MethMerge.h"
+#include "Pipeline.h"
+#include "Metrics.h"
+#include "Numa.h"
+
+// ckptPath: file the state is checkpointed to every ckptSecs seconds (never if 0), with resume the run continues
+// from the checkpoint if there is one
+// runs the batches of the sample of rQue through the stages of a Pipeline: parsing, matching by matchBatch, which is
+// called in input order with the number of reads of the batch in the read buffers of rQue, and, if rQue has output,
+// formatting and writing
+void runPipeline(ReadQueue& rQue, Metrics& metrics, const std::function<void(const unsigned int)>& matchBatch);
+void queryRoutine(ReadQueue& rQue, const bool isGZ, const bool bothStrandsFlag, const std::string& ckptPath, const unsigned int ckptSecs, const bool resume, Metrics& metrics);
+void queryRoutinePaired(ReadQueue& rQue, const bool isGZ, const bool bothStrandsFlag, const std::string& ckptPath, const unsigned int ckptSecs, const bool resume, Metrics& metrics);
 void queryRoutineSC(ReadQueue& rQue, const bool isGZ, const bool bothStrandsFlag, const char* scMetaFile);
 void queryRoutineSCPaired(ReadQueue& rQue, const bool isGZ, const bool bothStrandsFlag, const char* scMetaFile);
+// parameter sweep over one loaded index: the first sampleReads reads (pairs) of files (and files2) are matched once
+// for every setting of sweepPath, a line of runtime options (--qthresh, --kmer_dist, --errors,
+// --kmer_cutoff) on top of the command line, and the throughput and matching rates of each setting are printed;
+// with truth, the reads are also checked against the origin given by their names (see matchesOrigin)
+int sweepRoutine(const std::string& sweepPath, RefGenome& ref, const std::vector<std::string>& files, const std::vector<std::string>& files2, const bool isPaired, const bool isGZ, const bool bothStrandsFlag, const uint64_t sampleReads, const bool truth);
+// autotuning before an alignment run: the first sampleReads reads (pairs) of files (and files2) are matched with
+// several thread counts, thread layouts and batch sizes, and the configuration with the highest throughput whose
+// estimated memory stays below memCap bytes (0 for the memory available) is set in MyConst and printed
+void autotuneRoutine(RefGenome& ref, const std::vector<std::string>& files, const std::vector<std::string>& files2, const bool isPaired, const bool isGZ, const bool bothStrandsFlag, const uint64_t sampleReads, const uint64_t memCap);
+// single cell mode for reads of all cells in the same files, assigned to the cells by their barcodes
+void queryRoutineSCBarcodes(ReadQueue& rQue, const bool isGZ, const CellBarcodes& barcodes, const std::vector<std::string>& files, const std::vector<std::string>& files2);
 void printHelp();
+// parses the numeric argument val of option opt, terminates if val is not a non negative integer
+unsigned int parseUIntArg(const char* opt, const char* val);
+// appends the comma separated file paths of list to files
+void splitFileList(const char* list, std::vector<std::string>& files);
+// sets MyConst::shardIdx and MyConst::shardNum from arg, which is "i/n" or "auto" for the rank and size of an
+// MPI or SLURM job taken from the environment
+void parseShard(const char* opt, const std::string& arg);
+// inserts "_shard<i>" for the shard i of this run in front of the extension of path (".gz" counts with the one
+// before), such that every shard writes its own file
+void insertShardSuffix(std::string& path);
+// parses the command line and runs it; if loadedRef is given, the reads are aligned against it instead of
+// loading an index (used by the jobs of the alignment server)
+int runFAME(int argc, char** argv, RefGenome* loadedRef);
+// alignment server: accepts jobs on the unix socket socketPath and runs them one after the other in a forked
+// child sharing ref, the job's output is streamed back to the client (see submitJob)
+int serveJobs(const std::string& socketPath, RefGenome& ref);
+// sends the command line of a job (argc, argv without the program name) to the server listening on socketPath,
+// prints its output and returns its exit status
+int submitJob(const std::string& socketPath, int argc, char** argv);
+
+// first byte of the line the server sends after the output of a job, followed by the exit status of the job
+constexpr char JOBEXIT = '\x01';
+// start of the run (or job), the time to the first matched batch is reported relative to it
+static std::chrono::steady_clock::time_point runStart;
+// prints the time from runStart to the first matched batch
+static void reportFirstBatch()
+{
+    std::cout << "First batch matched " << std::chrono::duration<double>(std::chrono::steady_clock::now() - runStart).count() << "s after start\n";
+}
 
 // --------------- MAIN -----------------
 //
 //
 int main(int argc, char** argv)
+{
+    return runFAME(argc, argv, nullptr);
+}
+
+int runFAME(int argc, char** argv, RefGenome* loadedRef)
 {
 	MyConst::sanityChecks();
+    runStart = std::chrono::steady_clock::now();
 
     std::string indexFile = "";
     std::string genomeFile = "";
+    // (tag, FASTA file) of the genomes of a combined index, e.g. host and graft, whose chromosomes are named tag_<name>
+    std::vector<std::pair<std::string, std::string> > genomeFiles;
     std::string outputFile = "out";
-    char* readFile = NULL;
-    char* readFile2 = NULL;
+    // read files of the sample, several ones (e.g. lanes) are read back to back
+    std::vector<std::string> readFiles;
+    std::vector<std::string> readFiles2;
 	char* scMetaFile = NULL;
 	char* scOutputFile = "sc_out.tsv";
 
@@ -50,8 +124,22 @@ int main(int argc, char** argv)
     bool storeIndexFlag = false;
     // true iff reads are in .gz format
     bool readsGZ = false;
+    // true iff the files of -r hold read 1 and read 2 of every pair in consecutive records
+    bool interleavedFlag = false;
     // true iff index should be filtered only lossless
     bool noloss = false;
+    // true iff the stored index should keep the offsets of its k-mers inside their windows
+    bool kmerOffsetFlag = false;
+    // true iff the stored index should keep a fingerprint of each of its k-mers
+    bool kmerPrintFlag = false;
+    // smallest k-mer cutoff a load of the index may choose, 0 to filter the index while it is built
+    unsigned int deferCutoff = 0;
+    // true iff the stored index should be compressed
+    bool compressIndexFlag = false;
+    // true iff the index should hash the syncmers instead of every SKIPMOD-th k-mer
+    bool syncmerFlag = false;
+    // true iff the index should hash the k-mers with all seeds of MyConst::SEEDSET
+    bool multiSeedFlag = false;
     // true iff two (paired) read files are provided
     bool pairedReadFlag = false;
 	// true iff library is generated without particular stranding of reads
@@ -59,10 +147,69 @@ int main(int argc, char** argv)
 	bool bothStrandsFlag = false;
 	// true iff human reference genome optimization should be used to discard unlocalized contigs etc
 	bool humanOptFlag = false;
+	// BED file with the target regions the index is restricted to, empty for the whole genome
+	std::string targetFile = "";
+	unsigned int targetPad = MyConst::TARGETPAD;
+	// fragment lengths of an RRBS index, rrbsMax is 0 for other indices
+	unsigned int rrbsMin = 0;
+	unsigned int rrbsMax = 0;
+	// index the sequences given with --genome are appended to, empty to build a new index
+	std::string extendFile = "";
 	// true iff tool is called with single cell meta information file
 	bool scFlag = false;
 	// true iff output path for single cell analysis is given
 	bool scOutFlag = false;
+	// true iff single cell counts should be written in sparse format
+	bool scSparseFlag = false;
+	// whitelist of the cell barcodes of a multiplexed single cell run, empty if every cell has its own files
+	std::string barcodeFile = "";
+	// length of the barcode at the start of read 1, 0 if it is in the read header
+	unsigned int barcodeLen = 0;
+	// format of the methylation output files
+	METHFILE::FORMAT outFormat = METHFILE::TSV;
+	// file the alignments are written to, no alignment output if empty
+	std::string alignFile = "";
+	std::string unmappedFile = "";
+	// file the read level methylation calls are written to, none if empty
+	std::string callFile = "";
+	// true iff cytosines in CHG and CHH context should be counted besides the CpGs
+	bool nonCpGFlag = false;
+	// file the bisulfite QC report is written to, no QC if empty
+	std::string qcFile = "";
+	// true iff reads (pairs) at the 5' position of an earlier one are counted as PCR duplicates only
+	bool dedupFlag = false;
+	// file the per stage profile is written to, no profiling if empty
+	std::string profileFile = "";
+	// hardware counters per stage in the profile
+	bool profileCounters = false;
+	// seconds between two checkpoints of the alignment, no checkpoints if 0
+	unsigned int checkpointSecs = 0;
+	// true iff the alignment continues from the checkpoint of an earlier run
+	bool resumeFlag = false;
+	// file the live metrics are written to every metricsSecs seconds, no metrics if empty
+	std::string metricsFile = "";
+	unsigned int metricsSecs = 10;
+	// the counts are aggregated over tiles of binTiles bp or over the regions of binFile, no bins if both are unset
+	unsigned int binTiles = 0;
+	std::string binFile = "";
+	// binary methylation files to be summed instead of aligning reads
+	std::vector<std::string> mergeFiles;
+	// true iff the statistics of the index given by --load_index should be printed instead of aligning reads
+	bool indexStatsFlag = false;
+	// socket the alignment server listens on, no server if empty
+	std::string serverSocket = "";
+	// settings of the parameter sweep, no sweep if empty
+	std::string sweepFile = "";
+	// reads (pairs) matched per setting of the sweep
+	unsigned int sweepReads = 100000;
+	// true iff the reads of the sweep are checked against the origin in their names
+	bool sweepTruth = false;
+	// true iff the threads, their layout and the batch size are chosen by calibration batches (see autotuneRoutine)
+	bool autotuneFlag = false;
+	// reads (pairs) matched per configuration by the autotuner, 0 for the largest batch size it tries
+	unsigned int autotuneReads = 0;
+	// memory in MB the configuration chosen by the autotuner may take, 0 for the memory available
+	unsigned int autotuneMem = 0;
 
     if (argc == 1)
     {
@@ -83,7 +230,7 @@ int main(int argc, char** argv)
         {
             if (i + 1 < argc)
             {
-                readFile = argv[++i];
+                splitFileList(argv[++i], readFiles);
 
             } else {
 
@@ -96,7 +243,7 @@ int main(int argc, char** argv)
         {
             if (i + 1 < argc)
             {
-                readFile = argv[++i];
+                splitFileList(argv[++i], readFiles);
                 pairedReadFlag = true;
 
             } else {
@@ -111,7 +258,7 @@ int main(int argc, char** argv)
             if (i + 1 < argc)
             {
                 pairedReadFlag = true;
-                readFile2 = argv[++i];
+                splitFileList(argv[++i], readFiles2);
 
             } else {
 
@@ -135,6 +282,47 @@ int main(int argc, char** argv)
             continue;
         }
 
+        if (std::string(argv[i]) == "--genomes")
+        {
+            if (i + 1 >= argc)
+            {
+                std::cerr << "No genomes for option \"" << argv[i] << "\" provided! Terminating...\n\n";
+                exit(1);
+            }
+            std::istringstream list(argv[++i]);
+            std::string entry;
+            while (std::getline(list, entry, ','))
+            {
+                const size_t sep = entry.find('=');
+                const std::string tag = entry.substr(0, sep);
+                bool validTag = sep != std::string::npos && sep > 0 && sep + 1 < entry.size();
+                for (const char c : tag)
+                {
+                    validTag = validTag && (std::isalnum(static_cast<unsigned char>(c)) || c == '-' || c == '.');
+                }
+                if (!validTag)
+                {
+                    std::cerr << "Invalid genome \"" << entry << "\" of option \"--genomes\", expected <tag>=<fasta file> with a tag of letters, digits, '-' and '.'! Terminating...\n\n";
+                    exit(1);
+                }
+                for (const auto& genome : genomeFiles)
+                {
+                    if (genome.first == tag)
+                    {
+                        std::cerr << "Genome tag \"" << tag << "\" of option \"--genomes\" is given twice! Terminating...\n\n";
+                        exit(1);
+                    }
+                }
+                genomeFiles.emplace_back(tag, entry.substr(sep + 1));
+            }
+            if (genomeFiles.size() < 2 || genomeFiles.size() > 256)
+            {
+                std::cerr << "Option \"--genomes\" takes 2 to 256 genomes! Terminating...\n\n";
+                exit(1);
+            }
+            continue;
+        }
+
         if (std::string(argv[i]) == "--load_index")
         {
             if (i + 1 < argc)
@@ -199,6 +387,63 @@ int main(int argc, char** argv)
             noloss = true;
             continue;
         }
+        if (std::string(argv[i]) == "--index_mem")
+        {
+            if (i + 1 < argc)
+            {
+                MyConst::indexMem = parseUIntArg(argv[i], argv[i + 1]);
+                ++i;
+            } else {
+
+                std::cerr << "No memory budget for option \"" << argv[i] << "\" provided! Terminating...\n\n";
+                exit(1);
+            }
+            continue;
+        }
+
+		if (std::string(argv[i]) == "--kmer_offsets")
+		{
+			kmerOffsetFlag = true;
+			continue;
+		}
+
+		if (std::string(argv[i]) == "--kmer_prints")
+		{
+			kmerPrintFlag = true;
+			continue;
+		}
+
+		if (std::string(argv[i]) == "--defer_cutoff")
+		{
+			if (i + 1 < argc)
+			{
+				deferCutoff = parseUIntArg(argv[i], argv[i + 1]);
+				++i;
+			} else {
+
+                std::cerr << "No k-mer cutoff for option \"" << argv[i] << "\" provided! Terminating...\n\n";
+                exit(1);
+			}
+			continue;
+		}
+
+		if (std::string(argv[i]) == "--syncmers")
+		{
+			syncmerFlag = true;
+			continue;
+		}
+
+		if (std::string(argv[i]) == "--multi_seed")
+		{
+			multiSeedFlag = true;
+			continue;
+		}
+
+		if (std::string(argv[i]) == "--compress_index")
+		{
+			compressIndexFlag = true;
+			continue;
+		}
 
 		if (std::string(argv[i]) == "--unord_reads")
 		{
@@ -212,6 +457,70 @@ int main(int argc, char** argv)
 			continue;
 		}
 
+		if (std::string(argv[i]) == "--extend_index")
+		{
+			if (i + 1 < argc)
+			{
+				extendFile = std::string(argv[++i]);
+			} else {
+
+                std::cerr << "No filepath for option \"" << argv[i] << "\" provided! Terminating...\n\n";
+                exit(1);
+			}
+			continue;
+		}
+		if (std::string(argv[i]) == "--targets")
+		{
+			if (i + 1 < argc)
+			{
+				targetFile = std::string(argv[++i]);
+			} else {
+
+                std::cerr << "No BED file for option \"" << argv[i] << "\" provided! Terminating...\n\n";
+                exit(1);
+			}
+			continue;
+		}
+		if (std::string(argv[i]) == "--rrbs")
+		{
+			if (i + 1 < argc)
+			{
+				const std::string range(argv[i + 1]);
+				const size_t dash = range.find('-');
+				if (dash == std::string::npos)
+				{
+					std::cerr << "Fragment lengths for option \"" << argv[i] << "\" must be given as min-max! Terminating...\n\n";
+					exit(1);
+				}
+				rrbsMin = parseUIntArg(argv[i], range.substr(0, dash).c_str());
+				rrbsMax = parseUIntArg(argv[i], range.substr(dash + 1).c_str());
+				if (rrbsMax == 0 || rrbsMin > rrbsMax)
+				{
+					std::cerr << "Invalid fragment lengths " << range << " for option \"" << argv[i] << "\"! Terminating...\n\n";
+					exit(1);
+				}
+				++i;
+			} else {
+
+                std::cerr << "No fragment lengths for option \"" << argv[i] << "\" provided! Terminating...\n\n";
+                exit(1);
+			}
+			continue;
+		}
+		if (std::string(argv[i]) == "--target_pad")
+		{
+			if (i + 1 < argc)
+			{
+				targetPad = parseUIntArg(argv[i], argv[i + 1]);
+				++i;
+			} else {
+
+                std::cerr << "No padding for option \"" << argv[i] << "\" provided! Terminating...\n\n";
+                exit(1);
+			}
+			continue;
+		}
+
 		if (std::string(argv[i]) == "--sc_input")
 		{
 			scFlag = true;
@@ -238,90 +547,1019 @@ int main(int argc, char** argv)
 			}
 			continue;
 		}
+		if (std::string(argv[i]) == "--sc_barcodes")
+		{
+			scFlag = true;
+			if (i + 1 < argc)
+			{
+				barcodeFile = argv[++i];
+			} else {
+
+                std::cerr << "No filepath for option \"" << argv[i] << "\" provided! Terminating...\n\n";
+                exit(1);
+			}
+			continue;
+		}
+		if (std::string(argv[i]) == "--sc_barcode_len")
+		{
+			if (i + 1 < argc)
+			{
+				barcodeLen = parseUIntArg(argv[i], argv[i + 1]);
+				++i;
+			} else {
+
+                std::cerr << "No length for option \"" << argv[i] << "\" provided! Terminating...\n\n";
+                exit(1);
+			}
+			continue;
+		}
+		if (std::string(argv[i]) == "--sc_sparse")
+		{
+			scSparseFlag = true;
+			continue;
+		}
+		if (std::string(argv[i]) == "--non_cpg")
+		{
+			nonCpGFlag = true;
+			continue;
+		}
+		if (std::string(argv[i]) == "--dedup")
+		{
+			dedupFlag = true;
+			continue;
+		}
+		if (std::string(argv[i]) == "--interleaved")
+		{
+			interleavedFlag = true;
+			pairedReadFlag = true;
+			continue;
+		}
 		if (std::string(argv[i]) == "--paired")
 		{
 			pairedReadFlag = true;
 			continue;
 		}
+		if (std::string(argv[i]) == "--out_format")
+		{
+			if (i + 1 < argc)
+			{
+				const std::string fmt(argv[++i]);
+				if (fmt == "tsv")
+				{
+					outFormat = METHFILE::TSV;
 
+				} else if (fmt == "bgzip") {
 
-        // no such option
-        std::cerr << "Don\'t know the option \"" << argv[i] << "\". Terminating...\n\n";
-        exit(1);
-
-    }
-	if (scOutFlag && !scFlag)
-	{
-		std::cerr << "Output path for single cell analysis given but no single cell input provided (see \"--sc_input\"). Terminating...\n\n";
-		exit(1);
-	}
-
-
-    // Start processing
+					outFormat = METHFILE::BGZF;
 
-    if (loadIndexFlag)
-    {
+				} else if (fmt == "binary") {
 
-        if (noloss)
-        {
-            std::cout << "\nWARNING: You are reading an index from file. The option \"--no_loss\" has no effect.\n\n";
-        }
+					outFormat = METHFILE::BINARY;
 
-        RefGenome ref(indexFile);
+				} else {
 
-        if (pairedReadFlag)
-        {
+					std::cerr << "Unknown output format \"" << fmt << "\", use one of tsv, bgzip, binary! Terminating...\n\n";
+					exit(1);
+				}
+			} else {
 
-			if (scFlag)
+                std::cerr << "No format for option \"" << argv[i] << "\" provided! Terminating...\n\n";
+                exit(1);
+			}
+			continue;
+		}
+		if (std::string(argv[i]) == "--align_out")
+		{
+			if (i + 1 < argc)
 			{
+				alignFile = argv[++i];
+			} else {
 
-				ReadQueue rQue(scOutputFile, ref, readsGZ, bothStrandsFlag, true);
-				queryRoutineSCPaired(rQue, readsGZ, bothStrandsFlag, scMetaFile);
-				rQue.printMethylationLevels(outputFile);
-
+                std::cerr << "No output file for option \"" << argv[i] << "\" provided! Terminating...\n\n";
+                exit(1);
+			}
+			continue;
+		}
+		if (std::string(argv[i]) == "--read_calls")
+		{
+			if (i + 1 < argc)
+			{
+				callFile = argv[++i];
 			} else {
 
-				if (readFile == NULL || readFile2 == NULL)
-				{
-					std::cerr << "Entered paired end mode (\"-r1\" or \"-r2\" flag), but one of the read files is missing. Terminating...\n\n";
-					exit(1);
-				}
-				ReadQueue rQue(readFile, readFile2, ref, readsGZ, bothStrandsFlag);
-				queryRoutinePaired(rQue, readsGZ, bothStrandsFlag);
-				rQue.printMethylationLevels(outputFile);
+                std::cerr << "No output file for option \"" << argv[i] << "\" provided! Terminating...\n\n";
+                exit(1);
 			}
+			continue;
+		}
+		if (std::string(argv[i]) == "--qc")
+		{
+			if (i + 1 < argc)
+			{
+				qcFile = argv[++i];
+			} else {
 
-        } else {
+                std::cerr << "No output file for option \"" << argv[i] << "\" provided! Terminating...\n\n";
+                exit(1);
+			}
+			continue;
+		}
+		if (std::string(argv[i]) == "--unmapped_out")
+		{
+			if (i + 1 < argc)
+			{
+				unmappedFile = argv[++i];
+			} else {
 
-			if (scFlag)
+                std::cerr << "No output file for option \"" << argv[i] << "\" provided! Terminating...\n\n";
+                exit(1);
+			}
+			continue;
+		}
+		if (std::string(argv[i]) == "-p" || std::string(argv[i]) == "--threads")
+		{
+			if (i + 1 < argc)
 			{
+				MyConst::coreNum = parseUIntArg(argv[i], argv[i + 1]);
+				++i;
+			} else {
 
-				ReadQueue rQue(scOutputFile, ref, readsGZ, bothStrandsFlag, false);
-				queryRoutineSC(rQue, readsGZ, bothStrandsFlag, scMetaFile);
-				rQue.printMethylationLevels(outputFile);
+                std::cerr << "No number of threads for option \"" << argv[i] << "\" provided! Terminating...\n\n";
+                exit(1);
+			}
+			continue;
+		}
+		if (std::string(argv[i]) == "--chunk_size")
+		{
+			if (i + 1 < argc)
+			{
+				MyConst::chunkSize = parseUIntArg(argv[i], argv[i + 1]);
+				++i;
+			} else {
 
+                std::cerr << "No chunk size for option \"" << argv[i] << "\" provided! Terminating...\n\n";
+                exit(1);
+			}
+			continue;
+		}
+		if (std::string(argv[i]) == "--pipeline_depth")
+		{
+			if (i + 1 < argc)
+			{
+				MyConst::pipelineDepth = parseUIntArg(argv[i], argv[i + 1]);
+				++i;
 			} else {
 
-				if (readFile == NULL)
-				{
+                std::cerr << "No number of batches for option \"" << argv[i] << "\" provided! Terminating...\n\n";
+                exit(1);
+			}
+			continue;
+		}
+		if (std::string(argv[i]) == "--output_threads")
+		{
+			if (i + 1 < argc)
+			{
+				MyConst::outputThreads = parseUIntArg(argv[i], argv[i + 1]);
+				++i;
+			} else {
 
-					std::cerr << "No read file provided! Use \"-r\" option to specify read file path. Terminating...\n\n";
-					exit(1);
+                std::cerr << "No number of threads for option \"" << argv[i] << "\" provided! Terminating...\n\n";
+                exit(1);
+			}
+			continue;
+		}
+		if (std::string(argv[i]) == "--io_depth")
+		{
+			if (i + 1 < argc)
+			{
+				MyConst::ioDepth = parseUIntArg(argv[i], argv[i + 1]);
+				++i;
+			} else {
 
-				}
-				ReadQueue rQue(readFile, ref, readsGZ, bothStrandsFlag);
-				queryRoutine(rQue, readsGZ, bothStrandsFlag);
-				rQue.printMethylationLevels(outputFile);
+                std::cerr << "No number of requests for option \"" << argv[i] << "\" provided! Terminating...\n\n";
+                exit(1);
 			}
-        }
+			continue;
+		}
+		if (std::string(argv[i]) == "--errors")
+		{
+			if (i + 1 < argc)
+			{
+				MyConst::errBudget = parseUIntArg(argv[i], argv[i + 1]);
+				++i;
+			} else {
 
-    } else {
+                std::cerr << "No error budget for option \"" << argv[i] << "\" provided! Terminating...\n\n";
+                exit(1);
+			}
+			continue;
+		}
+		if (std::string(argv[i]) == "--qthresh")
+		{
+			if (i + 1 < argc)
+			{
+				MyConst::qThresh = parseUIntArg(argv[i], argv[i + 1]);
+				++i;
+			} else {
+
+                std::cerr << "No threshold for option \"" << argv[i] << "\" provided! Terminating...\n\n";
+                exit(1);
+			}
+			continue;
+		}
+		if (std::string(argv[i]) == "--kmer_dist")
+		{
+			if (i + 1 < argc)
+			{
+				MyConst::kmerDist = parseUIntArg(argv[i], argv[i + 1]);
+				++i;
+			} else {
+
+                std::cerr << "No distance for option \"" << argv[i] << "\" provided! Terminating...\n\n";
+                exit(1);
+			}
+			continue;
+		}
+		if (std::string(argv[i]) == "--mask_n")
+		{
+			MyConst::maskN = true;
+			continue;
+		}
+		if (std::string(argv[i]) == "--trim_qual")
+		{
+			if (i + 1 < argc)
+			{
+				MyConst::trimQual = parseUIntArg(argv[i], argv[i + 1]);
+				++i;
+			} else {
+
+                std::cerr << "No quality cutoff for option \"" << argv[i] << "\" provided! Terminating...\n\n";
+                exit(1);
+			}
+			continue;
+		}
+		if (std::string(argv[i]) == "--trim_adapter")
+		{
+			MyConst::trimAdapter = true;
+			continue;
+		}
+		if (std::string(argv[i]) == "--adaptive_errors")
+		{
+			MyConst::adaptiveErrors = true;
+			continue;
+		}
+		if (std::string(argv[i]) == "--batch_verify")
+		{
+			MyConst::batchVerify = true;
+			continue;
+		}
+		if (std::string(argv[i]) == "--offload")
+		{
+			MyConst::offload = true;
+			continue;
+		}
+		if (std::string(argv[i]) == "--read_cache")
+		{
+			MyConst::readCache = true;
+			continue;
+		}
+		if (std::string(argv[i]) == "--joint_strands")
+		{
+			MyConst::jointStrands = true;
+			continue;
+		}
+		if (std::string(argv[i]) == "--mate_rescue")
+		{
+			MyConst::mateRescue = true;
+			continue;
+		}
+		if (std::string(argv[i]) == "--fused_pairs")
+		{
+			MyConst::fusedPairs = true;
+			continue;
+		}
+		if (std::string(argv[i]) == "--tiered_errors")
+		{
+			MyConst::tieredErrors = true;
+			continue;
+		}
+		if (std::string(argv[i]) == "--interleave")
+		{
+			if (i + 1 < argc)
+			{
+				MyConst::interleave = parseUIntArg(argv[i], argv[i + 1]);
+				++i;
+			} else {
+
+                std::cerr << "No number of reads for option \"" << argv[i] << "\" provided! Terminating...\n\n";
+                exit(1);
+			}
+			continue;
+		}
+		if (std::string(argv[i]) == "--max_candidates")
+		{
+			if (i + 1 < argc)
+			{
+				MyConst::candidateBudget = parseUIntArg(argv[i], argv[i + 1]);
+				++i;
+			} else {
+
+                std::cerr << "No number of candidates for option \"" << argv[i] << "\" provided! Terminating...\n\n";
+                exit(1);
+			}
+			continue;
+		}
+		if (std::string(argv[i]) == "--substitution_calls")
+		{
+			MyConst::substitutionCalls = true;
+			continue;
+		}
+		if (std::string(argv[i]) == "--huge_pages")
+		{
+			MyConst::hugePages = true;
+			continue;
+		}
+		if (std::string(argv[i]) == "--numa")
+		{
+			MyConst::numa = true;
+			continue;
+		}
+		if (std::string(argv[i]) == "--warm_index")
+		{
+			MyConst::warmIndex = true;
+			continue;
+		}
+		if (std::string(argv[i]) == "--window_records")
+		{
+			MyConst::windowRecords = true;
+			continue;
+		}
+		if (std::string(argv[i]) == "--hot_buckets")
+		{
+			if (i + 1 < argc)
+			{
+				MyConst::hotBuckets = parseUIntArg(argv[i], argv[i + 1]);
+				++i;
+			} else {
+
+                std::cerr << "No size in KB for option \"" << argv[i] << "\" provided! Terminating...\n\n";
+                exit(1);
+			}
+			continue;
+		}
+		if (std::string(argv[i]) == "--kmer_cutoff")
+		{
+			if (i + 1 < argc)
+			{
+				MyConst::kmerCutoff = parseUIntArg(argv[i], argv[i + 1]);
+				++i;
+			} else {
+
+                std::cerr << "No k-mer cutoff for option \"" << argv[i] << "\" provided! Terminating...\n\n";
+                exit(1);
+			}
+			continue;
+		}
+		if (std::string(argv[i]) == "--verify_index")
+		{
+			MyConst::verifyIndex = true;
+			continue;
+		}
+		if (std::string(argv[i]) == "--index_stats")
+		{
+			indexStatsFlag = true;
+			continue;
+		}
+		if (std::string(argv[i]) == "--profile")
+		{
+			if (i + 1 < argc)
+			{
+				profileFile = argv[++i];
+			} else {
+
+                std::cerr << "No output file for option \"" << argv[i] << "\" provided! Terminating...\n\n";
+                exit(1);
+			}
+			continue;
+		}
+		if (std::string(argv[i]) == "--profile_counters")
+		{
+			profileCounters = true;
+			continue;
+		}
+		if (std::string(argv[i]) == "--checkpoint")
+		{
+			if (i + 1 < argc)
+			{
+				checkpointSecs = parseUIntArg(argv[i], argv[i + 1]);
+				++i;
+			} else {
+
+                std::cerr << "No interval for option \"" << argv[i] << "\" provided! Terminating...\n\n";
+                exit(1);
+			}
+			continue;
+		}
+		if (std::string(argv[i]) == "--shard")
+		{
+			if (i + 1 < argc)
+			{
+				parseShard(argv[i], argv[i + 1]);
+				++i;
+			} else {
+
+                std::cerr << "No shard for option \"" << argv[i] << "\" provided! Terminating...\n\n";
+                exit(1);
+			}
+			continue;
+		}
+		if (std::string(argv[i]) == "--resume")
+		{
+			resumeFlag = true;
+			continue;
+		}
+		if (std::string(argv[i]) == "--metrics")
+		{
+			if (i + 1 < argc)
+			{
+				metricsFile = argv[++i];
+			} else {
+
+                std::cerr << "No output file for option \"" << argv[i] << "\" provided! Terminating...\n\n";
+                exit(1);
+			}
+			continue;
+		}
+		if (std::string(argv[i]) == "--metrics_interval")
+		{
+			if (i + 1 < argc)
+			{
+				metricsSecs = parseUIntArg(argv[i], argv[i + 1]);
+				++i;
+			} else {
+
+                std::cerr << "No interval for option \"" << argv[i] << "\" provided! Terminating...\n\n";
+                exit(1);
+			}
+			continue;
+		}
+		if (std::string(argv[i]) == "--bins")
+		{
+			if (i + 1 < argc)
+			{
+				// a number is a tile size, anything else a BED file
+				const std::string arg(argv[i + 1]);
+				if (!arg.empty() && arg.find_first_not_of("0123456789") == std::string::npos)
+					binTiles = parseUIntArg(argv[i], argv[i + 1]);
+				else
+					binFile = arg;
+				++i;
+			} else {
+
+                std::cerr << "No tile size or BED file for option \"" << argv[i] << "\" provided! Terminating...\n\n";
+                exit(1);
+			}
+			continue;
+		}
+		if (std::string(argv[i]) == "--merge")
+		{
+			if (i + 1 < argc)
+			{
+				splitFileList(argv[++i], mergeFiles);
+			} else {
+
+                std::cerr << "No filepath for option \"" << argv[i] << "\" provided! Terminating...\n\n";
+                exit(1);
+			}
+			continue;
+		}
+		if (std::string(argv[i]) == "--sweep")
+		{
+			if (i + 1 < argc)
+			{
+				sweepFile = argv[++i];
+			} else {
+
+                std::cerr << "No filepath for option \"" << argv[i] << "\" provided! Terminating...\n\n";
+                exit(1);
+			}
+			continue;
+		}
+		if (std::string(argv[i]) == "--sweep_reads")
+		{
+			if (i + 1 < argc)
+			{
+				sweepReads = parseUIntArg(argv[i], argv[i + 1]);
+				++i;
+			} else {
+
+                std::cerr << "No number of reads for option \"" << argv[i] << "\" provided! Terminating...\n\n";
+                exit(1);
+			}
+			continue;
+		}
+		if (std::string(argv[i]) == "--autotune")
+		{
+			autotuneFlag = true;
+			continue;
+		}
+		if (std::string(argv[i]) == "--autotune_reads")
+		{
+			if (i + 1 < argc)
+			{
+				autotuneReads = parseUIntArg(argv[i], argv[i + 1]);
+				++i;
+			} else {
+
+                std::cerr << "No number of reads for option \"" << argv[i] << "\" provided! Terminating...\n\n";
+                exit(1);
+			}
+			continue;
+		}
+		if (std::string(argv[i]) == "--autotune_mem")
+		{
+			if (i + 1 < argc)
+			{
+				autotuneMem = parseUIntArg(argv[i], argv[i + 1]);
+				++i;
+			} else {
+
+                std::cerr << "No memory budget for option \"" << argv[i] << "\" provided! Terminating...\n\n";
+                exit(1);
+			}
+			continue;
+		}
+		if (std::string(argv[i]) == "--sweep_truth")
+		{
+			sweepTruth = true;
+			continue;
+		}
+		if (std::string(argv[i]) == "--server")
+		{
+			if (loadedRef != nullptr)
+			{
+				std::cerr << "Option \"--server\" cannot be used in a job! Terminating...\n\n";
+				exit(1);
+			}
+			if (i + 1 < argc)
+			{
+				serverSocket = argv[++i];
+			} else {
+
+                std::cerr << "No socket path for option \"" << argv[i] << "\" provided! Terminating...\n\n";
+                exit(1);
+			}
+			continue;
+		}
+		if (std::string(argv[i]) == "--submit")
+		{
+			if (loadedRef != nullptr)
+			{
+				std::cerr << "Option \"--submit\" cannot be used in a job! Terminating...\n\n";
+				exit(1);
+			}
+			if (i + 1 < argc)
+			{
+				// all following arguments belong to the job
+				return submitJob(argv[i + 1], argc - i - 2, argv + i + 2);
+			}
+			std::cerr << "No socket path for option \"" << argv[i] << "\" provided! Terminating...\n\n";
+			exit(1);
+		}
+		if (std::string(argv[i]) == "--thread_layout")
+		{
+			if (i + 1 < argc)
+			{
+				const std::string layout(argv[++i]);
+				if (layout == "os")
+				{
+					MyConst::threadLayout = MyConst::LAYOUT_OS;
+
+				} else if (layout == "compact") {
+
+					MyConst::threadLayout = MyConst::LAYOUT_COMPACT;
+
+				} else if (layout == "spread") {
+
+					MyConst::threadLayout = MyConst::LAYOUT_SPREAD;
+
+				} else {
+
+					std::cerr << "Unknown thread layout \"" << layout << "\", use one of os, compact, spread! Terminating...\n\n";
+					exit(1);
+				}
+			} else {
+
+                std::cerr << "No thread layout for option \"" << argv[i] << "\" provided! Terminating...\n\n";
+                exit(1);
+			}
+			continue;
+		}
+		if (std::string(argv[i]) == "--schedule")
+		{
+			if (i + 1 < argc)
+			{
+				const std::string sched(argv[++i]);
+				if (sched == "static")
+				{
+					MyConst::schedule = MyConst::SCHED_STATIC;
+
+				} else if (sched == "dynamic") {
+
+					MyConst::schedule = MyConst::SCHED_DYNAMIC;
+
+				} else if (sched == "auto") {
+
+					MyConst::schedule = MyConst::SCHED_AUTO;
+
+				} else {
+
+					std::cerr << "Unknown schedule \"" << sched << "\", use one of static, dynamic, auto! Terminating...\n\n";
+					exit(1);
+				}
+			} else {
+
+                std::cerr << "No schedule for option \"" << argv[i] << "\" provided! Terminating...\n\n";
+                exit(1);
+			}
+			continue;
+		}
+
+
+        // no such option
+        std::cerr << "Don\'t know the option \"" << argv[i] << "\". Terminating...\n\n";
+        exit(1);
+
+    }
+	MyConst::checkRuntimeParams();
+	if (loadedRef != nullptr)
+	{
+		loadIndexFlag = true;
+	}
+	if (!serverSocket.empty() && !loadIndexFlag)
+	{
+		std::cerr << "The alignment server needs an index to load (see \"--load_index\"). Terminating...\n\n";
+		exit(1);
+	}
+	if (!sweepFile.empty() && (!loadIndexFlag || scFlag || !serverSocket.empty() || sweepReads == 0))
+	{
+		std::cerr << "A parameter sweep (\"--sweep\") needs an index to load (see \"--load_index\"), reads given with \"-r\" or \"-r1\" and \"-r2\" and at least one read per setting (see \"--sweep_reads\"). Terminating...\n\n";
+		exit(1);
+	}
+	if (autotuneFlag && (!loadIndexFlag || scFlag || !serverSocket.empty() || !sweepFile.empty() || resumeFlag))
+	{
+		std::cerr << "Autotuning (\"--autotune\") needs an index to load (see \"--load_index\") and reads given with \"-r\" or \"-r1\" and \"-r2\", not single cell mode, a server, a sweep or a resumed run. Terminating...\n\n";
+		exit(1);
+	}
+	if (indexStatsFlag && !loadIndexFlag)
+	{
+		std::cerr << "Index statistics need an index to load (see \"--load_index\"). Terminating...\n\n";
+		exit(1);
+	}
+	if (scOutFlag && !scFlag)
+	{
+		std::cerr << "Output path for single cell analysis given but no single cell input provided (see \"--sc_input\"). Terminating...\n\n";
+		exit(1);
+	}
+	if (!barcodeFile.empty() && scMetaFile != NULL)
+	{
+		std::cerr << "Single cell reads are given either per cell (\"--sc_input\") or multiplexed with a barcode whitelist (\"--sc_barcodes\"), not both. Terminating...\n\n";
+		exit(1);
+	}
+	if (barcodeLen > 0 && barcodeFile.empty())
+	{
+		std::cerr << "Barcode length given but no barcode whitelist provided (see \"--sc_barcodes\"). Terminating...\n\n";
+		exit(1);
+	}
+	if (!barcodeFile.empty() && loadIndexFlag && (readFiles.empty() || interleavedFlag || (pairedReadFlag && readFiles2.size() != readFiles.size())))
+	{
+		std::cerr << "Multiplexed single cell reads are given with \"-r\", or with \"-r1\" and \"-r2\" with one file of read 2 per file of read 1 (not interleaved). Terminating...\n\n";
+		exit(1);
+	}
+	if (scFlag && MyConst::shardNum > 1)
+	{
+		std::cerr << "Sharding is not supported in single cell mode. Terminating...\n\n";
+		exit(1);
+	}
+	if (MyConst::shardNum > 1 && mergeFiles.empty())
+	{
+		// every shard writes its own counts, summed up with --merge
+		outputFile += "_shard" + std::to_string(MyConst::shardIdx);
+		std::cout << "Aligning shard " << MyConst::shardIdx << " of " << MyConst::shardNum << " to " << outputFile << "\n";
+	}
+	if (scFlag && (checkpointSecs > 0 || resumeFlag))
+	{
+		std::cerr << "Checkpoints are not supported in single cell mode. Terminating...\n\n";
+		exit(1);
+	}
+	if (!alignFile.empty() && (scFlag || resumeFlag))
+	{
+		std::cerr << "Alignment output is not supported in single cell mode or when resuming from a checkpoint. Terminating...\n\n";
+		exit(1);
+	}
+	if (!unmappedFile.empty() && (scFlag || resumeFlag))
+	{
+		std::cerr << "The output of unaligned reads is not supported in single cell mode or when resuming from a checkpoint. Terminating...\n\n";
+		exit(1);
+	}
+	if (nonCpGFlag && (scFlag || checkpointSecs > 0 || resumeFlag))
+	{
+		std::cerr << "Non CpG counts are not supported in single cell mode or with checkpoints. Terminating...\n\n";
+		exit(1);
+	}
+	if (!callFile.empty() && (scFlag || resumeFlag))
+	{
+		std::cerr << "Read level methylation calls are not supported in single cell mode or when resuming from a checkpoint. Terminating...\n\n";
+		exit(1);
+	}
+	if (!qcFile.empty() && resumeFlag)
+	{
+		std::cerr << "A QC report is not supported when resuming from a checkpoint. Terminating...\n\n";
+		exit(1);
+	}
+	if (dedupFlag && (checkpointSecs > 0 || resumeFlag || MyConst::shardNum > 1))
+	{
+		std::cerr << "Duplicate removal needs all reads in one run, it is not supported with checkpoints or shards. Terminating...\n\n";
+		exit(1);
+	}
+	if (!metricsFile.empty() && scFlag)
+	{
+		std::cerr << "Live metrics are not supported in single cell mode. Terminating...\n\n";
+		exit(1);
+	}
+	if (MyConst::shardNum > 1)
+	{
+		if (!alignFile.empty())
+			insertShardSuffix(alignFile);
+		if (!unmappedFile.empty())
+			insertShardSuffix(unmappedFile);
+		if (!callFile.empty())
+			insertShardSuffix(callFile);
+		if (!qcFile.empty())
+			insertShardSuffix(qcFile);
+		if (!metricsFile.empty())
+			insertShardSuffix(metricsFile);
+	}
+	if (scSparseFlag && !scFlag)
+	{
+		std::cerr << "Sparse single cell output requested but no single cell input provided (see \"--sc_input\"). Terminating...\n\n";
+		exit(1);
+	}
+	// the whitelist is only read when the reads are aligned
+	CellBarcodes barcodes;
+	if (!barcodeFile.empty() && mergeFiles.empty() && loadIndexFlag)
+	{
+		barcodes.setReadLength(barcodeLen);
+		if (!barcodes.load(barcodeFile))
+		{
+			std::cerr << "Terminating...\n\n";
+			exit(1);
+		}
+	}
+	// bins are only read when the reads are aligned
+	const bool binFlag = binTiles > 0 || !binFile.empty();
+	const regionMap binRegions = binFile.empty() || !mergeFiles.empty() || !loadIndexFlag ? regionMap() : readTargets(binFile, 0);
+
+
+    // Start processing
+
+    if (!mergeFiles.empty())
+    {
+        mergeMethFiles(mergeFiles, outputFile, outFormat);
+        return 0;
+    }
+
+    if (loadIndexFlag)
+    {
+
+        if (noloss)
+        {
+            std::cout << "\nWARNING: You are reading an index from file. The option \"--no_loss\" has no effect.\n\n";
+        }
+        if (kmerOffsetFlag)
+        {
+            std::cout << "\nWARNING: You are reading an index from file. The option \"--kmer_offsets\" has no effect.\n\n";
+        }
+        if (kmerPrintFlag)
+        {
+            std::cout << "\nWARNING: You are reading an index from file. The option \"--kmer_prints\" has no effect.\n\n";
+        }
+        if (deferCutoff)
+        {
+            std::cout << "\nWARNING: You are reading an index from file. The option \"--defer_cutoff\" has no effect.\n\n";
+        }
+        if (syncmerFlag)
+        {
+            std::cout << "\nWARNING: You are reading an index from file. The option \"--syncmers\" has no effect.\n\n";
+        }
+        if (multiSeedFlag)
+        {
+            std::cout << "\nWARNING: You are reading an index from file. The option \"--multi_seed\" has no effect.\n\n";
+        }
+        if (compressIndexFlag)
+        {
+            std::cout << "\nWARNING: You are reading an index from file. The option \"--compress_index\" has no effect.\n\n";
+        }
+
+        if (indexStatsFlag)
+        {
+            RefGenome ref(indexFile);
+            ref.printStats(std::cout);
+            return 0;
+        }
+        if (!serverSocket.empty())
+        {
+            RefGenome ref(indexFile);
+            return serveJobs(serverSocket, ref);
+        }
+        std::unique_ptr<RefGenome> ownRef(loadedRef == nullptr ? new RefGenome(indexFile) : nullptr);
+        RefGenome& ref = loadedRef == nullptr ? *ownRef : *loadedRef;
+        if (!sweepFile.empty())
+        {
+            if (readFiles.empty() || (pairedReadFlag && !interleavedFlag && readFiles2.size() != readFiles.size()))
+            {
+                std::cerr << "No reads for the parameter sweep, or not one file of read 2 (\"-r2\") per file of read 1 (\"-r1\"). Terminating...\n\n";
+                exit(1);
+            }
+            return sweepRoutine(sweepFile, ref, readFiles, readFiles2, pairedReadFlag, readsGZ, bothStrandsFlag, sweepReads, sweepTruth);
+        }
+
+        if (autotuneFlag)
+        {
+            if (readFiles.empty() || (pairedReadFlag && !interleavedFlag && readFiles2.size() != readFiles.size()))
+            {
+                std::cerr << "No reads to autotune with, or not one file of read 2 (\"-r2\") per file of read 1 (\"-r1\"). Terminating...\n\n";
+                exit(1);
+            }
+            autotuneRoutine(ref, readFiles, readFiles2, pairedReadFlag, readsGZ, bothStrandsFlag, autotuneReads, static_cast<uint64_t>(autotuneMem) << 20);
+        }
+
+        if (pairedReadFlag)
+        {
+
+			if (scFlag)
+			{
+
+				ReadQueue rQue(scOutputFile, ref, readsGZ, bothStrandsFlag, true, outFormat, scSparseFlag);
+				if (!profileFile.empty())
+					rQue.enableProfiling(profileCounters);
+				if (binFlag)
+				{
+					rQue.setBins(binTiles, binRegions);
+					rQue.openBinMatrix(outputFile);
+				}
+				if (!qcFile.empty())
+					rQue.openQc(qcFile);
+				if (dedupFlag)
+					rQue.enableDedup();
+				if (!barcodeFile.empty())
+					queryRoutineSCBarcodes(rQue, readsGZ, barcodes, readFiles, readFiles2);
+				else
+					queryRoutineSCPaired(rQue, readsGZ, bothStrandsFlag, scMetaFile);
+				rQue.printMethylationLevels(outputFile, outFormat);
+				rQue.writeQc();
+				if (dedupFlag)
+					std::cout << "Duplicates removed: " << rQue.duplicateCount() << "\n\n";
+				if (!profileFile.empty())
+					rQue.writeProfile(profileFile);
+
+			} else {
+
+				if (interleavedFlag && !readFiles2.empty())
+				{
+					std::cerr << "Interleaved reads are given with \"-r\" only, not with \"-r2\". Terminating...\n\n";
+					exit(1);
+				}
+				if (readFiles.empty() || (readFiles2.empty() && !interleavedFlag))
+				{
+					std::cerr << "Entered paired end mode (\"-r1\" or \"-r2\" flag), but one of the read files is missing. Terminating...\n\n";
+					exit(1);
+				}
+				if (!interleavedFlag && readFiles.size() != readFiles2.size())
+				{
+					std::cerr << "Got " << readFiles.size() << " files for read 1 (\"-r1\") but " << readFiles2.size() << " for read 2 (\"-r2\"). Terminating...\n\n";
+					exit(1);
+				}
+				ReadQueue rQue(readFiles, readFiles2, ref, readsGZ, bothStrandsFlag);
+				if (!profileFile.empty())
+					rQue.enableProfiling(profileCounters);
+				if (binFlag)
+					rQue.setBins(binTiles, binRegions);
+				if (!alignFile.empty())
+					rQue.openAlignments(alignFile);
+				if (!unmappedFile.empty())
+					rQue.openUnmapped(unmappedFile);
+				if (!callFile.empty())
+					rQue.openReadCalls(callFile);
+				if (nonCpGFlag)
+					rQue.enableContextCalls();
+				if (!qcFile.empty())
+					rQue.openQc(qcFile);
+				if (dedupFlag)
+					rQue.enableDedup();
+				Metrics metrics;
+				if (!metricsFile.empty() && !metrics.open(metricsFile, metricsSecs, true))
+				{
+					std::cerr << "Could not write metrics file " << metricsFile << "! Terminating...\n\n";
+					exit(1);
+				}
+				queryRoutinePaired(rQue, readsGZ, bothStrandsFlag, outputFile + ".ckpt", checkpointSecs, resumeFlag, metrics);
+				rQue.printMethylationLevels(outputFile, outFormat);
+				rQue.printBins(outputFile);
+				rQue.printContextLevels(outputFile, outFormat);
+				rQue.writeQc();
+				if (dedupFlag)
+					std::cout << "Duplicates removed: " << rQue.duplicateCount() << "\n\n";
+				std::remove((outputFile + ".ckpt").c_str());
+				if (!profileFile.empty())
+					rQue.writeProfile(profileFile);
+			}
+
+        } else {
+
+			if (scFlag)
+			{
+
+				ReadQueue rQue(scOutputFile, ref, readsGZ, bothStrandsFlag, false, outFormat, scSparseFlag);
+				if (!profileFile.empty())
+					rQue.enableProfiling(profileCounters);
+				if (binFlag)
+				{
+					rQue.setBins(binTiles, binRegions);
+					rQue.openBinMatrix(outputFile);
+				}
+				if (!qcFile.empty())
+					rQue.openQc(qcFile);
+				if (dedupFlag)
+					rQue.enableDedup();
+				if (!barcodeFile.empty())
+					queryRoutineSCBarcodes(rQue, readsGZ, barcodes, readFiles, readFiles2);
+				else
+					queryRoutineSC(rQue, readsGZ, bothStrandsFlag, scMetaFile);
+				rQue.printMethylationLevels(outputFile, outFormat);
+				rQue.writeQc();
+				if (dedupFlag)
+					std::cout << "Duplicates removed: " << rQue.duplicateCount() << "\n\n";
+				if (!profileFile.empty())
+					rQue.writeProfile(profileFile);
+
+			} else {
+
+				if (readFiles.empty())
+				{
+
+					std::cerr << "No read file provided! Use \"-r\" option to specify read file path. Terminating...\n\n";
+					exit(1);
+
+				}
+				ReadQueue rQue(readFiles, ref, readsGZ, bothStrandsFlag);
+				if (!profileFile.empty())
+					rQue.enableProfiling(profileCounters);
+				if (binFlag)
+					rQue.setBins(binTiles, binRegions);
+				if (!alignFile.empty())
+					rQue.openAlignments(alignFile);
+				if (!unmappedFile.empty())
+					rQue.openUnmapped(unmappedFile);
+				if (!callFile.empty())
+					rQue.openReadCalls(callFile);
+				if (nonCpGFlag)
+					rQue.enableContextCalls();
+				if (!qcFile.empty())
+					rQue.openQc(qcFile);
+				if (dedupFlag)
+					rQue.enableDedup();
+				Metrics metrics;
+				if (!metricsFile.empty() && !metrics.open(metricsFile, metricsSecs, false))
+				{
+					std::cerr << "Could not write metrics file " << metricsFile << "! Terminating...\n\n";
+					exit(1);
+				}
+				queryRoutine(rQue, readsGZ, bothStrandsFlag, outputFile + ".ckpt", checkpointSecs, resumeFlag, metrics);
+				rQue.printMethylationLevels(outputFile, outFormat);
+				rQue.printBins(outputFile);
+				rQue.printContextLevels(outputFile, outFormat);
+				rQue.writeQc();
+				if (dedupFlag)
+					std::cout << "Duplicates removed: " << rQue.duplicateCount() << "\n\n";
+				std::remove((outputFile + ".ckpt").c_str());
+				if (!profileFile.empty())
+					rQue.writeProfile(profileFile);
+			}
+        }
+
+    } else {
 
-        if (genomeFile == "")
+        if (genomeFile == "" && genomeFiles.empty())
         {
             std::cerr << "No reference genome file provided! Use \"--genome\" option to specify reference genome file path. Terminating...\n\n";
             exit(1);
         }
+        if (!genomeFiles.empty() && (genomeFile != "" || !extendFile.empty()))
+        {
+            std::cerr << "Option \"--genomes\" cannot be combined with \"--genome\" or \"--extend_index\"! Terminating...\n\n";
+            exit(1);
+        }
         if (!storeIndexFlag)
         {
             std::cerr << "No path to store index provided! Use \"--store_index\" option to specify path. Terminating...\n\n";
@@ -331,15 +1569,62 @@ int main(int argc, char** argv)
         std::vector<struct CpG> cpgTab;
         std::vector<struct CpG> cpgStartTab;
         std::vector<std::vector<char>> genSeq;
-		std::unordered_map<uint8_t, std::string> chrMap;
+		std::unordered_map<chromId, std::string> chrMap;
+        std::vector<uint32_t> chrOffsets;
 
-        readReference(genomeFile, cpgTab, cpgStartTab, genSeq, chrMap, humanOptFlag);
-        RefGenome ref(std::move(cpgTab), std::move(cpgStartTab), genSeq, noloss, chrMap);
-
-        if (storeIndexFlag)
+        if (!targetFile.empty() && rrbsMax > 0)
+        {
+            std::cerr << "Options \"--targets\" and \"--rrbs\" cannot be combined! Terminating...\n\n";
+            exit(1);
+        }
+        const regionMap targets = targetFile.empty() ? regionMap() : readTargets(targetFile, targetPad);
+        // the genomes of a combined index are read one after the other, their chromosomes are named after the genome
+        std::vector<std::string> genomeTags;
+        std::vector<uint8_t> chrGenome;
+        if (genomeFiles.empty())
+        {
+            readReference(genomeFile, cpgTab, cpgStartTab, genSeq, chrMap, chrOffsets, humanOptFlag, targets, rrbsMin, rrbsMax, targetPad, "");
+        }
+        for (const auto& genome : genomeFiles)
         {
-            ref.save(indexFile);
+            readReference(genome.second, cpgTab, cpgStartTab, genSeq, chrMap, chrOffsets, humanOptFlag, targets, rrbsMin, rrbsMax, targetPad, genome.first + "_");
+            chrGenome.resize(genSeq.size(), genomeTags.size());
+            genomeTags.push_back(genome.first);
+        }
+        if (!extendFile.empty())
+        {
+
+            // the sequences are appended to an existing index, which keeps its k-mer offsets and fingerprints if it has them
+            RefGenome ref(extendFile);
+            ref.extend(std::move(cpgTab), std::move(cpgStartTab), genSeq, noloss, chrMap, std::move(chrOffsets));
+            if (storeIndexFlag)
+            {
+                ref.save(indexFile, false, false, compressIndexFlag);
+            }
+
+        } else {
+
+            if (deferCutoff && noloss)
+            {
+                std::cerr << "Options \"--defer_cutoff\" and \"--no_loss\" cannot be combined! Terminating...\n\n";
+                exit(1);
+            }
+            if (deferCutoff > std::numeric_limits<uint16_t>::max())
+            {
+                std::cerr << "k-mer cutoff of option \"--defer_cutoff\" is larger than " << std::numeric_limits<uint16_t>::max() << "! Terminating...\n\n";
+                exit(1);
+            }
+            RefGenome ref(std::move(cpgTab), std::move(cpgStartTab), genSeq, noloss, chrMap, std::move(chrOffsets), syncmerFlag, multiSeedFlag, deferCutoff);
+            if (!genomeTags.empty())
+            {
+                ref.setGenomes(std::move(genomeTags), std::move(chrGenome));
+            }
 
+            if (storeIndexFlag)
+            {
+                ref.save(indexFile, kmerOffsetFlag, kmerPrintFlag, compressIndexFlag);
+
+            }
         }
     }
 
@@ -353,84 +1638,571 @@ int main(int argc, char** argv)
 
 
 
-void queryRoutine(ReadQueue& rQue, const bool isGZ, const bool bothStrandsFlag)
+void runPipeline(ReadQueue& rQue, Metrics& metrics, const std::function<void(const unsigned int)>& matchBatch)
+{
+
+    // parsing and matching overlap as soon as two batches are in flight, the output stages add the format threads
+    // and the writer
+    const unsigned int stageThreads = rQue.hasOutput() ? 3 + MyConst::outputThreads : 2;
+    Pipeline<ReadQueue::Batch> pipe(MyConst::pipelineDepth > 0 ? MyConst::pipelineDepth : stageThreads);
+    pipe.source("parse", [&rQue](ReadQueue::Batch& b)
+    {
+        return rQue.parseBatch(b);
+    });
+    // the OpenMP team matching the reads is driven by the thread of this stage
+    pipe.stage("match", 1, [&rQue, &matchBatch](ReadQueue::Batch& b)
+    {
+        rQue.swapBatch(b);
+        matchBatch(b.count);
+        rQue.swapBatch(b);
+    });
+    if (rQue.hasOutput())
+    {
+        pipe.stage("format", MyConst::outputThreads, [&rQue](ReadQueue::Batch& b)
+        {
+            rQue.formatBatch(b);
+        });
+        pipe.stage("write", 1, [&rQue](ReadQueue::Batch& b)
+        {
+            rQue.writeBatch(b);
+        });
+    }
+    metrics.attach([&pipe]() { return pipe.stats(); });
+    pipe.run();
+    metrics.attach(std::function<PipelineStats()>());
+    pipe.printTiming(std::cout);
+}
+
+void queryRoutine(ReadQueue& rQue, const bool isGZ, const bool bothStrandsFlag, const std::string& ckptPath, const unsigned int ckptSecs, const bool resume, Metrics& metrics)
 {
 
-    unsigned int readCounter = 0;
     unsigned int i = 0;
+    uint64_t readCount = 0;
     // counter
     uint64_t succMatch = 0;
     uint64_t nonUniqueMatch = 0;
     uint64_t unSuccMatch = 0;
     std::chrono::high_resolution_clock::time_point startTime = std::chrono::high_resolution_clock::now();
 
-	if (!bothStrandsFlag)
-	{
-		++i;
-		isGZ ? rQue.parseChunkGZ(readCounter) : rQue.parseChunk(readCounter);
-		rQue.matchReads(readCounter, succMatch, nonUniqueMatch, unSuccMatch, true);
-		rQue.decideStrand();
-        std::cout << "Processed " << MyConst::CHUNKSIZE * (i) << " reads\n";
-	}
+    CHECKPOINT::header ckpt;
+    const bool resumed = resume && rQue.loadCheckpoint(ckptPath, ckpt);
+    if (resumed)
+    {
+        i = ckpt.batches;
+        succMatch = ckpt.succMatch;
+        nonUniqueMatch = ckpt.nonUniqueMatch;
+        unSuccMatch = ckpt.unSuccMatch;
+    }
+    std::chrono::steady_clock::time_point lastCkpt = std::chrono::steady_clock::now();
+
+    // the strand is decided on a sample of the first batch
+    bool sample = !bothStrandsFlag && !resumed;
+    Metrics::Counts counts;
+    runPipeline(rQue, metrics, [&](const unsigned int procReads)
+    {
+        if (sample)
+        {
+            rQue.sampleStrand(procReads);
+            sample = false;
+        }
+        ++i;
+        readCount += procReads;
+        rQue.matchReads(procReads, succMatch, nonUniqueMatch, unSuccMatch, false);
+        if (readCount == procReads)
+            reportFirstBatch();
+        std::cout << "Processed " << readCount << " reads\n";
+        counts.reads = readCount;
+        counts.batches = i;
+        counts.matched = succMatch;
+        counts.unmatched = unSuccMatch;
+        counts.nonUnique = nonUniqueMatch;
+        metrics.update(counts);
+        if (ckptSecs > 0 && std::chrono::steady_clock::now() - lastCkpt >= std::chrono::seconds(ckptSecs))
+        {
+            ckpt.batches = i;
+            ckpt.succMatch = succMatch;
+            ckpt.nonUniqueMatch = nonUniqueMatch;
+            ckpt.unSuccMatch = unSuccMatch;
+            ckpt.succPairedMatch = 0;
+            ckpt.tooShortCount = 0;
+            rQue.writeCheckpoint(ckptPath, ckpt);
+            lastCkpt = std::chrono::steady_clock::now();
+        }
+    });
+
+    std::chrono::high_resolution_clock::time_point endTime = std::chrono::high_resolution_clock::now();
+    auto runtime = std::chrono::duration_cast<std::chrono::seconds>(endTime - startTime).count();
+
+    std::cout << "Done processing in " << runtime << "s\n";
+    rQue.printThreadTiming();
+    std::cout << "Successfully matched: " << succMatch << " / Unsuccessfully matched: " << unSuccMatch << " / Nonunique matches: " << nonUniqueMatch << "\n";
+    if (MyConst::readCache)
+        std::cout << "Reads taken from an identical read: " << rQue.getCachedReads() << "\n";
+    if (MyConst::candidateBudget)
+        std::cout << "Nonunique for exceeding the candidate budget: " << rQue.overBudgetCount() << "\n";
+
+}
+void queryRoutinePaired(ReadQueue& rQue, const bool isGZ, const bool bothStrandsFlag, const std::string& ckptPath, const unsigned int ckptSecs, const bool resume, Metrics& metrics)
+{
+
+    unsigned int i = 0;
+    uint64_t readCount = 0;
+    // counter
+    uint64_t succPairedMatch = 0;
+    uint64_t succMatch = 0;
+    uint64_t nonUniqueMatch = 0;
+    uint64_t unSuccMatch = 0;
+	uint64_t tooShortCount = 0;
+    std::chrono::high_resolution_clock::time_point startTime = std::chrono::high_resolution_clock::now();
+
+    CHECKPOINT::header ckpt;
+    const bool resumed = resume && rQue.loadCheckpoint(ckptPath, ckpt);
+    if (resumed)
+    {
+        i = ckpt.batches;
+        succMatch = ckpt.succMatch;
+        nonUniqueMatch = ckpt.nonUniqueMatch;
+        unSuccMatch = ckpt.unSuccMatch;
+        succPairedMatch = ckpt.succPairedMatch;
+        tooShortCount = ckpt.tooShortCount;
+    }
+    std::chrono::steady_clock::time_point lastCkpt = std::chrono::steady_clock::now();
+
+    // see queryRoutine
+    bool sample = !bothStrandsFlag && !resumed;
+    Metrics::Counts counts;
+    runPipeline(rQue, metrics, [&](const unsigned int procReads)
+    {
+        if (sample)
+        {
+            rQue.sampleStrand(procReads);
+            sample = false;
+        }
+        ++i;
+        readCount += procReads;
+        rQue.matchPairedReads(procReads, succMatch, nonUniqueMatch, unSuccMatch, succPairedMatch, tooShortCount, false);
+        if (readCount == procReads)
+            reportFirstBatch();
+        std::cout << "Processed " << readCount << " paired reads\n";
+        counts.reads = readCount;
+        counts.batches = i;
+        counts.matched = succMatch;
+        counts.unmatched = unSuccMatch;
+        counts.nonUnique = nonUniqueMatch;
+        counts.pairs = succPairedMatch;
+        counts.tooShort = tooShortCount;
+        metrics.update(counts);
+        if (ckptSecs > 0 && std::chrono::steady_clock::now() - lastCkpt >= std::chrono::seconds(ckptSecs))
+        {
+            ckpt.batches = i;
+            ckpt.succMatch = succMatch;
+            ckpt.nonUniqueMatch = nonUniqueMatch;
+            ckpt.unSuccMatch = unSuccMatch;
+            ckpt.succPairedMatch = succPairedMatch;
+            ckpt.tooShortCount = tooShortCount;
+            rQue.writeCheckpoint(ckptPath, ckpt);
+            lastCkpt = std::chrono::steady_clock::now();
+        }
+    });
+
+    std::chrono::high_resolution_clock::time_point endTime = std::chrono::high_resolution_clock::now();
+    auto runtime = std::chrono::duration_cast<std::chrono::seconds>(endTime - startTime).count();
+
+    std::cout << "Done processing in " << runtime << "s\n";
+    rQue.printThreadTiming();
+	std::cout << "\nOverall number of reads: (2*)" << readCount << "\n";
+    std::cout << "\tOverall successfully matched: " << succMatch << "\n\tUnsuccessfully matched: " << unSuccMatch << "\n\tNonunique matches: " << nonUniqueMatch << "\n\nReads discarded as too short: " << tooShortCount << "\n\nFully matched pairs: (2*)" << succPairedMatch << "\n";
+
+}
+
+// true iff the read matched at mat by rQue ends where its name says it comes from: the last field of the name
+// (fields separated by '_', up to the first white space) is the forward strand position of the first reference
+// letter of the read, and a field before it names the chromosome if the reference has more than one
+static bool matchesOrigin(ReadQueue& rQue, const Read& r, const size_t chromNum)
+{
+
+    std::string name(r.id.data(), r.id.size());
+    name = name.substr(name[0] == '@' ? 1 : 0, name.find_first_of(" \t") - (name[0] == '@' ? 1 : 0));
+    std::vector<std::string> fields;
+    std::istringstream in(name);
+    std::string field;
+    while (std::getline(in, field, '_'))
+        fields.push_back(field);
+    if (fields.empty() || fields.back().empty() || fields.back().find_first_not_of("0123456789") != std::string::npos)
+        return false;
+    if (chromNum > 1 && std::find(fields.begin(), fields.end() - 1, rQue.getMatchChrom(r.mat)) == fields.end() - 1)
+        return false;
+    // the match ends at the last letter of the forward strand interval of the read
+    const int64_t expected = std::stoll(fields.back()) + r.seq.size() - 1;
+    const int64_t diff = static_cast<int64_t>(rQue.getMatchChromPos(r.mat)) - expected;
+    return diff <= static_cast<int64_t>(MyConst::MISCOUNT) && diff >= -static_cast<int64_t>(MyConst::MISCOUNT);
+}
+
+int sweepRoutine(const std::string& sweepPath, RefGenome& ref, const std::vector<std::string>& files, const std::vector<std::string>& files2, const bool isPaired, const bool isGZ, const bool bothStrandsFlag, const uint64_t sampleReads, const bool truth)
+{
+
+    std::ifstream sweepIn(sweepPath);
+    if (!sweepIn)
+    {
+        std::cerr << "Could not open sweep file \"" << sweepPath << "\"! Terminating...\n\n";
+        exit(1);
+    }
+    std::vector<std::string> settings;
+    std::string line;
+    while (std::getline(sweepIn, line))
+    {
+        const size_t first = line.find_first_not_of(" \t\r");
+        if (first == std::string::npos || line[first] == '#')
+            continue;
+        settings.push_back(line.substr(first, line.find_last_not_of(" \t\r") + 1 - first));
+    }
+    if (settings.empty())
+    {
+        std::cerr << "Sweep file \"" << sweepPath << "\" holds no setting! Terminating...\n\n";
+        exit(1);
+    }
+
+    // the command line is the base of every setting
+    const unsigned int baseQThresh = MyConst::qThresh;
+    const unsigned int baseKmerDist = MyConst::kmerDist;
+    const unsigned int baseErrBudget = MyConst::errBudget;
+    const uint64_t baseCutoff = ref.kmerCutoffUsed();
+
+    // the table is printed at the end, after the output of the matching
+    std::ostringstream table;
+    table << "\n# parameter sweep over " << settings.size() << " settings, up to " << sampleReads << (isPaired ? " pairs" : " reads") << " each\n";
+    table << "setting\t" << (isPaired ? "pairs\tseconds\tpairs/s" : "reads\tseconds\treads/s") << "\tunique%\tnonunique%\tunmatched%" << (isPaired ? "\tpairs%" : "") << (truth ? "\tcorrect%\twrong%" : "") << "\n";
+    for (const std::string& setting : settings)
+    {
+
+        MyConst::qThresh = baseQThresh;
+        MyConst::kmerDist = baseKmerDist;
+        MyConst::errBudget = baseErrBudget;
+        uint64_t cutoff = baseCutoff;
+        std::istringstream opts(setting);
+        std::string opt;
+        std::string val;
+        while (opts >> opt)
+        {
+            if (!(opts >> val))
+            {
+                std::cerr << "No value for option \"" << opt << "\" of sweep setting \"" << setting << "\"! Terminating...\n\n";
+                exit(1);
+            }
+            if (opt == "--qthresh")
+            {
+                MyConst::qThresh = parseUIntArg(opt.c_str(), val.c_str());
+
+            } else if (opt == "--kmer_dist") {
+
+                MyConst::kmerDist = parseUIntArg(opt.c_str(), val.c_str());
+
+            } else if (opt == "--errors") {
+
+                MyConst::errBudget = parseUIntArg(opt.c_str(), val.c_str());
+
+            } else if (opt == "--kmer_cutoff") {
+
+                cutoff = parseUIntArg(opt.c_str(), val.c_str());
+
+            } else {
+
+                std::cerr << "Option \"" << opt << "\" of sweep setting \"" << setting << "\" cannot be swept, supported are \"--qthresh\", \"--kmer_dist\", \"--errors\" and \"--kmer_cutoff\". Terminating...\n\n";
+                exit(1);
+            }
+        }
+        MyConst::checkRuntimeParams();
+        if (cutoff != ref.kmerCutoffUsed() && !ref.setKmerCutoff(cutoff))
+        {
+            std::cerr << "The k-mer cutoff of sweep setting \"" << setting << "\" needs an index built with \"--defer_cutoff\" at most " << cutoff << ". Terminating...\n\n";
+            exit(1);
+        }
+
+        // thread state of ReadQueue is sized for the error budget, hence a fresh queue per setting
+        std::unique_ptr<ReadQueue> rQue(isPaired ? new ReadQueue(files, files2, ref, isGZ, bothStrandsFlag) : new ReadQueue(files, ref, isGZ, bothStrandsFlag));
+        if (truth)
+            rQue->keepIds();
+        uint64_t succMatch = 0;
+        uint64_t nonUniqueMatch = 0;
+        uint64_t unSuccMatch = 0;
+        uint64_t succPairedMatch = 0;
+        uint64_t tooShortCount = 0;
+        uint64_t correct = 0;
+        uint64_t wrong = 0;
+        uint64_t readCount = 0;
+        double sec = 0;
+        bool moreReads = true;
+        while (moreReads && readCount < sampleReads)
+        {
+            unsigned int procReads = 0;
+            moreReads = rQue->parseChunk(procReads);
+            procReads = static_cast<unsigned int>(std::min<uint64_t>(procReads, sampleReads - readCount));
+            if (procReads == 0)
+                break;
+            if (readCount == 0 && !bothStrandsFlag)
+                rQue->sampleStrand(procReads);
+
+            // only the matching is timed, parsing is overlapped with it otherwise
+            const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            if (isPaired)
+                rQue->matchPairedReads(procReads, succMatch, nonUniqueMatch, unSuccMatch, succPairedMatch, tooShortCount, false);
+            else
+                rQue->matchReads(procReads, succMatch, nonUniqueMatch, unSuccMatch, false);
+            sec += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            readCount += procReads;
+
+            if (!truth)
+                continue;
+            for (unsigned int i = 0; i < procReads; ++i)
+            {
+                for (ReadBatch* batch : {&rQue->getReads(), isPaired ? &rQue->getReads2() : nullptr})
+                {
+                    if (batch == nullptr || (*batch)[i].isInvalid)
+                        continue;
+                    if (matchesOrigin(*rQue, (*batch)[i], ref.chrMap.size()))
+                        ++correct;
+                    else
+                        ++wrong;
+                }
+            }
+        }
 
-    while(isGZ ? rQue.parseChunkGZ(readCounter) : rQue.parseChunk(readCounter))
-    {
-        ++i;
-        rQue.matchReads(readCounter, succMatch, nonUniqueMatch, unSuccMatch, false);
-        std::cout << "Processed " << MyConst::CHUNKSIZE * (i) << " reads\n";
+        // percentages of single reads, twice the number of pairs for paired reads
+        const double reads = static_cast<double>(readCount * (isPaired ? 2 : 1)) / 100;
+        table << setting << "\t" << readCount << "\t" << sec << "\t" << (sec > 0 ? readCount / sec : 0) << "\t";
+        table << succMatch / reads << "\t" << nonUniqueMatch / reads << "\t" << unSuccMatch / reads;
+        if (isPaired)
+            table << "\t" << succPairedMatch / (reads / 2);
+        if (truth)
+            table << "\t" << correct / reads << "\t" << wrong / reads;
+        table << "\n";
     }
-    // match remaining reads
-    rQue.matchReads(readCounter, succMatch, nonUniqueMatch, unSuccMatch, false);
-	std::cout << "Processed " << MyConst::CHUNKSIZE * (i+1) << " reads\n";
+    std::cout << table.str() << "\n";
 
-    std::chrono::high_resolution_clock::time_point endTime = std::chrono::high_resolution_clock::now();
-    auto runtime = std::chrono::duration_cast<std::chrono::seconds>(endTime - startTime).count();
+    MyConst::qThresh = baseQThresh;
+    MyConst::kmerDist = baseKmerDist;
+    MyConst::errBudget = baseErrBudget;
+    if (ref.kmerCutoffUsed() != baseCutoff)
+        ref.setKmerCutoff(baseCutoff);
+    return 0;
+}
 
-    std::cout << "Done processing in " << runtime << "s\n";
-    std::cout << "Successfully matched: " << succMatch << " / Unsuccessfully matched: " << unSuccMatch << " / Nonunique matches: " << nonUniqueMatch << "\n";
+// value in kB of the line starting with key of a file in the format of /proc/meminfo, 0 if there is none
+static uint64_t procKB(const char* path, const std::string& key)
+{
 
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line))
+    {
+        if (line.compare(0, key.size(), key) == 0)
+            return std::stoull(line.substr(key.size()));
+    }
+    return 0;
 }
-void queryRoutinePaired(ReadQueue& rQue, const bool isGZ, const bool bothStrandsFlag)
-{
 
-    unsigned int readCounter = 0;
-    unsigned int i = 0;
-    // counter
-    uint64_t succPairedMatch = 0;
-    uint64_t succMatch = 0;
-    uint64_t nonUniqueMatch = 0;
-    uint64_t unSuccMatch = 0;
-	uint64_t tooShortCount = 0;
-    std::chrono::high_resolution_clock::time_point startTime = std::chrono::high_resolution_clock::now();
+static const char* layoutName(const MyConst::LAYOUT layout)
+{
+    return layout == MyConst::LAYOUT_COMPACT ? "compact" : (layout == MyConst::LAYOUT_SPREAD ? "spread" : "os");
+}
 
-	if (!bothStrandsFlag)
-	{
-		++i;
-		isGZ ? rQue.parseChunkGZ(readCounter) : rQue.parseChunk(readCounter);
-		rQue.matchPairedReads(readCounter, succMatch, nonUniqueMatch, unSuccMatch, succPairedMatch, tooShortCount, true);
-		rQue.decideStrand();
-        std::cout << "Processed " << MyConst::CHUNKSIZE * (i) << " paired reads\n";
-	}
+// configuration of an autotuning trial and its outcome
+struct TuneTrial
+{
+    unsigned int threads;
+    unsigned int chunk;
+    MyConst::LAYOUT layout;
+    double readsPerSec;
+    // estimated memory an alignment run in this configuration adds to the loaded index, in bytes
+    uint64_t mem;
+};
+
+// matches the reads of sample (sample2 for read 2 of pairs) in batches with the configuration of trial and sets its
+// throughput and memory; readBytes is the memory of a read (pair) in a batch
+static void runTuneTrial(TuneTrial& trial, RefGenome& ref, const std::vector<MemoryReadSource::Seq>& sample, const std::vector<MemoryReadSource::Seq>& sample2, const bool isPaired, const bool bothStrandsFlag, const uint64_t readBytes)
+{
 
-    while(isGZ ? rQue.parseChunkGZ(readCounter) : rQue.parseChunk(readCounter))
+    MyConst::coreNum = trial.threads;
+    MyConst::chunkSize = trial.chunk;
+    MyConst::threadLayout = trial.layout;
+    // memory freed by the previous trial is returned to the system, the growth of the resident memory is then the
+    // memory of this trial
+    malloc_trim(0);
+    const uint64_t anonBefore = procKB("/proc/self/status", "RssAnon:");
+    uint64_t anonAfter = 0;
+    uint64_t readCount = 0;
+    double sec = 0;
     {
-        ++i;
-		// if (i>2)
-		// 	break;
-        rQue.matchPairedReads(readCounter, succMatch, nonUniqueMatch, unSuccMatch, succPairedMatch, tooShortCount, false);
-        std::cout << "Processed " << MyConst::CHUNKSIZE * (i) << " paired reads\n";
+        // thread state of ReadQueue is sized for the current coreNum, hence a fresh queue per trial
+        MemoryReadSource source;
+        source.reset(sample.data(), isPaired ? sample2.data() : nullptr, sample.size());
+        ReadQueue rQue(ref, isPaired, bothStrandsFlag);
+        rQue.setSource(&source);
+        uint64_t succMatch = 0;
+        uint64_t nonUniqueMatch = 0;
+        uint64_t unSuccMatch = 0;
+        uint64_t succPairedMatch = 0;
+        uint64_t tooShortCount = 0;
+        bool moreReads = true;
+        while (moreReads)
+        {
+            unsigned int procReads = 0;
+            moreReads = rQue.parseChunk(procReads);
+            if (procReads == 0)
+                break;
+            if (readCount == 0 && !bothStrandsFlag)
+                rQue.sampleStrand(procReads);
+
+            // only the matching is timed, parsing is overlapped with it otherwise
+            const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            if (isPaired)
+                rQue.matchPairedReads(procReads, succMatch, nonUniqueMatch, unSuccMatch, succPairedMatch, tooShortCount, false);
+            else
+                rQue.matchReads(procReads, succMatch, nonUniqueMatch, unSuccMatch, false);
+            sec += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            readCount += procReads;
+        }
+        anonAfter = procKB("/proc/self/status", "RssAnon:");
     }
-    // match remaining reads
-    rQue.matchPairedReads(readCounter, succMatch, nonUniqueMatch, unSuccMatch, succPairedMatch, tooShortCount, false);
-	std::cout << "Processed " << MyConst::CHUNKSIZE * (i+1) << " paired reads\n";
+    trial.readsPerSec = sec > 0 ? readCount / sec : 0;
+    // the queue itself plus the batches the pipeline of the run keeps in flight (see runPipeline)
+    const uint64_t depth = MyConst::pipelineDepth > 0 ? MyConst::pipelineDepth : 3 + MyConst::outputThreads;
+    trial.mem = (anonAfter > anonBefore ? anonAfter - anonBefore : 0) * 1024 + depth * trial.chunk * readBytes;
+}
 
-    std::chrono::high_resolution_clock::time_point endTime = std::chrono::high_resolution_clock::now();
-    auto runtime = std::chrono::duration_cast<std::chrono::seconds>(endTime - startTime).count();
+void autotuneRoutine(RefGenome& ref, const std::vector<std::string>& files, const std::vector<std::string>& files2, const bool isPaired, const bool isGZ, const bool bothStrandsFlag, const uint64_t sampleReads, const uint64_t memCap)
+{
 
-    std::cout << "Done processing in " << runtime << "s\n";
-	std::cout << "\nOverall number of reads: (2*)" << MyConst::CHUNKSIZE * i + readCounter << "\n";
-    std::cout << "\tOverall successfully matched: " << succMatch << "\n\tUnsuccessfully matched: " << unSuccMatch << "\n\tNonunique matches: " << nonUniqueMatch << "\n\nReads discarded as too short: " << tooShortCount << "\n\nFully matched pairs: (2*)" << succPairedMatch << "\n";
+    const std::chrono::steady_clock::time_point tuneStart = std::chrono::steady_clock::now();
+    const unsigned int baseChunk = MyConst::chunkSize;
+    std::vector<unsigned int> chunks;
+    for (const double f : MyConst::TUNECHUNKS)
+    {
+        const unsigned int c = std::max(1u, static_cast<unsigned int>(baseChunk * f));
+        if (std::find(chunks.begin(), chunks.end(), c) == chunks.end())
+            chunks.push_back(c);
+    }
+    const uint64_t cap = memCap > 0 ? memCap : procKB("/proc/meminfo", "MemAvailable:") * 1024;
 
+    // the sample is parsed once from the read files and held in memory for all trials
+    MyConst::chunkSize = static_cast<unsigned int>(sampleReads > 0 ? sampleReads : *std::max_element(chunks.begin(), chunks.end()));
+    std::vector<std::string> seqs;
+    std::vector<std::string> seqs2;
+    {
+        std::unique_ptr<ReadQueue> rQue(isPaired ? new ReadQueue(files, files2, ref, isGZ, bothStrandsFlag) : new ReadQueue(files, ref, isGZ, bothStrandsFlag));
+        unsigned int procReads = 0;
+        rQue->parseChunk(procReads);
+        for (unsigned int i = 0; i < procReads; ++i)
+        {
+            const Read& r = rQue->getReads()[i];
+            seqs.emplace_back(r.seq.data(), r.seq.size());
+            if (isPaired)
+            {
+                const Read& r2 = rQue->getReads2()[i];
+                seqs2.emplace_back(r2.seq.data(), r2.seq.size());
+            }
+        }
+    }
+    MyConst::chunkSize = baseChunk;
+    if (seqs.empty())
+    {
+        std::cout << "\nNo reads to autotune with, keeping " << MyConst::coreNum << " threads and batches of " << baseChunk << " reads\n\n";
+        return;
+    }
+    std::vector<MemoryReadSource::Seq> sample;
+    std::vector<MemoryReadSource::Seq> sample2;
+    uint64_t letters = 0;
+    for (size_t i = 0; i < seqs.size(); ++i)
+    {
+        sample.push_back({seqs[i].data(), seqs[i].size()});
+        letters += seqs[i].size();
+        if (isPaired)
+        {
+            sample2.push_back({seqs2[i].data(), seqs2[i].size()});
+            letters += seqs2[i].size();
+        }
+    }
+    // a read takes its record and its sequence, reverse complement and qualities (or id) in the arena of a batch
+    const uint64_t readBytes = (isPaired ? 2 : 1) * sizeof(Read) + 3 * letters / seqs.size();
+
+    // batch sizes beyond the sample cannot be told apart from the sample size
+    for (unsigned int& c : chunks)
+        c = std::min<unsigned int>(c, seqs.size());
+    std::sort(chunks.begin(), chunks.end());
+    chunks.erase(std::unique(chunks.begin(), chunks.end()), chunks.end());
+    const unsigned int firstChunk = std::min<unsigned int>(baseChunk, seqs.size());
+
+    unsigned int cpuNum = 0;
+    const std::vector<std::vector<int> > nodes = NUMA::nodeCpus();
+    for (const std::vector<int>& cpus : nodes)
+        cpuNum += cpus.size();
+    if (cpuNum == 0)
+        cpuNum = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<unsigned int> threadNums;
+    for (const unsigned int d : MyConst::TUNETHREADS)
+    {
+        const unsigned int t = std::max(1u, cpuNum / d);
+        if (std::find(threadNums.begin(), threadNums.end(), t) == threadNums.end())
+            threadNums.push_back(t);
+    }
+    // pinning only makes a difference with several nodes, and numa always spreads the threads
+    std::vector<MyConst::LAYOUT> layouts = {MyConst::LAYOUT_OS};
+    if (MyConst::numa)
+        layouts = {MyConst::LAYOUT_SPREAD};
+    else if (nodes.size() > 1)
+        layouts = {MyConst::LAYOUT_OS, MyConst::LAYOUT_COMPACT, MyConst::LAYOUT_SPREAD};
+
+    std::cout << "\nAutotuning on " << seqs.size() << (isPaired ? " pairs" : " reads") << ", " << cpuNum << " CPUs on " << nodes.size() << " node(s), memory cap " << (cap >> 20) << " MB\n\n";
+    // the first trial faults in the index and is not counted
+    TuneTrial warmUp = {threadNums.front(), firstChunk, layouts.front(), 0, 0};
+    runTuneTrial(warmUp, ref, sample, sample2, isPaired, bothStrandsFlag, readBytes);
+
+    // thread counts and layouts at the configured batch size, then the batch sizes with the best of them
+    std::vector<TuneTrial> trials;
+    const auto best = [&]() -> const TuneTrial&
+    {
+        size_t b = 0;
+        for (size_t i = 1; i < trials.size(); ++i)
+        {
+            const bool fits = trials[i].mem <= cap;
+            const bool bestFits = trials[b].mem <= cap;
+            if ((fits && (!bestFits || trials[i].readsPerSec > trials[b].readsPerSec)) || (!fits && !bestFits && trials[i].mem < trials[b].mem))
+                b = i;
+        }
+        return trials[b];
+    };
+    for (const unsigned int t : threadNums)
+    {
+        for (const MyConst::LAYOUT layout : layouts)
+        {
+            trials.push_back({t, firstChunk, layout, 0, 0});
+            runTuneTrial(trials.back(), ref, sample, sample2, isPaired, bothStrandsFlag, readBytes);
+        }
+    }
+    const TuneTrial bestLayout = best();
+    for (const unsigned int c : chunks)
+    {
+        if (c == firstChunk)
+            continue;
+        trials.push_back({bestLayout.threads, c, bestLayout.layout, 0, 0});
+        runTuneTrial(trials.back(), ref, sample, sample2, isPaired, bothStrandsFlag, readBytes);
+    }
+    const TuneTrial choice = best();
+
+    // the table is printed at the end, after the output of the matching
+    std::ostringstream table;
+    table << "\n# autotuning trials\nthreads\tchunk_size\tlayout\t" << (isPaired ? "pairs/s" : "reads/s") << "\tmemory_MB\n";
+    for (const TuneTrial& trial : trials)
+        table << trial.threads << "\t" << trial.chunk << "\t" << layoutName(trial.layout) << "\t" << trial.readsPerSec << "\t" << (trial.mem >> 20) << (trial.mem > cap ? " (over cap)" : "") << "\n";
+    std::cout << table.str() << "\n";
+    if (choice.mem > cap)
+        std::cout << "WARNING: no configuration fits the memory cap, taking the one with the least memory\n";
+    std::cout << "Autotuning chose --threads " << choice.threads << " --chunk_size " << choice.chunk << " --thread_layout " << layoutName(choice.layout);
+    std::cout << " (" << static_cast<uint64_t>(choice.readsPerSec) << (isPaired ? " pairs/s" : " reads/s") << ", about " << (choice.mem >> 20) << " MB) in ";
+    std::cout << std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now() - tuneStart).count() << "s\n\n";
+    MyConst::coreNum = choice.threads;
+    MyConst::chunkSize = choice.chunk;
+    MyConst::threadLayout = choice.layout;
 }
 
 void queryRoutineSC(ReadQueue& rQue, const bool isGZ, const bool bothStrandsFlag, const char* scMetaFile)
@@ -439,25 +2211,27 @@ void queryRoutineSC(ReadQueue& rQue, const bool isGZ, const bool bothStrandsFlag
 
 	std::ifstream scMeta (scMetaFile);
 	std::string line;
+	std::vector<ReadQueue::scCell> cells;
 	while (std::getline(scMeta, line))
 	{
 		size_t pos;
 		size_t oldPos = 0;
 
+		ReadQueue::scCell cell;
 		pos = line.find_first_of(' ');
-		std::string scId(line, oldPos, pos - oldPos);
+		cell.id = std::string(line, oldPos, pos - oldPos);
 		oldPos = pos + 1;
 		pos = line.find_first_of(' ', oldPos);
-		std::string scPath(line, oldPos, pos - oldPos);
-
-		rQue.matchSCBatch(scPath.c_str(), scId, isGZ);
-
+		cell.file1 = std::string(line, oldPos, pos - oldPos);
+		cells.push_back(cell);
 	}
+	rQue.matchSCCells(cells, isGZ);
 
     std::chrono::high_resolution_clock::time_point endTime = std::chrono::high_resolution_clock::now();
     auto runtime = std::chrono::duration_cast<std::chrono::seconds>(endTime - startTime).count();
 
     std::cout << "Done processing in " << runtime << "s\n";
+    rQue.printThreadTiming();
 }
 void queryRoutineSCPaired(ReadQueue& rQue, const bool isGZ, const bool bothStrandsFlag, const char* scMetaFile)
 {
@@ -465,30 +2239,227 @@ void queryRoutineSCPaired(ReadQueue& rQue, const bool isGZ, const bool bothStran
 
 	std::ifstream scMeta (scMetaFile);
 	std::string line;
+	std::vector<ReadQueue::scCell> cells;
 	while (std::getline(scMeta, line))
 	{
 		size_t pos;
 		size_t oldPos = 0;
 
+		ReadQueue::scCell cell;
 		pos = line.find_first_of(' ');
-		std::string scId(line, oldPos, pos - oldPos);
-		std::cout << "Processing:\n\t" << scId << "\t";
+		cell.id = std::string(line, oldPos, pos - oldPos);
 		oldPos = pos + 1;
 		pos = line.find_first_of(' ', oldPos);
-		std::string scPath1(line, oldPos, pos - oldPos);
-		std::cout << scPath1 << "\t";
+		cell.file1 = std::string(line, oldPos, pos - oldPos);
 		oldPos = pos + 1;
 		pos = line.find_first_of(' ', oldPos);
-		std::string scPath2(line, oldPos, pos - oldPos);
-		std::cout << scPath2 << "\n\n";
-
-		rQue.matchSCBatchPaired(scPath1.c_str(), scPath2.c_str(), scId, isGZ);
+		cell.file2 = std::string(line, oldPos, pos - oldPos);
+		cells.push_back(cell);
 	}
+	rQue.matchSCCells(cells, isGZ);
+
+    std::chrono::high_resolution_clock::time_point endTime = std::chrono::high_resolution_clock::now();
+    auto runtime = std::chrono::duration_cast<std::chrono::seconds>(endTime - startTime).count();
+
+    std::cout << "Done processing in " << runtime << "s\n";
+    rQue.printThreadTiming();
+}
+void queryRoutineSCBarcodes(ReadQueue& rQue, const bool isGZ, const CellBarcodes& barcodes, const std::vector<std::string>& files, const std::vector<std::string>& files2)
+{
+    std::chrono::high_resolution_clock::time_point startTime = std::chrono::high_resolution_clock::now();
+
+	std::cout << "Assigning reads to " << barcodes.size() << " cells by their barcode\n";
+	rQue.matchSCBarcodes(barcodes, files, files2, isGZ);
 
     std::chrono::high_resolution_clock::time_point endTime = std::chrono::high_resolution_clock::now();
     auto runtime = std::chrono::duration_cast<std::chrono::seconds>(endTime - startTime).count();
 
     std::cout << "Done processing in " << runtime << "s\n";
+    rQue.printThreadTiming();
+}
+
+int serveJobs(const std::string& socketPath, RefGenome& ref)
+{
+
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(addr.sun_path))
+    {
+        std::cerr << "Socket path " << socketPath << " is too long! Terminating...\n\n";
+        exit(1);
+    }
+    strcpy(addr.sun_path, socketPath.c_str());
+
+    const int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    // a socket left behind by a server that was killed
+    unlink(socketPath.c_str());
+    if (sock < 0 || bind(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(sock, 16) != 0)
+    {
+        std::cerr << "Could not listen on socket " << socketPath << "! Terminating...\n\n";
+        exit(1);
+    }
+    // a client that went away must not kill the server
+    signal(SIGPIPE, SIG_IGN);
+    std::cout << "Alignment server listening on " << socketPath << "\n" << std::flush;
+
+    while (true)
+    {
+        const int conn = accept(sock, nullptr, nullptr);
+        if (conn < 0)
+            continue;
+
+        // request: working directory of the client followed by the arguments of the job,
+        // each terminated by '\0', the end is marked by an empty string
+        std::vector<std::string> req;
+        std::string cur;
+        char buf[4096];
+        bool complete = false;
+        ssize_t n;
+        while (!complete && (n = read(conn, buf, sizeof(buf))) > 0)
+        {
+            for (ssize_t i = 0; i < n && !complete; ++i)
+            {
+                if (buf[i] != '\0')
+                {
+                    cur.push_back(buf[i]);
+
+                } else if (cur.empty()) {
+
+                    complete = true;
+
+                } else {
+
+                    req.push_back(std::move(cur));
+                    cur.clear();
+                }
+            }
+        }
+        if (!complete || req.empty())
+        {
+            close(conn);
+            continue;
+        }
+        std::cout << "Job:";
+        for (size_t i = 1; i < req.size(); ++i)
+            std::cout << " " << req[i];
+        std::cout << "\n" << std::flush;
+
+        // the job runs in a child sharing the index pages with the server, such that a job terminating
+        // on invalid input does not take the server down and every job starts from the default parameters
+        // the server itself never enters an OpenMP parallel region, whose threads would not survive the fork
+        const pid_t pid = fork();
+        if (pid == 0)
+        {
+            close(sock);
+            signal(SIGPIPE, SIG_DFL);
+            dup2(conn, STDOUT_FILENO);
+            dup2(conn, STDERR_FILENO);
+            close(conn);
+            if (chdir(req[0].c_str()) != 0)
+            {
+                std::cerr << "Could not change to working directory " << req[0] << "! Terminating...\n\n";
+                exit(1);
+            }
+            std::vector<char*> jobArgv;
+            jobArgv.push_back(const_cast<char*>("FAME"));
+            for (size_t i = 1; i < req.size(); ++i)
+                jobArgv.push_back(&req[i][0]);
+            jobArgv.push_back(nullptr);
+            const int ret = runFAME(static_cast<int>(jobArgv.size()) - 1, jobArgv.data(), &ref);
+            std::cout << std::flush;
+            exit(ret);
+        }
+
+        int status = 1;
+        if (pid < 0 || waitpid(pid, &status, 0) < 0)
+        {
+            status = 1;
+
+        } else {
+
+            status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+        }
+        const std::string trailer = std::string(1, JOBEXIT) + std::to_string(status) + "\n";
+        if (write(conn, trailer.data(), trailer.size()) < 0)
+            std::cerr << "Client of the job went away\n";
+        close(conn);
+        std::cout << "Job finished with status " << status << "\n" << std::flush;
+    }
+    return 0;
+}
+
+int submitJob(const std::string& socketPath, int argc, char** argv)
+{
+
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(addr.sun_path))
+    {
+        std::cerr << "Socket path " << socketPath << " is too long! Terminating...\n\n";
+        exit(1);
+    }
+    strcpy(addr.sun_path, socketPath.c_str());
+
+    const int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0 || connect(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0)
+    {
+        std::cerr << "Could not connect to the alignment server at " << socketPath << "! Terminating...\n\n";
+        exit(1);
+    }
+
+    // relative paths of the job are resolved in the working directory of the client
+    std::vector<char> cwd(4096);
+    if (getcwd(cwd.data(), cwd.size()) == nullptr)
+    {
+        std::cerr << "Could not determine the working directory! Terminating...\n\n";
+        exit(1);
+    }
+    std::string req(cwd.data());
+    req.push_back('\0');
+    for (int i = 0; i < argc; ++i)
+    {
+        req += argv[i];
+        req.push_back('\0');
+    }
+    req.push_back('\0');
+    for (size_t off = 0; off < req.size(); )
+    {
+        const ssize_t n = write(sock, req.data() + off, req.size() - off);
+        if (n <= 0)
+        {
+            std::cerr << "Could not send the job to the alignment server! Terminating...\n\n";
+            exit(1);
+        }
+        off += n;
+    }
+
+    // pass the output of the job through line by line, the last line holds its exit status
+    int status = 1;
+    std::string line;
+    char buf[4096];
+    ssize_t n;
+    while ((n = read(sock, buf, sizeof(buf))) > 0)
+    {
+        for (ssize_t i = 0; i < n; ++i)
+        {
+            line.push_back(buf[i]);
+            if (buf[i] != '\n')
+                continue;
+            if (line[0] == JOBEXIT)
+            {
+                status = std::stoi(line.substr(1));
+            } else {
+                std::cout << line;
+            }
+            line.clear();
+        }
+        std::cout << std::flush;
+    }
+    std::cout << line << std::flush;
+    close(sock);
+    return status;
 }
 
 void printHelp()
@@ -510,6 +2481,10 @@ void printHelp()
 
     std::cout << "\t--genome      [.]\t\tSpecification of a filepath to a reference genome\n";
     std::cout << "\t                 \t\tin fasta format.\n\n";
+    std::cout << "\t--genomes     [.]\t\tBuild a combined index of several genomes, e.g. host and\n";
+    std::cout << "\t                 \t\tgraft, given as <tag>=<fasta>,<tag>=<fasta>. Reads are\n";
+    std::cout << "\t                 \t\tassigned to the genome of their unique match, the CpG\n";
+    std::cout << "\t                 \t\ttable is written per genome (<basename>_<tag>_cpg.tsv).\n\n";
 
     std::cout << "\t-r            [.]\t\tSpecification of a filepath to a set of reads in\n";
     std::cout << "\t                 \t\tfastq format. If not specified, index is built and\n";
@@ -519,6 +2494,14 @@ void printHelp()
     std::cout << "\t                 \t\tfastq format corresponding to the first resp. second\n";
     std::cout << "\t                 \t\tread infor paired read set\n\n";
 
+    std::cout << "\t                 \t\t-r, -r1 and -r2 take comma separated lists of files\n";
+    std::cout << "\t                 \t\tand may be repeated, the files of a sample (e.g. its\n";
+    std::cout << "\t                 \t\tlanes) are read back to back in one run. A file\n";
+    std::cout << "\t                 \t\tnamed - is read from stdin, named pipes work as well.\n\n";
+
+    std::cout << "\t--interleaved   \t\tPaired end reads given with -r, read 1 and read 2 of\n";
+    std::cout << "\t                 \t\ta pair in consecutive records (e.g. from a trimmer).\n\n";
+
     std::cout << "\t--both_strands   \t\tAlways try to match the reads against both strands of\n";
     std::cout << "\t                 \t\treference file (unstranded libraries).\n\n";
 
@@ -537,13 +2520,265 @@ void printHelp()
     std::cout << "\t                 \t\tgenerating a file with name basename_cpg.tsv\n";
     std::cout << "\t                 \t\tFormat is specified as header in first line of file.\n\n";
 
+    std::cout << "\t--out_format  [.]\t\tFormat of the methylation output, one of tsv (default),\n";
+    std::cout << "\t                 \t\tbgzip (basename_cpg.tsv.gz) or binary (basename_cpg.bin).\n";
+    std::cout << "\t                 \t\tSingle cell output supports tsv and bgzip.\n\n";
+
+    std::cout << "\t--align_out   [.]\t\tWrite the alignment of every read to the given file, as\n";
+    std::cout << "\t                 \t\tBAM if it ends with .bam, bgzip compressed SAM if it ends\n";
+    std::cout << "\t                 \t\twith .gz and SAM otherwise, in the order of the input.\n\n";
+
+    std::cout << "\t--unmapped_out [.]\t\tWrite the reads without a unique match to the given\n";
+    std::cout << "\t                 \t\tFASTQ file (gzip compressed if it ends with .gz), tagged\n";
+    std::cout << "\t                 \t\twith the reason. Mates are written interleaved.\n\n";
+
+    std::cout << "\t--non_cpg       \t\tCount the cytosines in CHG and CHH context as well and\n";
+    std::cout << "\t                 \t\twrite them to basename_context.tsv.\n\n";
+
+    std::cout << "\t--read_calls  [.]\t\tWrite the methylation calls of every aligned read as\n";
+    std::cout << "\t                 \t\tbgzip compressed binary records (CpG bitsets) to the\n";
+    std::cout << "\t                 \t\tgiven file.\n\n";
+
+    std::cout << "\t--qc          [.]\t\tWrite a bisulfite QC report (M-bias, non CpG conversion\n";
+    std::cout << "\t                 \t\tper chromosome, read length, error and insert size\n";
+    std::cout << "\t                 \t\thistograms) of the aligned reads to the given file.\n\n";
+
+    std::cout << "\t--dedup         \t\tCount reads (pairs) whose 5' position, strand and mate\n";
+    std::cout << "\t                 \t\tposition equal those of an earlier read (of the same cell)\n";
+    std::cout << "\t                 \t\tas PCR duplicates and leave them out of all counts.\n\n";
+
+    std::cout << "\t--checkpoint  [.]\t\tWrite the counts so far and the position in the reads\n";
+    std::cout << "\t                 \t\tto basename.ckpt every given number of seconds.\n\n";
+
+    std::cout << "\t--resume        \t\tContinue from basename.ckpt if it exists (same index,\n";
+    std::cout << "\t                 \t\tread files and options as the interrupted run).\n\n";
+
+    std::cout << "\t--metrics     [.]\t\tRewrite the given file with live metrics (reads/s, stage\n";
+    std::cout << "\t                 \t\ttimes, queues, batch latency, memory) while aligning,\n";
+    std::cout << "\t                 \t\tPrometheus text format if it ends with .prom, else JSON.\n\n";
+
+    std::cout << "\t--metrics_interval [.]\tSeconds between two writes of --metrics (default 10).\n\n";
+
+    std::cout << "\t--bins        [.]\t\tAggregate the methylation levels over tiles of the given\n";
+    std::cout << "\t                 \t\tnumber of bp or over the regions of the given BED file\n";
+    std::cout << "\t                 \t\tand write them to basename_bins.bedGraph (single cell:\n";
+    std::cout << "\t                 \t\tcounts of every cell to basename_bins.bin).\n\n";
+
+    std::cout << "\t--shard       [.]\t\tAlign only shard i of n of the reads (i/n, zero based)\n";
+    std::cout << "\t                 \t\tor the shard given by the MPI or SLURM rank (auto).\n";
+    std::cout << "\t                 \t\tOutput goes to basename_shard<i>, combine with --merge.\n\n";
+
+    std::cout << "\t--merge       [.]\t\tSum the counts of the given binary methylation files\n";
+    std::cout << "\t                 \t\t(comma separated, computed with the same index) and\n";
+    std::cout << "\t                 \t\twrite them to the file given by -o and --out_format.\n\n";
+
     std::cout << "\t--no_loss        \t\tIndex is constructed losless (NOT RECOMMENDED)\n\n";
 
+    std::cout << "\t--index_mem   [.]\t\tMemory budget in MB for the k-mer table of index construction,\n";
+    std::cout << "\t                 \t\tlarger tables are built in several passes over the reference\n";
+    std::cout << "\t                 \t\tthrough a temporary file in TMPDIR (default 0 = no budget).\n\n";
+
+    std::cout << "\t--kmer_offsets   \t\tStored index keeps the position of every k-mer in its window,\n";
+    std::cout << "\t                 \t\tthe seeds then restrict the verification of a read to a band\n";
+    std::cout << "\t                 \t\taround its predicted position (index grows by 2 bytes per k-mer).\n\n";
+
+    std::cout << "\t--kmer_prints    \t\tStored index keeps a fingerprint of every k-mer, seeding then\n";
+    std::cout << "\t                 \t\tskips the k-mers of other sequences that share a bucket with\n";
+    std::cout << "\t                 \t\tthe read k-mer (index grows by 1 byte per k-mer).\n\n";
+
+    std::cout << "\t--defer_cutoff[.]\t\tStored index keeps the unfiltered hash table and the k-mer\n";
+    std::cout << "\t                 \t\tcounts, it is filtered when it is loaded with the cutoff of\n";
+    std::cout << "\t                 \t\t--kmer_cutoff, which may not be below the given one.\n\n";
+
+    std::cout << "\t--syncmers       \t\tIndex only the syncmers of the reference instead of every\n";
+    std::cout << "\t                 \t\tsecond k-mer, reads then only look up their syncmers\n";
+    std::cout << "\t                 \t\t(smaller index, fewer hash table probes per read).\n\n";
+
+    std::cout << "\t--multi_seed     \t\tHash every k-mer of the index with two complementary spaced\n";
+    std::cout << "\t                 \t\tseeds, more reads with errors find their seeds\n";
+    std::cout << "\t                 \t\t(index grows about twofold).\n\n";
+
+    std::cout << "\t--compress_index \t\tStore the index compressed in blocks, which are decompressed\n";
+    std::cout << "\t                 \t\tin parallel when it is loaded.\n\n";
+
 	std::cout << "\t--unord_reads	\t\tDisable optimization to find stranding of reads.\n\n";
 
 	std::cout << "\t--human_opt     \t\tThe reference genome is treated as GRCH or HG version\n";
 	std::cout << "\t                \t\tof the human genome. Unlocalized contigs etc are pruned.\n\n";
 
+	std::cout << "\t--targets     [.]\t\tBED file of target regions (e.g. of a capture panel), the\n";
+	std::cout << "\t                 \t\tindex is built for these regions only. Reads outside\n";
+	std::cout << "\t                 \t\tof them remain unaligned.\n\n";
+
+	std::cout << "\t--rrbs        [.]\t\tIndex for reduced representation (RRBS) libraries, given the\n";
+	std::cout << "\t                 \t\tsize selection as min-max (e.g. 40-220): only MspI fragments\n";
+	std::cout << "\t                 \t\tof this length are indexed.\n\n";
+
+	std::cout << "\t--extend_index [.]\t\tAppend the sequences given with --genome to this index\n";
+	std::cout << "\t                 \t\t(e.g. spike-ins or decoys) and store the result with\n";
+	std::cout << "\t                 \t\t--store_index, only the new sequences are hashed.\n\n";
+
+	std::cout << "\t--target_pad  [.]\t\tNumber of bp indexed on both sides of every target region\n";
+	std::cout << "\t                 \t\tresp. MspI fragment (default " << MyConst::TARGETPAD << ").\n\n";
+
+    std::cout << "\t--threads     [.]\n";
+    std::cout << "\t-p            [.]\t\tNumber of threads to use (default " << MyConst::DEFAULTCORENUM << ").\n\n";
+
+    std::cout << "\t--autotune       \t\tBefore aligning, match a sample of the reads with several\n";
+    std::cout << "\t                 \t\tthread counts, thread layouts and batch sizes and keep the\n";
+    std::cout << "\t                 \t\tfastest configuration within --autotune_mem (overrides\n";
+    std::cout << "\t                 \t\t--threads, --chunk_size and --thread_layout).\n\n";
+
+    std::cout << "\t--autotune_reads [.]\t\tReads (pairs) of the sample of --autotune (default the\n";
+    std::cout << "\t                 \t\tlargest batch size tried, twice --chunk_size).\n\n";
+
+    std::cout << "\t--autotune_mem [.]\t\tMemory in MB the configuration chosen by --autotune may\n";
+    std::cout << "\t                 \t\ttake besides the index (default the available memory).\n\n";
+
+    std::cout << "\t--chunk_size  [.]\t\tNumber of reads (or read pairs) processed per batch\n";
+    std::cout << "\t                 \t\t(default " << MyConst::CHUNKSIZE << ").\n\n";
+
+    std::cout << "\t--pipeline_depth [.]\t\tNumber of batches parsed, matched and written at the\n";
+    std::cout << "\t                 \t\tsame time (default: one per stage thread).\n\n";
+
+    std::cout << "\t--output_threads [.]\t\tNumber of threads formatting the output of --align_out\n";
+    std::cout << "\t                 \t\tand --unmapped_out (default 2).\n\n";
+
+    std::cout << "\t--io_depth    [.]\t\tNumber of 1MB reads or writes in flight per file\n";
+    std::cout << "\t                 \t\t(io_uring), 0 for blocking I/O (default 8).\n\n";
+
+    std::cout << "\t--errors      [.]\t\tNumber of errors allowed in the alignment of a read\n";
+    std::cout << "\t                 \t\t(default " << MyConst::MISCOUNT + MyConst::ADDMIS << ", supported are";
+    for (const unsigned int e : MyConst::ERRBUDGETS)
+    {
+        std::cout << " " << e;
+    }
+    std::cout << ").\n\n";
+
+    std::cout << "\t--qthresh     [.]\t\tMinimum number of k-mer hits of a window to verify a read\n";
+    std::cout << "\t                 \t\tin it (default " << MyConst::QTHRESH << ").\n\n";
+
+    std::cout << "\t--kmer_dist   [.]\t\tPaired reads: windows with more than this many k-mer hits\n";
+    std::cout << "\t                 \t\tfewer than the best window are skipped (default " << MyConst::KMERDIST << ").\n\n";
+
+    std::cout << "\t--mask_n        \t\tReads with Ns are matched with the Ns counted as errors\n";
+    std::cout << "\t                 \t\t(up to the error budget) instead of being discarded.\n\n";
+
+    std::cout << "\t--trim_qual   [.]\t\tCuts reads at the first window of " << MyConst::TRIMWINDOW << " bases with a mean\n";
+    std::cout << "\t                 \t\tPhred quality below the given cutoff (default 0 = off).\n\n";
+
+    std::cout << "\t--trim_adapter   \t\tCuts reads at the Illumina adapter " << MyConst::ADAPTER << "\n";
+    std::cout << "\t                 \t\t(or a prefix of it at the read end).\n\n";
+
+    std::cout << "\t--adaptive_errors\t\tSingle-end reads: after a match with e errors was found,\n";
+    std::cout << "\t                 \t\tthe remaining windows are only searched for matches with\n";
+    std::cout << "\t                 \t\tup to e + 1 errors (faster, output may differ slightly).\n\n";
+
+    std::cout << "\t--batch_verify\t\tSingle-end reads: verify the candidate windows of all reads\n";
+    std::cout << "\t              \t\tof a batch sorted by window, such that reads hitting the same\n";
+    std::cout << "\t              \t\twindow share the reference (same output).\n\n";
+
+    std::cout << "\t--offload\t\tSingle-end reads: as --batch_verify, but all windows of a batch\n";
+    std::cout << "\t         \t\tare verified in one kernel, on the GPU if FAME was built with\n";
+    std::cout << "\t         \t\tmake OFFLOAD=<target> (same output).\n\n";
+
+    std::cout << "\t--read_cache\t\tSingle-end reads: match identical reads of a batch (e.g. PCR\n";
+    std::cout << "\t            \t\tduplicates) only once and count the result for all of them\n";
+    std::cout << "\t            \t\t(same output).\n\n";
+
+    std::cout << "\t--joint_strands\t\tSingle-end reads: verify the read and its reverse complement\n";
+    std::cout << "\t               \t\ttogether in one shift and pass (same output, pays off for\n";
+    std::cout << "\t               \t\tnon-stranded libraries).\n\n";
+
+    std::cout << "\t--mate_rescue\t\tPaired-end reads: once read 1 has a confident match, read 2\n";
+    std::cout << "\t             \t\tis only searched within the maximum pair distance of it\n";
+    std::cout << "\t             \t\tinstead of being seeded.\n\n";
+
+    std::cout << "\t--fused_pairs\t\tPaired-end reads: seed both reads of a pair in one pass with\n";
+    std::cout << "\t             \t\tsorted hit lists instead of hash map lookups per k-mer.\n\n";
+
+    std::cout << "\t--tiered_errors\t\tMatch every batch with at most " << MyConst::TIERBUDGET << " errors first and\n";
+    std::cout << "\t               \t\tretry only the reads without such a match with the full\n";
+    std::cout << "\t               \t\terror budget (faster on clean data).\n\n";
+
+    std::cout << "\t--interleave  [.]\t\tSingle-end reads: number of reads a thread seeds together,\n";
+    std::cout << "\t                 \t\tprefetching the hash table buckets of all of them at once\n";
+    std::cout << "\t                 \t\t(1 to " << MyConst::MAXINTERLEAVE << ", default 1 for one read after the other).\n\n";
+
+    std::cout << "\t--max_candidates [.]\t\tSingle-end reads: class reads with more candidate windows\n";
+    std::cout << "\t                 \t\tthan this as non-unique without verifying them (0 for no\n";
+    std::cout << "\t                 \t\tlimit, the default).\n\n";
+
+    std::cout << "\t--substitution_calls\tCall reads whose errors are all mismatches like exact\n";
+    std::cout << "\t                    \tmatches, without the banded alignment.\n\n";
+
+    std::cout << "\t--huge_pages\t\tBack the hash table and the reference sequence of a loaded\n";
+    std::cout << "\t            \t\tindex with huge pages (copied out of the index file).\n\n";
+
+    std::cout << "\t--numa\t\t\tInterleave the hash table and the reference sequence of a\n";
+    std::cout << "\t      \t\t\tloaded index over all NUMA nodes and pin the matching\n";
+    std::cout << "\t      \t\t\tthreads to CPUs spread over the nodes.\n\n";
+
+    std::cout << "\t--warm_index\t\tStart matching right after mapping the index file and\n";
+    std::cout << "\t            \t\tread its sections in the background, the hash table first.\n\n";
+
+    std::cout << "\t--window_records\tCopy the reference around every window of a loaded index,\n";
+    std::cout << "\t                \ttogether with the positions of its CpGs, into one record\n";
+    std::cout << "\t                \tper window read by verification and calling.\n\n";
+
+    std::cout << "\t--hot_buckets [.]\t\tKB for compact window lists of the largest hash table\n";
+    std::cout << "\t                 \t\tbuckets of a loaded index, read by seeding instead of the\n";
+    std::cout << "\t                 \t\tbuckets (default 0 = none).\n\n";
+
+    std::cout << "\t--kmer_cutoff [.]\t\tk-mer cutoff an index stored with --defer_cutoff is\n";
+    std::cout << "\t                 \t\tfiltered with (default KMERCUTOFF).\n\n";
+
+    std::cout << "\t--verify_index\t\tVerify the checksums of all sections of a loaded index\n";
+    std::cout << "\t              \t\tbefore aligning.\n\n";
+
+    std::cout << "\t--index_stats\t\tPrint the sections of the index given by --load_index\n";
+    std::cout << "\t             \t\twith their sizes, the bucket size histogram, the number\n";
+    std::cout << "\t             \t\tof blacklisted k-mers and window and CpG statistics\n";
+    std::cout << "\t             \t\tand exit.\n\n";
+
+    std::cout << "\t--profile     [.]\t\tWrite the time spent per thread in parsing, seed lookup,\n";
+    std::cout << "\t                 \t\tverification, match extraction, alignment and output as\n";
+    std::cout << "\t                 \t\twell as bucket size and candidate histograms to the given\n";
+    std::cout << "\t                 \t\tfile (tab separated).\n\n";
+    std::cout << "\t--profile_counters\t\tAdd cycles, instructions, LLC, DTLB and branch misses per\n";
+    std::cout << "\t                  \t\tstage and thread to the profile (perf_event_open).\n\n";
+    std::cout << "\t--sc_barcodes [.]\t\tSingle cell reads of all cells in the files of -r (or\n";
+    std::cout << "\t                 \t\t-r1/-r2), assigned to the cells of the given barcode\n";
+    std::cout << "\t                 \t\twhitelist (one mismatch allowed).\n\n";
+
+    std::cout << "\t--sc_barcode_len [.]\t\tThe barcode is the given number of letters at the\n";
+    std::cout << "\t                 \t\tstart of read 1 instead of the end of the read header.\n\n";
+
+    std::cout << "\t--schedule    [.]\t\tDistribution of the reads of a batch among the threads,\n";
+    std::cout << "\t                 \t\tone of static, dynamic, auto (default). auto switches to\n";
+    std::cout << "\t                 \t\tdynamic after batches with large per thread imbalance.\n\n";
+
+    std::cout << "\t--thread_layout [.]\t\tCPUs the matching threads run on: os (default, not\n";
+    std::cout << "\t                 \t\tpinned), compact (one NUMA node after the other) or\n";
+    std::cout << "\t                 \t\tspread (alternating between the nodes).\n\n";
+
+    std::cout << "\t--server      [.]\t\tLoad the index given by --load_index once and run\n";
+    std::cout << "\t                 \t\talignment jobs sent to the given unix socket.\n\n";
+
+    std::cout << "\t--submit      [.]\t\tSend all following arguments as a job to the server\n";
+    std::cout << "\t                 \t\tlistening on the given socket and print its output.\n\n";
+
+    std::cout << "\t--sweep       [.]\t\tMatch a sample of the reads against the index of\n";
+    std::cout << "\t                 \t\t--load_index once per line of the given file, a setting\n";
+    std::cout << "\t                 \t\tof --qthresh, --kmer_dist, --errors and --kmer_cutoff, and\n";
+    std::cout << "\t                 \t\tprint throughput and match rates per setting.\n\n";
+
+    std::cout << "\t--sweep_reads [.]\t\tReads (pairs) matched per setting of --sweep\n";
+    std::cout << "\t                 \t\t(default 100000).\n\n";
+
+    std::cout << "\t--sweep_truth    \t\tCheck the matches of --sweep against the origin in the\n";
+    std::cout << "\t                 \t\tread names (chromosome_position, see README).\n\n";
+
     std::cout << "\nEXAMPLES\n\n";
 
     std::cout << "Setting: Read a reference genome and save index for\n";
@@ -552,7 +2787,95 @@ void printHelp()
 
     std::cout << "Setting: Load index from previously stored index, map reads stored in .gz\n";
     std::cout << "format.\n\n";
-    std::cout << "\t /path/to/Metal --load_index index.bin -r /path/to/reads.fastq.gz\n\n\n";
+    std::cout << "\t /path/to/Metal --load_index index.bin -r /path/to/reads.fastq.gz\n\n";
+
+    std::cout << "Setting: Keep the index loaded and align several samples against it.\n\n";
+    std::cout << "\t /path/to/Metal --load_index index.bin --server /tmp/metal.sock &\n";
+    std::cout << "\t /path/to/Metal --submit /tmp/metal.sock -r sample1.fastq -o sample1\n";
+    std::cout << "\t /path/to/Metal --submit /tmp/metal.sock -r1 s2_1.fastq -r2 s2_2.fastq -o sample2\n\n";
+
+    std::cout << "Setting: Compare error budgets and q-gram thresholds on 100000 reads.\n\n";
+    std::cout << "\t printf -- '--errors 4\\n--errors 6\\n--qthresh 4\\n' > sweep.txt\n";
+    std::cout << "\t /path/to/Metal --load_index index.bin -r reads.fastq --sweep sweep.txt\n\n\n";
 
     std::cout << "\n\n";
 }
+
+unsigned int parseUIntArg(const char* opt, const char* val)
+{
+
+    char* end;
+    const unsigned long n = strtoul(val, &end, 10);
+    if (*val == '\0' || *end != '\0' || *val == '-' || n > std::numeric_limits<unsigned int>::max())
+    {
+        std::cerr << "Invalid argument \"" << val << "\" for option \"" << opt << "\"! Terminating...\n\n";
+        exit(1);
+    }
+    return static_cast<unsigned int>(n);
+}
+void splitFileList(const char* list, std::vector<std::string>& files)
+{
+
+    std::string path;
+    for (const char* c = list; ; ++c)
+    {
+        if (*c == ',' || *c == '\0')
+        {
+            if (!path.empty())
+                files.push_back(path);
+            path.clear();
+            if (*c == '\0')
+                break;
+
+        } else {
+
+            path.push_back(*c);
+        }
+    }
+}
+
+void parseShard(const char* opt, const std::string& arg)
+{
+
+    if (arg == "auto")
+    {
+        // rank and size as exported by Open MPI, MPICH (and derivatives) and SLURM
+        const std::array<std::array<const char*, 2>, 3> vars = {{ {{"OMPI_COMM_WORLD_RANK", "OMPI_COMM_WORLD_SIZE"}},
+                                                                  {{"PMI_RANK", "PMI_SIZE"}},
+                                                                  {{"SLURM_PROCID", "SLURM_NTASKS"}} }};
+        for (const auto& v : vars)
+        {
+            const char* rank = std::getenv(v[0]);
+            const char* size = std::getenv(v[1]);
+            if (rank != nullptr && size != nullptr)
+            {
+                MyConst::shardIdx = parseUIntArg(v[0], rank);
+                MyConst::shardNum = parseUIntArg(v[1], size);
+                return;
+            }
+        }
+        std::cerr << "Option \"" << opt << " auto\" used outside of an MPI or SLURM job! Terminating...\n\n";
+        exit(1);
+    }
+
+    const size_t slash = arg.find('/');
+    if (slash == std::string::npos)
+    {
+        std::cerr << "Invalid argument \"" << arg << "\" for option \"" << opt << "\", use i/n or auto! Terminating...\n\n";
+        exit(1);
+    }
+    MyConst::shardIdx = parseUIntArg(opt, arg.substr(0, slash).c_str());
+    MyConst::shardNum = parseUIntArg(opt, arg.substr(slash + 1).c_str());
+}
+
+void insertShardSuffix(std::string& path)
+{
+
+    const size_t slash = path.find_last_of('/');
+    size_t ext = path.find_last_of('.');
+    if (ext != std::string::npos && path.compare(ext, std::string::npos, ".gz") == 0)
+        ext = path.find_last_of('.', ext - 1);
+    if (ext == std::string::npos || (slash != std::string::npos && ext < slash))
+        ext = path.size();
+    path.insert(ext, "_shard" + std::to_string(MyConst::shardIdx));
+}
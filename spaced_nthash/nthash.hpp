@@ -497,6 +497,37 @@ inline uint64_t NTPS64(const char * kmerSeq, const std::vector<bool> &seed, cons
     return sVal;
 }
 
+/*
+ * Multiple Spaced Seeds ntHash
+ *
+ * seeds given as bitmasks, bit k-1-i is set <=> position i of the k-mer is a care position
+ * sVal[s] is the spaced seed hash of seed s as computed by NTPS64, all seeds are evaluated in one pass over the
+ * k-mer with the seeds as independent lanes
+ */
+
+// multiple spaced seeds ntHash
+inline void NTMS64(const char * kmerSeq, const uint32_t *seeds, const unsigned m, const unsigned k, uint64_t &hVal, uint64_t *sVal) {
+    hVal=0;
+    for(unsigned s=0; s<m; s++) sVal[s] = 0;
+    for(unsigned i=0; i<k; i++) {
+        uint64_t ntVal = msTab[(unsigned char)kmerSeq[i]][(k-1-i)%64];
+        hVal ^= ntVal;
+        for(unsigned s=0; s<m; s++)
+            sVal[s] ^= ntVal & (0 - (uint64_t)((seeds[s] >> (k-1-i)) & 1));
+    }
+}
+
+// multiple spaced seeds ntHash for sliding k-mers
+inline void NTMS64(const char * kmerSeq, const uint32_t *seeds, const unsigned m, const unsigned char charOut, const unsigned char charIn, const unsigned k, uint64_t &hVal, uint64_t *sVal) {
+    hVal = rol1(hVal) ^ msTab[charOut][k%64] ^ msTab[charIn][0];
+    for(unsigned s=0; s<m; s++) sVal[s] = hVal;
+    for(unsigned i=0; i<k; i++) {
+        uint64_t ntVal = msTab[(unsigned char)kmerSeq[i]][(k-1-i)%64];
+        for(unsigned s=0; s<m; s++)
+            sVal[s] ^= ntVal & (0 - (uint64_t)(((seeds[s] >> (k-1-i)) & 1) ^ 1));
+    }
+}
+
 // end namespace ntHash
 }
 
@@ -37,10 +37,15 @@ struct idPos {
 };
 
 
+// internal id of a chromosome (or contig, scaffold, target region...) of the reference
+// positions stay relative to their chromosome, such that only single chromosomes are limited to 2^32 bp
+// (the id fills padding in CpG and metaWindow, neither of them grows)
+typedef uint32_t chromId;
+
 struct CpG {
 
 	// chromosome on which CpG appears
-    uint8_t chrom;
+    chromId chrom;
     // position where this CpG is present in genome
     // convention: pos points to position of start of context of CpG (C position - READLEN + 2)
     //              or to position of C if the former is negative
@@ -62,7 +67,7 @@ struct metaCpG {
 struct metaWindow {
 
 	uint32_t startPos;
-	uint8_t chrom;
+	chromId chrom;
 
     // index of first CpG of this meta CpG
 	// MyConst::CPGDUMMY if no CpG insige MetaCpG
@@ -78,6 +83,7 @@ inline constexpr bool testPODs()
 
     return (std::is_pod<struct CpG>::value && std::is_pod<struct metaCpG>::value);
 }
+static_assert(sizeof(struct CpG) == 8 && sizeof(struct metaWindow) == 16, "CpG tables must stay compact");
 
 namespace KMER {
 
@@ -117,16 +123,26 @@ namespace KMER {
 } // end namespace KMER
 namespace KMER_S {
 
-
+    // KMER DEFINITION
+    //
+    // representation of the kmers in the index used for querying
+    // meta: most significant bit is set <=> points to start meta CpG
+    //       next bit is set <=> kmer is from forward strand
+    //       lower 30 bits hold the meta CpG (window) index
+    // tmask: T mask of the kmer (see RefGenome::reproduceTMask)
     typedef struct kmer
 	{
 		uint32_t meta;
 		uint32_t tmask;
 	} kmer;
 
+    constexpr uint32_t FWDBIT = 0x40000000UL;
+    // largest meta CpG index that can be represented
+    constexpr uint32_t METAMAX = 0x3fffffffUL;
+
     inline uint32_t getMetaCpG(const KMER_S::kmer& k)
     {
-        return (k.meta & 0x7fffffffUL);
+        return (k.meta & METAMAX);
     }
 
     inline bool isStartCpG(const KMER_S::kmer& k)
@@ -134,19 +150,18 @@ namespace KMER_S {
         return (k.meta & 0x80000000UL);
     }
 
-    inline uint32_t getMetaCpG(KMER_S::kmer&& k)
+    inline bool isFwd(const KMER_S::kmer& k)
     {
-        return (k.meta & 0x7fffffffUL);
+        return (k.meta & FWDBIT);
     }
 
-    inline bool isStartCpG(KMER_S::kmer&& k)
-    {
-        return (k.meta & 0x80000000UL);
-    }
-
-	inline kmer constructKmerS(uint32_t metaCpG, uint32_t tMask)
+	// ARGUMENTS:
+	// 			core	start flag and meta CpG index as in KMER::getCore
+	// 			tMask	T mask of kmer
+	// 			fwd		flag - true iff kmer is from forward strand
+	inline kmer constructKmerS(uint32_t core, uint32_t tMask, bool fwd)
 	{
-		return {metaCpG, tMask};
+		return {fwd ? (core | FWDBIT) : core, tMask};
 	}
 } // end namespace KMER_S
 
@@ -159,6 +174,7 @@ namespace MATCH {
     // 8 higher bits hold number of errors produced by this match
     // next higher bit is strand flag
     // even next higher bit is start flag
+    // next higher bit is set iff the reverse complement of the read was matched (only set in Read::mat)
     // 32 most significant bits hold meta CpGID
     typedef uint64_t match;
 
@@ -183,6 +199,14 @@ namespace MATCH {
     {
         return static_cast<uint32_t>(m >> 32);
     }
+    inline bool isRevComp(const MATCH::match m)
+    {
+        return (m & 0x0000000004000000ULL);
+    }
+    inline MATCH::match setRevComp(const MATCH::match m)
+    {
+        return m | 0x0000000004000000ULL;
+    }
 
     inline MATCH::match constructMatch(uint16_t off, uint8_t errNum, uint64_t isFwd, uint64_t isStart, uint64_t metaID)
     {
@@ -192,5 +216,329 @@ namespace MATCH {
 } // end namespace MATCH
 
 
+namespace INDEX {
+
+    // INDEX FILE LAYOUT
+    //
+    // header (padded to ALIGN bytes) followed by the sections listed in header.sections
+    // every section starts at a multiple of ALIGN such that it can be used in place after mmap
+    // the header is written last, after all sections are on disk, such that an interrupted write leaves no valid index
+    //
+    // checksum of a section: XXH64 (see CHECKSUM::xxh64) with the section size as seed over the XXH64 values of its
+    // blocks of CHECKBLOCK bytes, each with the block number as seed, such that blocks are hashed in parallel
+
+    // "FAMEIDX" followed by a zero byte, read as little endian integer
+    constexpr uint64_t MAGIC = 0x00584449454d4146ULL;
+    // increase whenever the layout of the index file changes
+    constexpr uint32_t VERSION = 16;
+    // alignment of sections in the index file (page size)
+    constexpr uint64_t ALIGN = 4096;
+    // the bucket directory stores one 64 bit base per block of 2^TABBLOCKBITS hash keys
+    // and a 32 bit offset relative to the base of its block per key (see RefGenome::bucketStart)
+    constexpr unsigned int TABBLOCKBITS = 16;
+    // bytes per checksum block
+    constexpr uint64_t CHECKBLOCK = 1ULL << 24;
+
+    enum SECTION : uint32_t {
+        CPG = 0,        // cpgTable
+        CPGSTART,       // cpgStartTable
+        SEQ,            // all chromosome sequences 2 bit encoded (see PackedSeq) and concatenated, each starting at a new word
+        SEQOFF,         // offsets of chromosomes in the concatenated sequence in letters, one more than there are chromosomes
+        SEQNMASK,       // N masks of all chromosomes (see PackedSeq) concatenated, each starting at a new word
+        TABINDEX,       // tabIndex relative to the block bases, uint32_t per key
+        TABBLOCK,       // position of the first bucket of every block of tabIndex, uint64_t per block
+        KMERS,          // kmerTableSmall, including the strand of each kmer
+        METACPG,        // metaCpGs
+        METASTARTCPG,   // metaStartCpGs
+        METAWIN,        // metaWindows
+        FILTERED,       // filteredKmers
+        CHRMAP,         // chrMap as sequence of (internal id, name length, name)
+        KMEROFF,        // kmerOffsets, empty if the index was stored without k-mer offsets
+        CHROFF,         // chrOffsets, uint32_t per chromosome
+        KMERPRINT,      // kmerPrints, empty if the index was stored without k-mer fingerprints
+        KMERCOUNT,      // deferred index only (see RefGenome::applyKmerCutoff): occurrences of each k-mer in its bucket,
+                        // uint16_t saturated, 0 in buckets with fewer than kmerc k-mers; empty otherwise
+        FILTERCOUNT,    // deferred index only: occurrences of the k-mers of FILTERED, which lists all k-mers with at
+                        // least kmerc occurrences instead of the blacklist; empty otherwise
+        GENOMETAG,      // combined index only (see RefGenome::setGenomes): tags of the genomes as sequence of
+                        // (name length, name); empty otherwise
+        CHRGENOME,      // combined index only: genome of every chromosome, uint8_t per chromosome; empty otherwise
+        SECNUM
+    };
+
+    struct section {
+
+        // byte offset from start of file
+        uint64_t offset;
+        // size of section in bytes
+        uint64_t bytes;
+        // number of elements in section
+        uint64_t count;
+        // checksum of the section bytes
+        uint64_t checksum;
+    };
+
+    struct header {
+
+        uint64_t magic;
+        uint32_t version;
+        uint32_t secNum;
+        // constants the index was built with
+        uint64_t htabs;
+        uint64_t kmerc;
+        uint32_t readl;
+        uint32_t winl;
+        uint32_t kmerl;
+        uint32_t seedbits;
+        // SYNCLEN if the index holds the syncmers of the genome, 0 if every SKIPMOD-th k-mer
+        uint32_t syncl;
+        // number of seeds of MyConst::SEEDSET the k-mers are hashed with and these seeds, unused ones are 0
+        uint32_t seednum;
+        uint32_t seedset[2];
+        section sections[SECNUM];
+        // XXH64 of the header with this field set to 0
+        uint64_t checksum;
+    };
+
+    // COMPRESSED INDEX FILE LAYOUT (see RefGenome::save)
+    //
+    // zheader followed by the block table (one zblock per ZBLOCK bytes of the uncompressed file, the last one may be
+    // shorter) and the zlib compressed blocks; the uncompressed file is an index file as described above, its
+    // blocks are decompressed in parallel into memory on load
+
+    // "FAMEIDXZ", read as little endian integer
+    constexpr uint64_t ZMAGIC = 0x5a584449454d4146ULL;
+    // bytes of the uncompressed file per compressed block
+    constexpr uint64_t ZBLOCK = 1ULL << 22;
+
+    struct zheader {
+
+        uint64_t magic;
+        uint32_t version;
+        uint32_t reserved;
+        // size of the uncompressed file in bytes
+        uint64_t bytes;
+        // number of blocks
+        uint64_t blocks;
+        // XXH64 of the block table with the size of the uncompressed file as seed
+        uint64_t checksum;
+    };
+
+    struct zblock {
+
+        // byte offset of the compressed block from start of file
+        uint64_t offset;
+        // size of the compressed block in bytes
+        uint64_t bytes;
+    };
+
+} // end namespace INDEX
+
+
+namespace UNMAPPED {
+
+    // why a read is not aligned, reported in the dump of unaligned reads (see ReadQueue::openUnmapped)
+    enum REASON : uint8_t {
+        NONE = 0,       // read is aligned
+        LENGTH,         // read is shorter than a k-mer or longer than the automata
+        NLETTERS,       // read has more Ns than accepted
+        NOMATCH,        // no candidate window or no match within the error budget
+        NONUNIQUE,      // several equally good matches
+        OVERBUDGET      // more candidate windows than MyConst::candidateBudget, classed as non-unique
+    };
+
+} // end namespace UNMAPPED
+
+
+namespace METHFILE {
+
+    // output formats of the methylation report
+    enum FORMAT : uint8_t {
+        TSV = 0,        // tab separated text
+        BGZF,           // bgzip compressed tab separated text
+        BINARY          // binary count matrix as described below
+    };
+
+    // BINARY FILE LAYOUT
+    //
+    // header
+    // chrNum chromosome names, each as (chromId internal id, uint32_t name length, name)
+    // cpgNum records in the order of the CpGs in the index
+    //
+    // files with equal cpgNum and fingerprint hold counts of the same CpGs and can be summed record by record
+    // (see mergeMethFiles)
+
+    // "FAMEMETH" read as little endian integer
+    constexpr uint64_t MAGIC = 0x4854454d454d4146ULL;
+    // increase whenever the layout of the binary file changes
+    constexpr uint32_t VERSION = 4;
+
+    struct header {
+
+        uint64_t magic;
+        uint32_t version;
+        uint32_t chrNum;
+        uint64_t cpgNum;
+        // RefGenome::fingerprint() of the index the counts were computed with
+        uint64_t fingerprint;
+    };
+
+    struct record {
+
+        // position of the C of the CpG in its chromosome (zero based)
+        uint32_t pos;
+        // internal chromosome id as listed in the chromosome names
+        uint32_t chrom;
+        uint32_t methFwd;
+        uint32_t unmethFwd;
+        uint32_t methRev;
+        uint32_t unmethRev;
+    };
+
+} // end namespace METHFILE
+
+namespace BINFILE {
+
+    // LAYOUT OF THE SINGLE CELL TILE MATRIX (see ReadQueue::setBins)
+    //
+    // header
+    // chrNum chromosome names, each as (uint32_t name length, name)
+    // binNum bins, in the order of the bedGraph of a bulk run
+    // then for every cell
+    //      uint32_t id length, id, uint32_t number of covered bins, that many cellRecords in the order of the bins
+    //
+    // bins without a covered CpG are left out of a cell, the matrix is sparse such that its size is linear in the
+    // coverage of the cells
+
+    // "FAMEBINS" read as little endian integer
+    constexpr uint64_t MAGIC = 0x534e4942454d4146ULL;
+    // increase whenever the layout of the file changes
+    constexpr uint32_t VERSION = 1;
+
+    struct header {
+
+        uint64_t magic;
+        uint32_t version;
+        uint32_t chrNum;
+        uint64_t binNum;
+        // RefGenome::fingerprint() of the index the counts were computed with
+        uint64_t fingerprint;
+    };
+
+    struct bin {
+
+        // index of the chromosome in the list of names
+        uint32_t chrom;
+        // [start, end) zero based on the chromosome
+        uint32_t start;
+        uint32_t end;
+    };
+
+    struct cellRecord {
+
+        // index of the bin in the list of bins
+        uint32_t bin;
+        // counts of all CpGs in the bin, both strands summed
+        uint32_t meth;
+        uint32_t unmeth;
+    };
+
+} // end namespace BINFILE
+
+namespace READCALLS {
+
+    // LAYOUT OF THE READ LEVEL METHYLATION CALLS (see ReadQueue::openReadCalls)
+    //
+    // bgzip compressed
+    // header
+    // chrNum chromosome names, each as (chromId internal id, uint32_t name length, name)
+    // then one record per aligned read with a called CpG, each followed by two bitsets of (span + 7) / 8 bytes,
+    // the CpGs called in the read and the methylated ones among them; bit i (least significant bit of byte i / 8
+    // first) stands for CpG firstCpG + i, i.e. record firstCpG + i of a binary methylation file of the same index
+    //
+    // the mates of a pair follow each other, mate 1 first; the records of a batch of reads are written together,
+    // batches in input order
+
+    // "FAMECALL" read as little endian integer
+    constexpr uint64_t MAGIC = 0x4c4c4143454d4146ULL;
+    // increase whenever the layout of the file changes
+    constexpr uint32_t VERSION = 1;
+
+    enum FLAG : uint8_t {
+        REV = 1,        // read matched to the reverse strand
+        PAIRED = 2,     // read is part of a pair
+        MATE2 = 4       // read is the second mate of its pair
+    };
+
+    struct header {
+
+        uint64_t magic;
+        uint32_t version;
+        uint32_t chrNum;
+        // RefGenome::fingerprint() of the index the reads were aligned to
+        uint64_t fingerprint;
+    };
+
+    struct record {
+
+        // id of the first CpG called in the read, in the order of the CpGs in the index
+        uint32_t firstCpG;
+        // internal chromosome id as listed in the chromosome names
+        uint32_t chrom;
+        // position of the first base of the read in its chromosome (zero based), from the end of its match and
+        // hence off by the net length of indels for reads with gaps
+        uint32_t start;
+        // number of CpGs from firstCpG to the last CpG called in the read
+        uint16_t span;
+        // FLAGs
+        uint8_t flags;
+        uint8_t reserved;
+    };
+
+} // end namespace READCALLS
+
+namespace CHECKPOINT {
+
+    // CHECKPOINT FILE LAYOUT (basename.ckpt)
+    //
+    // header
+    // the counts so far as binary methylation file (see METHFILE)
+
+    // "FAMECKPT" read as little endian integer
+    constexpr uint64_t MAGIC = 0x54504b43454d4146ULL;
+    // increase whenever the layout of the checkpoint file changes
+    constexpr uint32_t VERSION = 1;
+
+    struct header {
+
+        uint64_t magic;
+        uint32_t version;
+        // 1 iff the reads are paired
+        uint32_t paired;
+        // RefGenome::fingerprint() of the index
+        uint64_t fingerprint;
+        // position after the last read whose counts are included: file (pair) of the sample, records read from
+        // it and byte offset of the next record (uncompressed files only), for read 1 and read 2
+        uint64_t fileIdx;
+        uint64_t records;
+        uint64_t offset;
+        uint64_t records2;
+        uint64_t offset2;
+        // state of the read routine: processed batches, match statistics and the strand decision
+        uint64_t batches;
+        uint64_t succMatch;
+        uint64_t nonUniqueMatch;
+        uint64_t unSuccMatch;
+        uint64_t succPairedMatch;
+        uint64_t tooShortCount;
+        uint64_t r1FwdMatches;
+        uint64_t r1RevMatches;
+        uint32_t matchR1Fwd;
+        uint32_t padding;
+    };
+
+} // end namespace CHECKPOINT
+
+
 
 #endif /* STRUCTS_H */
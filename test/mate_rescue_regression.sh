@@ -0,0 +1,42 @@
+#! /bin/bash
+
+# Checks that --mate_rescue never loses a pair: every pair that a run without
+# mate rescue aligns must be aligned at the same positions with mate rescue.
+# Rescue may align additional pairs, their number is reported.
+#
+# usage: test/mate_rescue_regression.sh <index> <reads_1.fq> <reads_2.fq>
+#
+# Run it from the FAME directory after make, extra FAME options can be given
+# in the environment variable FAME_OPTS (e.g. FAME_OPTS=--unord_reads).
+
+if [ $# -ne 3 ]; then
+	echo "usage: $0 <index> <reads_1.fq> <reads_2.fq>"
+	exit 2
+fi
+
+out=$(mktemp -d)
+trap 'rm -rf "$out"' EXIT
+
+run () {
+	./FAME --load_index "$1" -r1 "$2" -r2 "$3" --paired $FAME_OPTS -o "$out/$4" \
+		--align_out "$out/$4.sam" "${@:5}" > "$out/$4.log" 2>&1 || {
+		echo "FAME $4 run failed, see its log:"
+		cat "$out/$4.log"
+		exit 1
+	}
+	# name, flag, chromosome and position of the aligned mates (flag 0x4 unset)
+	grep -v "^@" "$out/$4.sam" | awk 'int($2 / 4) % 2 == 0 { print $1 "\t" $2 "\t" $3 "\t" $4 }' \
+		| sort > "$out/$4.aligned"
+}
+
+run "$1" "$2" "$3" default
+run "$1" "$2" "$3" rescue --mate_rescue
+
+lost=$(comm -23 "$out/default.aligned" "$out/rescue.aligned" | wc -l)
+gained=$(comm -13 "$out/default.aligned" "$out/rescue.aligned" | wc -l)
+echo "aligned mates: $(wc -l < "$out/default.aligned") default, $(wc -l < "$out/rescue.aligned") with mate rescue"
+echo "lost by mate rescue: $lost, gained or moved: $gained"
+if [ "$lost" -ne 0 ]; then
+	comm -23 "$out/default.aligned" "$out/rescue.aligned" | head -20
+	exit 1
+fi
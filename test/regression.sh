@@ -0,0 +1,70 @@
+#! /bin/bash
+
+# End to end checks of FAME on simulated reads, see the scripts called below.
+#
+# usage: test/regression.sh [<genome.fa>]
+#
+# Run it from the FAME directory after make and make -C Synth. Without a
+# genome a chromosome of 2 Mbp with segmental duplications is generated, the
+# duplications give reads with several matches.
+
+out=$(mktemp -d)
+trap 'rm -rf "$out"' EXIT
+
+genome=$1
+if [ -z "$genome" ]; then
+	genome="$out/genome.fa"
+	awk 'BEGIN {
+		srand(5)
+		split("A C G T", base, " ")
+		print ">chr1"
+		seq = ""
+		while (len < 2000000) {
+			n = 200 + int(rand() * 2800)
+			if (segs > 0 && rand() < 0.2) {
+				# mutated copy of an earlier segment
+				s = seg[1 + int(rand() * segs)]
+				c = ""
+				for (i = 1; i <= length(s); ++i)
+					c = c (rand() < 0.01 ? base[1 + int(rand() * 4)] : substr(s, i, 1))
+			} else {
+				c = ""
+				for (i = 0; i < n; ++i)
+					c = c base[1 + int(rand() * 4)]
+				seg[++segs] = c
+			}
+			seq = seq c
+			len += length(c)
+			while (length(seq) >= 80) {
+				print substr(seq, 1, 80)
+				seq = substr(seq, 81)
+			}
+		}
+		if (length(seq) > 0)
+			print seq
+	}' > "$genome"
+fi
+
+./FAME --genome "$genome" --store_index "$out/index" > "$out/index.log" 2>&1 || {
+	echo "building the index failed, see its log:"
+	cat "$out/index.log"
+	exit 1
+}
+./Synth/SimReads --genome "$genome" --out_basename "$out/reads" --reads 30000 --seed 1 > /dev/null 2>&1 &&
+./Synth/SimReads --genome "$genome" --out_basename "$out/pairs" --reads 30000 --paired > /dev/null 2>&1 || {
+	echo "simulating the reads failed"
+	exit 1
+}
+
+status=0
+check () {
+	echo "== $* $FAME_OPTS"
+	"$@" || status=1
+}
+
+check test/table_order_regression.sh
+check test/tiered_regression.sh "$out/index" "$out/reads.fq"
+check test/tiered_regression.sh "$out/index" "$out/pairs_1.fq" "$out/pairs_2.fq"
+check test/mate_rescue_regression.sh "$out/index" "$out/pairs_1.fq" "$out/pairs_2.fq"
+FAME_OPTS=--unord_reads check test/mate_rescue_regression.sh "$out/index" "$out/pairs_1.fq" "$out/pairs_2.fq"
+exit $status
@@ -0,0 +1,65 @@
+#! /bin/bash
+
+# Checks the order of the methylation table on a genome with CpGs next to the
+# chromosome starts: the table must be sorted by chromosome and printed
+# position, the bgzip output must get its tabix index and merging the binary
+# output must give the same table.
+#
+# usage: test/table_order_regression.sh
+#
+# Run it from the FAME directory after make and make -C Synth.
+
+out=$(mktemp -d)
+trap 'rm -rf "$out"' EXIT
+
+# two chromosomes with a CpG at the first position in the table (READLEN - 3)
+awk 'BEGIN {
+	srand(3)
+	split("A C G T", base, " ")
+	for (c = 1; c <= 2; ++c) {
+		print ">chr" c
+		s = ""
+		for (i = 0; i < 20000; ++i)
+			s = s (i == 97 ? "C" : i == 98 ? "G" : base[1 + int(rand() * 4)])
+		for (i = 1; i <= length(s); i += 80)
+			print substr(s, i, 80)
+	}
+}' > "$out/genome.fa"
+
+fame () {
+	./FAME "$@" > "$out/log" 2>&1 || {
+		echo "FAME $* failed, see its log:"
+		cat "$out/log"
+		exit 1
+	}
+}
+
+fame --genome "$out/genome.fa" --store_index "$out/index"
+./Synth/SimReads --genome "$out/genome.fa" --out_basename "$out/reads" --reads 2000 > /dev/null 2>&1 || {
+	echo "simulating the reads failed"
+	exit 1
+}
+fame --load_index "$out/index" -r "$out/reads.fq" -o "$out/tsv"
+fame --load_index "$out/index" -r "$out/reads.fq" -o "$out/bgzip" --out_format bgzip
+fame --load_index "$out/index" -r "$out/reads.fq" -o "$out/binary" --out_format binary
+fame --load_index "$out/index" --merge "$out/binary_cpg.bin" -o "$out/merged"
+
+status=0
+if ! awk '$1 != chr { if ($1 in seen) exit 1; seen[$1] = 1; chr = $1; pos = -1 } $2 < pos { exit 1 } { pos = $2 }' "$out/tsv_cpg.tsv"; then
+	echo "FAILED: the table is not sorted by chromosome and position"
+	status=1
+fi
+if [ "$(awk '$2 == 97' "$out/tsv_cpg.tsv" | wc -l)" -ne 2 ]; then
+	echo "FAILED: the CpGs at position 97 are missing"
+	status=1
+fi
+if [ ! -e "$out/bgzip_cpg.tsv.gz.tbi" ]; then
+	echo "FAILED: no tabix index for the bgzip output"
+	status=1
+fi
+if ! cmp -s "$out/tsv_cpg.tsv" "$out/merged_cpg.tsv"; then
+	echo "FAILED: the merged table differs from the direct one"
+	status=1
+fi
+[ $status -eq 0 ] && echo "table order ok"
+exit $status
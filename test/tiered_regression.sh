@@ -0,0 +1,50 @@
+#! /bin/bash
+
+# Checks that --tiered_errors only changes the speed of the matching: the CpG
+# counts and the alignments must be byte identical to a run with the full
+# error budget.
+#
+# usage: test/tiered_regression.sh <index> <reads.fq>
+#        test/tiered_regression.sh <index> <reads_1.fq> <reads_2.fq>
+#
+# Run it from the FAME directory after make, extra FAME options can be given
+# in the environment variable FAME_OPTS (e.g. FAME_OPTS=--unord_reads).
+
+if [ $# -ne 2 ] && [ $# -ne 3 ]; then
+	echo "usage: $0 <index> <reads.fq> [<reads_2.fq>]"
+	exit 2
+fi
+
+index=$1
+if [ $# -eq 2 ]; then
+	reads="-r $2"
+else
+	reads="-r1 $2 -r2 $3 --paired"
+fi
+
+out=$(mktemp -d)
+trap 'rm -rf "$out"' EXIT
+
+run () {
+	./FAME --load_index "$index" $reads $FAME_OPTS -o "$out/$1" \
+		--align_out "$out/$1.sam" "${@:2}" > "$out/$1.log" 2>&1 || {
+		echo "FAME $1 run failed, see its log:"
+		cat "$out/$1.log"
+		exit 1
+	}
+}
+
+run default
+run tiered --tiered_errors
+
+status=0
+for f in _cpg.tsv .sam; do
+	if cmp -s "$out/default$f" "$out/tiered$f"; then
+		echo "identical: *$f"
+	else
+		echo "DIFFERENT: *$f"
+		diff "$out/default$f" "$out/tiered$f" | head -20
+		status=1
+	fi
+done
+exit $status